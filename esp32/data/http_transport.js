@@ -7,6 +7,15 @@ class HTTPTransport {
         this.serverUrl = null;
         this.deviceName = null;
         this.onDisconnect = null;
+        this.compress = true;
+        // Registry ID of the bridge printer to use, first printer when null
+        this.printer = null;
+        // Jobs go back to back over one WebSocket instead of a TCP
+        // connection per POST; the bridge closes HTTP connections after
+        // every answer
+        this.persistent = true;
+        this.channel = null;
+        this.jobEvents = null;
     }
 
     isConnected() {
@@ -35,6 +44,7 @@ class HTTPTransport {
         // Ensure no trailing slash
         this.serverUrl = serverUrl.replace(/\/$/, '');
         this.deviceName = options.deviceName || 'ESP32 Printer';
+        this.printer = options.printer || null;
 
         // Test connection by fetching /status
         try {
@@ -58,6 +68,14 @@ class HTTPTransport {
     }
 
     async disconnect() {
+        if (this.channel) {
+            this.channel.shutdown();
+            this.channel = null;
+        }
+        if (this.jobEvents) {
+            this.jobEvents.close();
+            this.jobEvents = null;
+        }
         this.serverUrl = null;
         this.deviceName = null;
         if (this.onDisconnect) {
@@ -81,12 +99,47 @@ class HTTPTransport {
             throw new Error('Unsupported data type for HTTP write');
         }
 
+        if (this.persistent && typeof WebSocket !== 'undefined') {
+            if (!this.channel) {
+                this.channel = new WebSocketPrintStream(this.serverUrl.replace(/^http/, 'ws') + '/ws/print',
+                                                        this.printer, 4096, true);
+            }
+            let started = false;
+            try {
+                await this.channel.open();
+                started = true;
+                await this.channel.write(new Uint8Array(buffer));
+                const ended = await this.channel.close();
+                console.log('Print job queued:', ended);
+                await this.waitForJob(ended.id);
+                return;
+            } catch (error) {
+                // Without a socket, fall back to a POST; a job the bridge
+                // refused or lost stays an error
+                if (started || this.channel.isOpen()) {
+                    if (started) this.channel.abort();
+                    throw error;
+                }
+                console.warn('WebSocket printing unavailable, using POST:', error.message);
+                this.persistent = false;
+                this.channel = null;
+            }
+        }
+
+        // Raster jobs are mostly runs of zeros; deflate them when the browser
+        // can, the bridge decodes on the fly
+        const headers = { 'Content-Type': 'application/octet-stream' };
+        if (this.compress && typeof CompressionStream !== 'undefined') {
+            const compressed = new Blob([buffer]).stream().pipeThrough(new CompressionStream('deflate'));
+            buffer = await new Response(compressed).arrayBuffer();
+            headers['Content-Encoding'] = 'deflate';
+        }
+
         // POST binary data to /print endpoint
-        const response = await fetch(`${this.serverUrl}/print`, {
+        const query = this.printer ? `?printer=${encodeURIComponent(this.printer)}` : '';
+        const response = await fetch(`${this.serverUrl}/print${query}`, {
             method: 'POST',
-            headers: {
-                'Content-Type': 'application/octet-stream',
-            },
+            headers: headers,
             body: buffer,
             mode: 'cors',
             cache: 'no-cache'
@@ -94,7 +147,17 @@ class HTTPTransport {
 
         if (!response.ok) {
             const text = await response.text();
-            throw new Error(`Print request failed: ${response.status} ${response.statusText} - ${text}`);
+            const retryAfter = response.headers.get('Retry-After');
+            const retryHint = retryAfter ? ` (retry after ${retryAfter} s)` : '';
+            throw new Error(`Print request failed: ${response.status} ${response.statusText} - ${text}${retryHint}`);
+        }
+
+        // The bridge queues the job and answers 202 with its ID
+        if (response.status === 202) {
+            const job = await response.json();
+            console.log('Print job queued:', job);
+            await this.waitForJob(job.id);
+            return;
         }
 
         // Optionally read response text
@@ -103,4 +166,234 @@ class HTTPTransport {
             console.log('Server response:', responseText);
         }
     }
-}
\ No newline at end of file
+
+    // Open a WebSocket print job that can be fed incrementally, e.g. page by
+    // page while later pages are still being rendered.
+    async openStream() {
+        if (!this.isConnected()) throw new Error("Not connected");
+
+        const stream = new WebSocketPrintStream(this.serverUrl.replace(/^http/, 'ws') + '/ws/print', this.printer);
+        await stream.open();
+        return stream;
+    }
+
+    // Resolves once the job printed. Follows /events when the browser has
+    // EventSource, so waiting costs no request per poll.
+    async waitForJob(id, pollInterval = 250) {
+        if (typeof EventSource !== 'undefined') {
+            if (!this.jobEvents) {
+                this.jobEvents = new JobEvents(`${this.serverUrl}/events`);
+            }
+            try {
+                return await this.jobEvents.wait(id);
+            } catch (error) {
+                if (error.jobFailed) throw error;
+                this.jobEvents.close();
+                this.jobEvents = null;
+            }
+        }
+        for (;;) {
+            const response = await fetch(`${this.serverUrl}/jobs/${id}`, {
+                method: 'GET',
+                headers: { 'Accept': 'application/json' },
+                mode: 'cors',
+                cache: 'no-cache'
+            });
+            if (!response.ok) {
+                throw new Error(`Job status request failed: ${response.status} ${response.statusText}`);
+            }
+
+            const job = await response.json();
+            if (job.status === 'done') {
+                return job;
+            }
+            if (job.status === 'failed') {
+                throw new Error(`Print job ${id} failed after ${job.sent} of ${job.total} bytes`);
+            }
+            await new Promise(resolve => setTimeout(resolve, pollInterval));
+        }
+    }
+}
+
+/**
+ * Final job states from the bridge's /events stream. A job may finish
+ * before anyone waits for it, so the last states are kept.
+ */
+class JobEvents {
+    constructor(url) {
+        this.states = new Map();
+        this.waiters = new Map();
+        this.source = new EventSource(url);
+        this.source.addEventListener('job', (event) => {
+            const job = JSON.parse(event.data);
+            if (job.status !== 'done' && job.status !== 'failed') return;
+            this.states.set(job.id, job);
+            if (this.states.size > 64) {
+                this.states.delete(this.states.keys().next().value);
+            }
+            const waiter = this.waiters.get(job.id);
+            if (waiter) {
+                this.waiters.delete(job.id);
+                this.settle(job, waiter);
+            }
+        });
+        this.source.onerror = () => {
+            // Waiters fall back to polling; EventSource reconnects by itself
+            const waiters = this.waiters;
+            this.waiters = new Map();
+            waiters.forEach(waiter => waiter.reject(new Error('Event stream lost')));
+        };
+    }
+
+    settle(job, waiter) {
+        if (job.status === 'done') {
+            waiter.resolve(job);
+        } else {
+            const error = new Error(`Print job ${job.id} failed after ${job.sent} of ${job.total} bytes`);
+            error.jobFailed = true;
+            waiter.reject(error);
+        }
+    }
+
+    wait(id) {
+        return new Promise((resolve, reject) => {
+            const job = this.states.get(id);
+            if (job) {
+                this.settle(job, { resolve, reject });
+            } else {
+                this.waiters.set(id, { resolve, reject });
+            }
+        });
+    }
+
+    close() {
+        this.source.close();
+    }
+}
+
+/**
+ * Credit-based WebSocket print job. The bridge grants credits as absolute
+ * byte offsets; write() never sends past the latest one, so the ESP32 never
+ * has to buffer more than its job buffer holds. With keepOpen the socket
+ * stays up after close() and the next open() starts another job on it.
+ */
+class WebSocketPrintStream {
+    constructor(url, printer = null, frameSize = 4096, keepOpen = false) {
+        this.url = url;
+        this.printer = printer;
+        this.frameSize = frameSize;
+        this.keepOpen = keepOpen;
+        this.socket = null;
+        this.jobId = null;
+        this.sent = 0;
+        this.credit = 0;
+        this.error = null;
+        this.ended = null;
+        this.waiters = [];
+    }
+
+    isOpen() {
+        return !!this.socket && this.socket.readyState === WebSocket.OPEN;
+    }
+
+    connect() {
+        if (this.isOpen()) return Promise.resolve();
+        return new Promise((resolve, reject) => {
+            const socket = new WebSocket(this.url);
+            socket.binaryType = 'arraybuffer';
+            socket.onopen = () => resolve();
+            socket.onerror = () => reject(new Error('WebSocket connection failed'));
+            socket.onclose = () => {
+                // A socket shut down on purpose has already been replaced
+                if (this.socket !== socket) return;
+                this.socket = null;
+                if (!this.error) this.error = new Error('WebSocket closed');
+                this.wake();
+            };
+            socket.onmessage = (event) => {
+                const message = JSON.parse(event.data);
+                if (message.type === 'job') {
+                    this.jobId = message.id;
+                    this.credit = message.credit;
+                } else if (message.type === 'credit') {
+                    this.credit = Math.max(this.credit, message.credit);
+                } else if (message.type === 'error') {
+                    const retryHint = message.retryAfter ? ` (retry after ${message.retryAfter} s)` : '';
+                    this.error = new Error(`Print stream failed: ${message.message}${retryHint}`);
+                } else if (message.type === 'end') {
+                    this.ended = message;
+                }
+                this.wake();
+            };
+            this.socket = socket;
+        });
+    }
+
+    // Start a job, connecting first if the socket isn't up
+    async open() {
+        await this.connect();
+        this.jobId = null;
+        this.sent = 0;
+        this.credit = 0;
+        this.error = null;
+        this.ended = null;
+        this.socket.send(this.printer ? `start ${this.printer}` : 'start');
+        while (this.jobId === null && !this.error) {
+            await this.waitForMessage();
+        }
+        if (this.error) throw this.error;
+    }
+
+    wake() {
+        const waiters = this.waiters;
+        this.waiters = [];
+        waiters.forEach(resolve => resolve());
+    }
+
+    waitForMessage() {
+        return new Promise(resolve => this.waiters.push(resolve));
+    }
+
+    async write(data) {
+        const bytes = data instanceof Uint8Array ? data : new Uint8Array(data);
+        let offset = 0;
+        while (offset < bytes.length) {
+            if (this.error) throw this.error;
+            const allowed = Math.min(this.credit - this.sent, this.frameSize, bytes.length - offset);
+            if (allowed <= 0) {
+                await this.waitForMessage();
+                continue;
+            }
+            this.socket.send(bytes.subarray(offset, offset + allowed));
+            offset += allowed;
+            this.sent += allowed;
+        }
+    }
+
+    // Finish the job and wait until the bridge has taken all of it
+    async close() {
+        if (this.error) throw this.error;
+        this.socket.send('end');
+        while (!this.ended && !this.error) {
+            await this.waitForMessage();
+        }
+        const ended = this.ended;
+        if (!this.keepOpen) this.shutdown();
+        if (!ended) throw this.error;
+        return ended;
+    }
+
+    abort() {
+        if (this.isOpen()) {
+            this.socket.send('abort');
+            if (!this.keepOpen) this.shutdown();
+        }
+    }
+
+    shutdown() {
+        if (this.socket) {
+            this.socket.close();
+            this.socket = null;
+        }
+    }
+}
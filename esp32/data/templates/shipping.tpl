@@ -0,0 +1,6 @@
+# 50 x 30 mm shipping label at 203 dpi (8 dots/mm)
+size 400 240
+text 16 12 name font=4
+text 16 52 address font=2 size=2
+barcode 16 100 sku height=90 module=2
+text 200 200 sku font=2 align=center
@@ -0,0 +1,102 @@
+// C interface to printer_encoder.h for the host tools and the web UI.
+//
+// The firmware includes the header directly; everything else links this
+// file, built either as a native library:
+//
+//   g++ -O3 -march=native -shared -fPIC -Iinclude encoder/encoder_api.cpp -o libprinter_encoder.so
+//
+// or as WebAssembly for the web UI, with SIMD for the packing loops:
+//
+//   emcc -O3 -msimd128 -Iinclude encoder/encoder_api.cpp -o ../web/printer_encoder.js
+//        -sMODULARIZE -sEXPORT_NAME=PrinterEncoder -sALLOW_MEMORY_GROWTH
+//        -sEXPORTED_RUNTIME_METHODS=HEAPU8
+//
+// (one command line).
+//
+// Run both from esp32/. The functions take and fill caller buffers; from
+// JavaScript they come from penc_alloc() and are reached through HEAPU8.
+// Bitmaps are packed rows, MSB first, 1 for black, (width + 7) / 8 bytes a
+// row. Sizes are in bytes, 0 for a failure.
+
+#include <stdlib.h>
+#include "printer_encoder.h"
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#define PENC_API extern "C" EMSCRIPTEN_KEEPALIVE
+#else
+#define PENC_API extern "C" __attribute__((visibility("default")))
+#endif
+
+PENC_API void* penc_alloc(size_t bytes) {
+  return malloc(bytes);
+}
+
+PENC_API void penc_free(void* p) {
+  free(p);
+}
+
+// One byte a pixel, non-zero for black, into a packed bitmap
+PENC_API size_t penc_pack(const uint8_t* pixels, uint16_t width, uint16_t height, int invert, uint8_t* out) {
+  const size_t rowBytes = encodeRowBytes(width);
+  for (uint16_t y = 0; y < height; y++) {
+    encodePackRow(pixels + (size_t)y * width, width, out + y * rowBytes, invert != 0);
+  }
+  return rowBytes * height;
+}
+
+// Gray (0 black .. 255 white) into a packed bitmap; mode is an EncodeDither
+PENC_API size_t penc_dither(const uint8_t* gray, uint16_t width, uint16_t height, int mode, uint8_t threshold,
+                            uint8_t* out) {
+  if (mode < ENCODE_THRESHOLD || mode > ENCODE_FLOYD_STEINBERG) {
+    return 0;
+  }
+  const size_t rowBytes = encodeRowBytes(width);
+  EncodeErrorRows rows = {nullptr, nullptr};
+  if (mode == ENCODE_ATKINSON || mode == ENCODE_FLOYD_STEINBERG) {
+    rows.errors = (int16_t*)calloc(1, encodeErrorRowBytes(width));
+    rows.next = (int16_t*)calloc(1, encodeErrorRowBytes(width));
+    if (rows.errors == nullptr || rows.next == nullptr) {
+      free(rows.errors);
+      free(rows.next);
+      return 0;
+    }
+  }
+  for (uint16_t y = 0; y < height; y++) {
+    encodeDitherRow((EncodeDither)mode, gray + (size_t)y * width, width, threshold, y, &rows,
+                    out + y * rowBytes);
+  }
+  free(rows.errors);
+  free(rows.next);
+  return rowBytes * height;
+}
+
+PENC_API void penc_invert(uint8_t* bitmap, uint16_t width, uint16_t height) {
+  encodeInvertBitmap(bitmap, width, height);
+}
+
+// Clockwise by quarters; out holds encodeRowBytes(height) * width bytes for
+// an odd number of them
+PENC_API size_t penc_rotate(const uint8_t* bitmap, uint16_t width, uint16_t height, int quarters, uint8_t* out) {
+  encodeRotate(bitmap, width, height, (uint8_t)quarters, out);
+  return (quarters & 1) ? encodeRowBytes(height) * width : encodeRowBytes(width) * height;
+}
+
+PENC_API size_t penc_escpos_job_size(uint16_t width, uint16_t height) {
+  return encodeEscPosJobSize(width, height);
+}
+
+PENC_API size_t penc_escpos_job(const uint8_t* bitmap, uint16_t width, uint16_t height, int mode, uint8_t* out) {
+  return encodeEscPosJob(bitmap, width, height, (uint8_t)mode, out);
+}
+
+PENC_API size_t penc_tspl_label_max_size(uint16_t width, uint16_t height) {
+  return encodeTsplLabelMaxSize(width, height);
+}
+
+PENC_API size_t penc_tspl_label(const uint8_t* bitmap, uint16_t width, uint16_t height, uint16_t widthMm,
+                                uint16_t heightMm, int speed, int density, uint16_t marginX, uint16_t marginY,
+                                int invert, uint8_t* out) {
+  EncodeTsplLabel label = {widthMm, heightMm, (uint8_t)speed, (uint8_t)density, marginX, marginY};
+  return encodeTsplLabel(bitmap, width, height, label, invert != 0, out);
+}
@@ -0,0 +1,223 @@
+// Fake BLE printer for load tests of the bridge (env:fake-printer).
+//
+// Advertises the service and characteristic of private_config.ini and takes
+// writes with and without response like a printer would. Received bytes go
+// into an input buffer of FAKE_BUFFER_SIZE that a simulated print head
+// drains at FAKE_HEAD_BYTES_PER_SEC. A status characteristic in the same
+// service notifies XOFF when the buffer reaches FAKE_XOFF_LEVEL and XON once
+// it is down to FAKE_XON_LEVEL, and answers GS r 1 when the head gets to it,
+// so the bridge's flow control and idle detection run as against a real
+// printer. Bytes that arrive while the buffer is full are dropped and
+// counted. Every second the serial log has the receive rate, buffer fill
+// and drops.
+//
+// Enter the address logged at boot in the bridge's printers.conf.
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLE2902.h>
+
+#ifndef FAKE_PRINTER_NAME
+#define FAKE_PRINTER_NAME "FakePrinter"
+#endif
+#ifndef FAKE_NOTIFY_UUID
+#define FAKE_NOTIFY_UUID "49535343-1e4d-4bd9-ba61-23c647249616"  // ISSC transparent UART TX
+#endif
+#ifndef FAKE_BUFFER_SIZE
+#define FAKE_BUFFER_SIZE 4096               // Printer input buffer, bytes
+#endif
+#ifndef FAKE_HEAD_BYTES_PER_SEC
+#define FAKE_HEAD_BYTES_PER_SEC 6000        // 48 mm/s of 384-dot raster rows at 8 dots/mm
+#endif
+#ifndef FAKE_XOFF_LEVEL
+#define FAKE_XOFF_LEVEL (FAKE_BUFFER_SIZE * 3 / 4)
+#endif
+#ifndef FAKE_XON_LEVEL
+#define FAKE_XON_LEVEL (FAKE_BUFFER_SIZE / 4)
+#endif
+#ifndef FAKE_FLOW_CONTROL
+#define FAKE_FLOW_CONTROL 1                 // 0: never send XOFF, to see what the bridge overruns
+#endif
+#ifndef FAKE_HEAD_TICK_MS
+#define FAKE_HEAD_TICK_MS 10
+#endif
+#ifndef FAKE_REPORT_MS
+#define FAKE_REPORT_MS 1000
+#endif
+
+const uint8_t ASCII_XON = 0x11;
+const uint8_t ASCII_XOFF = 0x13;
+
+static BLECharacteristic* statusCharacteristic = nullptr;
+static bool connected = false;
+
+// Filled by the BLE stack's onWrite, drained by the head task
+static portMUX_TYPE bufferLock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t buffer[FAKE_BUFFER_SIZE];
+static size_t head = 0;                     // Next byte the print head takes
+static size_t fill = 0;
+
+// Counters since boot, read by the report under bufferLock
+static uint32_t received = 0;
+static uint32_t dropped = 0;
+static uint32_t writes = 0;
+static uint32_t printed = 0;
+static uint32_t xoffSent = 0;
+static size_t peakFill = 0;
+
+static void notifyStatus(uint8_t value) {
+  if (!connected) {
+    return;
+  }
+  statusCharacteristic->setValue(&value, 1);
+  statusCharacteristic->notify();
+}
+
+class PrintCallbacks : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic* characteristic) override {
+    auto value = characteristic->getValue();  // std::string or String, by core version
+    const char* data = value.c_str();
+    size_t length = value.length();
+    size_t taken;
+    portENTER_CRITICAL(&bufferLock);
+    taken = min(length, FAKE_BUFFER_SIZE - fill);
+    size_t tail = (head + fill) % FAKE_BUFFER_SIZE;
+    size_t first = min(taken, FAKE_BUFFER_SIZE - tail);
+    memcpy(buffer + tail, data, first);
+    memcpy(buffer, data + first, taken - first);
+    fill += taken;
+    peakFill = max(peakFill, fill);
+    received += length;
+    dropped += length - taken;
+    writes++;
+    portEXIT_CRITICAL(&bufferLock);
+  }
+};
+
+class ServerCallbacks : public BLEServerCallbacks {
+  void onConnect(BLEServer* server) override {
+    connected = true;
+    log_i("Bridge connected");
+  }
+
+  void onDisconnect(BLEServer* server) override {
+    connected = false;
+    log_i("Bridge disconnected, advertising again");
+    BLEDevice::startAdvertising();
+  }
+};
+
+// Takes from the buffer at head speed. XON/XOFF is decided here against the
+// fill level, and GS r 1 is answered in the order it was received.
+static void headTask(void* param) {
+  uint8_t command[3] = {0};                 // The last bytes printed
+  uint8_t taken[256];
+  uint32_t budget = 0;                      // Head bytes times 1000 not printed yet
+  bool paused = false;
+  TickType_t wake = xTaskGetTickCount();
+  while (true) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(FAKE_HEAD_TICK_MS));
+    budget += FAKE_HEAD_BYTES_PER_SEC * FAKE_HEAD_TICK_MS;
+
+    size_t level;
+    size_t count;
+    do {
+      portENTER_CRITICAL(&bufferLock);
+      count = min<size_t>(min<size_t>(budget / 1000, sizeof(taken)), fill);
+      for (size_t i = 0; i < count; i++) {
+        taken[i] = buffer[head];
+        head = (head + 1) % FAKE_BUFFER_SIZE;
+      }
+      fill -= count;
+      printed += count;
+      level = fill;
+      portEXIT_CRITICAL(&bufferLock);
+      budget -= count * 1000;
+
+      for (size_t i = 0; i < count; i++) {
+        command[0] = command[1];
+        command[1] = command[2];
+        command[2] = taken[i];
+        if (command[0] == 0x1D && command[1] == 0x72 && command[2] == 0x01) {
+          notifyStatus(0x00);               // Paper present
+        }
+      }
+    } while (count == sizeof(taken));
+    // An idle head doesn't save up speed
+    if (level == 0) {
+      budget = min<uint32_t>(budget, FAKE_HEAD_BYTES_PER_SEC * FAKE_HEAD_TICK_MS);
+    }
+
+#if FAKE_FLOW_CONTROL
+    if (!paused && level >= FAKE_XOFF_LEVEL) {
+      paused = true;
+      xoffSent++;
+      notifyStatus(ASCII_XOFF);
+    } else if (paused && level <= FAKE_XON_LEVEL) {
+      paused = false;
+      notifyStatus(ASCII_XON);
+    }
+    if (!connected) {
+      paused = false;
+    }
+#endif
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+
+  BLEDevice::init(FAKE_PRINTER_NAME);
+  BLEDevice::setMTU(517);
+  BLEServer* server = BLEDevice::createServer();
+  server->setCallbacks(new ServerCallbacks());
+
+  BLEService* service = server->createService(PRINTER_SERVICEUUID);
+  BLECharacteristic* print = service->createCharacteristic(
+      PRINTER_CHARACTERISTICUUID, BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_WRITE_NR);
+  print->setCallbacks(new PrintCallbacks());
+  statusCharacteristic = service->createCharacteristic(FAKE_NOTIFY_UUID, BLECharacteristic::PROPERTY_NOTIFY);
+  statusCharacteristic->addDescriptor(new BLE2902());
+  service->start();
+
+  BLEAdvertising* advertising = BLEDevice::getAdvertising();
+  advertising->addServiceUUID(PRINTER_SERVICEUUID);
+  advertising->setScanResponse(true);
+  BLEDevice::startAdvertising();
+
+  log_i("%s at %s: %u byte buffer, %u bytes/s head, XOFF at %u, XON at %u", FAKE_PRINTER_NAME,
+        BLEDevice::getAddress().toString().c_str(), FAKE_BUFFER_SIZE, FAKE_HEAD_BYTES_PER_SEC, FAKE_XOFF_LEVEL,
+        FAKE_XON_LEVEL);
+
+  xTaskCreate(headTask, "head", 4096, nullptr, 2, nullptr);
+}
+
+void loop() {
+  static uint32_t lastReceived = 0;
+  static uint32_t lastPrinted = 0;
+  static uint32_t lastReport = millis();
+
+  delay(FAKE_REPORT_MS);
+  uint32_t now = millis();
+  portENTER_CRITICAL(&bufferLock);
+  uint32_t rx = received;
+  uint32_t out = printed;
+  uint32_t lost = dropped;
+  uint32_t count = writes;
+  size_t level = fill;
+  size_t peak = peakFill;
+  peakFill = fill;
+  portEXIT_CRITICAL(&bufferLock);
+
+  uint32_t elapsed = max<uint32_t>(1, now - lastReport);
+  if (rx != lastReceived || out != lastPrinted) {
+    log_i("rx %u B/s, printed %u B/s, buffer %u/%u (peak %u), %u writes, %u bytes dropped, %u XOFF",
+          (uint32_t)((uint64_t)(rx - lastReceived) * 1000 / elapsed),
+          (uint32_t)((uint64_t)(out - lastPrinted) * 1000 / elapsed), level, FAKE_BUFFER_SIZE, peak, count, lost,
+          xoffSent);
+  }
+  lastReceived = rx;
+  lastPrinted = out;
+  lastReport = now;
+}
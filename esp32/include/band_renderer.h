@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+// Screen composed band by band in two small sprites in internal RAM instead
+// of one sprite of the whole panel. Each band is cleared, drawn by a
+// callback in panel coordinates, the sprite clipping to the band, and
+// pushed as one window write. Where the library has DMA, a band is sent
+// while the next one is drawn into the other sprite. Nothing is drawn on
+// the panel directly, so updates don't flicker; 320 pixel wide bands of 20
+// rows take 25 KB.
+
+#ifndef BAND_ROWS
+#define BAND_ROWS 20
+#endif
+
+// Draws the scene, or the part of it in the canvas' clip window
+typedef void (*BandDraw)(TFT_eSPI& canvas, void* context);
+
+class BandRenderer {
+public:
+  // After tft->init() and setRotation(); false without the memory
+  bool begin(TFT_eSPI* tft, int16_t rows = BAND_ROWS);
+  void end();
+  bool ready() const { return _bands[1] != nullptr; }
+  int16_t rows() const { return _rows; }
+
+  // Compose and push panel rows top to bottom (exclusive), on background;
+  // bottom < 0 is the panel height
+  void render(BandDraw draw, void* context, int16_t top = 0, int16_t bottom = -1,
+              uint16_t background = TFT_BLACK);
+
+private:
+  void pushBand(TFT_eSprite* band, int16_t y, int16_t rows);
+
+  TFT_eSPI* _tft = nullptr;
+  TFT_eSprite* _bands[2] = {};
+  uint8_t _next = 0;             // Band drawn next
+  int16_t _rows = 0;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+// Barcodes drawn on the bridge for label templates and thin clients.
+//
+// Symbols are drawn in ink (colour 1) with their top left corner at x, y.
+// In a 1-bit sprite at rotation 0 the bars go straight into the sprite's
+// buffer as byte spans; other sprites get fillRect per run of modules.
+// Sizes are in dots, so callers scale the module with barcodeDots() for the
+// head's resolution. Quiet zones are left to the layout.
+
+#ifndef BARCODE_MAX_LENGTH
+#define BARCODE_MAX_LENGTH 48    // Characters of a linear barcode
+#endif
+#ifndef BARCODE_MAX_2D_LENGTH
+#define BARCODE_MAX_2D_LENGTH 200  // Bytes of a QR code or Data Matrix
+#endif
+
+enum BarcodeType {
+  BARCODE_CODE128,
+  BARCODE_EAN13,
+  BARCODE_QR,
+  BARCODE_DATAMATRIX
+};
+
+// Type by name ("code128", "ean13", "qr", "datamatrix"); false for unknown names
+bool parseBarcodeType(const String& name, BarcodeType& type);
+
+// Dots for a length in mm at dpi, at least one
+uint16_t barcodeDots(float mm, uint16_t dpi);
+
+// Draw data as type. module is the narrowest bar or the side of a 2D
+// module; height only applies to linear barcodes. Returns false when the
+// data can't be encoded; width and height then stay untouched.
+bool drawBarcode(TFT_eSprite& sprite, BarcodeType type, int32_t x, int32_t y, const String& data,
+                 uint8_t module, uint16_t height, uint16_t* drawnWidth = nullptr, uint16_t* drawnHeight = nullptr);
+
+// Width in dots of data as Code 128 with the given module width; 0 when it
+// can't be encoded
+uint16_t code128Width(const String& data, uint8_t module);
+
+// Code 128. Digit runs use code set C, everything else set B (printable
+// ASCII). Returns the width drawn, 0 when the data can't be encoded.
+uint16_t drawCode128(TFT_eSprite& sprite, int32_t x, int32_t y, const String& data, uint8_t module, uint16_t height);
+
+// EAN-13 from 12 digits, or 13 with a correct check digit. The guard bars
+// reach five modules below height, where the digits usually go.
+uint16_t drawEan13(TFT_eSprite& sprite, int32_t x, int32_t y, const String& data, uint8_t module, uint16_t height);
+
+// QR code in byte mode, versions 1 to 10 at error correction level M.
+// Returns the side drawn, 0 when the data is too long.
+uint16_t drawQrCode(TFT_eSprite& sprite, int32_t x, int32_t y, const String& data, uint8_t module);
+
+// Square ECC 200 Data Matrix in ASCII encodation, 10x10 to 48x48 modules.
+// Returns the side drawn, 0 when the data is too long.
+uint16_t drawDataMatrix(TFT_eSprite& sprite, int32_t x, int32_t y, const String& data, uint8_t module);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Many labels in one upload, printed as one job.
+//
+// A /print/batch body is a run of labels, each a 4-byte big-endian length
+// followed by that many bytes of printer commands. The labels go into a
+// single print job back to back, so the printer is checked and the job
+// admitted once, and the next label is already buffered while the previous
+// one is written. Where each label ends in the job is recorded, and a label
+// is complete once the writer has sent past its end.
+
+#ifndef PRINT_BATCH_SLOTS
+#define PRINT_BATCH_SLOTS 2               // Batches tracked at once
+#endif
+#ifndef PRINT_BATCH_MAX_LABELS
+#define PRINT_BATCH_MAX_LABELS 1024       // Labels in one batch
+#endif
+
+enum PrintBatchError {
+  BATCH_OK,
+  BATCH_ERR_TOO_MANY,    // More than PRINT_BATCH_MAX_LABELS labels
+  BATCH_ERR_TRUNCATED,   // The body ended inside a label or its length
+  BATCH_ERR_OUTPUT,      // The job buffer didn't take the data
+  BATCH_ERR_NO_MEMORY    // No tracking slot
+};
+
+const char* printBatchErrorName(PrintBatchError error);
+
+// Create the lock of the batch table. Call once before the web server starts.
+bool initPrintBatches();
+
+// Splits one batch upload into its labels on their way into the job
+class PrintBatch {
+public:
+  PrintBatch() = default;
+
+  PrintBatch(const PrintBatch&) = delete;
+  PrintBatch& operator=(const PrintBatch&) = delete;
+
+  // Track the labels of an admitted job of unknown length
+  PrintBatchError begin(uint32_t jobId);
+
+  // Body data, in order. Blocks for at most timeoutMs per append while the
+  // job buffer is full.
+  PrintBatchError feed(const uint8_t* data, size_t length, uint32_t timeoutMs);
+
+  // The body is over; BATCH_ERR_TRUNCATED unless it ended between labels
+  PrintBatchError end();
+
+  PrintBatchError error() const { return _error; }
+  uint16_t labels() const { return _labels; }
+
+private:
+  int _slot = -1;
+  uint32_t _jobId = 0;
+  PrintBatchError _error = BATCH_OK;
+  uint16_t _labels = 0;
+  uint8_t _header[4];
+  uint8_t _headerLength = 0;
+  uint32_t _remaining = 0;   // Bytes of the current label still to come
+  uint32_t _offset = 0;      // Bytes appended to the job
+};
+
+// A label was printed, or failed with the rest of its job
+typedef void (*PrintBatchLabelCallback)(uint32_t jobId, uint16_t label, bool done);
+
+// Report labels completed since the last call, and release batches whose
+// job has ended. Call periodically from one task.
+void servicePrintBatches(PrintBatchLabelCallback callback);
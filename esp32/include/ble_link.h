@@ -0,0 +1,167 @@
+#pragma once
+
+#include <Arduino.h>
+
+// BLE host stack under the printer links: the scanner they share and one
+// client connection per printer, with connect, GATT discovery, writes by
+// handle and status notifications.
+//
+// Two implementations: Bluedroid through the Arduino BLE library and the
+// GAP/GATTC API (ble_link_bluedroid.cpp), and NimBLE-Arduino with its host
+// API (ble_link_nimble.cpp), chosen with -DBLE_TRANSPORT_NIMBLE=1. NimBLE
+// needs far less RAM than Bluedroid and writes without response straight
+// into the controller's buffers; the esp32-s3-nimble environment builds it
+// and hands the saved RAM to the print ring.
+//
+// Addresses are 6 bytes in the order they are written, AA first for
+// "AA:BB:CC:DD:EE:FF". Events come from the stack's task and reach the
+// owning BlePrinter through its on*() methods, which must not block.
+
+#ifndef BLE_TRANSPORT_NIMBLE
+#define BLE_TRANSPORT_NIMBLE 0
+#endif
+
+// Printers that stream over an L2CAP connection-oriented channel publish
+// its PSM in this readable characteristic of the print service, as a
+// 16-bit little-endian value. The UUID is the one iOS peripherals use.
+#ifndef BLE_L2CAP_PSM_UUID
+#define BLE_L2CAP_PSM_UUID "abdd3056-28fa-441d-a470-55a75a52553a"
+#endif
+// Largest SDU sent on the channel; the printer's MTU caps it further
+#ifndef BLE_L2CAP_SDU_MAX
+#define BLE_L2CAP_SDU_MAX 2048
+#endif
+
+// Characteristic properties, as in the GATT declaration and the NVS cache
+static const uint8_t BLE_PROP_WRITE_NR = 0x04;
+static const uint8_t BLE_PROP_WRITE = 0x08;
+static const uint8_t BLE_PROP_NOTIFY = 0x10;
+static const uint8_t BLE_PROP_INDICATE = 0x20;
+
+static const uint8_t BLE_PHY_1M = 1;
+static const uint8_t BLE_PHY_2M = 2;
+static const uint8_t BLE_PHY_CODED = 3;
+
+// Address types as the controller reports them; 2 and 3 are identities
+// resolved from a private address
+static const uint8_t BLE_ADDRESS_PUBLIC = 0;
+static const uint8_t BLE_ADDRESS_RANDOM = 1;
+
+// Scan hits and the end of a scan window, from the stack's task
+typedef void (*BleScanResult)(const uint8_t* address, uint8_t addressType, int rssi);
+typedef void (*BleScanDone)();
+
+struct BleScanSettings {
+  bool active;                 // Scan requests, or advertisements only
+  uint16_t intervalMs;
+  uint16_t windowMs;
+  const uint8_t (*accept)[6];  // Addresses the controller lets through, nullptr for all
+  size_t acceptCount;
+};
+
+// Bring up the stack and configure the scanner. Falls back to scanning for
+// all devices when the accept list doesn't fit the controller.
+bool bleStackInit(const char* deviceName, const BleScanSettings& settings, BleScanResult result, BleScanDone done);
+
+// One scan window, returning at once; done is called at its end but not
+// after bleStopScan()
+bool bleStartScan(uint32_t seconds);
+void bleStopScan();
+
+// Print characteristic and status characteristic of a printer
+struct BleGattHandles {
+  uint16_t tx;                 // Value handle writes go to
+  uint8_t txProperties;        // BLE_PROP_*
+  uint16_t notify;             // 0 without a status characteristic
+  uint16_t cccd;               // Its client characteristic configuration descriptor
+  uint8_t notifyProperties;
+  uint16_t psm;                // L2CAP PSM the printer published, 0 for none
+};
+
+// Link parameters asked for after connecting; the printer may refuse any
+struct BleLinkRequest {
+  uint16_t connIntervalMin;    // 1.25 ms units
+  uint16_t connIntervalMax;
+  uint16_t latency;
+  uint16_t supervisionTimeout; // 10 ms units
+  uint16_t eventLength;        // 0.625 ms units, 0 for the stack's; NimBLE only
+  uint16_t dataLength;         // TX octets for data length extension
+  uint8_t phy;                 // BLE_PHY_* to prefer
+};
+
+class BlePrinter;
+
+class BleLink {
+public:
+  BleLink() = default;
+
+  BleLink(const BleLink&) = delete;
+  BleLink& operator=(const BleLink&) = delete;
+
+  // Create the client, once; it is kept for every reconnect
+  bool begin(BlePrinter* owner);
+
+  // Connect and exchange the MTU; blocks the calling task
+  bool connect(const uint8_t* address, uint8_t addressType, uint16_t mtu);
+  void disconnect();
+  bool connected() const;
+  uint16_t mtu() const;
+
+  // Ask for the PHY, the data length and the connection parameters; the
+  // outcome arrives through onPhy(), onDataLength() and onConnParams()
+  void requestParameters(const BleLinkRequest& request);
+  // Only the connection parameters of the request, interval to event length
+  void requestConnParams(const BleLinkRequest& request);
+
+  // Service discovery for the print characteristic of the service, a
+  // notify or indicate characteristic next to it, and the device name
+  bool discover(const String& service, const String& characteristic, BleGattHandles& handles, String& name);
+
+  // Write a characteristic value by handle. With response the call waits
+  // for the printer's answer; a zero-length one proves a cached handle.
+  bool write(uint16_t handle, const uint8_t* data, size_t length, bool response);
+
+  // Turn on notifications, or indications, of the status characteristic
+  bool subscribe(const BleGattHandles& handles);
+
+  // L2CAP connection-oriented channel on the PSM, which streams print data
+  // under the printer's credits instead of in ATT writes. NimBLE only; the
+  // Bluedroid build never opens one. Blocks until the printer answers.
+  bool openChannel(uint16_t psm);
+  bool channelOpen() const { return _channel != nullptr; }
+  // SDU size the channel takes, at most BLE_L2CAP_SDU_MAX
+  uint16_t channelMtu() const { return _channelMtu; }
+  // One SDU made of two pieces, for data that straddles the ring end.
+  // Returns once the stack has taken it.
+  bool sendChannel(const uint8_t* first, size_t firstLength, const uint8_t* second, size_t secondLength);
+
+  // Free controller buffers for writes without response, -1 when the
+  // stack holds writes back by itself
+  int sendableBuffers() const;
+
+  // Read the connection's RSSI; the reading arrives through onRssi()
+  void requestRssi();
+
+  // Identifies the client in disconnect callbacks
+  const void* client() const { return _client; }
+
+  // UUID as the stack prints it, the form the NVS cache keeps
+  static String canonicalUuid(const String& uuid);
+
+private:
+  BlePrinter* _owner = nullptr;
+  void* _client = nullptr;        // The stack's client object
+  void* _characteristic = nullptr; // Bluedroid: the discovered print characteristic
+  uint16_t _txHandle = 0;         // Its handle
+  uint16_t _connHandle = 0;       // NimBLE: handle of the connection
+  SemaphoreHandle_t _writeDone = nullptr;
+  volatile int _writeStatus = 0;
+  volatile uint16_t _pendingWrite = 0;   // Handle of the write awaiting its response
+  void* volatile _channel = nullptr;      // NimBLE: the open L2CAP channel
+  uint16_t _channelMtu = 0;
+  SemaphoreHandle_t _channelEvent = nullptr;   // Channel connected, unstalled or gone
+  volatile bool _channelStalled = false;       // Out of credits, waiting for more
+
+  // Event handlers of the stack implementation
+  friend struct BleLinkStack;
+};
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ble_link.h"
+#include "print_writer.h"
+#include "print_pipeline.h"
+#include "raster_recoder.h"
+#include "raster_resample.h"
+#include "buffer_model.h"
+#include "link_metrics.h"
+#include "link_control.h"
+#include "tx_power.h"
+#include "conn_schedule.h"
+#include "printer_profile.h"
+#include "usb_printer.h"
+#include "spp_printer.h"
+
+// One BLE printer of the bridge: its link (ble_link.h), negotiated link
+// parameters, cached GATT handles and the link state machine task that keeps it
+// connected. The registry holds up to MAX_PRINTERS of them, each with its
+// own print writer channel, so several printers print at the same time.
+
+// Printer list on LittleFS, one printer per line:
+//   <id> <mac> [<service-uuid> <characteristic-uuid>] [pool=<name>]
+//        [dpi=<resolution>] [dots=<head width>]
+//        [buffer=<bytes>] [lines=<dot lines per second>] [psm=<L2CAP PSM>]
+// Lines starting with # are comments. Without the file the bridge drives a
+// single printer "default" from the PRINTER_* build flags. Printers sharing
+// a pool name are interchangeable; jobs sent to the pool go to the least
+// busy one. A printer with its dpi set gets the rasters of jobs made for
+// another resolution rescaled, and one with dots set gets wider rasters
+// cut to its head. A printer with buffer set and no notify characteristic
+// is paced by a model of that input buffer draining at lines dot lines per
+// second (see buffer_model.h), so it is never sent more than it can hold.
+// Print data streams over an L2CAP channel on the PSM given with psm=, or
+// the one the printer publishes (BLE_L2CAP_PSM_UUID); without either, or
+// when the channel can't be opened, it goes in GATT writes. One printer may
+// have "usb" in place of its MAC: it is the printer on the USB host port
+// (usb_printer.h), ready while plugged in. One may have "spp:" in front of
+// its MAC: it is a Classic Bluetooth printer on RFCOMM (spp_printer.h).
+#ifndef PRINTER_REGISTRY_PATH
+#define PRINTER_REGISTRY_PATH "/printers.conf"
+#endif
+
+// Head of the "default" printer, as dpi= and dots= in the list; 0 leaves
+// its jobs unscaled
+#ifndef PRINTER_DPI
+#define PRINTER_DPI 0
+#endif
+#ifndef PRINTER_DOTS
+#define PRINTER_DOTS 0
+#endif
+// Input buffer and head speed of the "default" printer, as buffer= and
+// lines= in the list; a buffer of 0 leaves it unpaced
+#ifndef PRINTER_BUFFER_BYTES
+#define PRINTER_BUFFER_BYTES 0
+#endif
+#ifndef PRINTER_LINES_PER_SEC
+#define PRINTER_LINES_PER_SEC 0
+#endif
+// L2CAP PSM of the "default" printer, as psm= in the list
+#ifndef PRINTER_L2CAP_PSM
+#define PRINTER_L2CAP_PSM 0
+#endif
+
+#ifndef BLE_LINK_CORE
+#define BLE_LINK_CORE 0
+#endif
+
+// Scanning. With the accept list on, the controller drops advertisements
+// from every address but the registered printers, so crowded sites don't
+// load the CPU; turn it off for printers with resolvable private addresses.
+// Duplicates are filtered within a window. Passive scans need no scan
+// request airtime and find printers from their advertisements alone.
+#ifndef BLE_SCAN_ACCEPT_LIST
+#define BLE_SCAN_ACCEPT_LIST 1
+#endif
+#ifndef BLE_SCAN_ACTIVE
+#define BLE_SCAN_ACTIVE 0
+#endif
+#ifndef BLE_SCAN_INTERVAL_MS
+#define BLE_SCAN_INTERVAL_MS 100
+#endif
+#ifndef BLE_SCAN_WINDOW_MS
+#define BLE_SCAN_WINDOW_MS 50              // Half duty leaves airtime for Wi-Fi
+#endif
+
+// The link settings below are defaults; /config overrides them at runtime.
+
+// ATT MTU we ask for. The printer may negotiate it down; the chunk size is
+// always derived from what it actually agreed to.
+#ifndef PRINTER_MTU
+#define PRINTER_MTU 517
+#endif
+// Optional upper bound for printers that drop larger writes silently
+#ifndef PRINTER_MAX_CHUNK
+#define PRINTER_MAX_CHUNK 512
+#endif
+
+// BLE transmit mode. AUTO uses write-without-response when the characteristic
+// supports it and falls back to acknowledged writes otherwise.
+enum BleWriteMode {
+  WRITE_MODE_AUTO,
+  WRITE_MODE_ACK,
+  WRITE_MODE_NO_RESPONSE
+};
+#ifndef PRINTER_WRITE_MODE
+#define PRINTER_WRITE_MODE WRITE_MODE_AUTO
+#endif
+#ifndef PRINTER_TX_WINDOW
+#define PRINTER_TX_WINDOW 8
+#endif
+// Link probe after each GATT connect: this many bytes of filler (probe= in
+// printer_profile.h) in each write mode the characteristic takes, at the
+// full chunk and at half of it. Under AUTO the fastest clean run picks the
+// write mode, a faster half chunk caps the chunks, and the rate stands in
+// for the drain rate until a job has measured one. 0 skips the probe.
+#ifndef LINK_PROBE_BYTES
+#define LINK_PROBE_BYTES 0
+#endif
+
+// After each job, ask a printer with a notify characteristic for its status
+// (GS r 1) and take the answer as the moment it finished printing
+#ifndef PRINTER_IDLE_QUERY
+#define PRINTER_IDLE_QUERY 1
+#endif
+
+// What keeps an idle printer from going to sleep (printer_keepalive.h):
+// an empty acknowledged write, which any printer takes, the GS r 1 status
+// query of ESC/POS printers, or the TSPL ~!T model query. keepalive= in the
+// registry, this for the printer of the build flags.
+enum PrinterKeepAlive {
+  KEEPALIVE_PING,
+  KEEPALIVE_STATUS,
+  KEEPALIVE_TSPL
+};
+#ifndef PRINTER_KEEPALIVE
+#define PRINTER_KEEPALIVE KEEPALIVE_PING
+#endif
+
+// Printers that pace the sender send XOFF on the notify characteristic when
+// their input buffer fills up and XON once it has drained. Writing stops in
+// between; a job fails when XON does not come within this many ms.
+#ifndef PRINTER_XOFF_TIMEOUT
+#define PRINTER_XOFF_TIMEOUT 30000
+#endif
+
+// BLE connection state machine. Runs in its own task per printer and is
+// driven by scan, client and HTTP events.
+enum BleLinkState {
+  LINK_IDLE,         // Disconnected on request, waiting for /connect
+  LINK_SCANNING,
+  LINK_CONNECTING,
+  LINK_DISCOVERING,
+  LINK_READY,
+  LINK_BACKOFF       // Waiting before the next scan after a failure
+};
+enum BleLinkEventType {
+  LINK_EVT_FOUND,          // Scan saw the printer
+  LINK_EVT_SCAN_DONE,      // Scan window ended without it
+  LINK_EVT_DISCONNECTED,   // Client callback, carries the client
+  LINK_EVT_CONNECT,        // /connect
+  LINK_EVT_DISCONNECT,     // /disconnect
+  LINK_EVT_JOB             // A job arrived while not connected
+};
+struct BleLinkEvent {
+  BleLinkEventType type;
+  const void* client;
+};
+
+const char* linkStateName(BleLinkState state);
+
+// Told when a printer's link state changes, from its link task; must not block
+typedef void (*BleLinkListener)(uint8_t printer, BleLinkState state);
+void setBleLinkListener(BleLinkListener listener);
+
+class BlePrinter {
+public:
+  BlePrinter();
+
+  BlePrinter(const BlePrinter&) = delete;
+  BlePrinter& operator=(const BlePrinter&) = delete;
+
+  void configure(uint8_t index, const String& id, const String& mac,
+                 const String& serviceUUID, const String& characteristicUUID);
+
+  // Start the link task, which connects right away
+  bool begin();
+
+  // Ask the link task to connect, or to disconnect and stay disconnected
+  void requestConnect() { postEvent(LINK_EVT_CONNECT, nullptr); }
+  void requestDisconnect() { postEvent(LINK_EVT_DISCONNECT, nullptr); }
+
+  // A job for this printer has started to arrive: cut a backoff short and
+  // connect, directly when the handles are cached, while it is received.
+  // Does nothing when connected, already trying or after /disconnect.
+  void requestJobConnect() {
+    if (!connected()) {
+      postEvent(LINK_EVT_JOB, nullptr);
+    }
+  }
+
+  // Print writer sink: routes job data through the stages of the printer's
+  // pipeline (print_pipeline.h), by default the resolution rescaler and the
+  // raster re-encoder when the printer needs them, and out over the link
+  bool write(const PrintSlice& slice);
+
+  // Link benchmark (link_bench.h): bytes of NUL in chunks of at most chunk
+  // bytes, capped to what the MTU allows, acknowledged or not, recorded into
+  // metrics. Unacknowledged runs end with an acknowledged byte so the time
+  // covers the drain. The caller holds the printer's writer.
+  bool benchWrite(size_t bytes, size_t chunk, bool noResponse, LinkMetrics& metrics);
+
+  // Send the keep-alive of setKeepAlive() over BLE. False when no BLE link
+  // is up to send it on. Called by the printer's writer between jobs.
+  bool keepAlive();
+
+  uint8_t index() const { return _index; }
+  const String& id() const { return _id; }
+  const String& mac() const { return _mac; }
+  bool usb() const { return _usb; }
+  bool spp() const { return _spp; }
+  const String& name() const { return _name; }
+  bool connected() const { return _connected; }
+  BleLinkState linkState() const { return _linkState; }
+  uint16_t mtu() const { return _connected ? _mtu : 0; }
+  size_t chunkSize() const { return _connected ? (_link.channelOpen() ? _link.channelMtu() : _chunkSize) : 0; }
+  // Where the link controller holds GATT writes now: chunk, writes in
+  // flight, gap between chunks and the last connection RSSI
+  size_t txChunk() const { return _connected && !_link.channelOpen() ? _control.chunkSize() : chunkSize(); }
+  uint16_t txWindow() const { return _connected ? _control.window() : 0; }
+  uint8_t txGapMs() const { return _connected ? _control.gapMs() : 0; }
+  int8_t rssi() const { return _connected ? _control.lastRssi() : 0; }
+  void onRssi(int8_t rssi) { _control.rssi(rssi); }
+  // Transmit power the link asks for (tx_power.h); the bridge sends at the
+  // highest any printer asks for
+  uint8_t txPowerStep() const { return _txPower.step(); }
+  int8_t txPowerDbm() const { return _connected ? _txPower.dBm() : 0; }
+  float connIntervalMs() const { return _connected ? _connInterval * 1.25f : 0.0f; }
+  // Has work by the connection schedule (conn_schedule.h)
+  bool connBusy() const { return _connected && _connBusy; }
+  bool phy2M() const { return _connected && _txPhy == BLE_PHY_2M; }
+  uint16_t dataLength() const { return _connected ? _dataLength : 0; }
+  bool gattCached() const { return _connected && _cacheUsed; }
+  // Print data goes over an L2CAP channel instead of GATT writes
+  bool l2cap() const { return _connected && _link.channelOpen(); }
+  bool notifying() const { return _connected && _notifyActive; }
+  bool flowPaused() const { return _connected && _txPaused; }
+  // From the answer to the last status query
+  bool paperOut() const { return _connected && _paperOut; }
+  const RasterRecoder& recoder() const { return _recoder; }
+  const PrintPipeline& pipeline() const { return _pipeline; }
+  // Its stages, comma-separated
+  String pipelineName() const;
+  // Pattern of the printer_profile.h profile in use, empty for none
+  const char* profileName() const { return _profile != nullptr ? _profile->pattern : ""; }
+  // Best run of the link probe on this connection, 0 when none ran
+  uint32_t probeRate() const { return _connected ? _probeRate : 0; }
+  uint16_t probeChunk() const { return _connected ? _probeChunk : 0; }
+  bool probeNoResponse() const { return _probeNoResponse; }
+  // Smoothed BLE drain rate in bytes/s, 0 until the first job
+  uint32_t throughput() const { return _throughput; }
+  uint8_t pool() const { return _pool; }
+  const LinkMetrics& metrics() const { return _metrics; }
+  void setPool(uint8_t pool) { _pool = pool; }
+  uint16_t dpi() const { return _dpi; }
+  uint16_t dots() const { return _dots; }
+  void setHead(uint16_t dpi, uint16_t dots) { _dpi = dpi; _dots = dots; }
+  // Modelled input buffer, for printers without status; after setHead()
+  void setBuffer(uint32_t bytes, uint16_t linesPerSecond) {
+    _bufferBytes = bytes;
+    _linesPerSecond = linesPerSecond;
+    _bufferModel.begin(bytes, linesPerSecond, _dpi);
+  }
+  bool paced() const { return _bufferModel.active() && !_notifyActive && !_usb && !_spp; }
+  // PSM to stream on, 0 to use the one the printer publishes
+  void setPsm(uint16_t psm) { _psm = psm; }
+  void setKeepAlive(PrinterKeepAlive mode) { _keepAlive = mode; }
+
+  // Dispatch from the shared BLE stack callbacks
+  bool wantsAdvertisement(const uint8_t* bda, uint8_t addressType, int rssi);
+  void postEvent(BleLinkEventType type, const void* client);
+  // Configured address in binary, nullptr when it doesn't parse
+  const uint8_t* macAddress() const { return _macValid ? _macAddress : nullptr; }
+  void onClientDisconnect(const void* client);
+  void onConnParams(uint16_t interval) { _connInterval = interval; }
+  void onPhy(uint8_t txPhy, uint8_t rxPhy) { _txPhy = txPhy; _rxPhy = rxPhy; }
+  void onDataLength(uint16_t txOctets) { _dataLength = txOctets; }
+  void onNotify(uint16_t handle, const uint8_t* data, size_t length);
+
+private:
+  static void linkTask(void* param);
+  static void usbEvent(void* context, bool attached);
+  static void sppEvent(void* context, bool connected);
+  static bool resampleStage(void* context, const PrintSlice& slice);
+  static bool recodeStage(void* context, const PrintSlice& slice);
+  static bool sendStage(void* context, const PrintSlice& slice);
+
+  void runLink();
+  void beginAttempt();
+  void startScan();
+  void enterBackoff();
+  uint32_t backoffDelay() const;
+
+  bool connect(bool direct);
+  bool discover();
+  bool restoreCachedHandles();
+  void disconnect();
+  void negotiateLinkParameters();
+  ConnSchedule connTarget() const;
+  void scheduleConnection();
+  bool matchProfile();
+  void configurePipeline();
+  void probeLink();
+  uint32_t probeRun(const uint8_t* filler, size_t bytes, size_t chunk, bool noResponse);
+  void sizeChunks();
+  RasterProfile rasterProfile() const;
+  bool subscribeNotify();
+
+  void loadGattCache();
+  void saveGattCache();
+  void clearGattCache();
+  String cacheNamespace() const;
+
+  bool send(const PrintSlice& slice);
+  void streamLinkChanged(bool up, const char* name, size_t chunkSize);
+  bool sendStream(const PrintSlice& slice, bool (*write)(const uint8_t*, size_t));
+  void updateThroughput(size_t length, unsigned long elapsedMs);
+  bool writeHandle(const uint8_t* data, size_t length, bool response);
+  bool waitForTxCredit();
+  bool waitForXon();
+  bool waitForBufferRoom(size_t length);
+
+  uint8_t _index = 0;
+  String _id;
+  String _mac;
+  uint8_t _macAddress[6] = {};
+  bool _macValid = false;
+  bool _usb = false;             // On the USB host port instead of BLE
+  bool _spp = false;             // On Classic Bluetooth RFCOMM instead of BLE
+  String _serviceUUID;           // As BleLink::canonicalUuid() prints them
+  String _characteristicUUID;
+  String _name = "Unknown";
+
+  BleLink _link;
+  // Where the last scan saw the printer; no copy of the advertisement is kept
+  bool _found = false;
+  uint8_t _foundAddress[6] = {};
+  uint8_t _foundAddressType = BLE_ADDRESS_PUBLIC;
+  volatile bool _connected = false;
+
+  // Negotiated link, filled in after connecting and from GAP events
+  uint16_t _mtu = 23;
+  size_t _chunkSize = 20;
+  volatile uint16_t _connInterval = 0;
+  volatile bool _connBusy = false;
+  uint32_t _busyAt = 0;          // Last time it had bytes queued
+  ConnSchedule _connRequested = {};
+  volatile uint8_t _txPhy = BLE_PHY_1M;
+  volatile uint8_t _rxPhy = BLE_PHY_1M;
+  volatile uint16_t _dataLength = 27;
+
+  volatile BleLinkState _linkState = LINK_IDLE;
+  QueueHandle_t _events = nullptr;
+  bool _autoConnect = true;      // Cleared by /disconnect
+  uint8_t _failures = 0;
+
+  // Print characteristic and the optional notify/indicate characteristic
+  // in the print service, possibly restored from the NVS cache
+  BleGattHandles _handles = {};
+  bool _cacheValid = false;
+  bool _cacheUsed = false;       // Current connection skipped discovery
+  bool _notifyActive = false;
+  volatile bool _idleQueryPending = false;
+  volatile bool _txPaused = false;   // XOFF received, waiting for XON
+  volatile bool _paperOut = false;
+
+  uint16_t _txPeakCredits = 0;   // Highest free TX buffer count on this connection
+  volatile uint32_t _throughput = 0;
+  uint8_t _pool = PRINT_NO_POOL;
+  uint16_t _dpi = 0;             // Head resolution and width, 0 when not configured
+  uint16_t _dots = 0;
+  uint16_t _psm = 0;             // From the registry, over the published one
+  uint32_t _bufferBytes = 0;     // From the registry, over the profile's
+  uint16_t _linesPerSecond = 0;
+  const PrinterProfile* _profile = nullptr;  // Matched on the name and service
+  volatile bool _probing = false;  // Job data waits while the probe runs
+  uint32_t _probeRate = 0;       // bytes/s
+  uint16_t _probeChunk = 0;
+  bool _probeNoResponse = false;
+  PrinterKeepAlive _keepAlive = KEEPALIVE_PING;
+  RasterResampler _resampler;
+  bool _jobStart = true;         // The next slice with data begins a job
+  RasterRecoder _recoder;
+  PrintPipeline _pipeline;
+  PrinterBufferModel _bufferModel;
+  LinkMetrics _metrics;
+  LinkController _control;
+  TxPowerPolicy _txPower;
+  uint8_t _gather[512];          // The one chunk that straddles the ring end
+};
+
+// Read the printer list, falling back to the build flags. Returns the number
+// of printers; LittleFS must already be mounted.
+size_t loadPrinterRegistry();
+
+// Bring up the BLE stack and start the link task of every printer
+bool initBlePrinters();
+
+size_t printerCount();
+BlePrinter* getPrinter(size_t index);
+// Printer by ID; an empty ID selects the first printer
+BlePrinter* findPrinter(const String& id);
+
+// Pools from the pool= option of the registry, numbered in order of appearance
+bool findPool(const String& name, uint8_t& pool);
+const char* poolName(uint8_t pool);
+// Least busy connected member of the pool, nullptr when none is connected
+BlePrinter* selectPoolPrinter(uint8_t pool, uint8_t exclude = PRINT_ALL_PRINTERS);
+// requestJobConnect() on every member of the pool, for a job none is connected for
+void requestPoolConnect(uint8_t pool);
+// PrintJobReroute for pooled jobs
+uint8_t reroutePoolJob(uint8_t pool, uint8_t failedPrinter);
+// PrintWriterRate: the printer's smoothed throughput, from its link probe
+// until jobs have been measured
+uint32_t printerDrainRate(uint8_t printer);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+// When each step of startup finished, in ms since boot, for /status and
+// the log. Wi-Fi, BLE and the display come up concurrently, so the phases
+// don't finish in a fixed order; ready is the moment both Wi-Fi and a
+// printer are up, i.e. the first label could print.
+
+enum BootPhase {
+  BOOT_FILESYSTEM,  // LittleFS mounted and the printer registry loaded
+  BOOT_BLE,         // BLE stack up, link tasks connecting
+  BOOT_WEB,         // Web server listening
+  BOOT_DISPLAY,     // LCD initialized
+  BOOT_WIFI,        // Wi-Fi has an address
+  BOOT_PRINTER,     // First printer connected
+  BOOT_READY,       // Wi-Fi and a printer
+  BOOT_PHASES
+};
+
+// Record a phase the first time it is reached; later calls are ignored
+void markBootPhase(BootPhase phase);
+
+// ms since boot when the phase was reached, 0 while it hasn't been
+uint32_t bootPhaseMs(BootPhase phase);
+
+// Key of the phase in /status
+const char* bootPhaseName(BootPhase phase);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Settings that used to need a rebuild, kept in NVS and changed through
+// /config. The build flags (WIFI_SSID, PRINTER_MTU, PRINTER_WRITE_MODE, ...)
+// are the defaults for whatever NVS doesn't hold.
+//
+// Changes apply without a restart: the write mode, TX window, queue depth,
+// fair quantum, keep-alive schedule and log level at once, the MTU, chunk size,
+// connection parameters and link probe from the next connect of each
+// printer, the network mode from the next boot. The printer list itself
+// stays in PRINTER_REGISTRY_PATH.
+
+struct BridgeConfig {
+  char wifiSsid[33];
+  char wifiPassword[65];
+  uint16_t mtu;
+  uint16_t maxChunk;
+  uint8_t writeMode;             // BleWriteMode
+  uint16_t txWindow;
+  uint16_t connIntervalMin;      // 1.25 ms units
+  uint16_t connIntervalMax;      // Taken as the minimum when below it
+  uint16_t connLatency;
+  uint16_t supervisionTimeout;   // 10 ms units
+  uint16_t queueDepth;           // Up to PRINT_QUEUE_DEPTH
+  uint8_t logLevel;              // ARDUHAL_LOG_LEVEL_*, up to CORE_DEBUG_LEVEL
+  uint8_t network;               // NetworkMode
+  uint16_t keepAliveInterval;    // s, 0 for none (printer_keepalive.h)
+  uint16_t keepAliveStart;       // Minutes after local midnight
+  uint16_t keepAliveEnd;
+  uint16_t probeBytes;           // Link probe per run, 0 for none
+  uint16_t fairQuantum;          // Bytes per client turn, 0 for none (print_writer.h)
+};
+
+enum ConfigResult {
+  CONFIG_OK,
+  CONFIG_UNKNOWN,                // No such setting
+  CONFIG_INVALID                 // Out of range or malformed
+};
+
+// Load the stored settings over the defaults. Call once, early in setup().
+void initBridgeConfig();
+
+// The settings in effect. Other tasks read single fields without a lock;
+// each is one aligned word.
+const BridgeConfig& bridgeConfig();
+
+// Change one setting of a copy by its /config name
+ConfigResult setConfigValue(BridgeConfig& config, const String& name, const String& value);
+
+// Put a changed copy in effect and write it to NVS
+bool applyBridgeConfig(const BridgeConfig& changed);
+
+// Back to the build flags, in memory and in NVS
+void resetBridgeConfig();
+
+// The settings as JSON, without the Wi-Fi password
+String getConfigJSON();
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "print_stream.h"
+
+// Open-loop model of a printer's input buffer, for pacing printers that
+// have no notify characteristic to send XOFF on.
+//
+// A byte written stays in the printer's buffer until the head has worked
+// through everything before it. The model parses what is written and
+// prices each part in print time: a raster row, a fed dot line or a text
+// line feed at the head's speed in dot lines per second, and a TSPL PRINT
+// at its label length (SIZE) and SPEED. Bytes that cost no printing, like
+// setup commands and the text before its line feed, count as consumed the
+// moment the head reaches them. The writer asks how long to wait before a
+// chunk fits under the capacity, so the buffer is never overrun and the
+// link runs at full speed whenever the head keeps up.
+//
+// It has no Arduino dependencies and builds on a host as it is; times are
+// microseconds of the caller's clock, which may wrap.
+
+#ifndef BUFFER_MODEL_SEGMENTS
+#define BUFFER_MODEL_SEGMENTS 32      // Writes tracked apart; further ones merge into the last
+#endif
+#ifndef BUFFER_MODEL_LINES_PER_SEC
+#define BUFFER_MODEL_LINES_PER_SEC 400 // ESC/POS head speed without lines=, 50 mm/s at 8 dots/mm
+#endif
+#ifndef BUFFER_MODEL_TEXT_LINE
+#define BUFFER_MODEL_TEXT_LINE 30     // Dot lines of one ESC/POS text line feed
+#endif
+#ifndef BUFFER_MODEL_TSPL_SPEED
+#define BUFFER_MODEL_TSPL_SPEED 4     // Inches/s of TSPL jobs that don't set SPEED
+#endif
+
+class PrinterBufferModel {
+public:
+  // capacity in bytes, 0 to not model at all. dpi turns TSPL SPEED and SIZE
+  // into dot lines.
+  void begin(uint32_t capacity, uint16_t linesPerSecond, uint16_t dpi);
+  bool active() const { return _capacity != 0; }
+
+  // A job begins; its dialect is told by its first command
+  void startJob();
+
+  // The printer lost what it held, after a disconnect
+  void clear();
+
+  // Microseconds to wait before length more bytes fit, 0 when they do now
+  uint32_t delayUs(size_t length, uint32_t nowUs);
+
+  // Bytes just written to the printer
+  void written(const uint8_t* data, size_t length, uint32_t nowUs);
+
+  // Bytes the printer still has to work through
+  uint32_t occupancy(uint32_t nowUs) {
+    drain(nowUs);
+    return _occupancy;
+  }
+
+private:
+  // Bytes of one write and the print time left before the last of them is
+  // consumed; the head spends it evenly across them
+  struct Segment {
+    uint32_t bytes;
+    uint32_t us;
+  };
+
+  static bool streamEvent(void* context, const PrintEvent& event);
+  void tsplSpeed(const uint8_t* line, size_t length);
+  void addLines(uint32_t lines, uint32_t linesPerSecond);
+  void drain(uint32_t nowUs);
+
+  uint32_t _capacity = 0;
+  uint16_t _linesPerSecond = BUFFER_MODEL_LINES_PER_SEC;
+  uint16_t _dpi = 203;
+
+  PrintStreamParser _parser;
+  uint64_t _cost = 0;              // Print time of the write being parsed
+  uint16_t _rowBytes = 0;          // Of the raster being received
+  uint8_t _rowLines = 1;           // Dot lines per raster row, 2 at double height
+  uint32_t _rowFill = 0;           // Bytes of the raster row in progress
+  uint32_t _tsplLinesPerSecond = 0;
+  uint32_t _labelLines = 0;        // TSPL SIZE height in dot lines
+
+  Segment _segments[BUFFER_MODEL_SEGMENTS];
+  size_t _head = 0;
+  size_t _count = 0;
+  uint32_t _occupancy = 0;
+  uint32_t _lastUs = 0;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+
+// What the bridge and each of its printers take, so a client can send the
+// smallest form of a job instead of full-width raster: a template call, a
+// cached hash, ZPL or an image left to the bridge to rasterize, deflated
+// uploads, and per printer its head, command set, the raster re-encoding
+// the bridge does for it and its measured drain rate.
+//
+//   GET /capabilities
+//     {"encodings":["identity","deflate"],
+//      "endpoints":{"raw":"/print","image":"/print/image","template":"/print/template/{name}",
+//                   "series":"/print/template/{name}/series",
+//                   "cached":"/print/cached/{hash}","batch":"/print/batch","zpl":"/print/zpl",
+//                   "pdf":"/print/pdf","ws":"/ws/print"},
+//      "image":{"types":["pbm","pgm","png"],"maxWidth":2048,
+//               "dither":["none","bayer","atkinson","fs"],"commands":["escpos","tspl"]},
+//      "batchMaxLabels":1024,
+//      "templates":["shipping"],
+//      "cachedJobs":[{"hash":"9f86d0...","bytes":18432}],
+//      "printers":[{"id":"default","name":"MTP-II","connected":true,"transport":"ble",
+//                   "dpi":203,"dots":384,"pool":null,"commands":"escpos",
+//                   "raster":["merge_rows","feed_blank"],"pipeline":"recode,send",
+//                   "ipp":"/ipp/print","rawPort":9100,"chunk":244,
+//                   "bytesPerSec":21000,"queue":0}]}
+//
+// commands is null for a model the bridge has no raster profile for, and
+// bytesPerSec is the smoothed drain rate of the last jobs, the link
+// probe's until then, or 0. cached is left out without a job cache, and
+// rawPort is null without the raw listeners.
+
+String getCapabilitiesJSON();
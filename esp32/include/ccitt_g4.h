@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CCITT Group 4 (T.6) decoder for the fax-coded 1-bit images inside
+// carrier-label PDFs (CCITTFaxDecode with K < 0).
+//
+// Each row is coded against the one above it, so the decoder keeps the
+// changing elements of two rows, 4 bytes per column, and nothing else; rows
+// come out one at a time, packed MSB first with 1 for black, the way the
+// raster writer takes them. The coded data is read in place. T.6 extensions
+// and uncompressed mode are refused. It has no Arduino dependencies and
+// builds on a host as it is.
+
+enum G4Status {
+  G4_ROW,           // One more row decoded
+  G4_END,           // End of the coded data, or the EOFB code
+  G4_ERROR          // Invalid code, or a run past the end of the row
+};
+
+class G4Decoder {
+public:
+  G4Decoder() = default;
+  ~G4Decoder();
+
+  G4Decoder(const G4Decoder&) = delete;
+  G4Decoder& operator=(const G4Decoder&) = delete;
+
+  // Coded data and the width of its rows. Allocates the two rows of
+  // changing elements; false without memory.
+  bool begin(const uint8_t* data, size_t length, uint16_t columns);
+  void end();
+
+  // Decode the next row into (columns + 7) / 8 bytes
+  G4Status row(uint8_t* bits);
+
+private:
+  int bit();
+  int run(bool black);
+  void addChange(uint16_t position);
+
+  const uint8_t* _data = nullptr;
+  size_t _bits = 0;              // Length of the coded data in bits
+  size_t _pos = 0;               // Next bit to read
+  uint16_t _columns = 0;
+
+  // Changing elements of the reference (previous) row and of the row being
+  // decoded; a row starts white, so even entries turn black
+  uint16_t* _ref = nullptr;
+  uint16_t* _cur = nullptr;
+  size_t _refCount = 0;
+  size_t _curCount = 0;
+};
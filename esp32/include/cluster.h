@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <IPAddress.h>
+#include <WiFi.h>
+#include "print_writer.h"
+
+// Bridge clustering: peer bridges found over mDNS, and print uploads for a
+// printer only a peer holds passed through to that peer.
+//
+// Every bridge advertises _printbridge._tcp on its HTTP port, with one TXT
+// item per connected printer: p<n>=<id>,<jobs queued>. A low-priority task
+// browses for the service every CLUSTER_QUERY_MS and keeps the peers it
+// found for CLUSTER_PEER_TTL_MS. A /print or /print/image upload naming a
+// printer this bridge doesn't have goes to the peer holding it, the least
+// busy one when several do, with its query and headers. The peer's answer
+// comes back as is, marked with X-Job-Forwarded, so clients only ever need
+// the address of one bridge. Forwarded uploads carry X-Bridge-Forwarded
+// and are never passed on again.
+
+#ifndef CLUSTER_ENABLED
+#define CLUSTER_ENABLED 1
+#endif
+#ifndef CLUSTER_MAX_PEERS
+#define CLUSTER_MAX_PEERS 8
+#endif
+#ifndef CLUSTER_QUERY_MS
+#define CLUSTER_QUERY_MS 15000          // Between browses; each costs airtime on every bridge
+#endif
+#ifndef CLUSTER_PEER_TTL_MS
+#define CLUSTER_PEER_TTL_MS 45000       // A peer not seen this long is dropped
+#endif
+#ifndef CLUSTER_ADVERTISE_MS
+#define CLUSTER_ADVERTISE_MS 2000       // Shortest time between TXT updates
+#endif
+#ifndef CLUSTER_FORWARD_TIMEOUT_MS
+#define CLUSTER_FORWARD_TIMEOUT_MS 5000 // Connect, and wait for the peer's answer
+#endif
+#ifndef CLUSTER_PRINTER_ID_MAX
+#define CLUSTER_PRINTER_ID_MAX 32
+#endif
+
+// Start the mDNS responder the bridge shares with IPP; safe to call twice
+bool beginMdns();
+
+// Advertise this bridge and start browsing for peers
+void initCluster(uint16_t httpPort);
+
+// Refresh the advertised printers and queue depths. Call periodically from
+// one task; updates go out at most every CLUSTER_ADVERTISE_MS.
+void serviceCluster();
+
+// Peer bridge holding the printer, the least busy one
+bool findClusterPrinter(const String& id, IPAddress& address, uint16_t& port);
+
+// Peers and their printers, for /cluster
+String getClusterJSON();
+
+// One upload passed through to a peer. Blocking socket writes from the
+// AsyncTCP task; the send buffer drains in the lwIP task.
+class ClusterForward {
+public:
+  // Connect and send the request head; a failure is answered by finish()
+  void begin(AsyncWebServerRequest* request, IPAddress peer, uint16_t port, size_t total);
+  void write(const uint8_t* data, size_t length);
+  // Answer the client with the peer's response, 502 when there was none
+  void finish(AsyncWebServerRequest* request);
+
+private:
+  WiFiClient _client;
+  bool _failed = false;
+};
+
+// Forwarder for an upload to a printer not in the registry, null when no
+// peer has it or the request was already forwarded
+ClusterForward* startClusterForward(AsyncWebServerRequest* request, size_t total);
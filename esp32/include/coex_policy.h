@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Wi-Fi/BLE coexistence while print data streams.
+//
+// Wi-Fi and BLE share the one 2.4 GHz radio. While any writer has a job
+// queued or streaming, the coexistence scheduler prefers BLE, and it goes
+// back to balanced COEX_IDLE_HOLD_MS after the last job, so back-to-back
+// jobs don't flip it. In that time no more than COEX_HTTP_BUSY_MAX static
+// asset bodies go out at once; further ones get 503 and Retry-After, and
+// the browser fetches them a moment later. Print uploads, /status and
+// 304 answers are never held back.
+
+#ifndef COEX_POLICY
+#define COEX_POLICY 1                  // 0 leaves the scheduler balanced
+#endif
+#ifndef COEX_IDLE_HOLD_MS
+#define COEX_IDLE_HOLD_MS 2000
+#endif
+#ifndef COEX_HTTP_BUSY_MAX
+#define COEX_HTTP_BUSY_MAX 2
+#endif
+
+// Follow the print queue. Call periodically from one task.
+void serviceCoexPolicy(bool printing);
+
+// BLE is preferred because jobs are printing
+bool coexFavoursBle();
+
+// Take a slot for a non-print response body, released when the request
+// goes. False, with 503 sent, when streaming and all slots are taken.
+bool coexAdmit(AsyncWebServerRequest* request);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+// Connection parameters of the BLE links of several printers.
+//
+// The controller serves every connection in events of its own, and the
+// links share one radio: two printers both asking for 7.5 ms intervals get
+// events that collide, and the controller drops whichever loses. So a link
+// only stays fast while it has work. A printer with bytes queued, or that
+// had some within CONN_IDLE_AFTER_MS, is busy: its interval is the /config
+// one, stretched so that every busy link gets CONN_BUSY_EVENT of radio time
+// per round, and it asks for an event length that fills its share. Idle
+// links drop to CONN_IDLE_INTERVAL with short events and leave the radio to
+// the busy ones. With one busy printer it runs as if it were alone.
+//
+// Each printer's link task re-reads the demand every CONN_SCHEDULE_PERIOD_MS
+// and asks for new parameters when its own changed; the printer may refuse
+// them. The event length only goes out with NimBLE, as Bluedroid's update
+// has no field for it. It has no Arduino dependencies and builds on a host
+// as it is.
+
+#ifndef CONN_SCHEDULE
+#define CONN_SCHEDULE 1                 // 0 keeps the /config parameters on every link
+#endif
+#ifndef CONN_SCHEDULE_PERIOD_MS
+#define CONN_SCHEDULE_PERIOD_MS 250
+#endif
+#ifndef CONN_IDLE_AFTER_MS
+#define CONN_IDLE_AFTER_MS 2000         // Without queued bytes before a link relaxes
+#endif
+#ifndef CONN_IDLE_INTERVAL
+#define CONN_IDLE_INTERVAL 80           // 1.25 ms units: 100 ms
+#endif
+#ifndef CONN_BUSY_EVENT
+#define CONN_BUSY_EVENT 6               // 1.25 ms units of radio time per busy link and round
+#endif
+
+struct ConnSchedule {
+  uint16_t intervalMin;        // 1.25 ms units
+  uint16_t intervalMax;
+  uint16_t latency;
+  uint16_t supervisionTimeout; // 10 ms units
+  uint16_t eventLength;        // 0.625 ms units
+
+  bool operator==(const ConnSchedule& other) const {
+    return intervalMin == other.intervalMin && intervalMax == other.intervalMax &&
+           latency == other.latency && supervisionTimeout == other.supervisionTimeout &&
+           eventLength == other.eventLength;
+  }
+  bool operator!=(const ConnSchedule& other) const { return !(*this == other); }
+};
+
+// Parameters of one link out of the configured ones (interval range,
+// latency, supervision timeout). busyLinks counts the busy links, this one
+// included when it is busy.
+ConnSchedule connSchedule(bool busy, uint8_t busyLinks, const ConnSchedule& configured);
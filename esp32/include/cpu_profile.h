@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Sampling CPU profiler for both cores, in the pprof format.
+//
+// While a profile is taken, a hardware timer on each core interrupts it
+// PROFILE_HZ times a second. The interrupt reads the program counter the
+// interrupted task was at, and its caller from the return address in a0,
+// out of the register frame the interrupt entry saved on the task's
+// stack, and counts the pair per task in a table of that core. Time in
+// interrupt handlers and critical sections, where the timer can't get in,
+// is counted at the code they return to. The tables take about 16 bytes
+// of internal RAM per slot and exist only while a profile runs.
+//
+// GET PROFILE_PATH?seconds=N samples for N seconds, then answers with the
+// profile as an uncompressed protocol buffer in the pprof format. Samples
+// carry "task" and "core" labels. The addresses are left for pprof to
+// symbolize against the firmware ELF with the Xtensa binutils, which it
+// finds as addr2line and nm in the PPROF_TOOLS directory. It takes the
+// standalone pprof (go install github.com/google/pprof@latest); the one of
+// `go tool pprof` only reads the symbols of Go binaries.
+//
+//   mkdir -p /tmp/xtensa
+//   ln -sf "$(which xtensa-esp32s3-elf-addr2line)" /tmp/xtensa/addr2line
+//   ln -sf "$(which xtensa-esp32s3-elf-nm)" /tmp/xtensa/nm
+//   elf=.pio/build/esp32-s3-devkitc-1/firmware.elf
+//   PPROF_TOOLS=/tmp/xtensa pprof -http=: $elf http://print-bridge.local/debug/pprof/profile?seconds=30
+//
+// 409 while another profile runs, 503 without the memory or the timers.
+
+#ifndef PROFILE_HZ
+#define PROFILE_HZ 997         // Samples per second and core, off the 1 kHz tick; 0 compiles the profiler out
+#endif
+#ifndef PROFILE_SLOTS
+#define PROFILE_SLOTS 1024     // Distinct PC, caller and task per core, a power of two
+#endif
+#ifndef PROFILE_TIMER
+#define PROFILE_TIMER 2        // Hardware timer of core 0; core 1 takes the next
+#endif
+#ifndef PROFILE_DEFAULT_SECONDS
+#define PROFILE_DEFAULT_SECONDS 30
+#endif
+#ifndef PROFILE_MAX_SECONDS
+#define PROFILE_MAX_SECONDS 300
+#endif
+#ifndef PROFILE_PATH
+#define PROFILE_PATH "/debug/pprof/profile"
+#endif
+
+// Register GET PROFILE_PATH on the server
+void initCpuProfile(AsyncWebServer& server);
@@ -0,0 +1,101 @@
+#pragma once
+
+// Logging that doesn't wait for the serial port.
+//
+// Arduino's log_e/w/i/d/v format and write straight to the UART, so a task
+// that logs while the FIFO is full waits at 115200 baud: a connect step or
+// a job start on the print path can lose milliseconds to its log line.
+// This header is force-included into every source (see platformio.ini) and
+// points those macros here instead. A line below the runtime level, set
+// through /config, costs one comparison and isn't formatted. Any other
+// line is formatted on the caller's stack and put in a ring buffer without
+// waiting; a low-priority task writes the ring to Serial. When the ring is
+// full the line is dropped and counted, so a burst of logging is capped at
+// what the port can drain instead of slowing the tasks that log.
+//
+// Lines logged before initDeferredLog() go to the port directly. Logging
+// from ESP-IDF components (the Bluetooth stack) takes the same ring.
+
+#ifndef __ASSEMBLER__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp32-hal-log.h>
+
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 8192           // Bytes of lines waiting for the port
+#endif
+#ifndef LOG_LINE_MAX
+#define LOG_LINE_MAX 192               // Longer lines are cut
+#endif
+#ifndef LOG_TASK_CORE
+#define LOG_TASK_CORE 1
+#endif
+#ifndef LOG_TASK_PRIORITY
+#define LOG_TASK_PRIORITY 1            // Below the print writers
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ARDUHAL_LOG_LEVEL_* of the lines that are kept; at most CORE_DEBUG_LEVEL,
+// since lines above that aren't compiled in
+extern uint8_t deferredLogLevel;
+
+// Queue one formatted line, dropping it if the ring is full
+void deferredLog(const char* format, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define DEFERRED_LOG(level, letter, format, ...)                                  \
+  do {                                                                            \
+    if (deferredLogLevel >= level) {                                              \
+      deferredLog(ARDUHAL_LOG_FORMAT(letter, format), ##__VA_ARGS__);             \
+    }                                                                             \
+  } while (0)
+
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_ERROR
+#undef log_e
+#define log_e(format, ...) DEFERRED_LOG(ARDUHAL_LOG_LEVEL_ERROR, E, format, ##__VA_ARGS__)
+#endif
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_WARN
+#undef log_w
+#define log_w(format, ...) DEFERRED_LOG(ARDUHAL_LOG_LEVEL_WARN, W, format, ##__VA_ARGS__)
+#endif
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
+#undef log_i
+#define log_i(format, ...) DEFERRED_LOG(ARDUHAL_LOG_LEVEL_INFO, I, format, ##__VA_ARGS__)
+#endif
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_DEBUG
+#undef log_d
+#define log_d(format, ...) DEFERRED_LOG(ARDUHAL_LOG_LEVEL_DEBUG, D, format, ##__VA_ARGS__)
+#endif
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_VERBOSE
+#undef log_v
+#define log_v(format, ...) DEFERRED_LOG(ARDUHAL_LOG_LEVEL_VERBOSE, V, format, ##__VA_ARGS__)
+#endif
+
+#ifdef __cplusplus
+
+struct DeferredLogStats {
+  uint32_t lines;                // Queued for the port
+  uint32_t dropped;              // Lost to a full ring
+  uint32_t truncated;            // Cut at LOG_LINE_MAX
+  size_t pending;                // Bytes still in the ring, roughly
+};
+
+// Create the ring and start the task that drains it, after Serial.begin()
+bool initDeferredLog();
+
+void getDeferredLogStats(DeferredLogStats& stats);
+
+// Log level names for /config, "none" to "verbose"
+const char* logLevelName(uint8_t level);
+bool parseLogLevel(const char* name, uint8_t& level);
+
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "band_renderer.h"
+
+// Screen recorded as a list of primitives and drawn in one go. Each call
+// appends a compact command with the rows it touches instead of drawing;
+// flush() merges those rows into runs, then composes each run band by band
+// through a BandRenderer, replaying only the commands that reach the band,
+// in the order they were recorded. A band goes out as one window write, by
+// DMA where the library has it, so a screen of dozens of small primitives
+// costs a few transactions instead of one setup per primitive.
+//
+// The bands are full width: rows a command touches are redrawn across the
+// panel, and what no command covers in them becomes the background. Rows
+// no command touches are not pushed. Text is drawn from its top-left
+// corner in a built-in font, as TFT_eSPI draws it.
+//
+// A full list drops further commands, with a warning, until flush().
+
+#ifndef DISPLAY_LIST_COMMANDS
+#define DISPLAY_LIST_COMMANDS 96
+#endif
+#ifndef DISPLAY_LIST_TEXT
+#define DISPLAY_LIST_TEXT 1024             // Bytes of text, terminators included
+#endif
+
+class DisplayList {
+public:
+  // After tft->init() and setRotation(); false without the memory for the bands
+  bool begin(TFT_eSPI* tft, int16_t rows = BAND_ROWS);
+  void end();
+  bool ready() const { return _bands.ready(); }
+
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+  void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+  void fillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t r, uint16_t color);
+  void drawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t r, uint16_t color);
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color);
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color);
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+  // Text at x, y in font and size; bg == color draws it transparent
+  void drawString(const char* text, int16_t x, int16_t y, uint8_t font, uint8_t size, uint16_t color,
+                  uint16_t bg);
+
+  size_t count() const { return _count; }
+  // Drop what is recorded without drawing it
+  void clear();
+  // Draw the rows the commands touch on background, then clear()
+  void flush(uint16_t background = TFT_BLACK);
+
+private:
+  enum Op : uint8_t {
+    OP_FILL_RECT,
+    OP_DRAW_RECT,
+    OP_FILL_ROUND_RECT,
+    OP_DRAW_ROUND_RECT,
+    OP_HLINE,
+    OP_VLINE,
+    OP_LINE,
+    OP_TEXT
+  };
+
+  struct Command {
+    Op op;
+    uint8_t arg;                 // Corner radius, or for text the size
+    uint8_t font;
+    int16_t x, y;
+    int16_t w, h;                // For a line its other end, for text unused
+    int16_t top, bottom;         // Rows touched, bottom exclusive
+    uint16_t color;
+    uint16_t bg;
+    uint16_t text;               // Offset into _text
+  };
+
+  Command* add(Op op, int16_t x, int16_t y, int16_t w, int16_t h, int16_t top, int16_t bottom,
+               uint16_t color);
+  void replay(TFT_eSPI& canvas);
+  static void drawBand(TFT_eSPI& canvas, void* context);
+
+  TFT_eSPI* _tft = nullptr;
+  BandRenderer _bands;
+  Command _commands[DISPLAY_LIST_COMMANDS];
+  size_t _count = 0;
+  char _text[DISPLAY_LIST_TEXT];
+  size_t _textUsed = 0;
+  bool _warned = false;          // Full list reported since the last flush()
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+// Backlight and panel power of the status display.
+//
+// The backlight runs from LEDC PWM, so an idle screen dims before it turns
+// off. Off also puts the panel controller to sleep (DISPOFF, SLPIN). Its
+// frame memory is kept through sleep, so on wake the panel shows the last
+// frame again and the status view only pushes what changed meanwhile.
+
+#ifndef DISPLAY_BRIGHTNESS
+#define DISPLAY_BRIGHTNESS 255         // Backlight duty while in use, of 255
+#endif
+#ifndef DISPLAY_DIM_BRIGHTNESS
+#define DISPLAY_DIM_BRIGHTNESS 32      // Backlight duty once dimmed
+#endif
+#ifndef DISPLAY_DIM_MS
+#define DISPLAY_DIM_MS 15000           // Inactivity before dimming; off follows at SCREEN_TIMEOUT
+#endif
+#ifndef DISPLAY_LEDC_CHANNEL
+#define DISPLAY_LEDC_CHANNEL 0
+#endif
+
+enum DisplayPower {
+  DISPLAY_POWER_ON,
+  DISPLAY_POWER_DIM,
+  DISPLAY_POWER_SLEEP              // Backlight off, panel in sleep mode
+};
+
+// Take over the backlight pin at full brightness. Call from the display
+// task after tft->init().
+void initDisplayPower(TFT_eSPI* tft, uint8_t backlightPin);
+
+// Change the display's power stage. Display task only; waking from sleep
+// blocks for the panel's 120 ms sleep-out time.
+void setDisplayPower(DisplayPower power);
+
+DisplayPower displayPower();
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include "printer_encoder.h"
+
+// Row streaming halftoning of 8-bit grayscale into printer raster bytes.
+//
+// Rows go in one at a time, top to bottom, and come out packed MSB first
+// with 1 for black, the way GS v 0 and TSPL BITMAP take them. The error
+// diffusion modes keep two rows of int16 error state whatever the image
+// height; Atkinson's second row down shares the slots of the row being read.
+// The row kernels are those of printer_encoder.h, which the host tools use.
+
+enum DitherMode {
+  DITHER_THRESHOLD = ENCODE_THRESHOLD,       // Plain cut at the threshold
+  DITHER_BAYER = ENCODE_BAYER,               // 8x8 ordered dither
+  DITHER_ATKINSON = ENCODE_ATKINSON,         // Diffuses 6/8 of the error, keeps contrast high
+  DITHER_FLOYD_STEINBERG = ENCODE_FLOYD_STEINBERG
+};
+
+// Mode by name ("none", "bayer", "atkinson", "fs"); false for unknown names
+bool parseDitherMode(const String& name, DitherMode& mode);
+
+class DitherEngine {
+public:
+  DitherEngine() = default;
+  ~DitherEngine();
+
+  DitherEngine(const DitherEngine&) = delete;
+  DitherEngine& operator=(const DitherEngine&) = delete;
+
+  // Gray values below threshold count as black. Allocates the error rows.
+  bool begin(DitherMode mode, uint16_t width, uint8_t threshold = 128);
+  void end();
+
+  // Dither the next row of width gray values (0 black .. 255 white) into
+  // (width + 7) / 8 bytes; the padding bits of the last byte stay white
+  void row(const uint8_t* gray, uint8_t* packed);
+
+  DitherMode mode() const { return _mode; }
+
+private:
+  DitherMode _mode = DITHER_THRESHOLD;
+  uint16_t _width = 0;
+  uint8_t _threshold = 128;
+  uint32_t _row = 0;
+  // Errors for this row and the next, offset by one so x - 1 and x + 1
+  // never leave the buffer
+  EncodeErrorRows _rows = {nullptr, nullptr};
+};
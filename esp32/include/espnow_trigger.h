@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include "image_raster.h"
+
+// Reprints triggered by button modules over ESP-NOW, with no Wi-Fi
+// association, TCP or HTTP between the press and the job.
+//
+// A button sends one packet on the bridge's Wi-Fi channel (its access
+// point's, or ESPNOW_TRIGGER_CHANNEL without one), at most 250 bytes:
+//
+//   0   "LB"                 magic
+//   2   1                    version
+//   3   type                 1: cached job, 2: label template
+//   4   counter              uint32, little-endian, higher than the last
+//   8   printer id           16 bytes, NUL-padded; empty for the first printer
+//   24  payload              type 1: the 32-byte SHA-256 of a cached job
+//                            type 2: template name, NUL, flat JSON of fields
+//   end tag                  first 16 bytes of HMAC-SHA256(ESPNOW_TRIGGER_KEY,
+//                            everything before it)
+//
+// A packet with a wrong tag, or a counter no higher than the last one
+// accepted from that sender, is dropped; the counters of each sender's MAC
+// address are kept in NVS so a replay stays refused across reboots. Accepted
+// packets are handed to a task of their own, which replays the cached job
+// (job_cache.h) or renders the template (label_template.h) straight into a
+// job for the printer. Nothing is answered: a press for a printer that
+// isn't connected wakes its link and is dropped.
+//
+// An empty ESPNOW_TRIGGER_KEY leaves ESP-NOW off. While it is on, Wi-Fi
+// stays up when Ethernet carries the bridge, so the radio keeps listening.
+
+#ifndef ESPNOW_TRIGGER_KEY
+#define ESPNOW_TRIGGER_KEY ""              // Shared with the buttons; empty disables ESP-NOW
+#endif
+#ifndef ESPNOW_TRIGGER_CHANNEL
+#define ESPNOW_TRIGGER_CHANNEL 1           // Channel when no access point sets one
+#endif
+#ifndef ESPNOW_TRIGGER_QUEUE
+#define ESPNOW_TRIGGER_QUEUE 4             // Triggers waiting for the task
+#endif
+#ifndef ESPNOW_TRIGGER_CORE
+#define ESPNOW_TRIGGER_CORE 1
+#endif
+#ifndef ESPNOW_TRIGGER_PRIORITY
+#define ESPNOW_TRIGGER_PRIORITY 2
+#endif
+
+enum EspNowResult : uint8_t {
+  ESPNOW_PRINTED,        // Queued as a job
+  ESPNOW_INVALID,        // Not a trigger, or a malformed one
+  ESPNOW_AUTH,           // Wrong tag
+  ESPNOW_REPLAY,         // Counter not above the sender's last
+  ESPNOW_REFUSED,        // Unknown printer or template, not cached, not connected, queue full
+  ESPNOW_RESULTS
+};
+
+const char* espNowResultName(EspNowResult result);
+
+// Whether a key is built in
+bool espNowTriggerEnabled();
+
+// Start ESP-NOW and the trigger task, after Wi-Fi is started or left off
+// and the printers, templates and job cache are up. Template labels go
+// through output with a pointer to the job ID, like the HTTP endpoint's.
+void initEspNowTrigger(ImageOutput output);
+
+// Packets of each result since boot
+uint32_t espNowTriggerCount(EspNowResult result);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// Wired Ethernet for the bridge, so HTTP, raw 9100 and IPP leave the 2.4 GHz
+// radio to BLE. ETH_LINK picks the hardware at build time: a W5500 on SPI
+// (the S3 has no EMAC) or an RMII PHY on the original ESP32's EMAC, set up
+// with the ETH_PHY_* flags of the Arduino ETH library. The "network"
+// setting of /config picks at run time, from the next boot: "auto" keeps
+// Wi-Fi off while the cable has an address, "ethernet" never starts Wi-Fi
+// and "wifi" leaves the wire alone.
+
+#define ETH_LINK_NONE 0
+#define ETH_LINK_W5500 1
+#define ETH_LINK_RMII 2
+
+#ifndef ETH_LINK
+#define ETH_LINK ETH_LINK_NONE
+#endif
+
+// W5500 wiring; the defaults are free pins of the LilyGo T-Display S3
+#ifndef ETH_W5500_SCK
+#define ETH_W5500_SCK 12
+#endif
+#ifndef ETH_W5500_MISO
+#define ETH_W5500_MISO 13
+#endif
+#ifndef ETH_W5500_MOSI
+#define ETH_W5500_MOSI 11
+#endif
+#ifndef ETH_W5500_CS
+#define ETH_W5500_CS 10
+#endif
+#ifndef ETH_W5500_INT
+#define ETH_W5500_INT 1
+#endif
+#ifndef ETH_W5500_RST
+#define ETH_W5500_RST 2                 // -1 when not wired
+#endif
+#ifndef ETH_W5500_MHZ
+#define ETH_W5500_MHZ 20                // SPI clock; the chip takes up to 80 on short wires
+#endif
+
+enum NetworkMode : uint8_t {
+  NETWORK_AUTO,                         // Ethernet while it has an address, Wi-Fi otherwise
+  NETWORK_WIFI,
+  NETWORK_ETHERNET
+};
+
+#ifndef NETWORK_MODE
+#define NETWORK_MODE NETWORK_AUTO        // Default of the "network" setting
+#endif
+
+// Start the Ethernet driver and DHCP. False when the build has no
+// Ethernet or the controller doesn't answer.
+bool initEthLink();
+
+// Cable in and an address
+bool ethLinkUp();
+
+// Address of whichever interface carries the bridge, Ethernet first;
+// 0.0.0.0 while neither is up
+IPAddress networkAddress();
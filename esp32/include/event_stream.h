@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Server-Sent Events push stream of printer and job status.
+//
+// Events, each with a JSON object as data:
+//   printer     {"id","status","link"}  on connect and disconnect, and for
+//                                       every printer when a client subscribes
+//   job         {"id","printer","status","total","received","sent"}  while a
+//                                       job moves, and once when it ends
+//   throughput  {"printer","bytes","rate10s","throughput"}  once a second
+//                                       while a printer moves data
+//   label       {"job","label","status"}  for each label of a /print/batch
+//                                       job once it is sent or failed
+//
+// State is compared by the task calling serviceEventStream(), so nothing
+// is sent while no client listens and nothing runs in the BLE or writer
+// tasks.
+
+#ifndef EVENTS_PATH
+#define EVENTS_PATH "/events"
+#endif
+#ifndef EVENTS_PROGRESS_MS
+#define EVENTS_PROGRESS_MS 250     // Shortest gap between job progress events
+#endif
+#ifndef EVENTS_SAMPLE_MS
+#define EVENTS_SAMPLE_MS 1000      // Throughput sample period
+#endif
+
+// Register the event source on the server
+void initEventStream(AsyncWebServer& server);
+
+// Send the events of whatever changed. Call periodically from one task.
+void serviceEventStream();
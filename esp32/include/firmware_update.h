@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Firmware and filesystem images written to flash as they are uploaded.
+//
+// A firmware image goes into the OTA slot that isn't running, a filesystem
+// image over the LittleFS partition. Both are hashed while they stream and
+// only take effect when the SHA-256 the client sent matches: the new
+// firmware is made the boot partition and the bridge restarts once no job
+// is queued, so a job in flight finishes first. The print writers keep
+// their priority over the upload; the flash writes happen in the HTTP task.
+
+enum FirmwareTarget {
+  UPDATE_FIRMWARE,
+  UPDATE_FILESYSTEM
+};
+
+enum FirmwareUpdateError {
+  UPDATE_OK,
+  UPDATE_ERR_BUSY,        // Another update is running or waits for restart
+  UPDATE_ERR_DIGEST,      // Not 64 hex digits
+  UPDATE_ERR_BEGIN,       // No room, or no partition for the image
+  UPDATE_ERR_WRITE,
+  UPDATE_ERR_MISMATCH,    // The image doesn't hash to the given digest
+  UPDATE_ERR_INCOMPLETE
+};
+
+// Start an update of size bytes that must hash to sha256Hex
+FirmwareUpdateError beginFirmwareUpdate(FirmwareTarget target, size_t size, const char* sha256Hex);
+
+FirmwareUpdateError writeFirmwareUpdate(const uint8_t* data, size_t length);
+
+// Verify the image and schedule the restart
+FirmwareUpdateError endFirmwareUpdate();
+
+// Drop an update whose upload ended early; the running image stays.
+// Does nothing once a later update took its place.
+void abortFirmwareUpdate(uint32_t session);
+
+// Number of the update begun last
+uint32_t firmwareUpdateSession();
+
+// Bytes of the running update, 0 when none
+size_t firmwareUpdateProgress();
+
+bool firmwareRestartPending();
+
+// Restart into the new image once idle. Call periodically from one task.
+void serviceFirmwareUpdate(bool idle);
+
+const char* firmwareUpdateErrorText(FirmwareUpdateError error);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Smooth fonts read straight from flash. A font loaded from LittleFS costs a
+// seek, an allocation and a read per glyph row while drawing; one copied to
+// the fonts partition (partitions.csv) is mapped into the address space and
+// drawn like a font compiled in as an array, through the flash cache.
+//
+// The .vlw files on LittleFS stay the source. The partition holds copies
+// found by path and checked against the file's size and CRC once per boot,
+// so a font replaced by a filesystem update is copied again at its next use.
+// Copies are appended; when the partition is full it is erased and refilled
+// with the fonts used from then on.
+//
+// One task at a time: the label renderer calls this under its lock, and
+// nothing may hold a font from the partition across the next call, which
+// may erase it.
+
+#ifndef FONT_PARTITION_LABEL
+#define FONT_PARTITION_LABEL "fonts"
+#endif
+
+// The mapped copy of a .vlw file on LittleFS, made first if needed; nullptr
+// without the partition or room in it, to load the font from the file then
+const uint8_t* mappedFont(const String& path);
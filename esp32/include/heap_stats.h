@@ -0,0 +1,129 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Heap, PSRAM and task stack telemetry for /metrics, and the memory
+// budget of the subsystems that hold large buffers.
+//
+// The heap figures come from the allocator: free and lowest-ever free
+// bytes and the largest free block, for internal RAM and PSRAM. Tasks
+// register themselves with trackTaskStack() so their stack high-water
+// marks can be read without the trace facility.
+//
+// The buffers the modules allocate through heapAlloc() carry a small
+// header, so the bytes each subsystem holds, and its peak, are counted.
+// Each subsystem has a quota (HEAP_BUDGET_*) and a region it prefers or
+// is bound to. An allocation that would take a subsystem past its quota,
+// or internal RAM below HEAP_INTERNAL_RESERVE, fails like an exhausted
+// heap does, and every caller already turns that into a refusal of the
+// work (503 on the print endpoints) instead of the bridge running dry
+// halfway through a job. Memory a subsystem allocates itself, like the
+// job ring buffers, is booked with heapReserve(). Built with
+// HEAP_TRACK_ALLOC=0, heapAlloc() is a plain allocation and nothing is
+// counted or enforced.
+
+#ifndef HEAP_TRACK_ALLOC
+#define HEAP_TRACK_ALLOC 1             // 0 for plain allocation without budgets
+#endif
+#ifndef HEAP_STAT_TASKS
+#define HEAP_STAT_TASKS 20             // Tasks whose stacks are watched
+#endif
+#ifndef HEAP_INTERNAL_RESERVE
+#define HEAP_INTERNAL_RESERVE (48 * 1024) // Internal RAM left to Wi-Fi, BLE and lwIP
+#endif
+
+// Quotas per subsystem in bytes, 0 for none
+#ifndef HEAP_BUDGET_INFLATE
+#define HEAP_BUDGET_INFLATE (512 * 1024)   // About ten 32 KB windows with their state
+#endif
+#ifndef HEAP_BUDGET_IMAGE
+#define HEAP_BUDGET_IMAGE (512 * 1024)     // Raster bands and scanlines
+#endif
+#ifndef HEAP_BUDGET_TEMPLATE
+#define HEAP_BUDGET_TEMPLATE (512 * 1024)
+#endif
+#ifndef HEAP_BUDGET_BATCH
+#define HEAP_BUDGET_BATCH (256 * 1024)
+#endif
+#ifndef HEAP_BUDGET_PREVIEW
+#define HEAP_BUDGET_PREVIEW (256 * 1024)
+#endif
+#ifndef HEAP_BUDGET_TRACE
+#define HEAP_BUDGET_TRACE (256 * 1024)
+#endif
+#ifndef HEAP_BUDGET_ZPL
+#define HEAP_BUDGET_ZPL (256 * 1024)
+#endif
+#ifndef HEAP_BUDGET_PDF
+#define HEAP_BUDGET_PDF (4 * 1024 * 1024)  // The file and the bitmap of one page
+#endif
+#ifndef HEAP_BUDGET_SPOOL
+#define HEAP_BUDGET_SPOOL (2 * 1024 * 1024) // PSRAM tier of the print spool
+#endif
+#ifndef HEAP_BUDGET_JOBS
+#define HEAP_BUDGET_JOBS (4 * 1024 * 1024) // Job ring buffers of all printers
+#endif
+
+// Owners of the large buffers, for HEAP_TRACK_ALLOC
+enum HeapSite {
+  HEAP_SITE_INFLATE,
+  HEAP_SITE_IMAGE,
+  HEAP_SITE_TEMPLATE,
+  HEAP_SITE_BATCH,
+  HEAP_SITE_PREVIEW,
+  HEAP_SITE_TRACE,
+  HEAP_SITE_ZPL,
+  HEAP_SITE_PDF,
+  HEAP_SITE_JOBS,
+  HEAP_SITE_SPOOL,
+  HEAP_SITES
+};
+
+// Where a subsystem's buffers go
+enum HeapRegion {
+  HEAP_PSRAM_FIRST,      // Internal RAM when there is no PSRAM or it is full
+  HEAP_INTERNAL_FIRST,
+  HEAP_PSRAM_ONLY,
+  HEAP_INTERNAL_ONLY
+};
+
+struct HeapRegionStats {
+  size_t total;
+  size_t free;
+  size_t minFree;       // Lowest free since boot
+  size_t largestBlock;
+};
+
+// Allocate in the subsystem's region, within its quota. nullptr when
+// either is exhausted. Free with heapFree().
+void* heapAlloc(HeapSite site, size_t size);
+void heapFree(void* p);
+
+// Book memory the subsystem allocated itself against its quota; false,
+// booking nothing, when it doesn't fit. Release the same size when it is
+// freed.
+bool heapReserve(HeapSite site, size_t size);
+void heapRelease(HeapSite site, size_t size);
+
+// Bytes a subsystem holds now and at most, zero without HEAP_TRACK_ALLOC
+size_t heapSiteBytes(HeapSite site);
+size_t heapSitePeak(HeapSite site);
+size_t heapSiteQuota(HeapSite site);
+// Allocations and reservations refused since boot
+uint32_t heapSiteRefused(HeapSite site);
+HeapRegion heapSiteRegion(HeapSite site);
+const char* heapSiteName(HeapSite site);
+const char* heapRegionName(HeapRegion region);
+
+void getInternalHeapStats(HeapRegionStats& stats);
+// All zero without PSRAM
+void getPsramStats(HeapRegionStats& stats);
+
+// Watch the stack of a task that lives until reboot. nullptr is ignored.
+void trackTaskStack(TaskHandle_t task);
+
+size_t trackedTaskCount();
+TaskHandle_t trackedTaskHandle(size_t index);
+const char* trackedTaskName(size_t index);
+// Bytes of stack the task never touched
+uint32_t trackedTaskStackFree(size_t index);
@@ -0,0 +1,21 @@
+#pragma once
+
+// Placement of the per-chunk data path: the ring buffer, the writer loop
+// and the chunking of a slice onto the link. In IRAM they run without
+// instruction cache misses, and the display and BLE stack code streaming
+// through the cache can't evict them mid-job. It costs about 3 KB of IRAM;
+// -DDATA_PATH_IRAM=0 gives it back on builds short of it.
+//
+// Flash writes still suspend the cache on both cores, and the ring sits in
+// cached PSRAM, so a spool write pauses the data path either way.
+
+#ifndef DATA_PATH_IRAM
+#define DATA_PATH_IRAM 1
+#endif
+
+#if DATA_PATH_IRAM && defined(ESP_PLATFORM)
+#include <esp_attr.h>
+#define HOT_PATH IRAM_ATTR
+#else
+#define HOT_PATH
+#endif
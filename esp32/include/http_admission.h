@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Bounded in-flight HTTP requests, with capacity kept for print uploads.
+//
+// The web server takes every connection, and each request holds its header
+// list, params and response, a file handle when it is served from LittleFS,
+// and for a long poll the whole wait. A reload storm from a dozen browsers
+// could so take the heap the /print body callbacks need. A handler ahead of
+// all others sorts each request into a lane by method and path and lets it
+// on only while its lane and the server have room:
+//
+//   print   POST /print..., PUT and DELETE /jobs, POST IPP_PATH
+//   status  GET /status, /metrics, /capabilities, /jobs..., /spool, ...
+//   static  any other GET or HEAD, the web UI and LittleFS files
+//   other   settings, updates, connect and the rest
+//
+// Of HTTP_MAX_IN_FLIGHT requests at once, HTTP_PRINT_RESERVED can only be
+// print uploads, so status and static traffic never fill the server for
+// them. A request over its lane's limit, or over the rest of the server's,
+// gets 503 with Retry-After: 1, its body dropped as it comes. WebSocket and
+// event stream upgrades aren't counted: they leave the request behind at
+// once, and keep their own client limits.
+//
+// GET /status is answered by the same handler once admitted, keeping only
+// If-None-Match of its headers, without walking the static asset handlers
+// and the LittleFS lookup of serveStatic() in front of its route.
+//
+// A slot is given back when the client disconnects. Code that needs the
+// disconnect itself registers with onRequestEnd() rather than
+// request->onDisconnect(), which holds one callback and would lose the slot.
+
+#ifndef HTTP_ADMISSION
+#define HTTP_ADMISSION 1               // 0 admits everything, as before
+#endif
+#ifndef HTTP_MAX_IN_FLIGHT
+#define HTTP_MAX_IN_FLIGHT 12          // Below the lwIP limit of open TCP connections
+#endif
+#ifndef HTTP_PRINT_RESERVED
+#define HTTP_PRINT_RESERVED 4          // Slots only print uploads take
+#endif
+#ifndef HTTP_PRINT_MAX
+#define HTTP_PRINT_MAX HTTP_MAX_IN_FLIGHT
+#endif
+#ifndef HTTP_STATUS_MAX
+#define HTTP_STATUS_MAX 6              // ?since= long polls hold theirs for the wait
+#endif
+#ifndef HTTP_STATIC_MAX
+#define HTTP_STATIC_MAX 4
+#endif
+#ifndef HTTP_OTHER_MAX
+#define HTTP_OTHER_MAX 2
+#endif
+
+enum HttpLane : uint8_t {
+  HTTP_LANE_PRINT,
+  HTTP_LANE_STATUS,
+  HTTP_LANE_STATIC,
+  HTTP_LANE_OTHER,
+  HTTP_LANE_COUNT,
+  HTTP_LANE_NONE = HTTP_LANE_COUNT     // Not counted
+};
+
+// Register the admission handler; must come before every other handler.
+// statusHandler answers GET /status on the fast lane.
+void initHttpAdmission(AsyncWebServer& server, ArRequestHandlerFunction statusHandler);
+
+// Run fn when the request's client disconnects, keeping its slot's release
+void onRequestEnd(AsyncWebServerRequest* request, std::function<void()> fn);
+
+const char* httpLaneName(HttpLane lane);
+uint8_t httpLaneInFlight(HttpLane lane);
+uint32_t httpLaneRejected(HttpLane lane);
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <Arduino.h>
+#include "inflate_stream.h"
+#include "dither.h"
+
+// Firmware side rasterizer behind /print/image.
+//
+// Takes a 1-bit PBM (P4), an 8-bit PGM (P5) or a palette or grayscale PNG as
+// it streams in and turns it into ESC/POS GS v 0 rows or a TSPL BITMAP label.
+// Gray pixels go through the dither engine a row at a time. Rows are
+// collected into a band that is handed on as soon as it fills, so memory is
+// one band plus, for PNG, two scanlines and the inflate window, however tall
+// the image is.
+
+#ifndef IMAGE_BAND_BYTES
+#define IMAGE_BAND_BYTES (64 * 1024)          // Band buffer with PSRAM
+#endif
+#ifndef IMAGE_BAND_BYTES_INTERNAL
+#define IMAGE_BAND_BYTES_INTERNAL (8 * 1024)  // Fallback without PSRAM
+#endif
+#ifndef IMAGE_MAX_WIDTH
+#define IMAGE_MAX_WIDTH 2048                  // Dots; wider images are refused
+#endif
+// Gray level (0..255) below which pixels print black, and the centre of the
+// dither modes
+#ifndef IMAGE_THRESHOLD
+#define IMAGE_THRESHOLD 128
+#endif
+
+enum ImageCommandSet {
+  IMAGE_ESCPOS,
+  IMAGE_TSPL
+};
+
+struct ImageRasterOptions {
+  ImageCommandSet commands = IMAGE_ESCPOS;
+  bool invert = false;          // Print white on black
+  DitherMode dither = DITHER_THRESHOLD;
+  // Send each band only between its leftmost and rightmost ink, placed with
+  // GS L or the BITMAP x
+  bool crop = false;
+  // TSPL label setup. A size of 0 is derived from the image at 8 dots/mm.
+  uint16_t paperWidthMm = 0;
+  uint16_t paperHeightMm = 0;
+  uint8_t speed = 4;
+  uint8_t density = 8;
+};
+
+enum ImageStatus {
+  IMAGE_MORE_INPUT,  // Image not complete yet
+  IMAGE_DONE,        // Last row written
+  IMAGE_ERROR
+};
+
+enum ImageError {
+  IMAGE_OK,
+  IMAGE_ERR_FORMAT,      // Not a PBM/PGM/PNG, or a variant we don't decode
+  IMAGE_ERR_CORRUPT,
+  IMAGE_ERR_TOO_LARGE,   // Wider than IMAGE_MAX_WIDTH
+  IMAGE_ERR_NO_MEMORY,
+  IMAGE_ERR_OUTPUT       // The output refused the commands
+};
+
+const char* imageErrorName(ImageError error);
+
+// Receives generated printer commands. Returns false to stop.
+typedef bool (*ImageOutput)(void* context, const uint8_t* data, size_t length);
+
+// Printer commands for a 1-bit raster of known size, handed on band by band:
+// ESC/POS GS v 0 rows, or a TSPL label with one BITMAP per band. Shared by
+// the image decoder and the label templates.
+class RasterCommandWriter {
+public:
+  RasterCommandWriter() = default;
+  ~RasterCommandWriter();
+
+  RasterCommandWriter(const RasterCommandWriter&) = delete;
+  RasterCommandWriter& operator=(const RasterCommandWriter&) = delete;
+
+  // Allocate the band and write the job preamble. Fails for lack of memory
+  // or when the output refuses the preamble; outputFailed() tells which.
+  bool begin(const ImageRasterOptions& options, uint16_t width, uint16_t height,
+             ImageOutput output, void* context);
+  void end();
+
+  // Next row, packed MSB first with 1 for black. The last row also writes
+  // the cut or PRINT that ends the job.
+  bool row(const uint8_t* bits);
+
+  // Commands of the caller's at the current row, like artwork the printer
+  // keeps in its memory. They start and must end with a GS L margin of 0,
+  // and take the place of rows rows of the raster, which the caller skips.
+  bool insert(const uint8_t* data, size_t length, uint16_t rows);
+
+  // Leave the cut or PRINT after the last row to finish(), so commands can
+  // still be inserted after the raster
+  void holdEnd() { _holdEnd = true; }
+  bool finish();
+
+  bool done() const { return _height != 0 && _row == _height; }
+  bool outputFailed() const { return _outputFailed; }
+
+private:
+  bool flushBand();
+  bool emit(const uint8_t* data, size_t length);
+  bool emit(const String& text) { return emit((const uint8_t*)text.c_str(), text.length()); }
+
+  ImageRasterOptions _options;
+  ImageOutput _output = nullptr;
+  void* _context = nullptr;
+  bool _outputFailed = false;
+  bool _holdEnd = false;
+
+  uint16_t _width = 0;
+  uint16_t _height = 0;
+  uint16_t _row = 0;             // Rows written so far
+  size_t _widthBytes = 0;        // Packed 1-bit row
+
+  uint8_t* _band = nullptr;
+  size_t _rowCost = 0;           // Bytes per row in the band, header included
+  size_t _bandRows = 0;
+  size_t _bandFill = 0;
+  uint16_t _margin = 0;          // GS L left margin set by cropping, in dots
+};
+
+class ImageRasterizer {
+public:
+  ImageRasterizer() = default;
+  ~ImageRasterizer();
+
+  ImageRasterizer(const ImageRasterizer&) = delete;
+  ImageRasterizer& operator=(const ImageRasterizer&) = delete;
+
+  // Buffers are only allocated once the image header says how wide it is
+  void begin(const ImageRasterOptions& options, ImageOutput output, void* context);
+  void end();
+
+  // Decode one piece of the upload
+  ImageStatus feed(const uint8_t* data, size_t length);
+
+  ImageStatus status() const { return _status; }
+  ImageError error() const { return _error; }
+  uint16_t width() const { return _width; }
+  uint16_t height() const { return _height; }
+
+private:
+  enum State {
+    SIGNATURE,
+    PBM_HEADER,
+    PBM_ROWS,
+    PNG_CHUNK_HEADER,
+    PNG_CHUNK_DATA,
+    PNG_CHUNK_CRC,
+    FINISHED
+  };
+
+  static bool pngOutput(void* context, const uint8_t* data, size_t length);
+
+  ImageStatus fail(ImageError error);
+  void pbmHeaderByte(uint8_t b);
+  void pngChunkByte(uint8_t b);
+  bool pngChunkEnd();
+  bool pngScanData(const uint8_t* data, size_t length);
+  bool unfilterScan();
+  void packScan(const uint8_t* samples, uint8_t bitDepth);
+
+  bool startImage(uint8_t bitDepth);
+  bool emitRow(const uint8_t* bits);
+
+  ImageRasterOptions _options;
+  ImageOutput _output = nullptr;
+  void* _context = nullptr;
+  ImageStatus _status = IMAGE_ERROR;
+  ImageError _error = IMAGE_OK;
+  State _state = SIGNATURE;
+
+  uint16_t _width = 0;
+  uint16_t _height = 0;
+  size_t _widthBytes = 0;        // Packed 1-bit row
+
+  uint8_t _header[16];           // Signature, chunk header or IHDR being collected
+  size_t _headerLen = 0;
+
+  // PBM/PGM header fields
+  bool _pgm = false;
+  uint8_t _pbmField = 0;
+  uint32_t _pbmValue = 0;
+  bool _pbmDigits = false;
+  bool _pbmComment = false;
+
+  // PNG chunk being read
+  uint32_t _chunkLeft = 0;
+  uint32_t _chunkPos = 0;
+  uint32_t _chunkType = 0;
+  bool _seenHeader = false;
+  uint8_t _bitDepth = 0;
+  uint8_t _colorType = 0;
+  uint16_t _paletteSize = 0;
+  uint16_t _lumaAcc = 0;
+  int32_t _transparentGray = -1;
+  uint8_t _luma[256];            // Per palette index or gray level
+  uint8_t _alpha[256];
+  InflateStream _inflater;
+
+  // Gray level per sample value, white where transparent, and the row of
+  // them the dither engine works on
+  uint8_t _gray[256];
+  uint8_t* _grayRow = nullptr;
+  DitherEngine _dither;
+
+  // Scanline of the source image; PNG keeps the previous one for unfiltering
+  uint8_t* _scan = nullptr;
+  uint8_t* _prevScan = nullptr;
+  size_t _scanBytes = 0;         // Without the PNG filter byte
+  size_t _scanLen = 0;
+  uint8_t* _packed = nullptr;
+
+  RasterCommandWriter _writer;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming zlib/deflate decoder for compressed print uploads.
+//
+// Wraps the tinfl inflater that ships in the ESP32 ROM. Memory is fixed at
+// the 32 KB deflate window plus the decoder state no matter how large the
+// job is; decoded bytes are handed to the output callback straight out of
+// the window as they are produced.
+
+// Receives decoded data. Returns false to stop decoding.
+typedef bool (*InflateOutput)(void* context, const uint8_t* data, size_t length);
+
+enum InflateStatus {
+  INFLATE_MORE_INPUT,  // Everything so far decoded, stream not finished
+  INFLATE_DONE,        // Final block decoded
+  INFLATE_ERROR        // Corrupt stream or the output refused the data
+};
+
+class InflateStream {
+public:
+  InflateStream() = default;
+  ~InflateStream();
+
+  InflateStream(const InflateStream&) = delete;
+  InflateStream& operator=(const InflateStream&) = delete;
+
+  // Allocate the window and decoder state, preferring PSRAM. zlib selects
+  // the RFC 1950 wrapper (HTTP "deflate"), otherwise raw RFC 1951 data.
+  bool begin(bool zlib, InflateOutput output, void* context);
+  void end();
+
+  // Decode one piece of compressed input
+  InflateStatus feed(const uint8_t* data, size_t length);
+
+  InflateStatus status() const { return _status; }
+  size_t decoded() const { return _decoded; }
+
+private:
+  void* _decompressor = nullptr;
+  uint8_t* _window = nullptr;
+  size_t _windowPos = 0;
+  uint32_t _flags = 0;
+  InflateStatus _status = INFLATE_ERROR;
+  size_t _decoded = 0;
+  InflateOutput _output = nullptr;
+  void* _context = nullptr;
+};
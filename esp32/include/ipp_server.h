@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "image_raster.h"
+
+// Minimal IPP Everywhere printer on the web server, so phones and laptops
+// print driverlessly: they find the bridge over mDNS (_ipp._tcp), ask for
+// its attributes and send pages already rendered as PWG Raster or Apple
+// Raster for the advertised resolution and media. The document is decoded
+// row by row as the body arrives (see pwg_raster.h) into ESC/POS or TSPL
+// raster, so nothing but a few rows is held in memory.
+//
+// POST /ipp/print goes to the first printer of the registry and
+// /ipp/print/<id> to the printer of that ID. Operations: Print-Job,
+// Validate-Job, Cancel-Job, Get-Job-Attributes, Get-Jobs and
+// Get-Printer-Attributes. The operation attributes are read up to the
+// end-of-attributes tag; the rest of the body is the document. Responses
+// carry all attributes of a group whatever requested-attributes asks for.
+//
+// Only the first printer is advertised over mDNS; the others are reached by
+// configuring their URI by hand.
+
+#ifndef IPP_PATH
+#define IPP_PATH "/ipp/print"
+#endif
+#ifndef IPP_MAX_ATTRIBUTES
+#define IPP_MAX_ATTRIBUTES 4096      // Bytes of a request before its document
+#endif
+#ifndef IPP_DEFAULT_DPI
+#define IPP_DEFAULT_DPI 203          // Printers without dpi= in printers.conf
+#endif
+#ifndef IPP_DEFAULT_DOTS
+#define IPP_DEFAULT_DOTS 384         // Printers without dots= in printers.conf
+#endif
+#ifndef IPP_MEDIA_LENGTH_MM
+#define IPP_MEDIA_LENGTH_MM 100      // Page length advertised for the roll
+#endif
+#ifndef IPP_COMMAND_SET
+#define IPP_COMMAND_SET IMAGE_ESCPOS
+#endif
+#ifndef IPP_DITHER
+#define IPP_DITHER DITHER_ATKINSON
+#endif
+#ifndef IPP_MDNS_HOSTNAME
+#define IPP_MDNS_HOSTNAME "print-bridge" // Empty to not advertise
+#endif
+
+// Register the IPP route and advertise it. Rasters reach their job through
+// output, called with a pointer to the job ID as context.
+void initIppServer(AsyncWebServer& server, ImageOutput output);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <mbedtls/sha256.h>
+
+// Command streams of earlier jobs kept on LittleFS under their SHA-256.
+//
+// A /print upload that names its hash in X-Job-Hash is stored as it passes
+// through, and only once the received stream matches the hash. Repeats are
+// replayed from flash by a task of their own into a freshly admitted job, so
+// the client doesn't have to upload them again. The least recently used
+// jobs are dropped to stay within JOB_CACHE_BUDGET.
+
+#ifndef JOB_CACHE_DIR
+#define JOB_CACHE_DIR "/cache"
+#endif
+#ifndef JOB_CACHE_BUDGET
+#define JOB_CACHE_BUDGET (1024 * 1024)    // Flash for cached jobs, 0 disables the cache
+#endif
+#ifndef JOB_CACHE_ENTRIES
+#define JOB_CACHE_ENTRIES 32              // Jobs cached at most
+#endif
+#ifndef JOB_CACHE_CORE
+#define JOB_CACHE_CORE 0
+#endif
+#ifndef JOB_CACHE_PRIORITY
+#define JOB_CACHE_PRIORITY 2
+#endif
+
+// Hex digits of a job hash
+static const size_t JOB_HASH_LENGTH = 64;
+
+// Index the cached jobs and start the replay task. Call after LittleFS is mounted.
+bool initJobCache();
+
+// 64 hex digits, either case
+bool isJobHash(const String& text);
+
+// Whether the job is cached, and its size
+bool jobCacheLookup(const String& hash, size_t& length);
+
+// Hash of the job cached or replayed last; false when the cache is empty
+bool lastCachedJob(String& hash);
+
+// Call fn with the hash and size of every cached job, most recently used
+// first. fn runs with the cache locked and must not call back into it.
+void forEachCachedJob(void (*fn)(const char* hash, size_t length, void* context), void* context);
+
+// Stream a cached job into an admitted job of the size jobCacheLookup()
+// gave and finish it. False when the job is no longer cached or too many
+// replays are waiting; the job is left to the caller then.
+bool replayCachedJob(const String& hash, uint32_t jobId);
+
+// Copy of an upload on its way into the cache. An upload that is never
+// committed, or doesn't match its hash, leaves nothing behind.
+class JobCacheRecorder {
+public:
+  JobCacheRecorder() = default;
+  ~JobCacheRecorder();
+
+  JobCacheRecorder(const JobCacheRecorder&) = delete;
+  JobCacheRecorder& operator=(const JobCacheRecorder&) = delete;
+
+  // False when the cache is disabled or the copy can't be created
+  bool begin(const String& hash);
+
+  // Next piece of the command stream. A job larger than the budget or a
+  // failing write quietly stops the copy.
+  void write(const uint8_t* data, size_t length);
+
+  // The stream is complete: keep it when it matches the hash. True when
+  // the job is cached now.
+  bool commit();
+
+private:
+  void discard();
+
+  bool _active = false;
+  char _hash[JOB_HASH_LENGTH + 1];
+  String _path;
+  File _file;
+  size_t _length = 0;
+  mbedtls_sha256_context _sha;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "print_writer.h"
+#include "text_run.h"
+
+// Job control panel on the LCD: the queue, and buttons to cancel the job
+// printing, pause or resume the printers and reprint the last cached job.
+//
+// The panel is drawn with TFT_eSPI_Button and worked with the hardware
+// button: a short press opens it and moves to the next control, a long
+// press uses the one selected. With a touch controller (TOUCH_CS in the
+// TFT_eSPI setup; SPI panels only) the controls are tapped as well. The
+// display task samples touch every JOB_PANEL_TOUCH_MS, and getTouch() takes
+// the shared SPI bus through spi_begin_touch(). With the controller's pen
+// line on TOUCH_IRQ it samples only from pen down to lift, woken by the
+// interrupt, and leaves the bus to the display otherwise. The panel closes after
+// JOB_PANEL_TIMEOUT_MS without input.
+
+#ifndef JOB_PANEL_TIMEOUT_MS
+#define JOB_PANEL_TIMEOUT_MS 10000
+#endif
+#ifndef JOB_PANEL_TOUCH_MS
+#define JOB_PANEL_TOUCH_MS 50
+#endif
+#define JOB_PANEL_ROWS 6               // Jobs listed
+
+enum JobPanelAction {
+  PANEL_NONE,
+  PANEL_CANCEL,
+  PANEL_PAUSE,
+  PANEL_REPRINT
+};
+
+class JobPanel {
+public:
+  void begin(TFT_eSPI* tft);
+
+  bool isOpen() const { return _open; }
+  void open();
+  void close() { _open = false; }
+  // Closed for lack of input
+  bool expired() const { return _open && millis() - _lastInput >= JOB_PANEL_TIMEOUT_MS; }
+
+  // Hardware button: select the next control, or use the selected one
+  void next();
+  JobPanelAction activate();
+  // Touch sample; returns the control released over, if any
+  JobPanelAction touch(bool pressed, int16_t x, int16_t y);
+
+  // Redraw what changed; paused is the state the pause control toggles
+  void draw(const PrintJobInfo* jobs, size_t count, bool paused);
+
+private:
+  static const uint8_t CONTROLS = 3;
+
+  TFT_eSPI* _tft = nullptr;
+  TFT_eSPI_Button _buttons[CONTROLS];
+  TextRun _title;
+  TextRun _rows[JOB_PANEL_ROWS];
+  char _labels[CONTROLS][8];
+  bool _open = false;
+  bool _fresh = false;           // Opened since the last draw
+  uint8_t _selected = 0;
+  uint8_t _drawnSelected = 0xFF;
+  int8_t _drawnPaused = -1;
+  unsigned long _lastInput = 0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include "label_template.h"
+
+// Runs of serial labels, such as asset tags, from one template request.
+//
+//   POST /print/template/{name}/series?field=serial&start=1000&count=500
+//        &step=1&format=A-%05d
+//
+// with the other field values in the body as for /print/template. Label i
+// gets start + i * step in field, written with format: any text with one
+// %d, optionally %0<width>d or %<width>d, and %% for a percent sign; plain
+// %d when left out. The first label is rendered in the request, so a bad
+// template or field is answered like a single label's. The rest render on
+// a task of their own into the same job, back to back, each only redrawing
+// the rows of the counter. The job stops at the next label once it is
+// cancelled or fails.
+
+#ifndef LABEL_SERIES_MAX
+#define LABEL_SERIES_MAX 10000             // Labels in one series
+#endif
+#ifndef LABEL_SERIES_FORMAT
+#define LABEL_SERIES_FORMAT 32             // Longest format
+#endif
+#ifndef LABEL_SERIES_QUEUE
+#define LABEL_SERIES_QUEUE 4               // Series waiting for the task
+#endif
+#ifndef LABEL_SERIES_CORE
+#define LABEL_SERIES_CORE 1
+#endif
+#ifndef LABEL_SERIES_PRIORITY
+#define LABEL_SERIES_PRIORITY 2
+#endif
+
+struct LabelSeries {
+  String name;
+  String field;
+  char format[LABEL_SERIES_FORMAT + 1];
+  int32_t start;
+  int32_t step;
+  uint32_t count;
+  ImageRasterOptions options;
+  LabelPrinter printer;
+  bool hasPrinter;                 // Known, not left to a pool
+  uint32_t jobId;
+  size_t length;
+  char body[LABEL_MAX_REQUEST];    // Flat JSON object of the other fields
+};
+
+// Start the series task. Call once, after initLabelTemplates().
+bool initLabelSeries();
+
+// Whether format has the one %d a counter needs
+bool validSeriesFormat(const char* format);
+
+// Render label index of the series into output
+LabelResult printSeriesLabel(const LabelSeries& series, uint32_t index, ImageOutput output, void* context,
+                             String& detail);
+
+// Hand the labels after the first to the series task, which finishes or
+// fails the job and deletes series, allocated with new. False when too
+// many series are waiting; series is still the caller's then.
+bool queueLabelSeries(LabelSeries* series);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "image_raster.h"
+
+// Label layouts stored on the bridge, printed with field values only.
+//
+// A template is a text file /templates/<name>.tpl, one element per line:
+//
+//   size <width> <height> [dpi=] [rotate=90]  label size in dots; rotate prints it turned clockwise
+//   bitmap <x> <y> <file.pbm> [stored]    static PBM (P4) from /templates
+//   text <x> <y> <field> [font=] [size=] [align=left|center|right] [tspl_font=1-8]
+//   barcode <x> <y> <field> [type=code128|ean13|qr|datamatrix] [height=] [module=] [tspl=1]
+//
+// font= is a built-in font number or the name of a smooth font (.vlw) on
+// LittleFS. Barcode height and module take dots or mm ("0.33mm"), the
+// latter scaled by the dpi of the size line. Static bitmaps are composed once into a base raster kept until
+// the template file changes; each print copies it into a 1-bit sprite, draws
+// the text and barcode fields over it and sends the rows to the printer.
+// The sprite is kept between prints, so the next label of the same template
+// only restores and redraws the rows of fields whose values changed.
+//
+// A stored bitmap is downloaded into the printer's own memory the first time
+// a label goes to that printer and printed from there by key afterwards (see
+// printer_artwork.h). It doesn't turn with rotate=90. On ESC/POS it is
+// printed as a block of its own, so its rows must hold nothing else; where
+// they do, or without a printer to keep it, the bitmap is sent as part of
+// the raster like any other.
+//
+// On TSPL, a text with tspl_font= is printed with that resident printer
+// font, and a barcode with tspl=1 with the printer's own BARCODE, QRCODE or
+// DMATRIX, sent as commands after the raster instead of drawn into it. The
+// fonts are fixed pitch, so a table of their cells keeps center and right
+// alignment in place. ESC/POS jobs, turned labels and negatives still draw
+// these elements into the raster, text with its font=.
+
+#ifndef LABEL_TEMPLATE_DIR
+#define LABEL_TEMPLATE_DIR "/templates"
+#endif
+#ifndef LABEL_MAX_ELEMENTS
+#define LABEL_MAX_ELEMENTS 16
+#endif
+#ifndef LABEL_MAX_ARTWORK
+#define LABEL_MAX_ARTWORK 4        // Stored bitmaps per template
+#endif
+#ifndef LABEL_MAX_FIELDS
+#define LABEL_MAX_FIELDS 16        // Values in one request
+#endif
+#ifndef LABEL_CACHED_TEMPLATES
+#define LABEL_CACHED_TEMPLATES 2   // Base rasters kept between prints
+#endif
+#ifndef LABEL_MAX_REQUEST
+#define LABEL_MAX_REQUEST 2048     // JSON body of a template print
+#endif
+#ifndef LABEL_DEFAULT_DPI
+#define LABEL_DEFAULT_DPI 203      // Head resolution unless the size line says dpi=
+#endif
+// Barcode defaults, converted to dots at the template's resolution
+#ifndef LABEL_BAR_MODULE_MM
+#define LABEL_BAR_MODULE_MM 0.25f
+#endif
+#ifndef LABEL_MATRIX_MODULE_MM
+#define LABEL_MATRIX_MODULE_MM 0.5f
+#endif
+#ifndef LABEL_BARCODE_HEIGHT_MM
+#define LABEL_BARCODE_HEIGHT_MM 8.0f
+#endif
+#ifndef LABEL_MAX_DOTS
+#define LABEL_MAX_DOTS 2048        // Longest side
+#endif
+
+enum LabelResult {
+  LABEL_OK,
+  LABEL_NOT_FOUND,
+  LABEL_INVALID,         // Bad template file or field values
+  LABEL_MISSING_FIELD,
+  LABEL_NO_MEMORY,
+  LABEL_OUTPUT           // The output refused the commands
+};
+
+const char* labelResultName(LabelResult result);
+
+// Printer a label goes to, for the bitmaps it keeps
+struct LabelPrinter {
+  uint8_t index;
+  String mac;
+  bool resend;                     // Download stored bitmaps even if they should be there
+};
+
+// Sprites for the labels are created against the display driver
+void initLabelTemplates(TFT_eSPI* display);
+
+// Render template name with the fields of a flat JSON object of strings or
+// numbers and write the printer commands to output. printer is nullptr when
+// it isn't known which printer the job ends up on. detail names the field
+// or line at fault.
+LabelResult printLabelTemplate(const String& name, const char* json, size_t length,
+                               const ImageRasterOptions& options, const LabelPrinter* printer,
+                               ImageOutput output, void* context, String& detail);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// On-device benchmark of the BLE data path.
+//
+// A run writes NUL bytes to one printer's characteristic in chunks of a
+// given size and write mode, the way BlePrinter::write() sends job data
+// but past the raster re-encoder, while that printer's writer is held. A
+// sweep is every chunk size with every mode. Each run reports bytes/s and
+// the chunk latency percentiles of LinkMetrics, next to the MTU, PHY,
+// connection interval and data length the link had.
+//
+// The MTU and connection parameters take a reconnect to change, so sweeps
+// across them are driven from outside: POST /config, /disconnect and
+// /connect, then one sweep per setting. The JSON is meant to be stored per
+// firmware version and compared run by run.
+//
+// ESC/POS printers ignore NUL but still take the airtime and may pace the
+// link. Another ESP32 or any peripheral with a writable characteristic,
+// entered in the printer list like a printer, gives steadier numbers.
+//
+//   POST /bench?printer=<id>&bytes=32768&chunks=20,128,244,512&modes=ack,nr
+//        202 once started, 409 while the printer is busy or a sweep runs
+//   GET  /bench
+//        {"state":"running","printer":"default","mtu":517,"phy2M":true,
+//         "connIntervalMs":7.5,"dataLength":251,"bytes":32768,
+//         "runs":[{"chunk":244,"mode":"nr","bytes":32768,"ms":410,
+//                  "bytesPerSec":79921,"p50Us":500,"p90Us":1000,"p99Us":5000,
+//                  "writeErrors":0,"ok":true}, ...]}
+//
+// A job run leaves the link alone and times a whole job through the
+// printer's writer and pipeline instead, the way a client's would go,
+// generated on the bridge so Wi-Fi and the client are out of the numbers.
+// The pattern is NUL bytes, or the calibration or density label of the Go
+// tool as TSPL, repeated until bytes are reached. Bytes/s is over the job's
+// first to last write, and the percentiles over its chunks' latencies.
+//
+//   POST /bench/ble?printer=<id>&pattern=nul|calibration|density&bytes=N
+//        &width=58&height=30&speed=4&density=8&marginX=0&marginY=0
+//        202 once started, 409 while the printer is busy or a benchmark runs
+//   GET  /bench/ble
+//        {"state":"done","printer":"default","pattern":"density","job":12,
+//         "pipeline":"recode,send","jobState":"done","generated":2260,
+//         "bytes":2260,"ms":95,"bytesPerSec":23789,"p50Us":2000,
+//         "p90Us":5000,"p99Us":5000,"writeErrors":0}
+
+#ifndef BENCH_PATH
+#define BENCH_PATH "/bench"
+#endif
+#ifndef BENCH_DEFAULT_BYTES
+#define BENCH_DEFAULT_BYTES (32 * 1024)    // Per run
+#endif
+#ifndef BENCH_MAX_BYTES
+#define BENCH_MAX_BYTES (1024 * 1024)
+#endif
+#ifndef BENCH_MAX_RUNS
+#define BENCH_MAX_RUNS 24                  // Chunk sizes times modes
+#endif
+
+// Register GET and POST BENCH_PATH and BENCH_PATH "/ble" on the server
+void initLinkBench(AsyncWebServer& server);
+
+// TSPL of the calibration or density label of BENCH_PATH "/ble" with its
+// default speed, density and margins, for other load generators
+// (soak_test.h)
+void appendBenchLabel(String& out, bool density, uint16_t widthMm, uint16_t heightMm);
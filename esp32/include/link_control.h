@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// AIMD control of GATT writes from what the link does: the chunk size, the
+// writes without response in flight and a gap between chunks.
+//
+// The writer reports each chunk with the time it took, from waiting for a
+// TX buffer to the stack taking it (or the printer acknowledging it), and
+// whether it failed. Every LINK_CONTROL_ROUND chunks the round is judged
+// against the best time per byte seen on this connection:
+//
+// - A failed write means the printer or the stack dropped data, so the
+//   window halves, the chunk halves and the gap grows.
+// - A TX credit timeout means the controller's buffers are backing up.
+//   The window halves; at a window of one the gap grows instead.
+// - A round LINK_CONTROL_SLOWDOWN_PCT slower than the best with more than
+//   one write in flight halves the window.
+// - A clean round first shrinks the gap, then grows the chunk by
+//   LINK_CONTROL_CHUNK_STEP, then the window by one.
+//
+// Control starts at the limits, which is how the writer ran before, and
+// only backs off when the link asks for it. The best time drifts up a
+// little every round, so it follows a link that got slower for good. An
+// RSSI below LINK_CONTROL_WEAK_RSSI halves the window it may grow to, as
+// each lost packet then holds up everything queued behind it.
+//
+// It has no Arduino dependencies and builds on a host as it is.
+
+#ifndef LINK_CONTROL
+#define LINK_CONTROL 1                  // 0 keeps the limits fixed
+#endif
+#ifndef LINK_CONTROL_ROUND
+#define LINK_CONTROL_ROUND 32           // Chunks judged together
+#endif
+#ifndef LINK_CONTROL_MIN_CHUNK
+#define LINK_CONTROL_MIN_CHUNK 20       // Bytes; the payload of the default MTU
+#endif
+#ifndef LINK_CONTROL_CHUNK_STEP
+#define LINK_CONTROL_CHUNK_STEP 20
+#endif
+#ifndef LINK_CONTROL_MAX_GAP_MS
+#define LINK_CONTROL_MAX_GAP_MS 20
+#endif
+#ifndef LINK_CONTROL_SLOWDOWN_PCT
+#define LINK_CONTROL_SLOWDOWN_PCT 150   // Round time per byte against the best
+#endif
+#ifndef LINK_CONTROL_WEAK_RSSI
+#define LINK_CONTROL_WEAK_RSSI -80      // dBm
+#endif
+
+class LinkController {
+public:
+  // A new connection: forget what the last one learned
+  void begin(size_t maxChunk, uint16_t maxWindow);
+
+  // Limits from the negotiated MTU and /config, applied to the next round
+  void setLimits(size_t maxChunk, uint16_t maxWindow);
+
+  // One chunk written; true when it ended a round
+  bool chunkDone(size_t bytes, uint32_t elapsedUs, bool ok);
+  void creditTimeout() { _roundCreditTimeouts++; }
+  // Connection RSSI in dBm
+  void rssi(int8_t dBm) { _rssi = dBm; }
+
+  size_t chunkSize() const { return _chunk; }
+  uint16_t window() const { return _window; }
+  uint8_t gapMs() const { return _gapMs; }
+  int8_t lastRssi() const { return _rssi; }
+  // The last round failed a write, timed out on a credit or slowed down
+  bool degraded() const { return _degraded; }
+
+private:
+  void endRound();
+  uint16_t windowLimit() const;
+  void growGap();
+
+  size_t _maxChunk = LINK_CONTROL_MIN_CHUNK;
+  uint16_t _maxWindow = 1;
+  size_t _chunk = LINK_CONTROL_MIN_CHUNK;
+  uint16_t _window = 1;
+  uint8_t _gapMs = 0;
+  int8_t _rssi = 0;               // 0 until read
+  bool _degraded = false;
+
+  uint32_t _bestNsPerByte = 0;    // 0 until the first round
+
+  uint16_t _roundChunks = 0;
+  uint32_t _roundBytes = 0;
+  uint64_t _roundUs = 0;
+  uint16_t _roundErrors = 0;
+  uint16_t _roundCreditTimeouts = 0;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Transmit telemetry of one BLE printer, kept in RAM.
+//
+// Only that printer's writer task and link task record into it; HTTP
+// handlers read it without locking. A reader may see a sample half counted,
+// which is harmless for monitoring.
+
+// Upper bounds of the chunk write latency buckets in microseconds. A chunk's
+// latency is the time from asking for a TX slot to the write being queued
+// or, for acknowledged writes, answered.
+static const uint32_t LINK_LATENCY_BOUNDS_US[] = {
+  250, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 250000, 1000000
+};
+static const size_t LINK_LATENCY_BUCKETS = sizeof(LINK_LATENCY_BOUNDS_US) / sizeof(LINK_LATENCY_BOUNDS_US[0]) + 1;
+
+// Seconds of per-second byte counts kept for the sliding throughput windows
+static const size_t LINK_RATE_SECONDS = 60;
+
+class LinkMetrics {
+public:
+  void recordChunk(size_t bytes, uint32_t latencyUs, bool acknowledged);
+  void recordCreditTimeout() { _creditTimeouts++; }
+  void recordWriteError() { _writeErrors++; }
+  void recordConnect(bool ok) { ok ? _connects++ : _connectFailures++; }
+  void recordDisconnect() { _disconnects++; }
+  void recordFlowPause(uint32_t ms) { _flowPauses++; _flowPausedMs += ms; }
+  // Time held back by the buffer model of a printer without status
+  void recordPacing(uint32_t ms) { _pacedMs += ms; }
+
+  // Bytes/s averaged over the last seconds, at most LINK_RATE_SECONDS. The
+  // second in progress is left out.
+  uint32_t rate(size_t seconds) const;
+
+  // Latency below which the given share (0..1) of chunks completed, from
+  // the bucket bounds; 0 before the first chunk
+  uint32_t latencyPercentileUs(float share) const;
+  // The same over LINK_LATENCY_BUCKETS counts of one's own, such as the
+  // difference of two readings of bucketCount()
+  static uint32_t percentileUs(const uint32_t* buckets, float share);
+
+  uint32_t bucketCount(size_t bucket) const { return _buckets[bucket]; }
+  uint64_t latencySumUs() const { return _latencySumUs; }
+
+  uint32_t bytes() const { return _bytes; }
+  uint32_t chunks() const { return _ackWrites + _noResponseWrites; }
+  uint32_t ackWrites() const { return _ackWrites; }
+  uint32_t noResponseWrites() const { return _noResponseWrites; }
+  uint32_t creditTimeouts() const { return _creditTimeouts; }
+  uint32_t writeErrors() const { return _writeErrors; }
+  uint32_t connects() const { return _connects; }
+  uint32_t connectFailures() const { return _connectFailures; }
+  uint32_t disconnects() const { return _disconnects; }
+  uint32_t flowPauses() const { return _flowPauses; }
+  uint32_t flowPausedMs() const { return _flowPausedMs; }
+  uint32_t pacedMs() const { return _pacedMs; }
+
+private:
+  volatile uint32_t _buckets[LINK_LATENCY_BUCKETS] = {};
+  volatile uint64_t _latencySumUs = 0;
+
+  // Ring of per-second byte counts; _second is the second the slot at
+  // _second % LINK_RATE_SECONDS belongs to
+  volatile uint32_t _perSecond[LINK_RATE_SECONDS] = {};
+  volatile uint32_t _second = 0;
+
+  volatile uint32_t _bytes = 0;
+  volatile uint32_t _ackWrites = 0;
+  volatile uint32_t _noResponseWrites = 0;
+  volatile uint32_t _creditTimeouts = 0;
+  volatile uint32_t _writeErrors = 0;
+  volatile uint32_t _connects = 0;
+  volatile uint32_t _connectFailures = 0;
+  volatile uint32_t _disconnects = 0;
+  volatile uint32_t _flowPauses = 0;
+  volatile uint32_t _flowPausedMs = 0;
+  volatile uint32_t _pacedMs = 0;
+};
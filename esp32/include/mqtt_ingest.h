@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Print jobs pulled from an MQTT broker, for warehouse systems that publish
+// labels instead of posting them.
+//
+// The client subscribes to <MQTT_TOPIC_PREFIX>/<printer id>/jobs at QoS 1
+// for every printer of the registry. Each message is one job: its payload
+// streams into the job queue in MQTT_BUFFER_SIZE pieces as it arrives.
+// While the printer's queue is full, the client holds the message for up
+// to MQTT_ADMIT_WAIT_MS, and while its buffer is full the client stops
+// reading, so the broker and the TCP window hold back the rest. The PUBACK
+// only goes out once the whole message is queued, spooled or refused. A
+// message for a disconnected printer goes to the spool when there is room.
+//
+// The session is persistent (clean session off, client ID fixed per
+// bridge), so QoS 1 messages published while the bridge was away arrive
+// after it reconnects. Outcomes are collected and published together, once
+// per MQTT_STATUS_INTERVAL_MS, to <prefix>/<printer id>/status as
+//   {"jobs":[{"job":12,"state":"done"},{"state":"rejected","reason":"..."}],"queue":1}
+// esp-mqtt acknowledges each message itself; it sends the PUBACK after the
+// handler returns and can't group them.
+
+#ifndef MQTT_BROKER_URI
+#define MQTT_BROKER_URI ""                 // e.g. "mqtt://broker.local", empty disables MQTT
+#endif
+#ifndef MQTT_CLIENT_ID
+#define MQTT_CLIENT_ID ""                  // Empty for bridge-<MAC tail>
+#endif
+#ifndef MQTT_USERNAME
+#define MQTT_USERNAME ""
+#endif
+#ifndef MQTT_PASSWORD
+#define MQTT_PASSWORD ""
+#endif
+#ifndef MQTT_TOPIC_PREFIX
+#define MQTT_TOPIC_PREFIX "printers"
+#endif
+#ifndef MQTT_KEEPALIVE_S
+#define MQTT_KEEPALIVE_S 30
+#endif
+#ifndef MQTT_BUFFER_SIZE
+#define MQTT_BUFFER_SIZE 4096              // Payload piece handed to the job queue at a time
+#endif
+#ifndef MQTT_ADMIT_WAIT_MS
+#define MQTT_ADMIT_WAIT_MS 20000           // Below the keepalive grace, so the broker keeps us
+#endif
+#ifndef MQTT_STATUS_INTERVAL_MS
+#define MQTT_STATUS_INTERVAL_MS 1000
+#endif
+#ifndef MQTT_TRACKED_JOBS
+#define MQTT_TRACKED_JOBS 16               // Outcomes waiting to be published
+#endif
+
+// Connect to the broker and subscribe; no-op without MQTT_BROKER_URI
+void initMqttIngest();
+
+// Publish the outcomes collected since the last call, at most every
+// MQTT_STATUS_INTERVAL_MS. Call periodically from one task.
+void serviceMqttIngest();
+
+// Connected to the broker
+bool mqttIngestConnected();
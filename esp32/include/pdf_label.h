@@ -0,0 +1,62 @@
+#pragma once
+
+#include <Arduino.h>
+#include "image_raster.h"
+
+// Carrier-label PDFs printed without a PDF renderer.
+//
+// The labels that carrier APIs hand out as PDF are almost always one
+// full-page bitmap per page: a CCITT G4 or deflated 1-bit image, placed
+// with a cm and drawn with Do, and nothing else. The fast path reads just
+// enough of the file to find that image: the objects (object streams
+// included), the page tree with its inherited resources and /Rotate, and
+// the page's content stream for the image's placement. The image is
+// decoded into a 1-bit bitmap as it inflates or its G4 rows come out,
+// turned upright, rotated so a landscape label runs along the paper, scaled
+// to the paper width and sent through the RasterCommandWriter, one label
+// per page.
+//
+// Images: 1-bit DeviceGray or ImageMask, or 8-bit gray or RGB (thresholded),
+// unfiltered, FlateDecode (PNG predictors included) or CCITTFaxDecode with
+// K < 0. Anything that needs a real renderer is refused with PDF_UNSUPPORTED
+// and a detail saying what: text, vector artwork other than white fills and
+// clipping paths, form XObjects, inline images, shadings, JPEG and other
+// filters, more than one image on a page, skewed placement, encryption.
+
+#ifndef PDF_MAX_BYTES
+#define PDF_MAX_BYTES (1024 * 1024)    // Largest upload, held whole in PSRAM
+#endif
+#ifndef PDF_MAX_OBJECTS
+#define PDF_MAX_OBJECTS 1024           // Objects indexed
+#endif
+#ifndef PDF_MAX_PAGES
+#define PDF_MAX_PAGES 32               // Labels of one upload
+#endif
+#ifndef PDF_MAX_CONTENT
+#define PDF_MAX_CONTENT (64 * 1024)    // Decoded content stream of one page
+#endif
+#ifndef PDF_MAX_IMAGE_DOTS
+#define PDF_MAX_IMAGE_DOTS 4096        // Longest side of a page's image
+#endif
+
+enum PdfResult {
+  PDF_OK,
+  PDF_INVALID,       // Not a PDF, or its structure or image data is broken
+  PDF_UNSUPPORTED,   // Needs full rendering
+  PDF_TOO_LARGE,     // Over PDF_MAX_BYTES, PDF_MAX_PAGES or the image limits
+  PDF_NO_MEMORY,
+  PDF_OUTPUT         // The output refused the commands
+};
+
+const char* pdfResultName(PdfResult result);
+
+struct PdfLabelOptions {
+  ImageRasterOptions raster;
+  uint16_t width = 0;     // Dots to scale the label to; 0 keeps the image's
+  int16_t rotate = -1;    // Clockwise 0, 90, 180 or 270; -1 turns landscape labels
+};
+
+// Print every page of a PDF held in memory as one label. pages is the
+// number printed; detail says what was wrong or unsupported, and where.
+PdfResult printPdfLabel(const uint8_t* pdf, size_t length, const PdfLabelOptions& options,
+                        ImageOutput output, void* context, uint16_t& pages, String& detail);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Power profile for battery-powered bridges.
+//
+// With POWER_SAVE set, Wi-Fi sleeps through beacons for up to
+// POWER_WAKE_LATENCY_MS and only wakes for traffic the access point buffered
+// for it, the CPU scales down to POWER_MIN_CPU_MHZ and enters automatic
+// light sleep between jobs, and the periodic upkeep slows down while nothing
+// prints. TCP traffic, the BLE stack and the button on its GPIO wake it.
+// BLE keeps scanning only while a printer is not connected, in either
+// profile. Light sleep needs a framework built with power management and
+// tickless idle; without it the profile falls back to frequency scaling.
+//
+// With POWER_SCALING, also the default, the clock scales in both profiles:
+// the print writers, screen updates and uploads hold it at full speed only
+// while they run, so printing is as fast as at a fixed clock. Light sleep
+// stays with POWER_SAVE, because it adds wake latency to every request.
+
+#ifndef POWER_SAVE
+#define POWER_SAVE 0                   // 1 for the battery profile
+#endif
+#ifndef POWER_WAKE_LATENCY_MS
+#define POWER_WAKE_LATENCY_MS 300      // Worst-case delay a sleeping bridge adds to a request
+#endif
+#ifndef POWER_MIN_CPU_MHZ
+#define POWER_MIN_CPU_MHZ 80           // Lowest CPU clock between jobs
+#endif
+#ifndef POWER_SCALING
+#define POWER_SCALING 1                // 0 for a fixed clock outside the battery profile
+#endif
+#ifndef POWER_INGEST_HOLD_MS
+#define POWER_INGEST_HOLD_MS 200       // Full speed kept after the last upload piece
+#endif
+
+// Parts of the bridge that need full speed while they are active
+enum PowerUser : uint8_t {
+  POWER_WRITER,                        // A print writer moving data: CPU clock
+  POWER_DISPLAY,                       // A screen update on the SPI bus: APB clock, no sleep mid-DMA
+  POWER_INGEST,                        // Uploads arriving: CPU clock
+  POWER_USERS
+};
+
+// Apply the profile's CPU settings and let the button wake light sleep.
+// Call before initWifiLink().
+void initPowerProfile(uint8_t wakePin);
+
+// Full speed for user until the matching powerRelease(). Holds count, and
+// may be taken and released from any task. No-ops at a fixed clock.
+void powerHold(PowerUser user);
+void powerRelease(PowerUser user);
+
+// An upload piece arrived: holds POWER_INGEST until none came for
+// POWER_INGEST_HOLD_MS, for ingest paths without a clear end
+void powerIngestActive();
+
+// Drop the ingest hold once uploads went quiet. Call periodically from one task.
+void servicePowerProfile();
+
+// Apply the profile's modem sleep. Call once Wi-Fi is started.
+void applyWifiPowerSave();
+
+// Beacon intervals Wi-Fi may sleep through, 0 to wake for every DTIM
+uint16_t wifiListenInterval();
+
+// Period of upkeep that may run slower while the bridge is idle
+uint32_t idleIntervalMs(uint32_t activeMs, bool idle);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "print_slice.h"
+
+// The chain of stages a printer's job data runs through on its way from the
+// job buffer to the link, as its profile lists them (printer_profile.h).
+//
+// Each stage is a PrintSink that takes one slice at a time and pushes what
+// it makes on to the stage after it, through output() and outputContext().
+// Stages hold back no more than their own bounded buffers (a band, a few
+// source rows), so a job is never copied whole between two of them. An empty
+// slice ends the job: the pipeline hands it to every stage in turn, so each
+// flushes what it still holds into the next before the next sees the end.
+//
+// The time spent in each stage is counted apart from the time spent in the
+// stages it pushed to, so the counters add up to the time the chain took
+// and show which stage costs what.
+
+enum PipelineStage : uint8_t {
+  STAGE_RESAMPLE,          // raster_resample.h: head resolution and width
+  STAGE_RECODE,            // raster_recoder.h: bands, blank feeds, crop, split
+  STAGE_SEND,              // The link: chunks, flow control, buffer pacing
+  PIPELINE_STAGE_KINDS
+};
+
+// Each kind of stage runs once at most
+#define PIPELINE_MAX_STAGES PIPELINE_STAGE_KINDS
+// Chain of printers whose profile has no pipeline=; send always comes last
+#ifndef PRINTER_PIPELINE
+#define PRINTER_PIPELINE "resample,recode"
+#endif
+
+struct PipelineStageStats {
+  uint64_t micros;         // In the stage itself, not in those after it
+  uint64_t bytes;          // Taken in
+  uint32_t slices;
+};
+
+const char* pipelineStageName(PipelineStage stage);
+
+// Comma-separated stage names, none for an empty list, into chain. False on
+// an unknown or repeated name, or send anywhere but last.
+bool parsePipeline(const char* text, uint8_t* chain, uint8_t& length);
+
+class PrintPipeline {
+public:
+  PrintPipeline();
+  PrintPipeline(const PrintPipeline&) = delete;
+  PrintPipeline& operator=(const PrintPipeline&) = delete;
+
+  // Where each kind of stage runs; a chain only uses the kinds it lists
+  void setStage(PipelineStage stage, PrintSink process, void* context);
+
+  // The stages in the order the data goes through them
+  void configure(const uint8_t* chain, uint8_t length);
+  uint8_t length() const { return _length; }
+  PipelineStage stage(uint8_t position) const { return (PipelineStage)_chain[position]; }
+  bool contains(PipelineStage stage) const { return _position[stage] < _length; }
+
+  // The sink a stage pushes its output into. The context stays valid across
+  // configure(), which only changes where it leads; output of the last stage
+  // in the chain, or of a stage not in it, is dropped.
+  static PrintSink output() { return forward; }
+  void* outputContext(PipelineStage stage) { return &_links[stage]; }
+
+  // Push one slice into the first stage; an empty one ends the job in all
+  bool process(const PrintSlice& slice);
+
+  const PipelineStageStats& stats(PipelineStage stage) const { return _stats[stage]; }
+
+private:
+  struct Link {
+    PrintPipeline* pipeline;
+    PipelineStage from;
+  };
+
+  static bool forward(void* context, const PrintSlice& slice);
+  bool run(uint8_t position, const PrintSlice& slice);
+
+  PrintSink _process[PIPELINE_STAGE_KINDS] = {};
+  void* _context[PIPELINE_STAGE_KINDS] = {};
+  Link _links[PIPELINE_STAGE_KINDS] = {};
+  uint8_t _chain[PIPELINE_MAX_STAGES] = {};
+  uint8_t _position[PIPELINE_STAGE_KINDS] = {};  // In _chain, _length when not in it
+  uint8_t _length = 0;
+  uint32_t _nestedMicros = 0;    // Time in stages entered from another
+  PipelineStageStats _stats[PIPELINE_STAGE_KINDS] = {};
+};
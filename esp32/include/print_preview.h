@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "print_writer.h"
+
+// Preview of the label being printed, on the LCD.
+//
+// The GS v 0 raster blocks of a job are picked out of its data on the way
+// to the printer and box-filtered down to the panel width, 384 dots to 320
+// pixels, into 16 grey levels. Rows go to the display task in small
+// bands; when it falls behind and every band is taken, rows are dropped
+// instead of holding up the writer. The display task scrolls them into a
+// 4 bpp sprite that replaces the status screen while one printer's job
+// prints, and for PREVIEW_HOLD_MS after it ends. Other printers' jobs are
+// not previewed meanwhile.
+
+#ifndef PRINT_PREVIEW
+#define PRINT_PREVIEW 0                // 1 to show labels as they print
+#endif
+#ifndef PREVIEW_HOLD_MS
+#define PREVIEW_HOLD_MS 5000           // Preview kept on screen after the job
+#endif
+#define PREVIEW_WIDTH 320              // Widest preview row in pixels
+#define PREVIEW_BAND_ROWS 8
+#ifndef PREVIEW_BANDS
+#define PREVIEW_BANDS 8                // Bands between the writers and the display task
+#endif
+#ifndef PREVIEW_MAX_DOTS
+#define PREVIEW_MAX_DOTS 1024          // Widest raster previewed, in dots
+#endif
+
+// Allocate the bands; notify is called from a writer task when a band is
+// ready and must not block. Does nothing unless PRINT_PREVIEW is set.
+bool initPrintPreview(void (*notify)());
+
+// Writer task of the printer: the job data as it is sent. An empty slice
+// ends the job.
+void previewJobData(uint8_t printer, const PrintSlice& slice);
+
+// Display task: draw the bands that arrived. True while the preview owns
+// the panel; the caller redraws its own screen in full once it doesn't.
+bool servicePrintPreview(TFT_eSPI* tft);
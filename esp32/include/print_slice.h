@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The interface between the print pipeline and whatever carries job data
+// onward: the BLE link on the bridge, or a buffer in a host build of the
+// stages that don't need Arduino (raster_recoder, ring_buffer).
+
+// A slice of job data as it sits in the job buffer: one span, or two when it
+// wraps around the end of the ring. Sinks read straight from the buffer and
+// only need to gather the one chunk that straddles the two spans.
+struct PrintSlice {
+  const uint8_t* data[2];
+  size_t length[2];
+
+  size_t total() const { return length[0] + length[1]; }
+};
+
+// Receives the slices of a job's data, in order. Returns false when the data
+// could not be delivered, which fails the job. An empty slice marks the end
+// of a job, done or failed, for sinks that hold data back.
+typedef bool (*PrintSink)(void* context, const PrintSlice& slice);
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Print jobs kept until their printer has taken them.
+//
+// A /print upload for a printer that isn't connected, or one sent with
+// ?spool=1, is spooled as it arrives. The spool has two tiers. A job goes
+// into PSRAM while the spool's share of it (HEAP_BUDGET_SPOOL) has room,
+// so the common case, a printer that is back within seconds, never
+// touches flash. A job moves to a LittleFS file only when it has to: its
+// printer has stayed away PRINT_SPOOL_FLUSH_MS, or the PSRAM tier is over
+// PRINT_SPOOL_PRESSURE percent full, or the job didn't fit there to begin
+// with. Files are written in PRINT_SPOOL_SEGMENT pieces, one sequential
+// write each instead of one per network packet: the command stream, then
+// a trailer with its length, CRC-32 and target. A task of its own
+// feeds each spooled job into a print job once its printer is connected,
+// woken by the link as soon as it is ready (the upload itself starts the
+// connect), in the order they came in, and drops the job once it is done;
+// the files of printed jobs are removed later, while the spool has nothing
+// to send, so the erase doesn't hold up the next job. A job that fails
+// because the link dropped is sent again from the start after the
+// reconnect; spool files survive a reboot and are checked against their
+// CRC before they are printed.
+
+#ifndef PRINT_SPOOL_DIR
+#define PRINT_SPOOL_DIR "/spool"
+#endif
+#ifndef PRINT_SPOOL_BUDGET
+#define PRINT_SPOOL_BUDGET (1024 * 1024)  // Flash for spooled jobs, 0 disables the spool
+#endif
+#ifndef PRINT_SPOOL_JOBS
+#define PRINT_SPOOL_JOBS 32               // Jobs spooled at most
+#endif
+#ifndef PRINT_SPOOL_SEGMENT
+#define PRINT_SPOOL_SEGMENT (32 * 1024)   // Bytes per flash write
+#endif
+#ifndef PRINT_SPOOL_FLUSH_MS
+#define PRINT_SPOOL_FLUSH_MS 10000        // Printer away this long moves its jobs to flash
+#endif
+#ifndef PRINT_SPOOL_PRESSURE
+#define PRINT_SPOOL_PRESSURE 75           // Percent of the PSRAM tier that moves waiting jobs to flash
+#endif
+#ifndef PRINT_SPOOL_ATTEMPTS
+#define PRINT_SPOOL_ATTEMPTS 3            // Failures on a connected printer before a job is dropped
+#endif
+#ifndef PRINT_SPOOL_POLL_MS
+#define PRINT_SPOOL_POLL_MS 500           // How often the spool task looks for work unwoken
+#endif
+#ifndef PRINT_SPOOL_CORE
+#define PRINT_SPOOL_CORE 0
+#endif
+#ifndef PRINT_SPOOL_PRIORITY
+#define PRINT_SPOOL_PRIORITY 2
+#endif
+
+// Whether a spooled job can be sent now. printer is the one it was spooled
+// for; a pooled job may get another member of its pool.
+typedef bool (*PrintSpoolTarget)(uint8_t pool, uint8_t& printer);
+
+// Index the spool and start its task. Call after LittleFS is mounted and
+// the print writers run.
+bool initPrintSpool(PrintSpoolTarget target);
+
+// Have the spool task look for work now instead of at its next poll, e.g.
+// when a printer has connected. Does not block.
+void wakePrintSpool();
+
+struct PrintSpoolInfo {
+  uint32_t id;
+  uint8_t printer;
+  size_t length;
+  uint32_t jobId;    // Print job of the current attempt, 0 while waiting
+  uint8_t failures;
+  bool onFlash;      // Moved to LittleFS, or written there
+};
+
+// Copy up to max spooled jobs, oldest first. Returns the number copied.
+size_t getSpooledJobs(PrintSpoolInfo* out, size_t max);
+
+// One upload on its way into the spool. An upload that is never committed
+// leaves nothing behind.
+class PrintSpoolWriter {
+public:
+  PrintSpoolWriter() = default;
+  ~PrintSpoolWriter();
+
+  PrintSpoolWriter(const PrintSpoolWriter&) = delete;
+  PrintSpoolWriter& operator=(const PrintSpoolWriter&) = delete;
+
+  // Reserve room for a job of total bytes, in PSRAM or else on flash.
+  // False when the spool is disabled, full or the file can't be created.
+  bool begin(uint8_t printer, uint8_t pool, size_t total);
+
+  // Next piece of the command stream. False once a write failed.
+  bool write(const uint8_t* data, size_t length);
+
+  // The upload is complete. jobId is the print job already taking it, 0
+  // when the spool task is to start one. Returns the spool ID, 0 when the
+  // job could not be spooled.
+  uint32_t commit(uint32_t jobId);
+
+private:
+  bool flushSegment();
+  void discard();
+
+  bool _active = false;
+  uint8_t _printer = 0;
+  uint8_t _pool = 0;
+  size_t _reserved = 0;
+  size_t _length = 0;
+  uint32_t _crc = 0;
+  uint32_t _id = 0;
+  uint8_t* _ram = nullptr;       // The whole job, in the PSRAM tier
+  uint8_t* _segment = nullptr;   // Next flash write, for a job on flash
+  size_t _segmentFill = 0;
+  File _file;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "print_slice.h"
+
+// Incremental parser of the printer command stream of a job.
+//
+// The bytes of a job arrive in slices cut anywhere, also in the middle of
+// a command header. The parser splits them into events, in stream order,
+// and hands each to a hook: runs of bytes outside any command (text, line
+// feeds, commands it doesn't know), the complete header of a command with
+// its arguments decoded, and the payload of a command that has one (the
+// pixels of a raster, a downloaded file) in pieces followed by an end
+// event. Every event carries the stream's own bytes, so a stage that
+// forwards them unchanged reproduces the job exactly, and one that rewrites
+// a command emits something else in their place.
+//
+// It holds at most PRINT_STREAM_HEADER_MAX bytes of one header and no other
+// buffer: payload and byte runs point into the slice being fed. It has no
+// Arduino dependencies and builds on a host as it is.
+//
+// ESC/POS: the common single-byte-argument ESC, GS, DLE and FS commands,
+// plus GS v 0 rasters, ESC * bit images, GS V cuts, GS ( and GS k with their
+// data, and the NUL-terminated ESC D and GS k forms. TSPL: one command per
+// line; SIZE, CLS, PRINT, BITMAP and DOWNLOAD are decoded, other lines that
+// fit the header buffer are PRINT_CMD_OTHER. Longer lines pass as bytes.
+
+#ifndef PRINT_STREAM_HEADER_MAX
+#define PRINT_STREAM_HEADER_MAX 64     // Longest header or TSPL line decoded
+#endif
+
+enum PrintDialect : uint8_t {
+  PRINT_DIALECT_AUTO,                  // Decided by the first command
+  PRINT_DIALECT_ESCPOS,
+  PRINT_DIALECT_TSPL
+};
+
+enum PrintCommand : uint8_t {
+  PRINT_CMD_NONE,                      // Bytes outside any command
+  PRINT_CMD_INIT,                      // ESC @
+  PRINT_CMD_RASTER,                    // GS v 0: width bytes by height rows, mode
+  PRINT_CMD_BIT_IMAGE,                 // ESC *: width columns, mode
+  PRINT_CMD_FEED,                      // ESC J n: count dots
+  PRINT_CMD_FEED_LINES,                // ESC d n: count lines
+  PRINT_CMD_CUT,                       // GS V: mode, count the feed before it
+  PRINT_CMD_STATUS,                    // GS r, DLE EOT, DLE ENQ: the printer answers
+  PRINT_CMD_OTHER,                     // Any other complete command or TSPL line
+  PRINT_CMD_TSPL_SIZE,                 // SIZE: width and height in 0.1 mm
+  PRINT_CMD_TSPL_CLS,
+  PRINT_CMD_TSPL_BITMAP,               // BITMAP x,y,width,height,mode,<data>
+  PRINT_CMD_TSPL_PRINT,                // PRINT m[,n]: count label sets
+  PRINT_CMD_TSPL_DOWNLOAD              // DOWNLOAD "name",size,<data>
+};
+
+enum PrintEventType : uint8_t {
+  PRINT_EVENT_BYTES,                   // Outside commands
+  PRINT_EVENT_COMMAND,                 // A complete header, args decoded
+  PRINT_EVENT_DATA,                    // Payload of that command, in pieces
+  PRINT_EVENT_END                      // Its payload is done
+};
+
+struct PrintCommandArgs {
+  uint16_t x;                          // TSPL BITMAP position in dots
+  uint16_t y;
+  uint16_t width;                      // Bytes per row, columns, or 0.1 mm
+  uint16_t height;                     // Rows, or 0.1 mm
+  uint8_t mode;
+  uint16_t count;
+  uint32_t payload;                    // Bytes after the header; 0 for none
+};
+
+struct PrintEvent {
+  PrintEventType type;
+  PrintCommand command;                // PRINT_CMD_NONE for bytes
+  const PrintCommandArgs* args;
+  const uint8_t* data;                 // The stream's bytes of this event
+  size_t length;
+};
+
+// Gets every event of the stream; false stops the parse, and feed()
+// returns false too
+typedef bool (*PrintStreamHook)(void* context, const PrintEvent& event);
+
+class PrintStreamParser {
+public:
+  void begin(PrintDialect dialect, PrintStreamHook hook, void* context);
+
+  // Parse the next bytes of the stream
+  bool feed(const uint8_t* data, size_t length);
+  bool feed(const PrintSlice& slice) {
+    return feed(slice.data[0], slice.length[0]) && feed(slice.data[1], slice.length[1]);
+  }
+
+  // End of the stream: an unfinished header goes to the hook as bytes
+  bool finish();
+
+  PrintDialect dialect() const { return _dialect; }
+
+  // Bytes the command under way still needs before another can start: the
+  // rest of its payload, or 1 while an ESC/POS header or a NUL-terminated
+  // payload is open. 0 between commands and within a TSPL line, which only
+  // a line end closes.
+  size_t commandLeft() const;
+
+private:
+  enum State : uint8_t {
+    SCAN,                              // Between commands
+    HEADER,                            // Collecting a header
+    PAYLOAD,                           // _left bytes of payload
+    TERMINATED,                        // Payload up to a NUL
+    LINE                               // Rest of a TSPL line, as bytes
+  };
+  enum Header : int8_t { HEADER_MORE, HEADER_DONE, HEADER_UNKNOWN };
+
+  bool emit(PrintEventType type, const uint8_t* data, size_t length);
+  bool headerByte(uint8_t b);
+  Header escposHeader();
+  Header tsplHeader(uint8_t b);
+  void decodeTspl();
+  bool isTsplKeyword() const;
+
+  PrintStreamHook _hook = nullptr;
+  void* _context = nullptr;
+  PrintDialect _dialect = PRINT_DIALECT_AUTO;
+  State _state = SCAN;
+  bool _lineStart = true;              // TSPL: at the start of a line
+  PrintCommand _command = PRINT_CMD_NONE;
+  PrintCommandArgs _args = {};
+  uint32_t _left = 0;
+  uint8_t _header[PRINT_STREAM_HEADER_MAX];
+  size_t _headerLen = 0;
+  size_t _keywordLen = 0;              // TSPL keyword within _header
+  size_t _fieldStart = 0;              // TSPL argument being read
+  uint8_t _commas = 0;                 // TSPL commas outside quotes so far
+  bool _quoted = false;
+  bool _named = false;                 // A quoted name came before this field
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <Arduino.h>
+#include "print_slice.h"
+
+// Streaming print pipeline with a bounded job queue per printer.
+//
+// Every print job gets its own ring buffer that the network producers (HTTP
+// body callback, raw socket, WebSocket) copy into. Each printer has a writer
+// task of its own that drains that printer's jobs one after another, so
+// network receive and BLE transmit overlap, printers run in parallel and
+// concurrent uploads never interleave on a characteristic.
+//
+// Jobs come in two classes. The writer takes the oldest job of the highest
+// class waiting, and an interactive job that has data waiting goes ahead of
+// a bulk job that is already printing. It does not split the bulk job mid-label:
+// the writer parses the job (print_stream.h) and hands over only at a
+// label boundary, just past a GS V cut or a TSPL PRINT. The bulk job goes on
+// from there once no interactive job is left. Its printer gets the handover
+// as the end of one job, so the sink's per-job stages start over.
+//
+// A job of several copies (setPrintJobCopies) is uploaded once and kept
+// whole in its ring buffer; each copy after the first is read out of it
+// again. The printer gets every copy as a job of its own, and another job
+// may take the printer over between copies.
+//
+// Within a class the printer is shared fairly between the clients sending
+// to it (setPrintJobClient), so one station's batch doesn't hold up the
+// labels of the others. The writer runs deficit round robin over the
+// clients with jobs pending, in bytes at label granularity: the client in
+// turn gets fair_quantum bytes (PRINT_FAIR_QUANTUM), and once it has used
+// them up the writer hands over at the next boundary to the oldest job of
+// the next client that has data waiting. A label longer than the quantum
+// still prints whole and leaves its client in debt for its next turns. The
+// jobs of one client keep their order.
+
+#ifndef PRINT_RING_SIZE
+#define PRINT_RING_SIZE (512 * 1024)      // Streaming buffer with PSRAM
+#endif
+#ifndef PRINT_RING_SIZE_INTERNAL
+#define PRINT_RING_SIZE_INTERNAL (32 * 1024) // Fallback without PSRAM
+#endif
+#ifndef PRINT_MAX_STAGED_JOB
+#define PRINT_MAX_STAGED_JOB (1024 * 1024) // Largest job that can wait in the queue
+#endif
+#ifndef PRINT_QUEUE_DEPTH
+#define PRINT_QUEUE_DEPTH 4                // Jobs queued or streaming at once, per printer; /config may lower it
+#endif
+#ifndef PRINT_JOB_SLOTS
+#define PRINT_JOB_SLOTS 16                 // Including finished jobs kept for polling
+#endif
+#ifndef PRINT_WRITER_CORE
+#define PRINT_WRITER_CORE 1
+#endif
+#ifndef PRINT_WRITER_PRIORITY
+#define PRINT_WRITER_PRIORITY 3
+#endif
+#ifndef PRINT_MAX_COPIES
+#define PRINT_MAX_COPIES 999               // Copies of one job
+#endif
+#ifndef PRINT_HISTORY_SIZE
+#define PRINT_HISTORY_SIZE 16              // Finished job timelines kept for /jobs/history
+#endif
+#ifndef PRINT_FAIR_QUANTUM
+#define PRINT_FAIR_QUANTUM 8192            // Bytes per client turn, about one label; 0 for plain age order
+#endif
+#ifndef MAX_PRINTERS
+#define MAX_PRINTERS 4                     // BLE printers driven at once
+#endif
+
+// Selects every printer in the queue queries below
+static const uint8_t PRINT_ALL_PRINTERS = 0xFF;
+// Job bound to its printer, not to a pool
+static const uint8_t PRINT_NO_POOL = 0xFF;
+
+enum PrintJobState {
+  JOB_QUEUED,
+  JOB_STREAMING,
+  JOB_DONE,
+  JOB_FAILED
+};
+
+// Why a job could not be admitted
+enum PrintJobReject {
+  JOB_ACCEPTED,
+  JOB_REJECT_QUEUE_FULL,
+  JOB_REJECT_TOO_LARGE,
+  JOB_REJECT_NO_MEMORY
+};
+
+// Job classes, lowest first
+enum PrintJobPriority : uint8_t {
+  PRINT_PRIORITY_BULK,         // Pick-list waves and batches
+  PRINT_PRIORITY_INTERACTIVE   // Single labels someone is waiting for; the default
+};
+
+struct PrintJobInfo {
+  uint32_t id;
+  uint8_t printer;  // Index in the printer registry
+  PrintJobState state;
+  PrintJobPriority priority;
+  size_t total;     // Expected job size (Content-Length), 0 when unknown
+  size_t received;  // Bytes received from the client
+  size_t sent;      // Bytes of the copy being printed written to the printer
+  uint16_t copies;  // Times the job is printed
+  uint16_t copiesDone;
+};
+
+// Start the writer task of one printer
+bool initPrintWriter(uint8_t printer, PrintSink sink, void* context);
+
+// Size of a job whose end is only known once the producer finishes it
+static const size_t PRINT_JOB_LENGTH_UNKNOWN = 0;
+
+// Admit a new job of the given size for a printer. Returns the job ID, or 0
+// with the reason in reject. Jobs of unknown length always get a streaming
+// window and rely on the producer to back off while it is full. A pooled job
+// may be moved to another printer of its pool when its own fails it.
+uint32_t createPrintJob(uint8_t printer, size_t total, PrintJobReject& reject,
+                        uint8_t pool = PRINT_NO_POOL);
+
+// Picks the pool member that takes over a job the failed printer could not
+// start. Returns PRINT_ALL_PRINTERS when no other member can.
+typedef uint8_t (*PrintJobReroute)(uint8_t pool, uint8_t failedPrinter);
+void setPrintJobReroute(PrintJobReroute reroute);
+
+// Asked by a printer's writer while it has no job, about every 100 ms, with
+// the ms since it last wrote to the printer. Runs on the writer task, so
+// whatever it writes can't interleave with a job. True when it wrote, or
+// tried to, which starts the count again.
+typedef bool (*PrintWriterIdle)(uint8_t printer, uint32_t idleMs);
+void setPrintWriterIdle(PrintWriterIdle idle);
+
+// Bytes per second the printer has been measured to take its data at, 0
+// while nothing was measured. Sets the wait printQueueRetryAfter() tells a
+// rejected client.
+typedef uint32_t (*PrintWriterRate)(uint8_t printer);
+void setPrintWriterRate(PrintWriterRate rate);
+
+// Resolution in dpi the job's raster data was made for, set before its
+// first byte. Printers of another resolution get it rescaled.
+void setPrintJobDpi(uint32_t id, uint16_t dpi);
+
+// Inside the sink: resolution of the job it is being handed, 0 when unknown
+uint16_t printWriterJobDpi(uint8_t printer);
+
+// Times the job is printed, set before its first byte. Its buffer grows to
+// hold all of it, up to PRINT_MAX_STAGED_JOB; false when it can't, and the
+// job prints once. A job of unknown length that outgrows it anyway fails
+// after its first copy.
+bool setPrintJobCopies(uint32_t id, uint16_t copies);
+
+// Class of a job, set before its first byte
+void setPrintJobPriority(uint32_t id, PrintJobPriority priority);
+const char* printJobPriorityName(PrintJobPriority priority);
+// "bulk" or "interactive"; false for anything else
+bool parsePrintJobPriority(const char* name, PrintJobPriority& priority);
+
+// Client a job came from, for the fair share of its printer, set before its
+// first byte. Jobs that never get one share client 0.
+void setPrintJobClient(uint32_t id, uint32_t client);
+// Key of a client by name, such as its address or station ID
+uint32_t printClientKey(const char* name);
+
+// Producer side: append data to a job. Blocks for at most timeoutMs while
+// the job's buffer is full and returns the number of bytes accepted.
+size_t appendPrintJob(uint32_t id, const uint8_t* data, size_t length, uint32_t timeoutMs);
+
+// Append all of it, waiting on the job buffer for as long as the printer
+// takes. False once the job failed, was cancelled, finished or aborted, or
+// is gone, with only part of the data taken.
+bool appendPrintJobWait(uint32_t id, const uint8_t* data, size_t length);
+
+// The job failed or was cancelled, or is no longer known
+bool printJobFailed(uint32_t id);
+
+// The job still takes data: it is known and was neither finished nor aborted
+bool printJobAccepting(uint32_t id);
+
+// No more data will arrive for the job. When the body was cut short of its
+// announced size the job fails instead of printing a truncated label.
+void finishPrintJob(uint32_t id);
+
+// The producer went away before finishing the job; whatever was received
+// is discarded instead of printed.
+void abortPrintJob(uint32_t id);
+
+// Bytes the job buffer can take right now without blocking. Only the writer
+// frees space, so a producer may rely on it until its next append.
+size_t printJobSpace(uint32_t id);
+
+// Stop a queued or streaming job on behalf of the user. Data already with
+// the printer still prints; the upload of a cancelled job is drained and
+// its client told it failed. False when the job isn't pending.
+bool cancelPrintJob(uint32_t id);
+
+// Hold a printer's writer between slices, or let it go on
+void pausePrintWriter(uint8_t printer, bool paused);
+bool printWriterPaused(uint8_t printer);
+
+bool getPrintJob(uint32_t id, PrintJobInfo& info);
+
+// Copy up to max jobs that are queued or streaming, in slot order. Returns
+// the number copied.
+size_t getPendingPrintJobs(PrintJobInfo* out, size_t max);
+
+// Where the time of a finished job went, in ms since boot. Steps that never
+// happened are 0; printerIdle stays 0 unless the printer can report it.
+struct PrintJobTimeline {
+  uint32_t id;
+  uint8_t printer;
+  PrintJobState state;
+  size_t bytes;          // Written to the printer, over all copies
+  uint32_t created;
+  uint32_t firstByte;    // Received from the client
+  uint32_t lastByte;
+  uint32_t firstWrite;   // Handed to the printer's sink
+  uint32_t lastWrite;
+  uint32_t printerIdle;  // Printer answered a status query sent after the job
+};
+
+// Copy up to max timelines, newest first. Returns the number copied.
+size_t getPrintHistory(PrintJobTimeline* out, size_t max);
+
+// The printer has processed everything it was sent; completes the timeline
+// of its last finished job
+void markPrinterIdle(uint8_t printer);
+
+const char* printJobStateName(PrintJobState state);
+
+// Seconds a rejected client should wait before retrying
+uint32_t printQueueRetryAfter(uint8_t printer = PRINT_ALL_PRINTERS);
+
+// Jobs a printer's writer finished since boot
+struct PrintWriterStats {
+  uint32_t done;
+  uint32_t failed;
+  uint32_t moved;   // Handed to another pool member
+};
+bool getPrintWriterStats(uint8_t printer, PrintWriterStats& stats);
+
+// Jobs queued or streaming
+size_t printQueueDepth(uint8_t printer = PRINT_ALL_PRINTERS);
+// Bytes accepted but not yet written to the printer
+size_t printWriterPending(uint8_t printer = PRINT_ALL_PRINTERS);
+bool printWriterIdle();
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+#include "image_raster.h"
+
+// Static label artwork kept in the printers' own memory, so that a label
+// only carries the short command that prints it.
+//
+// ESC/POS printers keep it as NV graphics, defined with function 67 of
+// GS ( L (GS 8 L when larger than 64 KB) under a two-character key and
+// printed with function 69. TSPL printers keep it as a monochrome BMP,
+// stored in flash with DOWNLOAD F and placed with PUTBMP. Each printer has
+// PRINTER_ARTWORK_SLOTS of them. Which artwork, by hash, sits in which slot
+// is remembered in NVS together with the printer's MAC; once all slots are
+// taken the one written longest ago is reused.
+//
+// What NVS says is the bridge's belief. It is written when the download is
+// handed to the job, so after a job that failed on the way, a printer that
+// lost its memory or one whose slots were overwritten by other software,
+// the artwork has to be sent again (?resend=1 on the template print).
+
+#ifndef PRINTER_ARTWORK_SLOTS
+#define PRINTER_ARTWORK_SLOTS 8
+#endif
+#if PRINTER_ARTWORK_SLOTS > 26
+#error "PRINTER_ARTWORK_SLOTS must be at most 26"
+#endif
+
+// 1-bit artwork, packed rows MSB first with 1 for ink
+struct PrinterArtwork {
+  uint16_t width;
+  uint16_t height;
+  const uint8_t* bits;
+  uint32_t hash;
+};
+
+uint32_t artworkHash(uint16_t width, uint16_t height, const uint8_t* bits);
+
+// Slot holding the artwork with that hash on the printer with that index
+// and MAC, or -1
+int findArtworkSlot(uint8_t printer, const String& mac, uint32_t hash);
+
+// Record the artwork as held in a new slot, which the caller downloads it
+// into. Slots set in avoid, used by the same label, aren't taken.
+uint8_t claimArtworkSlot(uint8_t printer, const String& mac, uint32_t hash, uint32_t avoid);
+
+// Commands that download the artwork into a slot
+bool writeArtworkDefine(ImageCommandSet commands, uint8_t slot, const PrinterArtwork& art, ImageOutput output,
+                        void* context);
+
+// Command that prints the artwork in a slot at x, y (ESC/POS: from the left
+// margin at x, at the current position). Returns its length in out.
+size_t artworkPrintCommand(ImageCommandSet commands, uint8_t slot, uint16_t x, uint16_t y, uint8_t* out,
+                           size_t size);
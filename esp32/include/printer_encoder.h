@@ -0,0 +1,445 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Printer command encoding shared by the firmware and the host tools.
+//
+// The raster steps every client repeats, in one header: packing pixels into
+// printer rows, halftoning gray rows, inverting and rotating packed bitmaps,
+// and framing them as ESC/POS GS v 0 rows or a TSPL label. Packed rows are
+// MSB first with 1 for black, (width + 7) / 8 bytes, and padding bits past
+// the width stay white. The whole-job encoders frame a page as
+// generateRasterCommands()/generateTSPLCommands() in go/print_label.go and
+// web/printer_commands.js do, with the TSPL bits the way /print/image sends
+// them, so every client can send the same stream and the bridge's parsers
+// see the framing they are written against.
+//
+// Nothing allocates; callers own every buffer. It has no Arduino
+// dependencies and builds on a host as it is; encoder/encoder_api.cpp wraps
+// it as a C library for native tools and for WebAssembly.
+//
+// The loops work a byte of output (eight pixels) or a machine word at a time
+// without branches on pixel values, so on a host or in WASM with -O3
+// (-msimd128) the compiler vectorizes them; on the ESP32 they run as word
+// operations. Error diffusion carries each pixel's error into the next and
+// stays a serial loop everywhere.
+
+enum EncodeDither : uint8_t {
+  ENCODE_THRESHOLD,                    // Plain cut at the threshold
+  ENCODE_BAYER,                        // 8x8 ordered dither
+  ENCODE_ATKINSON,                     // Diffuses 6/8 of the error, keeps contrast high
+  ENCODE_FLOYD_STEINBERG
+};
+
+static const size_t ENCODE_ESCPOS_ROW_HEADER = 8;   // GS v 0 m xL xH yL yH
+static const size_t ENCODE_TSPL_HEADER_MAX = 160;   // SIZE .. BITMAP header at most
+
+inline size_t encodeRowBytes(uint16_t width) { return (width + 7) / 8; }
+
+// Mask of the bits of the last byte of a row that are inside the width
+inline uint8_t encodeTailMask(uint16_t width) {
+  return (width & 7) ? (uint8_t)(0xFF << (8 - (width & 7))) : 0xFF;
+}
+
+// ---------------------------------------------------------------------------
+// Packing and halftoning
+
+// One byte a pixel, non-zero for black, into a packed row. Eight pixels are
+// read as one 64-bit word, squashed to one bit a byte and gathered into the
+// output byte by a multiply.
+inline void encodePackRow(const uint8_t* pixels, uint16_t width, uint8_t* packed, bool invert = false) {
+  const uint8_t flip = invert ? 0xFF : 0x00;
+  uint16_t x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint64_t v;
+    memcpy(&v, pixels + x, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    // Bit 0 of byte i set for a non-zero pixel x + i, then moved to bit
+    // 63 - i, the top byte, by the product
+    v = ((((v & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | v) >> 7) & 0x0101010101010101ULL;
+    *packed++ = (uint8_t)((v * 0x8040201008040201ULL) >> 56) ^ flip;
+  }
+  if (x < width) {
+    uint8_t b = 0;
+    for (uint8_t bit = 0; x < width; x++, bit++) {
+      b |= (uint8_t)((pixels[x] != 0) << (7 - bit));
+    }
+    *packed = (b ^ flip) & encodeTailMask(width);
+  }
+}
+
+// Gray values (0 black .. 255 white) below threshold count as black
+inline void encodeThresholdRow(const uint8_t* gray, uint16_t width, uint8_t threshold, uint8_t* packed) {
+  uint16_t x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const uint8_t* p = gray + x;
+    *packed++ = ((p[0] < threshold) << 7) | ((p[1] < threshold) << 6) | ((p[2] < threshold) << 5) |
+                ((p[3] < threshold) << 4) | ((p[4] < threshold) << 3) | ((p[5] < threshold) << 2) |
+                ((p[6] < threshold) << 1) | (p[7] < threshold);
+  }
+  if (x < width) {
+    uint8_t b = 0;
+    for (uint8_t bit = 0; x < width; x++, bit++) {
+      b |= (gray[x] < threshold) << (7 - bit);
+    }
+    *packed = b;
+  }
+}
+
+// Thresholds from the rows of an 8x8 Bayer matrix, scaled to 0..255 and
+// centred on threshold
+inline void encodeBayerRow(const uint8_t* gray, uint16_t width, uint8_t threshold, uint32_t row,
+                           uint8_t* packed) {
+  static const uint8_t BAYER_8X8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21}
+  };
+  uint8_t t[8];
+  const uint8_t* m = BAYER_8X8[row & 7];
+  for (uint8_t i = 0; i < 8; i++) {
+    int v = (int)threshold - 128 + m[i] * 4 + 2;
+    t[i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+  }
+
+  uint16_t x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const uint8_t* p = gray + x;
+    *packed++ = ((p[0] < t[0]) << 7) | ((p[1] < t[1]) << 6) | ((p[2] < t[2]) << 5) | ((p[3] < t[3]) << 4) |
+                ((p[4] < t[4]) << 3) | ((p[5] < t[5]) << 2) | ((p[6] < t[6]) << 1) | (p[7] < t[7]);
+  }
+  if (x < width) {
+    uint8_t b = 0;
+    for (uint8_t bit = 0; x < width; x++, bit++) {
+      b |= (gray[x] < t[bit]) << (7 - bit);
+    }
+    *packed = b;
+  }
+}
+
+// Error diffusion state: two rows of width + 3 int16, zeroed before the
+// first row and offset by one so x - 1 and x + 1 never leave the buffer
+struct EncodeErrorRows {
+  int16_t* errors;                     // This row
+  int16_t* next;                       // The row below
+};
+
+inline size_t encodeErrorRowBytes(uint16_t width) { return (width + 3) * sizeof(int16_t); }
+
+inline void encodeSwapErrorRows(EncodeErrorRows& rows, uint16_t width) {
+  int16_t* rowErrors = rows.errors;
+  rows.errors = rows.next;
+  rows.next = rowErrors;
+  // Shares pushed past the edges are dropped
+  rows.next[0] = 0;
+  rows.next[width + 1] = 0;
+  rows.next[width + 2] = 0;
+}
+
+// 7/16 right, 3/16, 5/16 and 1/16 to the row below. The right neighbour's
+// share travels in a register; the row below accumulates in rows.next.
+inline void encodeFloydSteinbergRow(const uint8_t* gray, uint16_t width, uint8_t threshold,
+                                    EncodeErrorRows& rows, uint8_t* packed) {
+  int16_t* cur = rows.errors + 1;
+  int16_t* below = rows.next + 1;
+  int carry = 0;
+  uint8_t b = 0;
+  uint8_t bit = 0x80;
+
+  for (uint16_t x = 0; x < width; x++) {
+    int value = gray[x] + cur[x] + carry;
+    cur[x] = 0;
+    int err;
+    if (value < threshold) {
+      b |= bit;
+      err = value;
+    } else {
+      err = value - 255;
+    }
+    carry = (err * 7) >> 4;
+    below[x - 1] += (err * 3) >> 4;
+    below[x] += (err * 5) >> 4;
+    below[x + 1] += err >> 4;
+
+    bit >>= 1;
+    if (bit == 0) {
+      *packed++ = b;
+      b = 0;
+      bit = 0x80;
+    }
+  }
+  if (bit != 0x80) {
+    *packed = b;
+  }
+  encodeSwapErrorRows(rows, width);
+}
+
+// 1/8 each to the two pixels right, three below and one two rows down. The
+// share for two rows down goes into the slot just read, which is where the
+// next row's "below" lands after the swap.
+inline void encodeAtkinsonRow(const uint8_t* gray, uint16_t width, uint8_t threshold,
+                              EncodeErrorRows& rows, uint8_t* packed) {
+  int16_t* cur = rows.errors + 1;
+  int16_t* below = rows.next + 1;
+  int carry1 = 0;
+  int carry2 = 0;
+  uint8_t b = 0;
+  uint8_t bit = 0x80;
+
+  for (uint16_t x = 0; x < width; x++) {
+    int value = gray[x] + cur[x] + carry1;
+    int err;
+    if (value < threshold) {
+      b |= bit;
+      err = value;
+    } else {
+      err = value - 255;
+    }
+    int share = err >> 3;
+    carry1 = carry2 + share;
+    carry2 = share;
+    below[x - 1] += share;
+    below[x] += share;
+    below[x + 1] += share;
+    cur[x] = share;
+
+    bit >>= 1;
+    if (bit == 0) {
+      *packed++ = b;
+      b = 0;
+      bit = 0x80;
+    }
+  }
+  if (bit != 0x80) {
+    *packed = b;
+  }
+  encodeSwapErrorRows(rows, width);
+}
+
+// Row row of an image in any mode; rows may be null for the point modes
+inline void encodeDitherRow(EncodeDither mode, const uint8_t* gray, uint16_t width, uint8_t threshold,
+                            uint32_t row, EncodeErrorRows* rows, uint8_t* packed) {
+  switch (mode) {
+    case ENCODE_THRESHOLD: encodeThresholdRow(gray, width, threshold, packed); break;
+    case ENCODE_BAYER: encodeBayerRow(gray, width, threshold, row, packed); break;
+    case ENCODE_ATKINSON: encodeAtkinsonRow(gray, width, threshold, *rows, packed); break;
+    case ENCODE_FLOYD_STEINBERG: encodeFloydSteinbergRow(gray, width, threshold, *rows, packed); break;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Packed bitmaps
+
+// Flip every bit, a word at a time between the unaligned ends. Bytes, not
+// pixels: the caller puts the padding of a row back if it must stay white.
+inline void encodeInvert(uint8_t* p, size_t length) {
+  while (length > 0 && ((uintptr_t)p & (sizeof(uintptr_t) - 1)) != 0) {
+    *p = ~*p;
+    p++;
+    length--;
+  }
+  for (; length >= sizeof(uintptr_t); p += sizeof(uintptr_t), length -= sizeof(uintptr_t)) {
+    *(uintptr_t*)p = ~*(uintptr_t*)p;
+  }
+  while (length-- > 0) {
+    *p = ~*p;
+    p++;
+  }
+}
+
+// Invert the pixels of a packed bitmap, leaving the row padding white
+inline void encodeInvertBitmap(uint8_t* bitmap, uint16_t width, uint16_t height) {
+  const size_t rowBytes = encodeRowBytes(width);
+  const uint8_t tail = encodeTailMask(width);
+  encodeInvert(bitmap, rowBytes * height);
+  if (tail != 0xFF) {
+    for (uint8_t* last = bitmap + rowBytes - 1; height-- > 0; last += rowBytes) {
+      *last &= tail;
+    }
+  }
+}
+
+inline uint8_t encodeReverseBits(uint8_t b) {
+  b = (uint8_t)((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+  b = (uint8_t)((b & 0xCC) >> 2 | (b & 0x33) << 2);
+  return (uint8_t)((b & 0xAA) >> 1 | (b & 0x55) << 1);
+}
+
+// Transpose an 8x8 bit block: bit 7 - k of in[i] becomes bit 7 - i of
+// out[k], as three rounds of swaps on two 32-bit words (Hacker's Delight,
+// 7-3)
+inline void encodeTranspose8(const uint8_t in[8], uint8_t out[8]) {
+  uint32_t x = ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+  uint32_t y = ((uint32_t)in[4] << 24) | ((uint32_t)in[5] << 16) | ((uint32_t)in[6] << 8) | in[7];
+  uint32_t t;
+  t = (x ^ (x >> 7)) & 0x00AA00AA; x = x ^ t ^ (t << 7);
+  t = (y ^ (y >> 7)) & 0x00AA00AA; y = y ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+  t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+  t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+  y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+  x = t;
+  out[0] = x >> 24; out[1] = x >> 16; out[2] = x >> 8; out[3] = x;
+  out[4] = y >> 24; out[5] = y >> 16; out[6] = y >> 8; out[7] = y;
+}
+
+// Turn a packed width x height bitmap clockwise by quarters (0..3) into
+// out, which must not overlap it. A quarter or three turn it into height x
+// width: encodeRowBytes(height) * width bytes. Quarter turns go through 8x8
+// bit blocks, a half turn reverses the bits of each row.
+inline void encodeRotate(const uint8_t* in, uint16_t width, uint16_t height, uint8_t quarters, uint8_t* out) {
+  const size_t inBytes = encodeRowBytes(width);
+  quarters &= 3;
+
+  if (quarters == 0) {
+    memcpy(out, in, inBytes * height);
+    return;
+  }
+
+  if (quarters == 2) {
+    // Reversed row, then moved left over the padding that is now in front
+    const uint8_t pad = (uint8_t)(inBytes * 8 - width);
+    for (uint16_t y = 0; y < height; y++) {
+      const uint8_t* src = in + (size_t)(height - 1 - y) * inBytes;
+      uint8_t* dst = out + (size_t)y * inBytes;
+      for (size_t i = 0; i < inBytes; i++) {
+        dst[i] = encodeReverseBits(src[inBytes - 1 - i]);
+      }
+      if (pad) {
+        for (size_t i = 0; i < inBytes; i++) {
+          dst[i] = (uint8_t)(dst[i] << pad | (i + 1 < inBytes ? dst[i + 1] >> (8 - pad) : 0));
+        }
+      }
+    }
+    return;
+  }
+
+  // Output row r is input column c; each output byte j takes eight input
+  // rows, bottom up for a clockwise turn. Rows past the bitmap read white.
+  const size_t outBytes = encodeRowBytes(height);
+  const bool clockwise = quarters == 1;
+  uint8_t block[8];
+  uint8_t turned[8];
+  for (size_t j = 0; j < outBytes; j++) {
+    for (size_t c = 0; c < inBytes; c++) {
+      for (uint8_t i = 0; i < 8; i++) {
+        int32_t y = clockwise ? (int32_t)height - 1 - (int32_t)(j * 8 + i) : (int32_t)(j * 8 + i);
+        block[i] = (y >= 0 && y < height) ? in[(size_t)y * inBytes + c] : 0;
+      }
+      encodeTranspose8(block, turned);
+      for (uint8_t k = 0; k < 8; k++) {
+        uint32_t column = c * 8 + k;
+        if (column >= width) {
+          break;
+        }
+        uint32_t r = clockwise ? column : width - 1 - column;
+        out[(size_t)r * outBytes + j] = turned[k];
+      }
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Command framing
+
+// GS v 0 header for rows of rowBytes bytes; mode 0 normal, 1 double width,
+// 2 double height, 3 both
+inline size_t encodeEscPosRasterHeader(uint8_t* out, uint8_t mode, uint16_t rowBytes, uint16_t rows) {
+  out[0] = 0x1D;
+  out[1] = 'v';
+  out[2] = '0';
+  out[3] = mode;
+  out[4] = (uint8_t)(rowBytes & 0xFF);
+  out[5] = (uint8_t)(rowBytes >> 8);
+  out[6] = (uint8_t)(rows & 0xFF);
+  out[7] = (uint8_t)(rows >> 8);
+  return ENCODE_ESCPOS_ROW_HEADER;
+}
+
+// "BITMAP x,y,rowBytes,rows,mode," into out; its length, 0 if it doesn't fit
+inline size_t encodeTsplBitmapHeader(char* out, size_t size, uint16_t x, uint16_t y, uint16_t rowBytes,
+                                     uint16_t rows, uint8_t mode) {
+  int len = snprintf(out, size, "BITMAP %u,%u,%u,%u,%u,", (unsigned)x, (unsigned)y, (unsigned)rowBytes,
+                     (unsigned)rows, (unsigned)mode);
+  return (len > 0 && (size_t)len < size) ? (size_t)len : 0;
+}
+
+// Bytes of encodeEscPosJob() for one page
+inline size_t encodeEscPosJobSize(uint16_t width, uint16_t height) {
+  return 2 + 3 + (size_t)height * (ENCODE_ESCPOS_ROW_HEADER + encodeRowBytes(width)) + 4;
+}
+
+// ESC @, ESC 3 0, one GS v 0 block per packed row, GS V 66 1: the job the
+// clients send for one page. Returns the bytes written to out.
+inline size_t encodeEscPosJob(const uint8_t* packed, uint16_t width, uint16_t height, uint8_t mode, uint8_t* out) {
+  const size_t rowBytes = encodeRowBytes(width);
+  uint8_t* p = out;
+  *p++ = 0x1B; *p++ = '@';
+  *p++ = 0x1B; *p++ = '3'; *p++ = 0;
+  for (uint16_t y = 0; y < height; y++) {
+    p += encodeEscPosRasterHeader(p, mode, (uint16_t)rowBytes, 1);
+    memcpy(p, packed + (size_t)y * rowBytes, rowBytes);
+    p += rowBytes;
+  }
+  *p++ = 0x1D; *p++ = 'V'; *p++ = 66; *p++ = 1;
+  return p - out;
+}
+
+struct EncodeTsplLabel {
+  uint16_t widthMm;
+  uint16_t heightMm;                   // 0: height / 8, at least 10
+  uint8_t speed;
+  uint8_t density;
+  uint16_t marginX;                    // BITMAP position in dots
+  uint16_t marginY;
+};
+
+// At most the bytes encodeTsplLabel() writes
+inline size_t encodeTsplLabelMaxSize(uint16_t width, uint16_t height) {
+  return ENCODE_TSPL_HEADER_MAX + encodeRowBytes(width) * height + 16;
+}
+
+// SIZE, GAP, DIRECTION, SPEED, DENSITY, CLS, a BITMAP of the packed rows
+// and PRINT 1,1. TSPL prints 0 bits, so the rows go out inverted unless
+// invert is set, as in the clients. Returns the bytes written, 0 if the
+// header didn't fit ENCODE_TSPL_HEADER_MAX.
+inline size_t encodeTsplLabel(const uint8_t* packed, uint16_t width, uint16_t height,
+                              const EncodeTsplLabel& label, bool invert, uint8_t* out) {
+  const size_t rowBytes = encodeRowBytes(width);
+  uint16_t heightMm = label.heightMm;
+  if (heightMm == 0) {
+    heightMm = height / 8 < 10 ? 10 : height / 8;
+  }
+  char* header = (char*)out;
+  int len = snprintf(header, ENCODE_TSPL_HEADER_MAX,
+                     "SIZE %u mm,%u mm\r\nGAP 2 mm,0 mm\r\nDIRECTION 1\r\nSPEED %u\r\nDENSITY %u\r\nCLS\r\n",
+                     (unsigned)label.widthMm, (unsigned)heightMm, (unsigned)label.speed, (unsigned)label.density);
+  if (len <= 0 || (size_t)len >= ENCODE_TSPL_HEADER_MAX) {
+    return 0;
+  }
+  size_t bitmap = encodeTsplBitmapHeader(header + len, ENCODE_TSPL_HEADER_MAX - len, label.marginX,
+                                         label.marginY, (uint16_t)rowBytes, height, 0);
+  if (bitmap == 0) {
+    return 0;
+  }
+  uint8_t* p = out + len + bitmap;
+  memcpy(p, packed, rowBytes * height);
+  if (!invert) {
+    encodeInvert(p, rowBytes * height);
+  }
+  p += rowBytes * height;
+  static const char TRAILER[] = "\r\nPRINT 1,1\r\n";
+  memcpy(p, TRAILER, sizeof(TRAILER) - 1);
+  p += sizeof(TRAILER) - 1;
+  return p - out;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Keep-alives for printers that drop BLE after a few idle minutes, so the
+// first label after a pause doesn't pay for scan, connect and discovery.
+//
+// Once a printer's link has been quiet for keepalive_interval seconds, its
+// writer sends the printer's keep-alive (keepalive= in the registry) between
+// jobs. This happens only inside the working-hours window from
+// keepalive_start to keepalive_end, in minutes after local midnight. A window
+// whose end is before its start runs past midnight, and equal ends cover the
+// whole day. The clock comes from SNTP; until it is set the window counts as
+// open. All three are /config settings over the build flags below.
+
+#ifndef KEEPALIVE_INTERVAL
+#define KEEPALIVE_INTERVAL 0              // s of quiet before a keep-alive, 0 sends none
+#endif
+#ifndef KEEPALIVE_START
+#define KEEPALIVE_START 0                 // Minutes after midnight
+#endif
+#ifndef KEEPALIVE_END
+#define KEEPALIVE_END 0
+#endif
+#ifndef BRIDGE_TIMEZONE
+#define BRIDGE_TIMEZONE "UTC0"            // POSIX TZ of the window, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+#endif
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
+
+// Start SNTP and hook the print writers. Call once the network is started.
+void initPrinterKeepAlive();
+
+// Whether keep-alives go out at this time of day
+bool keepAliveWindowOpen();
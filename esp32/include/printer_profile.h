@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include "print_pipeline.h"
+
+// Per-model link and print settings, picked on connect from the printer's
+// BLE device name and print service, so a new model runs at its best
+// without a firmware build or a registry line of its own.
+//
+// Profiles live on LittleFS, one per line:
+//   <name-pattern> [service=<uuid>] [mtu=<bytes>] [chunk=<bytes>]
+//        [write=auto|ack|noack] [phy=1m|2m|coded] [caps=<raster caps>]
+//        [band=<rows>] [buffer=<bytes>] [lines=<dot lines per second>]
+//        [probe=nul|init|off] [pipeline=<stage>,...|none]
+// The pattern is matched against the whole device name; * stands for any
+// run of characters and ? for one. With service= the profile only applies
+// when that is the print service. Lines starting with # are comments, and
+// the first matching profile wins.
+//
+// mtu= is the MTU asked for on the next connect, and caps the chunks on
+// this one; chunk= caps them further. write= and phy= replace the bridge's
+// write mode and the 2M PHY request. caps= and band= are the raster
+// re-encoding a printer takes (RasterCaps, see raster_recoder.h), over the
+// built-in table. buffer= and lines= model the input buffer of printers
+// whose registry line leaves them out. probe= is what the connect-time link
+// probe sends (probe_bytes, see ble_printer.h): NUL, ESC @ or nothing at all.
+// pipeline= lists the stages job data runs through, in order, from resample
+// and recode (print_pipeline.h); the link comes last whether listed as send
+// or not, and none sends the data as the client wrote it.
+// Whatever a profile leaves out stays as the bridge would have it without one.
+#ifndef PRINTER_PROFILE_PATH
+#define PRINTER_PROFILE_PATH "/profiles.conf"
+#endif
+#ifndef MAX_PRINTER_PROFILES
+#define MAX_PRINTER_PROFILES 16
+#endif
+
+// Filler of the link probe
+enum ProbeFill : uint8_t {
+  PROBE_NUL,
+  PROBE_INIT,              // ESC @, for printers that print NUL
+  PROBE_OFF
+};
+
+struct PrinterProfile {
+  char pattern[33];
+  char service[37];        // Canonical print service UUID, empty for any
+  uint16_t mtu;            // 0 for the bridge's
+  uint16_t chunk;          // 0 for as large as the MTU allows
+  int8_t writeMode;        // BleWriteMode, -1 for the bridge's
+  uint8_t phy;             // BLE_PHY_*, 0 to ask for 2M
+  int16_t rasterCaps;      // RasterCaps, -1 for the built-in table
+  uint16_t bandRows;       // Rows per band with rasterCaps, 0 for the table's
+  uint32_t bufferBytes;    // 0 to leave the buffer model as the registry has it
+  uint16_t linesPerSecond;
+  uint8_t probe;           // ProbeFill
+  uint8_t pipeline[PIPELINE_MAX_STAGES];  // PipelineStage
+  int8_t pipelineLength;   // -1 for PRINTER_PIPELINE
+};
+
+// Read PRINTER_PROFILE_PATH; LittleFS must already be mounted. Returns the
+// number of profiles.
+size_t loadPrinterProfiles();
+
+// First profile matching the device name and print service, nullptr for none
+const PrinterProfile* findPrinterProfile(const char* name, const char* service);
+
+// * and ? glob match of the whole of text, case-insensitive
+bool profilePatternMatch(const char* pattern, const char* text);
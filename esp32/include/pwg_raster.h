@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+#include "image_raster.h"
+#include "dither.h"
+
+// Streaming decoder of the page rasters driverless clients send, PWG
+// Raster (image/pwg-raster, "RaS2") and Apple Raster (image/urf,
+// "UNIRAST"), into printer raster.
+//
+// Both formats carry a header per page and then rows run-length encoded
+// the same way: a repeat count for the row, then runs of one pixel
+// repeated or of literal pixels, and for a run of 128 white to the end of
+// the row. Each row is decoded as it arrives, turned into gray (8-bit gray,
+// 24-bit RGB or 1-bit black), dithered and handed to a RasterCommandWriter,
+// so memory is one row of each plus the writer's band. Every page becomes
+// a raster of its own, cut or labelled like one /print/image upload.
+//
+// Pages wider than maxDots are cut at the right; the client is expected to
+// have rendered them for the resolution and media the printer advertised.
+
+enum PwgRasterError {
+  PWG_OK,
+  PWG_ERR_FORMAT,        // Neither format, or a colour space that isn't decoded
+  PWG_ERR_CORRUPT,       // Runs past the end of a row
+  PWG_ERR_NO_MEMORY,
+  PWG_ERR_OUTPUT         // The output refused the commands
+};
+
+const char* pwgRasterErrorName(PwgRasterError error);
+
+class PwgRasterDecoder {
+public:
+  PwgRasterDecoder() = default;
+  ~PwgRasterDecoder() { release(); }
+
+  PwgRasterDecoder(const PwgRasterDecoder&) = delete;
+  PwgRasterDecoder& operator=(const PwgRasterDecoder&) = delete;
+
+  void begin(const ImageRasterOptions& options, uint16_t maxDots, ImageOutput output, void* context);
+
+  // Document data, in order; stops at the first error
+  PwgRasterError feed(const uint8_t* data, size_t length);
+
+  // The document is over; PWG_ERR_CORRUPT when it ended inside a page
+  PwgRasterError end();
+
+  PwgRasterError error() const { return _error; }
+  uint16_t pages() const { return _pages; }
+
+private:
+  enum Format : uint8_t { FORMAT_UNKNOWN, FORMAT_PWG, FORMAT_URF };
+  enum State : uint8_t { SYNC, PAGE_HEADER, LINE_REPEAT, RUN_COUNT, RUN_PIXEL, RUN_LITERAL, DONE };
+  enum Pixel : uint8_t { PIXEL_GRAY, PIXEL_KEY, PIXEL_RGB, PIXEL_BLACK_1 };
+
+  PwgRasterError fail(PwgRasterError error);
+  bool startPage();
+  bool finishLine();
+  bool pixelByte(uint8_t b, bool literal);
+  void release();
+
+  ImageRasterOptions _options;
+  uint16_t _maxDots = IMAGE_MAX_WIDTH;
+  ImageOutput _output = nullptr;
+  void* _context = nullptr;
+  PwgRasterError _error = PWG_OK;
+  uint16_t _pages = 0;
+
+  Format _format = FORMAT_UNKNOWN;
+  State _state = SYNC;
+  uint8_t _header[32];             // Sync word, URF page header, PWG fields kept
+  size_t _headerLen = 0;           // Bytes of the current header read
+  size_t _headerSize = 0;
+
+  // Page being decoded
+  Pixel _pixel = PIXEL_GRAY;
+  uint8_t _pixelBytes = 1;         // Bytes of one pixel in the runs
+  uint32_t _width = 0;             // Pixels the client sent
+  uint32_t _height = 0;
+  uint16_t _dots = 0;              // Of them printed
+  uint32_t _row = 0;               // Rows decoded
+  uint16_t _repeat = 0;            // Copies of the row being decoded
+  uint32_t _lineUnits = 0;         // Pixels of a row, bytes for 1-bit rows
+  uint32_t _units = 0;             // Of them decoded so far
+  uint16_t _runLeft = 0;           // Pixels of the run still to come
+  uint8_t _pixelValue[3];
+  uint8_t _pixelLen = 0;
+
+  uint8_t* _line = nullptr;        // The row as sent, run-length decoded
+  uint8_t* _gray = nullptr;
+  uint8_t* _packed = nullptr;
+  size_t _lineBytes = 0;
+  DitherEngine _dither;
+  RasterCommandWriter _writer;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "print_slice.h"
+#include "print_stream.h"
+
+// Optional re-encoding of ESC/POS raster data on its way to the printer.
+//
+// Client encoders send one GS v 0 block per raster row, so every 48 or 72
+// bytes of pixels carry an 8 byte header, and blank rows go out as full rows
+// of zeros. Printers that can take it get the rows merged into multi-row
+// GS v 0 bands and runs of blank rows replaced by a paper feed (ESC J).
+// Commands are delimited by a PrintStreamParser, and everything that isn't
+// a GS v 0 block passes through unchanged, payloads unread.
+//
+// TSPL printers get BITMAP commands split around their white rows instead:
+// each run of rows with ink goes out as its own BITMAP at its own y, and the
+// white rows in between aren't sent at all. That leaves what was already
+// drawn under those rows as it was, where an overwrite BITMAP would have
+// cleared it, so it is only right for labels drawn from CLS up.
+//
+// With RASTER_CAP_CROP each band or BITMAP piece only carries the columns
+// between its leftmost and rightmost ink: GS v 0 bands are moved into place
+// with a GS L left margin, which is put back to the job's own before
+// anything else is sent, and TSPL pieces get a larger x.
+//
+// Printers that buffer a whole GS v 0 block before feeding get a tall block
+// cut into bands with RASTER_CAP_SPLIT_BANDS: each band has its own header of
+// at most maxBandRows rows, and its data is streamed through as it comes, so
+// the head starts with the first band whatever the width.
+//
+// Which of that a printer accepts is looked up by its BLE device name; for
+// unknown models the stage stays off and the data is forwarded untouched.
+// It has no Arduino dependencies and builds on a host as it is.
+
+enum RasterCaps : uint8_t {
+  RASTER_CAP_NONE = 0,
+  RASTER_CAP_MERGE_ROWS = 1 << 0,  // Multi-row GS v 0 bands
+  RASTER_CAP_FEED_BLANK = 1 << 1,  // ESC J n for blank rows
+  RASTER_CAP_TSPL_BITMAP = 1 << 2, // TSPL printer: BITMAP split at white rows
+  RASTER_CAP_CROP = 1 << 3,        // Rows narrowed to their inked columns
+  RASTER_CAP_SPLIT_BANDS = 1 << 4  // Tall blocks cut into maxBandRows bands
+};
+
+struct RasterProfile {
+  const char* namePrefix;  // Matched against the BLE device name
+  uint8_t caps;
+  uint16_t maxBandRows;    // Rows per merged or split band the printer buffers
+};
+
+// Build flag override for printers not in the table
+#ifndef PRINTER_RASTER_CAPS
+#define PRINTER_RASTER_CAPS -1
+#endif
+#ifndef RASTER_MAX_WIDTH
+#define RASTER_MAX_WIDTH 128         // Bytes per row that can be merged (1024 dots)
+#endif
+#ifndef RASTER_MAX_BAND_ROWS
+#define RASTER_MAX_BAND_ROWS 32
+#endif
+#ifndef PRINTER_BAND_ROWS
+#define PRINTER_BAND_ROWS RASTER_MAX_BAND_ROWS  // Band height with PRINTER_RASTER_CAPS
+#endif
+
+// Profile for the named printer; caps are RASTER_CAP_NONE for unknown models
+RasterProfile lookupRasterProfile(const char* printerName);
+
+class RasterRecoder {
+public:
+  // Select the profile and the sink the re-encoded data goes to
+  void begin(const RasterProfile& profile, PrintSink output, void* context);
+  bool active() const { return _caps != RASTER_CAP_NONE; }
+  uint8_t caps() const { return _caps; }
+
+  // Consume one slice of job data. An empty slice ends the job and flushes
+  // whatever is still held back.
+  bool feed(const PrintSlice& slice);
+
+  size_t bytesIn() const { return _bytesIn; }
+  size_t bytesOut() const { return _bytesOut; }
+
+private:
+  enum State { PASS, ROWS, RAW_DATA, SPLIT_DATA };
+
+  static bool escposEvent(void* context, const PrintEvent& event);
+  bool escposRaster(const PrintEvent& event);
+  bool rasterHeader(const PrintEvent& event);
+  bool rowComplete();
+  bool emit(const uint8_t* data, size_t len);
+  bool emitByte(uint8_t b) { return emit(&b, 1); }
+  bool flushBand();
+  bool splitBand();
+  static bool tsplEvent(void* context, const PrintEvent& event);
+  bool tsplBitmap(const PrintEvent& event);
+  bool tsplRow();
+  bool flushBitmap(bool more);
+  bool flushFeed();
+  bool flushPending() { return flushBand() && flushFeed() && restoreMargin(); }
+  bool restoreMargin();
+  size_t cropBand(size_t width, uint8_t blank, size_t& left);
+  bool flushOutput();
+  void reset();
+
+  uint8_t _caps = RASTER_CAP_NONE;
+  uint16_t _maxBandRows = 1;
+  PrintSink _output = nullptr;
+  void* _context = nullptr;
+
+  State _state = PASS;
+  size_t _rowBytes = 0;         // Width of the block being parsed
+  uint8_t _mode = 0;
+  size_t _rowsLeft = 0;
+  size_t _rawLeft = 0;          // Bytes of the split band under way
+  uint8_t _row[RASTER_MAX_WIDTH];
+  size_t _rowLen = 0;
+
+  // Band being collected: rows of the same width and mode
+  uint8_t _band[RASTER_MAX_WIDTH * RASTER_MAX_BAND_ROWS];
+  size_t _bandWidth = 0;
+  uint8_t _bandMode = 0;
+  size_t _bandRows = 0;
+  size_t _blankRows = 0;        // Pending paper feed in dots
+  uint16_t _jobMargin = 0;      // GS L left margin the job set, in dots
+  uint16_t _margin = 0;         // The one the printer has now
+
+  // Delimits the commands of the job. A TSPL BITMAP being split has its
+  // rows collected in _row and _band.
+  PrintStreamParser _parser;
+  bool _splitting = false;
+  uint16_t _bitmapX = 0;
+  uint16_t _bitmapY = 0;        // Of the next row
+  uint16_t _bandY = 0;          // Of the first row in _band
+
+  uint8_t _out[2048];
+  size_t _outLen = 0;
+
+  size_t _bytesIn = 0;
+  size_t _bytesOut = 0;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "print_slice.h"
+#include "print_stream.h"
+
+// Rescaling of ESC/POS raster data made for a printer of another
+// resolution, so one job prints at the same size on 203 and 300 dpi heads.
+//
+// Every GS v 0 block is resampled by targetDpi / sourceDpi with an area
+// filter: each output dot takes the share of its area that inked source
+// dots cover, in both directions, and is inked when that is at least half.
+// Rows are streamed through one at a time; only the coverage of the output
+// row in progress is held. Blocks come out narrowed to maxDots when they
+// would be wider than the head.
+//
+// Text, ESC * bit images and the rest of the stream pass unchanged, and so
+// does a TSPL job, whose BITMAP positions and label size are in dots too and
+// would have to be scaled with it. It has no Arduino dependencies and builds
+// on a host as it is.
+
+#ifndef RESAMPLE_MAX_SOURCE_BYTES
+#define RESAMPLE_MAX_SOURCE_BYTES 256      // Widest GS v 0 row rescaled (2048 dots)
+#endif
+#ifndef RESAMPLE_MAX_DOTS
+#define RESAMPLE_MAX_DOTS 2048             // Widest row it puts out
+#endif
+
+class RasterResampler {
+public:
+  ~RasterResampler() { release(); }
+
+  // Scale one job from sourceDpi to targetDpi and cut it to maxDots, 0 for
+  // no limit. Stays inactive, passing nothing through, when the resolutions
+  // are unknown (0) or equal and there is no limit, or without the memory.
+  // The row buffers, about 13 KB, are taken by the first job and kept.
+  bool begin(uint16_t sourceDpi, uint16_t targetDpi, uint16_t maxDots, PrintSink output, void* context);
+  bool active() const { return _active; }
+
+  // Consume one slice of job data. An empty slice ends the job: what is
+  // still held goes out and the stage turns inactive again.
+  bool feed(const PrintSlice& slice);
+
+  uint32_t blocksScaled() const { return _blocks; }
+
+private:
+  enum Block : uint8_t { BLOCK_NONE, BLOCK_PASS, BLOCK_SCALE };
+
+  static bool streamEvent(void* context, const PrintEvent& event);
+  bool beginBlock(const PrintEvent& event);
+  bool sourceByte(uint8_t b);
+  bool sourceRow();
+  bool outputRow();
+  bool finishBlock();
+  bool emit(const uint8_t* data, size_t len);
+  bool flushOutput();
+  void release();
+
+  PrintSink _output = nullptr;
+  void* _context = nullptr;
+  PrintStreamParser _parser;
+  bool _active = false;
+  uint32_t _blocks = 0;
+
+  // Common unit of both grids: a source dot is _sourceUnit long, an output
+  // dot _outputUnit
+  uint32_t _sourceUnit = 1;
+  uint32_t _outputUnit = 1;
+  uint16_t _maxDots = 0;
+
+  Block _block = BLOCK_NONE;
+  uint16_t _sourceBytes = 0;
+  uint16_t _sourceRows = 0;
+  uint16_t _sourceRow = 0;             // Rows read so far
+  uint16_t _rowLen = 0;
+  uint16_t _outputDots = 0;
+  uint16_t _outputRows = 0;
+  uint16_t _outputRow = 0;             // Rows put out so far
+
+  uint8_t* _row = nullptr;             // Source row being read
+  uint16_t* _cover = nullptr;          // Its inked length within each output dot
+  uint32_t* _area = nullptr;           // Inked area of each dot of the output row
+  uint8_t* _line = nullptr;            // Output row packed
+  uint8_t _out[512];
+  size_t _outLen = 0;
+};
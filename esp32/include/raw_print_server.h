@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Raw TCP print listener ("JetDirect" / port 9100 mode).
+//
+// Each connection is one print job: everything the client sends until it
+// closes the socket goes straight into the print writer pipeline. Spoolers
+// (CUPS socket://, Windows Standard TCP/IP port in RAW mode) connect here
+// without any HTTP framing. Each printer gets a listener of its own, on
+// RAW_PRINT_PORT plus its registry index. Connections are served one at a
+// time; further ones wait in the listen backlog like on a real JetDirect port.
+
+#ifndef RAW_PRINT_PORT
+#define RAW_PRINT_PORT 9100               // First printer's port, 0 disables the listeners
+#endif
+#ifndef RAW_PRINT_IDLE_TIMEOUT
+#define RAW_PRINT_IDLE_TIMEOUT 30000      // ms without data that ends a job
+#endif
+#ifndef RAW_PRINT_CORE
+#define RAW_PRINT_CORE 0
+#endif
+#ifndef RAW_PRINT_PRIORITY
+#define RAW_PRINT_PRIORITY 2
+#endif
+
+#ifndef RAW_PRINT_CONNECT_WAIT
+#define RAW_PRINT_CONNECT_WAIT 10000      // ms a connection waits for its printer to connect
+#endif
+#ifndef RAW_PRINT_CONNECT_POLL
+#define RAW_PRINT_CONNECT_POLL 50         // ms between checks while it waits
+#endif
+
+// Asked before a connection is admitted, and may wait for the printer to
+// connect; refusing lets the spooler retry
+typedef bool (*RawPrintGate)(uint8_t printer);
+
+// Start the listener task feeding the printer's job queue
+bool initRawPrintServer(uint8_t printer, uint16_t port, RawPrintGate printerReady);
+
+// Job currently being received over the printer's raw port, 0 when idle
+uint32_t rawPrintActiveJob(uint8_t printer);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Print jobs whose body arrives in Content-Range segments over several
+// requests.
+//
+// POST /print with Upload-Length and no body admits a job of that size and
+// leaves it open; PUT /jobs/{id} segments then append to it. The job buffer
+// only takes the stream in order, so a segment may overlap what was
+// already received but not start past it: the writer prints from the
+// contiguous offset while later segments come in, and a client whose
+// upload dropped carries on from Upload-Offset instead of from zero. An
+// open upload that sees no segment for UPLOAD_RESUME_IDLE_MS fails.
+//
+// With Upload-Defer-Length: 1 instead, the size is left open, for producers
+// that send page by page as they render. Segments then give the size as *
+// ("bytes 0-4095/*") until one names it, or an empty PUT with
+// "Content-Range: bytes */<size>" ends the job at that size once the data
+// is in. HTTP bodies here need a Content-Length, so this stands in for a
+// chunked /print upload.
+
+#ifndef UPLOAD_RESUME_SLOTS
+#define UPLOAD_RESUME_SLOTS 4              // Resumable uploads open at once
+#endif
+#ifndef UPLOAD_RESUME_IDLE_MS
+#define UPLOAD_RESUME_IDLE_MS 120000       // Idle time before an open upload fails
+#endif
+
+enum UploadSegmentResult {
+  SEGMENT_OK,
+  SEGMENT_UNKNOWN,  // No open upload for the job
+  SEGMENT_GAP,      // Starts past the received data
+  SEGMENT_FULL,     // The job buffer didn't take all of it in time
+  SEGMENT_LENGTH    // Names another size than the upload has, or less than was received
+};
+
+// Create the lock of the upload table. Call once before the web server starts.
+bool initResumableUploads();
+
+// Keep an admitted job open for segments, of the job's size or of a size
+// that one of them names when length is PRINT_JOB_LENGTH_UNKNOWN. False when
+// all slots are taken.
+bool openResumableUpload(uint32_t jobId, size_t length);
+
+bool isResumableUpload(uint32_t jobId);
+
+// Append the part of a segment at offset that is new. total is the size the
+// segment names, PRINT_JOB_LENGTH_UNKNOWN for none. received is the
+// contiguous length afterwards. The job is finished once it is complete.
+UploadSegmentResult writeUploadSegment(uint32_t jobId, size_t offset, const uint8_t* data, size_t length,
+                                       size_t total, uint32_t timeoutMs, size_t& received);
+
+// Name the size of an upload without sending data, finishing the job when
+// it has all been received
+UploadSegmentResult endUploadAt(uint32_t jobId, size_t total, size_t& received);
+
+// Fail open uploads that went idle. Call periodically from one task.
+void serviceResumableUploads();
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free single-producer / single-consumer byte ring.
+//
+// The producer (HTTP body callback) only ever moves the head, the consumer
+// (BLE writer task) only ever moves the tail, so no lock is needed as long as
+// there is exactly one of each. Head and tail are free-running counters and
+// the capacity is a power of two, so the whole buffer is usable.
+class RingBuffer {
+public:
+  RingBuffer() = default;
+  ~RingBuffer();
+
+  RingBuffer(const RingBuffer&) = delete;
+  RingBuffer& operator=(const RingBuffer&) = delete;
+
+  // Allocate the storage, preferring PSRAM when it is available. The
+  // capacity is rounded up to a power of two.
+  bool begin(size_t capacity);
+  void end();
+
+  // Producer side: copy up to len bytes in, returns the number accepted.
+  size_t write(const uint8_t* data, size_t len);
+
+  // Consumer side: expose the largest contiguous readable region without
+  // copying it, then release it with consume() once it has been sent.
+  size_t peek(const uint8_t** data) const;
+  // Same, but also expose the part that wraps around to the start of the
+  // storage. Returns the total of both spans.
+  size_t peek(const uint8_t** first, size_t* firstLen,
+              const uint8_t** second, size_t* secondLen) const;
+  void consume(size_t len);
+  // Give the last len bytes consumed back to be read again. Only while the
+  // producer hasn't written over them since, which the caller ensures.
+  void rewind(size_t len);
+
+  // Drop everything that is buffered. Only call while the producer is idle.
+  void clear();
+
+  size_t available() const;
+  size_t space() const;
+  size_t capacity() const { return _capacity; }
+  bool inPsram() const { return _inPsram; }
+
+private:
+  uint8_t* _buf = nullptr;
+  size_t _capacity = 0;
+  bool _inPsram = false;
+  std::atomic<size_t> _head{0};
+  std::atomic<size_t> _tail{0};
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <TFT_eSPI.h>
+
+// Status screen mirrored to WebSocket clients, so it can be watched
+// remotely without a cable or reading the panel back.
+//
+// The display task hands over the status sprite after each frame. It is
+// split into tiles of SCREEN_MIRROR_TILE pixels, and a hash of each is kept;
+// only tiles whose hash changed are encoded and sent, and a new client gets
+// every tile. Each binary message, all values little endian:
+//   u16 width, u16 height        of the screen
+//   u16 tiles                    in this message
+//   per tile: u16 x, u16 y, u8 w, u8 h, u16 bytes, then bytes of runs
+// covering the tile's w x h pixels row by row. A run byte with the top bit
+// set repeats the 565 word after it (low 7 bits + 1) times, otherwise
+// (run + 1) 565 words follow. Messages are at most SCREEN_MIRROR_MESSAGE
+// bytes; a frame takes as many as its tiles need.
+//
+// Nothing is encoded without a client. When a client's queue is full, or
+// internal RAM is below HEAP_INTERNAL_RESERVE, the rest of the frame's
+// tiles wait for the next frame. The mirror follows the status sprite, so it
+// shows the status screen while the job panel or a print preview is on the
+// panel, and nothing without the memory for the sprite or while the screen
+// is off.
+
+#ifndef SCREEN_MIRROR_PATH
+#define SCREEN_MIRROR_PATH "/screen"
+#endif
+#ifndef SCREEN_MIRROR_TILE
+#define SCREEN_MIRROR_TILE 16              // Pixels, at most 255
+#endif
+#ifndef SCREEN_MIRROR_MESSAGE
+#define SCREEN_MIRROR_MESSAGE 4096         // Bytes, over one tile of literals
+#endif
+#ifndef SCREEN_MIRROR_CLIENTS
+#define SCREEN_MIRROR_CLIENTS 4
+#endif
+
+// Register the WebSocket handler on the server
+void initScreenMirror(AsyncWebServer& server);
+
+// Send what changed in the screen; call from the task that draws it, after
+// each frame. nullptr when there is no sprite.
+void screenMirrorFrame(TFT_eSprite* screen);
+
+// Clients watching
+size_t screenMirrorClients();
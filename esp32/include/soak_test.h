@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Soak test mode: hours of print, reconnect and status traffic against one
+// printer, watching the bridge for drift.
+//
+// Built with -DSOAK_TEST=1 (pio run -e soak-test), the bridge starts a task
+// after boot that prints a job every SOAK_JOB_INTERVAL_MS to printer
+// SOAK_PRINTER, normally the fake printer (fake_printer/main.cpp). The jobs
+// rotate through the calibration and density labels of BENCH_PATH "/ble"
+// and SOAK_NUL_BYTES of NUL. Every SOAK_RECONNECT_JOBS jobs it drops the
+// link and connects again, which runs the scan, client and callback setup
+// of a real reconnect, and every job refreshes the /status snapshot.
+//
+// Each SOAK_SAMPLE_MS it records the largest free block, the free and the
+// lowest-ever free internal RAM, the p99 job latency (created to done) and
+// the slowest reconnect of the interval, and logs them. After
+// SOAK_WARMUP_SAMPLES, the medians of the next SOAK_WINDOW samples are the
+// baseline; from then on the medians of the last SOAK_WINDOW samples are
+// compared with it. The test fails when the largest block shrank by
+// SOAK_BLOCK_DRIFT_PCT, free or lowest free RAM by SOAK_HEAP_DRIFT_BYTES,
+// the p99 latency grew by SOAK_LATENCY_DRIFT_PCT, the reconnect time by
+// SOAK_RECONNECT_DRIFT_PCT, or more than SOAK_MAX_ERRORS jobs or reconnects
+// failed. A failure is logged as an error every sample from then on, and
+// the traffic goes on so the state can be looked at.
+//
+//   GET SOAK_PATH
+//       200 while passing, 500 once failed, so `curl -f` in a monitor trips
+//       {"state":"running","printer":"fake","uptimeS":7260,"jobs":3500,
+//        "reconnects":175,"errors":0,"failures":[],
+//        "baseline":{"largestBlock":...,"minFree":...,"freeHeap":...,
+//                    "p99Ms":...,"reconnectMs":...},"current":{...},
+//        "samples":[[uptimeS,largestBlock,minFree,freeHeap,p99Ms,
+//                    reconnectMs,jobs,errors], ...]}
+
+#ifndef SOAK_TEST
+#define SOAK_TEST 0                    // 1 builds the soak test mode
+#endif
+#ifndef SOAK_PATH
+#define SOAK_PATH "/soak"
+#endif
+#ifndef SOAK_PRINTER
+#define SOAK_PRINTER 0                 // Index in the printer registry
+#endif
+#ifndef SOAK_START_DELAY_MS
+#define SOAK_START_DELAY_MS 30000      // Boot, Wi-Fi and the first connect settle first
+#endif
+#ifndef SOAK_JOB_INTERVAL_MS
+#define SOAK_JOB_INTERVAL_MS 2000      // Pause after each job
+#endif
+#ifndef SOAK_JOB_TIMEOUT_MS
+#define SOAK_JOB_TIMEOUT_MS 60000      // A job still pending after this is aborted and failed
+#endif
+#ifndef SOAK_NUL_BYTES
+#define SOAK_NUL_BYTES (16 * 1024)
+#endif
+#ifndef SOAK_RECONNECT_JOBS
+#define SOAK_RECONNECT_JOBS 20         // Jobs between reconnects, 0 for none
+#endif
+#ifndef SOAK_RECONNECT_TIMEOUT_MS
+#define SOAK_RECONNECT_TIMEOUT_MS 30000
+#endif
+#ifndef SOAK_SAMPLE_MS
+#define SOAK_SAMPLE_MS 60000
+#endif
+#ifndef SOAK_SAMPLES
+#define SOAK_SAMPLES 240               // Kept for SOAK_PATH, 28 bytes each; the log has them all
+#endif
+#ifndef SOAK_WARMUP_SAMPLES
+#define SOAK_WARMUP_SAMPLES 10         // Caches and pools fill up before the baseline
+#endif
+#ifndef SOAK_WINDOW
+#define SOAK_WINDOW 10                 // Samples a median is taken over, at most 32
+#endif
+#ifndef SOAK_BLOCK_DRIFT_PCT
+#define SOAK_BLOCK_DRIFT_PCT 25
+#endif
+#ifndef SOAK_HEAP_DRIFT_BYTES
+#define SOAK_HEAP_DRIFT_BYTES (16 * 1024)
+#endif
+#ifndef SOAK_LATENCY_DRIFT_PCT
+#define SOAK_LATENCY_DRIFT_PCT 50
+#endif
+#ifndef SOAK_RECONNECT_DRIFT_PCT
+#define SOAK_RECONNECT_DRIFT_PCT 100
+#endif
+#ifndef SOAK_MAX_ERRORS
+#define SOAK_MAX_ERRORS 5
+#endif
+
+// Start the soak task and register GET SOAK_PATH; nothing without SOAK_TEST
+void initSoakTest(AsyncWebServer& server);
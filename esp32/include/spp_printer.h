@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Classic Bluetooth transport for a printer that speaks RFCOMM (SPP), built
+// with -DSPP_PRINTER=1 for the original ESP32 (env:esp32dev); the S3 has no
+// BR/EDR radio. Many cheap printers take data over SPP several times faster
+// than over GATT writes.
+//
+// The registry entry of the SPP printer has "spp:" in front of its MAC and
+// goes through the same job queue, rescaler and re-encoder as BLE printers.
+// BluetoothSerial holds one connection, so there is one SPP printer at most.
+// RFCOMM has credit-based flow control, so there is no XOFF or pacing to do.
+
+#ifndef SPP_PRINTER
+#define SPP_PRINTER 0
+#endif
+#ifndef SPP_PRINTER_TIMEOUT_MS
+#define SPP_PRINTER_TIMEOUT_MS 30000     // A printer taking nothing this long fails the job
+#endif
+#ifndef SPP_PRINTER_PIN
+#define SPP_PRINTER_PIN "0000"           // For printers still on legacy pairing
+#endif
+#ifndef SPP_CHUNK_SIZE
+#define SPP_CHUNK_SIZE 990               // RFCOMM frame payload of BluetoothSerial
+#endif
+#ifndef SPP_BACKOFF_MIN
+#define SPP_BACKOFF_MIN 1000             // First retry after a failed connect
+#endif
+#ifndef SPP_BACKOFF_MAX
+#define SPP_BACKOFF_MAX 60000
+#endif
+#ifndef SPP_LINK_CORE
+#define SPP_LINK_CORE 0
+#endif
+
+// Told when the RFCOMM link comes up or drops, from the SPP link task or the
+// Bluedroid task; must not block
+typedef void (*SppPrinterListener)(void* context, bool connected);
+
+// Start the link task, which connects to the printer at address and
+// reconnects with backoff whenever the link drops
+bool initSppPrinter(const uint8_t address[6], SppPrinterListener listener, void* context);
+
+bool sppPrinterConnected();
+
+// Send data to the printer, blocking while RFCOMM has no credits. Returns
+// false once the link is gone or the printer stopped taking data.
+bool sppPrinterWrite(const uint8_t* data, size_t length);
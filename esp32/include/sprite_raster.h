@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "image_raster.h"
+
+// Printer raster straight from a composed 1-bit sprite.
+//
+// The sprite's buffer already is packed MSB first with 1 for ink, rows
+// padded to whole bytes, so rows go to the RasterCommandWriter as they are
+// stored. The buffer is read as stored whatever setRotation() says: a label
+// drawn at rotation 1 comes out turned clockwise for free. For labels drawn
+// upright that feed sideways, TURN_90 transposes 8x8 blocks in two 32-bit
+// words instead of reading pixels one at a time.
+
+enum SpriteRasterTurn {
+  SPRITE_RASTER_AS_STORED,
+  SPRITE_RASTER_TURN_90      // Clockwise, the stored top row becomes the right edge
+};
+
+// Size of the raster writeSpriteRaster() produces, in dots
+void spriteRasterSize(TFT_eSprite& sprite, SpriteRasterTurn turn, uint16_t& width, uint16_t& height);
+
+// Stream the sprite as printer commands. Fails with IMAGE_ERR_FORMAT unless
+// it is a created 1-bit sprite.
+ImageError writeSpriteRaster(TFT_eSprite& sprite, SpriteRasterTurn turn, const ImageRasterOptions& options,
+                             ImageOutput output, void* context);
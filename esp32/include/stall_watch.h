@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Which code blocks the bridge's tasks for long, and what was blocking
+// when the last watchdog reset or crash hit.
+//
+// Code that may block (a BLE connect, an acknowledged write, a body chunk
+// handled on AsyncTCP) is wrapped in STALL_SECTION("tag"). Each task keeps
+// the longest section it has been in and that section's tag. A timer looks
+// at the open sections every STALL_CHECK_MS and keeps the one open longest
+// in RTC memory, which survives a panic or watchdog reset but not a power
+// cycle; a section open for STALL_REPORT_MS is logged and kept there as the
+// worst stall of the boot. The next boot reads both back together with the
+// reset reason, and /status reports them under "stalls".
+
+#ifndef STALL_TASKS
+#define STALL_TASKS 12                 // Tasks with sections that are followed
+#endif
+#ifndef STALL_CHECK_MS
+#define STALL_CHECK_MS 100             // How often the open sections are looked at
+#endif
+#ifndef STALL_REPORT_MS
+#define STALL_REPORT_MS 2000           // Open this long counts as a stall, below the 5 s task watchdog
+#endif
+
+// Marks the enclosing scope as a section named tag. Sections nest; the
+// innermost one is what a stall is blamed on. tag must be a literal.
+class StallSection {
+public:
+  explicit StallSection(const char* tag);
+  ~StallSection();
+
+private:
+  struct StallSlot* _slot;
+  const char* _outerTag;
+  uint32_t _outerSince;
+  uint32_t _since;
+};
+
+#define STALL_CONCAT2(a, b) a##b
+#define STALL_CONCAT(a, b) STALL_CONCAT2(a, b)
+#define STALL_SECTION(tag) StallSection STALL_CONCAT(stallSection, __LINE__)(tag)
+
+struct StallTaskInfo {
+  TaskHandle_t task;
+  const char* longestTag;        // nullptr until a section finished
+  uint32_t longestMs;
+};
+
+// One section as kept in RTC memory
+struct StallRecord {
+  char task[16];
+  char tag[24];
+  uint32_t ms;                   // How long it was open, so far for one still open
+  uint32_t uptime;               // Seconds since boot when it was recorded
+};
+
+struct StallReport {
+  const char* resetReason;       // Of this boot, e.g. "task_wdt", "panic"
+  bool hasWorst;
+  StallRecord worst;             // Longest stall of the boot before
+  bool hasOpen;
+  StallRecord open;              // Section open longest at that boot's last check
+};
+
+// Read what the boot before left and start checking. Call early in setup().
+void initStallWatch();
+
+// Tasks that have been in a section, with their longest one
+size_t getStallTasks(StallTaskInfo* out, size_t max);
+
+// What the previous boot left in RTC memory
+const StallReport& previousStallReport();
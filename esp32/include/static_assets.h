@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Web UI assets packed by scripts/pack_data.py.
+//
+// The build stores the assets gzipped and lists them in /assets.txt with an
+// ETag each. They go out with Content-Encoding: gzip and their ETag; a
+// matching If-None-Match gets 304 without touching the file. Names with a
+// content hash (libs/) are cached by the browser for good, the rest is
+// revalidated on every load. Files not in the list are left to serveStatic.
+//
+// Builds with STATIC_ASSET_BUNDLE (set by the script, custom_asset_bundle in
+// platformio.ini) also carry the packed assets in the firmware, as const
+// data in mapped flash with type, length and ETag worked out at build time.
+// Those are sent straight from flash, with no LittleFS call and no copy of
+// the body. An asset whose ETag in /assets.txt differs from the bundled one
+// was updated on LittleFS since and is served from there.
+
+#ifndef STATIC_ASSET_MANIFEST
+#define STATIC_ASSET_MANIFEST "/assets.txt"
+#endif
+#ifndef STATIC_MAX_ASSETS
+#define STATIC_MAX_ASSETS 32
+#endif
+
+// Read the manifest and register the handlers. Call before serveStatic so
+// they take precedence. False when there is neither a bundle nor a manifest
+// (data/ uploaded unpacked).
+bool initStaticAssets(AsyncWebServer& server);
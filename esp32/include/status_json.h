@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "print_writer.h"
+#include "stall_watch.h"
+
+// /status without building Strings on every poll.
+//
+// Each request takes a fixed-size snapshot of the bridge and printer state
+// and compares it with the last one. Only when something changed is the
+// JSON written again with snprintf into one of two static buffers, and the
+// status version goes up. The version is the ETag, so a matching
+// If-None-Match gets 304, and ?since=<version> holds the request until the
+// status changes or STATUS_LONG_POLL_MS pass. uptime is left out of the
+// comparison and filled in per response.
+
+#ifndef STATUS_JSON_SIZE
+#define STATUS_JSON_SIZE (1152 + STALL_TASKS * 64 + MAX_PRINTERS * 896)  // Bytes of one serialized status
+#endif
+#ifndef STATUS_LONG_POLL_MS
+#define STATUS_LONG_POLL_MS 25000                    // Longest wait for ?since=
+#endif
+
+// Answer a /status request
+void sendStatus(AsyncWebServerRequest* request);
+
+// Refresh the snapshot and return the current status version
+uint32_t statusVersion();
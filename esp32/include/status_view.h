@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "print_writer.h"
+#include "band_renderer.h"
+
+// Status screen kept as a list of text lines. Each frame fills in the lines
+// anew; render() compares them with what the panel shows and redraws only
+// the lines that changed, so the screen doesn't flash once a second and an
+// idle frame costs no bus traffic. The lines are drawn into a sprite of the
+// whole panel in PSRAM and only the rows that changed are pushed, each band
+// as one window write. Without the memory for it the changed rows are
+// composed in small bands of internal RAM instead, and as a last resort the
+// lines are drawn on the panel directly, without the graph.
+//
+// The panel shares the CPU with the print writers, so a frame spends at
+// most STATUS_DRAW_BUDGET_US pushing rows; what is left goes with the next
+// frame.
+
+// Wi-Fi, printer summary, one per printer, last action and uptime
+#define STATUS_VIEW_LINES (4 + MAX_PRINTERS)
+#define STATUS_VIEW_TEXT 48
+
+// Throughput graph along the bottom of the panel, one column per frame
+#ifndef STATUS_GRAPH_HEIGHT
+#define STATUS_GRAPH_HEIGHT 30
+#endif
+#define STATUS_GRAPH_COLUMNS 320           // Widest panel supported
+#ifndef STATUS_DRAW_BUDGET_US
+#define STATUS_DRAW_BUDGET_US 4000
+#endif
+#define STATUS_PUSH_ROWS 8                 // Rows pushed between budget checks
+// Expanded glyphs kept for the status sprite, and for the panel that the job
+// panel and the direct fallback draw on; 0 turns the caches off
+#ifndef STATUS_GLYPH_CACHE
+#define STATUS_GLYPH_CACHE 8192
+#endif
+
+class StatusView {
+public:
+  // After tft->init() and setRotation()
+  void begin(TFT_eSPI* tft);
+
+  // Start a frame; lines not set again are blanked by render()
+  void beginFrame();
+  void set(uint8_t line, int16_t y, uint8_t size, uint16_t color, const char* format, ...)
+    __attribute__((format(printf, 6, 7)));
+  // Add a graph sample; render() scrolls the graph left by one column and
+  // draws only the new one
+  void addSample(uint32_t value);
+  void render();
+
+  // Clear the panel and redraw every line on the next render(), after
+  // something else drew on it
+  void invalidate() { _clear = true; }
+
+  // The sprite the screen is drawn in, nullptr when drawn in bands or on the panel
+  TFT_eSprite* sprite() const { return _sprite; }
+
+private:
+  struct Line {
+    char text[STATUS_VIEW_TEXT];
+    uint16_t color;
+    int16_t y;
+    uint8_t size;
+  };
+
+  struct Rows {
+    int16_t top;
+    int16_t bottom;              // Exclusive
+  };
+
+  static bool same(const Line& a, const Line& b);
+  Rows rows(const Line& line);
+  void markDirty(const Rows& rows);
+  void push();
+  int16_t graphTop() const { return _tft->height() - STATUS_GRAPH_HEIGHT; }
+  void drawColumn(TFT_eSPI& canvas, int16_t x, uint32_t value);
+  uint32_t graphScale() const;
+  void drawGraph();
+  static void drawBand(TFT_eSPI& canvas, void* context);
+
+  TFT_eSPI* _tft = nullptr;
+  TFT_eSprite* _sprite = nullptr;
+  BandRenderer _bands;           // Without the sprite
+  TFT_eSPI* _canvas = nullptr;   // The sprite, or the panel without one
+  bool _clear = true;
+  Line _shown[STATUS_VIEW_LINES] = {};
+  Line _next[STATUS_VIEW_LINES] = {};
+  // Row bands to push, two per line at most: where it was and where it is
+  Rows _dirty[2 * STATUS_VIEW_LINES + 1];
+  uint8_t _dirtyCount = 0;
+
+  // Graph samples, oldest first once the ring has wrapped
+  uint32_t _samples[STATUS_GRAPH_COLUMNS] = {};
+  uint16_t _sampleNext = 0;
+  uint16_t _newSamples = 0;      // Not drawn yet
+  uint32_t _graphScale = 0;      // Sample value drawn at the full height
+};
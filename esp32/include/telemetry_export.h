@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Fleet telemetry pushed over UDP, so dashboards over dozens of bridges
+// don't have to poll /status or /metrics on each.
+//
+// Once per TELEMETRY_INTERVAL_MS a task of its own formats the bridge's
+// counters into one static buffer and sends them to TELEMETRY_HOST as
+// datagrams of at most TELEMETRY_PACKET_BYTES: one line per printer with
+// its link counters, throughput, latency percentiles, queue and reconnects,
+// one with its chunk latency histogram, and one for the bridge with heap
+// and queue figures. Lines are InfluxDB line protocol, or StatsD gauges with
+// TELEMETRY_FORMAT=TELEMETRY_STATSD. Values are the totals since boot, as
+// in /metrics, so a lost packet loses nothing but its sample points.
+//
+// Sends never block: a datagram the stack has no room for is dropped and
+// counted, and a round is skipped while internal RAM is below
+// HEAP_INTERNAL_RESERVE or no network is up.
+
+#define TELEMETRY_INFLUX 0
+#define TELEMETRY_STATSD 1
+
+#ifndef TELEMETRY_HOST
+#define TELEMETRY_HOST ""                  // Name or address of the collector, empty disables export
+#endif
+#ifndef TELEMETRY_PORT
+#define TELEMETRY_PORT 8089                // InfluxDB UDP listener; StatsD is usually 8125
+#endif
+#ifndef TELEMETRY_FORMAT
+#define TELEMETRY_FORMAT TELEMETRY_INFLUX
+#endif
+#ifndef TELEMETRY_INTERVAL_MS
+#define TELEMETRY_INTERVAL_MS 10000
+#endif
+#ifndef TELEMETRY_PACKET_BYTES
+#define TELEMETRY_PACKET_BYTES 1024        // Under the path MTU, so nothing is fragmented
+#endif
+#ifndef TELEMETRY_CORE
+#define TELEMETRY_CORE 0
+#endif
+#ifndef TELEMETRY_PRIORITY
+#define TELEMETRY_PRIORITY 1
+#endif
+
+// Start the exporter task; no-op without TELEMETRY_HOST
+void initTelemetryExport();
+
+bool telemetryExportEnabled();
+
+// Datagrams sent, and dropped for want of memory, buffer space or a route
+uint32_t telemetryPacketsSent();
+uint32_t telemetryPacketsDropped();
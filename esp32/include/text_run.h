@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+// One line of text in a built-in TFT_eSPI font (GLCD, Font 2 or the RLE
+// fonts), decoded from UTF-8 once by set(). The glyph advances and the
+// width are measured once per font and size, and the run remembers what it
+// drew where: drawing it again redraws only the glyphs that changed or
+// moved, and clears only the part of the old text the new one doesn't
+// cover, instead of padding the whole width. A changing right-aligned
+// number rewrites its changed digits and nothing else.
+//
+// The built-in fonts paint their whole cell when the background differs
+// from the text colour, which is what lets a glyph be redrawn over another.
+// Free fonts and smooth fonts don't, and aren't supported.
+
+#define TEXT_RUN_GLYPHS 48
+
+class TextRun {
+public:
+  // False when the text is the same as before
+  bool set(const char* utf8);
+  uint8_t length() const { return _length; }
+
+  // Width in the canvas's current font and size
+  int16_t width(TFT_eSPI& canvas);
+
+  // Draw with the current font and size at x, y. The horizontal part of
+  // datum (TL_DATUM, TC_DATUM or TR_DATUM and the M and B rows) aligns the
+  // text on x; y is always its top row.
+  void draw(TFT_eSPI& canvas, int16_t x, int16_t y, uint8_t datum, uint16_t color, uint16_t bg);
+
+  // Forget what was drawn, after something else drew over it
+  void invalidate() { _drawnLength = 0; _drawnWidth = 0; }
+
+private:
+  void measure(TFT_eSPI& canvas);
+
+  uint16_t _codes[TEXT_RUN_GLYPHS];
+  uint8_t _length = 0;
+
+  // Advances for _metricsKey, font and size; 0 when not measured
+  uint8_t _advance[TEXT_RUN_GLYPHS];
+  int16_t _width = 0;
+  uint16_t _metricsKey = 0;
+
+  // What the canvas shows
+  uint16_t _drawnCodes[TEXT_RUN_GLYPHS];
+  uint8_t _drawnAdvance[TEXT_RUN_GLYPHS];
+  uint8_t _drawnLength = 0;
+  int16_t _drawnX = 0;
+  int16_t _drawnY = 0;
+  int16_t _drawnWidth = 0;
+  int16_t _drawnHeight = 0;
+  uint16_t _drawnKey = 0;
+  uint16_t _drawnColor = 0;
+  uint16_t _drawnBg = 0;
+};
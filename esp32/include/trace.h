@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Timeline of what the bridge's tasks do, for chrome://tracing and Perfetto.
+//
+// TRACE_BEGIN/TRACE_END mark spans and TRACE_INSTANT single moments, each
+// with one number (bytes, a job ID, a state). A record is 16 bytes written
+// into a ring per core with a claimed slot, so it takes no lock, doesn't
+// block and costs well under a microsecond; a log line at 115200 baud costs
+// milliseconds. The rings keep the last TRACE_EVENTS records per core.
+//
+// GET TRACE_PATH takes a copy of both rings and streams it as Chrome trace
+// JSON, one track per task, so HTTP ingest on AsyncTCP, the print writers,
+// BLE writes and credit waits, link state changes and screen updates can
+// be lined up against each other. Open it in https://ui.perfetto.dev.
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 512       // Records per core, a power of two; 0 compiles tracing out
+#endif
+#ifndef TRACE_PATH
+#define TRACE_PATH "/trace"
+#endif
+
+enum TraceEvent : uint16_t {
+  TRACE_HTTP_BODY,             // Instant: bytes of a print upload arrived
+  TRACE_JOB_ADMIT,             // Instant: job ID admitted to a queue
+  TRACE_JOB_APPEND,            // Span: copying into a job, waiting for room included; bytes
+  TRACE_JOB_STREAMING,         // Instant: a writer started on job ID
+  TRACE_JOB_DONE,              // Instant: job ID finished or failed
+  TRACE_WRITER_SLICE,          // Span: a writer handing one slice to its printer; bytes
+  TRACE_BLE_WRITE,             // Span: one characteristic write; bytes
+  TRACE_TX_CREDIT,             // Span: waiting for a controller TX buffer; printer index
+  TRACE_LINK_STATE,            // Instant: printer index << 8 | BleLinkState
+  TRACE_DISPLAY,               // Span: one screen update
+  TRACE_EVENT_COUNT
+};
+
+#if TRACE_EVENTS
+void traceRecord(TraceEvent event, char phase, uint32_t arg);
+#define TRACE_BEGIN(event, arg) traceRecord(event, 'B', arg)
+#define TRACE_END(event, arg) traceRecord(event, 'E', arg)
+#define TRACE_INSTANT(event, arg) traceRecord(event, 'i', arg)
+#else
+#define TRACE_BEGIN(event, arg)
+#define TRACE_END(event, arg)
+#define TRACE_INSTANT(event, arg)
+#endif
+
+// Register GET TRACE_PATH on the server
+void initTrace(AsyncWebServer& server);
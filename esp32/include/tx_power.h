@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+// BLE transmit power policy of one printer's link.
+//
+// Missed packets at range cost link-layer retransmits that eat throughput
+// without any error showing, while full power on a short link only adds
+// interference with neighbouring bridges and draw. A printer connects at
+// full power, and after each round of the link controller (link_control.h)
+// the policy steps it: up at once when the link degraded or the RSSI is
+// below TX_POWER_RAISE_RSSI, down after TX_POWER_LOWER_ROUNDS clean rounds
+// in a row above TX_POWER_LOWER_RSSI. The RSSI is what we receive from the
+// printer, which stands in for what it receives from us.
+//
+// The steps are the 3 dB levels from -12 to +9 dBm every ESP32 controller
+// has. It has no Arduino dependencies and builds on a host as it is.
+
+#ifndef TX_POWER_POLICY
+#define TX_POWER_POLICY 1               // 0 leaves the controller's default power
+#endif
+#ifndef TX_POWER_RAISE_RSSI
+#define TX_POWER_RAISE_RSSI -75         // dBm
+#endif
+#ifndef TX_POWER_LOWER_RSSI
+#define TX_POWER_LOWER_RSSI -55
+#endif
+#ifndef TX_POWER_LOWER_ROUNDS
+#define TX_POWER_LOWER_ROUNDS 8
+#endif
+#ifndef TX_POWER_MIN_DBM
+#define TX_POWER_MIN_DBM -6             // Lowest level the policy goes down to
+#endif
+
+static const uint8_t TX_POWER_STEPS = 8;
+
+class TxPowerPolicy {
+public:
+  // A connection starts at full power
+  void begin();
+
+  // A round of the link controller ended; true when the step changed.
+  // rssi is 0 when it hasn't been read.
+  bool round(int8_t rssi, bool degraded);
+
+  // 0 is -12 dBm, each step 3 dB more
+  uint8_t step() const { return _step; }
+  int8_t dBm() const { return -12 + 3 * _step; }
+
+private:
+  uint8_t _step = TX_POWER_STEPS - 1;
+  uint8_t _strongRounds = 0;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+
+// USB host transport for a printer on the ESP32-S3's OTG port, built with
+// -DUSB_HOST_PRINTER=1. It takes the first bulk OUT endpoint of a printer
+// class interface (0x07), or of a CDC data interface for printers that
+// emulate a serial port, which then get their line coding and DTR/RTS set.
+// One device at a time; the port must supply VBUS.
+//
+// The registry entry of the USB printer has "usb" in place of its MAC and
+// goes through the same job queue, rescaler and re-encoder as BLE printers.
+// Bulk transfers are flow-controlled by the printer, so there is no XOFF or
+// pacing to do.
+
+#ifndef USB_HOST_PRINTER
+#define USB_HOST_PRINTER 0
+#endif
+#ifndef USB_PRINTER_TRANSFER_SIZE
+#define USB_PRINTER_TRANSFER_SIZE 8192   // Bytes per bulk transfer, in DMA-capable RAM
+#endif
+#ifndef USB_PRINTER_TRANSFERS
+#define USB_PRINTER_TRANSFERS 2          // In flight at once, one filling while one goes out
+#endif
+#ifndef USB_PRINTER_TIMEOUT_MS
+#define USB_PRINTER_TIMEOUT_MS 30000     // A printer NAKing this long fails the job
+#endif
+#ifndef USB_CDC_BAUD
+#define USB_CDC_BAUD 115200              // Line coding for CDC-ACM printers
+#endif
+#ifndef USB_HOST_CORE
+#define USB_HOST_CORE 0
+#endif
+
+enum UsbPrinterClass {
+  USB_PRINTER_NONE,
+  USB_PRINTER_CLASS,    // Printer class bulk OUT
+  USB_PRINTER_CDC       // CDC-ACM data interface
+};
+
+// Told when a printer is plugged in or pulled, from the USB client task;
+// must not block
+typedef void (*UsbPrinterListener)(void* context, bool attached);
+
+// Install the USB host and start looking for a printer
+bool initUsbPrinter(UsbPrinterListener listener, void* context);
+
+bool usbPrinterAttached();
+UsbPrinterClass usbPrinterClass();
+// Product string of the attached printer, "USB printer" without one
+const char* usbPrinterName();
+
+// Queue data for the printer, blocking while all transfers are in flight.
+// Returns false once the printer is gone or stopped taking data.
+bool usbPrinterWrite(const uint8_t* data, size_t length);
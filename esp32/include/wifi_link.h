@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Wi-Fi station driven by events instead of busy-waiting.
+//
+// initWifiLink() only starts the connection; boot and the printer side go
+// on while it comes up. A dropped or failed connection is retried with
+// exponential backoff from serviceWifiLink(). The BSSID and channel of the
+// last access point are kept in RTC memory, so a reconnect or a warm reboot
+// joins it without a scan, falling back to a full scan when that fails.
+// With WIFI_STATIC_IP set, DHCP is skipped as well.
+
+#ifndef WIFI_BACKOFF_MIN_MS
+#define WIFI_BACKOFF_MIN_MS 500         // First retry after a drop
+#endif
+#ifndef WIFI_BACKOFF_MAX_MS
+#define WIFI_BACKOFF_MAX_MS 30000       // Longest wait between attempts
+#endif
+#ifndef WIFI_CONNECT_TIMEOUT_MS
+#define WIFI_CONNECT_TIMEOUT_MS 15000   // Attempt without an IP counts as failed
+#endif
+// Static addressing, dotted quads; an empty WIFI_STATIC_IP uses DHCP
+#ifndef WIFI_STATIC_IP
+#define WIFI_STATIC_IP ""
+#endif
+#ifndef WIFI_GATEWAY
+#define WIFI_GATEWAY ""
+#endif
+#ifndef WIFI_SUBNET
+#define WIFI_SUBNET "255.255.255.0"
+#endif
+#ifndef WIFI_DNS
+#define WIFI_DNS ""                     // Defaults to the gateway
+#endif
+
+// Register the event handlers and start connecting
+void initWifiLink(const char* ssid, const char* password);
+
+// Start the next attempt once its backoff has passed. Call periodically
+// from one task.
+void serviceWifiLink();
+
+// Join another network from serviceWifiLink(), shortly after the call so a
+// client on the old one still gets its answer
+void setWifiCredentials(const char* ssid, const char* password);
+
+// Turn the station off, or back on and connecting, from serviceWifiLink().
+// Used while Ethernet carries the bridge, so the radio is BLE's alone.
+void suspendWifiLink(bool suspend);
+
+// Connected with an address
+bool wifiLinkUp();
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// WebSocket print channel for incremental streaming from the web UI.
+//
+// Protocol, one job at a time per socket; after "end" the socket may start
+// the next one, so a client keeps one connection for any number of jobs:
+//   client -> "start [printer]"        open a job of unknown length
+//   server -> {"type":"job","id":N,"credit":C}
+//   client -> binary frames            job data, never beyond the credit
+//   server -> {"type":"credit","id":N,"credit":C}  as the printer drains
+//   client -> "end" | "abort"          finish or discard the job
+//   server -> {"type":"end","id":N,"received":R}
+//   server -> {"type":"error","message":"...","retryAfter":S}
+//
+// Credits are absolute byte offsets into the job, so the client may send
+// until it has sent C bytes in total. They are granted from the free space
+// in the job buffer; the socket callback never has to block. Without a
+// printer ID the job goes to the first printer of the registry.
+
+#ifndef WS_PRINT_PATH
+#define WS_PRINT_PATH "/ws/print"
+#endif
+#ifndef WS_PRINT_CREDIT_STEP
+#define WS_PRINT_CREDIT_STEP 4096   // Smallest credit increase worth a message
+#endif
+
+// Resolves the printer ID of a "start" command to its index. Returns false
+// with a message for the client when the job can't go to that printer.
+typedef bool (*WsPrintRoute)(const String& printerId, uint8_t& printer, const char*& error);
+
+// Register the WebSocket handler on the server
+void initWsPrint(AsyncWebServer& server, WsPrintRoute route);
+
+// Hand out new credits and drop dead clients. Call periodically from one task.
+void serviceWsPrint();
+
+// Sockets with a job open
+size_t wsPrintActiveJobs();
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "image_raster.h"
+
+// ZPL labels rendered on the bridge, so a warehouse system that drives
+// Zebra printers sends a kilobyte of ZPL instead of a raster.
+//
+// The body is interpreted as it arrives. Each label from ^XA to ^XZ is
+// collected as a list of fields, then drawn band by band into a 1-bit
+// sprite of ZPL_BAND_ROWS rows and sent through the RasterCommandWriter as
+// ESC/POS or TSPL raster; no label is held in memory as a whole. With
+// ZPL_PARALLEL_BANDS a helper task on the other core draws every other band
+// into a second sprite while this one's band is drawn and queued, and the
+// bands go out in order, which roughly halves the time of labels heavy with
+// text and QR codes.
+//
+// Understood: ^XA ^XZ, ^FO and ^FT (field origin, text baseline), ^LH,
+// ^PW and ^LL (label size), ^A0 and ^CF0 (font height; other fonts are
+// drawn with font 0), ^FD ^FS, ^FH (hex escapes), ^BY (module width and
+// bar height), ^BC (Code 128, interpretation line below), ^BQ (QR code,
+// its magnification as module), ^GB (filled or outlined box, black or
+// white) and ^PQ (copies). Fields are not rotated, and ^A widths are
+// ignored: text is drawn with the built-in font and size whose height is
+// nearest. ^FX comments, ~ commands and anything else are skipped.
+//
+// Without ^PW a label is as wide as the printer's head (dots= in
+// printers.conf, ZPL_DEFAULT_WIDTH otherwise); without ^LL it ends below
+// its lowest field.
+
+#ifndef ZPL_DEFAULT_WIDTH
+#define ZPL_DEFAULT_WIDTH 384      // Dots, a 58 mm head at 203 dpi
+#endif
+#ifndef ZPL_BAND_ROWS
+#define ZPL_BAND_ROWS 64           // Rows of the sprite labels are drawn in
+#endif
+#ifndef ZPL_MAX_FIELDS
+#define ZPL_MAX_FIELDS 32          // Fields of one label
+#endif
+#ifndef ZPL_MAX_PARAMETERS
+#define ZPL_MAX_PARAMETERS 256     // Longest command with its parameters or ^FD data
+#endif
+#ifndef ZPL_MAX_COPIES
+#define ZPL_MAX_COPIES 100         // ^PQ of one label
+#endif
+#ifndef ZPL_MAX_DOTS
+#define ZPL_MAX_DOTS 2048          // Longest side
+#endif
+#ifndef ZPL_PARALLEL_BANDS
+#define ZPL_PARALLEL_BANDS 1       // Every other band drawn on the other core
+#endif
+#ifndef ZPL_BAND_CORE
+#define ZPL_BAND_CORE 0            // Core of the band helper, away from the web server
+#endif
+#ifndef ZPL_BAND_PRIORITY
+#define ZPL_BAND_PRIORITY 2
+#endif
+
+enum ZplResult {
+  ZPL_OK,
+  ZPL_INVALID,           // A command or field that can't be printed
+  ZPL_TOO_MANY,          // More than ZPL_MAX_FIELDS fields in a label
+  ZPL_TRUNCATED,         // The body ended inside a label
+  ZPL_NO_MEMORY,
+  ZPL_OUTPUT             // The output refused the commands
+};
+
+const char* zplResultName(ZplResult result);
+
+// The band sprites are created against the display driver
+void initZplLabels(TFT_eSPI* display);
+
+// One ZPL upload, rendered label by label as its ^XZ arrives
+class ZplInterpreter {
+public:
+  ZplInterpreter() = default;
+
+  ZplInterpreter(const ZplInterpreter&) = delete;
+  ZplInterpreter& operator=(const ZplInterpreter&) = delete;
+
+  // Raster options of the output, head width for labels without ^PW
+  void begin(const ImageRasterOptions& options, uint16_t headDots, ImageOutput output, void* context);
+
+  // Body data, in order. Stops at the first error, which sticks.
+  ZplResult feed(const uint8_t* data, size_t length);
+
+  // The body is over; ZPL_TRUNCATED when it ended between ^XA and ^XZ
+  ZplResult end();
+
+  ZplResult error() const { return _error; }
+  // Command or field at fault
+  const String& detail() const { return _detail; }
+  uint16_t labels() const { return _labels; }
+
+private:
+  friend void initZplLabels(TFT_eSPI* display);
+
+  enum FieldType : uint8_t { FIELD_TEXT, FIELD_CODE128, FIELD_QR, FIELD_BOX };
+
+  struct Field {
+    FieldType type;
+    int16_t x;
+    int16_t y;
+    bool baseline;           // ^FT: y is the text baseline or barcode bottom
+    uint16_t width;          // Box width, text font height
+    uint16_t height;         // Box height, barcode bar height
+    uint16_t thickness;      // Box border
+    uint8_t module;
+    bool white;              // Box drawn in white
+    bool line;               // Code 128 interpretation line
+    String data;
+    int32_t top;             // Rows it covers once measured
+    int32_t bottom;
+  };
+
+  enum State : uint8_t { SCAN, COMMAND, PARAMETERS };
+
+  void command();
+  void resetLabel();
+  void finishField();
+  ZplResult printLabel();
+  void drawBand(TFT_eSprite& band, uint16_t top, uint16_t rows) const;
+  static void bandTask(void* param);
+  String decodeHex(const String& data) const;
+  void fail(ZplResult result, const String& detail);
+
+  ImageRasterOptions _options;
+  uint16_t _headDots = ZPL_DEFAULT_WIDTH;
+  ImageOutput _output = nullptr;
+  void* _context = nullptr;
+  ZplResult _error = ZPL_OK;
+  String _detail;
+  uint16_t _labels = 0;
+
+  State _state = SCAN;
+  char _prefix = '^';
+  char _name[3] = {};
+  uint8_t _nameLen = 0;
+  String _parameters;
+  bool _inLabel = false;
+
+  // Label state between ^XA and ^XZ
+  Field _fields[ZPL_MAX_FIELDS];
+  size_t _fieldCount = 0;
+  uint16_t _width = 0;             // ^PW, 0 for the head width
+  uint16_t _length = 0;            // ^LL, 0 to end below the last field
+  int16_t _homeX = 0;
+  int16_t _homeY = 0;
+  uint16_t _copies = 1;
+  uint16_t _fontHeight = 9;        // ^CF
+  uint16_t _nextFont = 0;          // ^A before the ^FO it applies to
+  uint8_t _barModule = 2;          // ^BY
+  uint16_t _barHeight = 10;
+
+  // Field being built up to its ^FS
+  Field _field;
+  bool _fieldOpen = false;
+  bool _fieldHasData = false;
+  char _hexIndicator = 0;          // ^FH, 0 without
+};
@@ -0,0 +1,125 @@
+/***************************************************************************************
+** Code for the arc meter UI element
+***************************************************************************************/
+TFT_eArcMeter::TFT_eArcMeter(void) {
+  _gfx   = nullptr;
+  _min   = 0;
+  _max   = 100;
+  _value = 0;
+  _last  = 0;
+  _drawn = false;
+}
+
+void TFT_eArcMeter::initMeter(TFT_eSPI *gfx, int32_t x, int32_t y, int32_t r, int32_t ir,
+                              uint16_t startAngle, uint16_t endAngle,
+                              uint32_t fg_color, uint32_t track_color, uint32_t bg_color, bool roundEnds)
+{
+  if (r < ir) transpose(r, ir);
+  _gfx    = gfx;
+  _x      = x;
+  _y      = y;
+  _r      = r;
+  _ir     = ir;
+  _start  = startAngle % 360;
+  _sweep  = (endAngle % 360 + 360 - _start) % 360;
+  if (_sweep == 0) _sweep = 360;
+  _fg     = fg_color;
+  _track  = track_color;
+  _bg     = bg_color;
+  _round  = roundEnds && _sweep < 360; // A full ring has no ends
+  // Half the ring width as an angle at the middle of the ring
+  _endDeg = ceilf((r - ir) / (float)(r + ir + 1) / deg2rad) + 1;
+  _drawn  = false;
+}
+
+void TFT_eArcMeter::setRange(int32_t minValue, int32_t maxValue)
+{
+  _min   = minValue;
+  _max   = maxValue;
+  _drawn = false;
+}
+
+uint16_t TFT_eArcMeter::offset(int32_t value)
+{
+  if (_max == _min) return 0;
+  int64_t span = (int64_t)_max - _min;
+  int64_t v = (int64_t)value - _min;
+  if (span < 0) { span = -span; v = -v; }
+  if (v <= 0) return 0;
+  if (v >= span) return _sweep;
+  return (v * _sweep + span / 2) / span;
+}
+
+// drawArc() leaves the ends of a segment square and not anti-aliased, so segments
+// drawn next to each other join cleanly
+void TFT_eArcMeter::segment(uint16_t from, uint16_t to, uint32_t color)
+{
+  if (from >= to) return;
+  // The same start and end angle would draw nothing
+  if (to - from > 180) {
+    segment(from, from + 180, color);
+    from += 180;
+  }
+  _gfx->drawArc(_x, _y, _r, _ir, (_start + from) % 360, (_start + to) % 360, color, _bg);
+}
+
+void TFT_eArcMeter::drawEnd(uint16_t at, uint32_t color)
+{
+  float sx = -sinf((_start + at) * deg2rad);
+  float sy = +cosf((_start + at) * deg2rad);
+
+  if (_round) {
+    _gfx->drawSpot(sx * (_r + _ir) / 2.0 + _x, sy * (_r + _ir) / 2.0 + _y, (_r - _ir) / 2.0, color, _bg);
+  }
+  else {
+    _gfx->drawWedgeLine(sx * _ir + _x, sy * _ir + _y, sx * _r + _x, sy * _r + _y, 0.3, 0.3, color, _bg);
+  }
+}
+
+void TFT_eArcMeter::drawMeter(int32_t value)
+{
+  if (!_gfx) return;
+
+  _value = value;
+  uint16_t v = offset(value);
+
+  segment(0, v, _fg);
+  segment(v, _sweep, _track);
+
+  if (_sweep < 360) {
+    drawEnd(0, v > 0 ? _fg : _track);
+    drawEnd(_sweep, v >= _sweep ? _fg : _track);
+  }
+  if (_round && v > 0 && v < _sweep) drawEnd(v, _fg);
+
+  _last  = v;
+  _drawn = true;
+}
+
+void TFT_eArcMeter::setValue(int32_t value)
+{
+  if (!_gfx) return;
+  if (!_drawn) { drawMeter(value); return; }
+
+  _value = value;
+  uint16_t v = offset(value);
+  uint16_t old = _last;
+  if (v == old) return;
+
+  // A round end reaches past its value, the track drawn back covers it
+  uint16_t reach = 0;
+  if (v > old) segment(old, v, _fg);
+  else {
+    reach = _round ? _endDeg : 0;
+    segment(v, old + reach < _sweep ? old + reach : _sweep, _track);
+  }
+
+  // The scale ends the segment reached, for their colour or their anti-aliasing
+  if (_sweep < 360) {
+    if (min(v, old) == 0) drawEnd(0, v > 0 ? _fg : _track);
+    if (max(v, old) + reach >= _sweep) drawEnd(_sweep, v >= _sweep ? _fg : _track);
+  }
+  if (_round && v > 0 && v < _sweep) drawEnd(v, _fg);
+
+  _last = v;
+}
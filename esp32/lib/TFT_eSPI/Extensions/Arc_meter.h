@@ -0,0 +1,51 @@
+/***************************************************************************************
+// The following class draws an anti-aliased arc meter, a ring the value fills clockwise
+// from the start of its scale. After the first draw an update only redraws the part of
+// the ring between the value drawn last and the new one, and the ends next to it, so a
+// meter can be updated often for a small part of the cost of drawArc() over the ring.
+***************************************************************************************/
+
+class TFT_eArcMeter
+{
+ public:
+  TFT_eArcMeter(void);
+
+           // Centre at x, y with outer radius r and inner radius ir, the scale running clockwise
+           // from startAngle to endAngle (0 at 6 o'clock, as for drawArc(), the same angle for a
+           // full ring). The value's arc is drawn in fg_color and the rest of the scale in
+           // track_color, both anti-aliased with bg_color. Round ends are drawn as for drawSmoothArc(),
+           // a full ring has none. gfx can be the TFT or a Sprite
+  void     initMeter(TFT_eSPI *gfx, int32_t x, int32_t y, int32_t r, int32_t ir,
+                     uint16_t startAngle, uint16_t endAngle,
+                     uint32_t fg_color, uint32_t track_color, uint32_t bg_color, bool roundEnds = false);
+
+           // Values at the start and at the end of the scale, 0 and 100 by default
+  void     setRange(int32_t minValue, int32_t maxValue);
+
+           // Draw the whole meter showing value
+  void     drawMeter(int32_t value);
+
+           // Show value, drawing only what changed since the last draw. Values are resolved to
+           // whole degrees, a change of less than that draws nothing. The first call draws the
+           // whole meter
+  void     setValue(int32_t value);
+
+           // Have the next setValue() draw the whole meter, e.g. after the screen was cleared
+  void     invalidate(void) { _drawn = false; }
+
+  int32_t  getValue(void) { return _value; }
+
+ private:
+  uint16_t offset(int32_t value);                             // Degrees from the scale start
+  void     segment(uint16_t from, uint16_t to, uint32_t color); // Ring between two offsets
+  void     drawEnd(uint16_t at, uint32_t color);               // Square or round end at an offset
+
+  TFT_eSPI *_gfx;
+  int32_t  _x, _y, _r, _ir;
+  uint16_t _start, _sweep;   // Scale start angle and the degrees it spans
+  uint16_t _endDeg;          // Degrees a round end reaches past its angle, AA edge included
+  uint16_t _last;            // Offset of the value drawn last
+  uint32_t _fg, _track, _bg;
+  int32_t  _min, _max, _value;
+  bool     _round, _drawn;
+};
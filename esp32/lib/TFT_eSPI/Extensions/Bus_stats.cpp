@@ -0,0 +1,27 @@
+// Bus use counters, see Bus_stats.h
+
+/***************************************************************************************
+** Function name:           getStats
+** Description:             Bus use counters since the start or the last resetStats()
+***************************************************************************************/
+tft_stats_t TFT_eSPI::getStats(void)
+{
+#if defined (SPI_18BIT_DRIVER)
+  const uint32_t pixelBytes = 3;
+#else
+  const uint32_t pixelBytes = 2;
+#endif
+  tft_stats_t stats = _stats;
+  stats.bytes = (stats.pixels + stats.dmaPixels) * pixelBytes + stats.windows * 11;
+  return stats;
+}
+
+/***************************************************************************************
+** Function name:           resetStats
+** Description:             Set the bus use counters back to 0
+***************************************************************************************/
+void TFT_eSPI::resetStats(void)
+{
+  memset(&_stats, 0, sizeof(_stats));
+  _statsStart = micros();
+}
@@ -0,0 +1,15 @@
+ // This is part of the TFT_eSPI class and is associated with the TFT_STATS bus counters
+
+ public:
+
+  // Counters since the start or the last resetStats(). bytes is worked out from
+  // the pixel and window counts (11 bytes a window for the common drivers), so
+  // it is an upper bound where drawPixel() skips unchanged coordinates. heldUs
+  // over a second of wall time is the share of the bus the display takes.
+  tft_stats_t getStats(void);
+  void     resetStats(void);
+
+ private:
+
+  tft_stats_t _stats;
+  uint32_t _statsStart;        // micros() when the TFT was last selected
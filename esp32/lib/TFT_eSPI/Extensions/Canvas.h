@@ -0,0 +1,169 @@
+/***************************************************************************************
+// Canvas: drawing into a Sprite with its colour depth and rotation fixed at compile
+// time. TFT_eSprite::drawPixel() is a virtual call that checks the depth, rotation
+// and viewport of the Sprite for every pixel; a TFT_eCanvas<BPP, ROT> reads those
+// once when it is made, so its functions inline into the caller's loop with a
+// single path left for the depth and rotation.
+//
+// The panel driver needs no such parameter: it is chosen at compile time already,
+// window commands come from the driver's _Defines.h file as macros.
+//
+// A canvas is a view of the Sprite as it is when it is made, so make one for each
+// batch of drawing and don't keep it over deleting, re-creating or rotating the
+// Sprite or changing its viewport. It draws nothing when the Sprite is not created
+// with that depth or, for 1 bit, rotation (check valid()). On a shadow Sprite (see
+// createShadow()) the area drawn is marked changed when the canvas goes.
+***************************************************************************************/
+
+template <uint8_t BPP, uint8_t ROT = 0>
+class TFT_eCanvas {
+
+  static_assert(BPP == 1 || BPP == 4 || BPP == 8 || BPP == 16, "Sprite colour depth is 1, 4, 8 or 16 bits");
+  static_assert(ROT < 4 && (BPP == 1 || ROT == 0), "Only 1 bit Sprites have a coordinate rotation");
+
+ public:
+
+  explicit TFT_eCanvas(TFT_eSprite &spr) : _spr(&spr)
+  {
+    if (!spr._created || spr._vpOoB || spr._bpp != BPP || (BPP == 1 && spr.rotation != ROT)) return;
+
+    _buf    = (BPP == 16) ? (uint8_t*)spr._img : (BPP == 4) ? spr._img4 : spr._img8;
+    _pitch  = (BPP == 1) ? spr._bitwidth : spr._iwidth;
+    _width  = spr._dwidth;
+    _height = spr._dheight;
+    _xDatum = spr._xDatum;
+    _yDatum = spr._yDatum;
+    _vpX = spr._vpX; _vpY = spr._vpY;
+    _vpW = spr._vpW; _vpH = spr._vpH;
+    _track  = (BPP == 16) && spr._dirty != nullptr;
+  }
+
+  ~TFT_eCanvas()
+  {
+    if (_track && _bx1 > _bx0) _spr->markDirty(_bx0, _by0, _bx1 - _bx0, _by1 - _by0);
+  }
+
+  bool     valid(void) const { return _buf != nullptr; }
+
+           // Colour as the Sprite stores it: 565 in panel byte order, 332, palette index or bit
+  static inline uint16_t pack(uint32_t color)
+  {
+    return (BPP == 16) ? (uint16_t)(color >> 8 | color << 8)
+         : (BPP == 8)  ? (uint16_t)((color & 0xE000)>>8 | (color & 0x0700)>>6 | (color & 0x0018)>>3)
+         : (BPP == 4)  ? (uint16_t)(color & 0x0F)
+         :               (uint16_t)(color != 0);
+  }
+
+           // A pack()ed value at x,y in Sprite coordinates, without the viewport datum or
+           // clipping; the caller keeps x,y inside the Sprite
+  inline void writePixel(int32_t x, int32_t y, uint16_t value)
+  {
+    if (BPP == 1) {
+      // Sprite rotation to memory, as TFT_eSprite::drawPixel() does it
+      int32_t t = x;
+      if (ROT == 1)      { x = _width - y - 1; y = t; }
+      else if (ROT == 2) { x = _width - x - 1; y = _height - y - 1; }
+      else if (ROT == 3) { x = y; y = _height - t - 1; }
+      uint8_t *p = _buf + ((x + y * _pitch) >> 3);
+      uint8_t mask = 0x80 >> (x & 7);
+      if (value) *p |= mask;
+      else       *p &= ~mask;
+    }
+    else if (BPP == 4) {
+      uint8_t *p = _buf + ((x + y * _pitch) >> 1);
+      if (x & 1) *p = (*p & 0xF0) | value;
+      else       *p = (*p & 0x0F) | value << 4;
+    }
+    else if (BPP == 8) _buf[x + y * _pitch] = (uint8_t)value;
+    else {
+      ((uint16_t*)_buf)[x + y * _pitch] = value;
+      if (_track) grow(x, y, 1, 1);
+    }
+  }
+
+           // Drawing in viewport coordinates, clipped to it like the Sprite functions;
+           // colours are 565 (or the palette index or bit of 4 and 1 bit Sprites)
+  inline void drawPixel(int32_t x, int32_t y, uint32_t color)
+  {
+    x += _xDatum;
+    y += _yDatum;
+    if (!_buf || (x < _vpX) || (y < _vpY) || (x >= _vpW) || (y >= _vpH)) return;
+    writePixel(x, y, pack(color));
+  }
+
+  inline void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color)
+  {
+    fillRect(x, y, w, 1, color);
+  }
+
+  inline void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color)
+  {
+    fillRect(x, y, 1, h, color);
+  }
+
+  void     fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color)
+  {
+    x += _xDatum;
+    y += _yDatum;
+    if (!_buf) return;
+    if (x < _vpX) { w += x - _vpX; x = _vpX; }
+    if (y < _vpY) { h += y - _vpY; y = _vpY; }
+    if ((x + w) > _vpW) w = _vpW - x;
+    if ((y + h) > _vpH) h = _vpH - y;
+    if ((w < 1) || (h < 1)) return;
+
+    uint16_t value = pack(color);
+    if (BPP == 16) {
+      if (_track) grow(x, y, w, h);
+      uint16_t *row = (uint16_t*)_buf + x + y * _pitch;
+      for (int32_t j = 0; j < h; j++, row += _pitch)
+        for (int32_t i = 0; i < w; i++) row[i] = value;
+    }
+    else if (BPP == 8) {
+      uint8_t *row = _buf + x + y * _pitch;
+      for (int32_t j = 0; j < h; j++, row += _pitch) memset(row, (uint8_t)value, w);
+    }
+    else {
+      for (int32_t j = y; j < y + h; j++)
+        for (int32_t i = x; i < x + w; i++) writePixel(i, j, value);
+    }
+  }
+
+           // The stored value at x,y in Sprite coordinates, like TFT_eSprite::readPixelValue()
+  inline uint16_t readValue(int32_t x, int32_t y) const
+  {
+    if (BPP == 1) {
+      int32_t t = x;
+      if (ROT == 1)      { x = _width - y - 1; y = t; }
+      else if (ROT == 2) { x = _width - x - 1; y = _height - y - 1; }
+      else if (ROT == 3) { x = y; y = _height - t - 1; }
+      return (_buf[(x + y * _pitch) >> 3] >> (7 - (x & 7))) & 1;
+    }
+    if (BPP == 4) {
+      uint8_t p = _buf[(x + y * _pitch) >> 1];
+      return (x & 1) ? p & 0x0F : p >> 4;
+    }
+    if (BPP == 8) return _buf[x + y * _pitch];
+    return ((uint16_t*)_buf)[x + y * _pitch];
+  }
+
+ private:
+
+  inline void grow(int32_t x, int32_t y, int32_t w, int32_t h)
+  {
+    if (_bx1 <= _bx0) { _bx0 = x; _by0 = y; _bx1 = x + w; _by1 = y + h; return; }
+    if (x < _bx0) _bx0 = x;
+    if (y < _by0) _by0 = y;
+    if (x + w > _bx1) _bx1 = x + w;
+    if (y + h > _by1) _by1 = y + h;
+  }
+
+  TFT_eSprite *_spr;
+  uint8_t  *_buf = nullptr;          // Frame drawn to, nullptr when not valid()
+  int32_t  _pitch = 0;               // Pixels from one row of memory to the next
+  int32_t  _width = 0, _height = 0;  // Unrotated Sprite size
+  int32_t  _xDatum = 0, _yDatum = 0;
+  int32_t  _vpX = 0, _vpY = 0, _vpW = 0, _vpH = 0;
+  bool     _track = false;           // Shadow Sprite, the area drawn is marked
+  int32_t  _bx0 = 0, _by0 = 0, _bx1 = 0, _by1 = 0;
+};
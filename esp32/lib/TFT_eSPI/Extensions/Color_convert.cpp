@@ -0,0 +1,104 @@
+ // This is part of the TFT_eSPI library and holds the bulk colour conversions
+
+static inline uint16_t to565(uint8_t r, uint8_t g, uint8_t b)
+{
+  return (r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3;
+}
+
+static inline uint16_t swap565(uint16_t c)
+{
+  return c << 8 | c >> 8;
+}
+
+// Four 565 colours, as two words when dst is word aligned
+static inline void store565(uint16_t *dst, bool aligned, bool swap, uint16_t c0, uint16_t c1, uint16_t c2, uint16_t c3)
+{
+  if (swap) { c0 = swap565(c0); c1 = swap565(c1); c2 = swap565(c2); c3 = swap565(c3); }
+  if (aligned) {
+    ((uint32_t *)dst)[0] = c0 | (uint32_t)c1 << 16;
+    ((uint32_t *)dst)[1] = c2 | (uint32_t)c3 << 16;
+  }
+  else {
+    dst[0] = c0; dst[1] = c1; dst[2] = c2; dst[3] = c3;
+  }
+}
+
+/***************************************************************************************
+** Function name:           convert888to565
+** Description:             RGB888 bytes to 565 colours
+***************************************************************************************/
+void convert888to565(const uint8_t *src, uint16_t *dst, uint32_t n, bool swap)
+{
+  // Up to 3 pixels until src is word aligned, then 12 bytes in and 8 out at a time
+  while (n && ((uintptr_t)src & 3)) {
+    uint16_t c = to565(src[0], src[1], src[2]);
+    *dst++ = swap ? swap565(c) : c;
+    src += 3;
+    n--;
+  }
+
+  bool aligned = !((uintptr_t)dst & 3);
+  const uint32_t *in = (const uint32_t *)src;
+  for (; n >= 4; n -= 4, in += 3, dst += 4) {
+    // Little endian: r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+    uint32_t w0 = in[0], w1 = in[1], w2 = in[2];
+    store565(dst, aligned, swap, to565(w0,       w0 >> 8,  w0 >> 16),
+                                 to565(w0 >> 24, w1,       w1 >> 8),
+                                 to565(w1 >> 16, w1 >> 24, w2),
+                                 to565(w2 >> 8,  w2 >> 16, w2 >> 24));
+  }
+  src = (const uint8_t *)in;
+
+  for (; n; n--, src += 3) {
+    uint16_t c = to565(src[0], src[1], src[2]);
+    *dst++ = swap ? swap565(c) : c;
+  }
+}
+
+
+/***************************************************************************************
+** Function name:           convert565to888
+** Description:             565 colours to RGB888 bytes
+***************************************************************************************/
+void convert565to888(const uint16_t *src, uint8_t *dst, uint32_t n, bool swap)
+{
+  for (; n; n--, dst += 3) {
+    uint16_t c = *src++;
+    if (swap) c = swap565(c);
+    uint8_t r = (c >> 8) & 0xF8; r |= r >> 5;
+    uint8_t g = (c >> 3) & 0xFC; g |= g >> 6;
+    uint8_t b = (c << 3) & 0xF8; b |= b >> 5;
+    dst[0] = r;
+    dst[1] = g;
+    dst[2] = b;
+  }
+}
+
+
+/***************************************************************************************
+** Function name:           convertGray8to565
+** Description:             8-bit gray levels to 565 colours
+***************************************************************************************/
+void convertGray8to565(const uint8_t *src, uint16_t *dst, uint32_t n, bool swap)
+{
+  while (n && ((uintptr_t)src & 3)) {
+    uint16_t c = to565(*src, *src, *src);
+    *dst++ = swap ? swap565(c) : c;
+    src++;
+    n--;
+  }
+
+  bool aligned = !((uintptr_t)dst & 3);
+  const uint32_t *in = (const uint32_t *)src;
+  for (; n >= 4; n -= 4, in++, dst += 4) {
+    uint32_t w = *in;
+    uint8_t  g0 = w, g1 = w >> 8, g2 = w >> 16, g3 = w >> 24;
+    store565(dst, aligned, swap, to565(g0, g0, g0), to565(g1, g1, g1), to565(g2, g2, g2), to565(g3, g3, g3));
+  }
+  src = (const uint8_t *)in;
+
+  for (; n; n--, src++) {
+    uint16_t c = to565(*src, *src, *src);
+    *dst++ = swap ? swap565(c) : c;
+  }
+}
@@ -0,0 +1,18 @@
+/***************************************************************************************
+// Bulk colour conversion of pixel buffers, e.g. decoder output on its way to a block
+// of 565 colours. With swap the 565 values are in the byte order pushImage() sends
+// with setSwapBytes(false) and Sprites hold, high byte first.
+//
+// After at most 3 pixels to word align the RGB888 or grayscale source, four pixels
+// are converted at a time from 32-bit loads, and stored as two words when dst is
+// word aligned. Pixels left at the end go one at a time.
+***************************************************************************************/
+
+// n pixels of r, g, b bytes to 565
+void convert888to565(const uint8_t *src, uint16_t *dst, uint32_t n, bool swap = false);
+
+// n 565 colours to r, g, b bytes, the low bits filled as color16to24() does
+void convert565to888(const uint16_t *src, uint8_t *dst, uint32_t n, bool swap = false);
+
+// n gray levels to 565
+void convertGray8to565(const uint8_t *src, uint16_t *dst, uint32_t n, bool swap = false);
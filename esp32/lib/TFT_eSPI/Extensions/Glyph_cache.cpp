@@ -0,0 +1,201 @@
+ // This is part of the TFT_eSPI class and is associated with the built-in font glyph cache
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// New glyph cache functions are defined below
+////////////////////////////////////////////////////////////////////////////////////////
+
+/***************************************************************************************
+** Function name:           setGlyphCache
+** Description:             Bound the glyph cache in bytes, 0 turns it off
+***************************************************************************************/
+void TFT_eSPI::setGlyphCache(size_t bytes, bool psram)
+{
+  _glyphLimit = bytes;
+  _glyphPsram = psram;
+  while (_glyphBytes > _glyphLimit) dropGlyph();
+}
+
+
+/***************************************************************************************
+** Function name:           dropGlyph
+** Description:             Free the least recently used glyph
+***************************************************************************************/
+void TFT_eSPI::dropGlyph(void)
+{
+  if (!_glyphs) { _glyphBytes = 0; return; }
+
+  GlyphEntry **link = &_glyphs;
+  while ((*link)->next) link = &(*link)->next;
+
+  GlyphEntry *oldest = *link;
+  *link = nullptr;
+  _glyphBytes -= sizeof(GlyphEntry) + oldest->w * oldest->h * sizeof(uint16_t);
+  free(oldest);
+}
+
+
+/***************************************************************************************
+** Function name:           drawCachedGlyph
+** Description:             Draw a glyph as one block, expanding it on a miss
+***************************************************************************************/
+bool TFT_eSPI::drawCachedGlyph(uint8_t id, uint16_t code, int32_t xd, int32_t yd, uint16_t fg, uint16_t bg, uint8_t size)
+{
+  if (!_glyphLimit || !size) return false;
+
+  // Stored and matched in panel byte order, as the blocks hold them
+  fg = fg << 8 | fg >> 8;
+  bg = bg << 8 | bg >> 8;
+  uint32_t key = (uint32_t)id << 24 | (uint32_t)code << 8 | size;
+
+  GlyphEntry **link = &_glyphs;
+  GlyphEntry *entry;
+  while ((entry = *link) && !(entry->key == key && entry->fg == fg && entry->bg == bg)) link = &entry->next;
+
+  if (entry) *link = entry->next; // Moved to the front below
+  else {
+    int32_t w = 0, h = 0;
+    if (!expandGlyph(id, code, size, fg, bg, w, h, nullptr)) return false;
+
+    size_t bytes = sizeof(GlyphEntry) + w * h * sizeof(uint16_t);
+    if (bytes > _glyphLimit) return false;
+    while (_glyphBytes + bytes > _glyphLimit) dropGlyph();
+
+    entry = nullptr;
+#if defined (ESP32) && defined (CONFIG_SPIRAM_SUPPORT)
+    if (_glyphPsram && psramFound()) entry = (GlyphEntry *)ps_malloc(bytes);
+#endif
+    if (!entry) entry = (GlyphEntry *)malloc(bytes);
+    if (!entry) return false;
+    entry->key = key;
+    entry->fg  = fg;
+    entry->bg  = bg;
+    entry->w   = w;
+    entry->h   = h;
+    expandGlyph(id, code, size, fg, bg, w, h, entry->pixels);
+    _glyphBytes += bytes;
+  }
+
+  entry->next = _glyphs;
+  _glyphs = entry;
+
+  return pushGlyph(xd, yd, entry->w, entry->h, entry->pixels);
+}
+
+
+/***************************************************************************************
+** Function name:           expandGlyph
+** Description:             Decode a built-in font glyph into a 565 block
+***************************************************************************************/
+// code is the GLCD character after the cp437 adjustment, or the character less 32
+// for Font 2 and the RLE fonts. id 0 is the loaded smooth font, code the glyph index;
+// size only tells fonts apart there. fg and bg are in panel byte order.
+bool TFT_eSPI::expandGlyph(uint8_t id, uint16_t code, uint8_t size, uint16_t fg, uint16_t bg, int32_t &w, int32_t &h, uint16_t *out)
+{
+  int32_t width = 0, height = 0;
+  const uint8_t *data = nullptr;
+
+#ifdef SMOOTH_FONT
+  if (id == 0) {
+    if (!fontLoaded || code >= gFont.gCount || size != gCacheGen) return false;
+    w = gWidth[code];
+    h = gHeight[code];
+    if (w < 1 || h < 1) return false;
+    if (!out) return true;
+
+    // Blended in native order, stored in panel order
+    uint16_t fgn = fg << 8 | fg >> 8;
+    uint16_t bgn = bg << 8 | bg >> 8;
+    uint16_t rowBytes = glyphRowBytes(code);
+    const uint8_t *row = (const uint8_t *)gFont.gArray + gBitmap[code];
+#ifdef FONT_FS_AVAILABLE
+    uint8_t  rowBuffer[rowBytes];
+    if (fs_font) fontFile.seek(gBitmap[code], fs::SeekSet);
+#endif
+    for (int32_t py = 0; py < h; py++, row += rowBytes) {
+      const uint8_t *src = row;
+#ifdef FONT_FS_AVAILABLE
+      if (fs_font) { fontFile.read(rowBuffer, rowBytes); src = rowBuffer; }
+#endif
+      for (int32_t px = 0; px < w; px++) {
+        uint8_t a = glyphPixel(src, px);
+        uint16_t color = a == 0xFF ? fgn : a ? alphaBlend(a, fgn, bgn) : bgn;
+        *out++ = color << 8 | color >> 8;
+      }
+    }
+    return true;
+  }
+#endif
+
+#ifdef LOAD_GLCD
+  if (id == 1) { width = 6; height = 8; data = font + code * 5; }
+#endif
+#ifdef LOAD_FONT2
+  if (id == 2) {
+    data   = (const uint8_t *)pgm_read_dword(&chrtbl_f16[code]);
+    width  = pgm_read_byte(widtbl_f16 + code);
+    height = chr_hgt_f16;
+  }
+#endif
+#ifdef LOAD_RLE
+  if ((id > 2) && (id < 9)) {
+    data   = (const uint8_t *)pgm_read_dword( (const void*)(pgm_read_dword( &(fontdata[id].chartbl ) ) + code*sizeof(void *)) );
+    width  = pgm_read_byte( (uint8_t *)pgm_read_dword( &(fontdata[id].widthtbl ) ) + code );
+    height = pgm_read_byte( &fontdata[id].height );
+  }
+#endif
+
+  if (!data || width < 1 || height < 1) return false;
+
+  w = width  * size;
+  h = height * size;
+  if (!out) return true;
+
+  int32_t bw  = (width + 6) / 8; // Font 2 bytes per row, as drawChar() reads them
+  int32_t run = 0;               // RLE pixels left in the current run
+  bool    ink = false;
+
+  for (int32_t py = 0; py < height; py++) {
+    for (int32_t px = 0; px < width; px++) {
+      bool on;
+      if (id == 1) on = (px < 5) && ((pgm_read_byte(data + px) >> py) & 1);
+      else if (id == 2) on = ((px >> 3) < bw) && (pgm_read_byte(data + bw * py + (px >> 3)) & (0x80 >> (px & 7)));
+      else {
+        if (!run) {
+          uint8_t line = pgm_read_byte(data++);
+          ink = line & 0x80;
+          run = (line & 0x7F) + 1;
+        }
+        run--;
+        on = ink;
+      }
+
+      uint16_t color = on ? fg : bg;
+      uint16_t *p = out + py * size * w + px * size;
+      for (int32_t sy = 0; sy < size; sy++, p += w) {
+        for (int32_t sx = 0; sx < size; sx++) p[sx] = color;
+      }
+    }
+  }
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           pushGlyph
+** Description:             Write a block in panel byte order through one window
+***************************************************************************************/
+bool TFT_eSPI::pushGlyph(int32_t xd, int32_t yd, int32_t w, int32_t h, const uint16_t *data)
+{
+  begin_tft_write();
+
+  setWindow(xd, yd, xd + w - 1, yd + h - 1);
+
+  bool swap = _swapBytes;
+  _swapBytes = false;
+  pushPixels(data, w * h);
+  _swapBytes = swap;
+
+  end_tft_write();
+  return true;
+}
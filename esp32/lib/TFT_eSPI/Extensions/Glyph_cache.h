@@ -0,0 +1,44 @@
+ // This is part of the TFT_eSPI class and is associated with the built-in font glyph cache
+
+ public:
+
+  // Opaque glyphs of the GLCD, Font 2 and RLE fonts (text colour differs from the
+  // background) that lie whole inside the viewport are expanded once per colour
+  // pair and text size into a 565 block in RAM, then drawn as one window. bytes
+  // bounds the cache and the least recently used glyphs are dropped first; 0, the
+  // default, turns it off and frees it. The panel and each 16-bit sprite keep their
+  // own cache.
+  //
+  // Smooth font glyphs drawn with a background (setTextColor(fg, bg, true)) share
+  // it, blended once per colour pair, and are keyed to the font loaded so another
+  // font never matches them. With psram the blocks go to PSRAM when there is some,
+  // which suits the larger smooth glyphs.
+  void     setGlyphCache(size_t bytes, bool psram = false);
+  size_t   glyphCacheUsed(void) { return _glyphBytes; }
+
+ protected:
+
+  // Draw a glyph at absolute coordinates from the cache, expanding it first when
+  // missing. False when the cache is off or the glyph can't be drawn from it.
+  bool     drawCachedGlyph(uint8_t id, uint16_t code, int32_t xd, int32_t yd, uint16_t fg, uint16_t bg, uint8_t size);
+
+  // Write a w x h block in panel byte order at absolute coordinates
+  virtual bool pushGlyph(int32_t xd, int32_t yd, int32_t w, int32_t h, const uint16_t *data);
+
+ private:
+
+  struct GlyphEntry {
+    GlyphEntry *next;          // Most recently used first
+    uint32_t    key;           // Font, code and size, or 0, glyph index and font load
+    uint16_t    fg, bg;        // Panel byte order
+    uint16_t    w, h;
+    uint16_t    pixels[];
+  };
+
+  // Size of a glyph, and its pixels when out is given
+  bool     expandGlyph(uint8_t id, uint16_t code, uint8_t size, uint16_t fg, uint16_t bg, int32_t &w, int32_t &h, uint16_t *out);
+  void     dropGlyph(void);
+
+  GlyphEntry *_glyphs;
+  size_t   _glyphBytes, _glyphLimit;
+  bool     _glyphPsram;
@@ -0,0 +1,667 @@
+ // This is part of the TFT_eSPI class and is associated with the image decoders
+
+#if defined (ESP32)
+  #include "esp_heap_caps.h"         // DMA capable buffers, decoder state in PSRAM
+#endif
+
+#ifdef TFT_ROM_DECODERS
+  #if defined (CONFIG_IDF_TARGET_ESP32S3)
+    #include "esp32s3/rom/tjpgd.h"
+    #include "esp32s3/rom/miniz.h"
+  #else
+    #include "esp32/rom/tjpgd.h"
+    #include "esp32/rom/miniz.h"
+  #endif
+#endif
+
+#define JPG_POOL_BYTES 3100          // Work area the ROM tjpgd needs
+
+////////////////////////////////////////////////////////////////////////////////////////
+// New image pipeline functions are defined below
+////////////////////////////////////////////////////////////////////////////////////////
+
+/***************************************************************************************
+** Function name:           drawImageDMA
+** Description:             Decode an image through two alternating DMA buffers
+***************************************************************************************/
+bool TFT_eSPI::drawImageDMA(int32_t x, int32_t y, Stream &src, TFT_eImageDecoder &decoder)
+{
+  uint16_t w = 0, h = 0;
+  uint32_t block = 0;
+
+  bool ok = decoder.begin(src, &w, &h, &block);
+  if (ok) {
+    TFT_eImagePipe pipe(this, x, y, _vpH, block);
+    ok = pipe.ready();
+    if (ok) {
+      // Decoders make 565 values, sent high byte first
+      bool swap = _swapBytes;
+      _swapBytes = true;
+
+      begin_tft_write();
+      inTransaction = true;
+
+      ok = decoder.decode(src, pipe);
+
+#ifdef ESP32_DMA
+      dmaWait();
+#endif
+      inTransaction = lockTransaction;
+      end_tft_write();
+
+      _swapBytes = swap;
+    }
+  }
+  decoder.end();
+  return ok;
+}
+
+#ifdef TFT_ROM_DECODERS
+/***************************************************************************************
+** Function name:           drawJpgDMA
+** Description:             Draw a JPEG with the ROM decoder
+***************************************************************************************/
+bool TFT_eSPI::drawJpgDMA(int32_t x, int32_t y, Stream &src)
+{
+  TFT_eJpgDecoder jpg;
+  return drawImageDMA(x, y, src, jpg);
+}
+
+bool TFT_eSPI::drawJpgDMA(int32_t x, int32_t y, const uint8_t *data, uint32_t len)
+{
+  TFT_eMemoryStream src(data, len);
+  return drawJpgDMA(x, y, src);
+}
+
+/***************************************************************************************
+** Function name:           drawPngDMA
+** Description:             Draw a PNG with the ROM inflater
+***************************************************************************************/
+bool TFT_eSPI::drawPngDMA(int32_t x, int32_t y, Stream &src)
+{
+  TFT_ePngDecoder png;
+  return drawImageDMA(x, y, src, png);
+}
+
+bool TFT_eSPI::drawPngDMA(int32_t x, int32_t y, const uint8_t *data, uint32_t len)
+{
+  TFT_eMemoryStream src(data, len);
+  return drawPngDMA(x, y, src);
+}
+#endif // TFT_ROM_DECODERS
+
+
+/***************************************************************************************
+** Function name:           TFT_eImagePipe
+** Description:             Allocate the block buffers
+***************************************************************************************/
+TFT_eImagePipe::TFT_eImagePipe(TFT_eSPI *tft, int32_t x, int32_t y, int32_t bottom, uint32_t pixels)
+  : _tft(tft), _x(x), _y(y), _bottom(bottom), _pixels(pixels), _next(0), _dma(false)
+{
+#ifdef ESP32_DMA
+  _dma = tft->DMA_Enabled;
+  if (_dma) {
+    // One block is decoded while the other is read by the DMA, from internal RAM
+    _buf[0] = (uint16_t*)heap_caps_malloc(pixels * 2, MALLOC_CAP_DMA);
+    _buf[1] = (uint16_t*)heap_caps_malloc(pixels * 2, MALLOC_CAP_DMA);
+    return;
+  }
+#endif
+  // The CPU pushes a block before the next is decoded, so one buffer serves
+  _buf[0] = _buf[1] = (uint16_t*)malloc(pixels * 2);
+}
+
+
+/***************************************************************************************
+** Function name:           ~TFT_eImagePipe
+** Description:             Free the buffers once the last block is out
+***************************************************************************************/
+TFT_eImagePipe::~TFT_eImagePipe(void)
+{
+#ifdef ESP32_DMA
+  if (_dma) {
+    _tft->dmaWait();
+    free(_buf[1]);
+  }
+#endif
+  free(_buf[0]);
+}
+
+
+/***************************************************************************************
+** Function name:           buffer
+** Description:             The buffer not in flight
+***************************************************************************************/
+uint16_t *TFT_eImagePipe::buffer(uint32_t pixels)
+{
+  return (pixels <= _pixels) ? _buf[_next] : nullptr;
+}
+
+
+/***************************************************************************************
+** Function name:           push
+** Description:             Send the block in the last buffer, swap buffers
+***************************************************************************************/
+bool TFT_eImagePipe::push(int32_t x, int32_t y, int32_t w, int32_t h)
+{
+  x += _x;
+  y += _y;
+  if (y >= _bottom) return false;
+
+#ifdef ESP32_DMA
+  if (_dma) {
+    // Waits for the block before this one to be out, which frees its buffer for the next
+    _tft->pushImageDMA(x, y, w, h, _buf[_next]);
+    _next ^= 1;
+    return true;
+  }
+#endif
+  _tft->pushImage(x, y, w, h, _buf[_next]);
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           readBytes
+** Description:             Copy out of the array
+***************************************************************************************/
+size_t TFT_eMemoryStream::readBytes(char *buffer, size_t length)
+{
+  if (length > _len - _pos) length = _len - _pos;
+  memcpy_P(buffer, _data + _pos, length);
+  _pos += length;
+  return length;
+}
+
+
+#ifdef TFT_ROM_DECODERS
+////////////////////////////////////////////////////////////////////////////////////////
+// JPEG
+////////////////////////////////////////////////////////////////////////////////////////
+
+struct JpgWork {
+  JDEC            jdec;
+  Stream         *src;
+  TFT_eImagePipe *pipe;
+  bool            stopped;          // Rest of the image below the viewport
+  uint8_t         pool[JPG_POOL_BYTES] __attribute__((aligned(4)));
+};
+
+// Fill buf with len bytes of the stream, or skip them when buf is nullptr
+static UINT jpgInput(JDEC *jd, BYTE *buf, UINT len)
+{
+  Stream *src = ((JpgWork*)jd->device)->src;
+  if (buf) return src->readBytes((char*)buf, len);
+
+  char skip[32];
+  UINT done = 0;
+  while (done < len) {
+    UINT n = len - done;
+    if (n > sizeof(skip)) n = sizeof(skip);
+    UINT got = src->readBytes(skip, n);
+    done += got;
+    if (got < n) break;
+  }
+  return done;
+}
+
+// An MCU decoded to RGB888
+static UINT jpgOutput(JDEC *jd, void *bitmap, JRECT *rect)
+{
+  JpgWork *work = (JpgWork*)jd->device;
+  int32_t w = rect->right - rect->left + 1;
+  int32_t h = rect->bottom - rect->top + 1;
+
+  uint16_t *out = work->pipe->buffer(w * h);
+  if (!out) return 0;
+
+  convert888to565((const uint8_t*)bitmap, out, w * h);
+
+  if (work->pipe->push(rect->left, rect->top, w, h)) return 1;
+  work->stopped = true;
+  return 0;
+}
+
+
+/***************************************************************************************
+** Function name:           setScale
+** Description:             Reduce the image by 1, 2, 4 or 8
+***************************************************************************************/
+void TFT_eJpgDecoder::setScale(uint8_t scale)
+{
+  _scale = (scale >= 8) ? 3 : (scale >= 4) ? 2 : (scale >= 2) ? 1 : 0;
+}
+
+
+/***************************************************************************************
+** Function name:           begin
+** Description:             Read the JPEG header
+***************************************************************************************/
+bool TFT_eJpgDecoder::begin(Stream &src, uint16_t *w, uint16_t *h, uint32_t *block)
+{
+  end();
+
+  JpgWork *work = (JpgWork*)malloc(sizeof(JpgWork));
+  if (!work) return false;
+  _work = work;
+
+  work->src = &src;
+  work->pipe = nullptr;
+  work->stopped = false;
+  if (jd_prepare(&work->jdec, jpgInput, work->pool, JPG_POOL_BYTES, work) != JDR_OK) return false;
+
+  uint16_t round = (1 << _scale) - 1;
+  *w = (work->jdec.width  + round) >> _scale;
+  *h = (work->jdec.height + round) >> _scale;
+  *block = ((work->jdec.msx * 8) >> _scale) * ((work->jdec.msy * 8) >> _scale);
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           decode
+** Description:             Decode the MCUs, pushing each
+***************************************************************************************/
+bool TFT_eJpgDecoder::decode(Stream &src, TFT_eImagePipe &pipe)
+{
+  JpgWork *work = (JpgWork*)_work;
+  if (!work) return false;
+
+  work->src = &src;
+  work->pipe = &pipe;
+  JRESULT result = jd_decomp(&work->jdec, jpgOutput, _scale);
+  return (result == JDR_OK) || (result == JDR_INTR && work->stopped);
+}
+
+
+/***************************************************************************************
+** Function name:           end
+** Description:             Free the work area
+***************************************************************************************/
+void TFT_eJpgDecoder::end(void)
+{
+  free(_work);
+  _work = nullptr;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// PNG
+////////////////////////////////////////////////////////////////////////////////////////
+
+#define PNG_IHDR 0x49484452
+#define PNG_PLTE 0x504C5445
+#define PNG_tRNS 0x74524E53
+#define PNG_IDAT 0x49444154
+#define PNG_IEND 0x49454E44
+
+static inline uint32_t pngWord(const uint8_t *p)
+{
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline uint16_t png565(uint8_t r, uint8_t g, uint8_t b)
+{
+  return (r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3;
+}
+
+static inline uint16_t pngBlend(uint8_t alpha, uint16_t fgc, uint16_t bgc)
+{
+  return (alpha == 255) ? fgc : (alpha == 0) ? bgc : fastBlend(alpha, fgc, bgc);
+}
+
+// Sample x of a row packed at 1, 2 or 4 bits
+static inline uint8_t pngBits(const uint8_t *row, uint32_t x, uint8_t depth)
+{
+  uint32_t bit = x * depth;
+  return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+}
+
+// Sample of 8 or 16 bits, as stored, for the tRNS colour
+static inline uint16_t pngValue(const uint8_t *p, uint8_t step)
+{
+  return (step == 2) ? p[0] << 8 | p[1] : p[0];
+}
+
+static void *pngAlloc(size_t size)
+{
+  void *p = nullptr;
+#if defined (ESP32)
+  p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+  if (!p) p = malloc(size);
+  return p;
+}
+
+
+/***************************************************************************************
+** Function name:           skip
+** Description:             Read past len bytes
+***************************************************************************************/
+bool TFT_ePngDecoder::skip(Stream &src, uint32_t len)
+{
+  char buf[32];
+  while (len > 0) {
+    uint32_t n = (len < sizeof(buf)) ? len : sizeof(buf);
+    if (src.readBytes(buf, n) != n) return false;
+    len -= n;
+  }
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           chunk
+** Description:             Read a chunk length and type
+***************************************************************************************/
+bool TFT_ePngDecoder::chunk(Stream &src, uint32_t *len, uint32_t *type)
+{
+  uint8_t head[8];
+  if (src.readBytes((char*)head, 8) != 8) return false;
+  *len = pngWord(head);
+  *type = pngWord(head + 4);
+  return *len < 0x80000000;
+}
+
+
+/***************************************************************************************
+** Function name:           begin
+** Description:             Read the chunks before the image data
+***************************************************************************************/
+bool TFT_ePngDecoder::begin(Stream &src, uint16_t *w, uint16_t *h, uint32_t *block)
+{
+  static const uint8_t signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+
+  end();
+
+  uint8_t head[13];
+  if (src.readBytes((char*)head, 8) != 8 || memcmp(head, signature, 8)) return false;
+
+  uint32_t len, type;
+  if (!chunk(src, &len, &type) || type != PNG_IHDR || len != 13) return false;
+  if (src.readBytes((char*)head, 13) != 13 || !skip(src, 4)) return false;
+
+  uint32_t width = pngWord(head), height = pngWord(head + 4);
+  _depth = head[8];
+  _colorType = head[9];
+  // Compression and filter method 0 are the only ones, interlaced images are not taken
+  if (width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF || head[10] || head[11] || head[12]) return false;
+
+  uint8_t channels;
+  switch (_colorType) {
+    case 0: channels = 1; break;
+    case 2: channels = 3; break;
+    case 3: channels = 1; break;
+    case 4: channels = 2; break;
+    case 6: channels = 4; break;
+    default: return false;
+  }
+  bool packed = (_colorType == 0 || _colorType == 3) && (_depth == 1 || _depth == 2 || _depth == 4);
+  if (!packed && _depth != 8 && !(_depth == 16 && _colorType != 3)) return false;
+
+  _width = width;
+  _height = height;
+  uint32_t bits = channels * _depth;
+  _rowBytes = (width * bits + 7) >> 3;
+  _pixelBytes = (bits < 8) ? 1 : bits >> 3;
+
+  // The palette and transparency come before the image data
+  for (;;) {
+    if (!chunk(src, &len, &type) || type == PNG_IEND) return false;
+    if (type == PNG_IDAT) break;
+
+    if (type == PNG_PLTE && _colorType == 3) {
+      if (len % 3 || len > 768) return false;
+      if (!_palette) _palette = (uint16_t*)calloc(256, sizeof(uint16_t));
+      if (!_palette) return false;
+      for (uint32_t i = 0; i < len / 3; i++) {
+        uint8_t rgb[3];
+        if (src.readBytes((char*)rgb, 3) != 3) return false;
+        _palette[i] = png565(rgb[0], rgb[1], rgb[2]);
+      }
+    }
+    else if (type == PNG_tRNS && _colorType == 3 && _palette) {
+      // An alpha per palette entry, the entries past the end are opaque
+      for (uint32_t i = 0; i < len; i++) {
+        uint8_t alpha;
+        if (src.readBytes((char*)&alpha, 1) != 1) return false;
+        if (i < 256) _palette[i] = pngBlend(alpha, _palette[i], _bg);
+      }
+    }
+    else if (type == PNG_tRNS && (_colorType == 0 || _colorType == 2) && len == channels * 2u) {
+      uint8_t key[6];
+      if (src.readBytes((char*)key, len) != len) return false;
+      for (uint8_t c = 0; c < channels; c++) _key[c] = key[c * 2] << 8 | key[c * 2 + 1];
+      _hasKey = true;
+    }
+    else if (!skip(src, len)) return false;
+
+    if (!skip(src, 4)) return false;
+  }
+  if (_colorType == 3 && !_palette) return false;
+  _chunkLeft = len;
+
+  _inflator = pngAlloc(sizeof(tinfl_decompressor));
+  _window = (uint8_t*)pngAlloc(TINFL_LZ_DICT_SIZE);
+  _cur = (uint8_t*)malloc(_rowBytes + 1);
+  _prev = (uint8_t*)malloc(_rowBytes + 1);
+  if (!_inflator || !_window || !_cur || !_prev) return false;
+
+  _rows = (width < PNG_DMA_PIXELS) ? PNG_DMA_PIXELS / width : 1;
+  if (_rows > height) _rows = height;
+
+  *w = _width;
+  *h = _height;
+  *block = (uint32_t)_width * _rows;
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           decode
+** Description:             Inflate the IDAT chunks, pushing blocks of rows
+***************************************************************************************/
+bool TFT_ePngDecoder::decode(Stream &src, TFT_eImagePipe &pipe)
+{
+  if (!_inflator || !_window || !_cur || !_prev) return false;
+
+  tinfl_init((tinfl_decompressor*)_inflator);
+  _windowPos = 0;
+  _scanFill = 0;
+  _row = 0;
+  _blockRow = 0;
+  // The row above the first is zeros
+  memset(_prev, 0, _rowBytes + 1);
+
+  uint8_t in[PNG_READ_BYTES];
+  for (;;) {
+    // The image data may be split over any number of IDAT chunks
+    while (_chunkLeft == 0) {
+      uint32_t len, type;
+      if (!skip(src, 4) || !chunk(src, &len, &type) || type != PNG_IDAT) return false;
+      _chunkLeft = len;
+    }
+    size_t len = (_chunkLeft < sizeof(in)) ? _chunkLeft : sizeof(in);
+    if (src.readBytes((char*)in, len) != len) return false;
+    _chunkLeft -= len;
+
+    const uint8_t *data = in;
+    for (;;) {
+      // The window is the output buffer, tinfl wraps around it as in InflateStream
+      size_t inSize = len;
+      size_t outSize = TINFL_LZ_DICT_SIZE - _windowPos;
+      tinfl_status status = tinfl_decompress((tinfl_decompressor*)_inflator, data, &inSize,
+                                             _window, _window + _windowPos, &outSize,
+                                             TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_PARSE_ZLIB_HEADER);
+      data += inSize;
+      len -= inSize;
+
+      if (outSize > 0) {
+        int8_t done = scanBytes(_window + _windowPos, outSize, pipe);
+        if (done < 0) return false;
+        if (done > 0) return true;  // Last row out, or the rest is below the viewport
+        _windowPos = (_windowPos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+      }
+
+      // Data that ends before the last row is corrupt like a failed inflate
+      if (status <= TINFL_STATUS_DONE) return false;
+      if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) break;
+    }
+  }
+}
+
+
+/***************************************************************************************
+** Function name:           scanBytes
+** Description:             Collect inflated bytes into scanlines, push full blocks
+***************************************************************************************/
+// -1 on a bad filter type, 1 once the last row is sent or the rest is not visible
+int8_t TFT_ePngDecoder::scanBytes(const uint8_t *data, size_t len, TFT_eImagePipe &pipe)
+{
+  while (len > 0) {
+    uint32_t take = _rowBytes + 1 - _scanFill;
+    if (take > len) take = len;
+    memcpy(_cur + _scanFill, data, take);
+    _scanFill += take;
+    data += take;
+    len -= take;
+    if (_scanFill <= _rowBytes) continue;
+
+    if (!unfilter()) return -1;
+    if (_blockRow == 0) _block = pipe.buffer((uint32_t)_width * _rows);
+    if (!_block) return -1;
+    convert(_cur + 1, _block + (uint32_t)_blockRow * _width);
+
+    uint8_t *t = _prev; _prev = _cur; _cur = t;
+    _scanFill = 0;
+    _row++;
+    _blockRow++;
+
+    if (_blockRow == _rows || _row == _height) {
+      bool more = pipe.push(0, _row - _blockRow, _width, _blockRow);
+      _blockRow = 0;
+      if (!more || _row == _height) return 1;
+    }
+  }
+  return 0;
+}
+
+
+/***************************************************************************************
+** Function name:           unfilter
+** Description:             Undo the scanline filter against the row above
+***************************************************************************************/
+bool TFT_ePngDecoder::unfilter(void)
+{
+  uint8_t *c = _cur + 1;
+  const uint8_t *p = _prev + 1;
+  uint32_t n = _rowBytes, b = _pixelBytes, i;
+
+  switch (_cur[0]) {
+    case 0:
+      break;
+    case 1: // Sub
+      for (i = b; i < n; i++) c[i] += c[i - b];
+      break;
+    case 2: // Up
+      for (i = 0; i < n; i++) c[i] += p[i];
+      break;
+    case 3: // Average
+      for (i = 0; i < b && i < n; i++) c[i] += p[i] >> 1;
+      for (; i < n; i++) c[i] += (c[i - b] + p[i]) >> 1;
+      break;
+    case 4: // Paeth, which for the first pixel is the byte above
+      for (i = 0; i < b && i < n; i++) c[i] += p[i];
+      for (; i < n; i++) {
+        int16_t a = c[i - b], up = p[i], ul = p[i - b];
+        int16_t pa = abs(up - ul), pb = abs(a - ul), pc = abs(a + up - 2 * ul);
+        c[i] += (pa <= pb && pa <= pc) ? a : (pb <= pc) ? up : ul;
+      }
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           convert
+** Description:             Unfiltered scanline to 565
+***************************************************************************************/
+void TFT_ePngDecoder::convert(const uint8_t *row, uint16_t *out)
+{
+  uint8_t step = _depth >> 3;   // Bytes per sample, 0 when packed
+
+  switch (_colorType) {
+    case 0: // Gray
+      if (!step) {
+        uint8_t scale = 255 / ((1 << _depth) - 1);
+        for (uint32_t x = 0; x < _width; x++) {
+          uint8_t s = pngBits(row, x, _depth);
+          out[x] = (_hasKey && s == _key[0]) ? _bg : png565(s * scale, s * scale, s * scale);
+        }
+      }
+      else if (step == 1 && !_hasKey) convertGray8to565(row, out, _width);
+      else {
+        for (uint32_t x = 0; x < _width; x++, row += step) {
+          out[x] = (_hasKey && pngValue(row, step) == _key[0]) ? _bg : png565(row[0], row[0], row[0]);
+        }
+      }
+      break;
+
+    case 2: // RGB
+      if (step == 1 && !_hasKey) {
+        convert888to565(row, out, _width);
+        break;
+      }
+      for (uint32_t x = 0; x < _width; x++, row += 3 * step) {
+        if (_hasKey && pngValue(row, step) == _key[0] && pngValue(row + step, step) == _key[1] &&
+            pngValue(row + 2 * step, step) == _key[2]) out[x] = _bg;
+        else out[x] = png565(row[0], row[step], row[2 * step]);
+      }
+      break;
+
+    case 3: // Palette
+      if (!step) {
+        for (uint32_t x = 0; x < _width; x++) out[x] = _palette[pngBits(row, x, _depth)];
+      }
+      else {
+        for (uint32_t x = 0; x < _width; x++) out[x] = _palette[row[x]];
+      }
+      break;
+
+    case 4: // Gray and alpha
+      for (uint32_t x = 0; x < _width; x++, row += 2 * step) {
+        out[x] = pngBlend(row[step], png565(row[0], row[0], row[0]), _bg);
+      }
+      break;
+
+    case 6: // RGBA
+      for (uint32_t x = 0; x < _width; x++, row += 4 * step) {
+        out[x] = pngBlend(row[3 * step], png565(row[0], row[step], row[2 * step]), _bg);
+      }
+      break;
+  }
+}
+
+
+/***************************************************************************************
+** Function name:           end
+** Description:             Free the decoder memory
+***************************************************************************************/
+void TFT_ePngDecoder::end(void)
+{
+  free(_palette);
+  free(_inflator);
+  free(_window);
+  free(_cur);
+  free(_prev);
+  _palette = nullptr;
+  _inflator = nullptr;
+  _window = nullptr;
+  _cur = nullptr;
+  _prev = nullptr;
+  _hasKey = false;
+}
+#endif // TFT_ROM_DECODERS
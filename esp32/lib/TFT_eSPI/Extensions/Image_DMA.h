@@ -0,0 +1,24 @@
+ // This is part of the TFT_eSPI class and is associated with the image decoders
+
+ public:
+
+  // Decode an image from src, a File, a network client or a TFT_eMemoryStream over
+  // an array in flash, with its top left corner at x,y. The decoder writes each block
+  // (JPEG MCU or run of PNG rows) into one of two internal RAM buffers, and while that
+  // block goes to the TFT by DMA it decodes the next into the other, so decoding and
+  // the transfer overlap. Without initDMA() the blocks are pushed by the CPU instead.
+  //
+  // Any TFT_eImageDecoder can be given; false when src is not an image the decoder
+  // takes, is cut short or corrupt, or there is no memory for the buffers. Decoding
+  // stops early once the rest of the image is below the viewport. Draws to the TFT,
+  // not to Sprites.
+  bool     drawImageDMA(int32_t x, int32_t y, Stream &src, TFT_eImageDecoder &decoder);
+
+#ifdef TFT_ROM_DECODERS
+           // Baseline JPEG and non-interlaced PNG with the decoders in the ESP32 ROM, see
+           // TFT_eJpgDecoder and TFT_ePngDecoder for the options they have
+  bool     drawJpgDMA(int32_t x, int32_t y, Stream &src);
+  bool     drawJpgDMA(int32_t x, int32_t y, const uint8_t *data, uint32_t len);
+  bool     drawPngDMA(int32_t x, int32_t y, Stream &src);
+  bool     drawPngDMA(int32_t x, int32_t y, const uint8_t *data, uint32_t len);
+#endif
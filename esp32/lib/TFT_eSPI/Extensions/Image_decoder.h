@@ -0,0 +1,166 @@
+/***************************************************************************************
+// Image decoders for TFT_eSPI::drawImageDMA(). A decoder reads the header of an image
+// from a Stream in begin(), then in decode() writes the pixels block by block into
+// buffers it takes from a TFT_eImagePipe, handing each one back with push() to be sent
+// while it decodes the next. Wrap another decoder library in TFT_eImageDecoder to add
+// a format.
+***************************************************************************************/
+
+#ifndef PNG_DMA_PIXELS
+  #define PNG_DMA_PIXELS 2048  // Pixels of PNG rows in each of the two DMA buffers
+#endif
+
+#ifndef PNG_READ_BYTES
+  #define PNG_READ_BYTES 256   // Compressed bytes read from the Stream at a time
+#endif
+
+class TFT_eImagePipe {
+
+ public:
+
+  ~TFT_eImagePipe(void);
+
+           // The buffer to decode the next block into, valid until push(); nullptr
+           // when pixels is more than decoder's begin() asked for
+  uint16_t *buffer(uint32_t pixels);
+
+           // Send the last buffer() as a w x h block of 565 colours at x,y in the image.
+           // False once the block, and so the rest of the image, is below the viewport,
+           // the decoder then stops with success.
+  bool     push(int32_t x, int32_t y, int32_t w, int32_t h);
+
+ private:
+
+  friend class TFT_eSPI;
+
+  TFT_eImagePipe(TFT_eSPI *tft, int32_t x, int32_t y, int32_t bottom, uint32_t pixels);
+  TFT_eImagePipe(const TFT_eImagePipe&) = delete;
+  TFT_eImagePipe& operator=(const TFT_eImagePipe&) = delete;
+
+  bool      ready(void) const { return _buf[0] && _buf[1]; }
+
+  TFT_eSPI *_tft;
+  int32_t   _x, _y;               // Image origin on the TFT
+  int32_t   _bottom;              // Viewport bottom edge
+  uint32_t  _pixels;              // Size of each buffer
+  uint16_t *_buf[2];
+  uint8_t   _next;                // Buffer not in flight
+  bool      _dma;
+};
+
+
+class TFT_eImageDecoder {
+
+ public:
+
+  virtual ~TFT_eImageDecoder(void) {}
+
+           // Read the image header from src: its size and the largest block in pixels
+           // decode() will ask the pipe for. False when src does not hold an image
+           // this decoder takes.
+  virtual bool begin(Stream &src, uint16_t *w, uint16_t *h, uint32_t *block) = 0;
+
+           // Decode the rest of src through pipe, false when it is cut short or corrupt
+  virtual bool decode(Stream &src, TFT_eImagePipe &pipe) = 0;
+
+           // Free what begin() allocated
+  virtual void end(void) {}
+};
+
+
+// Stream over an array, e.g. an image held in flash
+class TFT_eMemoryStream : public Stream {
+
+ public:
+
+  TFT_eMemoryStream(const uint8_t *data, uint32_t len) : _data(data), _len(len), _pos(0) {}
+
+  int      available(void) { return _len - _pos; }
+  int      read(void)      { return (_pos < _len) ? pgm_read_byte(_data + _pos++) : -1; }
+  int      peek(void)      { return (_pos < _len) ? pgm_read_byte(_data + _pos) : -1; }
+  size_t   readBytes(char *buffer, size_t length);
+  size_t   write(uint8_t) { return 0; }
+  void     flush(void) {}
+
+ private:
+
+  const uint8_t *_data;
+  uint32_t  _len;
+  uint32_t  _pos;
+};
+
+
+#ifdef TFT_ROM_DECODERS
+
+// Baseline JPEG through the tjpgd decoder in ROM. The ROM version does not take
+// progressive JPEGs. Blocks are the MCUs, 8x8 to 16x16 pixels.
+class TFT_eJpgDecoder : public TFT_eImageDecoder {
+
+ public:
+
+  ~TFT_eJpgDecoder(void) { end(); }
+
+           // Draw at 1/1, 1/2, 1/4 or 1/8 of the size, scale 1, 2, 4 or 8
+  void     setScale(uint8_t scale);
+
+  bool     begin(Stream &src, uint16_t *w, uint16_t *h, uint32_t *block);
+  bool     decode(Stream &src, TFT_eImagePipe &pipe);
+  void     end(void);
+
+ private:
+
+  void    *_work = nullptr;       // Decoder state and work area, laid out in the .cpp
+  uint8_t  _scale = 0;            // Log2 of the reduction
+};
+
+
+// Non-interlaced PNG of any colour type and depth, the zlib data inflated by tinfl in
+// ROM. Blocks are as many whole rows as fit PNG_DMA_PIXELS, at least one. Memory is
+// the 32 KB inflate window and decoder, in PSRAM when there is some, and two rows.
+class TFT_ePngDecoder : public TFT_eImageDecoder {
+
+ public:
+
+  ~TFT_ePngDecoder(void) { end(); }
+
+           // Colour transparent pixels are blended onto, black by default
+  void     setBackground(uint16_t color) { _bg = color; }
+
+  bool     begin(Stream &src, uint16_t *w, uint16_t *h, uint32_t *block);
+  bool     decode(Stream &src, TFT_eImagePipe &pipe);
+  void     end(void);
+
+ private:
+
+  bool     skip(Stream &src, uint32_t len);
+  bool     chunk(Stream &src, uint32_t *len, uint32_t *type);
+  int8_t   scanBytes(const uint8_t *data, size_t len, TFT_eImagePipe &pipe);
+  bool     unfilter(void);
+  void     convert(const uint8_t *row, uint16_t *out);
+
+  uint16_t _bg = 0;
+  uint16_t _width = 0, _height = 0;
+  uint8_t  _depth = 0;            // Bits per sample
+  uint8_t  _colorType = 0;
+  uint8_t  _pixelBytes = 0;       // Filter distance, whole bytes per pixel, at least 1
+  uint32_t _rowBytes = 0;         // Scanline without its filter type byte
+  uint16_t _rows = 0;             // Rows in a block
+
+  uint16_t *_palette = nullptr;   // 565, transparent entries blended onto _bg
+  bool     _hasKey = false;       // tRNS colour drawn as _bg
+  uint16_t _key[3];
+
+  void    *_inflator = nullptr;
+  uint8_t *_window = nullptr;
+  uint32_t _windowPos = 0;
+  uint32_t _chunkLeft = 0;        // Bytes of the IDAT chunk still to read
+
+  uint8_t *_cur = nullptr;        // Scanline being filled and the one before it,
+  uint8_t *_prev = nullptr;       // each with the filter type byte first
+  uint32_t _scanFill = 0;
+  uint16_t _row = 0;              // Rows decoded
+  uint16_t _blockRow = 0;         // Rows in the block being filled
+  uint16_t *_block = nullptr;
+};
+
+#endif // TFT_ROM_DECODERS
@@ -1,6 +1,7 @@
  // Coded by Bodmer 10/2/18, see license in root directory.
  // This is part of the TFT_eSPI class and is associated with anti-aliased font functions
  
+#include <algorithm>
 
 ////////////////////////////////////////////////////////////////////////////////////////
 // New anti-aliased (smoothed) font functions added below
@@ -126,7 +127,7 @@ void TFT_eSPI::loadFont(String fontName, bool flash)
   gFont.gArray   = (const uint8_t*)fontPtr;
 
   gFont.gCount   = (uint16_t)readInt32(); // glyph count in file
-                             readInt32(); // vlw encoder version - discard
+  gMono          = (readInt32() & VLW_MONO) != 0; // vlw encoder version, flags 1-bit bitmaps
   gFont.yAdvance = (uint16_t)readInt32(); // Font size in points, not pixels
                              readInt32(); // discard
   gFont.ascent   = (uint16_t)readInt32(); // top of "d"
@@ -139,6 +140,7 @@ void TFT_eSPI::loadFont(String fontName, bool flash)
   gFont.spaceWidth = gFont.yAdvance / 4;  // Guess at space width
 
   fontLoaded = true;
+  if (!++gCacheGen) gCacheGen = 1; // 0 is no size to the glyph cache
 
   // Fetch the metrics for each glyph
   loadMetrics();
@@ -236,7 +238,7 @@ void TFT_eSPI::loadMetrics(void)
 
     gBitmap[gNum] = bitmapPtr;
 
-    bitmapPtr += gWidth[gNum] * gHeight[gNum];
+    bitmapPtr += glyphRowBytes(gNum) * gHeight[gNum];
 
     gNum++;
     yield();
@@ -245,6 +247,42 @@ void TFT_eSPI::loadMetrics(void)
   gFont.yAdvance = gFont.maxAscent + gFont.maxDescent;
 
   gFont.spaceWidth = (gFont.ascent + gFont.descent) * 2/7;  // Guess at space width
+
+  indexMetrics();
+}
+
+
+/***************************************************************************************
+** Function name:           indexMetrics
+** Description:             Build the lookup tables getUnicodeIndex() searches
+*************************************************************************************x*/
+// Printable ASCII maps straight to its glyph. Everything else is found by binary search,
+// in gUnicode itself when the font lists its glyphs in code order, as the Processing
+// tool writes them, else through gSorted. Both give the first glyph of a code, as the
+// linear search did.
+void TFT_eSPI::indexMetrics(void)
+{
+  memset(gAscii, 0xFF, sizeof(gAscii));
+  for (uint16_t i = gFont.gCount; i-- > 0; )
+  {
+    if (gUnicode[i] >= 0x20 && gUnicode[i] < 0x80) gAscii[gUnicode[i] - 0x20] = i;
+  }
+
+  gInOrder = true;
+  for (uint16_t i = 1; i < gFont.gCount && gInOrder; i++) gInOrder = gUnicode[i - 1] <= gUnicode[i];
+  if (gInOrder) return;
+
+#if defined (ESP32) && defined (CONFIG_SPIRAM_SUPPORT)
+  if ( psramFound() ) gSorted = (uint16_t*)ps_malloc( gFont.gCount * 2);
+  else
+#endif
+  gSorted = (uint16_t*)malloc( gFont.gCount * 2);
+  if (!gSorted) return; // Left to the linear search
+
+  for (uint16_t i = 0; i < gFont.gCount; i++) gSorted[i] = i;
+  std::sort(gSorted, gSorted + gFont.gCount, [this](uint16_t a, uint16_t b) {
+    return gUnicode[a] < gUnicode[b] || (gUnicode[a] == gUnicode[b] && a < b);
+  });
 }
 
 
@@ -296,6 +334,12 @@ void TFT_eSPI::unloadFont( void )
     gBitmap = NULL;
   }
 
+  if (gSorted)
+  {
+    free(gSorted);
+    gSorted = NULL;
+  }
+
   gFont.gArray = nullptr;
 
 #ifdef FONT_FS_AVAILABLE
@@ -340,6 +384,32 @@ uint32_t TFT_eSPI::readInt32(void)
 *************************************************************************************x*/
 bool TFT_eSPI::getUnicodeIndex(uint16_t unicode, uint16_t *index)
 {
+  if (!gUnicode) return false;
+
+  if (unicode >= 0x20 && unicode < 0x80)
+  {
+    if (gAscii[unicode - 0x20] == 0xFFFF) return false;
+    *index = gAscii[unicode - 0x20];
+    return true;
+  }
+
+  if (gInOrder || gSorted)
+  {
+    // First glyph with a code not below unicode
+    uint16_t lo = 0, hi = gFont.gCount;
+    while (lo < hi)
+    {
+      uint16_t mid = (lo + hi) / 2;
+      if (gUnicode[gSorted ? gSorted[mid] : mid] < unicode) lo = mid + 1;
+      else hi = mid;
+    }
+    if (lo == gFont.gCount) return false;
+    uint16_t i = gSorted ? gSorted[lo] : lo;
+    if (gUnicode[i] != unicode) return false;
+    *index = i;
+    return true;
+  }
+
   for (uint16_t i = 0; i < gFont.gCount; i++)
   {
     if (gUnicode[i] == unicode)
@@ -411,7 +481,7 @@ void TFT_eSPI::drawGlyph(uint16_t code)
     if (fs_font)
     {
       fontFile.seek(gBitmap[gNum], fs::SeekSet);
-      pbuffer =  (uint8_t*)malloc(gWidth[gNum]);
+      pbuffer =  (uint8_t*)malloc(glyphRowBytes(gNum));
     }
 #endif
 
@@ -458,32 +528,66 @@ void TFT_eSPI::drawGlyph(uint16_t code)
       }
     }
 
-    for (int32_t y = 0; y < gHeight[gNum]; y++)
+    // A glyph painted whole over its background, inside the viewport, is blended
+    // once per colour pair into the glyph cache and pushed from there as one block
+    int32_t xd = cx + _xDatum;
+    int32_t yd = cy + _yDatum;
+    bool cached = _fillbg && !bx && !getColor && fg != bg &&
+                  xd >= _vpX && yd >= _vpY && xd + gWidth[gNum] <= _vpW && yd + gHeight[gNum] <= _vpH &&
+                  drawCachedGlyph(0, gNum, xd, yd, fg, bg, gCacheGen);
+#ifdef FONT_FS_AVAILABLE
+    if (fs_font && !cached) fontFile.seek(gBitmap[gNum], fs::SeekSet); // A miss may have read it
+#endif
+
+    uint8_t alphaRow[gWidth[gNum]];
+
+    for (int32_t y = 0; !cached && y < gHeight[gNum]; y++)
     {
 #ifdef FONT_FS_AVAILABLE
       if (fs_font) {
         if (spiffs)
         {
-          fontFile.read(pbuffer, gWidth[gNum]);
+          fontFile.read(pbuffer, glyphRowBytes(gNum));
           //Serial.println("SPIFFS");
         }
         else
         {
           endWrite();    // Release SPI for SD card transaction
-          fontFile.read(pbuffer, gWidth[gNum]);
+          fontFile.read(pbuffer, glyphRowBytes(gNum));
           startWrite();  // Re-start SPI for TFT transaction
           //Serial.println("Not SPIFFS");
         }
       }
 #endif
 
+      // Without a background callback the row goes out as runs of the pixels it draws,
+      // the blended edges and its fill alike, each through one window by drawAlphaSpan
+      if (!getColor)
+      {
+        const uint8_t* row = gPtr + gBitmap[gNum] + glyphRowBytes(gNum) * y;
+#ifdef FONT_FS_AVAILABLE
+        if (fs_font) row = pbuffer;
+#endif
+        for (int32_t x = 0; x < gWidth[gNum]; x++) alphaRow[x] = glyphPixel(row, x);
+
+        int32_t x = 0;
+        while (x < gWidth[gNum])
+        {
+          if (!alphaRow[x] && !(_fillbg && x >= bx)) { x++; continue; }
+          int32_t xs = x;
+          while (x < gWidth[gNum] && (alphaRow[x] || (_fillbg && x >= bx))) x++;
+          drawAlphaSpan(cx + xs, y + cy, x - xs, alphaRow + xs, fg, bg);
+        }
+        continue;
+      }
+
       for (int32_t x = 0; x < gWidth[gNum]; x++)
       {
 #ifdef FONT_FS_AVAILABLE
-        if (fs_font) pixel = pbuffer[x];
+        if (fs_font) pixel = glyphPixel(pbuffer, x);
         else
 #endif
-        pixel = pgm_read_byte(gPtr + gBitmap[gNum] + x + gWidth[gNum] * y);
+        pixel = glyphPixel(gPtr + gBitmap[gNum] + glyphRowBytes(gNum) * y, x);
 
         if (pixel)
         {
@@ -495,7 +599,7 @@ void TFT_eSPI::drawGlyph(uint16_t code)
               else drawFastHLine( fxs, y + cy, fl, fg);
               fl = 0;
             }
-            if (getColor) bg = getColor(x + cx, y + cy);
+            bg = getColor(x + cx, y + cy);
             drawPixel(x + cx, y + cy, alphaBlend(pixel, fg, bg));
           }
           else
@@ -40,8 +40,29 @@ fontMetrics gFont = { nullptr, 0, 0, 0, 0, 0, 0, 0 };
   int8_t*   gdX = NULL;       //leftExtent
   uint32_t* gBitmap = NULL;   //file pointer to greyscale bitmap
 
+  // Lookup tables built by loadMetrics() so getUnicodeIndex() needn't scan gUnicode
+  uint16_t  gAscii[96];       //glyph of each code 0x20-0x7F, 0xFFFF when missing
+  uint16_t* gSorted = NULL;   //glyphs in code order, only when gUnicode isn't in order
+  bool      gInOrder = false; //gUnicode is in code order, binary search it directly
+
   bool     fontLoaded = false; // Flags when a anti-aliased font is loaded
 
+  // 1-bit fonts from Tools/Create_Smooth_Font/vlw_mono.py have VLW_MONO set in the
+  // version word and one bit a pixel, rows padded to whole bytes, MSB first
+#define VLW_MONO 0x100
+  bool     gMono = false;
+
+  // Tells the glyph cache entries of this font from those of fonts loaded before
+  uint8_t  gCacheGen = 0;
+
+  // Bytes of one bitmap row of a glyph
+  uint16_t glyphRowBytes(uint16_t gNum) { return gMono ? (gWidth[gNum] + 7) >> 3 : gWidth[gNum]; }
+  // Alpha of pixel x of a bitmap row
+  uint8_t  glyphPixel(const uint8_t* row, int32_t x) {
+    if (gMono) return (pgm_read_byte(row + (x >> 3)) & (0x80 >> (x & 7))) ? 0xFF : 0;
+    return pgm_read_byte(row + x);
+  }
+
 #ifdef FONT_FS_AVAILABLE
   fs::File fontFile;
   fs::FS   &fontFS  = SPIFFS;
@@ -55,6 +76,7 @@ fontMetrics gFont = { nullptr, 0, 0, 0, 0, 0, 0, 0 };
   private:
 
   void     loadMetrics(void);
+  void     indexMetrics(void);
   uint32_t readInt32(void);
 
   uint8_t* fontPtr = nullptr;
@@ -10,6 +10,10 @@
 // there is a nett performance gain by using swapped bytes.
 ***************************************************************************************/
 
+#if defined (ESP32)
+  #include "esp_heap_caps.h" // Sprite placement in internal RAM or PSRAM
+#endif
+
 /***************************************************************************************
 ** Function name:           TFT_eSprite
 ** Description:             Class constructor
@@ -73,9 +77,11 @@ void* TFT_eSprite::createSprite(int16_t w, int16_t h, uint8_t frames)
   _img8_2 = _img8;
   _img    = (uint16_t*) _img8;
   _img4   = _img8;
+  _backFrame = 1;
 
+  // Frame 2 word aligned for the DMA, with its off screen pixel in what spriteBytes() adds
   if ( (_bpp == 16) && (frames > 1) ) {
-    _img8_2 = _img8 + (w * h * 2 + 1);
+    _img8_2 = _img8 + (((w * h + 1) * 2 + 3) & ~3);
   }
 
   // ESP32 only 16bpp check
@@ -111,6 +117,220 @@ void* TFT_eSprite::createSprite(int16_t w, int16_t h, uint8_t frames)
 }
 
 
+/***************************************************************************************
+** Function name:           createSprite
+** Description:             Create a sprite in a buffer owned by the caller
+***************************************************************************************/
+void* TFT_eSprite::createSprite(int16_t w, int16_t h, void* buffer, size_t size)
+{
+  SpriteMemory policy = _memPolicy;
+  void*  arena        = _arena;
+  size_t arenaSize    = _arenaSize;
+
+  setSpriteArena(buffer, size);
+  void* ptr = createSprite(w, h, 1);
+
+  _memPolicy = policy;
+  _arena     = arena;
+  _arenaSize = arenaSize;
+  return ptr;
+}
+
+
+/***************************************************************************************
+** Function name:           createShadow
+** Description:             Create a 16-bit Sprite of the panel that tracks its changes
+***************************************************************************************/
+void* TFT_eSprite::createShadow(void)
+{
+  if ( _created ) return _dirty ? _img8_1 : nullptr;
+
+  _dirty = (DirtyRect*) malloc(SHADOW_DIRTY_RECTS * sizeof(DirtyRect));
+  if (!_dirty) return nullptr;
+
+  SpriteMemory policy = _memPolicy;
+#if defined (ESP32)
+  _memPolicy = SPRITE_MEM_PSRAM;
+#else
+  _memPolicy = SPRITE_MEM_INTERNAL;
+#endif
+  _bpp = 16;
+  void* ptr = createSprite(_tft->width(), _tft->height(), 1);
+  _memPolicy = policy;
+
+  if (!ptr) {
+    free(_dirty);
+    _dirty = nullptr;
+    return nullptr;
+  }
+
+  // What the panel shows is not known, so the first flush() pushes it all
+  _dirtyCount = 0;
+  markDirty(0, 0, _dwidth, _dheight);
+  return ptr;
+}
+
+
+#define SHADOW_MERGE_SLACK 256 // Extra pixels worth pushing to save a window setup
+
+/***************************************************************************************
+** Function name:           markDirty
+** Description:             Add an area to the changed areas of a shadow Sprite
+***************************************************************************************/
+// Areas that overlap, or whose union is barely larger than the two, become one; when
+// all slots are in use the new area joins the one it grows least
+void TFT_eSprite::markDirty(int32_t x, int32_t y, int32_t w, int32_t h)
+{
+  if (!_dirty) return;
+
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if ((x + w) > _dwidth ) w = _dwidth  - x;
+  if ((y + h) > _dheight) h = _dheight - y;
+  if (w < 1 || h < 1) return;
+
+  // Runs of drawing mostly land inside the area that grew last
+  if (_dirtyCount) {
+    DirtyRect &r = _dirty[_dirtyLast];
+    if (x >= r.x && y >= r.y && x + w <= r.x + r.w && y + h <= r.y + r.h) return;
+  }
+
+  DirtyRect add = { (int16_t)x, (int16_t)y, (int16_t)w, (int16_t)h };
+  auto growth = [](const DirtyRect &a, const DirtyRect &b) {
+    int32_t x0 = min(a.x, b.x), y0 = min(a.y, b.y);
+    int32_t x1 = max(a.x + a.w, b.x + b.w), y1 = max(a.y + a.h, b.y + b.h);
+    return (x1 - x0) * (y1 - y0) - a.w * a.h - b.w * b.h;
+  };
+  auto join = [](DirtyRect &a, const DirtyRect &b) {
+    int16_t x1 = max(a.x + a.w, b.x + b.w), y1 = max(a.y + a.h, b.y + b.h);
+    a.x = min(a.x, b.x);
+    a.y = min(a.y, b.y);
+    a.w = x1 - a.x;
+    a.h = y1 - a.y;
+  };
+
+  int32_t best = -1, bestGrowth = 0;
+  for (uint8_t i = 0; i < _dirtyCount; i++) {
+    int32_t g = growth(_dirty[i], add);
+    if (best < 0 || g < bestGrowth) { best = i; bestGrowth = g; }
+  }
+
+  if (best < 0 || (bestGrowth > SHADOW_MERGE_SLACK && _dirtyCount < SHADOW_DIRTY_RECTS)) {
+    _dirtyLast = _dirtyCount;
+    _dirty[_dirtyCount++] = add;
+    return;
+  }
+
+  // The grown area may now take in others
+  join(_dirty[best], add);
+  bool joined = true;
+  while (joined) {
+    joined = false;
+    for (uint8_t i = 0; i < _dirtyCount; i++) {
+      if (i == best || growth(_dirty[best], _dirty[i]) > SHADOW_MERGE_SLACK) continue;
+      join(_dirty[best], _dirty[i]);
+      _dirty[i] = _dirty[--_dirtyCount];
+      if (best == _dirtyCount) best = i;
+      joined = true;
+      break;
+    }
+  }
+  _dirtyLast = best;
+}
+
+
+/***************************************************************************************
+** Function name:           flush
+** Description:             Push the changed areas of a shadow Sprite to the panel
+***************************************************************************************/
+// PSRAM can't be read by the DMA, so each area goes out a slice at a time through two
+// internal buffers, one filled while the other is sent
+void TFT_eSprite::flush(void)
+{
+  if (!_dirty || !_dirtyCount) return;
+
+#if defined (ESP32_DMA)
+  if (_tft->DMA_Enabled && !_bounce)
+    _bounce = (uint16_t*) heap_caps_malloc(2 * SHADOW_FLUSH_PIXELS * sizeof(uint16_t), MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+
+  if (_tft->DMA_Enabled && _bounce) {
+    bool oldSwapBytes = _tft->getSwapBytes();
+    _tft->setSwapBytes(false);
+    _tft->startWrite();
+    uint8_t half = 0;
+    for (uint8_t i = 0; i < _dirtyCount; i++) {
+      const DirtyRect &r = _dirty[i];
+      if (r.w > SHADOW_FLUSH_PIXELS) {
+        _tft->dmaWait();
+        pushSprite(r.x, r.y, r.x, r.y, r.w, r.h);
+        continue;
+      }
+      int32_t slice = SHADOW_FLUSH_PIXELS / r.w;
+      for (int32_t y = r.y; y < r.y + r.h; y += slice) {
+        int32_t rows = min(slice, r.y + r.h - y);
+        // pushImageDMA() waits for the transfer before, the last one from this half
+        uint16_t *buf = _bounce + half * SHADOW_FLUSH_PIXELS;
+        for (int32_t j = 0; j < rows; j++)
+          memcpy(buf + j * r.w, _img + r.x + (y + j) * _iwidth, r.w * sizeof(uint16_t));
+        _tft->pushImageDMA(r.x, y, r.w, rows, (uint16_t const*)buf);
+        half ^= 1;
+      }
+    }
+    _tft->dmaWait();
+    _tft->endWrite();
+    _tft->setSwapBytes(oldSwapBytes);
+    _dirtyCount = 0;
+    _windowMarked = true;
+    return;
+  }
+#elif defined (RP2040_DMA)
+  // Without PSRAM the DMA reads the Sprite itself: the rows of each area are queued
+  // straight from it and chained by the DMA interrupt
+  if (_tft->DMA_Enabled) {
+    bool oldSwapBytes = _tft->getSwapBytes();
+    _tft->setSwapBytes(false);
+    _tft->startWrite();
+    for (uint8_t i = 0; i < _dirtyCount; i++) {
+      const DirtyRect &r = _dirty[i];
+      _tft->dmaWait(); // The window is set by the CPU
+      _tft->setAddrWindow(r.x, r.y, r.w, r.h);
+      for (int32_t y = r.y; y < r.y + r.h; y++) _tft->pushPixelsDMA(_img + r.x + y * _iwidth, r.w);
+    }
+    _tft->dmaWait();
+    _tft->endWrite();
+    _tft->setSwapBytes(oldSwapBytes);
+    _dirtyCount = 0;
+    _windowMarked = true;
+    return;
+  }
+#endif
+
+  for (uint8_t i = 0; i < _dirtyCount; i++) {
+    const DirtyRect &r = _dirty[i];
+    pushSprite(r.x, r.y, r.x, r.y, r.w, r.h);
+  }
+  _dirtyCount = 0;
+  _windowMarked = true; // pushSprite() set the window to read from
+}
+
+
+/***************************************************************************************
+** Function name:           spriteBytes
+** Description:             Returns the memory a sprite takes, with its off screen pixel
+***************************************************************************************/
+size_t TFT_eSprite::spriteBytes(int16_t w, int16_t h, uint8_t bpp, uint8_t frames)
+{
+  if (frames > 2) frames = 2; // Currently restricted to 2 frame buffers
+  if (frames < 1) frames = 1;
+
+  // Two 16-bit frames get a pixel more, frame 2 is moved up to a word boundary
+  if (bpp == 16) return (frames * w * h + frames + (frames - 1)) * sizeof(uint16_t);
+  if (bpp == 8)  return frames * w * h + frames;
+  if (bpp == 4)  return ((frames * ((w+1) & 0xFFFE) * h) >> 1) + frames;
+  return frames * (((w+7) & 0xFFF8) >> 3) * h + frames;
+}
+
+
 /***************************************************************************************
 ** Function name:           getPointer
 ** Description:             Returns pointer to start of sprite memory area
@@ -139,6 +359,7 @@ bool TFT_eSprite::created(void)
 TFT_eSprite::~TFT_eSprite(void)
 {
   deleteSprite();
+  setGlyphCache(0);
 
 #ifdef SMOOTH_FONT
   if(fontLoaded) unloadFont();
@@ -146,6 +367,38 @@ TFT_eSprite::~TFT_eSprite(void)
 }
 
 
+/***************************************************************************************
+** Function name:           setSpriteMemory
+** Description:             Set where the next createSprite() puts the pixels
+***************************************************************************************/
+void TFT_eSprite::setSpriteMemory(SpriteMemory placement)
+{
+  _memPolicy = placement;
+}
+
+
+/***************************************************************************************
+** Function name:           setSpriteArena
+** Description:             Create the next sprite in a buffer owned by the caller
+***************************************************************************************/
+void TFT_eSprite::setSpriteArena(void* arena, size_t size)
+{
+  _arena = arena;
+  _arenaSize = size;
+  _memPolicy = SPRITE_MEM_ARENA;
+}
+
+
+/***************************************************************************************
+** Function name:           spriteMemory
+** Description:             Returns where the created sprite is
+***************************************************************************************/
+TFT_eSprite::SpriteMemory TFT_eSprite::spriteMemory(void)
+{
+  return _memPlaced;
+}
+
+
 /***************************************************************************************
 ** Function name:           callocSprite
 ** Description:             Allocate a memory area for the Sprite and return pointer
@@ -160,43 +413,15 @@ void* TFT_eSprite::callocSprite(int16_t w, int16_t h, uint8_t frames)
   if (frames > 2) frames = 2; // Currently restricted to 2 frame buffers
   if (frames < 1) frames = 1;
 
-  if (_bpp == 16)
-  {
-#if defined (ESP32) && defined (CONFIG_SPIRAM_SUPPORT)
-    if ( psramFound() && _psram_enable && !_tft->DMA_Enabled)
-    {
-      ptr8 = ( uint8_t*) ps_calloc(frames * w * h + frames, sizeof(uint16_t));
-      //Serial.println("PSRAM");
-    }
-    else
-#endif
-    {
-      ptr8 = ( uint8_t*) calloc(frames * w * h + frames, sizeof(uint16_t));
-      //Serial.println("Normal RAM");
-    }
-  }
+  size_t bytes = spriteBytes(w, h, _bpp, frames);
 
-  else if (_bpp == 8)
-  {
-#if defined (ESP32) && defined (CONFIG_SPIRAM_SUPPORT)
-    if ( psramFound() && _psram_enable ) ptr8 = ( uint8_t*) ps_calloc(frames * w * h + frames, sizeof(uint8_t));
-    else
-#endif
-    ptr8 = ( uint8_t*) calloc(frames * w * h + frames, sizeof(uint8_t));
-  }
-
-  else if (_bpp == 4)
+  if (_bpp == 4)
   {
     w = (w+1) & 0xFFFE; // width needs to be multiple of 2, with an extra "off screen" pixel
     _iwidth = w;
-#if defined (ESP32) && defined (CONFIG_SPIRAM_SUPPORT)
-    if ( psramFound() && _psram_enable ) ptr8 = ( uint8_t*) ps_calloc(((frames * w * h) >> 1) + frames, sizeof(uint8_t));
-    else
-#endif
-    ptr8 = ( uint8_t*) calloc(((frames * w * h) >> 1) + frames, sizeof(uint8_t));
   }
 
-  else // Must be 1 bpp
+  else if (_bpp == 1)
   {
     //_dwidth   Display width+height in pixels always in rotation 0 orientation
     //_dheight  Not swapped for sprite rotations
@@ -205,14 +430,49 @@ void* TFT_eSprite::callocSprite(int16_t w, int16_t h, uint8_t frames)
     w =  (w+7) & 0xFFF8; // width should be the multiple of 8 bits to be compatible with epdpaint
     _iwidth = w;         // _iwidth is rounded up to be multiple of 8, so might not be = _dwidth
     _bitwidth = w;       // _bitwidth will not be rotated whereas _iwidth may be
+  }
+
+  switch (_memPolicy)
+  {
+    case SPRITE_MEM_ARENA:
+      if (_arena == nullptr || _arenaSize < bytes) return nullptr;
+      ptr8 = (uint8_t*) _arena;
+      memset(ptr8, 0, bytes);
+      break;
+
+#if defined (ESP32)
+    case SPRITE_MEM_INTERNAL:
+      ptr8 = (uint8_t*) heap_caps_calloc(bytes, 1, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+      break;
+
+    case SPRITE_MEM_PSRAM:
+      ptr8 = (uint8_t*) heap_caps_calloc(bytes, 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      break;
+#else
+    case SPRITE_MEM_INTERNAL:
+      ptr8 = (uint8_t*) calloc(bytes, 1);
+      break;
+
+    case SPRITE_MEM_PSRAM:
+      return nullptr;
+#endif
 
+    default:
 #if defined (ESP32) && defined (CONFIG_SPIRAM_SUPPORT)
-    if ( psramFound() && _psram_enable ) ptr8 = ( uint8_t*) ps_calloc(frames * (w>>3) * h + frames, sizeof(uint8_t));
-    else
+      // 16 bit sprites stay in DMA capable RAM once DMA is on
+      if ( psramFound() && _psram_enable && (_bpp != 16 || !_tft->DMA_Enabled))
+      {
+        ptr8 = ( uint8_t*) ps_calloc(bytes, 1);
+        if (ptr8) _memPlaced = SPRITE_MEM_PSRAM;
+        return ptr8;
+      }
 #endif
-    ptr8 = ( uint8_t*) calloc(frames * (w>>3) * h + frames, sizeof(uint8_t));
+      ptr8 = ( uint8_t*) calloc(bytes, 1);
+      _memPlaced = SPRITE_MEM_INTERNAL;
+      return ptr8;
   }
 
+  _memPlaced = _memPolicy;
   return ptr8;
 }
 
@@ -294,6 +554,68 @@ void* TFT_eSprite::frameBuffer(int8_t f)
 }
 
 
+/***************************************************************************************
+** Function name:           beginFrame
+** Description:             Select the swap chain frame to draw next, return a pointer to it
+***************************************************************************************/
+void* TFT_eSprite::beginFrame(void)
+{
+  return frameBuffer(_backFrame);
+}
+
+
+/***************************************************************************************
+** Function name:           present
+** Description:             Send the frame drawn to the panel and swap frames
+***************************************************************************************/
+void TFT_eSprite::present(int32_t x, int32_t y)
+{
+  if (!_created) return;
+
+  if (_bpp != 16 || _img8_2 == _img8_1) {
+    pushSprite(x, y);
+    return;
+  }
+
+  frameBuffer(_backFrame);
+
+#if defined (ESP32_DMA) || defined (RP2040_DMA)
+  // pushImageDMA() would clip a partly hidden image in place, in the frame drawn after next
+  if (_tft->DMA_Enabled && _memPlaced != SPRITE_MEM_PSRAM &&
+      x >= 0 && y >= 0 && x + _dwidth <= _tft->width() && y + _dheight <= _tft->height()) {
+    // Waits for the frame before, the one beginFrame() selects next
+    if (_presenting) _tft->endWrite();
+    _tft->startWrite();
+    _presenting = true;
+    bool oldSwapBytes = _tft->getSwapBytes();
+    _tft->setSwapBytes(false);
+    _tft->pushImageDMA(x, y, _dwidth, _dheight, _img);
+    _tft->setSwapBytes(oldSwapBytes);
+  }
+  else
+#endif
+  {
+    presentWait();
+    pushSprite(x, y);
+  }
+
+  _backFrame = 3 - _backFrame;
+  frameBuffer(_backFrame);
+}
+
+
+/***************************************************************************************
+** Function name:           presentWait
+** Description:             Wait for the frame present() sent and release the bus
+***************************************************************************************/
+void TFT_eSprite::presentWait(void)
+{
+  if (!_presenting) return;
+  _tft->endWrite(); // Waits for the DMA
+  _presenting = false;
+}
+
+
 /***************************************************************************************
 ** Function name:           setColorDepth
 ** Description:             Set bits per pixel for colour (1, 8 or 16)
@@ -342,6 +664,30 @@ void TFT_eSprite::setBitmapColor(uint16_t c, uint16_t b)
 }
 
 
+/***************************************************************************************
+** Function name:           createPaletteRamp
+** Description:             Set palette entries first to last to a blend from bg to fg
+***************************************************************************************/
+void TFT_eSprite::createPaletteRamp(uint16_t fg, uint16_t bg, uint8_t first, uint8_t last)
+{
+  if (!_created) return;
+
+  if (_colorMap == nullptr) createPalette(default_4bit_palette);
+
+  if (last > 15) last = 15;
+  if (first > last) return;
+
+  // The ends are the colours themselves, alphaBlend() stops a little short of fg
+  uint8_t steps = last - first;
+  _colorMap[first] = bg;
+  for (uint8_t i = 1; i < steps; i++)
+  {
+    _colorMap[first + i] = alphaBlend((i * 255 + (steps >> 1)) / steps, fg, bg);
+  }
+  _colorMap[last] = fg;
+}
+
+
 /***************************************************************************************
 ** Function name:           setPaletteColor
 ** Description:             Set the 4bpp palette color at the given index
@@ -372,6 +718,8 @@ uint16_t TFT_eSprite::getPaletteColor(uint8_t index)
 ***************************************************************************************/
 void TFT_eSprite::deleteSprite(void)
 {
+  presentWait(); // The DMA may still be reading it
+
   if (_colorMap != nullptr)
   {
     free(_colorMap);
@@ -380,11 +728,112 @@ void TFT_eSprite::deleteSprite(void)
 
   if (_created)
   {
-    free(_img8_1);
+    if (_memPlaced != SPRITE_MEM_ARENA) free(_img8_1);
     _img8 = nullptr;
     _created = false;
     _vpOoB   = true;  // TFT_eSPI class write() uses this to check for valid sprite
   }
+
+  if (_rotLine) free(_rotLine);
+  _rotLine = nullptr;
+  _rotLineSize = 0;
+
+  if (_dirty) free(_dirty);
+  _dirty = nullptr;
+  _dirtyCount = 0;
+  _windowMarked = true;
+
+  if (_bounce) free(_bounce);
+  _bounce = nullptr;
+
+  if (_spans) free(_spans);
+  _spans = nullptr;
+}
+
+
+#define FP_SCALE 10
+#define ROTATE_STACK_PIXELS 128 // Wider rows use the heap line buffer
+
+/***************************************************************************************
+** Function name:           rotatedSpan
+** Description:             Narrow [lo, hi) to the k where 0 <= a + d * k < e
+***************************************************************************************/
+// The source x or y of a destination row is linear in its column, so the columns
+// inside the Sprite are found once per row instead of stepped to one by one
+static void rotatedSpan(int32_t a, int32_t d, int32_t e, int32_t &lo, int32_t &hi)
+{
+  auto floorDiv = [](int32_t n, int32_t m) { return n / m - ((n % m != 0) && (n < 0)); }; // m > 0
+
+  if (d == 0) {
+    if (a < 0 || a >= e) hi = lo;
+  }
+  else if (d > 0) {
+    lo = max(lo, -floorDiv(a, d));        // ceil(-a / d)
+    hi = min(hi, -floorDiv(a - e, d));    // ceil((e - a) / d)
+  }
+  else {
+    lo = max(lo, floorDiv(a - e, -d) + 1);
+    hi = min(hi, floorDiv(a, -d) + 1);
+  }
+}
+
+
+/***************************************************************************************
+** Function name:           readRotated
+** Description:             Fetch a row of rotated source pixels for one colour depth
+***************************************************************************************/
+// Every pixel is inside the Sprite, rotatedSpan() saw to that
+template <uint8_t BPP>
+void TFT_eSprite::readRotated(uint16_t *out, int32_t xs, int32_t ys, int32_t n)
+{
+  static const uint8_t blue[] = {0, 11, 21, 31};
+  uint16_t fg = _tft->bitmap_fg >> 8 | _tft->bitmap_fg << 8;
+  uint16_t bg = _tft->bitmap_bg >> 8 | _tft->bitmap_bg << 8;
+
+  for (int32_t i = 0; i < n; i++, xs += _cosra, ys += _sinra) {
+    int32_t xp = xs >> FP_SCALE;
+    int32_t yp = ys >> FP_SCALE;
+    uint16_t color;
+    if (BPP == 16) { out[i] = _img[xp + yp * _iwidth]; continue; }
+    else if (BPP == 8) {
+      color = _img8[xp + yp * _iwidth];
+      if (color) color = (color & 0xE0)<<8 | (color & 0xC0)<<5 | (color & 0x1C)<<6 | (color & 0x1C)<<3 | blue[color & 0x03];
+    }
+    else if (BPP == 4) {
+      uint8_t index = _img4[(xp + yp * _iwidth) >> 1];
+      color = _colorMap[(xp & 0x01) ? index & 0x0F : index >> 4];
+    }
+    else if (BPP == 1) {
+      out[i] = (_img8[(xp + yp * _bitwidth) >> 3] << (xp & 0x7)) & 0x80 ? fg : bg;
+      continue;
+    }
+    else color = readPixel(xp, yp); // Rotated 1-bit Sprites
+    out[i] = color >> 8 | color << 8;
+  }
+}
+
+void TFT_eSprite::readRotated(uint16_t *out, int32_t xs, int32_t ys, int32_t n)
+{
+  if (_bpp == 16) readRotated<16>(out, xs, ys, n);
+  else if (_bpp == 8) readRotated<8>(out, xs, ys, n);
+  else if (_bpp == 4) readRotated<4>(out, xs, ys, n);
+  else if (rotation == 0) readRotated<1>(out, xs, ys, n);
+  else readRotated<0>(out, xs, ys, n);
+}
+
+
+/***************************************************************************************
+** Function name:           rotatedLine
+** Description:             Line buffer of at least w pixels for pushRotated()
+***************************************************************************************/
+uint16_t *TFT_eSprite::rotatedLine(int32_t w)
+{
+  if (w > _rotLineSize) {
+    if (_rotLine) free(_rotLine);
+    _rotLine = (uint16_t *)malloc(w * sizeof(uint16_t));
+    _rotLineSize = _rotLine ? w : 0;
+  }
+  return _rotLine;
 }
 
 
@@ -392,7 +841,6 @@ void TFT_eSprite::deleteSprite(void)
 ** Function name:           pushRotated - Fast fixed point integer maths version
 ** Description:             Push rotated Sprite to TFT screen
 ***************************************************************************************/
-#define FP_SCALE 10
 bool TFT_eSprite::pushRotated(int16_t angle, uint32_t transp)
 {
   if ( !_created || _tft->_vpOoB) return false;
@@ -406,12 +854,14 @@ bool TFT_eSprite::pushRotated(int16_t angle, uint32_t transp)
   // Get the bounding box of this rotated source Sprite relative to Sprite pivot
   if ( !getRotatedBounds(angle, &min_x, &min_y, &max_x, &max_y) ) return false;
 
-  uint16_t sline_buffer[max_x - min_x + 1];
+  uint16_t stack_buffer[ROTATE_STACK_PIXELS];
+  uint16_t *sline_buffer = (max_x - min_x <= ROTATE_STACK_PIXELS) ? stack_buffer : rotatedLine(max_x - min_x);
+  if (!sline_buffer) return false;
 
   int32_t xt = min_x - _tft->_xPivot;
   int32_t yt = min_y - _tft->_yPivot;
-  uint32_t xe = _dwidth << FP_SCALE;
-  uint32_t ye = _dheight << FP_SCALE;
+  int32_t xe = _dwidth << FP_SCALE;
+  int32_t ye = _dheight << FP_SCALE;
   uint16_t tpcolor = (uint16_t)transp;
 
   if (transp != 0x00FFFFFF) {
@@ -422,36 +872,30 @@ bool TFT_eSprite::pushRotated(int16_t angle, uint32_t transp)
 
   // Scan destination bounding box and fetch transformed pixels from source Sprite
   for (int32_t y = min_y; y <= max_y; y++, yt++) {
-    int32_t x = min_x;
-    uint32_t xs = (_cosra * xt - (_sinra * yt - (_xPivot << FP_SCALE)) + (1 << (FP_SCALE - 1)));
-    uint32_t ys = (_sinra * xt + (_cosra * yt + (_yPivot << FP_SCALE)) + (1 << (FP_SCALE - 1)));
-
-    while ((xs >= xe || ys >= ye) && x < max_x) { x++; xs += _cosra; ys += _sinra; }
-    if (x == max_x) continue;
-
-    uint32_t pixel_count = 0;
-    do {
-      uint32_t rp;
-      int32_t xp = xs >> FP_SCALE;
-      int32_t yp = ys >> FP_SCALE;
-      if (_bpp == 16) {rp = _img[xp + yp * _iwidth]; }
-      else { rp = readPixel(xp, yp); rp = (uint16_t)(rp>>8 | rp<<8); }
-      if (transp != 0x00FFFFFF && tpcolor == rp) {
-        if (pixel_count) {
-          // TFT window is already clipped, so this is faster than pushImage()
-          _tft->setWindow(x - pixel_count, y, x - 1, y);
-          _tft->pushPixels(sline_buffer, pixel_count);
-          pixel_count = 0;
-        }
+    int32_t xs = (_cosra * xt - (_sinra * yt - (_xPivot << FP_SCALE)) + (1 << (FP_SCALE - 1)));
+    int32_t ys = (_sinra * xt + (_cosra * yt + (_yPivot << FP_SCALE)) + (1 << (FP_SCALE - 1)));
+
+    // Columns of the row that land inside the source, max_x itself excluded
+    int32_t lo = 0, hi = max_x - min_x;
+    rotatedSpan(xs, _cosra, xe, lo, hi);
+    rotatedSpan(ys, _sinra, ye, lo, hi);
+    if (lo >= hi) continue;
+
+    int32_t n = hi - lo;
+    int32_t x = min_x + lo;
+    readRotated(sline_buffer, xs + _cosra * lo, ys + _sinra * lo, n);
+
+    // Runs of opaque pixels, each through a window. TFT window is already clipped,
+    // so this is faster than pushImage()
+    for (int32_t i = 0; i < n; ) {
+      if (transp != 0x00FFFFFF) while (i < n && sline_buffer[i] == tpcolor) i++;
+      int32_t start = i;
+      if (transp != 0x00FFFFFF) while (i < n && sline_buffer[i] != tpcolor) i++;
+      else i = n;
+      if (i > start) {
+        _tft->setWindow(x + start, y, x + i - 1, y);
+        _tft->pushPixels(sline_buffer + start, i - start);
       }
-      else {
-        sline_buffer[pixel_count++] = rp;
-      }
-    } while (++x < max_x && (xs += _cosra) < xe && (ys += _sinra) < ye);
-    if (pixel_count) {
-      // TFT window is already clipped, so this is faster than pushImage()
-      _tft->setWindow(x - pixel_count, y, x - 1, y);
-      _tft->pushPixels(sline_buffer, pixel_count);
     }
   }
 
@@ -480,12 +924,14 @@ bool TFT_eSprite::pushRotated(TFT_eSprite *spr, int16_t angle, uint32_t transp)
   // Get the bounding box of this rotated source Sprite
   if ( !getRotatedBounds(spr, angle, &min_x, &min_y, &max_x, &max_y) ) return false;
 
-  uint16_t sline_buffer[max_x - min_x + 1];
+  uint16_t stack_buffer[ROTATE_STACK_PIXELS];
+  uint16_t *sline_buffer = (max_x - min_x <= ROTATE_STACK_PIXELS) ? stack_buffer : rotatedLine(max_x - min_x);
+  if (!sline_buffer) return false;
 
   int32_t xt = min_x - spr->_xPivot;
   int32_t yt = min_y - spr->_yPivot;
-  uint32_t xe = _dwidth << FP_SCALE;
-  uint32_t ye = _dheight << FP_SCALE;
+  int32_t xe = _dwidth << FP_SCALE;
+  int32_t ye = _dheight << FP_SCALE;
   uint16_t tpcolor = (uint16_t)transp;
   
   if (transp != 0x00FFFFFF) {
@@ -498,31 +944,25 @@ bool TFT_eSprite::pushRotated(TFT_eSprite *spr, int16_t angle, uint32_t transp)
 
   // Scan destination bounding box and fetch transformed pixels from source Sprite
   for (int32_t y = min_y; y <= max_y; y++, yt++) {
-    int32_t x = min_x;
-    uint32_t xs = (_cosra * xt - (_sinra * yt - (_xPivot << FP_SCALE)) + (1 << (FP_SCALE - 1)));
-    uint32_t ys = (_sinra * xt + (_cosra * yt + (_yPivot << FP_SCALE)) + (1 << (FP_SCALE - 1)));
+    int32_t xs = (_cosra * xt - (_sinra * yt - (_xPivot << FP_SCALE)) + (1 << (FP_SCALE - 1)));
+    int32_t ys = (_sinra * xt + (_cosra * yt + (_yPivot << FP_SCALE)) + (1 << (FP_SCALE - 1)));
 
-    while ((xs >= xe || ys >= ye) && x < max_x) { x++; xs += _cosra; ys += _sinra; }
-    if (x == max_x) continue;
+    int32_t lo = 0, hi = max_x - min_x;
+    rotatedSpan(xs, _cosra, xe, lo, hi);
+    rotatedSpan(ys, _sinra, ye, lo, hi);
+    if (lo >= hi) continue;
 
-    uint32_t pixel_count = 0;
-    do {
-      uint32_t rp;
-      int32_t xp = xs >> FP_SCALE;
-      int32_t yp = ys >> FP_SCALE;
-      if (_bpp == 16) rp = _img[xp + yp * _iwidth];
-      else { rp = readPixel(xp, yp); rp = (uint16_t)(rp>>8 | rp<<8); }
-      if (transp != 0x00FFFFFF && tpcolor == rp) {
-        if (pixel_count) {
-          spr->pushImage(x - pixel_count, y, pixel_count, 1, sline_buffer);
-          pixel_count = 0;
-        }
-      }
-      else {
-        sline_buffer[pixel_count++] = rp;
-      }
-    } while (++x < max_x && (xs += _cosra) < xe && (ys += _sinra) < ye);
-    if (pixel_count) spr->pushImage(x - pixel_count, y, pixel_count, 1, sline_buffer);
+    int32_t n = hi - lo;
+    int32_t x = min_x + lo;
+    readRotated(sline_buffer, xs + _cosra * lo, ys + _sinra * lo, n);
+
+    for (int32_t i = 0; i < n; ) {
+      if (transp != 0x00FFFFFF) while (i < n && sline_buffer[i] == tpcolor) i++;
+      int32_t start = i;
+      if (transp != 0x00FFFFFF) while (i < n && sline_buffer[i] != tpcolor) i++;
+      else i = n;
+      if (i > start) spr->pushImage(x + start, y, i - start, 1, sline_buffer + start);
+    }
   }
   spr->setSwapBytes(oldSwapBytes);
   return true;
@@ -652,6 +1092,192 @@ void TFT_eSprite::getRotatedBounds(int16_t angle, int16_t w, int16_t h, int16_t
 }
 
 
+/***************************************************************************************
+** Function name:           transposeBits8
+** Description:             Transpose an 8x8 bit block, bit 7 - c of in[i] to bit 7 - i of out[c]
+***************************************************************************************/
+// Hacker's Delight transpose8, the block held in two words
+static void transposeBits8(const uint8_t *in, uint8_t *out)
+{
+  uint32_t x = ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+  uint32_t y = ((uint32_t)in[4] << 24) | ((uint32_t)in[5] << 16) | ((uint32_t)in[6] << 8) | in[7];
+  uint32_t t;
+
+  t = (x ^ (x >> 7)) & 0x00AA00AA;  x = x ^ t ^ (t << 7);
+  t = (y ^ (y >> 7)) & 0x00AA00AA;  y = y ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+  t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+  t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+  y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+  x = t;
+
+  out[0] = x >> 24; out[1] = x >> 16; out[2] = x >> 8; out[3] = x;
+  out[4] = y >> 24; out[5] = y >> 16; out[6] = y >> 8; out[7] = y;
+}
+
+
+/***************************************************************************************
+** Function name:           turnImage
+** Description:             Turn the stored pixels into another buffer by quarter turns
+***************************************************************************************/
+// dst is sized for the turned image and cleared; w and h are the stored image's
+void TFT_eSprite::turnImage(const uint8_t *src, uint8_t *dst, uint8_t turns)
+{
+  int32_t w = _dwidth;
+  int32_t h = _dheight;
+
+  if (_bpp == 16) {
+    const uint16_t *s = (const uint16_t *)src;
+    uint16_t *d = (uint16_t *)dst;
+    const int32_t T = 16; // Tile side, so that neither image is walked a pixel per row
+    for (int32_t ty = 0; ty < h; ty += T) {
+      for (int32_t tx = 0; tx < w; tx += T) {
+        int32_t ye = min(ty + T, h);
+        int32_t xe = min(tx + T, w);
+        for (int32_t y = ty; y < ye; y++) {
+          const uint16_t *row = s + y * w;
+          for (int32_t x = tx; x < xe; x++) {
+            if (turns == 1)      d[x * h + (h - 1 - y)] = row[x];
+            else if (turns == 2) d[(h - 1 - y) * w + (w - 1 - x)] = row[x];
+            else if (turns == 3) d[(w - 1 - x) * h + y] = row[x];
+            else                 d[y * w + x] = row[x];
+          }
+        }
+      }
+    }
+    return;
+  }
+
+  // 1 bit: rows padded to whole bytes, MSB first
+  int32_t sb = (w + 7) >> 3;
+
+  if (turns == 0) { memcpy(dst, src, sb * h); return; }
+
+  if (turns == 2) {
+    // A row read backwards is its bytes reversed and bit reversed, then shifted
+    // left by the padding of the last byte
+    uint8_t pad = sb * 8 - w;
+    for (int32_t y = 0; y < h; y++) {
+      const uint8_t *row = src + (h - 1 - y) * sb;
+      uint8_t *out = dst + y * sb;
+      for (int32_t j = 0; j < sb; j++) {
+        uint8_t a = row[sb - 1 - j];
+        uint8_t b = (j + 1 < sb) ? row[sb - 2 - j] : 0;
+        a = (a & 0xF0) >> 4 | (a & 0x0F) << 4; a = (a & 0xCC) >> 2 | (a & 0x33) << 2; a = (a & 0xAA) >> 1 | (a & 0x55) << 1;
+        b = (b & 0xF0) >> 4 | (b & 0x0F) << 4; b = (b & 0xCC) >> 2 | (b & 0x33) << 2; b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+        out[j] = pad ? (uint8_t)(a << pad | b >> (8 - pad)) : a;
+      }
+    }
+    return;
+  }
+
+  // Quarter turns: each stored byte column of eight stored rows is one 8x8 block
+  // of eight turned rows. Clockwise, turned row x is stored column x read bottom up;
+  // anticlockwise, turned row w - 1 - x is it read top down.
+  int32_t db = (h + 7) >> 3;
+  uint8_t in[8], out[8];
+  for (int32_t b = 0; b < sb; b++) {
+    for (int32_t k = 0; k < db; k++) {
+      for (uint8_t i = 0; i < 8; i++) {
+        int32_t y = (turns == 1) ? h - 1 - (k * 8 + i) : k * 8 + i;
+        in[i] = (y >= 0 && y < h) ? src[y * sb + b] : 0;
+      }
+      transposeBits8(in, out);
+      for (uint8_t c = 0; c < 8 && b * 8 + c < w; c++) {
+        int32_t r = (turns == 1) ? b * 8 + c : w - 1 - (b * 8 + c);
+        dst[r * db + k] = out[c];
+      }
+    }
+  }
+}
+
+
+/***************************************************************************************
+** Function name:           rotateTo
+** Description:             Turn a copy of the Sprite into another by a multiple of 90 degrees
+***************************************************************************************/
+bool TFT_eSprite::rotateTo(TFT_eSprite *spr, int16_t angle)
+{
+  angle %= 360;
+  if (angle < 0) angle += 360;
+  if (!_created || spr == this || angle % 90 || (_bpp != 1 && _bpp != 16) || rotation) return false;
+
+  uint8_t turns = angle / 90;
+  int16_t w = (turns & 1) ? _dheight : _dwidth;
+  int16_t h = (turns & 1) ? _dwidth  : _dheight;
+
+  if (!spr->_created) {
+    spr->setColorDepth(_bpp);
+    if (!spr->createSprite(w, h)) return false;
+  }
+  if (spr->_bpp != _bpp || spr->_dwidth != w || spr->_dheight != h || spr->rotation) return false;
+
+  turnImage(_img8_1, spr->_img8_1, turns);
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           rotateInPlace
+** Description:             Turn the Sprite by a multiple of 90 degrees
+***************************************************************************************/
+// The turned image is built in a second buffer placed like the first, then replaces
+// it; an arena Sprite has it copied back into the arena
+bool TFT_eSprite::rotateInPlace(int16_t angle)
+{
+  angle %= 360;
+  if (angle < 0) angle += 360;
+  if (!_created || angle % 90 || (_bpp != 1 && _bpp != 16) || rotation || _img8_2 != _img8_1) return false;
+
+  uint8_t turns = angle / 90;
+  if (!turns) return true;
+
+  int16_t w = (turns & 1) ? _dheight : _dwidth;
+  int16_t h = (turns & 1) ? _dwidth  : _dheight;
+  size_t bytes = spriteBytes(w, h, _bpp, 1);
+
+  uint8_t *turned;
+  bool arena = _memPlaced == SPRITE_MEM_ARENA;
+  if (arena) {
+    if (bytes > _arenaSize) return false;
+    turned = (uint8_t *)calloc(bytes, 1);
+  }
+  else {
+    SpriteMemory policy = _memPolicy;
+    int32_t  iwidth = _iwidth, bitwidth = _bitwidth;
+    _memPolicy = _memPlaced;
+    turned = (uint8_t *)callocSprite(w, h, 1); // Sets _iwidth and _bitwidth for w
+    _memPolicy = policy;
+    _iwidth = iwidth;
+    _bitwidth = bitwidth;
+  }
+  if (!turned) return false;
+
+  turnImage(_img8_1, turned, turns);
+
+  if (arena) {
+    memcpy(_img8_1, turned, bytes);
+    free(turned);
+    turned = _img8_1;
+  }
+  else free(_img8_1);
+
+  _img8 = _img8_1 = _img8_2 = turned;
+  _img  = (uint16_t *)turned;
+  _img4 = turned;
+
+  _dwidth  = w;
+  _dheight = h;
+  _iwidth  = _bitwidth = (_bpp == 1) ? (w + 7) & 0xFFF8 : w;
+  _iheight = h;
+
+  _sx = 0; _sy = 0; _sw = w; _sh = h;
+  setViewport(0, 0, _dwidth, _dheight);
+  shadowMark(0, 0, w, h);
+  return true;
+}
+
+
 /***************************************************************************************
 ** Function name:           pushSprite
 ** Description:             Push the sprite to the TFT at x, y
@@ -703,6 +1329,229 @@ void TFT_eSprite::pushSprite(int32_t x, int32_t y, uint16_t transp)
 }
 
 
+/***************************************************************************************
+** Function name:           createSpans
+** Description:             List the opaque spans of the Sprite for pushSpans()
+***************************************************************************************/
+bool TFT_eSprite::createSpans(uint16_t transp)
+{
+  if (_spans) free(_spans);
+  _spans = nullptr;
+  _spansTransp = transp;
+
+  if (!_created) return false;
+  if (_bpp != 16) return true;
+
+  // Sprite pixels are in panel byte order, as pushSprite() sends them
+  bool oldSwapBytes = _tft->getSwapBytes();
+  _tft->setSwapBytes(false);
+  _spans = _tft->createSpanList(_dwidth, _dheight, _img, transp);
+  _tft->setSwapBytes(oldSwapBytes);
+  return _spans != nullptr;
+}
+
+
+/***************************************************************************************
+** Function name:           pushSpans
+** Description:             Push the opaque spans listed by createSpans() to the TFT at x, y
+***************************************************************************************/
+void TFT_eSprite::pushSpans(int32_t x, int32_t y)
+{
+  if (!_created) return;
+
+  if (!_spans) {
+    pushSprite(x, y, _spansTransp);
+    return;
+  }
+
+  bool oldSwapBytes = _tft->getSwapBytes();
+  _tft->setSwapBytes(false);
+  _tft->pushImageSpans(x, y, _dwidth, _dheight, _img, _spans);
+  _tft->setSwapBytes(oldSwapBytes);
+}
+
+
+/***************************************************************************************
+** Function name:           moveBits
+** Description:             Copy n bits, MSB first, from one bit position to another
+***************************************************************************************/
+// The ranges may overlap, the source is gathered byte aligned first. Bits of the
+// destination bytes outside the range are kept.
+static void moveBits(uint8_t *dst, uint32_t dbit, const uint8_t *src, uint32_t sbit, uint32_t n)
+{
+  if (!n) return;
+  uint32_t bytes = (n + 7) >> 3;
+  uint8_t  line[bytes + 1];
+
+  const uint8_t *s = src + (sbit >> 3);
+  uint8_t sh = sbit & 7;
+  for (uint32_t k = 0; k < bytes; k++) {
+    uint8_t v = s[k] << sh;
+    if (sh && ((k + 1) << 3) < sh + n) v |= s[k + 1] >> (8 - sh); // Never past the range
+    line[k] = v;
+  }
+  line[bytes] = 0;
+
+  uint32_t first = dbit >> 3;
+  uint32_t last  = (dbit + n - 1) >> 3;
+  for (uint32_t j = first; j <= last; j++) {
+    int32_t  o = (int32_t)(j << 3) - (int32_t)dbit; // Range bit at the byte's MSB
+    uint8_t  v, mask = 0xFF;
+    if (o < 0) { v = line[0] >> -o; mask >>= -o; }
+    else       { v = line[o >> 3] << (o & 7); if (o & 7) v |= line[(o >> 3) + 1] >> (8 - (o & 7)); }
+    int32_t  end = (int32_t)(n - o); // Range bits from the MSB on
+    if (end < 8) mask &= 0xFF << (8 - end);
+    dst[j] = (dst[j] & ~mask) | (v & mask);
+  }
+}
+
+
+/***************************************************************************************
+** Function name:           blitTo
+** Description:             Copy the Sprite into another a clipped row at a time
+***************************************************************************************/
+// Depths  16, 8 -> same depth  rows copied whole, colour keyed two 16-bit pixels a word
+//         16 -> 8              converted per pixel
+//          8, 4 -> 16          through a table of the source's 256 or 16 colours
+//          4 -> 4, 1 -> 1      rows moved as bit ranges; keyed on the palette or bitmap
+//                              colours. 1-bit Sprites only at rotation 0.
+// False for other pairs, which go the way pushImage() takes them.
+bool TFT_eSprite::blitTo(TFT_eSprite *dspr, int32_t x, int32_t y, bool keyed, uint16_t transp)
+{
+  uint8_t db = dspr->_bpp;
+  bool same = (_bpp == db) && (_bpp != 1 || (rotation == 0 && dspr->rotation == 0));
+  if (!same && !(_bpp == 16 && db == 8) && !((_bpp == 8 || _bpp == 4) && db == 16)) return false;
+
+  if (dspr->_vpOoB) return true;
+
+  // Clip to the destination viewport once
+  x += dspr->_xDatum;
+  y += dspr->_yDatum;
+  int32_t sx = 0, sy = 0, w = _dwidth, h = _dheight;
+  if (x < dspr->_vpX) { sx = dspr->_vpX - x; w -= sx; x = dspr->_vpX; }
+  if (y < dspr->_vpY) { sy = dspr->_vpY - y; h -= sy; y = dspr->_vpY; }
+  if (x + w > dspr->_vpW) w = dspr->_vpW - x;
+  if (y + h > dspr->_vpH) h = dspr->_vpH - y;
+  if (w < 1 || h < 1) return true;
+
+  dspr->shadowMark(x, y, w, h);
+
+  uint16_t key = transp >> 8 | transp << 8; // Sprite (panel) byte order
+
+  // Source colours as 565 in panel byte order, for the table conversions and keys
+  uint16_t lut[256];
+  if (_bpp == 8) {
+    static const uint8_t blue[] = {0, 11, 21, 31};
+    for (uint16_t c = 0; c < 256; c++) {
+      uint16_t color = c ? (c & 0xE0)<<8 | (c & 0xC0)<<5 | (c & 0x1C)<<6 | (c & 0x1C)<<3 | blue[c & 0x03] : 0;
+      lut[c] = color >> 8 | color << 8;
+    }
+  }
+  else if (_bpp == 4) {
+    for (uint8_t c = 0; c < 16; c++) lut[c] = _colorMap[c] >> 8 | _colorMap[c] << 8;
+  }
+
+  for (int32_t j = 0; j < h; j++) {
+    int32_t srow = sy + j;
+    int32_t drow = y + j;
+
+    if (_bpp == 16) {
+      const uint16_t *s = _img + sx + srow * _iwidth;
+      if (db == 16) {
+        uint16_t *d = dspr->_img + x + drow * dspr->_iwidth;
+        if (!keyed) { memcpy(d, s, w << 1); continue; }
+        // A pixel pair a word: the halves equal to the key are masked off
+        uint32_t key2 = (uint32_t)key << 16 | key;
+        int32_t i = 0;
+        for (; i + 1 < w; i += 2) {
+          uint32_t sw, dw;
+          memcpy(&sw, s + i, 4);
+          uint32_t t = sw ^ key2;
+          if (!t) continue;  // Both keyed
+          uint32_t m = ((t & 0x0000FFFF) ? 0x0000FFFF : 0) | ((t & 0xFFFF0000) ? 0xFFFF0000 : 0);
+          memcpy(&dw, d + i, 4);
+          dw = (dw & ~m) | (sw & m);
+          memcpy(d + i, &dw, 4);
+        }
+        if (i < w && s[i] != key) d[i] = s[i];
+      }
+      else {
+        uint8_t *d = dspr->_img8 + x + drow * dspr->_iwidth;
+        for (int32_t i = 0; i < w; i++) {
+          uint16_t c = s[i];
+          if (keyed && c == key) continue;
+          d[i] = (uint8_t)((c & 0xE0) | (c & 0x07)<<2 | (c & 0x1800)>>11); // Bytes already swapped
+        }
+      }
+    }
+    else if (_bpp == 8) {
+      const uint8_t *s = _img8 + sx + srow * _iwidth;
+      if (db == 8) {
+        uint8_t *d = dspr->_img8 + x + drow * dspr->_iwidth;
+        if (!keyed) { memcpy(d, s, w); continue; }
+        for (int32_t i = 0; i < w; i++) if (lut[s[i]] != key) d[i] = s[i];
+      }
+      else {
+        uint16_t *d = dspr->_img + x + drow * dspr->_iwidth;
+        for (int32_t i = 0; i < w; i++) {
+          uint16_t c = lut[s[i]];
+          if (!keyed || c != key) d[i] = c;
+        }
+      }
+    }
+    else if (_bpp == 4) {
+      const uint8_t *s = _img4 + srow * (_iwidth >> 1);
+      if (db == 16) {
+        uint16_t *d = dspr->_img + x + drow * dspr->_iwidth;
+        for (int32_t i = 0; i < w; i++) {
+          uint8_t  p = s[(sx + i) >> 1];
+          uint16_t c = lut[((sx + i) & 1) ? p & 0x0F : p >> 4];
+          if (!keyed || c != key) d[i] = c;
+        }
+        continue;
+      }
+      uint8_t *d = dspr->_img4 + drow * (dspr->_iwidth >> 1);
+      if (!keyed) { moveBits(d, x * 4, s, sx * 4, w * 4); continue; }
+      for (int32_t i = 0; i < w; i++) {
+        uint8_t p = s[(sx + i) >> 1];
+        uint8_t v = ((sx + i) & 1) ? p & 0x0F : p >> 4;
+        if (lut[v] == key) continue;
+        uint8_t *q = d + ((x + i) >> 1);
+        if ((x + i) & 1) *q = (*q & 0xF0) | v;
+        else             *q = (*q & 0x0F) | v << 4;
+      }
+    }
+    else {
+      const uint8_t *s = _img8 + srow * (_bitwidth >> 3);
+      uint8_t *d = dspr->_img8 + drow * (dspr->_bitwidth >> 3);
+      if (!keyed) { moveBits(d, x, s, sx, w); continue; }
+
+      // Source bits lined up with the destination bytes, then for each byte the
+      // opaque bits take the destination bit drawPixel() gives their colour
+      uint16_t fg = _tft->bitmap_fg, bg = _tft->bitmap_bg;
+      uint8_t  phase = x & 7;
+      int32_t  bytes = (phase + w + 7) >> 3;
+      uint8_t  line[bytes];
+      line[0] = 0;
+      moveBits(line, phase, s, sx, w);
+      for (int32_t k = 0; k < bytes; k++) {
+        uint8_t b = line[k];
+        uint8_t m = 0xFF;
+        if (k == 0) m >>= phase;
+        int32_t end = phase + w - k * 8;   // Range bits from this byte's MSB
+        if (end < 8) m &= 0xFF << (8 - end);
+        if (fg == transp) m &= ~b;
+        if (bg == transp) m &= b;
+        uint8_t v = (fg ? b : 0) | (bg ? (uint8_t)~b : 0);
+        uint8_t *q = d + (x >> 3) + k;
+        *q = (*q & ~m) | (v & m);
+      }
+    }
+  }
+  return true;
+}
+
+
 /***************************************************************************************
 ** Function name:           pushToSprite
 ** Description:             Push the sprite to another sprite at x, y
@@ -712,6 +1561,8 @@ void TFT_eSprite::pushSprite(int32_t x, int32_t y, uint16_t transp)
 //    16bpp  -> 16bpp
 //    16bpp  ->  8bpp
 //     8bpp  ->  8bpp
+//     8bpp  -> 16bpp
+//     4bpp  -> 16bpp
 //     4bpp  ->  4bpp (note: color translation depends on the 2 sprites palette colors)
 //     1bpp  ->  1bpp (note: color translation depends on the 2 sprites bitmap colors)
 
@@ -720,6 +1571,8 @@ bool TFT_eSprite::pushToSprite(TFT_eSprite *dspr, int32_t x, int32_t y)
   if (!_created) return false;
   if (!dspr->created()) return false;
 
+  if (blitTo(dspr, x, y, false, 0)) return true;
+
   // Check destination sprite compatibility
   int8_t ds_bpp = dspr->getColorDepth();
   if (_bpp == 16 && ds_bpp != 16 && ds_bpp !=  8) return false;
@@ -745,12 +1598,17 @@ bool TFT_eSprite::pushToSprite(TFT_eSprite *dspr, int32_t x, int32_t y)
 //    16bpp  -> 16bpp
 //    16bpp  ->  8bpp
 //     8bpp  ->  8bpp
+//     8bpp  -> 16bpp
+//     4bpp  -> 16bpp
+//     4bpp  ->  4bpp (keyed on the source palette colour)
 //     1bpp  ->  1bpp
 
 bool TFT_eSprite::pushToSprite(TFT_eSprite *dspr, int32_t x, int32_t y, uint16_t transp)
 {
   if ( !_created  || !dspr->_created) return false; // Check Sprites exist
 
+  if (blitTo(dspr, x, y, true, transp)) return true;
+
   // Check destination sprite compatibility
   int8_t ds_bpp = dspr->getColorDepth();
   if (_bpp == 16 && ds_bpp != 16 && ds_bpp !=  8) return false;
@@ -1034,6 +1892,8 @@ void  TFT_eSprite::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_
 
   PI_CLIP;
 
+  shadowMark(x, y, dw, dh);
+
   if (_bpp == 16) // Plot a 16 bpp image into a 16 bpp Sprite
   {
     // Pointer within original image
@@ -1177,6 +2037,8 @@ void  TFT_eSprite::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const u
 
   PI_CLIP;
 
+  shadowMark(x, y, dw, dh);
+
   if (_bpp == 16) // Plot a 16 bpp image into a 16 bpp Sprite
   {
     for (int32_t yp = dy; yp < dy + dh; yp++)
@@ -1280,6 +2142,8 @@ void TFT_eSprite::setWindow(int32_t x0, int32_t y0, int32_t x1, int32_t y1)
 
   _xptr = _xs;
   _yptr = _ys;
+
+  _windowMarked = false;
 }
 
 
@@ -1291,6 +2155,8 @@ void TFT_eSprite::pushColor(uint16_t color)
 {
   if (!_created ) return;
 
+  if (!_windowMarked) shadowMarkWindow();
+
   // Write the colour to RAM in set window
   if (_bpp == 16)
     _img [_xptr + _yptr * _iwidth] = (uint16_t) (color >> 8) | (color << 8);
@@ -1355,6 +2221,8 @@ void TFT_eSprite::writeColor(uint16_t color)
 {
   if (!_created ) return;
 
+  if (!_windowMarked) shadowMarkWindow();
+
   // Write 16-bit RGB 565 encoded colour to RAM
   if (_bpp == 16) _img [_xptr + _yptr * _iwidth] = color;
 
@@ -1470,23 +2338,24 @@ void TFT_eSprite::scroll(int16_t dx, int16_t dy)
       fyp += iw;
     }
   }
-  else if (_bpp == 4)
+  else if (_bpp == 4 || (_bpp == 1 && rotation == 0))
   {
-    // could optimize for scrolling by even # pixels using memove (later)
-    if (dx >  0) { tx += w; fx += w; } // Start from right edge
+    // Rows of packed pixels, MSB first, moved as bit ranges a byte at a time
+    uint8_t  bits  = _bpp;
+    int32_t  pitch = (_bpp == 4) ? (_iwidth >> 1) : (_bitwidth >> 3);
+    if (dy > 0) pitch = -pitch;
+    uint8_t* from  = _img8 + fy * abs(pitch);
+    uint8_t* to    = _img8 + ty * abs(pitch);
     while (h--)
-    { // move pixels one by one
-      for (uint16_t xp = 0; xp < w; xp++)
-      {
-        if (dx <= 0) drawPixel(tx + xp, ty, readPixelValue(fx + xp, fy));
-        if (dx >  0) drawPixel(tx - xp, ty, readPixelValue(fx - xp, fy));
-      }
-      if (dy <= 0)  { ty++; fy++; }
-      else  { ty--; fy--; }
+    {
+      moveBits(to, tx * bits, from, fx * bits, w * bits);
+      from += pitch;
+      to   += pitch;
     }
   }
   else if (_bpp == 1 )
   {
+    // Rotated 1-bit Sprites, pixel by pixel through the coordinate rotation
     if (dx >  0) { tx += w; fx += w; } // Start from right edge
     while (h--)
     { // move pixels one by one
@@ -1501,6 +2370,8 @@ void TFT_eSprite::scroll(int16_t dx, int16_t dy)
   }
   else return; // Not 1, 4, 8 or 16 bpp
 
+  shadowMark(_sx, _sy, _sw, _sh);
+
   // Fill the gap left by the scrolling
   if (dx > 0) fillRect(_sx, _sy, dx, _sh, _scolor);
   if (dx < 0) fillRect(_sx + _sw + dx, _sy, -dx, _sh, _scolor);
@@ -1523,6 +2394,7 @@ void TFT_eSprite::fillSprite(uint32_t color)
     if(_bpp == 16) {
       if ( (uint8_t)color == (uint8_t)(color>>8) ) {
         memset(_img,  (uint8_t)color, _iwidth * _yHeight * 2);
+        shadowMark(0, 0, _iwidth, _yHeight);
       }
       else fillRect(_vpX, _vpY, _xWidth, _yHeight, color);
     }
@@ -1637,6 +2509,8 @@ void TFT_eSprite::drawPixel(int32_t x, int32_t y, uint32_t color)
   // Range checking
   if ((x < _vpX) || (y < _vpY) ||(x >= _vpW) || (y >= _vpH)) return;
 
+  shadowMark(x, y, 1, 1);
+
   if (_bpp == 16)
   {
     color = (color >> 8) | (color << 8);
@@ -1683,6 +2557,52 @@ void TFT_eSprite::drawPixel(int32_t x, int32_t y, uint32_t color)
 }
 
 
+/***************************************************************************************
+** Function name:           pushGlyph
+** Description:             Copy a cached glyph block into the sprite
+***************************************************************************************/
+// 16-bit sprites hold their pixels in panel byte order, like the cache
+bool TFT_eSprite::pushGlyph(int32_t xd, int32_t yd, int32_t w, int32_t h, const uint16_t *data)
+{
+  if (!_created || _bpp != 16) return false;
+
+  shadowMark(xd, yd, w, h);
+  uint16_t *row = _img + xd + yd * _iwidth;
+  for (int32_t j = 0; j < h; j++, row += _iwidth, data += w) memcpy(row, data, w * sizeof(uint16_t));
+  return true;
+}
+
+
+/***************************************************************************************
+** Function name:           drawAlphaSpan
+** Description:             Blend a colour over a run of pixels, one alpha per pixel
+***************************************************************************************/
+void TFT_eSprite::drawAlphaSpan(int32_t x, int32_t y, int32_t w, const uint8_t *alpha, uint32_t fg_color, uint32_t bg_color)
+{
+  if (!_created || _vpOoB || w < 1) return;
+
+  // Other colour depths go through the palette or colour conversion pixel by pixel
+  if (_bpp != 16) {
+    for (int32_t i = 0; i < w; i++) TFT_eSPI::drawPixel(x + i, y, fg_color, alpha[i], bg_color);
+    return;
+  }
+
+  x+= _xDatum;
+  y+= _yDatum;
+
+  if ((y < _vpY) || (y >= _vpH) || (x >= _vpW)) return;
+  if (x < _vpX) { alpha += _vpX - x; w -= _vpX - x; x = _vpX; }
+  if ((x + w) > _vpW) w = _vpW - x;
+  if (w < 1) return;
+
+  shadowMark(x, y, w, 1);
+
+  // Blended in place, the run is read from the sprite in its swapped byte order
+  uint16_t *line = _img + x + y * _iwidth;
+  alphaBlendSpan(line, (bg_color == 0x00FFFFFF) ? line : nullptr, bg_color, alpha, w, fg_color, true);
+}
+
+
 /***************************************************************************************
 ** Function name:           drawLine
 ** Description:             draw a line between 2 arbitrary points
@@ -1761,6 +2681,8 @@ void TFT_eSprite::drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color)
 
   if (h < 1) return;
 
+  shadowMark(x, y, 1, h);
+
   if (_bpp == 16)
   {
     color = (color >> 8) | (color << 8);
@@ -1822,6 +2744,8 @@ void TFT_eSprite::drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color)
 
   if (w < 1) return;
 
+  shadowMark(x, y, w, 1);
+
   if (_bpp == 16)
   {
     color = (color >> 8) | (color << 8);
@@ -1887,6 +2811,8 @@ void TFT_eSprite::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t
 
   if ((w < 1) || (h < 1)) return;
 
+  shadowMark(x, y, w, h);
+
   int32_t yp = _iwidth * y + x;
 
   if (_bpp == 16)
@@ -2006,6 +2932,11 @@ void TFT_eSprite::drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uin
 
   bool fillbg = (bg != color);
 
+  int32_t xd = x + _xDatum;
+  int32_t yd = y + _yDatum;
+  if (fillbg && xd >= _vpX && yd >= _vpY && xd + 6 * size <= _vpW && yd + 8 * size <= _vpH &&
+      drawCachedGlyph(1, c, xd, yd, color, bg, size)) return;
+
   if ((size==1) && fillbg)
   {
     uint8_t column[6];
@@ -2190,7 +3121,7 @@ int16_t TFT_eSprite::drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t fo
 
   int32_t width  = 0;
   int32_t height = 0;
-  uint32_t flash_address = 0;
+  uintptr_t flash_address = 0;
   uniCode -= 32;
 
 #ifdef LOAD_FONT2
@@ -2225,6 +3156,9 @@ int16_t TFT_eSprite::drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t fo
   uint8_t line = 0;
   bool clip = xd < _vpX || xd + width  * textsize >= _vpW || yd < _vpY || yd + height * textsize >= _vpH;
 
+  if (textcolor != textbgcolor && !clip && drawCachedGlyph(font, uniCode, xd, yd, textcolor, textbgcolor, textsize))
+    return width * textsize;
+
 #ifdef LOAD_FONT2 // chop out code if we do not need it
   if (font == 2) {
     w = w + 6; // Should be + 7 but we need to compensate for width increment
@@ -2416,7 +3350,7 @@ void TFT_eSprite::drawGlyph(uint16_t code)
   uint16_t fg = textcolor;
   uint16_t bg = textbgcolor;
   bool getBG  = false;
-  if (fg == bg) getBG = true;
+  if (fg == bg && _bpp != 4) getBG = true;
 
   // Check if cursor has moved
   if (last_cursor_x != cursor_x)
@@ -2481,7 +3415,7 @@ void TFT_eSprite::drawGlyph(uint16_t code)
 #ifdef FONT_FS_AVAILABLE
     if (fs_font) {
       fontFile.seek(gBitmap[gNum], fs::SeekSet); // This is slow for a significant position shift!
-      pbuffer =  (uint8_t*)malloc(gWidth[gNum]);
+      pbuffer =  (uint8_t*)malloc(glyphRowBytes(gNum));
     }
 #endif
 
@@ -2491,6 +3425,76 @@ void TFT_eSprite::drawGlyph(uint16_t code)
     //  if (cx > width() && bg_cursor_x > width()) return;
     //  if (cursor_y > height()) return;
 
+    // Glyphs inside the viewport are ORed a byte at a time into the rows of a 1-bit
+    // sprite, or cleared from them for a zero colour. 1-bit glyphs go as they are;
+    // 8-bit ones are packed a row at a time first: a pixel is ink from the alpha at
+    // which its blend would take the colour's bit in drawPixel(), or by an ordered
+    // dither. Less coverage leaves the sprite as it is, as a 1-bit glyph's clear bits do.
+    int16_t xd = cx + _xDatum;
+    int16_t yd = cy + _yDatum;
+    if (_bpp == 1 && rotation == 0 && !newSprite && !_fillbg && !getBG &&
+        xd >= _vpX && yd >= _vpY && xd + gWidth[gNum] <= _vpW && yd + gHeight[gNum] <= _vpH)
+    {
+      static const uint8_t bayer4[4][4] = {
+        {   8, 136,  40, 168 }, { 200,  72, 232, 104 },
+        {  56, 184,  24, 152 }, { 248, 120, 216,  88 }
+      };
+
+      uint16_t rowBytes  = glyphRowBytes(gNum);
+      uint16_t packBytes = (gWidth[gNum] + 7) >> 3;
+      uint8_t  shift     = xd & 7;
+      uint8_t  tail      = 0xFF << (packBytes * 8 - gWidth[gNum]); // Row padding off
+      uint8_t* dst       = _img8 + ((xd + yd * _bitwidth) >> 3);
+      uint8_t  packed[packBytes];
+
+      // Lowest alpha drawn in the colour's bit, the blend moving one way from bg to fg
+      uint8_t threshold = 255;
+      if (!gMono) {
+        uint8_t lo = 1;
+        while (lo < threshold) {
+          uint8_t mid = (lo + threshold) >> 1;
+          if ((alphaBlend(mid, fg, bg) != 0) == (fg != 0)) threshold = mid;
+          else lo = mid + 1;
+        }
+      }
+
+      for (int32_t y = 0; y < gHeight[gNum]; y++, dst += _bitwidth >> 3)
+      {
+        const uint8_t* src = gPtr + gBitmap[gNum] + rowBytes * y;
+#ifdef FONT_FS_AVAILABLE
+        if (fs_font) { fontFile.read(pbuffer, rowBytes); src = pbuffer; }
+#endif
+        if (!gMono)
+        {
+          const uint8_t* dither = _glyphDither ? bayer4[(yd + y) & 3] : nullptr;
+          memset(packed, 0, packBytes);
+          for (int32_t x = 0; x < gWidth[gNum]; x++)
+          {
+            uint8_t a = pgm_read_byte(src + x);
+            if (a && a >= (dither ? dither[(xd + x) & 3] : threshold)) packed[x >> 3] |= 0x80 >> (x & 7);
+          }
+          src = packed;
+        }
+
+        for (uint16_t i = 0; i < packBytes; i++)
+        {
+          uint8_t b = pgm_read_byte(src + i);
+          if (i == packBytes - 1) b &= tail;
+          if (!b) continue;
+          uint8_t hi = b >> shift;
+          uint8_t lo = shift ? (uint8_t)(b << (8 - shift)) : 0; // Only set when inside the glyph
+          if (fg) { dst[i] |= hi;  if (lo) dst[i + 1] |= lo; }
+          else    { dst[i] &= ~hi; if (lo) dst[i + 1] &= ~lo; }
+        }
+      }
+
+      if (pbuffer) free(pbuffer);
+      cursor_x += gxAdvance[gNum];
+      bg_cursor_x = cursor_x;
+      last_cursor_x = cursor_x;
+      return;
+    }
+
     int16_t  fxs = cx;
     uint32_t fl = 0;
     int16_t  bxs = cx;
@@ -2525,21 +3529,49 @@ void TFT_eSprite::drawGlyph(uint16_t code)
       }
     }
 
-    for (int32_t y = 0; y < gHeight[gNum]; y++)
+    // In a 4-bit sprite the colours are palette indices, and the alpha picks the index
+    // nearest to it between bg and fg, on a ramp set up by createPaletteRamp(). Inside
+    // the viewport the indices are written straight into the nibbles.
+    int16_t rampSteps = (int16_t)(fg & 0x0F) - (int16_t)(bg & 0x0F);
+    auto rampIndex = [&](uint8_t alpha) -> uint8_t {
+      return (bg & 0x0F) + (rampSteps * alpha + (rampSteps < 0 ? -127 : 127)) / 255;
+    };
+    bool nibbles = _bpp == 4 && rotation == 0 && !newSprite &&
+                   xd >= _vpX && yd >= _vpY && xd + gWidth[gNum] <= _vpW && yd + gHeight[gNum] <= _vpH;
+
+    // As in TFT_eSPI::drawGlyph(), from the glyph cache of a 16-bit sprite
+    bool cached = _fillbg && !bx && !getBG && !newSprite && _bpp == 16 && rotation == 0 &&
+                  xd >= _vpX && yd >= _vpY && xd + gWidth[gNum] <= _vpW && yd + gHeight[gNum] <= _vpH &&
+                  drawCachedGlyph(0, gNum, xd, yd, fg, bg, gCacheGen);
+#ifdef FONT_FS_AVAILABLE
+    if (fs_font && !cached) fontFile.seek(gBitmap[gNum], fs::SeekSet);
+#endif
+
+    for (int32_t y = 0; !cached && y < gHeight[gNum]; y++)
     {
 #ifdef FONT_FS_AVAILABLE
       if (fs_font) {
-        fontFile.read(pbuffer, gWidth[gNum]);
+        fontFile.read(pbuffer, glyphRowBytes(gNum));
       }
 #endif
 
       for (int32_t x = 0; x < gWidth[gNum]; x++)
       {
 #ifdef FONT_FS_AVAILABLE
-        if (fs_font) pixel = pbuffer[x];
+        if (fs_font) pixel = glyphPixel(pbuffer, x);
         else
 #endif
-        pixel = pgm_read_byte(gPtr + gBitmap[gNum] + x + gWidth[gNum] * y);
+        pixel = glyphPixel(gPtr + gBitmap[gNum] + glyphRowBytes(gNum) * y, x);
+
+        if (nibbles)
+        {
+          if (!pixel && !(_fillbg && x >= bx)) continue;
+          uint8_t  c = pixel ? rampIndex(pixel) : (bg & 0x0F);
+          uint8_t* q = _img4 + (((xd + x) + (yd + y) * _iwidth) >> 1);
+          if ((xd + x) & 1) *q = (*q & 0xF0) | c;
+          else              *q = (*q & 0x0F) | (c << 4);
+          continue;
+        }
 
         if (pixel)
         {
@@ -2552,7 +3584,7 @@ void TFT_eSprite::drawGlyph(uint16_t code)
               fl = 0;
             }
             if (getBG) bg = readPixel(x + cx, y + cy);
-            drawPixel(x + cx, y + cy, alphaBlend(pixel, fg, bg));
+            drawPixel(x + cx, y + cy, _bpp == 4 ? rampIndex(pixel) : alphaBlend(pixel, fg, bg));
           }
           else
           {
@@ -2574,6 +3606,7 @@ void TFT_eSprite::drawGlyph(uint16_t code)
       if (fl) { drawFastHLine( fxs, y + cy, fl, fg); fl = 0; }
       if (bl) { drawFastHLine( bxs, y + cy, bl, bg); bl = 0; }
     }
+    if (nibbles) shadowMark(xd, yd, gWidth[gNum], gHeight[gNum]);
 
     // Fill area below glyph
     if (fillwidth > 0) {
@@ -5,13 +5,41 @@
 // graphics are written to the Sprite rather than the TFT.
 ***************************************************************************************/
 
+// Changed rectangles a shadow Sprite tracks before they are merged together
+#ifndef SHADOW_DIRTY_RECTS
+  #define SHADOW_DIRTY_RECTS 16
+#endif
+
+// Pixels per DMA transfer when a shadow Sprite is flushed, two such bounce buffers
+// are taken from internal RAM. Not less than the panel width.
+#ifndef SHADOW_FLUSH_PIXELS
+  #define SHADOW_FLUSH_PIXELS 4096
+#endif
+
 class TFT_eSprite : public TFT_eSPI {
 
+  template <uint8_t B, uint8_t R> friend class TFT_eCanvas; // Reads the Sprite's layout once
+
  public:
 
   explicit TFT_eSprite(TFT_eSPI *tft);
   ~TFT_eSprite(void);
 
+           // Where createSprite() puts the pixels
+  enum SpriteMemory : uint8_t {
+    SPRITE_MEM_AUTO,     // PSRAM if found and enabled, unless DMA is on for 16 bit (the default)
+    SPRITE_MEM_INTERNAL, // Internal DMA capable RAM, fast to draw in and to push
+    SPRITE_MEM_PSRAM,    // PSRAM only, for large sprites that are seldom pushed
+    SPRITE_MEM_ARENA     // Caller's buffer set with setSpriteArena(), not freed by deleteSprite()
+  };
+
+           // Set the placement for the next createSprite(), it fails rather than using other memory
+  void     setSpriteMemory(SpriteMemory placement);
+           // Create the sprite in a buffer of size bytes owned by the caller (sets SPRITE_MEM_ARENA)
+  void     setSpriteArena(void* arena, size_t size);
+           // Where the created sprite is: AUTO is reported as INTERNAL or PSRAM
+  SpriteMemory spriteMemory(void);
+
            // Create a sprite of width x height pixels, return a pointer to the RAM area
            // Sketch can cast returned value to (uint16_t*) for 16-bit depth if needed
            // RAM required is:
@@ -21,6 +49,26 @@ class TFT_eSprite : public TFT_eSPI {
            //  - 2 bytes per pixel for 16-bit color depth (565 RGB format)
   void*    createSprite(int16_t width, int16_t height, uint8_t frames = 1);
 
+           // Create a one frame sprite in a buffer of size bytes owned by the caller, nullptr if it is too
+           // small. Nothing is allocated or freed, so sprites can be made and deleted without fragmenting
+           // the heap. The placement set before is kept for later createSprite() calls.
+  void*    createSprite(int16_t width, int16_t height, void* buffer, size_t size);
+
+           // Bytes a sprite of this size and colour depth takes, to size a buffer for the above
+  static size_t spriteBytes(int16_t width, int16_t height, uint8_t bpp, uint8_t frames = 1);
+
+           // Shadow framebuffer: a 16-bit Sprite of the whole panel in PSRAM, drawn to instead
+           // of the panel. Reads come from memory and overdraw costs no bus time; the areas
+           // drawn to are tracked and flush() pushes only those to the panel, by DMA when it
+           // is on. Returns nullptr if there is no memory for it.
+  void*    createShadow(void);
+           // Mark an area of a shadow Sprite as changed, for pixels written via getPointer()
+  void     markDirty(int32_t x, int32_t y, int32_t w, int32_t h);
+           // Number of changed areas waiting for flush()
+  uint8_t  dirtyCount(void) { return _dirtyCount; }
+           // Push the changed areas of a shadow Sprite to the same place on the panel
+  void     flush(void);
+
            // Returns a pointer to the sprite or nullptr if not created, user must cast to pointer type
   void*    getPointer(void);
 
@@ -33,6 +81,18 @@ class TFT_eSprite : public TFT_eSPI {
            // Select the frame buffer for graphics write (for 2 colour ePaper and DMA toggle buffer)
            // Returns a pointer to the Sprite frame buffer
   void*    frameBuffer(int8_t f);
+
+           // Swap chain of a 16-bit Sprite created with 2 frames: draw into the frame beginFrame()
+           // selects, then present() sends it to the panel at x, y and selects the other one for the
+           // next frame. With DMA on, present() returns once the frame is queued, waiting only while
+           // the frame before is still going out, so the next one is drawn during the transfer. The
+           // sprite must be in DMA capable RAM and wholly on the panel (and inside its viewport),
+           // otherwise, like without DMA, the frame is pushed with pushSprite(). The bus is held
+           // while a frame is out: call presentWait() before drawing on the panel directly.
+  void*    beginFrame(void);
+  void     present(int32_t x, int32_t y);
+           // Wait for the last present() and release the bus
+  void     presentWait(void);
   
            // Set or get the colour depth to 1, 4, 8 or 16 bits. Can be used to change depth an existing
            // sprite, but clears it to black, returns a new pointer if sprite is re-created.
@@ -43,6 +103,11 @@ class TFT_eSprite : public TFT_eSPI {
   void     createPalette(uint16_t *palette = nullptr, uint8_t colors = 16);       // Palette in RAM
   void     createPalette(const uint16_t *palette = nullptr, uint8_t colors = 16); // Palette in FLASH
 
+           // Fill palette entries first to last with a ramp from bg to fg, creating the palette if
+           // needed. With setTextColor(last, first) smooth font glyphs in a 4-bit sprite take the
+           // entry nearest their alpha. Ramps over separate index ranges can share one palette.
+  void     createPaletteRamp(uint16_t fg, uint16_t bg, uint8_t first = 0, uint8_t last = 15);
+
            // Set a single palette index to the given color
   void     setPaletteColor(uint8_t index, uint16_t color);
 
@@ -55,6 +120,12 @@ class TFT_eSprite : public TFT_eSPI {
            // Draw a single pixel at x,y
   void     drawPixel(int32_t x, int32_t y, uint32_t color);
 
+           // Pixels go to memory, so TFT class functions skip their window setup
+  bool     directWindow(void) { return false; }
+
+           // Blend a colour over a run of pixels in place, one alpha per pixel
+  void     drawAlphaSpan(int32_t x, int32_t y, int32_t w, const uint8_t *alpha, uint32_t fg_color, uint32_t bg_color = 0x00FFFFFF);
+
            // Draw a single character in the GLCD or GFXFF font
   void     drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32_t bg, uint8_t size),
 
@@ -107,6 +178,13 @@ class TFT_eSprite : public TFT_eSPI {
   void     getRotatedBounds(int16_t angle, int16_t w, int16_t h, int16_t xp, int16_t yp,
                             int16_t *min_x, int16_t *min_y, int16_t *max_x, int16_t *max_y);
 
+           // Exact quarter turns, angle 0, 90, 180 or 270 clockwise, of 1 and 16-bit Sprites
+           // at rotation 0. Into another Sprite of the same depth and the turned size, which
+           // is created so when it isn't yet, or in place, the Sprite taking the turned size.
+           // 1-bit Sprites turn in 8x8 bit blocks, 16-bit ones in tiles of 16x16 pixels.
+  bool     rotateTo(TFT_eSprite *spr, int16_t angle);
+  bool     rotateInPlace(int16_t angle);
+
            // Read the colour of a pixel at x,y and return value in 565 format 
   uint16_t readPixel(int32_t x0, int32_t y0);
 
@@ -122,6 +200,11 @@ class TFT_eSprite : public TFT_eSPI {
            // Optionally a "transparent" colour can be defined, pixels of that colour will not be rendered
   void     pushSprite(int32_t x, int32_t y);
   void     pushSprite(int32_t x, int32_t y, uint16_t transparent);
+           // For a 16-bit Sprite pushed often with a transparent colour: list the opaque spans of its
+           // rows once, false if there is no memory, then pushSpans() sends only those, a window
+           // each. List them again after drawing in the Sprite. Other depths use pushSprite().
+  bool     createSpans(uint16_t transparent);
+  void     pushSpans(int32_t x, int32_t y);
 
            // Push a windowed area of the sprite to the TFT at tx, ty
   bool     pushSprite(int32_t tx, int32_t ty, int32_t sx, int32_t sy, int32_t sw, int32_t sh);
@@ -147,6 +230,9 @@ class TFT_eSprite : public TFT_eSPI {
   void     printToSprite(char *cbuffer, uint16_t len);
            // Print indexed glyph to sprite using loaded font at x,y
   int16_t  printToSprite(int16_t x, int16_t y, uint16_t index);
+           // 8-bit glyphs in a 1-bit sprite: ordered 4x4 dither of the coverage
+           // instead of the threshold the colours give
+  void     setGlyphDither(bool dither) { _glyphDither = dither; }
 
  private:
 
@@ -159,6 +245,29 @@ class TFT_eSprite : public TFT_eSPI {
   void     begin_nin_write(void) { ; }
   void     end_nin_write(void) { ; }
 
+           // Cached glyphs are copied into a 16-bit sprite's rows
+  bool     pushGlyph(int32_t xd, int32_t yd, int32_t w, int32_t h, const uint16_t *data);
+
+           // n source pixels of a pushRotated() row, stepped from fixed point xs, ys,
+           // in swapped (panel) byte order; one loop per colour depth
+  template <uint8_t BPP>
+  void     readRotated(uint16_t *out, int32_t xs, int32_t ys, int32_t n);
+  void     readRotated(uint16_t *out, int32_t xs, int32_t ys, int32_t n);
+           // pushRotated() line buffer for rows wider than the stack one, kept for reuse
+  uint16_t *rotatedLine(int32_t w);
+
+           // Turn the stored image into dst, clockwise by turns quarters
+  void     turnImage(const uint8_t *src, uint8_t *dst, uint8_t turns);
+
+           // pushToSprite() for the depth pairs with a row copy; false for the others
+  bool     blitTo(TFT_eSprite *dspr, int32_t x, int32_t y, bool keyed, uint16_t transp);
+
+  struct   DirtyRect { int16_t x, y, w, h; };
+           // Drawing functions call this with the area they wrote, after clipping
+  void     shadowMark(int32_t x, int32_t y, int32_t w, int32_t h) { if (_dirty) markDirty(x, y, w, h); }
+           // The setWindow() area, on the first pixel written to it
+  void     shadowMarkWindow(void) { _windowMarked = true; shadowMark(_xs, _ys, _xe - _xs + 1, _ye - _ys + 1); }
+
  protected:
 
   uint8_t  _bpp;     // bits per pixel (1, 4, 8 or 16)
@@ -174,6 +283,23 @@ class TFT_eSprite : public TFT_eSPI {
   int32_t  _cosra;   // Cosine of rotation angle in fixed point
 
   bool     _created; // A Sprite has been created and memory reserved
+
+  SpriteMemory _memPolicy = SPRITE_MEM_AUTO; // Requested placement
+  SpriteMemory _memPlaced = SPRITE_MEM_AUTO; // Placement of the created sprite
+  void*    _arena = nullptr;                 // Caller's buffer for SPRITE_MEM_ARENA
+  size_t   _arenaSize = 0;
+  bool     _glyphDither = false;             // See setGlyphDither()
+  uint16_t *_rotLine = nullptr;              // See rotatedLine()
+  int32_t  _rotLineSize = 0;
+  DirtyRect *_dirty = nullptr;               // Changed areas, a shadow Sprite only
+  uint8_t  _dirtyCount = 0;
+  uint8_t  _dirtyLast = 0;                   // Area grown last, checked first
+  bool     _windowMarked = true;             // setWindow() area is marked
+  uint16_t *_bounce = nullptr;               // flush() DMA buffers, taken on first use
+  uint16_t *_spans = nullptr;                // Opaque spans, see createSpans()
+  uint16_t _spansTransp = 0;
+  uint8_t  _backFrame = 1;                   // Frame drawn next in a swap chain
+  bool     _presenting = false;              // present() holds the bus for its DMA
   bool     _gFont = false; 
 
   int32_t  _xs, _ys, _xe, _ye, _xptr, _yptr; // for setWindow
@@ -15,6 +15,28 @@
   #define Z_THRESHOLD 350 // Touch pressure threshold for validating touches
 #endif
 
+#ifdef TOUCH_IRQ
+  #ifndef TOUCH_IRQ_SAMPLES
+    #define TOUCH_IRQ_SAMPLES 5 // Raw reads per getTouch() while the pen is down, odd for a true median
+  #endif
+  #ifndef TOUCH_IRQ_SMOOTHING
+    #define TOUCH_IRQ_SMOOTHING 2 // Each new position moves the filter 1/2^n of the way, 0 = no smoothing
+  #endif
+  #ifndef IRAM_ATTR
+    #define IRAM_ATTR
+  #endif
+
+// The controller pulls T_IRQ low while the pen is down, between conversions
+static volatile bool touchIrqSeen = false;
+static void (*touchIrqCallback)(void) = nullptr;
+
+static void IRAM_ATTR touchIrqHandler(void)
+{
+  touchIrqSeen = true;
+  if (touchIrqCallback) touchIrqCallback();
+}
+#endif
+
 /***************************************************************************************
 ** Function name:           begin_touch_read_write - was spi_begin_touch
 ** Description:             Start transaction and select touch controller
@@ -162,6 +184,55 @@ uint8_t TFT_eSPI::validTouch(uint16_t *x, uint16_t *y, uint16_t threshold){
   return true;
 }
   
+#ifdef TOUCH_IRQ
+/***************************************************************************************
+** Function name:           medianTouch
+** Description:             median of several raw positions. Return false if not pressed.
+***************************************************************************************/
+uint8_t TFT_eSPI::medianTouch(uint16_t *x, uint16_t *y, uint16_t threshold){
+  uint16_t xs[TOUCH_IRQ_SAMPLES], ys[TOUCH_IRQ_SAMPLES];
+  uint8_t count = 0;
+
+  // Each read is a transaction of its own, so display transfers can go in between
+  for (uint8_t n = 0; n < TOUCH_IRQ_SAMPLES; n++) {
+    if (getTouchRawZ() <= threshold) continue;
+    uint16_t x_tmp, y_tmp;
+    getTouchRaw(&x_tmp, &y_tmp);
+
+    // Insertion sort as they come
+    uint8_t i = count++;
+    while (i > 0 && xs[i - 1] > x_tmp) { xs[i] = xs[i - 1]; i--; }
+    xs[i] = x_tmp;
+    i = count - 1;
+    while (i > 0 && ys[i - 1] > y_tmp) { ys[i] = ys[i - 1]; i--; }
+    ys[i] = y_tmp;
+  }
+
+  // A majority of the reads must have been pressed, so the median is one of them
+  if (count <= TOUCH_IRQ_SAMPLES / 2) return false;
+
+  *x = xs[count / 2];
+  *y = ys[count / 2];
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           touchPending
+** Description:             pen is down or went down since the last getTouch()
+***************************************************************************************/
+bool TFT_eSPI::touchPending(void){
+  return touchIrqSeen || digitalRead(TOUCH_IRQ) == LOW;
+}
+
+/***************************************************************************************
+** Function name:           setTouchIrqCallback
+** Description:             function called from the pen interrupt
+***************************************************************************************/
+void TFT_eSPI::setTouchIrqCallback(void (*callback)(void)){
+  touchIrqCallback = callback;
+}
+#endif
+
 /***************************************************************************************
 ** Function name:           getTouch
 ** Description:             read callibrated position. Return false if not pressed. 
@@ -172,6 +243,26 @@ uint8_t TFT_eSPI::getTouch(uint16_t *x, uint16_t *y, uint16_t threshold){
   if (threshold<20) threshold = 20;
   if (_pressTime > millis()) threshold=20;
 
+#ifdef TOUCH_IRQ
+  // Pen up: nothing to read, and the bus stays with the display
+  touchIrqSeen = false;
+  if (digitalRead(TOUCH_IRQ) != LOW) { _pressTime = 0; _touchFiltered = false; return false; }
+
+  if (!medianTouch(&x_tmp, &y_tmp, threshold)) { _pressTime = 0; _touchFiltered = false; return false; }
+
+  // First-order low pass over successive calls of one press
+  if (!_touchFiltered) {
+    _touchFilterX = (uint32_t)x_tmp << 4;
+    _touchFilterY = (uint32_t)y_tmp << 4;
+    _touchFiltered = true;
+  } else {
+    _touchFilterX += (int32_t)(((uint32_t)x_tmp << 4) - _touchFilterX) >> TOUCH_IRQ_SMOOTHING;
+    _touchFilterY += (int32_t)(((uint32_t)y_tmp << 4) - _touchFilterY) >> TOUCH_IRQ_SMOOTHING;
+  }
+  x_tmp = (_touchFilterX + 8) >> 4;
+  y_tmp = (_touchFilterY + 8) >> 4;
+  uint8_t valid = 1;
+#else
   uint8_t n = 5;
   uint8_t valid = 0;
   while (n--)
@@ -180,6 +271,7 @@ uint8_t TFT_eSPI::getTouch(uint16_t *x, uint16_t *y, uint16_t threshold){
   }
 
   if (valid<1) { _pressTime = 0; return false; }
+#endif
   
   _pressTime = millis() + 50;
 
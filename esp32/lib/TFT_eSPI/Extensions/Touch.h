@@ -22,6 +22,17 @@
            // Set the screen calibration values
   void     setTouch(uint16_t *data);
 
+#ifdef TOUCH_IRQ
+           // With the controller's pen interrupt line on TOUCH_IRQ, getTouch() reads that pin first
+           // and leaves the SPI bus alone while the pen is up. While it is down the position is the
+           // median of TOUCH_IRQ_SAMPLES reads, smoothed from one call to the next.
+           // True while the pen is down, or went down since the last getTouch(); does not use the bus
+  bool     touchPending(void);
+           // Function called from the pen interrupt when the pen goes down, e.g. to wake a task
+           // that would otherwise have to poll getTouch()
+  void     setTouchIrqCallback(void (*callback)(void));
+#endif
+
  private:
            // Legacy support only - deprecated TODO: delete
   void     spi_begin_touch();
@@ -38,5 +49,12 @@
   uint16_t touchCalibration_x0 = 300, touchCalibration_x1 = 3600, touchCalibration_y0 = 300, touchCalibration_y1 = 3600;
   uint8_t  touchCalibration_rotate = 1, touchCalibration_invert_x = 2, touchCalibration_invert_y = 0;
 
+#ifdef TOUCH_IRQ
+           // Median filtered raw position, false when too few samples were pressed
+  uint8_t  medianTouch(uint16_t *x, uint16_t *y, uint16_t threshold);
+  uint32_t _touchFilterX, _touchFilterY; // Smoothed raw position, fixed point with 4 fraction bits
+  bool     _touchFiltered = false;       // Filter holds a position of the current press
+#endif
+
   uint32_t _pressTime;        // Press and hold time-out
   uint16_t _pressX, _pressY;  // For future use (last sampled calibrated coordinates)
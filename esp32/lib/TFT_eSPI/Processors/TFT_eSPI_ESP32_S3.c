@@ -29,7 +29,7 @@
   #endif
 #endif
 
-#ifdef ESP32_DMA
+#if defined (ESP32_DMA) && !defined (ESP32_LCD_CAM)
   // DMA SPA handle
   spi_device_handle_t dmaHAL;
   #ifdef CONFIG_IDF_TARGET_ESP32
@@ -157,6 +157,7 @@ void TFT_eSPI::gpioMode(uint8_t gpio, uint8_t mode)
 ***************************************************************************************/
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 {
+  TFT_STAT_PIXELS(len);
   uint8_t colorBin[] = { (uint8_t) (color >> 8), (uint8_t) color };
   if(len) spi.writePattern(&colorBin[0], 2, 1); len--;
   while(len--) {WR_L; WR_H;}
@@ -168,6 +169,7 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len)
 {
+  TFT_STAT_PIXELS(len);
   uint8_t *data = (uint8_t*)data_in;
 
   if(_swapBytes) {
@@ -189,6 +191,7 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len)
 ***************************************************************************************/
 /*
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+  TFT_STAT_PIXELS(len);
 
   uint32_t color32 = (color<<8 | color >>8)<<16 | (color<<8 | color >>8);
   bool empty = true;
@@ -236,6 +239,7 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
 //*/
 //*
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+  TFT_STAT_PIXELS(len);
 
   volatile uint32_t* spi_w = _spi_w;
   uint32_t color32 = (color<<8 | color >>8)<<16 | (color<<8 | color >>8);
@@ -372,6 +376,7 @@ void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
 ** Description:             Write a sequence of pixels
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+  TFT_STAT_PIXELS(len);
 
   if(_swapBytes) {
     pushSwapBytePixels(data_in, len);
@@ -429,12 +434,57 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 #elif defined (SPI_18BIT_DRIVER) // SPI 18-bit colour
 ////////////////////////////////////////////////////////////////////////////////////////
 
+/***************************************************************************************
+** Function name:           pack666
+** Description:             Expand 565 pixels to the 3 bytes per pixel of the panel
+***************************************************************************************/
+// native: the pixels are in processor byte order, else swapped as in a Sprite
+static inline void pack666(uint8_t* out, const uint16_t* data, uint32_t len, bool native)
+{
+  while (len--) {
+    uint16_t color = *data++;
+    if (!native) color = color << 8 | color >> 8;
+    *out++ = (color & 0xF800)>>8;
+    *out++ = (color & 0x07E0)>>3;
+    *out++ = (color & 0x001F)<<3;
+  }
+}
+
+/***************************************************************************************
+** Function name:           push666
+** Description:             Write pixels 20 at a time through the SPI data registers
+***************************************************************************************/
+// The next 20 are expanded while the last are still shifted out
+static void push666(const uint16_t* data, uint32_t len, bool native)
+{
+  uint32_t words[15]; // 60 bytes, W0 to W14
+
+  while (len) {
+    uint32_t count = len > 20 ? 20 : len;
+    pack666((uint8_t*)words, data, count, native);
+
+    while (READ_PERI_REG(SPI_CMD_REG(SPI_PORT))&SPI_USR);
+    WRITE_PERI_REG(SPI_MOSI_DLEN_REG(SPI_PORT), (count * 24) - 1);
+    for (uint32_t i = 0; i < (count * 3 + 3) >> 2; i++) WRITE_PERI_REG(SPI_W0_REG(SPI_PORT) + (i << 2), words[i]);
+#if CONFIG_IDF_TARGET_ESP32S3
+    SET_PERI_REG_MASK(SPI_CMD_REG(SPI_PORT), SPI_UPDATE);
+    while (READ_PERI_REG(SPI_CMD_REG(SPI_PORT))&SPI_UPDATE);
+#endif
+    SET_PERI_REG_MASK(SPI_CMD_REG(SPI_PORT), SPI_USR);
+
+    data += count;
+    len  -= count;
+  }
+  while (READ_PERI_REG(SPI_CMD_REG(SPI_PORT))&SPI_USR);
+}
+
 /***************************************************************************************
 ** Function name:           pushBlock - for ESP32 and 3 byte RGB display
 ** Description:             Write a block of pixels of the same colour
 ***************************************************************************************/
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 {
+  TFT_STAT_PIXELS(len);
   // Split out the colours
   uint32_t r = (color & 0xF800)>>8;
   uint32_t g = (color & 0x07E0)<<5;
@@ -511,11 +561,10 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 ** Description:             Write a sequence of pixels
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+  TFT_STAT_PIXELS(len);
 
-  uint16_t *data = (uint16_t*)data_in;
-  // ILI9488 write macro is not endianess dependant, hence !_swapBytes
-  if(!_swapBytes) { while ( len-- ) {tft_Write_16S(*data); data++;} }
-  else { while ( len-- ) {tft_Write_16(*data); data++;} }
+  // Not endianess dependant: only pixels with swapped bytes need !_swapBytes undone
+  push666((const uint16_t*)data_in, len, _swapBytes);
 }
 
 /***************************************************************************************
@@ -524,9 +573,8 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 ***************************************************************************************/
 void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
 
-  uint16_t *data = (uint16_t*)data_in;
-  // ILI9488 write macro is not endianess dependant, so swap byte macro not used here
-  while ( len-- ) {tft_Write_16(*data); data++;}
+  // Not endianess dependant, so the pixels go as they are
+  push666((const uint16_t*)data_in, len, true);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -538,6 +586,7 @@ void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
 ** Description:             Write a block of pixels of the same colour
 ***************************************************************************************/
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+  TFT_STAT_PIXELS(len);
   if ( (color >> 8) == (color & 0x00FF) )
   { if (!len) return;
     tft_Write_16(color);
@@ -551,7 +600,20 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
     #endif
   #endif
   }
-  else while (len--) {tft_Write_16(color);}
+  else {
+  #if defined (SSD1963_DRIVER) || defined (PSEUDO_16_BIT)
+    while (len--) {tft_Write_16(color);}
+  #else
+    // Look the bus patterns up once, then only strobe them out
+    uint32_t hi = set_mask((uint8_t) (color >> 8));
+    uint32_t lo = set_mask((uint8_t) (color >> 0));
+    #define PUSH_BLOCK_16 GPIO_CLR_REG = GPIO_OUT_CLR_MASK; GPIO_SET_REG = hi; WR_H; \
+                          GPIO_CLR_REG = GPIO_OUT_CLR_MASK; GPIO_SET_REG = lo; WR_H
+    while (len >= 4) { PUSH_BLOCK_16; PUSH_BLOCK_16; PUSH_BLOCK_16; PUSH_BLOCK_16; len -= 4; }
+    while (len--) { PUSH_BLOCK_16; }
+    #undef PUSH_BLOCK_16
+  #endif
+  }
 }
 
 /***************************************************************************************
@@ -569,6 +631,7 @@ void TFT_eSPI::pushSwapBytePixels(const void* data_in, uint32_t len){
 ** Description:             Write a sequence of pixels
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+  TFT_STAT_PIXELS(len);
 
   uint16_t *data = (uint16_t*)data_in;
   if(_swapBytes) { while ( len-- ) {tft_Write_16(*data); data++; } }
@@ -581,9 +644,219 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 
 
 ////////////////////////////////////////////////////////////////////////////////////////
-#if defined (ESP32_DMA) && !defined (TFT_PARALLEL_8_BIT) //       DMA FUNCTIONS
+#if defined (ESP32_DMA) //       DMA FUNCTIONS
+////////////////////////////////////////////////////////////////////////////////////////
+
+static uint8_t dmaTransNext = 0;
+// Start of the pushed pixels on the last segment of each push, or nullptr
+static const uint16_t* dmaTransDone[DMA_QUEUE_SIZE];
+
+static void (*dmaDoneCallback)(const uint16_t* data, void* arg) = nullptr;
+static void* dmaDoneArg = nullptr;
+
+// DMA_SWAP_SEGMENT pixels per descriptor for pushes with swapped colour bytes.
+// Neither the S3 SPI nor the LCD_CAM i80 bus swap bytes per transfer, so swapped pixels
+// are copied here segment by segment while earlier segments are sent, leaving the image
+// as is. 18-bit SPI panels have all their pixels expanded here, 3 bytes each.
+static uint16_t* dmaBounce = nullptr;
+#if defined (SPI_18BIT_DRIVER)
+  #define DMA_BOUNCE_BYTES 3
+#else
+  #define DMA_BOUNCE_BYTES 2
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////
+#if defined (ESP32_LCD_CAM) // 8-bit parallel through the LCD_CAM i80 bus and GDMA
+////////////////////////////////////////////////////////////////////////////////////////
+
+// The commands, reads and pixel writes of the rest of the library bit-bang the bus
+// through the GPIO registers. The bus pins are only switched over to the LCD_CAM
+// signals while pushes are in flight, and handed back once the last one is out, so
+// the peripheral drives WR and holds DC at data level during the push.
+static esp_lcd_i80_bus_handle_t lcdBus = nullptr;
+static esp_lcd_panel_io_handle_t lcdIo = nullptr;
+static bool lcdAttached = false;
+// Ring index of the oldest push in flight, moved on by the completion interrupt
+static volatile uint8_t dmaTransTail = 0;
+// Given once per finished transfer
+static SemaphoreHandle_t dmaDoneSem = nullptr;
+
+/***************************************************************************************
+** Function name:           lcdAttach
+** Description:             Route the bus pins to the LCD_CAM signals, or back to GPIO
+***************************************************************************************/
+static void lcdAttach(bool attach)
+{
+  if (attach == lcdAttached) return;
+
+  static const int8_t data[8] = { TFT_D0, TFT_D1, TFT_D2, TFT_D3, TFT_D4, TFT_D5, TFT_D6, TFT_D7 };
+  // WR idles high on both sides, so the switch strobes nothing in
+  for (uint8_t i = 0; i < 8; i++) {
+    esp_rom_gpio_connect_out_signal(data[i], attach ? lcd_periph_signals.buses[0].data_sigs[i] : SIG_GPIO_OUT_IDX, false, false);
+  }
+  esp_rom_gpio_connect_out_signal(TFT_WR, attach ? lcd_periph_signals.buses[0].wr_sig : SIG_GPIO_OUT_IDX, false, false);
+  esp_rom_gpio_connect_out_signal(TFT_DC, attach ? lcd_periph_signals.buses[0].dc_sig : SIG_GPIO_OUT_IDX, false, false);
+  lcdAttached = attach;
+}
+
+/***************************************************************************************
+** Function name:           lcd_trans_done
+** Description:             Completion interrupt of one transfer, tells the sketch
+***************************************************************************************/
+#if ESP_IDF_VERSION_MAJOR >= 5
+static bool IRAM_ATTR lcd_trans_done(esp_lcd_panel_io_handle_t io, esp_lcd_panel_io_event_data_t* event, void* ctx)
+#else
+static bool IRAM_ATTR lcd_trans_done(esp_lcd_panel_io_handle_t io, void* ctx, void* event)
+#endif
+{
+  // Transfers complete in the order they were queued
+  uint8_t tail = dmaTransTail;
+  const uint16_t* done = dmaTransDone[tail];
+  dmaTransTail = (tail + 1) % DMA_QUEUE_SIZE;
+  if (done && dmaDoneCallback) dmaDoneCallback(done, dmaDoneArg);
+
+  BaseType_t woken = pdFALSE;
+  xSemaphoreGiveFromISR(dmaDoneSem, &woken);
+  return woken == pdTRUE;
+}
+
+/***************************************************************************************
+** Function name:           queueDMA
+** Description:             Queue pixels in transfers, waiting only while the ring is full
+***************************************************************************************/
+// A transfer unswapped from the image is as long as the GDMA descriptor chain allows,
+// LCD_CAM_MAX_TRANSFER bytes, so frames beyond the 64 Kbyte SPI limit go out in one.
+static void queueDMA(const uint16_t* data, uint32_t len, uint8_t &inFlight, bool swap = false)
+{
+  const uint16_t* start = data;
+  uint32_t maxSegment = swap ? DMA_SWAP_SEGMENT : LCD_CAM_MAX_TRANSFER / 2;
+
+  lcdAttach(true);
+  while (len) {
+    uint32_t segment = len > maxSegment ? maxSegment : len;
+
+    if (inFlight >= DMA_QUEUE_SIZE) {
+      xSemaphoreTake(dmaDoneSem, portMAX_DELAY);
+      inFlight--;
+    }
+
+    const uint16_t* tx = data;
+    if (swap) {
+      uint16_t* bounce = dmaBounce + dmaTransNext * DMA_SWAP_SEGMENT;
+      for (uint32_t i = 0; i < segment; i++) bounce[i] = data[i] << 8 | data[i] >> 8;
+      tx = bounce;
+    }
+    dmaTransDone[dmaTransNext] = (segment == len) ? start : nullptr;
+    dmaTransNext = (dmaTransNext + 1) % DMA_QUEUE_SIZE;
+
+    // No command phase: the window and RAMWR went out from the CPU already
+  #if ESP_IDF_VERSION_MAJOR >= 5
+    esp_err_t ret = esp_lcd_panel_io_tx_color(lcdIo, -1, tx, segment * 2);
+  #else
+    esp_err_t ret = esp_lcd_panel_io_tx_color(lcdIo, 0, tx, segment * 2);
+  #endif
+    assert(ret == ESP_OK);
+    inFlight++;
+
+    data += segment;
+    len  -= segment;
+  }
+}
+
+/***************************************************************************************
+** Function name:           dmaBusy
+** Description:             Check if DMA is busy
+***************************************************************************************/
+bool TFT_eSPI::dmaBusy(void)
+{
+  if (!DMA_Enabled) return false;
+
+  while (spiBusyCheck && xSemaphoreTake(dmaDoneSem, 0) == pdTRUE) spiBusyCheck--;
+  if (spiBusyCheck) return true;
+
+  // The CPU may drive the bus again
+  lcdAttach(false);
+  return false;
+}
+
+
+/***************************************************************************************
+** Function name:           dmaWait
+** Description:             Wait until DMA is over (blocking!)
+***************************************************************************************/
+void TFT_eSPI::dmaWait(void)
+{
+  if (!DMA_Enabled) return;
+  while (spiBusyCheck) {
+    xSemaphoreTake(dmaDoneSem, portMAX_DELAY);
+    spiBusyCheck--;
+  }
+  lcdAttach(false);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+#else // SPI DMA
 ////////////////////////////////////////////////////////////////////////////////////////
 
+// Ring of transaction descriptors. The SPI driver completes transfers in the
+// order they were queued, so with fewer than DMA_QUEUE_SIZE in flight the next
+// descriptor is always free.
+static spi_transaction_t dmaTrans[DMA_QUEUE_SIZE];
+
+/***************************************************************************************
+** Function name:           queueDMA
+** Description:             Queue pixels in segments, waiting only while the ring is full
+***************************************************************************************/
+static void queueDMA(const uint16_t* data, uint32_t len, uint8_t &inFlight, bool swap = false)
+{
+  const uint16_t* start = data;
+#if defined (SPI_18BIT_DRIVER)
+  uint32_t maxSegment = DMA_SWAP_SEGMENT;
+#else
+  uint32_t maxSegment = swap ? DMA_SWAP_SEGMENT : DMA_SEGMENT;
+#endif
+
+  while (len) {
+    uint32_t segment = len > maxSegment ? maxSegment : len;
+
+    if (inFlight >= DMA_QUEUE_SIZE) {
+      spi_transaction_t *rtrans;
+      esp_err_t ret = spi_device_get_trans_result(dmaHAL, &rtrans, portMAX_DELAY);
+      assert(ret == ESP_OK);
+      inFlight--;
+    }
+
+    spi_transaction_t *trans = &dmaTrans[dmaTransNext];
+    const void* tx = data;
+#if defined (SPI_18BIT_DRIVER)
+    uint8_t* bounce = (uint8_t*)dmaBounce + dmaTransNext * DMA_SWAP_SEGMENT * 3;
+    pack666(bounce, data, segment, swap);
+    tx = bounce;
+#else
+    if (swap) {
+      uint16_t* bounce = dmaBounce + dmaTransNext * DMA_SWAP_SEGMENT;
+      for (uint32_t i = 0; i < segment; i++) bounce[i] = data[i] << 8 | data[i] >> 8;
+      tx = bounce;
+    }
+#endif
+    dmaTransDone[dmaTransNext] = (segment == len) ? start : nullptr;
+    dmaTransNext = (dmaTransNext + 1) % DMA_QUEUE_SIZE;
+
+    memset(trans, 0, sizeof(spi_transaction_t));
+    trans->user = (void *)1;
+    trans->tx_buffer = tx;         // Data pointer
+    trans->length = segment * DMA_BOUNCE_BYTES * 8; // Data length, in bits
+    trans->flags = 0;              // SPI_TRANS_USE_TXDATA flag
+
+    esp_err_t ret = spi_device_queue_trans(dmaHAL, trans, portMAX_DELAY);
+    assert(ret == ESP_OK);
+    inFlight++;
+
+    data += segment;
+    len  -= segment;
+  }
+}
+
 /***************************************************************************************
 ** Function name:           dmaBusy
 ** Description:             Check if DMA is busy
@@ -624,56 +897,46 @@ void TFT_eSPI::dmaWait(void)
   spiBusyCheck = 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////
+#endif // SPI DMA
+////////////////////////////////////////////////////////////////////////////////////////
+
 
 /***************************************************************************************
-** Function name:           pushPixelsDMA
-** Description:             Push pixels to TFT (len must be less than 32767)
+** Function name:           setDMACallback
+** Description:             Set the function told when the pixels of a push are out
 ***************************************************************************************/
-// This will byte swap the original image if setSwapBytes(true) was called by sketch.
-void TFT_eSPI::pushPixelsDMA(uint16_t* image, uint32_t len)
+void TFT_eSPI::setDMACallback(void (*callback)(const uint16_t* data, void* arg), void* arg)
 {
-  if ((len == 0) || (!DMA_Enabled)) return;
-
+  // Transfers in flight must not see the pointer and argument change halfway
   dmaWait();
+  dmaDoneArg = arg;
+  dmaDoneCallback = callback;
+}
 
-  if(_swapBytes) {
-    for (uint32_t i = 0; i < len; i++) (image[i] = image[i] << 8 | image[i] >> 8);
-  }
-
-  // DMA byte count for transmit is 64Kbytes maximum, so to avoid this constraint
-  // small transfers are performed using a blocking call until DMA capacity is reached.
-  // User sketch can prevent blocking by managing pixel count and splitting into blocks
-  // of 32768 pixels maximum. (equivalent to an area of ~320 x 100 pixels)
-  bool temp = _swapBytes;
-  _swapBytes = false;
-  while(len>0x4000) { // Transfer 16-bit pixels in blocks if len*2 over 65536 bytes
-    pushPixels(image, 0x400);
-    len -= 0x400; image+= 0x400; // Arbitrarily send 1K pixel blocks (2Kbytes)
-  }
-  _swapBytes = temp;
-
-  esp_err_t ret;
-  static spi_transaction_t trans;
-
-  memset(&trans, 0, sizeof(spi_transaction_t));
-
-  trans.user = (void *)1;
-  trans.tx_buffer = image;  //finally send the line data
-  trans.length = len * 16;        //Data length, in bits
-  trans.flags = 0;                //SPI_TRANS_USE_TXDATA flag
 
-  ret = spi_device_queue_trans(dmaHAL, &trans, portMAX_DELAY);
-  assert(ret == ESP_OK);
+/***************************************************************************************
+** Function name:           pushPixelsDMA
+** Description:             Push pixels to TFT
+***************************************************************************************/
+// Bytes are swapped on the way if setSwapBytes(true) was called by sketch, the image
+// itself is left as is. Transfers still in flight are not waited for, so consecutive
+// calls into one window queue up; the DMA byte count limit of 64Kbytes is met by
+// queuing DMA_SEGMENT pixels per transfer (LCD_CAM_MAX_TRANSFER bytes on the i80 bus).
+void TFT_eSPI::pushPixelsDMA(uint16_t* image, uint32_t len)
+{
+  if ((len == 0) || (!DMA_Enabled)) return;
 
-  spiBusyCheck++;
+  TFT_STAT_DMA(len);
+  queueDMA(image, len, spiBusyCheck, _swapBytes);
 }
 
 
 /***************************************************************************************
 ** Function name:           pushImageDMA
-** Description:             Push image to a window (w*h must be less than 65536)
+** Description:             Push image to a window
 ***************************************************************************************/
-// Fixed const data assumed, will NOT clip or swap bytes
+// Fixed const data assumed, will NOT clip, bytes are swapped on the way if setSwapBytes(true)
 void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t const* image)
 {
   if ((w == 0) || (h == 0) || (!DMA_Enabled)) return;
@@ -681,41 +944,19 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
   uint16_t *buffer = (uint16_t*)image;
   uint32_t len = w*h;
 
+  // The window is set by the CPU, so the pixels of the last window must be out first
   dmaWait();
 
   setAddrWindow(x, y, w, h);
-  // DMA byte count for transmit is 64Kbytes maximum, so to avoid this constraint
-  // small transfers are performed using a blocking call until DMA capacity is reached.
-  // User sketch can prevent blocking by managing pixel count and splitting into blocks
-  // of 32768 pixels maximum. (equivalent to an area of ~320 x 100 pixels)
-  bool temp = _swapBytes;
-  _swapBytes = false;
-  while(len>0x4000) { // Transfer 16-bit pixels in blocks if len*2 over 65536 bytes
-    pushPixels(buffer, 0x400);
-    len -= 0x400; buffer+= 0x400; // Arbitrarily send 1K pixel blocks (2Kbytes)
-  }
-  _swapBytes = temp;
-
-  esp_err_t ret;
-  static spi_transaction_t trans;
-
-  memset(&trans, 0, sizeof(spi_transaction_t));
-
-  trans.user = (void *)1;
-  trans.tx_buffer = buffer;   //Data pointer
-  trans.length = len * 16;   //Data length, in bits
-  trans.flags = 0;           //SPI_TRANS_USE_TXDATA flag
 
-  ret = spi_device_queue_trans(dmaHAL, &trans, portMAX_DELAY);
-  assert(ret == ESP_OK);
-
-  spiBusyCheck++;
+  TFT_STAT_DMA(len);
+  queueDMA(buffer, len, spiBusyCheck, _swapBytes);
 }
 
 
 /***************************************************************************************
 ** Function name:           pushImageDMA
-** Description:             Push image to a window (w*h must be less than 65536)
+** Description:             Push image to a window
 ***************************************************************************************/
 // This will clip and also swap bytes if setSwapBytes(true) was called by sketch
 void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* image, uint16_t* buffer)
@@ -736,6 +977,7 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
   if (dw < 1 || dh < 1) return;
 
   uint32_t len = dw*dh;
+  bool swap = false;
 
   if (buffer == nullptr) {
     buffer = image;
@@ -759,7 +1001,7 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
     }
   }
   // else, if a buffer pointer has been provided copy whole image to the buffer
-  else if (buffer != image || _swapBytes) {
+  else if (buffer != image) {
     if(_swapBytes) {
       for (uint32_t i = 0; i < len; i++) (buffer[i] = image[i] << 8 | image[i] >> 8);
     }
@@ -767,44 +1009,118 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
       memcpy(buffer, image, len*2);
     }
   }
+  // else, swap unclipped pixels on the way rather than in the image
+  else swap = _swapBytes;
 
   if (spiBusyCheck) dmaWait(); // In case we did not wait earlier
 
   setAddrWindow(x, y, dw, dh);
 
-  // DMA byte count for transmit is 64Kbytes maximum, so to avoid this constraint
-  // small transfers are performed using a blocking call until DMA capacity is reached.
-  // User sketch can prevent blocking by managing pixel count and splitting into blocks
-  // of 32768 pixels maximum. (equivalent to an area of ~320 x 100 pixels)
-  bool temp = _swapBytes;
-  _swapBytes = false;
-  while(len>0x4000) { // Transfer 16-bit pixels in blocks if len*2 over 65536 bytes
-    pushPixels(buffer, 0x400);
-    len -= 0x400; buffer+= 0x400; // Arbitrarily send 1K pixel blocks (2Kbytes)
-  }
-  _swapBytes = temp;
+  TFT_STAT_DMA(len);
+  queueDMA(buffer, len, spiBusyCheck, swap);
+}
 
-  esp_err_t ret;
-  static spi_transaction_t trans;
+////////////////////////////////////////////////////////////////////////////////////////
+// Processor specific DMA initialisation
+////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined (ESP32_LCD_CAM)
+/***************************************************************************************
+** Function name:           initDMA
+** Description:             Initialise the LCD_CAM i80 bus - returns true if init OK
+***************************************************************************************/
+// CS stays with the library (startWrite/endWrite), so ctrl_cs is not used
+bool TFT_eSPI::initDMA(bool ctrl_cs)
+{
+  if (DMA_Enabled) return false;
 
-  memset(&trans, 0, sizeof(spi_transaction_t));
+  if (dmaDoneSem == nullptr) {
+    dmaDoneSem = xSemaphoreCreateCounting(DMA_QUEUE_SIZE, 0);
+    if (dmaDoneSem == nullptr) return false;
+  }
+  if (dmaBounce == nullptr) {
+    dmaBounce = (uint16_t*)heap_caps_malloc(DMA_QUEUE_SIZE * DMA_SWAP_SEGMENT * DMA_BOUNCE_BYTES, MALLOC_CAP_DMA);
+    if (dmaBounce == nullptr) return false;
+  }
 
-  trans.user = (void *)1;
-  trans.tx_buffer = buffer;  //finally send the line data
-  trans.length = len * 16;   //Data length, in bits
-  trans.flags = 0;           //SPI_TRANS_USE_TXDATA flag
+  esp_lcd_i80_bus_config_t buscfg = {};
+  buscfg.dc_gpio_num = TFT_DC;
+  buscfg.wr_gpio_num = TFT_WR;
+  buscfg.data_gpio_nums[0] = TFT_D0;
+  buscfg.data_gpio_nums[1] = TFT_D1;
+  buscfg.data_gpio_nums[2] = TFT_D2;
+  buscfg.data_gpio_nums[3] = TFT_D3;
+  buscfg.data_gpio_nums[4] = TFT_D4;
+  buscfg.data_gpio_nums[5] = TFT_D5;
+  buscfg.data_gpio_nums[6] = TFT_D6;
+  buscfg.data_gpio_nums[7] = TFT_D7;
+  buscfg.bus_width = 8;
+  // Sizes the GDMA descriptor chain, 4092 bytes per descriptor
+  buscfg.max_transfer_bytes = LCD_CAM_MAX_TRANSFER;
+#if ESP_IDF_VERSION_MAJOR >= 5
+  buscfg.clk_src = LCD_CLK_SRC_DEFAULT;
+#endif
+  esp_err_t ret = esp_lcd_new_i80_bus(&buscfg, &lcdBus);
+  if (ret != ESP_OK) return false;
+
+  esp_lcd_panel_io_i80_config_t iocfg = {};
+  iocfg.cs_gpio_num = -1;
+  iocfg.pclk_hz = LCD_CAM_PCLK_HZ;
+  iocfg.trans_queue_depth = DMA_QUEUE_SIZE;
+  iocfg.on_color_trans_done = lcd_trans_done;
+  iocfg.user_ctx = nullptr;
+#if ESP_IDF_VERSION_MAJOR >= 5
+  iocfg.lcd_cmd_bits = 8;      // Unused, every transfer skips the command
+#else
+  iocfg.lcd_cmd_bits = 0;      // No command phase
+#endif
+  iocfg.lcd_param_bits = 8;
+  iocfg.dc_levels.dc_idle_level = 1;
+  iocfg.dc_levels.dc_cmd_level = 0;
+  iocfg.dc_levels.dc_dummy_level = 0;
+  iocfg.dc_levels.dc_data_level = 1;
+  ret = esp_lcd_new_panel_io_i80(lcdBus, &iocfg, &lcdIo);
+  if (ret != ESP_OK) {
+    esp_lcd_del_i80_bus(lcdBus);
+    lcdBus = nullptr;
+    return false;
+  }
 
-  ret = spi_device_queue_trans(dmaHAL, &trans, portMAX_DELAY);
-  assert(ret == ESP_OK);
+  // The bus driver took the pins; the library drives them until the first push
+  lcdAttached = true;
+  lcdAttach(false);
 
-  spiBusyCheck++;
+  DMA_Enabled = true;
+  spiBusyCheck = 0;
+  dmaTransNext = 0;
+  dmaTransTail = 0;
+  return true;
+}
+
+/***************************************************************************************
+** Function name:           deInitDMA
+** Description:             Release the LCD_CAM i80 bus
+***************************************************************************************/
+void TFT_eSPI::deInitDMA(void)
+{
+  if (!DMA_Enabled) return;
+  dmaWait();
+  esp_lcd_panel_io_del(lcdIo);
+  esp_lcd_del_i80_bus(lcdBus);
+  lcdIo = nullptr;
+  lcdBus = nullptr;
+  // Whatever the bus driver left on the pins, they go back to GPIO
+  lcdAttached = true;
+  lcdAttach(false);
+  heap_caps_free(dmaBounce);
+  dmaBounce = nullptr;
+  DMA_Enabled = false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
-// Processor specific DMA initialisation
+#else // SPI DMA
 ////////////////////////////////////////////////////////////////////////////////////////
 
-// The DMA functions here work with SPI only (not parallel)
 /***************************************************************************************
 ** Function name:           dc_callback
 ** Description:             Toggles DC line during transaction (not used)
@@ -819,13 +1135,16 @@ void IRAM_ATTR dc_callback(spi_transaction_t *spi_tx)
 
 /***************************************************************************************
 ** Function name:           dma_end_callback
-** Description:             Clear DMA run flag to stop retransmission loop
+** Description:             Clear DMA run flag to stop retransmission loop, tell the sketch
 ***************************************************************************************/
 extern "C" void dma_end_callback();
 
 void IRAM_ATTR dma_end_callback(spi_transaction_t *spi_tx)
 {
   WRITE_PERI_REG(SPI_DMA_CONF_REG(spi_host), 0);
+
+  const uint16_t* done = dmaTransDone[spi_tx - dmaTrans];
+  if (done && dmaDoneCallback) dmaDoneCallback(done, dmaDoneArg);
 }
 
 /***************************************************************************************
@@ -867,10 +1186,15 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
     .input_delay_ns = 0,
     .spics_io_num = pin,
     .flags = SPI_DEVICE_NO_DUMMY, //0,
-    .queue_size = 1,            // Not using queues
+    .queue_size = DMA_QUEUE_SIZE, // Transfers queued by queueDMA()
     .pre_cb = 0, //dc_callback, //Callback to handle D/C line (not used)
     .post_cb = dma_end_callback //Callback to end transmission
   };
+  if (dmaBounce == nullptr) {
+    dmaBounce = (uint16_t*)heap_caps_malloc(DMA_QUEUE_SIZE * DMA_SWAP_SEGMENT * DMA_BOUNCE_BYTES, MALLOC_CAP_DMA);
+    if (dmaBounce == nullptr) return false;
+  }
+
   ret = spi_bus_initialize(spi_host, &buscfg, DMA_CHANNEL);
   ESP_ERROR_CHECK(ret);
   ret = spi_bus_add_device(spi_host, &devcfg, &dmaHAL);
@@ -878,6 +1202,7 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
 
   DMA_Enabled = true;
   spiBusyCheck = 0;
+  dmaTransNext = 0;
   return true;
 }
 
@@ -888,11 +1213,18 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
 void TFT_eSPI::deInitDMA(void)
 {
   if (!DMA_Enabled) return;
+  dmaWait();
   spi_bus_remove_device(dmaHAL);
   spi_bus_free(spi_host);
+  heap_caps_free(dmaBounce);
+  dmaBounce = nullptr;
   DMA_Enabled = false;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////
+#endif // SPI DMA
+////////////////////////////////////////////////////////////////////////////////////////
+
 ////////////////////////////////////////////////////////////////////////////////////////
 #endif // End of DMA FUNCTIONS
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -13,6 +13,7 @@
 // Include processor specific header
 #include "soc/spi_reg.h"
 #include "driver/spi_master.h"
+#include "esp_heap_caps.h"
 #include "hal/gpio_ll.h"
 
 #if !defined(CONFIG_IDF_TARGET_ESP32S3) && !defined(CONFIG_IDF_TARGET_ESP32S2) && !defined(CONFIG_IDF_TARGET_ESP32)
@@ -107,7 +108,26 @@ SPI3_HOST = 2
   #endif
 #endif
 
-#if !defined(DISABLE_ALL_LIBRARY_WARNINGS) && defined (ESP32_PARALLEL)
+// 8-bit parallel pushes DMA through the LCD_CAM i80 bus, except for the 18-bit SSD1963
+// and one byte per pixel PSEUDO_16_BIT writes. TFT_NO_LCD_CAM keeps it off.
+#if defined (ESP32_PARALLEL) && !defined (SSD1963_DRIVER) && !defined (PSEUDO_16_BIT) && !defined (TFT_NO_LCD_CAM)
+  #define ESP32_LCD_CAM
+  #include "esp_lcd_panel_io.h"
+  #include "soc/lcd_periph.h"
+  #include "soc/gpio_sig_map.h"
+  #include "esp_rom_gpio.h"
+  #include "esp_idf_version.h"
+  // WR clock of pushes, 20 MHz suits most ILI9341/ST7789/ILI9488 panels
+  #ifndef LCD_CAM_PCLK_HZ
+    #define LCD_CAM_PCLK_HZ 20000000
+  #endif
+  // Largest transfer in bytes, one descriptor chain; a 320 x 480 frame by default
+  #ifndef LCD_CAM_MAX_TRANSFER
+    #define LCD_CAM_MAX_TRANSFER (320 * 480 * 2)
+  #endif
+#endif
+
+#if !defined(DISABLE_ALL_LIBRARY_WARNINGS) && defined (ESP32_PARALLEL) && !defined (ESP32_LCD_CAM)
  #warning >>>>------>> DMA is not supported in parallel mode
 #endif
 
@@ -132,10 +152,20 @@ SPI3_HOST = 2
 #endif
 
 // Code to check if DMA is busy, used by SPI bus transaction transaction and endWrite functions
-#if !defined(TFT_PARALLEL_8_BIT) && !defined(SPI_18BIT_DRIVER)
+// 18-bit SPI panels get every segment expanded to 3 bytes per pixel in a bounce buffer
+#if !defined(TFT_PARALLEL_8_BIT) || defined (ESP32_LCD_CAM)
   #define ESP32_DMA
   // Code to check if DMA is busy, used by SPI DMA + transaction + endWrite functions
   #define DMA_BUSY_CHECK  dmaWait()
+  // Number of DMA transfers that can be queued at once, each up to DMA_SEGMENT pixels
+  #ifndef DMA_QUEUE_SIZE
+    #define DMA_QUEUE_SIZE 4
+  #endif
+  #define DMA_SEGMENT 0x4000
+  // Pixels per transfer when colour bytes are swapped through a bounce buffer on the way
+  #ifndef DMA_SWAP_SEGMENT
+    #define DMA_SWAP_SEGMENT 1024
+  #endif
 #else
   #define DMA_BUSY_CHECK
 #endif
@@ -0,0 +1,311 @@
+        ////////////////////////////////////////////////////
+        //       TFT_eSPI host (PC) driver functions      //
+        ////////////////////////////////////////////////////
+
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Global variables
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Select the SPI port to use, only its transaction calls are made
+#ifdef TFT_SPI_PORT
+  SPIClass& spi = TFT_SPI_PORT;
+#else
+  SPIClass& spi = SPI;
+#endif
+
+#ifndef SPI_READ_FREQUENCY
+  #define SPI_READ_FREQUENCY SPI_FREQUENCY
+#endif
+
+// Bytes a pixel takes on the bus
+#if defined (SPI_18BIT_DRIVER)
+  #define HOST_PIXEL_BYTES 3
+#else
+  #define HOST_PIXEL_BYTES 2
+#endif
+
+// Bytes a pixel takes when read back, after the dummy byte
+#if defined (ST7796_DRIVER)
+  #define HOST_READ_BYTES 2
+#else
+  #define HOST_READ_BYTES 3
+#endif
+
+static uint16_t tft_host_fb[TFT_HOST_FB_WIDTH * TFT_HOST_FB_HEIGHT];
+
+// Controller state
+static struct
+{
+  bool     csHigh = true;
+  bool     data;
+  uint8_t  cmd;        // Last command byte
+  uint32_t arg;        // Data bytes since the command
+  uint16_t xs, xe, ys, ye;
+  uint16_t x, y;       // Memory access pointer
+  uint8_t  pix[3];     // Bytes of the pixel being written or read
+} hostBus;
+
+static tft_host_stats_t hostStats;
+
+/***************************************************************************************
+** Function name:           hostAdvance
+** Description:             Step the memory pointer through the window, wrapping at the end
+***************************************************************************************/
+static void hostAdvance(void)
+{
+  if (++hostBus.x > hostBus.xe) {
+    hostBus.x = hostBus.xs;
+    if (++hostBus.y > hostBus.ye) hostBus.y = hostBus.ys;
+  }
+}
+
+/***************************************************************************************
+** Function name:           hostStore
+** Description:             Store a pixel at the memory pointer
+***************************************************************************************/
+static void hostStore(uint16_t color)
+{
+  if (hostBus.x < TFT_HOST_FB_WIDTH && hostBus.y < TFT_HOST_FB_HEIGHT) {
+    tft_host_fb[hostBus.y * TFT_HOST_FB_WIDTH + hostBus.x] = color;
+    hostStats.pixels++;
+  }
+  else hostStats.clipped++;
+  hostAdvance();
+}
+
+/***************************************************************************************
+** Function name:           tft_host_cs
+** Description:             Chip select, a transaction starts when it goes low
+***************************************************************************************/
+void tft_host_cs(bool high)
+{
+  if (hostBus.csHigh && !high) hostStats.transactions++;
+  hostBus.csHigh = high;
+}
+
+/***************************************************************************************
+** Function name:           tft_host_dc
+** Description:             Data/command line
+***************************************************************************************/
+void tft_host_dc(bool data)
+{
+  hostBus.data = data;
+}
+
+/***************************************************************************************
+** Function name:           tft_host_write8
+** Description:             Decode a byte as the display controller would
+***************************************************************************************/
+void tft_host_write8(uint8_t b)
+{
+  if (!hostBus.data) {
+    hostStats.commands++;
+    hostBus.cmd = b;
+    hostBus.arg = 0;
+    if (b == TFT_RAMWR || b == TFT_RAMRD) {
+      hostStats.windows++;
+      hostBus.x = hostBus.xs;
+      hostBus.y = hostBus.ys;
+    }
+    return;
+  }
+
+  hostStats.dataBytes++;
+  uint32_t i = hostBus.arg++;
+
+  switch (hostBus.cmd) {
+    case TFT_CASET:
+      if      (i == 0) hostBus.xs = b << 8;
+      else if (i == 1) hostBus.xs |= b;
+      else if (i == 2) hostBus.xe = b << 8;
+      else if (i == 3) hostBus.xe |= b;
+      break;
+    case TFT_PASET:
+      if      (i == 0) hostBus.ys = b << 8;
+      else if (i == 1) hostBus.ys |= b;
+      else if (i == 2) hostBus.ye = b << 8;
+      else if (i == 3) hostBus.ye |= b;
+      break;
+    case TFT_RAMWR:
+      hostBus.pix[i % HOST_PIXEL_BYTES] = b;
+      if (i % HOST_PIXEL_BYTES == HOST_PIXEL_BYTES - 1) {
+#if defined (SPI_18BIT_DRIVER)
+        // Colour is in the top 6 bits of each byte, keep the 5/6/5 that 16-bit would send
+        hostStore(((hostBus.pix[0] & 0xF8) << 8) | ((hostBus.pix[1] & 0xFC) << 3) | (hostBus.pix[2] >> 3));
+#else
+        hostStore((hostBus.pix[0] << 8) | hostBus.pix[1]);
+#endif
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/***************************************************************************************
+** Function name:           tft_host_write16
+** Description:             Write a 16-bit value, most significant byte first
+***************************************************************************************/
+void tft_host_write16(uint16_t c)
+{
+#if defined (SPI_18BIT_DRIVER)
+  // Pixels are expanded to 18 bits, address and parameter words are not
+  if (hostBus.data && hostBus.cmd == TFT_RAMWR) {
+    tft_host_write8((c & 0xF800) >> 8);
+    tft_host_write8((c & 0x07E0) >> 3);
+    tft_host_write8((c & 0x001F) << 3);
+    return;
+  }
+#endif
+  tft_host_write8(c >> 8);
+  tft_host_write8(c);
+}
+
+/***************************************************************************************
+** Function name:           tft_host_read8
+** Description:             Read a byte, memory reads return the framebuffer
+***************************************************************************************/
+uint8_t tft_host_read8(void)
+{
+  hostStats.readBytes++;
+  if (hostBus.cmd != TFT_RAMRD) return 0;
+
+  // First byte is a dummy, as on the display
+  uint32_t i = hostBus.arg++;
+  if (i == 0) return 0;
+  i = (i - 1) % HOST_READ_BYTES;
+
+  if (i == 0) {
+    uint16_t color = 0;
+    if (hostBus.x < TFT_HOST_FB_WIDTH && hostBus.y < TFT_HOST_FB_HEIGHT)
+      color = tft_host_fb[hostBus.y * TFT_HOST_FB_WIDTH + hostBus.x];
+#if defined (ST7796_DRIVER)
+    hostBus.pix[0] = color >> 8;
+    hostBus.pix[1] = color;
+#elif defined (ST7735_DRIVER)
+    // Colour in the top 7 bits, shifted right one place
+    hostBus.pix[0] = (color & 0xF800) >> 9;
+    hostBus.pix[1] = (color & 0x07E0) >> 4;
+    hostBus.pix[2] = (color & 0x001F) << 2;
+#else
+    hostBus.pix[0] = (color & 0xF800) >> 8;
+    hostBus.pix[1] = (color & 0x07E0) >> 3;
+    hostBus.pix[2] = (color & 0x001F) << 3;
+#endif
+    hostAdvance();
+  }
+  return hostBus.pix[i];
+}
+
+/***************************************************************************************
+** Function name:           tft_host_framebuffer
+** Description:             The framebuffer, TFT_HOST_FB_WIDTH pixels a row
+***************************************************************************************/
+uint16_t* tft_host_framebuffer(void)
+{
+  return tft_host_fb;
+}
+
+/***************************************************************************************
+** Function name:           tft_host_stats
+** Description:             Bus traffic with the time it would take on the wire
+***************************************************************************************/
+tft_host_stats_t tft_host_stats(void)
+{
+  tft_host_stats_t s = hostStats;
+  s.busUs = (uint32_t)(((uint64_t)(s.commands + s.dataBytes) * 8000000 / SPI_FREQUENCY) +
+                       ((uint64_t)s.readBytes * 8000000 / SPI_READ_FREQUENCY));
+  return s;
+}
+
+/***************************************************************************************
+** Function name:           tft_host_reset_stats
+** Description:             Clear the bus counters, the framebuffer is left as it is
+***************************************************************************************/
+void tft_host_reset_stats(void)
+{
+  hostStats = tft_host_stats_t();
+}
+
+/***************************************************************************************
+** Function name:           tft_host_write_ppm
+** Description:             Save an area of the framebuffer as 24-bit binary PPM
+***************************************************************************************/
+bool tft_host_write_ppm(const char* path, int32_t x, int32_t y, int32_t w, int32_t h)
+{
+  if (x < 0 || y < 0 || w <= 0 || h <= 0 ||
+      x + w > TFT_HOST_FB_WIDTH || y + h > TFT_HOST_FB_HEIGHT) return false;
+
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+
+  fprintf(f, "P6\n%d %d\n255\n", (int)w, (int)h);
+  for (int32_t row = y; row < y + h; row++) {
+    for (int32_t col = x; col < x + w; col++) {
+      uint16_t c = tft_host_fb[row * TFT_HOST_FB_WIDTH + col];
+      // Replicate the top bits so white comes out as 255
+      uint8_t rgb[3] = {
+        (uint8_t)(((c >> 8) & 0xF8) | (c >> 13)),
+        (uint8_t)(((c >> 3) & 0xFC) | ((c >> 9) & 0x03)),
+        (uint8_t)(((c << 3) & 0xF8) | ((c >> 2) & 0x07))
+      };
+      fwrite(rgb, 1, 3, f);
+    }
+  }
+  return fclose(f) == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+#if defined (TFT_SDA_READ)
+////////////////////////////////////////////////////////////////////////////////////////
+
+/***************************************************************************************
+** Function name:           beginSDA
+** Description:             Nothing to switch, reads come from the model
+***************************************************************************************/
+void TFT_eSPI::begin_SDA_Read(void)
+{
+}
+
+/***************************************************************************************
+** Function name:           endSDA
+** Description:             Nothing to switch back
+***************************************************************************************/
+void TFT_eSPI::end_SDA_Read(void)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+#endif // #if defined (TFT_SDA_READ)
+////////////////////////////////////////////////////////////////////////////////////////
+
+/***************************************************************************************
+** Function name:           pushBlock - for host
+** Description:             Write a block of pixels of the same colour
+***************************************************************************************/
+void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+  TFT_STAT_PIXELS(len);
+
+  while ( len-- ) {tft_Write_16(color);}
+}
+
+/***************************************************************************************
+** Function name:           pushPixels - for host
+** Description:             Write a sequence of pixels
+***************************************************************************************/
+void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+  TFT_STAT_PIXELS(len);
+
+  uint16_t *data = (uint16_t*)data_in;
+
+  if (_swapBytes) while ( len-- ) {tft_Write_16(*data); data++;}
+  else while ( len-- ) {tft_Write_16S(*data); data++;}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+//                                DMA FUNCTIONS
+////////////////////////////////////////////////////////////////////////////////////////
+
+//                No DMA on the host, pixels are written by pushPixels()
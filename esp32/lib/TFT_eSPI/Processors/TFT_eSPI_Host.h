@@ -0,0 +1,163 @@
+        ////////////////////////////////////////////////////
+        //       TFT_eSPI host (PC) driver functions      //
+        ////////////////////////////////////////////////////
+
+// This is a driver for running TFT_eSPI off-target, selected with TFT_HOST defined.
+// Nothing is sent anywhere: the bytes the library would clock out on the SPI bus are
+// decoded as the display controller would decode them. Column/page address set and
+// memory write commands place the pixels in a framebuffer in memory, memory reads
+// return them, and every command and data byte is counted. Rendering changes can so
+// be benchmarked and checked against golden images on a PC, and their bus traffic
+// measured exactly rather than estimated as TFT_STATS does.
+//
+// The host has to provide Arduino.h, Print.h and SPI.h (any Arduino API emulation,
+// the SPIClass calls can all do nothing). Only the SPI interface is modelled, with
+// 16-bit or, for SPI_18BIT_DRIVER, 18-bit colour. Drivers with their own address
+// commands (ILI9225, SSD1351) and MADCTL rotation are not decoded: pixels land at
+// the addresses sent, which are the coordinates of the rotation in use plus any
+// CGRAM offset.
+
+#ifndef _TFT_eSPI_HOSTH_
+#define _TFT_eSPI_HOSTH_
+
+#if defined (TFT_PARALLEL_8_BIT) || defined (RPI_DISPLAY_TYPE)
+  #error TFT_HOST models SPI displays only
+#endif
+
+// Processor ID reported by getSetup()
+#define PROCESSOR_ID 0x0001
+
+// Framebuffer size. By default it holds the 240x320 memory of the common controllers,
+// CGRAM offsets included, or the display if larger, at any rotation. Pixels addressed
+// outside it are counted as clipped and dropped.
+#ifndef TFT_HOST_FB_WIDTH
+  #if (TFT_WIDTH) > 320 || (TFT_HEIGHT) > 320
+    #define TFT_HOST_FB_WIDTH ((TFT_WIDTH) > (TFT_HEIGHT) ? (TFT_WIDTH) : (TFT_HEIGHT))
+  #else
+    #define TFT_HOST_FB_WIDTH 320
+  #endif
+#endif
+#ifndef TFT_HOST_FB_HEIGHT
+  #define TFT_HOST_FB_HEIGHT TFT_HOST_FB_WIDTH
+#endif
+
+// Include processor specific header
+#include <type_traits>
+
+// Font and glyph tables hold pointers that are read with pgm_read_dword(), which on a
+// 64-bit PC would cut them short. Pointers are read at their full width instead, as
+// are untyped reads, which all index tables of pointers.
+template <typename T>
+inline typename std::conditional<std::is_pointer<T>::value, uintptr_t, uint32_t>::type
+tft_host_pgm_read_dword(const T* addr)
+{
+  return (typename std::conditional<std::is_pointer<T>::value, uintptr_t, uint32_t>::type)*addr;
+}
+inline uintptr_t tft_host_pgm_read_dword(const void* addr) { return *(const uintptr_t*)addr; }
+
+#undef  pgm_read_dword
+#define pgm_read_dword(addr) tft_host_pgm_read_dword(addr)
+
+// Bus traffic since the start or the last tft_host_reset_stats()
+typedef struct
+{
+uint32_t transactions; // Times CS was taken low
+uint32_t commands;     // Command bytes (DC low)
+uint32_t dataBytes;    // Parameter and pixel bytes written (DC high)
+uint32_t readBytes;    // Bytes read back
+uint32_t windows;      // Memory write and read commands, each starting a run of pixels
+uint32_t pixels;       // Pixels stored in the framebuffer
+uint32_t clipped;      // Pixels addressed outside the framebuffer
+uint32_t busUs;        // Time the bytes take on the wire at SPI_FREQUENCY
+} tft_host_stats_t;
+
+// Framebuffer of TFT_HOST_FB_WIDTH x TFT_HOST_FB_HEIGHT RGB565 pixels, row by row
+uint16_t*        tft_host_framebuffer(void);
+tft_host_stats_t tft_host_stats(void);
+void             tft_host_reset_stats(void);
+// Write an area of the framebuffer as a binary PPM (P6) image, false if it can't
+bool             tft_host_write_ppm(const char* path, int32_t x, int32_t y, int32_t w, int32_t h);
+
+// Bus model, called by the macros below
+void    tft_host_cs(bool high);
+void    tft_host_dc(bool data);
+void    tft_host_write8(uint8_t b);
+void    tft_host_write16(uint16_t c);
+uint8_t tft_host_read8(void);
+
+// Processor specific code used by SPI bus transaction startWrite and endWrite functions
+#define SET_BUS_WRITE_MODE // Not used
+#define SET_BUS_READ_MODE  // Not used
+
+// Code to check if DMA is busy, used by SPI bus transaction startWrite and endWrite functions
+#define DMA_BUSY_CHECK // Not used so leave blank
+
+// Writes complete at once
+#define SPI_BUSY_CHECK
+
+// To be safe, SUPPORT_TRANSACTIONS is assumed mandatory
+#if !defined (SUPPORT_TRANSACTIONS)
+  #define SUPPORT_TRANSACTIONS
+#endif
+
+// Initialise processor specific SPI functions, used by init()
+#define INIT_TFT_DATA_BUS
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Define the DC (TFT Data/Command or Register Select (RS))pin drive code
+////////////////////////////////////////////////////////////////////////////////////////
+#define DC_C tft_host_dc(false)
+#define DC_D tft_host_dc(true)
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Define the CS (TFT chip select) pin drive code
+////////////////////////////////////////////////////////////////////////////////////////
+#define CS_L tft_host_cs(false)
+#define CS_H tft_host_cs(true)
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Make sure TFT_RD is defined if not used to avoid an error message
+////////////////////////////////////////////////////////////////////////////////////////
+#ifndef TFT_RD
+  #define TFT_RD -1
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Define the touch screen chip select pin drive code
+////////////////////////////////////////////////////////////////////////////////////////
+#define T_CS_L // No touch controller on the host
+#define T_CS_H
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Make sure TFT_MISO is defined if not used to avoid an error message
+////////////////////////////////////////////////////////////////////////////////////////
+#ifndef TFT_MISO
+  #define TFT_MISO -1
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Macros to write commands/pixel colour data, 18-bit colour is expanded in the model
+////////////////////////////////////////////////////////////////////////////////////////
+#define tft_Write_8(C)   tft_host_write8(C)
+#define tft_Write_16(C)  tft_host_write16(C)
+#define tft_Write_16N(C) tft_host_write16(C)
+#define tft_Write_16S(C) tft_host_write16((uint16_t)(((C)>>8) | ((C)<<8)))
+
+#define tft_Write_32(C) \
+  tft_host_write16((uint16_t) ((C)>>16)); \
+  tft_host_write16((uint16_t) ((C)>>0))
+
+#define tft_Write_32C(C,D) \
+  tft_host_write16((uint16_t) (C)); \
+  tft_host_write16((uint16_t) (D))
+
+#define tft_Write_32D(C) \
+  tft_host_write16((uint16_t) (C)); \
+  tft_host_write16((uint16_t) (C))
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Macros to read from display
+////////////////////////////////////////////////////////////////////////////////////////
+#define tft_Read_8() tft_host_read8()
+
+#endif // Header end
@@ -70,6 +70,77 @@
 #ifdef RP2040_DMA
   int32_t            dma_tx_channel;
   dma_channel_config dma_tx_config;
+
+  #if !defined (RP2040_PIO_INTERFACE)
+    #define DMA_TX_TARGET &spi_get_hw(SPI_X)->dr
+  #else
+    #define DMA_TX_TARGET &tft_pio->txf[pio_sm]
+  #endif
+
+  // Ring of pushes for the channel. [dmaTail, dmaHead) are queued and dmaTail is the one
+  // being sent; the completion interrupt starts the next, so pushes go out back to back.
+  struct DmaTransfer {
+    const uint16_t*    data;
+    uint32_t           len;
+    dma_channel_config config; // With the byte swap, and read increment off for fills
+    bool               report; // Told to the callback once out
+  };
+  static DmaTransfer dmaRing[DMA_QUEUE_SIZE];
+  static volatile uint8_t dmaHead = 0;
+  static volatile uint8_t dmaTail = 0;
+
+  static void (*dmaDoneCallback)(const uint16_t* data, void* arg) = nullptr;
+  static void* dmaDoneArg = nullptr;
+
+  // Read by the DMA over and over for pushBlock()
+  static uint16_t dmaFillColor;
+
+/***************************************************************************************
+** Function name:           dma_done_irq
+** Description:             Start the next queued push, tell the sketch the last is out
+***************************************************************************************/
+static void dma_done_irq(void)
+{
+  if (!dma_channel_get_irq0_status(dma_tx_channel)) return; // Another channel's
+  dma_channel_acknowledge_irq0(dma_tx_channel);
+
+  const DmaTransfer &done = dmaRing[dmaTail];
+  const uint16_t* data = done.data;
+  bool report = done.report;
+
+  uint8_t tail = (dmaTail + 1) % DMA_QUEUE_SIZE;
+  dmaTail = tail;
+  if (tail != dmaHead) {
+    const DmaTransfer &next = dmaRing[tail];
+    dma_channel_configure(dma_tx_channel, &next.config, DMA_TX_TARGET, next.data, next.len, true);
+  }
+
+  if (report && dmaDoneCallback) dmaDoneCallback(data, dmaDoneArg);
+}
+
+/***************************************************************************************
+** Function name:           queueDMA
+** Description:             Queue a push, waiting only while the ring is full
+***************************************************************************************/
+static void queueDMA(const uint16_t* data, uint32_t len, bool bswap, bool increment, bool report)
+{
+  while ((dmaHead + 1) % DMA_QUEUE_SIZE == dmaTail) tight_loop_contents();
+
+  DmaTransfer &trans = dmaRing[dmaHead];
+  trans.data = data;
+  trans.len = len;
+  trans.report = report;
+  trans.config = dma_tx_config;
+  channel_config_set_bswap(&trans.config, bswap);
+  channel_config_set_read_increment(&trans.config, increment);
+
+  // The interrupt must not see the ring go idle between the check and the start
+  uint32_t save = save_and_disable_interrupts();
+  bool idle = (dmaHead == dmaTail);
+  dmaHead = (dmaHead + 1) % DMA_QUEUE_SIZE;
+  if (idle) dma_channel_configure(dma_tx_channel, &trans.config, DMA_TX_TARGET, data, len, true);
+  restore_interrupts(save);
+}
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -264,6 +335,7 @@ void pioinit(uint16_t clock_div, uint16_t fract_div) {
 // PIO handles pixel block fill writes
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 {
+  TFT_STAT_PIXELS(len);
 #if  defined (SPI_18BIT_DRIVER) || (defined (SSD1963_DRIVER) && defined (TFT_PARALLEL_8_BIT))
   uint32_t col = ((color & 0xF800)<<8) | ((color & 0x07E0)<<5) | ((color & 0x001F)<<3);
   if (len) {
@@ -286,6 +358,17 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 
 #else
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+  TFT_STAT_PIXELS(len);
+#ifdef RP2040_DMA
+  // Long fills are read by the DMA from one colour, without the CPU feeding the FIFO
+  if (DMA_Enabled && len >= DMA_FILL_MIN) {
+    dmaWait(); // The colour word is shared by all fills
+    dmaFillColor = color;
+    queueDMA(&dmaFillColor, len, false, false, false);
+    dmaWait();
+    return;
+  }
+#endif
 
   while (len > 4) {
     // 5 seems to be the optimum for maximum transfer rate
@@ -312,6 +395,7 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
 ** Description:             Write a sequence of pixels
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+  TFT_STAT_PIXELS(len);
 #if  defined (SPI_18BIT_DRIVER) || (defined (SSD1963_DRIVER) && defined (TFT_PARALLEL_8_BIT))
   uint16_t *data = (uint16_t*)data_in;
   if (_swapBytes) {
@@ -440,6 +524,7 @@ uint8_t TFT_eSPI::readByte(void)
 ** Description:             Write a block of pixels of the same colour
 ***************************************************************************************/
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+  TFT_STAT_PIXELS(len);
 
   if(len) { tft_Write_16(color); len--; }
   while(len--) {WR_L; WR_H;}
@@ -451,6 +536,7 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len)
 {
+  TFT_STAT_PIXELS(len);
   uint16_t *data = (uint16_t*)data_in;
 
   if (_swapBytes) while ( len-- ) {tft_Write_16S(*data); data++;}
@@ -467,6 +553,7 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len)
 ***************************************************************************************/
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 {
+  TFT_STAT_PIXELS(len);
   uint16_t r = (color & 0xF800)>>8;
   uint16_t g = (color & 0x07E0)>>3;
   uint16_t b = (color & 0x001F)<<3;
@@ -499,6 +586,7 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len)
 ** Description:             Write a sequence of pixels
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+  TFT_STAT_PIXELS(len);
 
   uint16_t *data = (uint16_t*)data_in;
   if (_swapBytes) {
@@ -524,6 +612,18 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 ** Description:             Write a block of pixels of the same colour
 ***************************************************************************************/
 void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
+  TFT_STAT_PIXELS(len);
+#ifdef RP2040_DMA
+  // Long fills are read by the DMA from one colour, without the CPU feeding the FIFO
+  if (DMA_Enabled && len >= DMA_FILL_MIN) {
+    dmaWait(); // The colour word is shared by all fills
+    dmaFillColor = color;
+    queueDMA(&dmaFillColor, len, false, false, false);
+    dmaWait();
+    return;
+  }
+#endif
+
   while(len--)
   {
     while (!spi_is_writable(SPI_X)){};
@@ -536,6 +636,7 @@ void TFT_eSPI::pushBlock(uint16_t color, uint32_t len){
 ** Description:             Write a sequence of pixels
 ***************************************************************************************/
 void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
+  TFT_STAT_PIXELS(len);
   uint16_t *data = (uint16_t*)data_in;
   if (_swapBytes) {
     while(len--)
@@ -565,9 +666,10 @@ void TFT_eSPI::pushPixels(const void* data_in, uint32_t len){
 #ifdef RP2040_DMA // DMA functions for 16-bit SPI and 8/16-bit parallel displays
 ////////////////////////////////////////////////////////////////////////////////////////
 /*
-These are created in header file:
+These are created at the top of this file:
   uint32_t           dma_tx_channel;
   dma_channel_config dma_tx_config;
+  the ring of queued pushes, queueDMA() and its completion interrupt
 */
 
 /***************************************************************************************
@@ -577,7 +679,7 @@ These are created in header file:
 bool TFT_eSPI::dmaBusy(void) {
   if (!DMA_Enabled) return false;
 
-  if (dma_channel_is_busy(dma_tx_channel)) return true;
+  if (dmaHead != dmaTail || dma_channel_is_busy(dma_tx_channel)) return true;
 
 #if !defined (RP2040_PIO_INTERFACE)
   // For SPI must also wait for FIFO to flush and reset format
@@ -594,7 +696,8 @@ bool TFT_eSPI::dmaBusy(void) {
 ***************************************************************************************/
 void TFT_eSPI::dmaWait(void)
 {
-  while (dma_channel_is_busy(dma_tx_channel));
+  // The queue empties from the interrupt, after the channel goes idle
+  while (dmaHead != dmaTail || dma_channel_is_busy(dma_tx_channel)) tight_loop_contents();
 
 #if !defined (RP2040_PIO_INTERFACE)
   // For SPI must also wait for FIFO to flush and reset format
@@ -607,19 +710,14 @@ void TFT_eSPI::dmaWait(void)
 ** Function name:           pushPixelsDMA
 ** Description:             Push pixels to TFT
 ***************************************************************************************/
+// Transfers still in flight are not waited for, so consecutive calls into one window
+// queue up, DMA_QUEUE_SIZE - 1 at most
 void TFT_eSPI::pushPixelsDMA(uint16_t* image, uint32_t len)
 {
   if ((len == 0) || (!DMA_Enabled)) return;
 
-  dmaWait();
-
-  channel_config_set_bswap(&dma_tx_config, !_swapBytes);
-
-#if !defined (RP2040_PIO_INTERFACE)
-  dma_channel_configure(dma_tx_channel, &dma_tx_config, &spi_get_hw(SPI_X)->dr, (uint16_t*)image, len, true);
-#else
-  dma_channel_configure(dma_tx_channel, &dma_tx_config, &tft_pio->txf[pio_sm], (uint16_t*)image, len, true);
-#endif
+  TFT_STAT_DMA(len);
+  queueDMA(image, len, !_swapBytes, true, true);
 }
 
 /***************************************************************************************
@@ -662,17 +760,25 @@ void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t
     memcpy(buffer, image, len*2);
   }
 
-  dmaWait(); // In case we did not wait earlier
+  // The window is set by the CPU, so the pixels of the last window must be out first
+  dmaWait();
 
   setAddrWindow(x, y, dw, dh);
 
-  channel_config_set_bswap(&dma_tx_config, !_swapBytes);
+  TFT_STAT_DMA(len);
+  queueDMA(buffer, len, !_swapBytes, true, true);
+}
 
-#if !defined (RP2040_PIO_INTERFACE)
-  dma_channel_configure(dma_tx_channel, &dma_tx_config, &spi_get_hw(SPI_X)->dr, (uint16_t*)buffer, len, true);
-#else
-  dma_channel_configure(dma_tx_channel, &dma_tx_config, &tft_pio->txf[pio_sm], (uint16_t*)buffer, len, true);
-#endif
+/***************************************************************************************
+** Function name:           setDMACallback
+** Description:             Set the function told when the pixels of a push are out
+***************************************************************************************/
+void TFT_eSPI::setDMACallback(void (*callback)(const uint16_t* data, void* arg), void* arg)
+{
+  // Transfers in flight must not see the pointer and argument change halfway
+  dmaWait();
+  dmaDoneArg = arg;
+  dmaDoneCallback = callback;
 }
 
 /***************************************************************************************
@@ -698,6 +804,12 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
   channel_config_set_dreq(&dma_tx_config, pio_get_dreq(tft_pio, pio_sm, true));
 #endif
 
+  // On the core that calls this, next to any other users of DMA_IRQ_0
+  dmaHead = dmaTail = 0;
+  dma_channel_set_irq0_enabled(dma_tx_channel, true);
+  irq_add_shared_handler(DMA_IRQ_0, dma_done_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_0, true);
+
   DMA_Enabled = true;
   return true;
 }
@@ -709,6 +821,9 @@ bool TFT_eSPI::initDMA(bool ctrl_cs)
 void TFT_eSPI::deInitDMA(void)
 {
   if (!DMA_Enabled) return;
+  dmaWait();
+  dma_channel_set_irq0_enabled(dma_tx_channel, false);
+  irq_remove_handler(DMA_IRQ_0, dma_done_irq);
   dma_channel_unclaim(dma_tx_channel);
   DMA_Enabled = false;
 }
@@ -61,6 +61,16 @@
   #define RP2040_DMA
   // Code to check if DMA is busy, used by SPI DMA + transaction + endWrite functions
   #define DMA_BUSY_CHECK dmaWait()
+  // Pushes that can be queued at once, started one after the other from the DMA interrupt
+  #ifndef DMA_QUEUE_SIZE
+    #define DMA_QUEUE_SIZE 8
+  #endif
+  // Shorter pushBlock() fills are fed by the CPU, setting up the DMA would cost more
+  #ifndef DMA_FILL_MIN
+    #define DMA_FILL_MIN 64
+  #endif
+  #include "hardware/irq.h"
+  #include "hardware/sync.h"
 #else
   #define DMA_BUSY_CHECK
 #endif
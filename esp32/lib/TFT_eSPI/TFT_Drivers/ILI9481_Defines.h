@@ -26,6 +26,9 @@
 #define TFT_RAMWR   0x2C
 
 #define TFT_RAMRD   0x2E
+#define TFT_VSCRDEF 0x33 // Vertical scrolling definition
+#define TFT_VSCRSADD 0x37 // Vertical scrolling start address
+#define TFT_SCROLL_LINES 480 // Frame memory rows the scrolling area is set in
 
 #define TFT_MADCTL  0x36
 
@@ -67,6 +67,9 @@
 #define TFT_RAMWR   0x2C
 #define TFT_RAMRD   0x2E
 #define TFT_MADCTL  0x36
+#define TFT_VSCRDEF 0x33 // Vertical scrolling definition
+#define TFT_VSCRSADD 0x37 // Vertical scrolling start address
+#define TFT_SCROLL_LINES 320 // Frame memory rows, more than shorter panels show
 #define TFT_COLMOD  0x3A
 
 // Flags for TFT_MADCTL
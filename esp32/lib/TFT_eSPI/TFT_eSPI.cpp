@@ -15,7 +15,9 @@
 
 #include "TFT_eSPI.h"
 
-#if defined (ESP32)
+#if defined (TFT_HOST)
+  #include "Processors/TFT_eSPI_Host.c" // Framebuffer in memory, for PC builds
+#elif defined (ESP32)
   #if defined(CONFIG_IDF_TARGET_ESP32S3)
     #include "Processors/TFT_eSPI_ESP32_S3.c" // Tested with SPI and 8-bit parallel
   #elif defined(CONFIG_IDF_TARGET_ESP32C3)
@@ -79,6 +81,10 @@ inline void TFT_eSPI::begin_tft_write(void){
 #endif
     CS_L;
     SET_BUS_WRITE_MODE;  // Some processors (e.g. ESP32) allow recycling the tx buffer when rx is not used
+#ifdef TFT_STATS
+    _stats.transactions++;
+    _statsStart = micros();
+#endif
   }
 }
 
@@ -91,6 +97,10 @@ void TFT_eSPI::begin_nin_write(void){
 #endif
     CS_L;
     SET_BUS_WRITE_MODE;  // Some processors (e.g. ESP32) allow recycling the tx buffer when rx is not used
+#ifdef TFT_STATS
+    _stats.transactions++;
+    _statsStart = micros();
+#endif
   }
 }
 
@@ -105,6 +115,9 @@ inline void TFT_eSPI::end_tft_write(void){
       SPI_BUSY_CHECK;       // Check send complete and clean out unused rx data
       CS_H;
       SET_BUS_READ_MODE;    // In case bus has been configured for tx only
+#ifdef TFT_STATS
+      _stats.heldUs += micros() - _statsStart;
+#endif
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
       spi.endTransaction();
 #endif
@@ -120,6 +133,9 @@ inline void TFT_eSPI::end_nin_write(void){
       SPI_BUSY_CHECK;       // Check send complete and clean out unused rx data
       CS_H;
       SET_BUS_READ_MODE;    // In case SPI has been configured for tx only
+#ifdef TFT_STATS
+      _stats.heldUs += micros() - _statsStart;
+#endif
 #if defined (SPI_HAS_TRANSACTION) && defined (SUPPORT_TRANSACTIONS) && !defined(TFT_PARALLEL_8_BIT) && !defined(RP2040_PIO_INTERFACE)
       spi.endTransaction();
 #endif
@@ -462,6 +478,15 @@ TFT_eSPI::TFT_eSPI(int16_t w, int16_t h)
 
   _swapBytes = false;   // Do not swap colour bytes by default
 
+  _glyphs     = nullptr; // Glyph cache off until setGlyphCache()
+  _glyphBytes = 0;
+  _glyphLimit = 0;
+  _glyphPsram = false;
+
+#ifdef TFT_STATS
+  resetStats();
+#endif
+
   locked = true;           // Transaction mutex lock flag to ensure begin/endTranaction pairing
   inTransaction = false;   // Flag to prevent multiple sequential functions to keep bus access open
   lockTransaction = false; // start/endWrite lock flag to allow sketch to keep SPI bus access open
@@ -526,6 +551,10 @@ TFT_eSPI::TFT_eSPI(int16_t w, int16_t h)
 #endif
 }
 
+#if defined (TOUCH_CS) && defined (TOUCH_IRQ)
+  static void touchIrqHandler(void); // In Extensions/Touch.cpp
+#endif
+
 /***************************************************************************************
 ** Function name:           initBus
 ** Description:             initialise the SPI or parallel bus
@@ -547,6 +576,14 @@ void TFT_eSPI::initBus(void) {
   }
 #endif
 
+// Pen interrupt of the touch controller, open drain
+#if defined (TOUCH_CS) && defined (TOUCH_IRQ)
+  if (TOUCH_IRQ >= 0) {
+    pinMode(TOUCH_IRQ, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(TOUCH_IRQ), touchIrqHandler, FALLING);
+  }
+#endif
+
 // In parallel mode and with the RP2040 processor, the TFT_WR line is handled in the  PIO
 #if defined (TFT_WR) && !defined (ARDUINO_ARCH_RP2040) && !defined (ARDUINO_ARCH_MBED)
   if (TFT_WR >= 0) {
@@ -1616,6 +1653,26 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint1
   end_tft_write();
 }
 
+// 332 colours of 8 bit images and Sprites expanded to 565, in panel byte order
+static const uint16_t *rgb332Lut(void)
+{
+  static uint16_t lut[256];
+  static bool ready = false;
+
+  if (!ready) {
+    uint8_t  blue[] = {0, 11, 21, 31}; // blue 2 to 5-bit colour lookup table
+    for (uint32_t color = 0; color < 256; color++) {
+      //               =====Green=====     ===============Red==============
+      uint8_t msb = (color & 0x1C)>>2 | (color & 0xC0)>>3 | (color & 0xE0);
+      //               =====Green=====    =======Blue======
+      uint8_t lsb = (color & 0x1C)<<3 | blue[color & 0x03];
+      lut[color] = lsb << 8 | msb;
+    }
+    ready = true;
+  }
+  return lut;
+}
+
 /***************************************************************************************
 ** Function name:           pushImage
 ** Description:             plot 8-bit or 4-bit or 1 bit image or sprite using a line buffer
@@ -1630,103 +1687,75 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint8
 
   setWindow(x, y, x + dw - 1, y + dh - 1); // Sets CS low and sent RAMWR
 
-  // Line buffer makes plotting faster
-  uint16_t  lineBuf[dw];
-
-  if (bpp8)
+  if (bpp8 || cmap != nullptr)
   {
+    // Rows are expanded by table into colours in panel byte order
     _swapBytes = false;
 
-    uint8_t  blue[] = {0, 11, 21, 31}; // blue 2 to 5-bit colour lookup table
+    // A 4 bit row is expanded from the byte holding its first pixel, in pairs
+    int32_t first = 0;
+    uint32_t pairs[bpp8 ? 1 : 256];
+    const uint16_t *lut = nullptr;
 
-    _lastColor = -1; // Set to illegal value
-
-    // Used to store last shifted colour
-    uint8_t msbColor = 0;
-    uint8_t lsbColor = 0;
-
-    data += dx + dy * w;
-    while (dh--) {
-      uint32_t len = dw;
-      uint8_t* ptr = (uint8_t*)data;
-      uint8_t* linePtr = (uint8_t*)lineBuf;
-
-      while(len--) {
-        uint32_t color = pgm_read_byte(ptr++);
-
-        // Shifts are slow so check if colour has changed first
-        if (color != _lastColor) {
-          //          =====Green=====     ===============Red==============
-          msbColor = (color & 0x1C)>>2 | (color & 0xC0)>>3 | (color & 0xE0);
-          //          =====Green=====    =======Blue======
-          lsbColor = (color & 0x1C)<<3 | blue[color & 0x03];
-          _lastColor = color;
-        }
-
-       *linePtr++ = msbColor;
-       *linePtr++ = lsbColor;
-      }
-
-      pushPixels(lineBuf, dw);
-
-      data += w;
-    }
-    _swapBytes = swap; // Restore old value
-  }
-  else if (cmap != nullptr) // Must be 4bpp
-  {
-    _swapBytes = true;
-
-    w = (w+1) & 0xFFFE;   // if this is a sprite, w will already be even; this does no harm.
-    bool splitFirst = (dx & 0x01) != 0; // split first means we have to push a single px from the left of the sprite / image
-
-    if (splitFirst) {
-      data += ((dx - 1 + dy * w) >> 1);
+    if (bpp8) {
+      lut = rgb332Lut();
+      data += dx + dy * w;
     }
     else {
-      data += ((dx + dy * w) >> 1);
+      for (uint32_t i = 0; i < 256; i++) {
+        uint16_t hi = cmap[i >> 4], lo = cmap[i & 0x0F];
+        pairs[i] = (uint16_t)(hi >> 8 | hi << 8) | (uint32_t)(uint16_t)(lo >> 8 | lo << 8) << 16;
+      }
+      w = (w+1) & 0xFFFE;   // if this is a sprite, w will already be even; this does no harm.
+      first = dx & 1;
+      data += (dx - first + dy * w) >> 1;
     }
+    int32_t stride = bpp8 ? w : w >> 1;
+    int32_t count  = bpp8 ? dw : (first + dw + 1) >> 1;
+
+    // With DMA a row is expanded while the one before goes out, from two line buffers
+    // in 32 bit words, aligned for the DMA. It must start on a word, so 4 bit images
+    // clipped to an odd first column are sent by the CPU.
+    bool dma = false;
+#ifdef ESP32_DMA
+    dma = DMA_Enabled && !first;
+#endif
+    int32_t words = (dw + 2) >> 1;
+    uint32_t lineBuf[dma ? 2 * words : words];
 
-    while (dh--) {
-      uint32_t len = dw;
-      uint8_t * ptr = (uint8_t*)data;
-      uint16_t *linePtr = lineBuf;
-      uint8_t colors; // two colors in one byte
-      uint16_t index;
+    for (int32_t j = 0; j < dh; j++) {
+      uint32_t *buf = lineBuf + ((dma && (j & 1)) ? words : 0);
 
-      if (splitFirst) {
-        colors = pgm_read_byte(ptr);
-        index = (colors & 0x0F);
-        *linePtr++ = cmap[index];
-        len--;
-        ptr++;
+      if (bpp8) {
+        uint16_t *out = (uint16_t*)buf;
+        for (int32_t i = 0; i < count; i++) out[i] = lut[pgm_read_byte(data + i)];
       }
-
-      while (len--)
-      {
-        colors = pgm_read_byte(ptr);
-        index = ((colors & 0xF0) >> 4) & 0x0F;
-        *linePtr++ = cmap[index];
-
-        if (len--)
-        {
-          index = colors & 0x0F;
-          *linePtr++ = cmap[index];
-        } else {
-          break;  // nothing to do here
-        }
-
-        ptr++;
+      else {
+        for (int32_t i = 0; i < count; i++) buf[i] = pairs[pgm_read_byte(data + i)];
       }
+      data += stride;
 
-      pushPixels(lineBuf, dw);
-      data += (w >> 1);
+#ifdef ESP32_DMA
+      if (dma) {
+        dmaWait(); // The row before, sent from the other buffer
+        pushPixelsDMA((uint16_t*)buf, dw);
+        continue;
+      }
+#endif
+      pushPixels((uint16_t*)buf + first, dw);
     }
-    _swapBytes = swap; // Restore old value
+
+#ifdef ESP32_DMA
+    if (dma) dmaWait();
+#endif
   }
   else // Must be 1bpp
   {
     _swapBytes = false;
+
+    // Line buffer makes plotting faster
+    uint16_t  lineBuf[dw];
+
     uint8_t * ptr = (uint8_t*)data;
     uint32_t ww =  (w+7)>>3; // Width of source image line in bytes
     for (int32_t yp = dy;  yp < dy + dh; yp++)
@@ -1755,130 +1784,8 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint8
 ***************************************************************************************/
 void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t *data, bool bpp8,  uint16_t *cmap)
 {
-  PI_CLIP;
-
-  begin_tft_write();
-  inTransaction = true;
-  bool swap = _swapBytes;
-
-  setWindow(x, y, x + dw - 1, y + dh - 1); // Sets CS low and sent RAMWR
-
-  // Line buffer makes plotting faster
-  uint16_t  lineBuf[dw];
-
-  if (bpp8)
-  {
-    _swapBytes = false;
-
-    uint8_t  blue[] = {0, 11, 21, 31}; // blue 2 to 5-bit colour lookup table
-
-    _lastColor = -1; // Set to illegal value
-
-    // Used to store last shifted colour
-    uint8_t msbColor = 0;
-    uint8_t lsbColor = 0;
-
-    data += dx + dy * w;
-    while (dh--) {
-      uint32_t len = dw;
-      uint8_t* ptr = data;
-      uint8_t* linePtr = (uint8_t*)lineBuf;
-
-      while(len--) {
-        uint32_t color = *ptr++;
-
-        // Shifts are slow so check if colour has changed first
-        if (color != _lastColor) {
-          //          =====Green=====     ===============Red==============
-          msbColor = (color & 0x1C)>>2 | (color & 0xC0)>>3 | (color & 0xE0);
-          //          =====Green=====    =======Blue======
-          lsbColor = (color & 0x1C)<<3 | blue[color & 0x03];
-          _lastColor = color;
-        }
-
-       *linePtr++ = msbColor;
-       *linePtr++ = lsbColor;
-      }
-
-      pushPixels(lineBuf, dw);
-
-      data += w;
-    }
-    _swapBytes = swap; // Restore old value
-  }
-  else if (cmap != nullptr) // Must be 4bpp
-  {
-    _swapBytes = true;
-
-    w = (w+1) & 0xFFFE;   // if this is a sprite, w will already be even; this does no harm.
-    bool splitFirst = (dx & 0x01) != 0; // split first means we have to push a single px from the left of the sprite / image
-
-    if (splitFirst) {
-      data += ((dx - 1 + dy * w) >> 1);
-    }
-    else {
-      data += ((dx + dy * w) >> 1);
-    }
-
-    while (dh--) {
-      uint32_t len = dw;
-      uint8_t * ptr = data;
-      uint16_t *linePtr = lineBuf;
-      uint8_t colors; // two colors in one byte
-      uint16_t index;
-
-      if (splitFirst) {
-        colors = *ptr;
-        index = (colors & 0x0F);
-        *linePtr++ = cmap[index];
-        len--;
-        ptr++;
-      }
-
-      while (len--)
-      {
-        colors = *ptr;
-        index = ((colors & 0xF0) >> 4) & 0x0F;
-        *linePtr++ = cmap[index];
-
-        if (len--)
-        {
-          index = colors & 0x0F;
-          *linePtr++ = cmap[index];
-        } else {
-          break;  // nothing to do here
-        }
-
-        ptr++;
-      }
-
-      pushPixels(lineBuf, dw);
-      data += (w >> 1);
-    }
-    _swapBytes = swap; // Restore old value
-  }
-  else // Must be 1bpp
-  {
-    _swapBytes = false;
-
-    uint32_t ww =  (w+7)>>3; // Width of source image line in bytes
-    for (int32_t yp = dy;  yp < dy + dh; yp++)
-    {
-      uint8_t* linePtr = (uint8_t*)lineBuf;
-      for (int32_t xp = dx; xp < dx + dw; xp++)
-      {
-        uint16_t col = (data[(xp>>3)] & (0x80 >> (xp & 0x7)) );
-        if (col) {*linePtr++ = bitmap_fg>>8; *linePtr++ = (uint8_t) bitmap_fg;}
-        else     {*linePtr++ = bitmap_bg>>8; *linePtr++ = (uint8_t) bitmap_bg;}
-      }
-      data += ww;
-      pushPixels(lineBuf, dw);
-    }
-  }
-
-  _swapBytes = swap; // Restore old value
-  inTransaction = lockTransaction;
-  end_tft_write();
+  // Same expansion, reading through pgm_read_byte() works for RAM as well
+  pushImage(x, y, w, h, (const uint8_t*)data, bpp8, cmap);
 }
 
 
@@ -2087,6 +1994,121 @@ void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t *da
   end_tft_write();
 }
 
+/***************************************************************************************
+** Function name:           pushImageRLE
+** Description:             plot a run length encoded image, from RAM or FLASH (PROGMEM)
+***************************************************************************************/
+// The format written by Tools/bmp2rle/bmp2rle.py, little endian:
+//   "RL", format (0 = 565 colours, 1 = palette), palette size - 1, width, height,
+//   the palette as 565 words for format 1, then each row as runs, none crossing a row.
+// A run is a byte with its type in the top 2 bits and its length - 1 in the low 6:
+//   00 literal: length colours follow, 01 repeat: one colour follows, 10 transparent.
+// A colour is a 565 word, or a palette index byte for format 1.
+#define RLE_LITERAL     0
+#define RLE_REPEAT      1
+#define RLE_TRANSPARENT 2
+
+static inline uint16_t rleColor(const uint8_t *ptr, const uint8_t *palette)
+{
+  if (palette) ptr = palette + 2 * pgm_read_byte(ptr);
+  return pgm_read_byte(ptr) | pgm_read_byte(ptr + 1) << 8;
+}
+
+void TFT_eSPI::pushImageRLE(int32_t x, int32_t y, const uint8_t *data)
+{
+  if (pgm_read_byte(data) != 'R' || pgm_read_byte(data + 1) != 'L') return;
+
+  const uint8_t *palette = nullptr;
+  int32_t w = pgm_read_byte(data + 4) | pgm_read_byte(data + 5) << 8;
+  int32_t h = pgm_read_byte(data + 6) | pgm_read_byte(data + 7) << 8;
+  const uint8_t *ptr = data + 8;
+  if (pgm_read_byte(data + 2) == 1) {
+    palette = ptr;
+    ptr += 2 * (pgm_read_byte(data + 3) + 1);
+  }
+  int32_t bpp = palette ? 1 : 2; // Bytes per colour in the runs
+
+  // A Sprite draws the runs into memory, clipped by fillRect() and drawPixel()
+  if (!directWindow()) {
+    //begin_tft_write();          // Sprite class can use this function, avoiding begin_tft_write()
+    inTransaction = true;
+
+    for (int32_t row = 0; row < h; row++) {
+      for (int32_t col = 0; col < w; ) {
+        uint8_t run = pgm_read_byte(ptr++);
+        int32_t len = (run & 0x3F) + 1;
+        if (run >> 6 == RLE_REPEAT) {
+          fillRect(x + col, y + row, len, 1, rleColor(ptr, palette));
+          ptr += bpp;
+        }
+        else if (run >> 6 == RLE_LITERAL) {
+          for (int32_t i = 0; i < len; i++, ptr += bpp) drawPixel(x + col + i, y + row, rleColor(ptr, palette));
+        }
+        col += len;
+      }
+    }
+
+    inTransaction = lockTransaction;
+    end_tft_write();              // Does nothing if Sprite class uses this function
+    return;
+  }
+
+  PI_CLIP;
+
+  begin_tft_write();
+  inTransaction = true;
+
+  bool swap = _swapBytes;
+  _swapBytes = true;     // The line buffer holds plain 565 colours
+
+  uint16_t lineBuf[64];  // The longest run
+
+  // The runs stream into one window over the image until a transparent run is seen,
+  // from then on each row and each stretch after a transparent run gets its own
+  setWindow(x, y, x + dw - 1, y + dh - 1);
+  bool whole = true, open = true;
+  int32_t right = dx + dw; // First column past the visible ones
+
+  for (int32_t row = 0; row < dy + dh; row++) {
+    bool visible = row >= dy;
+    if (!whole) open = false;
+    for (int32_t col = 0; col < w; ) {
+      uint8_t run = pgm_read_byte(ptr++);
+      int32_t len = (run & 0x3F) + 1;
+      // Visible columns of the run
+      int32_t s = col > dx ? col : dx;
+      int32_t e = col + len < right ? col + len : right;
+      bool show = visible && s < e;
+
+      if (run >> 6 == RLE_TRANSPARENT) {
+        if (show) whole = open = false;
+      }
+      else if (run >> 6 == RLE_REPEAT || run >> 6 == RLE_LITERAL) {
+        if (show && !open) {
+          setWindow(x + s - dx, y + row - dy, x + dw - 1, y + row - dy);
+          open = true;
+        }
+        if (run >> 6 == RLE_REPEAT) {
+          if (show) pushBlock(rleColor(ptr, palette), e - s);
+          ptr += bpp;
+        }
+        else {
+          if (show) {
+            for (int32_t i = s; i < e; i++) lineBuf[i - s] = rleColor(ptr + (i - col) * bpp, palette);
+            pushPixels(lineBuf, e - s);
+          }
+          ptr += len * bpp;
+        }
+      }
+      col += len;
+    }
+  }
+
+  _swapBytes = swap; // Restore old value
+  inTransaction = lockTransaction;
+  end_tft_write();
+}
+
 /***************************************************************************************
 ** Function name:           pushMaskedImage
 ** Description:             Render a 16-bit colour image to TFT with a 1bpp mask
@@ -2173,6 +2195,87 @@ void TFT_eSPI::pushMaskedImage(int32_t x, int32_t y, int32_t w, int32_t h, uint1
 }
 
 
+/***************************************************************************************
+** Function name:           createSpanList
+** Description:             List the opaque spans of each row of a 16-bit image
+***************************************************************************************/
+// The list is one word with the span count of a row, then the start and length of each
+// span, row after row. The transparent colour is compared as pushImage() does, so the
+// setSwapBytes() setting must be the same as when the list is pushed.
+uint16_t* TFT_eSPI::createSpanList(int32_t w, int32_t h, const uint16_t *data, uint16_t transp)
+{
+  if (w < 1 || h < 1 || w > 0xFFFF) return nullptr;
+
+  // The little endian transp color must be byte swapped if the image is big endian
+  if (!_swapBytes) transp = transp >> 8 | transp << 8;
+
+  // Counted first, so the list takes only the memory it needs
+  uint32_t words = h;
+  for (int32_t j = 0; j < h; j++) {
+    const uint16_t *row = data + j * w;
+    for (int32_t i = 0; i < w; i++) {
+      if (row[i] != transp && (i == 0 || row[i - 1] == transp)) words += 2;
+    }
+  }
+
+  uint16_t *spans = (uint16_t*)malloc(words * sizeof(uint16_t));
+  if (!spans) return nullptr;
+
+  uint16_t *ptr = spans;
+  for (int32_t j = 0; j < h; j++) {
+    const uint16_t *row = data + j * w;
+    uint16_t *count = ptr++;
+    *count = 0;
+    for (int32_t i = 0; i < w; ) {
+      if (row[i] == transp) { i++; continue; }
+      int32_t start = i;
+      while (i < w && row[i] != transp) i++;
+      *ptr++ = start;
+      *ptr++ = i - start;
+      (*count)++;
+    }
+  }
+  return spans;
+}
+
+
+/***************************************************************************************
+** Function name:           pushImageSpans
+** Description:             plot the opaque spans of a 16-bit image listed by createSpanList()
+***************************************************************************************/
+void TFT_eSPI::pushImageSpans(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data, const uint16_t *spans)
+{
+  if (!spans) return;
+
+  PI_CLIP;
+
+  begin_tft_write();
+  inTransaction = true;
+
+  // Rows above the viewport are stepped over
+  for (int32_t j = 0; j < dy; j++) spans += 1 + 2 * spans[0];
+
+  int32_t right = dx + dw; // First column past the visible ones
+
+  for (int32_t j = 0; j < dh; j++) {
+    uint16_t n = *spans++;
+    const uint16_t *row = data + (dy + j) * w;
+    while (n--) {
+      int32_t s = spans[0], e = s + spans[1];
+      spans += 2;
+      if (s < dx) s = dx;
+      if (e > right) e = right;
+      if (s >= e) continue;
+      setWindow(x + s - dx, y + j, x + e - dx - 1, y + j);
+      pushPixels(row + s, e - s);
+    }
+  }
+
+  inTransaction = lockTransaction;
+  end_tft_write();
+}
+
+
 /***************************************************************************************
 ** Function name:           setSwapBytes
 ** Description:             Used by 16-bit pushImage() to swap byte order in colours
@@ -2736,30 +2839,247 @@ void TFT_eSPI::fillTriangle ( int32_t x0, int32_t y0, int32_t x1, int32_t y1, in
     drawFastHLine(a, y, b - a + 1, color);
   }
 
-  // For lower part of triangle, find scanline crossings for segments
-  // 0-2 and 1-2.  This loop is skipped if y1=y2.
-  sa = dx12 * (y - y1);
-  sb = dx02 * (y - y0);
-  for (; y <= y2; y++) {
-    a   = x1 + sa / dy12;
-    b   = x0 + sb / dy02;
-    sa += dx12;
-    sb += dx02;
+  // For lower part of triangle, find scanline crossings for segments
+  // 0-2 and 1-2.  This loop is skipped if y1=y2.
+  sa = dx12 * (y - y1);
+  sb = dx02 * (y - y0);
+  for (; y <= y2; y++) {
+    a   = x1 + sa / dy12;
+    b   = x0 + sb / dy02;
+    sa += dx12;
+    sb += dx02;
+
+    if (a > b) transpose(a, b);
+    drawFastHLine(a, y, b - a + 1, color);
+  }
+
+  inTransaction = lockTransaction;
+  end_tft_write();              // Does nothing if Sprite class uses this function
+}
+
+
+/***************************************************************************************
+** Function name:           fillSpans
+** Description:             Send the rows of a filled shape on a background as one window
+***************************************************************************************/
+// Runs of one colour are joined, also across the end of a row, so a shape costs a
+// window setup and a pushBlock() per colour change
+void TFT_eSPI::fillSpans(int32_t x, int32_t y, int32_t w, int32_t h, ShapeSpan span, const void *shape, uint32_t color, uint32_t bg_color)
+{
+  PI_CLIP;
+
+  begin_tft_write();
+  inTransaction = true;
+
+  setWindow(x, y, x + dw - 1, y + dh - 1);
+
+  uint16_t runColor = bg_color;
+  uint32_t run = 0;
+  auto add = [&](uint16_t c, int32_t n) {
+    if (n < 1) return;
+    if (c != runColor && run) { pushBlock(runColor, run); run = 0; }
+    runColor = c;
+    run += n;
+  };
+
+  int32_t right = x + dw - 1;
+  for (int32_t j = y; j < y + dh; j++) {
+    int32_t a, b;
+    span(shape, j - _yDatum, a, b);
+    a += _xDatum;
+    b += _xDatum;
+    if (a < x) a = x;
+    if (b > right) b = right;
+    if (a > b) { add(bg_color, dw); continue; }
+    add(bg_color, a - x);
+    add(color, b - a + 1);
+    add(bg_color, right - b);
+  }
+  if (run) pushBlock(runColor, run);
+
+  inTransaction = lockTransaction;
+  end_tft_write();
+}
+
+
+#define SPAN_MAX_RADIUS 480 // Larger radii would put too big a half width table on the stack
+
+// Half widths of the rows of a filled circle, row offset d from the centre, from the
+// same midpoint steps as fillCircle() so the two draw the same pixels
+static void circleHalfWidths(int32_t r, int16_t *half)
+{
+  int32_t x  = 0;
+  int32_t dx = 1;
+  int32_t dy = r+r;
+  int32_t p  = -(r>>1);
+
+  for (int32_t d = 0; d <= r; d++) half[d] = -1;
+  half[0] = r;
+
+  while (x < r) {
+    if (p >= 0) {
+      if (x > half[r]) half[r] = x;
+      dy -= 2;
+      p  -= dy;
+      r--;
+    }
+    dx += 2;
+    p  += dx;
+    x++;
+    if (r > half[x]) half[x] = r;
+  }
+}
+
+// Half widths for the corners of fillRoundRect(), the steps of fillCircleHelper()
+static void cornerHalfWidths(int32_t r, int16_t *half)
+{
+  int32_t f     = 1 - r;
+  int32_t ddF_x = 1;
+  int32_t ddF_y = -r - r;
+  int32_t y     = 0;
+
+  for (int32_t d = 0; d <= r; d++) half[d] = -1;
+
+  while (y < r) {
+    if (f >= 0) {
+      if (y > half[r]) half[r] = y;
+      r--;
+      ddF_y += 2;
+      f     += ddF_y;
+    }
+    y++;
+    ddF_x += 2;
+    f     += ddF_x;
+    if (r > half[y]) half[y] = r;
+  }
+}
+
+struct CircleShape { int32_t x0, y0, r; const int16_t *half; };
+
+static void circleSpan(const void *shape, int32_t y, int32_t &a, int32_t &b)
+{
+  const CircleShape *c = (const CircleShape *)shape;
+  int32_t d = abs(y - c->y0);
+  int32_t hw = (d <= c->r) ? c->half[d] : -1;
+  a = c->x0 - hw;
+  b = c->x0 + hw;
+  if (hw < 0) b = a - 1;
+}
+
+struct RoundRectShape { int32_t x, y, w, h, r; const int16_t *half; };
+
+static void roundRectSpan(const void *shape, int32_t y, int32_t &a, int32_t &b)
+{
+  const RoundRectShape *s = (const RoundRectShape *)shape;
+  int32_t top = s->y + s->r, bottom = s->y + s->h - s->r - 1; // Corner centre rows
+  int32_t d = (y < top) ? top - y : (y > bottom) ? y - bottom : 0;
+  a = s->x;
+  b = s->x + s->w - 1;
+  if (d == 0) return;
+  int32_t hw = (d <= s->r) ? s->half[d] : -1;
+  if (hw < 0) { b = a - 1; return; }
+  a = s->x + s->r - hw;
+  b = s->x + s->w - s->r - 1 + hw;
+}
+
+// Vertices sorted by y, crossings as fillTriangle() steps them
+struct TriangleShape { int32_t x0, y0, x1, y1, x2, y2; };
+
+static void triangleSpan(const void *shape, int32_t y, int32_t &a, int32_t &b)
+{
+  const TriangleShape *t = (const TriangleShape *)shape;
+  if (t->y0 == t->y2) {
+    a = min(t->x0, min(t->x1, t->x2));
+    b = max(t->x0, max(t->x1, t->x2));
+    return;
+  }
+  int32_t last = (t->y1 == t->y2) ? t->y1 : t->y1 - 1;
+  if (y <= last) a = t->x0 + (t->x1 - t->x0) * (y - t->y0) / (t->y1 - t->y0);
+  else           a = t->x1 + (t->x2 - t->x1) * (y - t->y1) / (t->y2 - t->y1);
+  b = t->x0 + (t->x2 - t->x0) * (y - t->y0) / (t->y2 - t->y0);
+  if (a > b) transpose(a, b);
+}
+
+
+/***************************************************************************************
+** Function name:           fillCircle
+** Description:             draw a filled circle on a known background
+***************************************************************************************/
+void TFT_eSPI::fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color, uint32_t bg_color)
+{
+  if (r < 0) return;
+
+  // A Sprite writes pixels to memory, the window is only worth it on a panel
+  if (!directWindow() || r > SPAN_MAX_RADIUS) {
+    fillRect(x0 - r, y0 - r, r + r + 1, r + r + 1, bg_color);
+    fillCircle(x0, y0, r, color);
+    return;
+  }
+
+  int16_t half[r + 1];
+  circleHalfWidths(r, half);
+  CircleShape shape = { x0, y0, r, half };
+  fillSpans(x0 - r, y0 - r, r + r + 1, r + r + 1, circleSpan, &shape, color, bg_color);
+}
+
+
+/***************************************************************************************
+** Function name:           fillRoundRect
+** Description:             Draw a rounded corner filled rectangle on a known background
+***************************************************************************************/
+void TFT_eSPI::fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint32_t color, uint32_t bg_color)
+{
+  if (w < 1 || h < 1 || r < 0) return;
+
+  if (!directWindow() || r > SPAN_MAX_RADIUS) {
+    fillRect(x, y, w, h, bg_color);
+    fillRoundRect(x, y, w, h, r, color);
+    return;
+  }
+
+  int16_t half[r + 1];
+  cornerHalfWidths(r, half);
+  RoundRectShape shape = { x, y, w, h, r, half };
+  fillSpans(x, y, w, h, roundRectSpan, &shape, color, bg_color);
+}
+
+
+/***************************************************************************************
+** Function name:           fillTriangle
+** Description:             Draw a filled triangle on a known background
+***************************************************************************************/
+void TFT_eSPI::fillTriangle(int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint32_t color, uint32_t bg_color)
+{
+  // Sort coordinates by Y order (y2 >= y1 >= y0)
+  if (y0 > y1) {
+    transpose(y0, y1); transpose(x0, x1);
+  }
+  if (y1 > y2) {
+    transpose(y2, y1); transpose(x2, x1);
+  }
+  if (y0 > y1) {
+    transpose(y0, y1); transpose(x0, x1);
+  }
+
+  int32_t left  = min(x0, min(x1, x2));
+  int32_t right = max(x0, max(x1, x2));
 
-    if (a > b) transpose(a, b);
-    drawFastHLine(a, y, b - a + 1, color);
+  if (!directWindow()) {
+    fillRect(left, y0, right - left + 1, y2 - y0 + 1, bg_color);
+    fillTriangle(x0, y0, x1, y1, x2, y2, color);
+    return;
   }
 
-  inTransaction = lockTransaction;
-  end_tft_write();              // Does nothing if Sprite class uses this function
+  TriangleShape shape = { x0, y0, x1, y1, x2, y2 };
+  fillSpans(left, y0, right - left + 1, y2 - y0 + 1, triangleSpan, &shape, color, bg_color);
 }
 
 
 /***************************************************************************************
-** Function name:           drawBitmap
-** Description:             Draw an image stored in an array on the TFT
+** Function name:           drawBitmapRuns
+** Description:             Draw the set pixels of a 1 bit image as horizontal runs
 ***************************************************************************************/
-void TFT_eSPI::drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color)
+void TFT_eSPI::drawBitmapRuns(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color, bool lsbFirst)
 {
   //begin_tft_write();          // Sprite class can use this function, avoiding begin_tft_write()
   inTransaction = true;
@@ -2767,11 +3087,23 @@ void TFT_eSPI::drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w
   int32_t i, j, byteWidth = (w + 7) / 8;
 
   for (j = 0; j < h; j++) {
+    const uint8_t *row = bitmap + j * byteWidth;
+    int32_t run = -1; // Start of the current run of set pixels
     for (i = 0; i < w; i++ ) {
-      if (pgm_read_byte(bitmap + j * byteWidth + i / 8) & (128 >> (i & 7))) {
-        drawPixel(x + i, y + j, color);
+      uint8_t bits = pgm_read_byte(row + i / 8);
+      // Whole bytes of one colour need no bit tests
+      if ((i & 7) == 0 && i + 8 <= w) {
+        if (bits == 0x00 && run < 0) { i += 7; continue; }
+        if (bits == 0xFF) { if (run < 0) run = i; i += 7; continue; }
+      }
+      bool set = bits & (lsbFirst ? (1 << (i & 7)) : (128 >> (i & 7)));
+      if (set && run < 0) run = i;
+      else if (!set && run >= 0) {
+        drawFastHLine(x + run, y + j, i - run, color);
+        run = -1;
       }
     }
+    if (run >= 0) drawFastHLine(x + run, y + j, w - run, color);
   }
 
   inTransaction = lockTransaction;
@@ -2780,49 +3112,100 @@ void TFT_eSPI::drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w
 
 
 /***************************************************************************************
-** Function name:           drawBitmap
-** Description:             Draw an image stored in an array on the TFT
+** Function name:           drawBitmapBlock
+** Description:             Draw a 1 bit image with foreground and background colours
 ***************************************************************************************/
-void TFT_eSPI::drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t fgcolor, uint16_t bgcolor)
+void TFT_eSPI::drawBitmapBlock(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t fgcolor, uint16_t bgcolor, bool lsbFirst)
 {
-  //begin_tft_write();          // Sprite class can use this function, avoiding begin_tft_write()
+  int32_t i, j, byteWidth = (w + 7) / 8;
+
+  // A Sprite writes pixels to memory, the window is only worth it on a panel
+  if (!directWindow()) {
+    //begin_tft_write();          // Sprite class can use this function, avoiding begin_tft_write()
+    inTransaction = true;
+
+    for (j = 0; j < h; j++) {
+      for (i = 0; i < w; i++ ) {
+        uint8_t bits = pgm_read_byte(bitmap + j * byteWidth + i / 8);
+        if (bits & (lsbFirst ? (1 << (i & 7)) : (128 >> (i & 7))))
+             drawPixel(x + i, y + j, fgcolor);
+        else drawPixel(x + i, y + j, bgcolor);
+      }
+    }
+
+    inTransaction = lockTransaction;
+    end_tft_write();              // Does nothing if Sprite class uses this function
+    return;
+  }
+
+  PI_CLIP;
+
+  // Four pixels per nibble in the order pushPixels() sends them
+  if (!_swapBytes) {
+    fgcolor = fgcolor >> 8 | fgcolor << 8;
+    bgcolor = bgcolor >> 8 | bgcolor << 8;
+  }
+  uint16_t lut[16][4];
+  for (i = 0; i < 16; i++) {
+    for (j = 0; j < 4; j++) {
+      // Bit 3 of the nibble is its first pixel, or bit 0 for XBM
+      lut[i][j] = (i & (lsbFirst ? (1 << j) : (8 >> j))) ? fgcolor : bgcolor;
+    }
+  }
+
+  // Whole bytes of the clipped columns, pushed from the first visible pixel
+  int32_t firstByte = dx / 8;
+  int32_t byteCount = ((dx & 7) + dw + 7) / 8;
+  uint16_t lineBuf[byteCount * 8];
+
+  begin_tft_write();
   inTransaction = true;
 
-  int32_t i, j, byteWidth = (w + 7) / 8;
+  setWindow(x, y, x + dw - 1, y + dh - 1);
 
-  for (j = 0; j < h; j++) {
-    for (i = 0; i < w; i++ ) {
-      if (pgm_read_byte(bitmap + j * byteWidth + i / 8) & (128 >> (i & 7)))
-           drawPixel(x + i, y + j, fgcolor);
-      else drawPixel(x + i, y + j, bgcolor);
+  for (j = dy; j < dy + dh; j++) {
+    const uint8_t *row = bitmap + j * byteWidth + firstByte;
+    uint16_t *out = lineBuf;
+    for (i = 0; i < byteCount; i++) {
+      uint8_t bits = pgm_read_byte(row + i);
+      memcpy(out,     lut[lsbFirst ? bits & 0x0F : bits >> 4], 8);
+      memcpy(out + 4, lut[lsbFirst ? bits >> 4 : bits & 0x0F], 8);
+      out += 8;
     }
+    pushPixels(lineBuf + (dx & 7), dw);
   }
 
   inTransaction = lockTransaction;
-  end_tft_write();              // Does nothing if Sprite class uses this function
+  end_tft_write();
 }
 
+
 /***************************************************************************************
-** Function name:           drawXBitmap
-** Description:             Draw an image stored in an XBM array onto the TFT
+** Function name:           drawBitmap
+** Description:             Draw an image stored in an array on the TFT
 ***************************************************************************************/
-void TFT_eSPI::drawXBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color)
+void TFT_eSPI::drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color)
 {
-  //begin_tft_write();          // Sprite class can use this function, avoiding begin_tft_write()
-  inTransaction = true;
+  drawBitmapRuns(x, y, bitmap, w, h, color, false);
+}
 
-  int32_t i, j, byteWidth = (w + 7) / 8;
 
-  for (j = 0; j < h; j++) {
-    for (i = 0; i < w; i++ ) {
-      if (pgm_read_byte(bitmap + j * byteWidth + i / 8) & (1 << (i & 7))) {
-        drawPixel(x + i, y + j, color);
-      }
-    }
-  }
+/***************************************************************************************
+** Function name:           drawBitmap
+** Description:             Draw an image stored in an array on the TFT
+***************************************************************************************/
+void TFT_eSPI::drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t fgcolor, uint16_t bgcolor)
+{
+  drawBitmapBlock(x, y, bitmap, w, h, fgcolor, bgcolor, false);
+}
 
-  inTransaction = lockTransaction;
-  end_tft_write();              // Does nothing if Sprite class uses this function
+/***************************************************************************************
+** Function name:           drawXBitmap
+** Description:             Draw an image stored in an XBM array onto the TFT
+***************************************************************************************/
+void TFT_eSPI::drawXBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color)
+{
+  drawBitmapRuns(x, y, bitmap, w, h, color, true);
 }
 
 
@@ -2832,21 +3215,7 @@ void TFT_eSPI::drawXBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t
 ***************************************************************************************/
 void TFT_eSPI::drawXBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color, uint16_t bgcolor)
 {
-  //begin_tft_write();          // Sprite class can use this function, avoiding begin_tft_write()
-  inTransaction = true;
-
-  int32_t i, j, byteWidth = (w + 7) / 8;
-
-  for (j = 0; j < h; j++) {
-    for (i = 0; i < w; i++ ) {
-      if (pgm_read_byte(bitmap + j * byteWidth + i / 8) & (1 << (i & 7)))
-           drawPixel(x + i, y + j,   color);
-      else drawPixel(x + i, y + j, bgcolor);
-    }
-  }
-
-  inTransaction = lockTransaction;
-  end_tft_write();              // Does nothing if Sprite class uses this function
+  drawBitmapBlock(x, y, bitmap, w, h, color, bgcolor, true);
 }
 
 
@@ -3176,6 +3545,9 @@ int16_t TFT_eSPI::fontHeight(void)
   return fontHeight(textfont);
 }
 
+#define GFXFF_RUNS        24 // Runs of a free font glyph row that can grow down
+#define GFXFF_BOX_GLYPHS  32 // Glyphs drawFreeFontBox() takes, longer strings are drawn glyph by glyph
+
 /***************************************************************************************
 ** Function name:           drawChar
 ** Description:             draw a single character in the GLCD or GFXFF font
@@ -3206,6 +3578,9 @@ void TFT_eSPI::drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32
   bool fillbg = (bg != color);
   bool clip = xd < _vpX || xd + 6  * textsize >= _vpW || yd < _vpY || yd + 8 * textsize >= _vpH;
 
+  if (fillbg && xd >= _vpX && yd >= _vpY && xd + 6 * size <= _vpW && yd + 8 * size <= _vpH &&
+      drawCachedGlyph(1, c, xd, yd, color, bg, size)) return;
+
   if ((size==1) && fillbg && !clip) {
     uint8_t column[6];
     uint8_t mask = 0x1;
@@ -3280,7 +3655,7 @@ void TFT_eSPI::drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32
                //xa = pgm_read_byte(&glyph->xAdvance);
       int8_t   xo = pgm_read_byte(&glyph->xOffset),
                yo = pgm_read_byte(&glyph->yOffset);
-      uint8_t  xx, yy, bits=0, bit=0;
+      uint8_t  yy, bits=0, bit=0;
       int16_t  xo16 = 0, yo16 = 0;
 
       if(size > 1) {
@@ -3288,31 +3663,50 @@ void TFT_eSPI::drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32
         yo16 = yo;
       }
 
-      // GFXFF rendering speed up
+      // GFXFF rendering speed up: the set bits of a row as runs, and a run at the same
+      // place as one in the row above grows down instead of being drawn, so stems and
+      // bars go out as one rectangle each
+      struct Run { uint8_t x, len, top; };
+      Run open[GFXFF_RUNS], next[GFXFF_RUNS];
+      uint8_t openCount = 0;
+      auto drawRun = [&](const Run &r, uint8_t bottom) {
+        if(size == 1) fillRect(x+xo+r.x, y+yo+r.top, r.len, bottom - r.top, color);
+        else fillRect(x+(xo16+r.x)*size, y+(yo16+r.top)*size, size*r.len, size*(bottom - r.top), color);
+      };
+
       uint16_t hpc = 0; // Horizontal foreground pixel count
       for(yy=0; yy<h; yy++) {
-        for(xx=0; xx<w; xx++) {
-          if(bit == 0) {
-            bits = pgm_read_byte(&bitmap[bo++]);
-            bit  = 0x80;
-          }
-          if(bits & bit) hpc++;
-          else {
-           if (hpc) {
-              if(size == 1) drawFastHLine(x+xo+xx-hpc, y+yo+yy, hpc, color);
-              else fillRect(x+(xo16+xx-hpc)*size, y+(yo16+yy)*size, size*hpc, size, color);
-              hpc=0;
+        uint8_t nextCount = 0;
+        for(uint16_t xc=0; xc<=w; xc++) { // One past the end closes the last run
+          bool set = false;
+          if (xc < w) {
+            if(bit == 0) {
+              bits = pgm_read_byte(&bitmap[bo++]);
+              bit  = 0x80;
             }
+            set = bits & bit;
+            bit >>= 1;
+          }
+          if(set) hpc++;
+          else if (hpc) {
+            Run r = { (uint8_t)(xc - hpc), (uint8_t)hpc, yy };
+            if (nextCount < GFXFF_RUNS) next[nextCount++] = r;
+            else drawRun(r, yy + 1); // More runs than kept, drawn as they are
+            hpc = 0;
           }
-          bit >>= 1;
         }
-        // Draw pixels for this line as we are about to increment yy
-        if (hpc) {
-          if(size == 1) drawFastHLine(x+xo+xx-hpc, y+yo+yy, hpc, color);
-          else fillRect(x+(xo16+xx-hpc)*size, y+(yo16+yy)*size, size*hpc, size, color);
-          hpc=0;
+
+        // Both lists are in x order: runs above that don't go on are drawn
+        uint8_t i = 0;
+        for (uint8_t j = 0; j < nextCount; j++) {
+          while (i < openCount && open[i].x < next[j].x) drawRun(open[i++], yy);
+          if (i < openCount && open[i].x == next[j].x && open[i].len == next[j].len) next[j].top = open[i++].top;
         }
+        while (i < openCount) drawRun(open[i++], yy);
+        memcpy(open, next, nextCount * sizeof(Run));
+        openCount = nextCount;
       }
+      for (uint8_t i = 0; i < openCount; i++) drawRun(open[i], h);
 
       inTransaction = lockTransaction;
       end_tft_write();              // Does nothing if Sprite class uses this function
@@ -3362,6 +3756,7 @@ void TFT_eSPI::setWindow(int32_t x0, int32_t y0, int32_t x1, int32_t y1)
   //begin_tft_write(); // Must be called before setWindow
   addr_row = 0xFFFF;
   addr_col = 0xFFFF;
+  TFT_STAT_WINDOW;
 
 #if defined (ILI9225_DRIVER)
   if (rotation & 0x01) { transpose(x0, y0); transpose(x1, y1); }
@@ -3600,6 +3995,8 @@ void TFT_eSPI::drawPixel(int32_t x, int32_t y, uint32_t color)
 #endif
 
   begin_tft_write();
+  TFT_STAT_WINDOW;
+  TFT_STAT_PIXELS(1);
 
 #if defined (ILI9225_DRIVER)
   if (rotation & 0x01) { transpose(x, y); }
@@ -3881,10 +4278,65 @@ void TFT_eSPI::pushColors(uint16_t *data, uint32_t len, bool swap)
 ***************************************************************************************/
 // Bresenham's algorithm - thx Wikipedia - speed enhanced by Bodmer to use
 // an efficient FastH/V Line draw routine for line segments of 2 pixels or more
+//
+// On the TFT the runs are computed whole, run-slice fashion, each clipped to the
+// viewport and sent as one window and pushBlock() in a single transaction
 void TFT_eSPI::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color)
 {
   if (_vpOoB) return;
 
+  if (directWindow()) {
+    x0 += _xDatum; y0 += _yDatum;
+    x1 += _xDatum; y1 += _yDatum;
+
+    bool steep = abs(y1 - y0) > abs(x1 - x0);
+    if (steep) {
+      transpose(x0, y0);
+      transpose(x1, y1);
+    }
+    if (x0 > x1) {
+      transpose(x0, x1);
+      transpose(y0, y1);
+    }
+
+    int32_t dx = x1 - x0, dy = abs(y1 - y0);
+    int32_t err = dx >> 1, ystep = (y0 < y1) ? 1 : -1;
+
+    // Viewport along the run (major) axis and across it
+    int32_t mMin = steep ? _vpY : _vpX, mMax = steep ? _vpH : _vpW;
+    int32_t nMin = steep ? _vpX : _vpY, nMax = steep ? _vpW : _vpH;
+
+    begin_tft_write();
+    inTransaction = true;
+
+    while (x0 <= x1) {
+      // Pixels until the error goes negative, as the pixel by pixel loop counts them
+      int32_t len = dy ? err / dy + 1 : x1 - x0 + 1;
+      if (len > x1 - x0 + 1) len = x1 - x0 + 1;
+
+      // Both axes only move one way, so once past the far edges nothing more shows
+      if (x0 >= mMax || ((ystep > 0) ? (y0 >= nMax) : (y0 < nMin))) break;
+
+      if (y0 >= nMin && y0 < nMax) {
+        int32_t a = (x0 > mMin) ? x0 : mMin;
+        int32_t b = (x0 + len < mMax) ? x0 + len : mMax;
+        if (a < b) {
+          if (steep) setWindow(y0, a, y0, b - 1);
+          else       setWindow(a, y0, b - 1, y0);
+          pushBlock(color, b - a);
+        }
+      }
+
+      x0 += len;
+      y0 += ystep;
+      err += dx - len * dy;
+    }
+
+    inTransaction = lockTransaction;
+    end_tft_write();
+    return;
+  }
+
   //begin_tft_write();       // Sprite class can use this function, avoiding begin_tft_write()
   inTransaction = true;
 
@@ -4257,9 +4709,14 @@ void TFT_eSPI::fillSmoothCircle(int32_t x, int32_t y, int32_t r, uint32_t color,
   r++;
   int32_t r2 = r * r;
   
+  // Edge alphas of one row, outermost first; alpha rises towards the fill so
+  // only the outer pixels can be skipped and the rest form one run
+  uint8_t edge[r];
+
   for (int32_t cy = r - 1; cy > 0; cy--)
   {
     int32_t dy2 = (r - cy) * (r - cy);
+    int32_t c0 = 0, n = 0;
     for (cx = xs; cx < r; cx++)
     {
       int32_t hyp2 = (r - cx) * (r - cx) + dy2;
@@ -4271,18 +4728,12 @@ void TFT_eSPI::fillSmoothCircle(int32_t x, int32_t y, int32_t r, uint32_t color,
       xs = cx;
       if (alpha < 9) continue;
 
-      if (bg_color == 0x00FFFFFF) {
-        drawPixel(x + cx - r, y + cy - r, color, alpha, bg_color);
-        drawPixel(x - cx + r, y + cy - r, color, alpha, bg_color);
-        drawPixel(x - cx + r, y - cy + r, color, alpha, bg_color);
-        drawPixel(x + cx - r, y - cy + r, color, alpha, bg_color);
-      }
-      else {
-        uint16_t pcol = drawPixel(x + cx - r, y + cy - r, color, alpha, bg_color);
-        drawPixel(x - cx + r, y + cy - r, pcol);
-        drawPixel(x - cx + r, y - cy + r, pcol);
-        drawPixel(x + cx - r, y - cy + r, pcol);
-      }
+      if (!n) c0 = cx;
+      edge[n++] = alpha;
+    }
+    if (n) {
+      drawSmoothEdges(x + c0 - r, x - c0 + r, y + cy - r, edge, n, color, bg_color);
+      drawSmoothEdges(x + c0 - r, x - c0 + r, y - cy + r, edge, n, color, bg_color);
     }
     drawFastHLine(x + cx - r, y + cy - r, 2 * (r - cx) + 1, color);
     drawFastHLine(x + cx - r, y - cy + r, 2 * (r - cx) + 1, color);
@@ -4395,6 +4846,23 @@ void TFT_eSPI::drawSmoothRoundRect(int32_t x, int32_t y, int32_t r, int32_t ir,
   end_tft_write();
 }
 
+/***************************************************************************************
+** Function name:           drawSmoothEdges - private helper for the smooth fills
+** Description:             Blend the anti-aliased ends of one row of a filled shape
+***************************************************************************************/
+// edge[] holds n alphas from the left end xl inwards; the right end mirrors them
+// back to xr. Each end is one span, so a read back costs one readRect, not a
+// readPixel per pixel.
+void TFT_eSPI::drawSmoothEdges(int32_t xl, int32_t xr, int32_t y, const uint8_t *edge, int32_t n, uint32_t color, uint32_t bg_color)
+{
+  drawAlphaSpan(xl, y, n, edge, color, bg_color);
+
+  uint8_t mirror[n];
+  for (int32_t i = 0; i < n; i++) mirror[i] = edge[n - 1 - i];
+  drawAlphaSpan(xr - n + 1, y, n, mirror, color, bg_color);
+}
+
+
 /***************************************************************************************
 ** Function name:           fillSmoothRoundRect
 ** Description:             Draw a filled anti-aliased rounded corner rectangle
@@ -4423,9 +4891,14 @@ void TFT_eSPI::fillSmoothRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, i
   r++;
   int32_t r2 = r * r;
 
+  // Edge alphas of one row, outermost first; alpha rises towards the fill so
+  // only the outer pixels can be skipped and the rest form one run
+  uint8_t edge[r];
+
   for (int32_t cy = r - 1; cy > 0; cy--)
   {
     int32_t dy2 = (r - cy) * (r - cy);
+    int32_t c0 = 0, n = 0;
     for (cx = xs; cx < r; cx++)
     {
       int32_t hyp2 = (r - cx) * (r - cx) + dy2;
@@ -4437,10 +4910,12 @@ void TFT_eSPI::fillSmoothRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, i
       xs = cx;
       if (alpha < 9) continue;
 
-      drawPixel(x + cx - r, y + cy - r, color, alpha, bg_color);
-      drawPixel(x - cx + r + w, y + cy - r, color, alpha, bg_color);
-      drawPixel(x - cx + r + w, y - cy + r + h, color, alpha, bg_color);
-      drawPixel(x + cx - r, y - cy + r + h, color, alpha, bg_color);
+      if (!n) c0 = cx;
+      edge[n++] = alpha;
+    }
+    if (n) {
+      drawSmoothEdges(x + c0 - r, x - c0 + r + w, y + cy - r, edge, n, color, bg_color);
+      drawSmoothEdges(x + c0 - r, x - c0 + r + w, y - cy + r + h, edge, n, color, bg_color);
     }
     drawFastHLine(x + cx - r, y + cy - r, 2 * (r - cx) + 1 + w, color);
     drawFastHLine(x + cx - r, y - cy + r + h, 2 * (r - cx) + 1 + w, color);
@@ -4494,16 +4969,18 @@ void TFT_eSPI::drawWedgeLine(float ax, float ay, float bx, float by, float ar, f
   float alpha = 1.0f;
   ar += 0.5;
 
-  uint16_t bg = bg_color;
   float xpax, ypay, bax = bx - ax, bay = by - ay;
 
+  // Pixel alphas of one row, blended and drawn as one run
+  uint8_t alphaRow[x1 - x0 + 1];
+
   begin_nin_write();
   inTransaction = true;
 
   int32_t xs = x0;
   // Scan bounding box from ys down, calculate pixel intensity from distance to line
   for (int32_t yp = ys; yp <= y1; yp++) {
-    bool swin = true;  // Flag to start new window area
+    int32_t first = -1, last = -1; // Run of pixels to draw
     bool endX = false; // Flag to skip pixels
     ypay = yp - ay;
     for (int32_t xp = xs; xp <= x1; xp++) {
@@ -4512,36 +4989,18 @@ void TFT_eSPI::drawWedgeLine(float ax, float ay, float bx, float by, float ar, f
       alpha = ar - wedgeLineDistance(xpax, ypay, bax, bay, rdt);
       if (alpha <= LoAlphaTheshold ) continue;
       // Track edge to minimise calculations
-      if (!endX) { endX = true; xs = xp; }
-      if (alpha > HiAlphaTheshold) {
-        #ifdef GC9A01_DRIVER
-          drawPixel(xp, yp, fg_color);
-        #else
-          if (swin) { setWindow(xp, yp, x1, yp); swin = false; }
-          pushColor(fg_color);
-        #endif
-        continue;
-      }
-      //Blend color with background and plot
-      if (bg_color == 0x00FFFFFF) {
-        bg = readPixel(xp, yp); swin = true;
-      }
-      #ifdef GC9A01_DRIVER
-        uint16_t pcol = fastBlend((uint8_t)(alpha * PixelAlphaGain), fg_color, bg);
-        drawPixel(xp, yp, pcol);
-        swin = swin;
-      #else
-        if (swin) { setWindow(xp, yp, x1, yp); swin = false; }
-        pushColor(fastBlend((uint8_t)(alpha * PixelAlphaGain), fg_color, bg));
-      #endif
+      if (!endX) { endX = true; xs = xp; first = xp; }
+      alphaRow[xp - x0] = (alpha > HiAlphaTheshold) ? 255 : (uint8_t)(alpha * PixelAlphaGain);
+      last = xp;
     }
+    if (first >= 0) drawAlphaSpan(first - _xDatum, yp - _yDatum, last - first + 1, alphaRow + first - x0, fg_color, bg_color);
   }
 
   // Reset x start to left side of box
   xs = x0;
   // Scan bounding box from ys-1 up, calculate pixel intensity from distance to line
   for (int32_t yp = ys-1; yp >= y0; yp--) {
-    bool swin = true;  // Flag to start new window area
+    int32_t first = -1, last = -1; // Run of pixels to draw
     bool endX = false; // Flag to skip pixels
     ypay = yp - ay;
     for (int32_t xp = xs; xp <= x1; xp++) {
@@ -4550,29 +5009,11 @@ void TFT_eSPI::drawWedgeLine(float ax, float ay, float bx, float by, float ar, f
       alpha = ar - wedgeLineDistance(xpax, ypay, bax, bay, rdt);
       if (alpha <= LoAlphaTheshold ) continue;
       // Track line boundary
-      if (!endX) { endX = true; xs = xp; }
-      if (alpha > HiAlphaTheshold) {
-        #ifdef GC9A01_DRIVER
-          drawPixel(xp, yp, fg_color);
-        #else
-          if (swin) { setWindow(xp, yp, x1, yp); swin = false; }
-          pushColor(fg_color);
-        #endif
-        continue;
-      }
-      //Blend colour with background and plot
-      if (bg_color == 0x00FFFFFF) {
-        bg = readPixel(xp, yp); swin = true;
-      }
-      #ifdef GC9A01_DRIVER
-        uint16_t pcol = fastBlend((uint8_t)(alpha * PixelAlphaGain), fg_color, bg);
-        drawPixel(xp, yp, pcol);
-        swin = swin;
-      #else
-        if (swin) { setWindow(xp, yp, x1, yp); swin = false; }
-        pushColor(fastBlend((uint8_t)(alpha * PixelAlphaGain), fg_color, bg));
-      #endif
+      if (!endX) { endX = true; xs = xp; first = xp; }
+      alphaRow[xp - x0] = (alpha > HiAlphaTheshold) ? 255 : (uint8_t)(alpha * PixelAlphaGain);
+      last = xp;
     }
+    if (first >= 0) drawAlphaSpan(first - _xDatum, yp - _yDatum, last - first + 1, alphaRow + first - x0, fg_color, bg_color);
   }
 
   inTransaction = lockTransaction;
@@ -4580,6 +5021,43 @@ void TFT_eSPI::drawWedgeLine(float ax, float ay, float bx, float by, float ar, f
 }
 
 
+/***************************************************************************************
+** Function name:           drawAlphaSpan
+** Description:             Blend a colour over a run of pixels, one alpha per pixel
+***************************************************************************************/
+void TFT_eSPI::drawAlphaSpan(int32_t x, int32_t y, int32_t w, const uint8_t *alpha, uint32_t fg_color, uint32_t bg_color)
+{
+  if (_vpOoB || w < 1) return;
+
+  x+= _xDatum;
+  y+= _yDatum;
+
+  if ((y < _vpY) || (y >= _vpH) || (x >= _vpW)) return;
+  if (x < _vpX) { alpha += _vpX - x; w -= _vpX - x; x = _vpX; }
+  if ((x + w) > _vpW) w = _vpW - x;
+  if (w < 1) return;
+
+  // Pixels in panel byte order, as readRect() returns them
+  uint16_t lineBuf[w];
+  bool readBack = (bg_color == 0x00FFFFFF);
+  if (readBack) readRect(x - _xDatum, y - _yDatum, w, 1, lineBuf);
+  alphaBlendSpan(lineBuf, readBack ? lineBuf : nullptr, bg_color, alpha, w, fg_color, true);
+
+  begin_tft_write();
+  inTransaction = true;
+
+  setWindow(x, y, x + w - 1, y);
+
+  bool swap = _swapBytes;
+  _swapBytes = false;
+  pushPixels(lineBuf, w);
+  _swapBytes = swap;
+
+  inTransaction = lockTransaction;
+  end_tft_write();
+}
+
+
 /***************************************************************************************
 ** Function name:           lineDistance - private helper function for drawWedgeLine
 ** Description:             returns distance of px,py to closest part of a to b wedge
@@ -4846,6 +5324,76 @@ void TFT_eSPI::invertDisplay(bool i)
 }
 
 
+#ifndef TFT_SCROLL_LINES
+  #define TFT_SCROLL_LINES TFT_HEIGHT // Frame memory rows, the panel height unless the driver says
+#endif
+
+/***************************************************************************************
+** Function name:           setScrollArea
+** Description:             Define the hardware scrolling area between fixed rows
+***************************************************************************************/
+void TFT_eSPI::setScrollArea(uint16_t top, uint16_t bottom)
+{
+#ifdef TFT_VSCRDEF
+  if (top + bottom >= _init_height) return;
+
+  // Frame memory rows below a shorter panel join the bottom fixed area
+  uint16_t lines = _init_height - top - bottom;
+  uint16_t fixed = bottom + TFT_SCROLL_LINES - _init_height;
+  begin_tft_write();
+  writecommand(TFT_VSCRDEF);
+  writedata(top >> 8);   writedata(top);
+  writedata(lines >> 8); writedata(lines);
+  writedata(fixed >> 8); writedata(fixed);
+  end_tft_write();
+
+  _scrollTop = top;
+  _scrollEnd = top + lines;
+  scrollTo(top);
+#else
+  (void)top; (void)bottom;
+#endif
+}
+
+
+/***************************************************************************************
+** Function name:           scrollTo
+** Description:             Set the frame memory row at the top of the scrolling area
+***************************************************************************************/
+void TFT_eSPI::scrollTo(uint16_t start)
+{
+#ifdef TFT_VSCRSADD
+  _scrollStart = start;
+  begin_tft_write();
+  writecommand(TFT_VSCRSADD);
+  writedata(start >> 8);
+  writedata(start);
+  end_tft_write();
+#else
+  (void)start;
+#endif
+}
+
+
+/***************************************************************************************
+** Function name:           scrollBy
+** Description:             Scroll the area by lines, return where the new ones go
+***************************************************************************************/
+uint16_t TFT_eSPI::scrollBy(int16_t lines)
+{
+  int32_t area = _scrollEnd - _scrollTop;
+  if (area <= 0) return _scrollTop; // No scrolling area set
+
+  uint16_t old = _scrollStart;
+  int32_t start = (_scrollStart - _scrollTop + lines) % area;
+  if (start < 0) start += area;
+  scrollTo(_scrollTop + start);
+
+  // Rows that left the top now show at the bottom; scrolling back, the new top ones
+  return (lines >= 0) ? old : _scrollStart;
+}
+
+
 /**************************************************************************
 ** Function name:           setAttribute
 ** Description:             Sets a control parameter of an attribute
@@ -5231,7 +5779,7 @@ int16_t TFT_eSPI::drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t font)
 
   int32_t width  = 0;
   int32_t height = 0;
-  uint32_t flash_address = 0;
+  uintptr_t flash_address = 0;
   uniCode -= 32;
 
 #ifdef LOAD_FONT2
@@ -5266,6 +5814,9 @@ int16_t TFT_eSPI::drawChar(uint16_t uniCode, int32_t x, int32_t y, uint8_t font)
   uint8_t line = 0;
   bool clip = xd < _vpX || xd + width  * textsize >= _vpW || yd < _vpY || yd + height * textsize >= _vpH;
 
+  if (textcolor != textbgcolor && !clip && drawCachedGlyph(font, uniCode, xd, yd, textcolor, textbgcolor, textsize))
+    return width * textsize;
+
 #ifdef LOAD_FONT2 // chop out code if we do not need it
   if (font == 2) {
     w = w + 6; // Should be + 7 but we need to compensate for width increment
@@ -5602,6 +6153,7 @@ int16_t TFT_eSPI::drawString(const char *string, int32_t poX, int32_t poY, uint8
 
 
   int8_t xo = 0;
+  bool composed = false; // Background and glyphs sent together by drawFreeFontBox()
 #ifdef LOAD_GFXFF
   if (freeFont && (textcolor!=textbgcolor)) {
       cheight = (glyph_ab + glyph_bb) * textsize;
@@ -5622,7 +6174,8 @@ int16_t TFT_eSPI::drawString(const char *string, int32_t poX, int32_t poY, uint8
         // Add 1 pixel of padding all round
         //cheight +=2;
         //fillRect(poX+xo-1, poY - 1 - glyph_ab * textsize, cwidth+2, cheight, textbgcolor);
-        fillRect(poX+xo, poY - glyph_ab * textsize, cwidth, cheight, textbgcolor);
+        composed = drawFreeFontBox(string, poX, poY, poX+xo, poY - glyph_ab * textsize, cwidth, cheight, sumX);
+        if (!composed) fillRect(poX+xo, poY - glyph_ab * textsize, cwidth, cheight, textbgcolor);
       }
       padding -=100;
     }
@@ -5650,7 +6203,7 @@ int16_t TFT_eSPI::drawString(const char *string, int32_t poX, int32_t poY, uint8
   else
 #endif
   {
-    while (n < len) {
+    while (!composed && n < len) {
       uint16_t uniCode = decodeUTF8((uint8_t*)string, &n, len - n);
       sumX += drawChar(uniCode, poX+sumX, poY, font);
     }
@@ -5723,6 +6276,92 @@ return sumX;
 }
 
 
+#ifdef LOAD_GFXFF
+/***************************************************************************************
+** Function name:           drawFreeFontBox
+** Description:             Send a free font string and its background as one window
+***************************************************************************************/
+// Each row of the box is filled with the background in a line buffer, the glyph rows
+// that cross it are set over that, and the row is pushed; the same pixels as filling
+// the box and drawing the glyphs over it, without sending any of them twice
+bool TFT_eSPI::drawFreeFontBox(const char *string, int32_t poX, int32_t poY, int32_t bx, int32_t by, int32_t bw, int32_t bh, int16_t &sumX)
+{
+  if (!directWindow() || _vpOoB || bw < 1 || bh < 1) return false;
+
+  struct Placed { int16_t x, y; uint8_t w, h; uint32_t bo; }; // Bitmap corner in the box
+  Placed glyphs[GFXFF_BOX_GLYPHS];
+  uint8_t count = 0;
+  uint8_t size = textsize;
+  uint16_t first = pgm_read_word(&gfxFont->first);
+  uint16_t last  = pgm_read_word(&gfxFont->last);
+  uint8_t *bitmap = (uint8_t *)pgm_read_dword(&gfxFont->bitmap);
+
+  int32_t pen = 0;
+  uint16_t len = strlen(string);
+  uint16_t n = 0;
+  while (n < len) {
+    uint16_t c = decodeUTF8((uint8_t*)string, &n, len - n);
+    if (c < first || c > last) continue;
+    GFXglyph *glyph = &(((GFXglyph *)pgm_read_dword(&gfxFont->glyph))[c - first]);
+    uint8_t w = pgm_read_byte(&glyph->width);
+    uint8_t h = pgm_read_byte(&glyph->height);
+    if (w && h) {
+      int32_t gx = poX + pen + (int8_t)pgm_read_byte(&glyph->xOffset) * size - bx;
+      int32_t gy = poY + (int8_t)pgm_read_byte(&glyph->yOffset) * size - by;
+      // Ink outside the box is drawn by the glyph by glyph path
+      if (count == GFXFF_BOX_GLYPHS || gx < 0 || gy < 0 || gx + w * size > bw || gy + h * size > bh) return false;
+      glyphs[count++] = { (int16_t)gx, (int16_t)gy, w, h, pgm_read_word(&glyph->bitmapOffset) };
+    }
+    pen += pgm_read_byte(&glyph->xAdvance) * size;
+  }
+
+  sumX = pen;
+
+  // The box clipped to the viewport, dx and dy are the columns and rows cut off
+  int32_t x = bx + _xDatum, y = by + _yDatum;
+  int32_t dx = 0, dy = 0, dw = bw, dh = bh;
+  if (x < _vpX) { dx = _vpX - x; dw -= dx; x = _vpX; }
+  if (y < _vpY) { dy = _vpY - y; dh -= dy; y = _vpY; }
+  if ((x + dw) > _vpW) dw = _vpW - x;
+  if ((y + dh) > _vpH) dh = _vpH - y;
+  if (dw < 1 || dh < 1) return true;
+
+  uint16_t fg = textcolor, bg = textbgcolor;
+  if (!_swapBytes) { // In the order pushPixels() sends them
+    fg = fg >> 8 | fg << 8;
+    bg = bg >> 8 | bg << 8;
+  }
+  uint16_t line[dw];
+
+  begin_tft_write();
+  inTransaction = true;
+
+  setWindow(x, y, x + dw - 1, y + dh - 1);
+
+  for (int32_t r = dy; r < dy + dh; r++) {
+    for (int32_t i = 0; i < dw; i++) line[i] = bg;
+    for (uint8_t g = 0; g < count; g++) {
+      const Placed &p = glyphs[g];
+      if (r < p.y || r >= p.y + p.h * size) continue;
+      // Glyph bitmaps are one bit stream, rows are not byte aligned
+      uint32_t bitPos = (uint32_t)((r - p.y) / size) * p.w;
+      for (uint8_t xx = 0; xx < p.w; xx++, bitPos++) {
+        if (!(pgm_read_byte(&bitmap[p.bo + (bitPos >> 3)]) & (0x80 >> (bitPos & 7)))) continue;
+        int32_t col = p.x + xx * size - dx;
+        for (uint8_t k = 0; k < size; k++, col++)
+          if (col >= 0 && col < dw) line[col] = fg;
+      }
+    }
+    pushPixels(line, dw);
+  }
+
+  inTransaction = lockTransaction;
+  end_tft_write();
+  return true;
+}
+#endif
+
+
 /***************************************************************************************
 ** Function name:           drawCentreString (deprecated, use setTextDatum())
 ** Descriptions:            draw string centred on dX
@@ -6143,10 +6782,22 @@ void TFT_eSPI::getSetup(setup_t &tft_settings)
   #include "Extensions/Touch.cpp"
 #endif
 
+#include "Extensions/Color_convert.cpp"
+
 #include "Extensions/Button.cpp"
 
+#include "Extensions/Arc_meter.cpp"
+
 #include "Extensions/Sprite.cpp"
 
+#include "Extensions/Glyph_cache.cpp"
+
+#include "Extensions/Image_DMA.cpp"
+
+#ifdef TFT_STATS
+  #include "Extensions/Bus_stats.cpp"
+#endif
+
 #ifdef SMOOTH_FONT
   #include "Extensions/Smooth_font.cpp"
 #endif
@@ -93,7 +93,10 @@
 #endif
 
 // Include the processor specific drivers
-#if defined(CONFIG_IDF_TARGET_ESP32S3)
+#if defined (TFT_HOST)
+  #include "Processors/TFT_eSPI_Host.h"
+  #define GENERIC_PROCESSOR
+#elif defined(CONFIG_IDF_TARGET_ESP32S3)
   #include "Processors/TFT_eSPI_ESP32_S3.h"
 #elif defined(CONFIG_IDF_TARGET_ESP32C3)
   #include "Processors/TFT_eSPI_ESP32_C3.h"
@@ -423,6 +426,37 @@ int16_t tch_spi_freq;// Touch controller read/write SPI frequency
 // Callback prototype for smooth font pixel colour read
 typedef uint16_t (*getColorCallback)(uint16_t x, uint16_t y);
 
+// Image decoder for drawImageDMA(), see Extensions/Image_decoder.h
+class TFT_eImageDecoder;
+
+// JPEG and PNG decoders built on the tjpgd and tinfl code in the ESP32 and ESP32-S3 ROM
+#if defined (CONFIG_IDF_TARGET_ESP32S3) || defined (CONFIG_IDF_TARGET_ESP32)
+  #define TFT_ROM_DECODERS
+#endif
+
+// Bus use counted with TFT_STATS defined, see getStats(). The counters wrap, so
+// take rates from the difference of two readings.
+typedef struct
+{
+uint32_t transactions; // Times the TFT was selected for writing
+uint32_t windows;      // Address windows set, drawPixel() ones included
+uint32_t pixels;       // Pixels written by the CPU
+uint32_t dmaTransfers; // DMA transfers queued (ESP32 processors only)
+uint32_t dmaPixels;    // Pixels written by DMA
+uint32_t bytes;        // Bus bytes, from the pixel and window counts
+uint32_t heldUs;       // Microseconds the TFT was selected for writing
+} tft_stats_t;
+
+#ifdef TFT_STATS
+  #define TFT_STAT_PIXELS(n) _stats.pixels += (n)
+  #define TFT_STAT_WINDOW    _stats.windows++
+  #define TFT_STAT_DMA(n)    { _stats.dmaTransfers++; _stats.dmaPixels += (n); }
+#else
+  #define TFT_STAT_PIXELS(n)
+  #define TFT_STAT_WINDOW
+  #define TFT_STAT_DMA(n)
+#endif
+
 // Class functions and variables
 class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has access to protected members
 
@@ -460,6 +494,9 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
   virtual void     begin_nin_write();
   virtual void     end_nin_write();
 
+                   // True when setWindow() and pushPixels() stream to the panel
+  virtual bool     directWindow(void) { return true; }
+
   void     setRotation(uint8_t r); // Set the display image orientation to 0, 1, 2 or 3
   uint8_t  getRotation(void);      // Read the current rotation
 
@@ -471,6 +508,21 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
 
   void     invertDisplay(bool i);  // Tell TFT to invert all displayed colours
 
+  // Hardware scroll of the panel's native rows, the rotation 0 y axis (across the screen
+  // in landscape). top and bottom rows stay fixed and the rows between show frame memory
+  // from start on, wrapping, so a scrolled view only redraws the row it brings in.
+  // Drivers with TFT_VSCRDEF in their _Defines.h file (ILI9341, ILI948x, ST7789, ST7796),
+  // a no-op on others. Panels shorter than the frame memory are taken to start at its
+  // first row, which leaves out those with a row offset in portrait (e.g. 135x240).
+  void     setScrollArea(uint16_t top, uint16_t bottom); // Also scrolls back to top
+  void     scrollTo(uint16_t start);  // Row shown first, from top to the area's end - 1
+
+           // Scroll a log or terminal view by lines, up (content moves up) when positive,
+           // wrapping in the area. Returns the first row to draw what came into view at:
+           // for lines > 0 the bottom lines of the area are the rows from there on, for
+           // lines < 0 the top ones. Keep the area a multiple of the text line height.
+  uint16_t scrollBy(int16_t lines);
+
 
   // The TFT_eSprite class inherits the following functions (not all are useful to Sprite class
   void     setAddrWindow(int32_t xs, int32_t ys, int32_t w, int32_t h); // Note: start coordinates + width and height
@@ -533,6 +585,13 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            drawTriangle(int32_t x1,int32_t y1, int32_t x2,int32_t y2, int32_t x3,int32_t y3, uint32_t color),
            fillTriangle(int32_t x1,int32_t y1, int32_t x2,int32_t y2, int32_t x3,int32_t y3, uint32_t color);
 
+           // The same filled shapes on a known background: the bounding box is sent as one window,
+           // each row as runs of bg_color and color, instead of a window per row. Sprites draw
+           // the box in bg_color, then the shape.
+  void     fillCircle(int32_t x, int32_t y, int32_t r, uint32_t color, uint32_t bg_color),
+           fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t radius, uint32_t color, uint32_t bg_color),
+           fillTriangle(int32_t x1,int32_t y1, int32_t x2,int32_t y2, int32_t x3,int32_t y3, uint32_t color, uint32_t bg_color);
+
 
   // Smooth (anti-aliased) graphics drawing
            // Draw a pixel blended with the background pixel colour (bg_color) specified,  return blended colour
@@ -579,6 +638,10 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            // If bg_color is not included the background pixel colour will be read from TFT or sprite
   void     drawWedgeLine(float ax, float ay, float bx, float by, float aw, float bw, uint32_t fg_color, uint32_t bg_color = 0x00FFFFFF);
 
+           // Blend fg_color over a run of w pixels from x,y with one alpha per pixel, in one window
+           // If bg_color is not included the run is read back from TFT or sprite in one go
+  virtual void drawAlphaSpan(int32_t x, int32_t y, int32_t w, const uint8_t *alpha, uint32_t fg_color, uint32_t bg_color = 0x00FFFFFF);
+
 
   // Image rendering
            // Swap the byte order for pushImage() and pushPixels() - corrects endianness
@@ -622,6 +685,16 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            // Render a 16-bit colour image with a 1bpp mask
   void     pushMaskedImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *img, uint8_t *mask);
 
+           // For a 16-bit image with a transparent colour that is pushed often: list the opaque spans
+           // of each row once (free() the list when done, nullptr if there is no memory), then each
+           // push is one window and pushPixels() per span instead of a test of every pixel
+  uint16_t* createSpanList(int32_t w, int32_t h, const uint16_t *data, uint16_t transparent);
+  void     pushImageSpans(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data, const uint16_t *spans);
+
+           // Render a run length encoded image made by Tools/bmp2rle, from RAM or FLASH. Runs of one
+           // colour become pushBlock() calls, and transparent runs are skipped
+  void     pushImageRLE(int32_t x, int32_t y, const uint8_t *data);
+
            // This next function has been used successfully to dump the TFT screen to a PC for documentation purposes
            // It reads a screen area and returns the 3 RGB 8-bit colour values of each pixel in the buffer
            // Set w and h to 1 to read 1 pixel's colour. The data buffer must be at least w * h * 3 bytes
@@ -742,6 +815,8 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
   // Direct Memory Access (DMA) support functions
   // These can be used for SPI writes when using the ESP32 (original) or STM32 processors.
   // DMA also works on a RP2040 processor with PIO based SPI and parallel (8 and 16-bit) interfaces
+  // On the ESP32 S3 8-bit parallel displays push through the LCD_CAM i80 bus with GDMA; the
+  // pixels must then be in internal RAM, and a push may be longer than 64 Kbytes
            // Bear in mind DMA will only be of benefit in particular circumstances and can be tricky
            // to manage by noobs. The functions have however been designed to be noob friendly and
            // avoid a few DMA behaviour "gotchas".
@@ -776,6 +851,7 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            //
            // Note 1: If swapping colour bytes is defined, and the double buffer option is NOT used, then the bytes
            // in the original image buffer content will be byte swapped by the function before DMA is initiated.
+           // On the ESP32 S3 an unclipped image is swapped on the way instead and keeps its content.
            //
            // Note 2: If part of the image will be off screen or outside of a set viewport, then the the original
            // image buffer content will be altered to a correctly clipped image before DMA is initiated.
@@ -795,6 +871,14 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
   bool     dmaBusy(void); // returns true if DMA is still in progress
   void     dmaWait(void); // wait until DMA is complete
 
+#if (defined (CONFIG_IDF_TARGET_ESP32S3) && defined (ESP32_DMA)) || defined (RP2040_DMA)
+           // Called from the DMA interrupt once the pixels of each pushImageDMA() or pushPixelsDMA()
+           // call are out, with the data pointer that call was given (or its copy buffer), so that
+           // buffer can be reused. Keep it short (and in IRAM on the S3), e.g. vTaskNotifyGiveFromISR()
+           // to wake a task that renders the next band. nullptr turns it off.
+  void     setDMACallback(void (*callback)(const uint16_t* data, void* arg), void* arg = nullptr);
+#endif
+
   bool     DMA_Enabled = false;   // Flag for DMA enabled state
   uint8_t  spiBusyCheck = 0;      // Number of ESP32 transfer buffers to check
 
@@ -861,6 +945,25 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
            // Temporary  library development function  TODO: remove need for this
   void     pushSwapBytePixels(const void* data_in, uint32_t len);
 
+           // 1 bit images, MSB first (drawBitmap) or LSB first (drawXBitmap)
+  void     drawBitmapRuns(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t color, bool lsbFirst),
+           drawBitmapBlock(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint16_t fgcolor, uint16_t bgcolor, bool lsbFirst);
+
+#ifdef LOAD_GFXFF
+           // A free font string on its background as one window of rows composed in a line buffer,
+           // the box at bx, by with the pen starting at poX and the baseline at poY. False, with
+           // nothing drawn, for a Sprite or when a glyph reaches out of the box.
+  bool     drawFreeFontBox(const char *string, int32_t poX, int32_t poY, int32_t bx, int32_t by, int32_t bw, int32_t bh, int16_t &sumX);
+#endif
+
+           // Row y of a filled shape spans a to b inclusive, a > b for none
+  typedef void (*ShapeSpan)(const void *shape, int32_t y, int32_t &a, int32_t &b);
+           // Shape rows in the box at x, y as one window of runs on bg_color
+  void     fillSpans(int32_t x, int32_t y, int32_t w, int32_t h, ShapeSpan span, const void *shape, uint32_t color, uint32_t bg_color);
+
+           // Both anti-aliased ends of a row of fillSmoothCircle/fillSmoothRoundRect
+  void     drawSmoothEdges(int32_t xl, int32_t xr, int32_t y, const uint8_t *edge, int32_t n, uint32_t color, uint32_t bg_color);
+
            // Same as setAddrWindow but exits with CGRAM in read mode
   void     readAddrWindow(int32_t xs, int32_t ys, int32_t w, int32_t h);
 
@@ -947,6 +1050,9 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
 
   bool     _fillbg;    // Fill background flag (just for for smooth fonts at the moment)
 
+  uint16_t _scrollTop = 0, _scrollEnd = 0; // Hardware scrolling area rows, end exclusive
+  uint16_t _scrollStart = 0;               // Row shown first in it
+
 #if defined (SSD1963_DRIVER)
   uint16_t Cswap;      // Swap buffer for SSD1963
   uint8_t r6, g6, b6;  // RGB buffer for SSD1963
@@ -974,6 +1080,17 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
     #endif
 #endif
 
+// Load the bus use counters
+#ifdef TFT_STATS
+  #include "Extensions/Bus_stats.h"
+#endif
+
+// Load the glyph cache for the built-in fonts
+#include "Extensions/Glyph_cache.h"
+
+// Load the image pipeline, decoding into alternating DMA buffers
+#include "Extensions/Image_DMA.h"
+
 // Load the Anti-aliased font extension
 #ifdef SMOOTH_FONT
   #include "Extensions/Smooth_font.h"  // Loaded if SMOOTH_FONT is defined by user
@@ -985,6 +1102,30 @@ class TFT_eSPI : public Print { friend class TFT_eSprite; // Sprite class has ac
 template <typename T> static inline void
 transpose(T& a, T& b) { T t = a; a = b; b = t; }
 
+// Blend one colour over a run of pixels, each with its own alpha, 255 being opaque.
+// bg is nullptr for one background colour, else it holds a colour per pixel; swap is
+// set for colours in panel (swapped) byte order, in and out.
+static inline void
+alphaBlendSpan(uint16_t *out, const uint16_t *bg, uint16_t bgc, const uint8_t *alpha, int32_t len, uint16_t fgc, bool swap)
+{
+  // Foreground channels split out once for the run
+  uint32_t fgrb = fgc & 0xF81F;
+  uint32_t fgg  = fgc & 0x07E0;
+
+  for (int32_t i = 0; i < len; i++) {
+    uint16_t b = bg ? bg[i] : bgc;
+    if (bg && swap) b = b << 8 | b >> 8;
+    uint8_t a = alpha[i];
+    if (a == 255) { out[i] = swap ? (uint16_t)(fgc << 8 | fgc >> 8) : fgc; continue; }
+    uint32_t rxb = b & 0xF81F;
+    rxb += (fgrb - rxb) * (a >> 2) >> 6;
+    uint32_t xgx = b & 0x07E0;
+    xgx += (fgg - xgx) * a >> 8;
+    uint16_t c = (rxb & 0xF81F) | (xgx & 0x07E0);
+    out[i] = swap ? (uint16_t)(c << 8 | c >> 8) : c;
+  }
+}
+
 // Fast alphaBlend
 template <typename A, typename F, typename B> static inline uint16_t
 fastBlend(A alpha, F fgc, B bgc)
@@ -1002,10 +1143,22 @@ fastBlend(A alpha, F fgc, B bgc)
 /***************************************************************************************
 **                         Section 10: Additional extension classes
 ***************************************************************************************/
+// Load the bulk colour conversions
+#include "Extensions/Color_convert.h"
+
 // Load the Button Class
 #include "Extensions/Button.h"
 
+// Load the arc meter Class
+#include "Extensions/Arc_meter.h"
+
 // Load the Sprite Class
 #include "Extensions/Sprite.h"
 
+// Load the Canvas template, compile time depth drawing into a Sprite
+#include "Extensions/Canvas.h"
+
+// Load the image decoders for drawImageDMA()
+#include "Extensions/Image_decoder.h"
+
 #endif // ends #ifndef _TFT_eSPIH_
@@ -111,6 +111,7 @@ Software License Agreement (FreeBSD License)
 
 
 import java.awt.Desktop; // Required to allow sketch to open file windows
+import java.util.TreeSet; // Sorts the characters and drops duplicates
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -365,6 +366,16 @@ static final int[] specificUnicodes = {
   //*/
 };
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Subsetting: instead of the Unicode blocks above, include only the characters of a sample text, e.g. the templates    //
+// a device prints. Put the text in sampleText, or in a UTF-8 file in the sketch "data" folder named in sampleFile.      //
+// The specific Unicodes above are added to it. Leave both empty to use the blocks. A font of only the glyphs that are  //
+// used loads faster and takes less RAM on the device, TFT_eSPI allocates the glyph metrics per glyph.                  //
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+String sampleText = "";
+String sampleFile = ""; // e.g. "templates.txt"
+
 //                       >>>>>>>>>> USER CONFIGURED PARAMETERS END HERE <<<<<<<<<<
 
 ////////////////////////////////////////////////////////////////////////////////////////////////
@@ -405,28 +416,57 @@ void setup() {
   char[]   charset;
   int  index = 0, count = 0;
 
-  int blockCount = unicodeBlocks.length;
+  // Glyphs are written in code order, so TFT_eSPI finds them by binary search
+  TreeSet<Integer> codes = new TreeSet<Integer>();
 
-  for (int i = 0; i < blockCount; i+=2) {
-    firstUnicode = unicodeBlocks[i];
-    lastUnicode  = unicodeBlocks[i+1];
-    if (lastUnicode < firstUnicode) {
+  String sample = sampleText;
+  if (sampleFile.length() > 0) {
+    String[] lines = loadStrings(sampleFile);
+    if (lines == null) {
       delay(100);
-      System.err.println("ERROR: Bad Unicode range secified, last < first!");
-      System.err.print("first in range = 0x" + hex(firstUnicode, 4));
-      System.err.println(", last in range  = 0x" + hex(lastUnicode, 4));
+      System.err.println("ERROR: Sample file " + sampleFile + " not found in the data folder!");
       while (true);
     }
-    // calculate the number of characters
-    count += (lastUnicode - firstUnicode + 1);
+    sample += join(lines, "");
   }
 
-  count += specificUnicodes.length;
+  int blockCount = unicodeBlocks.length;
+
+  if (sample.length() > 0) {
+    for (int i = 0; i < sample.length(); i++) {
+      char c = sample.charAt(i);
+      // Control codes are not drawn and 16-bit codes only, so no surrogate pairs
+      if (c >= 0x20 && !Character.isSurrogate(c)) codes.add((int)c);
+    }
+    println();
+    println("Characters in the sample text = " + codes.size());
+  }
+  else {
+    for (int i = 0; i < blockCount; i+=2) {
+      firstUnicode = unicodeBlocks[i];
+      lastUnicode  = unicodeBlocks[i+1];
+      if (lastUnicode < firstUnicode) {
+        delay(100);
+        System.err.println("ERROR: Bad Unicode range secified, last < first!");
+        System.err.print("first in range = 0x" + hex(firstUnicode, 4));
+        System.err.println(", last in range  = 0x" + hex(lastUnicode, 4));
+        while (true);
+      }
+      // loading the range specified
+      for (int code = firstUnicode; code <= lastUnicode; code++) codes.add(code);
+    }
+  }
+
+  // loading the specific point codes
+  for (int i = 0; i < specificUnicodes.length; i++) codes.add(specificUnicodes[i]);
+
+  count = codes.size();
 
   println();
   println("=====================");
   println("Creating font file...");
-  println("Unicode blocks included     = " + (blockCount/2));
+  if (sample.length() > 0) println("Subset of the sample text");
+  else println("Unicode blocks included     = " + (blockCount/2));
   println("Specific unicodes included  = " + specificUnicodes.length);
   println("Total number of characters  = " + count);
 
@@ -439,20 +479,8 @@ void setup() {
   // allocate memory
   charset = new char[count];
 
-  for (int i = 0; i < blockCount; i+=2) {
-    firstUnicode = unicodeBlocks[i];
-    lastUnicode  =  unicodeBlocks[i+1];
-
-    // loading the range specified
-    for (int code = firstUnicode; code <= lastUnicode; code++) {
-      charset[index] = Character.toChars(code)[0];
-      index++;
-    }
-  }
-
-  // loading the specific point codes
-  for (int i = 0; i < specificUnicodes.length; i++) {
-    charset[index] = Character.toChars(specificUnicodes[i])[0];
+  for (int code : codes) {
+    charset[index] = Character.toChars(code)[0];
     index++;
   }
 
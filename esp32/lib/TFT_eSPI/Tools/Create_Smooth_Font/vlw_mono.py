@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Convert a .vlw smooth font from Create_font into its 1-bit variant.
+
+The 8-bit alpha of each glyph pixel is thresholded, or Floyd-Steinberg
+dithered within the glyph, to one bit a pixel. Rows are padded to whole
+bytes, MSB first, and the version word gets VLW_MONO (0x100) so loadFont()
+reads the bitmaps that way. The header, the glyph metrics and the trailing
+font names are kept as they are. The result is about 8 times smaller and
+is drawn into 1-bit sprites a byte at a time.
+
+    vlw_mono.py NotoSans-20.vlw NotoSans-20-mono.vlw [--threshold 128] [--dither]
+"""
+
+import argparse
+import struct
+import sys
+
+VLW_MONO = 0x100
+HEADER_WORDS = 6
+METRIC_WORDS = 7
+
+
+def to_bits(alpha, width, height, threshold, dither):
+    rows = []
+    err = [[0.0] * (width + 2) for _ in range(2)]
+    for y in range(height):
+        row = bytearray((width + 7) // 8)
+        here, below = err[y % 2], err[(y + 1) % 2]
+        for i in range(len(below)):
+            below[i] = 0.0
+        for x in range(width):
+            value = alpha[y * width + x] + (here[x + 1] if dither else 0)
+            on = value >= threshold
+            if on:
+                row[x >> 3] |= 0x80 >> (x & 7)
+            if dither:
+                e = value - (255 if on else 0)
+                here[x + 2] += e * 7 / 16
+                below[x] += e * 3 / 16
+                below[x + 1] += e * 5 / 16
+                below[x + 2] += e * 1 / 16
+        rows.append(bytes(row))
+    return b"".join(rows)
+
+
+def convert(data, threshold, dither):
+    header = list(struct.unpack_from(">%dI" % HEADER_WORDS, data, 0))
+    if header[1] & VLW_MONO:
+        raise ValueError("already a 1-bit font")
+    count = header[0]
+    metrics_end = HEADER_WORDS * 4 + count * METRIC_WORDS * 4
+    metrics = [struct.unpack_from(">%dI" % METRIC_WORDS, data, HEADER_WORDS * 4 + i * METRIC_WORDS * 4)
+               for i in range(count)]
+
+    bitmaps = []
+    offset = metrics_end
+    for unicode, height, width, *_ in metrics:
+        size = width * height
+        bitmaps.append(to_bits(data[offset:offset + size], width, height, threshold, dither))
+        offset += size
+
+    header[1] |= VLW_MONO
+    return (struct.pack(">%dI" % HEADER_WORDS, *header) + data[HEADER_WORDS * 4:metrics_end] +
+            b"".join(bitmaps) + data[offset:])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source")
+    parser.add_argument("target")
+    parser.add_argument("--threshold", type=int, default=128, help="alpha from which a pixel is set")
+    parser.add_argument("--dither", action="store_true", help="diffuse the rounding error within each glyph")
+    args = parser.parse_args()
+
+    with open(args.source, "rb") as f:
+        data = f.read()
+    try:
+        mono = convert(data, args.threshold, args.dither)
+    except ValueError as e:
+        sys.exit("%s: %s" % (args.source, e))
+    with open(args.target, "wb") as f:
+        f.write(mono)
+    print("%s: %d -> %d bytes" % (args.target, len(data), len(mono)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Cut a .vlw smooth font from Create_font down to the glyphs a text needs.
+
+Glyphs are kept for the characters of the sample text and files and the
+listed codes, each once, and written in code order so loadFont() finds
+them by binary search. loadMetrics() reads and allocates per glyph, so a
+font of a few dozen glyphs instead of thousands loads in a fraction of the
+time and RAM. The header and the trailing font names are kept as they are;
+1-bit fonts from vlw_mono.py work too.
+
+    vlw_subset.py NotoSans-20.vlw NotoSans-20-sub.vlw --text "Job 0123456789" \\
+        --text-file templates/label.txt --codes 0x20-0x7E,0xB0
+"""
+
+import argparse
+import struct
+import sys
+
+VLW_MONO = 0x100
+HEADER_WORDS = 6
+METRIC_WORDS = 7
+
+
+def parse_codes(spec):
+    codes = set()
+    for part in spec.split(","):
+        part = part.strip()
+        if not part:
+            continue
+        first, _, last = part.partition("-")
+        first = int(first, 0)
+        last = int(last, 0) if last else first
+        if last < first:
+            raise ValueError("bad range %s" % part)
+        codes.update(range(first, last + 1))
+    return codes
+
+
+def subset(data, wanted):
+    header = list(struct.unpack_from(">%dI" % HEADER_WORDS, data, 0))
+    count = header[0]
+    mono = header[1] & VLW_MONO
+    metrics_end = HEADER_WORDS * 4 + count * METRIC_WORDS * 4
+    if metrics_end > len(data):
+        raise ValueError("not a .vlw font")
+
+    glyphs = {}
+    offset = metrics_end
+    for i in range(count):
+        metric = struct.unpack_from(">%dI" % METRIC_WORDS, data, HEADER_WORDS * 4 + i * METRIC_WORDS * 4)
+        unicode, height, width = metric[:3]
+        size = ((width + 7) // 8) * height if mono else width * height
+        # The first glyph of a code is the one loadFont() draws
+        if unicode in wanted and unicode not in glyphs:
+            glyphs[unicode] = (metric, data[offset:offset + size])
+        offset += size
+    if offset > len(data):
+        raise ValueError("glyph bitmaps cut short")
+
+    codes = sorted(glyphs)
+    header[0] = len(codes)
+    out = [struct.pack(">%dI" % HEADER_WORDS, *header)]
+    out += [struct.pack(">%dI" % METRIC_WORDS, *glyphs[c][0]) for c in codes]
+    out += [glyphs[c][1] for c in codes]
+    out.append(data[offset:])
+    return b"".join(out), count, set(wanted) - set(codes)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source")
+    parser.add_argument("target")
+    parser.add_argument("--text", action="append", default=[], help="sample text whose characters are kept")
+    parser.add_argument("--text-file", action="append", default=[], help="UTF-8 file whose characters are kept")
+    parser.add_argument("--codes", default="", help="code points to keep, e.g. 0x20-0x7E,0xB0")
+    args = parser.parse_args()
+
+    text = "".join(args.text)
+    for name in args.text_file:
+        with open(name, encoding="utf-8") as f:
+            text += f.read()
+    try:
+        wanted = parse_codes(args.codes)
+    except ValueError as e:
+        sys.exit("--codes: %s" % e)
+    # Line ends and other control codes are never drawn
+    wanted.update(ord(c) for c in text if ord(c) >= 0x20)
+    outside = sorted(c for c in wanted if c > 0xFFFF)
+    if outside:
+        print("Skipped %d characters outside 0x0000-0xFFFF" % len(outside))
+        wanted -= set(outside)
+    if not wanted:
+        sys.exit("No characters given, use --text, --text-file or --codes")
+
+    with open(args.source, "rb") as f:
+        data = f.read()
+    try:
+        font, count, missing = subset(data, wanted)
+    except (ValueError, struct.error) as e:
+        sys.exit("%s: %s" % (args.source, e))
+    if missing:
+        print("Not in the font: " + " ".join("U+%04X" % c for c in sorted(missing)))
+    with open(args.target, "wb") as f:
+        f.write(font)
+    print("%s: %d -> %d glyphs, %d -> %d bytes" % (args.target, count, len(wanted - missing), len(data), len(font)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+'''
+
+    This script takes in an image and outputs a C array of the image
+    run length encoded, for TFT_eSPI pushImageRLE().
+
+    You'll need python 3.6 and Pillow (pip install pillow)
+
+    usage: python bmp2rle.py [-v] logo.png [-o logo.h] [-n logo] [-t ff00ff] [--no-palette]
+
+    Pixels with alpha under 128, or of the colour given with -t, become
+    transparent runs. An image of 256 colours or fewer (after reduction to
+    565) is stored with a palette and one byte a colour, others as 565 words.
+
+    Format, little endian:
+        "RL", format (0 = 565 colours, 1 = palette), palette size - 1,
+        width, height, the palette as 565 words for format 1, then each
+        row as runs, none crossing a row. A run is a byte with its type
+        in the top 2 bits and its length - 1 in the low 6:
+            00 literal: length colours follow
+            01 repeat: one colour follows
+            10 transparent: nothing follows
+
+'''
+
+import argparse
+import os
+import struct
+import sys
+
+from PIL import Image
+
+LITERAL = 0
+REPEAT = 1
+TRANSPARENT = 2
+MAX_RUN = 64
+
+debug = None
+
+def debugOut(s):
+    if debug:
+        print(s)
+
+def to565(r, g, b):
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)
+
+def encodeRow(row, colour, repeatMin):
+    # row holds 565 colours, None for transparent pixels
+    out = bytearray()
+    literal = []
+
+    def flushLiteral():
+        while literal:
+            part = literal[:MAX_RUN]
+            del literal[:MAX_RUN]
+            out.append(LITERAL << 6 | (len(part) - 1))
+            for c in part:
+                out.extend(colour(c))
+
+    i = 0
+    while i < len(row):
+        n = 1
+        while i + n < len(row) and n < MAX_RUN and row[i + n] == row[i]:
+            n += 1
+        if row[i] is None:
+            flushLiteral()
+            out.append(TRANSPARENT << 6 | (n - 1))
+        elif n >= repeatMin:
+            flushLiteral()
+            out.append(REPEAT << 6 | (n - 1))
+            out.extend(colour(row[i]))
+        else:
+            literal.extend(row[i:i + n])
+        i += n
+    flushLiteral()
+    return out
+
+# look at arguments
+parser = argparse.ArgumentParser(description="Convert an image to a run length encoded C array")
+parser.add_argument("-v", "--verbose", help="debug output", action="store_true")
+parser.add_argument("input", help="input file name")
+parser.add_argument("-o", "--output", help="output file name")
+parser.add_argument("-n", "--name", help="array name, the input file name by default")
+parser.add_argument("-t", "--transparent", help="colour to make transparent as RRGGBB")
+parser.add_argument("--no-palette", help="always store 565 colours", action="store_true")
+args = parser.parse_args()
+
+if not os.path.exists(args.input):
+    parser.print_help()
+    print("The input file {} does not exist".format(args.input))
+    sys.exit(1)
+
+base = os.path.splitext(os.path.basename(args.input))[0]
+output = args.output if args.output else base + ".h"
+name = args.name if args.name else "".join(c if c.isalnum() else "_" for c in base)
+debug = args.verbose
+
+key = None
+if args.transparent:
+    key = int(args.transparent, 16)
+    key = to565(key >> 16, (key >> 8) & 0xFF, key & 0xFF)
+
+image = Image.open(args.input).convert("RGBA")
+width, height = image.size
+if width > 0xFFFF or height > 0xFFFF:
+    print("The image is too large")
+    sys.exit(1)
+
+pixels = image.load()
+rows = []
+for y in range(height):
+    row = []
+    for x in range(width):
+        r, g, b, a = pixels[x, y]
+        c = to565(r, g, b)
+        row.append(None if a < 128 or c == key else c)
+    rows.append(row)
+
+colours = sorted({c for row in rows for c in row if c is not None})
+usePalette = not args.no_palette and 0 < len(colours) <= 256
+debugOut("{} x {}, {} colours".format(width, height, len(colours)))
+
+data = bytearray(b"RL")
+if usePalette:
+    index = {c: i for i, c in enumerate(colours)}
+    data.extend(struct.pack("<BBHH", 1, len(colours) - 1, width, height))
+    for c in colours:
+        data.extend(struct.pack("<H", c))
+    colour = lambda c: bytes([index[c]])
+    repeatMin = 3   # A repeat of 2 takes as many bytes as 2 literals
+else:
+    data.extend(struct.pack("<BBHH", 0, 0, width, height))
+    colour = lambda c: struct.pack("<H", c)
+    repeatMin = 2
+
+for row in rows:
+    data.extend(encodeRow(row, colour, repeatMin))
+
+raw = width * height * 2
+print("{}: {} bytes, {} as a 16 bit image ({:.1f}x)".format(output, len(data), raw, raw / len(data)))
+
+with open(output, "w") as outfile:
+    outfile.write("// {} x {} run length encoded image from {}, for pushImageRLE()\n".format(width, height, os.path.basename(args.input)))
+    outfile.write("// {} bytes\n\n".format(len(data)))
+    outfile.write("const uint8_t {}[] PROGMEM = {{\n".format(name))
+    for i in range(0, len(data), 16):
+        outfile.write("  " + ", ".join("0x{:02X}".format(b) for b in data[i:i + 16]) + ",\n")
+    outfile.write("};\n")
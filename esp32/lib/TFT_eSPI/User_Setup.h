@@ -327,6 +327,14 @@
 //
 // ##################################################################################
 
+// Uncomment to count bus transactions, address windows and pixels and the time the
+// TFT is held selected, read back with tft.getStats(). Costs a few cycles per call.
+//#define TFT_STATS
+
+// Define (with -DTFT_HOST) for a PC build that draws into a framebuffer in memory and
+// counts the bus bytes, see Processors/TFT_eSPI_Host.h.
+//#define TFT_HOST
+
 // For RP2040 processor and SPI displays, uncomment the following line to use the PIO interface.
 //#define RP2040_PIO_SPI // Leave commented out to use standard RP2040 SPI port interface
 
@@ -72,8 +72,9 @@ void setup() {
   // Change colour for scrolling zone text
   tft.setTextColor(TFT_WHITE, TFT_BLACK);
 
-  // Setup scroll area
-  setupScrollArea(TOP_FIXED_AREA, BOT_FIXED_AREA);
+  // Setup scroll area, we are using a hardware feature of the display, so we can only
+  // scroll in portrait orientation
+  tft.setScrollArea(TOP_FIXED_AREA, BOT_FIXED_AREA);
 
   // Zero the array
   for (byte i = 0; i<18; i++) blank[i]=0;
@@ -119,30 +120,6 @@ int scroll_line() {
   // The value must wrap around as the screen memory is a circular buffer
   if (yStart >= YMAX - BOT_FIXED_AREA) yStart = TOP_FIXED_AREA + (yStart - YMAX + BOT_FIXED_AREA);
   // Now we can scroll the display
-  scrollAddress(yStart);
+  tft.scrollTo(yStart);
   return  yTemp;
 }
-
-// ##############################################################################################
-// Setup a portion of the screen for vertical scrolling
-// ##############################################################################################
-// We are using a hardware feature of the display, so we can only scroll in portrait orientation
-void setupScrollArea(uint16_t tfa, uint16_t bfa) {
-  tft.writecommand(ILI9341_VSCRDEF); // Vertical scroll definition
-  tft.writedata(tfa >> 8);           // Top Fixed Area line count
-  tft.writedata(tfa);
-  tft.writedata((YMAX-tfa-bfa)>>8);  // Vertical Scrolling Area line count
-  tft.writedata(YMAX-tfa-bfa);
-  tft.writedata(bfa >> 8);           // Bottom Fixed Area line count
-  tft.writedata(bfa);
-}
-
-// ##############################################################################################
-// Setup the vertical scrolling start address pointer
-// ##############################################################################################
-void scrollAddress(uint16_t vsp) {
-  tft.writecommand(ILI9341_VSCRSADD); // Vertical scrolling pointer
-  tft.writedata(vsp>>8);
-  tft.writedata(vsp);
-}
-
@@ -0,0 +1,275 @@
+/*
+  Times each rendering primitive of the library and prints the results as
+  CSV over serial, one line per test:
+
+    test,bpp,variant,pixels,calls,cycles_per_call,us_per_call,mpixels_per_s
+
+  "pixels" is the number of pixels one call covers, so the last column
+  compares primitives of different sizes. Copy the serial output into a
+  spreadsheet, or diff two runs to see what a change to the library or the
+  setup did. Lines starting with # describe the board and the display.
+
+  Covered are fills, lines, pixels and smooth graphics, 16-bit images and
+  1-bit bitmaps, text in each loaded font (GLCD, the numbered fonts, a GFX
+  free font and a smooth font, with and without the glyph cache), sprites
+  of 1, 4, 8 and 16 bits per pixel pushed to the screen, rotated and
+  blitted into another sprite, and pushImage() against pushImageDMA() where
+  the processor and bus support DMA.
+
+  The smooth font is loaded from LittleFS: upload the data folder of the
+  "Smooth Fonts/LittleFS/Font_Demo_1" example first, or the smooth font
+  tests are skipped.
+
+  On ESP32 and ESP8266 the cycles come from the CPU cycle counter. On other
+  processors they are worked out from micros() and F_CPU.
+
+  #########################################################################
+  ###### DON'T FORGET TO UPDATE THE User_Setup.h FILE IN THE LIBRARY ######
+  #########################################################################
+*/
+
+#include <TFT_eSPI.h>
+
+#ifdef SMOOTH_FONT
+  #include <FS.h>
+  #include <LittleFS.h>
+  #define AA_FONT "NotoSansBold15"
+#endif
+
+TFT_eSPI tft = TFT_eSPI();
+TFT_eSprite spr = TFT_eSprite(&tft);
+TFT_eSprite dst = TFT_eSprite(&tft);
+
+#define SPRITE_SIZE 64             // Sprites and images are squares of this size
+#define MIN_TIME_US 200000         // Each test repeats for at least this long
+
+uint16_t image[SPRITE_SIZE * SPRITE_SIZE];
+uint8_t  bitmap[SPRITE_SIZE * SPRITE_SIZE / 8];
+
+#if defined (ESP32) || defined (ESP8266)
+  #define CYCLES() ESP.getCycleCount()
+  #define CPU_MHZ  (ESP.getCpuFreqMHz())
+#else
+  #define CYCLES() (micros() * (F_CPU / 1000000))
+  #define CPU_MHZ  (F_CPU / 1000000)
+#endif
+
+#if defined (ESP32_DMA) || defined (RP2040_DMA) || defined (STM32_DMA)
+  #define BENCH_DMA
+#endif
+
+typedef void (*BenchCall)(uint32_t i);
+
+void bench(const char* test, uint8_t bpp, const char* variant, uint32_t pixels, BenchCall call);
+void benchScreen();
+void benchImages();
+void benchText();
+void benchSprite(uint8_t bpp);
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+
+  tft.init();
+  tft.setRotation(1);
+  tft.fillScreen(TFT_BLACK);
+
+  for (uint32_t i = 0; i < SPRITE_SIZE * SPRITE_SIZE; i++) image[i] = i * 37;
+  for (uint32_t i = 0; i < sizeof(bitmap); i++) bitmap[i] = i * 73;
+
+#ifdef SMOOTH_FONT
+  if (!LittleFS.begin()) Serial.println("# LittleFS not mounted, smooth font tests skipped");
+#endif
+#ifdef BENCH_DMA
+  tft.initDMA();
+#endif
+}
+
+void loop() {
+  Serial.printf("# %d x %d display, rotation %d, %d MHz CPU\n", tft.width(), tft.height(), tft.getRotation(), CPU_MHZ);
+  Serial.println("test,bpp,variant,pixels,calls,cycles_per_call,us_per_call,mpixels_per_s");
+
+  benchScreen();
+  benchImages();
+  benchText();
+  for (uint8_t bpp : {1, 4, 8, 16}) benchSprite(bpp);
+
+  Serial.println("# done");
+  delay(10000);
+}
+
+// Repeat call until MIN_TIME_US has passed, then print its line. The DMA
+// tests count the time until the transfer is over.
+void bench(const char* test, uint8_t bpp, const char* variant, uint32_t pixels, BenchCall call) {
+  call(0);                         // Warm the caches and the glyph cache
+#ifdef BENCH_DMA
+  tft.dmaWait();
+#endif
+  yield();
+
+  uint32_t calls = 0;
+  uint64_t cycles = 0;
+  uint32_t start = micros();
+  do {
+    uint32_t c0 = CYCLES();
+    call(calls + 1);
+#ifdef BENCH_DMA
+    tft.dmaWait();
+#endif
+    cycles += (uint32_t)(CYCLES() - c0);
+    calls++;
+    if ((calls & 15) == 0) yield();
+  } while (micros() - start < MIN_TIME_US);
+
+  float perCall = (float)cycles / calls;
+  float us = perCall / CPU_MHZ;
+  Serial.printf("%s,%u,%s,%lu,%lu,%.0f,%.2f,%.2f\n", test, bpp, variant, (unsigned long)pixels,
+                (unsigned long)calls, perCall, us, us > 0 ? pixels / us : 0);
+}
+
+//=========================================================================
+// Screen primitives
+//=========================================================================
+void benchScreen() {
+  int32_t w = tft.width(), h = tft.height();
+
+  bench("fillScreen", 16, "", w * h, [](uint32_t i) { tft.fillScreen(i & 1 ? TFT_BLUE : TFT_BLACK); });
+  bench("fillRect", 16, "64x64", 64 * 64, [](uint32_t i) { tft.fillRect(i % 32, 0, 64, 64, i * 31); });
+  bench("fillRect", 16, "8x8", 8 * 8, [](uint32_t i) { tft.fillRect(i % 64, i % 32, 8, 8, i * 31); });
+  bench("drawPixel", 16, "", 1, [](uint32_t i) { tft.drawPixel(i % 128, (i >> 7) % 64, i * 31); });
+  bench("drawFastHLine", 16, "100", 100, [](uint32_t i) { tft.drawFastHLine(0, i % 64, 100, i * 31); });
+  bench("drawFastVLine", 16, "100", 100, [](uint32_t i) { tft.drawFastVLine(i % 128, 0, 100, i * 31); });
+  bench("drawLine", 16, "diagonal 100", 100, [](uint32_t i) { tft.drawLine(0, 0, 99, 99 - i % 8, i * 31); });
+  bench("fillCircle", 16, "r20", 1257, [](uint32_t i) { tft.fillCircle(40, 40, 20, i * 31); });
+  bench("fillSmoothCircle", 16, "r20", 1257, [](uint32_t i) { tft.fillSmoothCircle(40, 40, 20, i * 31, TFT_BLACK); });
+  bench("drawSmoothArc", 16, "r30 w6 270deg", 848, [](uint32_t i) {
+    tft.drawSmoothArc(60, 60, 30, 24, 45, 315, i * 31, TFT_BLACK, true);
+  });
+  bench("drawWideLine", 16, "100 w5", 500, [](uint32_t i) { tft.drawWideLine(10, 10, 110, 60, 5, i * 31, TFT_BLACK); });
+}
+
+//=========================================================================
+// Images and bitmaps
+//=========================================================================
+void benchImages() {
+  bench("pushImage", 16, "blocking", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) {
+    tft.pushImage(i % 32, 0, SPRITE_SIZE, SPRITE_SIZE, image);
+  });
+  bench("pushImage", 16, "clipped", SPRITE_SIZE * SPRITE_SIZE / 2, [](uint32_t i) {
+    tft.pushImage(-SPRITE_SIZE / 2, 0, SPRITE_SIZE, SPRITE_SIZE, image);
+  });
+#ifdef BENCH_DMA
+  bench("pushImageDMA", 16, "", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) {
+    tft.startWrite();
+    tft.pushImageDMA(i % 32, 0, SPRITE_SIZE, SPRITE_SIZE, (const uint16_t*)image);
+    tft.endWrite();
+  });
+#else
+  Serial.println("# no DMA on this processor or bus, pushImageDMA skipped");
+#endif
+  bench("drawBitmap", 1, "", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) {
+    tft.drawBitmap(0, 0, bitmap, SPRITE_SIZE, SPRITE_SIZE, TFT_WHITE, TFT_BLACK);
+  });
+  bench("drawXBitmap", 1, "", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) {
+    tft.drawXBitmap(0, 0, bitmap, SPRITE_SIZE, SPRITE_SIZE, TFT_WHITE, TFT_BLACK);
+  });
+}
+
+//=========================================================================
+// Text, ten characters a call
+//=========================================================================
+uint32_t textPixels() {
+  return tft.textWidth("0123456789") * tft.fontHeight();
+}
+
+void benchFont(const char* name) {
+  tft.setTextColor(TFT_WHITE, TFT_BLACK, true);
+  bench("drawString", 16, name, textPixels(), [](uint32_t i) { tft.drawString("0123456789", 0, 0); });
+}
+
+void benchText() {
+  tft.setTextDatum(TL_DATUM);
+  tft.setTextSize(1);
+
+#ifdef LOAD_GLCD
+  tft.setTextFont(1);
+  benchFont("GLCD");
+#endif
+#ifdef LOAD_FONT2
+  tft.setTextFont(2);
+  benchFont("font 2");
+#endif
+#ifdef LOAD_FONT4
+  tft.setTextFont(4);
+  benchFont("font 4");
+#endif
+#ifdef LOAD_FONT7
+  tft.setTextFont(7);
+  benchFont("font 7");
+#endif
+#ifdef LOAD_GFXFF
+  tft.setFreeFont(&FreeSans12pt7b);
+  benchFont("FreeSans12pt7b");
+  tft.setFreeFont(nullptr);
+#endif
+
+#ifdef SMOOTH_FONT
+  if (LittleFS.exists("/" AA_FONT ".vlw")) {
+    tft.loadFont(AA_FONT, LittleFS);
+    tft.setGlyphCache(0);
+    benchFont(AA_FONT);
+    tft.setGlyphCache(8192);
+    benchFont(AA_FONT " cached");
+    tft.setGlyphCache(0);
+    tft.unloadFont();
+  }
+  else Serial.println("# /" AA_FONT ".vlw not on LittleFS, smooth font tests skipped");
+#endif
+}
+
+//=========================================================================
+// Sprites of one colour depth
+//=========================================================================
+void benchSprite(uint8_t bpp) {
+  spr.setColorDepth(bpp);
+  if (!spr.createSprite(SPRITE_SIZE, SPRITE_SIZE)) {
+    Serial.printf("# no memory for a %u bpp sprite\n", bpp);
+    return;
+  }
+  spr.fillSprite(TFT_BLACK);
+  spr.fillCircle(SPRITE_SIZE / 2, SPRITE_SIZE / 2, SPRITE_SIZE / 3, TFT_WHITE);
+  spr.setPivot(SPRITE_SIZE / 2, SPRITE_SIZE / 2);
+  tft.setPivot(tft.width() / 2, tft.height() / 2);
+
+  bench("fillSprite", bpp, "", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) { spr.fillSprite(i & 1); });
+  spr.fillCircle(SPRITE_SIZE / 2, SPRITE_SIZE / 2, SPRITE_SIZE / 3, TFT_WHITE);
+  bench("pushSprite", bpp, "", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) { spr.pushSprite(i % 32, 0); });
+  bench("pushSprite", bpp, "transparent", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) {
+    spr.pushSprite(i % 32, 0, TFT_BLACK);
+  });
+  bench("pushRotated", bpp, "30deg", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) { spr.pushRotated(30); });
+  bench("pushRotated", bpp, "90deg", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) { spr.pushRotated(90); });
+
+#ifdef LOAD_FONT2
+  spr.setTextFont(2);
+  spr.setTextColor(TFT_WHITE, TFT_BLACK, true);
+  bench("sprite drawString", bpp, "font 2", spr.textWidth("0123456789") * spr.fontHeight(), [](uint32_t i) {
+    spr.drawString("0123456789", 0, 0);
+  });
+#endif
+
+  dst.setColorDepth(bpp);
+  if (dst.createSprite(SPRITE_SIZE * 2, SPRITE_SIZE)) {
+    bench("pushToSprite", bpp, "", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) { spr.pushToSprite(&dst, i % 32, 0); });
+    bench("pushToSprite", bpp, "transparent", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) {
+      spr.pushToSprite(&dst, i % 32, 0, TFT_BLACK);
+    });
+    if (bpp == 1 || bpp == 16) {
+      dst.deleteSprite();
+      dst.createSprite(SPRITE_SIZE, SPRITE_SIZE);
+      bench("rotateTo", bpp, "90deg", SPRITE_SIZE * SPRITE_SIZE, [](uint32_t i) { spr.rotateTo(&dst, 90); });
+    }
+    dst.deleteSprite();
+  }
+  spr.deleteSprite();
+}
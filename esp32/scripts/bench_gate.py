@@ -0,0 +1,180 @@
+# Throughput regression gate: measures a bridge and compares the numbers
+# with a baseline kept in the repository.
+#
+#   python scripts/bench_gate.py run --host 192.168.1.50 --printer fake \
+#       --render render.csv -o results.json
+#   python scripts/bench_gate.py compare bench/baselines/t-display-s3.json results.json
+#
+# `run` sweeps the printer's BLE link with POST /bench, prints --jobs small
+# jobs and takes the ms from job creation to the first BLE write from
+# /jobs/history, and reads the CSV that the TFT_eSPI Render_Benchmark
+# example prints over serial, if given. The results are one flat map of
+# metric names to numbers together with the commit they were measured on.
+#
+# `compare` prints every metric of the baseline next to the new value and
+# exits with 1 when one got worse by more than --threshold percent: bytes/s
+# that went down, or latencies and draw times that went up. A new baseline
+# is a `run` written into bench/baselines/ and committed with the change
+# that moved the numbers. Run against the fake printer (env:fake-printer),
+# whose drain rate doesn't change between runs, so the numbers compare.
+
+import argparse
+import csv
+import json
+import statistics
+import subprocess
+import sys
+import time
+import urllib.parse
+import urllib.request
+
+# ESC @ (initialize) and a line feed: a job that costs no paper to speak of
+PROBE_JOB = b"\x1b@\n"
+
+# Suffixes of metrics where a bigger number is better
+HIGHER_IS_BETTER = ("bytes_per_sec", "mpixels_per_s")
+
+
+def request(host, method, path, params=None, body=None, timeout=30):
+    url = "http://%s%s" % (host, path)
+    params = {k: v for k, v in (params or {}).items() if v is not None}
+    if params:
+        url += "?" + urllib.parse.urlencode(params)
+    req = urllib.request.Request(url, data=body, method=method)
+    with urllib.request.urlopen(req, timeout=timeout) as response:
+        return json.loads(response.read() or b"null")
+
+
+def link_metrics(host, printer, size, chunks, modes):
+    request(host, "POST", "/bench",
+            {"printer": printer, "bytes": size, "chunks": chunks, "modes": modes}, b"")
+    while True:
+        time.sleep(1)
+        results = request(host, "GET", "/bench")
+        if results["state"] != "running":
+            break
+    if results["state"] != "done":
+        sys.exit("Link benchmark %s" % results["state"])
+
+    metrics = {}
+    for run in results["runs"]:
+        if not run["ok"]:
+            continue
+        key = "link.%s.%s" % (run["chunk"], run["mode"])
+        metrics[key + ".bytes_per_sec"] = run["bytesPerSec"]
+        metrics[key + ".p50_us"] = run["p50Us"]
+        metrics[key + ".p99_us"] = run["p99Us"]
+    return metrics
+
+
+def first_write_metrics(host, printer, jobs):
+    ids = []
+    for _ in range(jobs):
+        job = request(host, "POST", "/print", {"printer": printer}, PROBE_JOB)
+        ids.append(job["id"])
+        # One at a time, so no job waits behind another
+        while request(host, "GET", "/jobs/%d" % job["id"])["status"] in ("queued", "streaming"):
+            time.sleep(0.1)
+
+    offsets = [entry["firstWrite"] for entry in request(host, "GET", "/jobs/history")
+               if entry["id"] in ids and entry["firstWrite"] is not None]
+    if not offsets:
+        return {}
+    return {"job.first_write_ms": statistics.median(offsets)}
+
+
+def render_metrics(path):
+    metrics = {}
+    with open(path) as f:
+        rows = [line for line in f if line.strip() and not line.startswith("#")]
+    for row in csv.DictReader(rows):
+        key = "display.%s.%sbpp.%s" % (row["test"], row["bpp"], row["variant"])
+        metrics[key + ".us_per_call"] = float(row["us_per_call"])
+        metrics[key + ".mpixels_per_s"] = float(row["mpixels_per_s"])
+    return metrics
+
+
+def commit():
+    try:
+        return subprocess.check_output(["git", "describe", "--always", "--dirty"], text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def run(args):
+    metrics = {}
+    if args.host:
+        metrics.update(link_metrics(args.host, args.printer, args.bytes, args.chunks, args.modes))
+        metrics.update(first_write_metrics(args.host, args.printer, args.jobs))
+    if args.render:
+        metrics.update(render_metrics(args.render))
+    if not metrics:
+        sys.exit("Nothing measured: give --host, --render or both")
+
+    results = {"commit": commit(), "date": time.strftime("%Y-%m-%d"), "metrics": metrics}
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+        f.write("\n")
+    print("%d metrics written to %s" % (len(metrics), args.output))
+
+
+def change(name, old, new):
+    # Percent by which the metric got worse, negative when it got better
+    if old == 0:
+        return 0.0
+    worse = old - new if name.endswith(HIGHER_IS_BETTER) else new - old
+    return 100.0 * worse / old
+
+
+def compare(args):
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    with open(args.results) as f:
+        results = json.load(f)
+
+    print("%s -> %s" % (baseline.get("commit"), results.get("commit")))
+    regressions = 0
+    for name, old in sorted(baseline["metrics"].items()):
+        new = results["metrics"].get(name)
+        if new is None:
+            print("  %-48s %12s   missing" % (name, old))
+            continue
+        worse = change(name, old, new)
+        flag = ""
+        if worse > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("  %-48s %12s %12s %+7.1f%%%s" % (name, old, new, -worse, flag))
+
+    if regressions:
+        print("%d metrics worse by more than %.1f%%" % (regressions, args.threshold))
+        sys.exit(1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Throughput regression gate for the bridge")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    measure = commands.add_parser("run", help="measure a bridge")
+    measure.add_argument("--host", help="address of the bridge")
+    measure.add_argument("--printer", help="printer ID to benchmark, the first one when left out")
+    measure.add_argument("--bytes", type=int, default=32768, help="bytes per link benchmark run")
+    measure.add_argument("--chunks", default="20,128,244", help="chunk sizes of the link sweep")
+    measure.add_argument("--modes", default="ack,nr", help="write modes of the link sweep")
+    measure.add_argument("--jobs", type=int, default=5, help="probe jobs for the first write time")
+    measure.add_argument("--render", help="serial output of the Render_Benchmark example")
+    measure.add_argument("-o", "--output", default="results.json")
+    measure.set_defaults(func=run)
+
+    check = commands.add_parser("compare", help="compare results with a baseline")
+    check.add_argument("baseline")
+    check.add_argument("results")
+    check.add_argument("--threshold", type=float, default=5.0, help="percent a metric may get worse")
+    check.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,129 @@
+# PlatformIO pre script: builds the LittleFS image from a packed copy of data/.
+#
+# Web assets (html, js, css, svg, json) are stored gzipped as <name>.gz and
+# served with Content-Encoding: gzip. Files below libs/ get a content hash in
+# their name, and the references to them in the other assets are rewritten,
+# so the bridge can send them with Cache-Control: immutable. /assets.txt
+# lists every packed asset with its ETag for the firmware.
+#
+# Everything else (label templates, fonts, the printer registry) is copied
+# unchanged, because the firmware reads those files itself.
+#
+# With custom_asset_bundle = yes (the default) the packed assets are also
+# compiled into the firmware: asset_bundle.h, in the build directory, holds
+# each gzipped body as a const array with its type, ETag and cache policy
+# worked out here. Const data stays in flash, mapped into the address space,
+# so include/static_assets.h serves it without LittleFS.
+
+import gzip
+import hashlib
+import os
+import shutil
+
+Import("env")
+
+COMPRESSED = (".html", ".htm", ".js", ".css", ".svg", ".json")
+FINGERPRINTED = "libs/"
+MANIFEST = "assets.txt"
+BUNDLE = "asset_bundle.h"
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".htm": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+    ".svg": "image/svg+xml",
+    ".json": "application/json",
+}
+
+
+def digest(data):
+    return hashlib.sha256(data).hexdigest()
+
+
+def fingerprinted_name(rel, data):
+    head, ext = os.path.splitext(rel)
+    return "%s.%s%s" % (head, digest(data)[:8], ext)
+
+
+def pack(source, target):
+    if os.path.isdir(target):
+        shutil.rmtree(target)
+
+    files = {}
+    for root, _, names in os.walk(source):
+        for name in names:
+            path = os.path.join(root, name)
+            rel = os.path.relpath(path, source).replace(os.sep, "/")
+            with open(path, "rb") as f:
+                files[rel] = f.read()
+
+    renamed = {}
+    for rel, data in files.items():
+        if rel.startswith(FINGERPRINTED) and rel.endswith(COMPRESSED):
+            renamed[rel] = fingerprinted_name(rel, data)
+
+    manifest = []
+    bundle = []
+    for rel in sorted(files):
+        data = files[rel]
+        out_rel = renamed.get(rel, rel)
+        out_path = os.path.join(target, out_rel)
+        os.makedirs(os.path.dirname(out_path), exist_ok=True)
+
+        if not rel.endswith(COMPRESSED):
+            with open(out_path, "wb") as f:
+                f.write(data)
+            continue
+
+        # Longest names first, so one name inside another can't be half rewritten
+        for old, new in sorted(renamed.items(), key=lambda item: -len(item[0])):
+            data = data.replace(old.encode(), new.encode())
+        # mtime=0 keeps the image identical between builds of the same data
+        body = gzip.compress(data, compresslevel=9, mtime=0)
+        with open(out_path + ".gz", "wb") as f:
+            f.write(body)
+        cache = "immutable" if rel in renamed else "revalidate"
+        manifest.append("/%s %s %s\n" % (out_rel, digest(data)[:16], cache))
+        bundle.append(("/" + out_rel, digest(data)[:16], cache == "immutable", body))
+
+    with open(os.path.join(target, MANIFEST), "w") as f:
+        f.writelines(manifest)
+    return bundle
+
+
+def write_bundle(bundle, path):
+    lines = ["// Generated by scripts/pack_data.py from data/, do not edit\n\n"]
+    for index, (_, _, _, body) in enumerate(bundle):
+        lines.append("static const uint8_t ASSET_%d[] = {\n" % index)
+        for start in range(0, len(body), 16):
+            lines.append("  %s,\n" % ",".join("0x%02x" % b for b in body[start:start + 16]))
+        lines.append("};\n")
+    lines.append("\nstatic const BundledAsset BUNDLED_ASSETS[] = {\n")
+    for index, (url, etag, immutable, body) in enumerate(bundle):
+        content_type = CONTENT_TYPES[os.path.splitext(url)[1]]
+        lines.append('  {"%s", "%s", "\\"%s\\"", %s, ASSET_%d, %d},\n'
+                     % (url, content_type, etag, "true" if immutable else "false", index, len(body)))
+    lines.append("};\n")
+
+    text = "".join(lines)
+    # Left alone when unchanged, so the build doesn't recompile it
+    if os.path.isfile(path):
+        with open(path) as f:
+            if f.read() == text:
+                return
+    with open(path, "w") as f:
+        f.write(text)
+
+
+source = env.subst("$PROJECT_DATA_DIR")
+target = os.path.join(env.subst("$PROJECT_BUILD_DIR"), env.subst("$PIOENV"), "data")
+bundle = pack(source, target)
+env.Replace(PROJECT_DATA_DIR=target)
+print("Packed %s into %s" % (source, target))
+
+if env.GetProjectOption("custom_asset_bundle", "yes") == "yes" and bundle:
+    include = os.path.join(env.subst("$PROJECT_BUILD_DIR"), env.subst("$PIOENV"), "asset_bundle")
+    os.makedirs(include, exist_ok=True)
+    write_bundle(bundle, os.path.join(include, BUNDLE))
+    env.Append(CPPPATH=[include], CPPDEFINES=[("STATIC_ASSET_BUNDLE", 1)])
+    print("Bundled %u web assets, %u bytes" % (len(bundle), sum(len(item[3]) for item in bundle)))
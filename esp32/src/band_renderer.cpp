@@ -0,0 +1,74 @@
+#include "band_renderer.h"
+#include "power_profile.h"
+
+bool BandRenderer::begin(TFT_eSPI* tft, int16_t rows) {
+  end();
+  _tft = tft;
+  _rows = rows;
+  for (uint8_t i = 0; i < 2; i++) {
+    TFT_eSprite* band = new TFT_eSprite(tft);
+    band->setColorDepth(16);
+    // PSRAM is too slow to push from
+    band->setSpriteMemory(TFT_eSprite::SPRITE_MEM_INTERNAL);
+    if (!band->createSprite(tft->width(), rows)) {
+      log_w("No memory for %dx%d bands", tft->width(), rows);
+      delete band;
+      end();
+      return false;
+    }
+    _bands[i] = band;
+  }
+  return true;
+}
+
+void BandRenderer::end() {
+  for (uint8_t i = 0; i < 2; i++) {
+    if (_bands[i]) {
+      _bands[i]->deleteSprite();
+      delete _bands[i];
+      _bands[i] = nullptr;
+    }
+  }
+}
+
+void BandRenderer::pushBand(TFT_eSprite* band, int16_t y, int16_t rows) {
+#ifdef ESP32_DMA
+  if (_tft->DMA_Enabled) {
+    // Sprite pixels are in panel byte order already. The push waits for the
+    // band before, which frees the sprite drawn into next.
+    bool swap = _tft->getSwapBytes();
+    _tft->setSwapBytes(false);
+    _tft->pushImageDMA(0, y, band->width(), rows, (const uint16_t*)band->getPointer());
+    _tft->setSwapBytes(swap);
+    return;
+  }
+#endif
+  band->pushSprite(0, y, 0, 0, band->width(), rows);
+}
+
+void BandRenderer::render(BandDraw draw, void* context, int16_t top, int16_t bottom,
+                          uint16_t background) {
+  if (!ready()) {
+    return;
+  }
+  if (bottom < 0 || bottom > _tft->height()) {
+    bottom = _tft->height();
+  }
+  top = max<int16_t>(top, 0);
+
+  // The SPI clock comes from APB, and light sleep would stop a DMA
+  powerHold(POWER_DISPLAY);
+  _tft->startWrite();
+  for (int16_t y = top; y < bottom; y += _rows) {
+    TFT_eSprite* band = _bands[_next];
+    _next ^= 1;
+    band->setOrigin(0, 0);
+    band->fillSprite(background);
+    band->setOrigin(0, -y);
+    draw(*band, context);
+    pushBand(band, y, min<int16_t>(_rows, bottom - y));
+  }
+  // Waits for the last band's DMA
+  _tft->endWrite();
+  powerRelease(POWER_DISPLAY);
+}
@@ -0,0 +1,905 @@
+#include "barcode.h"
+
+// Bar patterns of the Code 128 symbols 0..105, 11 modules each, MSB first
+// with 1 for a bar
+static const uint16_t CODE128_PATTERNS[106] = {
+  0x6CC, 0x66C, 0x666, 0x498, 0x48C, 0x44C, 0x4C8, 0x4C4, 0x464, 0x648,
+  0x644, 0x624, 0x59C, 0x4DC, 0x4CE, 0x5CC, 0x4EC, 0x4E6, 0x672, 0x65C,
+  0x64E, 0x6E4, 0x674, 0x76E, 0x74C, 0x72C, 0x726, 0x764, 0x734, 0x732,
+  0x6D8, 0x6C6, 0x636, 0x518, 0x458, 0x446, 0x588, 0x468, 0x462, 0x688,
+  0x628, 0x622, 0x5B8, 0x58E, 0x46E, 0x5D8, 0x5C6, 0x476, 0x776, 0x68E,
+  0x62E, 0x6E8, 0x6E2, 0x6EE, 0x758, 0x746, 0x716, 0x768, 0x762, 0x71A,
+  0x77A, 0x642, 0x78A, 0x530, 0x50C, 0x4B0, 0x486, 0x42C, 0x426, 0x590,
+  0x584, 0x4D0, 0x4C2, 0x434, 0x432, 0x612, 0x650, 0x7BA, 0x614, 0x47A,
+  0x53C, 0x4BC, 0x49E, 0x5E4, 0x4F4, 0x4F2, 0x7A4, 0x794, 0x792, 0x6DE,
+  0x6F6, 0x7B6, 0x578, 0x51E, 0x45E, 0x5E8, 0x5E2, 0x7A8, 0x7A2, 0x5DE,
+  0x5EE, 0x75E, 0x7AE, 0x684, 0x690, 0x69C
+};
+// Stop pattern, 13 modules including the final bar
+static const uint16_t CODE128_STOP = 0x18EB;
+
+static const uint8_t CODE128_CODE_B = 100;
+static const uint8_t CODE128_CODE_C = 99;
+static const uint8_t CODE128_START_B = 104;
+static const uint8_t CODE128_START_C = 105;
+
+// EAN-13 set A digit patterns, 7 modules each; set C is their complement and
+// set B set C reversed
+static const uint8_t EAN_SET_A[10] = {0x0D, 0x19, 0x13, 0x3D, 0x23, 0x31, 0x2F, 0x3B, 0x37, 0x0B};
+// Sets A (0) and B (1) of the left half for each first digit, MSB first
+static const uint8_t EAN_PARITY[10] = {0x00, 0x0B, 0x0D, 0x0E, 0x13, 0x19, 0x1C, 0x15, 0x16, 0x1A};
+
+// QR versions 1..10 at level M: EC codewords per block, then the blocks and
+// data codewords of the two block groups
+struct QrVersion {
+  uint8_t eccPerBlock;
+  uint8_t blocks1;
+  uint8_t data1;
+  uint8_t blocks2;
+  uint8_t data2;
+};
+static const QrVersion QR_VERSIONS[10] = {
+  {10, 1, 16, 0, 0}, {16, 1, 28, 0, 0}, {26, 1, 44, 0, 0}, {18, 2, 32, 0, 0}, {24, 2, 43, 0, 0},
+  {16, 4, 27, 0, 0}, {18, 4, 31, 0, 0}, {22, 2, 38, 2, 39}, {22, 3, 36, 2, 37}, {26, 4, 43, 1, 44}
+};
+// Alignment pattern centres of versions 2..10 after the fixed one at 6
+static const uint8_t QR_ALIGNMENT[9][2] = {
+  {18, 0}, {22, 0}, {26, 0}, {30, 0}, {34, 0}, {22, 38}, {24, 42}, {26, 46}, {28, 50}
+};
+static const uint16_t QR_MAX_CODEWORDS = 346;  // Data and EC codewords of version 10
+// Matrix cells of the QR and Data Matrix encoders
+static const uint8_t MODULE_DARK = 0x01;
+static const uint8_t MODULE_FUNCTION = 0x02;  // Finder, timing, format and the like
+static const uint8_t MODULE_SET = 0x02;       // Data Matrix: placed already
+
+// Square ECC 200 symbols with a single Reed-Solomon block
+struct DataMatrixSize {
+  uint8_t size;
+  uint8_t dataCodewords;
+  uint8_t eccCodewords;
+  uint8_t regions;     // Data regions per side
+};
+static const DataMatrixSize DATAMATRIX_SIZES[] = {
+  {10, 3, 5, 1}, {12, 5, 7, 1}, {14, 8, 10, 1}, {16, 12, 12, 1}, {18, 18, 14, 1}, {20, 22, 18, 1},
+  {22, 30, 20, 1}, {24, 36, 24, 1}, {26, 44, 28, 1}, {32, 62, 36, 2}, {36, 86, 42, 2},
+  {40, 114, 48, 2}, {44, 144, 56, 2}, {48, 174, 68, 2}
+};
+
+bool parseBarcodeType(const String& name, BarcodeType& type) {
+  if (name.equalsIgnoreCase("code128")) {
+    type = BARCODE_CODE128;
+  } else if (name.equalsIgnoreCase("ean13")) {
+    type = BARCODE_EAN13;
+  } else if (name.equalsIgnoreCase("qr")) {
+    type = BARCODE_QR;
+  } else if (name.equalsIgnoreCase("datamatrix")) {
+    type = BARCODE_DATAMATRIX;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+uint16_t barcodeDots(float mm, uint16_t dpi) {
+  int dots = (int)(mm * dpi / 25.4f + 0.5f);
+  return dots < 1 ? 1 : dots;
+}
+
+// Where the symbol is drawn. bits is set for a 1-bit sprite at rotation 0,
+// whose rows are packed MSB first, (width + 7) / 8 bytes each.
+struct BitCanvas {
+  TFT_eSprite* sprite;
+  uint8_t* bits;
+  int32_t width;
+  int32_t height;
+  size_t rowBytes;
+};
+
+static BitCanvas canvasFor(TFT_eSprite& sprite) {
+  BitCanvas canvas;
+  canvas.sprite = &sprite;
+  canvas.width = sprite.width();
+  canvas.height = sprite.height();
+  canvas.rowBytes = (canvas.width + 7) / 8;
+  bool packed = sprite.getColorDepth() == 1 && sprite.getRotation() == 0;
+  canvas.bits = packed ? (uint8_t*)sprite.getPointer() : nullptr;
+  return canvas;
+}
+
+// Ink in x0 <= x < x1 of one packed row: masked end bytes and a memset between
+static void setSpan(uint8_t* row, int32_t x0, int32_t x1) {
+  size_t first = x0 >> 3;
+  size_t last = (x1 - 1) >> 3;
+  uint8_t firstMask = 0xFF >> (x0 & 7);
+  uint8_t lastMask = 0xFF << (7 - ((x1 - 1) & 7));
+  if (first == last) {
+    row[first] |= firstMask & lastMask;
+    return;
+  }
+  row[first] |= firstMask;
+  memset(row + first + 1, 0xFF, last - first - 1);
+  row[last] |= lastMask;
+}
+
+static void fillRun(const BitCanvas& canvas, int32_t x, int32_t y, int32_t w, int32_t h) {
+  if (canvas.bits == nullptr) {
+    canvas.sprite->fillRect(x, y, w, h, 1);
+    return;
+  }
+  int32_t x1 = x + w;
+  int32_t y1 = y + h;
+  if (x < 0) x = 0;
+  if (y < 0) y = 0;
+  if (x1 > canvas.width) x1 = canvas.width;
+  if (y1 > canvas.height) y1 = canvas.height;
+  if (x >= x1) {
+    return;
+  }
+  for (; y < y1; y++) {
+    setSpan(canvas.bits + y * canvas.rowBytes, x, x1);
+  }
+}
+
+// The bars of a pattern of modules, MSB first. Returns the x after it.
+static int32_t drawPattern(const BitCanvas& canvas, int32_t x, int32_t y, uint32_t pattern, uint8_t modules,
+                           uint8_t module, uint16_t height) {
+  for (int8_t bit = modules - 1; bit >= 0;) {
+    if ((pattern >> bit & 1) == 0) {
+      x += module;
+      bit--;
+      continue;
+    }
+    uint8_t bar = 0;
+    while (bit >= 0 && (pattern >> bit & 1)) {
+      bar++;
+      bit--;
+    }
+    fillRun(canvas, x, y, bar * module, height);
+    x += bar * module;
+  }
+  return x;
+}
+
+// Dark runs of a module matrix, one fill per run and row of modules
+static void drawMatrix(const BitCanvas& canvas, int32_t x, int32_t y, const uint8_t* matrix, uint8_t size,
+                       uint8_t module) {
+  for (uint8_t r = 0; r < size; r++) {
+    const uint8_t* row = matrix + r * size;
+    for (uint8_t c = 0; c < size;) {
+      if ((row[c] & MODULE_DARK) == 0) {
+        c++;
+        continue;
+      }
+      uint8_t start = c;
+      while (c < size && (row[c] & MODULE_DARK)) {
+        c++;
+      }
+      fillRun(canvas, x + start * module, y + r * module, (c - start) * module, module);
+    }
+  }
+}
+
+// GF(256) arithmetic for the Reed-Solomon codes of QR (0x11D) and Data
+// Matrix (0x12D), tables built on first use
+struct GaloisField {
+  uint16_t poly;
+  bool ready;
+  uint8_t exp[512];
+  uint8_t log[256];
+};
+static GaloisField qrField = {0x11D, false, {}, {}};
+static GaloisField dataMatrixField = {0x12D, false, {}, {}};
+
+static const GaloisField& galoisField(GaloisField& field) {
+  if (!field.ready) {
+    uint16_t value = 1;
+    for (uint16_t i = 0; i < 255; i++) {
+      field.exp[i] = value;
+      field.log[value] = i;
+      value <<= 1;
+      if (value & 0x100) {
+        value ^= field.poly;
+      }
+    }
+    for (uint16_t i = 255; i < 512; i++) {
+      field.exp[i] = field.exp[i - 255];
+    }
+    field.ready = true;
+  }
+  return field;
+}
+
+static uint8_t gfMultiply(const GaloisField& field, uint8_t a, uint8_t b) {
+  return (a == 0 || b == 0) ? 0 : field.exp[field.log[a] + field.log[b]];
+}
+
+// eccLength check codewords for data with the generator whose roots are
+// a^firstRoot .. a^(firstRoot + eccLength - 1)
+static void reedSolomon(const GaloisField& field, uint8_t firstRoot, const uint8_t* data, size_t length,
+                        uint8_t* ecc, size_t eccLength) {
+  // Generator coefficients, highest power first and monic
+  uint8_t generator[69];
+  memset(generator, 0, sizeof(generator));
+  generator[0] = 1;
+  for (size_t i = 0; i < eccLength; i++) {
+    uint8_t root = field.exp[i + firstRoot];
+    for (size_t j = i + 1; j > 0; j--) {
+      generator[j] ^= gfMultiply(field, generator[j - 1], root);
+    }
+  }
+
+  memset(ecc, 0, eccLength);
+  for (size_t i = 0; i < length; i++) {
+    uint8_t factor = data[i] ^ ecc[0];
+    memmove(ecc, ecc + 1, eccLength - 1);
+    ecc[eccLength - 1] = 0;
+    for (size_t j = 0; j < eccLength; j++) {
+      ecc[j] ^= gfMultiply(field, generator[j + 1], factor);
+    }
+  }
+}
+
+// Symbols for data: start, data, switches and checksum, without the stop
+// symbol. Returns the count, 0 when a character is outside set B.
+static size_t encodeCode128(const String& data, uint8_t* symbols, size_t maxSymbols) {
+  size_t length = data.length();
+  if (length == 0 || length > BARCODE_MAX_LENGTH) {
+    return 0;
+  }
+
+  auto digitRun = [&](size_t from) {
+    size_t end = from;
+    while (end < length && isdigit((unsigned char)data[end])) {
+      end++;
+    }
+    return end - from;
+  };
+
+  size_t count = 0;
+  bool setC = digitRun(0) >= 4 || (digitRun(0) == length && length % 2 == 0);
+  symbols[count++] = setC ? CODE128_START_C : CODE128_START_B;
+
+  size_t i = 0;
+  while (i < length) {
+    if (count + 3 > maxSymbols) {
+      return 0;
+    }
+    size_t run = digitRun(i);
+    if (setC) {
+      if (run >= 2) {
+        symbols[count++] = (data[i] - '0') * 10 + (data[i + 1] - '0');
+        i += 2;
+        continue;
+      }
+      symbols[count++] = CODE128_CODE_B;
+      setC = false;
+    }
+    // Four or more digits are shorter in set C; an odd run starts in B
+    if (run >= 4 && run % 2 == 0) {
+      symbols[count++] = CODE128_CODE_C;
+      setC = true;
+      continue;
+    }
+    uint8_t c = data[i];
+    if (c < 32 || c > 126) {
+      return 0;
+    }
+    symbols[count++] = c - 32;
+    i++;
+  }
+
+  uint32_t checksum = symbols[0];
+  for (size_t s = 1; s < count; s++) {
+    checksum += symbols[s] * s;
+  }
+  symbols[count++] = checksum % 103;
+  return count;
+}
+
+uint16_t code128Width(const String& data, uint8_t module) {
+  uint8_t symbols[BARCODE_MAX_LENGTH * 2 + 4];
+  size_t count = encodeCode128(data, symbols, sizeof(symbols));
+  return count == 0 ? 0 : (count * 11 + 13) * module;
+}
+
+uint16_t drawCode128(TFT_eSprite& sprite, int32_t x, int32_t y, const String& data, uint8_t module, uint16_t height) {
+  uint8_t symbols[BARCODE_MAX_LENGTH * 2 + 4];
+  size_t count = encodeCode128(data, symbols, sizeof(symbols));
+  if (count == 0 || module == 0) {
+    return 0;
+  }
+
+  BitCanvas canvas = canvasFor(sprite);
+  int32_t left = x;
+  for (size_t s = 0; s < count; s++) {
+    x = drawPattern(canvas, x, y, CODE128_PATTERNS[symbols[s]], 11, module, height);
+  }
+  x = drawPattern(canvas, x, y, CODE128_STOP, 13, module, height);
+  return x - left;
+}
+
+uint16_t drawEan13(TFT_eSprite& sprite, int32_t x, int32_t y, const String& data, uint8_t module, uint16_t height) {
+  if ((data.length() != 12 && data.length() != 13) || module == 0) {
+    return 0;
+  }
+  uint8_t digits[13];
+  for (size_t i = 0; i < data.length(); i++) {
+    if (!isdigit((unsigned char)data[i])) {
+      return 0;
+    }
+    digits[i] = data[i] - '0';
+  }
+  uint16_t sum = 0;
+  for (uint8_t i = 0; i < 12; i++) {
+    sum += digits[i] * ((i & 1) ? 3 : 1);
+  }
+  uint8_t check = (10 - sum % 10) % 10;
+  if (data.length() == 13 && digits[12] != check) {
+    return 0;
+  }
+  digits[12] = check;
+
+  BitCanvas canvas = canvasFor(sprite);
+  uint16_t guardHeight = height + 5 * module;
+  int32_t left = x;
+  x = drawPattern(canvas, x, y, 0x5, 3, module, guardHeight);
+  for (uint8_t i = 1; i < 7; i++) {
+    uint8_t pattern = EAN_SET_A[digits[i]];
+    if (EAN_PARITY[digits[0]] >> (6 - i) & 1) {
+      // Set B: set C mirrored
+      uint8_t c = ~pattern & 0x7F;
+      pattern = 0;
+      for (uint8_t b = 0; b < 7; b++) {
+        pattern |= ((c >> b) & 1) << (6 - b);
+      }
+    }
+    x = drawPattern(canvas, x, y, pattern, 7, module, height);
+  }
+  x = drawPattern(canvas, x, y, 0x0A, 5, module, guardHeight);
+  for (uint8_t i = 7; i < 13; i++) {
+    x = drawPattern(canvas, x, y, ~EAN_SET_A[digits[i]] & 0x7F, 7, module, height);
+  }
+  x = drawPattern(canvas, x, y, 0x5, 3, module, guardHeight);
+  return x - left;
+}
+
+// QR matrix being built, size * size cells of MODULE_ flags
+struct QrMatrix {
+  uint8_t* cells;
+  uint8_t size;
+
+  bool dark(int x, int y) const { return cells[y * size + x] & MODULE_DARK; }
+  bool function(int x, int y) const { return cells[y * size + x] & MODULE_FUNCTION; }
+  void setFunction(int x, int y, bool isDark) { cells[y * size + x] = MODULE_FUNCTION | (isDark ? MODULE_DARK : 0); }
+};
+
+static bool qrMask(uint8_t mask, int x, int y) {
+  switch (mask) {
+    case 0: return (x + y) % 2 == 0;
+    case 1: return y % 2 == 0;
+    case 2: return x % 3 == 0;
+    case 3: return (x + y) % 3 == 0;
+    case 4: return (x / 3 + y / 2) % 2 == 0;
+    case 5: return x * y % 2 + x * y % 3 == 0;
+    case 6: return (x * y % 2 + x * y % 3) % 2 == 0;
+    default: return ((x + y) % 2 + x * y % 3) % 2 == 0;
+  }
+}
+
+// Both copies of the format bits: level M (00) and the mask, BCH coded
+static void qrDrawFormat(QrMatrix& m, uint8_t mask) {
+  uint16_t data = mask;
+  uint16_t rem = data;
+  for (uint8_t i = 0; i < 10; i++) {
+    rem = (rem << 1) ^ ((rem >> 9) * 0x537);
+  }
+  uint16_t bits = ((data << 10) | rem) ^ 0x5412;
+  uint8_t size = m.size;
+  for (uint8_t i = 0; i <= 5; i++) {
+    m.setFunction(8, i, bits >> i & 1);
+  }
+  m.setFunction(8, 7, bits >> 6 & 1);
+  m.setFunction(8, 8, bits >> 7 & 1);
+  m.setFunction(7, 8, bits >> 8 & 1);
+  for (uint8_t i = 9; i < 15; i++) {
+    m.setFunction(14 - i, 8, bits >> i & 1);
+  }
+  for (uint8_t i = 0; i < 8; i++) {
+    m.setFunction(size - 1 - i, 8, bits >> i & 1);
+  }
+  for (uint8_t i = 8; i < 15; i++) {
+    m.setFunction(8, size - 15 + i, bits >> i & 1);
+  }
+  m.setFunction(8, size - 8, true);
+}
+
+static void qrDrawFunctionPatterns(QrMatrix& m, uint8_t version) {
+  uint8_t size = m.size;
+  for (uint8_t i = 0; i < size; i++) {
+    m.setFunction(6, i, i % 2 == 0);
+    m.setFunction(i, 6, i % 2 == 0);
+  }
+
+  // Finders with their light separators
+  const int centres[3][2] = {{3, 3}, {size - 4, 3}, {3, size - 4}};
+  for (uint8_t f = 0; f < 3; f++) {
+    for (int dy = -4; dy <= 4; dy++) {
+      for (int dx = -4; dx <= 4; dx++) {
+        int x = centres[f][0] + dx;
+        int y = centres[f][1] + dy;
+        if (x < 0 || y < 0 || x >= size || y >= size) {
+          continue;
+        }
+        int distance = max(abs(dx), abs(dy));
+        m.setFunction(x, y, distance != 2 && distance != 4);
+      }
+    }
+  }
+
+  if (version >= 2) {
+    uint8_t positions[3] = {6, QR_ALIGNMENT[version - 2][0], QR_ALIGNMENT[version - 2][1]};
+    uint8_t count = positions[2] != 0 ? 3 : 2;
+    for (uint8_t i = 0; i < count; i++) {
+      for (uint8_t j = 0; j < count; j++) {
+        // Not over the finders
+        if ((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0)) {
+          continue;
+        }
+        for (int dy = -2; dy <= 2; dy++) {
+          for (int dx = -2; dx <= 2; dx++) {
+            m.setFunction(positions[i] + dx, positions[j] + dy, max(abs(dx), abs(dy)) != 1);
+          }
+        }
+      }
+    }
+  }
+
+  // Reserve the format areas; the bits follow once the mask is chosen
+  qrDrawFormat(m, 0);
+
+  if (version >= 7) {
+    uint32_t rem = version;
+    for (uint8_t i = 0; i < 12; i++) {
+      rem = (rem << 1) ^ ((rem >> 11) * 0x1F25);
+    }
+    uint32_t bits = ((uint32_t)version << 12) | rem;
+    for (uint8_t i = 0; i < 18; i++) {
+      bool bit = bits >> i & 1;
+      int a = size - 11 + i % 3;
+      int b = i / 3;
+      m.setFunction(a, b, bit);
+      m.setFunction(b, a, bit);
+    }
+  }
+}
+
+static void qrApplyMask(QrMatrix& m, uint8_t mask) {
+  for (uint8_t y = 0; y < m.size; y++) {
+    for (uint8_t x = 0; x < m.size; x++) {
+      if (!m.function(x, y) && qrMask(mask, x, y)) {
+        m.cells[y * m.size + x] ^= MODULE_DARK;
+      }
+    }
+  }
+}
+
+// Penalty of the masked symbol by the four rules of the specification
+static uint32_t qrPenalty(const QrMatrix& m) {
+  uint8_t size = m.size;
+  uint32_t penalty = 0;
+  uint32_t darkCount = 0;
+
+  for (uint8_t pass = 0; pass < 2; pass++) {
+    for (uint8_t a = 0; a < size; a++) {
+      uint8_t run = 0;
+      bool runDark = false;
+      uint16_t window = 0;
+      for (uint8_t b = 0; b < size; b++) {
+        bool dark = pass == 0 ? m.dark(b, a) : m.dark(a, b);
+        if (b > 0 && dark == runDark) {
+          run++;
+          if (run == 5) {
+            penalty += 3;
+          } else if (run > 5) {
+            penalty++;
+          }
+        } else {
+          run = 1;
+          runDark = dark;
+        }
+        // Finder-like 1011101 with four light modules on one side
+        window = ((window << 1) | dark) & 0x7FF;
+        if (b >= 10 && (window == 0x5D0 || window == 0x05D)) {
+          penalty += 40;
+        }
+      }
+    }
+  }
+
+  for (uint8_t y = 0; y < size; y++) {
+    for (uint8_t x = 0; x < size; x++) {
+      bool dark = m.dark(x, y);
+      darkCount += dark;
+      if (x + 1 < size && y + 1 < size && dark == m.dark(x + 1, y) && dark == m.dark(x, y + 1) &&
+          dark == m.dark(x + 1, y + 1)) {
+        penalty += 3;
+      }
+    }
+  }
+
+  uint32_t total = size * size;
+  uint32_t k = ((uint32_t)abs((int32_t)(darkCount * 20) - (int32_t)(total * 10)) + total - 1) / total - 1;
+  return penalty + k * 10;
+}
+
+// Codewords of data in byte mode for the smallest version that holds it
+static uint16_t qrEncode(const String& data, uint8_t* codewords, uint8_t& version) {
+  size_t length = data.length();
+  if (length == 0 || length > BARCODE_MAX_2D_LENGTH) {
+    return 0;
+  }
+  version = 0;
+  uint16_t dataCodewords = 0;
+  for (uint8_t v = 1; v <= 10; v++) {
+    const QrVersion& info = QR_VERSIONS[v - 1];
+    dataCodewords = info.blocks1 * info.data1 + info.blocks2 * info.data2;
+    uint16_t bits = 4 + (v < 10 ? 8 : 16) + length * 8;
+    if (bits <= dataCodewords * 8) {
+      version = v;
+      break;
+    }
+  }
+  if (version == 0) {
+    return 0;
+  }
+
+  // Mode, count, bytes, up to four terminator bits, then pad bytes
+  uint8_t stream[QR_MAX_CODEWORDS];
+  memset(stream, 0, sizeof(stream));
+  uint16_t bitPos = 0;
+  auto putBits = [&](uint32_t value, uint8_t count) {
+    for (int8_t i = count - 1; i >= 0; i--, bitPos++) {
+      if (value >> i & 1) {
+        stream[bitPos >> 3] |= 0x80 >> (bitPos & 7);
+      }
+    }
+  };
+  putBits(0x4, 4);
+  putBits(length, version < 10 ? 8 : 16);
+  for (size_t i = 0; i < length; i++) {
+    putBits((uint8_t)data[i], 8);
+  }
+  size_t used = (bitPos + 4 + 7) / 8;
+  if (used > dataCodewords) {
+    used = dataCodewords;
+  }
+  for (size_t i = used; i < dataCodewords; i++) {
+    stream[i] = ((i - used) & 1) ? 0x11 : 0xEC;
+  }
+
+  // Blocks with their EC codewords, interleaved column by column
+  const QrVersion& info = QR_VERSIONS[version - 1];
+  const GaloisField& field = galoisField(qrField);
+  uint8_t blocks = info.blocks1 + info.blocks2;
+  uint8_t ecc[8][30];
+  uint8_t offsets[8];
+  uint8_t lengths[8];
+  uint16_t offset = 0;
+  for (uint8_t b = 0; b < blocks; b++) {
+    offsets[b] = offset;
+    lengths[b] = b < info.blocks1 ? info.data1 : info.data2;
+    reedSolomon(field, 0, stream + offset, lengths[b], ecc[b], info.eccPerBlock);
+    offset += lengths[b];
+  }
+  uint16_t count = 0;
+  uint8_t longest = info.blocks2 != 0 ? info.data2 : info.data1;
+  for (uint8_t i = 0; i < longest; i++) {
+    for (uint8_t b = 0; b < blocks; b++) {
+      if (i < lengths[b]) {
+        codewords[count++] = stream[offsets[b] + i];
+      }
+    }
+  }
+  for (uint8_t i = 0; i < info.eccPerBlock; i++) {
+    for (uint8_t b = 0; b < blocks; b++) {
+      codewords[count++] = ecc[b][i];
+    }
+  }
+  return count;
+}
+
+uint16_t drawQrCode(TFT_eSprite& sprite, int32_t x, int32_t y, const String& data, uint8_t module) {
+  uint8_t codewords[QR_MAX_CODEWORDS];
+  uint8_t version;
+  uint16_t count = qrEncode(data, codewords, version);
+  if (count == 0 || module == 0) {
+    return 0;
+  }
+
+  QrMatrix m;
+  m.size = 17 + 4 * version;
+  m.cells = (uint8_t*)calloc(m.size, m.size);
+  if (m.cells == nullptr) {
+    return 0;
+  }
+  qrDrawFunctionPatterns(m, version);
+
+  // Codewords in the two-module zigzag from the bottom right, skipping the
+  // vertical timing pattern; remainder bits stay light
+  uint16_t bit = 0;
+  uint16_t totalBits = count * 8;
+  for (int right = m.size - 1; right >= 1; right -= 2) {
+    if (right == 6) {
+      right = 5;
+    }
+    bool upward = ((right + 1) & 2) == 0;
+    for (int vert = 0; vert < m.size; vert++) {
+      int row = upward ? m.size - 1 - vert : vert;
+      for (int j = 0; j < 2; j++) {
+        int col = right - j;
+        if (m.function(col, row) || bit >= totalBits) {
+          continue;
+        }
+        if (codewords[bit >> 3] >> (7 - (bit & 7)) & 1) {
+          m.cells[row * m.size + col] |= MODULE_DARK;
+        }
+        bit++;
+      }
+    }
+  }
+
+  uint8_t best = 0;
+  uint32_t bestPenalty = UINT32_MAX;
+  for (uint8_t mask = 0; mask < 8; mask++) {
+    qrApplyMask(m, mask);
+    qrDrawFormat(m, mask);
+    uint32_t penalty = qrPenalty(m);
+    if (penalty < bestPenalty) {
+      best = mask;
+      bestPenalty = penalty;
+    }
+    qrApplyMask(m, mask);
+  }
+  qrApplyMask(m, best);
+  qrDrawFormat(m, best);
+
+  drawMatrix(canvasFor(sprite), x, y, m.cells, m.size, module);
+  uint16_t side = m.size * module;
+  free(m.cells);
+  return side;
+}
+
+// ECC 200 placement of the codewords into the mapping matrix (ISO/IEC
+// 16022 annex F)
+struct DataMatrixPlacement {
+  uint8_t* cells;
+  int rows;
+  int cols;
+  const uint8_t* codewords;
+
+  void module(int row, int col, int pos, int bit) {
+    if (row < 0) {
+      row += rows;
+      col += 4 - ((rows + 4) % 8);
+    }
+    if (col < 0) {
+      col += cols;
+      row += 4 - ((cols + 4) % 8);
+    }
+    bool dark = codewords[pos] >> (8 - bit) & 1;
+    cells[row * cols + col] = MODULE_SET | (dark ? MODULE_DARK : 0);
+  }
+
+  void utah(int row, int col, int pos) {
+    module(row - 2, col - 2, pos, 1);
+    module(row - 2, col - 1, pos, 2);
+    module(row - 1, col - 2, pos, 3);
+    module(row - 1, col - 1, pos, 4);
+    module(row - 1, col, pos, 5);
+    module(row, col - 2, pos, 6);
+    module(row, col - 1, pos, 7);
+    module(row, col, pos, 8);
+  }
+
+  void corner1(int pos) {
+    module(rows - 1, 0, pos, 1);
+    module(rows - 1, 1, pos, 2);
+    module(rows - 1, 2, pos, 3);
+    module(0, cols - 2, pos, 4);
+    module(0, cols - 1, pos, 5);
+    module(1, cols - 1, pos, 6);
+    module(2, cols - 1, pos, 7);
+    module(3, cols - 1, pos, 8);
+  }
+
+  void corner2(int pos) {
+    module(rows - 3, 0, pos, 1);
+    module(rows - 2, 0, pos, 2);
+    module(rows - 1, 0, pos, 3);
+    module(0, cols - 4, pos, 4);
+    module(0, cols - 3, pos, 5);
+    module(0, cols - 2, pos, 6);
+    module(0, cols - 1, pos, 7);
+    module(1, cols - 1, pos, 8);
+  }
+
+  void corner3(int pos) {
+    module(rows - 3, 0, pos, 1);
+    module(rows - 2, 0, pos, 2);
+    module(rows - 1, 0, pos, 3);
+    module(0, cols - 2, pos, 4);
+    module(0, cols - 1, pos, 5);
+    module(1, cols - 1, pos, 6);
+    module(2, cols - 1, pos, 7);
+    module(3, cols - 1, pos, 8);
+  }
+
+  void corner4(int pos) {
+    module(rows - 1, 0, pos, 1);
+    module(rows - 1, cols - 1, pos, 2);
+    module(0, cols - 3, pos, 3);
+    module(0, cols - 2, pos, 4);
+    module(0, cols - 1, pos, 5);
+    module(1, cols - 3, pos, 6);
+    module(1, cols - 2, pos, 7);
+    module(1, cols - 1, pos, 8);
+  }
+
+  bool placed(int row, int col) const { return cells[row * cols + col] & MODULE_SET; }
+
+  void place() {
+    int pos = 0;
+    int row = 4;
+    int col = 0;
+    do {
+      if (row == rows && col == 0) corner1(pos++);
+      if (row == rows - 2 && col == 0 && cols % 4 != 0) corner2(pos++);
+      if (row == rows - 2 && col == 0 && cols % 8 == 4) corner3(pos++);
+      if (row == rows + 4 && col == 2 && cols % 8 == 0) corner4(pos++);
+      // Up and to the right, then down and to the left
+      do {
+        if (row < rows && col >= 0 && !placed(row, col)) utah(row, col, pos++);
+        row -= 2;
+        col += 2;
+      } while (row >= 0 && col < cols);
+      row++;
+      col += 3;
+      do {
+        if (row >= 0 && col < cols && !placed(row, col)) utah(row, col, pos++);
+        row += 2;
+        col -= 2;
+      } while (row < rows && col >= 0);
+      row += 3;
+      col++;
+    } while (row < rows || col < cols);
+
+    // Symbols that leave the bottom right corner unfilled get a fixed pattern
+    if (!placed(rows - 1, cols - 1)) {
+      cells[(rows - 1) * cols + cols - 1] = MODULE_SET | MODULE_DARK;
+      cells[(rows - 2) * cols + cols - 2] = MODULE_SET | MODULE_DARK;
+    }
+  }
+};
+
+uint16_t drawDataMatrix(TFT_eSprite& sprite, int32_t x, int32_t y, const String& data, uint8_t module) {
+  size_t length = data.length();
+  if (length == 0 || length > BARCODE_MAX_2D_LENGTH || module == 0) {
+    return 0;
+  }
+
+  // ASCII encodation: digit pairs in one codeword, upper shift above 127
+  uint8_t codewords[174 + 68];
+  size_t count = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (count + 2 > 174) {
+      return 0;
+    }
+    uint8_t c = data[i];
+    if (isdigit(c) && i + 1 < length && isdigit((unsigned char)data[i + 1])) {
+      codewords[count++] = 130 + (c - '0') * 10 + (data[i + 1] - '0');
+      i++;
+    } else if (c < 128) {
+      codewords[count++] = c + 1;
+    } else {
+      codewords[count++] = 235;
+      codewords[count++] = c - 127;
+    }
+  }
+
+  const DataMatrixSize* symbol = nullptr;
+  for (const DataMatrixSize& candidate : DATAMATRIX_SIZES) {
+    if (candidate.dataCodewords >= count) {
+      symbol = &candidate;
+      break;
+    }
+  }
+  if (symbol == nullptr) {
+    return 0;
+  }
+
+  // First pad 129, the rest scrambled by position
+  for (size_t i = count; i < symbol->dataCodewords; i++) {
+    if (i == count) {
+      codewords[i] = 129;
+      continue;
+    }
+    uint16_t pad = 129 + ((149 * (i + 1)) % 253) + 1;
+    codewords[i] = pad > 254 ? pad - 254 : pad;
+  }
+  reedSolomon(galoisField(dataMatrixField), 1, codewords, symbol->dataCodewords, codewords + symbol->dataCodewords,
+              symbol->eccCodewords);
+
+  uint8_t regionSize = (symbol->size - 2 * symbol->regions) / symbol->regions;
+  DataMatrixPlacement placement;
+  placement.rows = regionSize * symbol->regions;
+  placement.cols = placement.rows;
+  placement.codewords = codewords;
+  placement.cells = (uint8_t*)calloc(placement.rows, placement.cols);
+  uint8_t* matrix = (uint8_t*)calloc(symbol->size, symbol->size);
+  if (placement.cells == nullptr || matrix == nullptr) {
+    free(placement.cells);
+    free(matrix);
+    return 0;
+  }
+  placement.place();
+
+  // Data regions, each framed by a solid L on the left and bottom and
+  // alternating modules on the top and right
+  uint8_t block = regionSize + 2;
+  for (uint8_t r = 0; r < symbol->size; r++) {
+    for (uint8_t c = 0; c < symbol->size; c++) {
+      uint8_t br = r % block;
+      uint8_t bc = c % block;
+      bool dark;
+      if (bc == 0 || br == block - 1) {
+        dark = true;
+      } else if (br == 0) {
+        dark = bc % 2 == 0;
+      } else if (bc == block - 1) {
+        dark = br % 2 == 1;
+      } else {
+        int row = (r / block) * regionSize + br - 1;
+        int col = (c / block) * regionSize + bc - 1;
+        dark = placement.cells[row * placement.cols + col] & MODULE_DARK;
+      }
+      matrix[r * symbol->size + c] = dark ? MODULE_DARK : 0;
+    }
+  }
+  free(placement.cells);
+
+  drawMatrix(canvasFor(sprite), x, y, matrix, symbol->size, module);
+  free(matrix);
+  return symbol->size * module;
+}
+
+bool drawBarcode(TFT_eSprite& sprite, BarcodeType type, int32_t x, int32_t y, const String& data,
+                 uint8_t module, uint16_t height, uint16_t* drawnWidth, uint16_t* drawnHeight) {
+  uint16_t width = 0;
+  switch (type) {
+    case BARCODE_CODE128:
+      width = drawCode128(sprite, x, y, data, module, height);
+      break;
+    case BARCODE_EAN13:
+      width = drawEan13(sprite, x, y, data, module, height);
+      height += 5 * module;
+      break;
+    case BARCODE_QR:
+      width = drawQrCode(sprite, x, y, data, module);
+      height = width;
+      break;
+    case BARCODE_DATAMATRIX:
+      width = drawDataMatrix(sprite, x, y, data, module);
+      height = width;
+      break;
+  }
+  if (width == 0) {
+    return false;
+  }
+  if (drawnWidth != nullptr) {
+    *drawnWidth = width;
+  }
+  if (drawnHeight != nullptr) {
+    *drawnHeight = height;
+  }
+  return true;
+}
@@ -0,0 +1,149 @@
+#include "batch_print.h"
+#include "print_writer.h"
+#include "heap_stats.h"
+
+struct BatchSlot {
+  bool used;
+  uint32_t jobId;
+  uint32_t* ends;     // Job offset just past each label
+  uint16_t count;     // Labels fully appended
+  uint16_t reported;  // Labels already passed to the callback
+};
+
+static BatchSlot slots[PRINT_BATCH_SLOTS];
+static SemaphoreHandle_t batchLock = nullptr;
+
+static void* allocPreferPsram(size_t size) {
+  return heapAlloc(HEAP_SITE_BATCH, size);
+}
+
+const char* printBatchErrorName(PrintBatchError error) {
+  switch (error) {
+    case BATCH_OK: return "OK";
+    case BATCH_ERR_TOO_MANY: return "Too many labels in batch";
+    case BATCH_ERR_TRUNCATED: return "Batch ends inside a label";
+    case BATCH_ERR_OUTPUT: return "Print job buffer full";
+    case BATCH_ERR_NO_MEMORY: return "Too many batches";
+  }
+  return "Unknown";
+}
+
+bool initPrintBatches() {
+  batchLock = xSemaphoreCreateMutex();
+  return batchLock != nullptr;
+}
+
+// The slot outlives the upload until its job ends, so the last labels are
+// still reported
+PrintBatchError PrintBatch::begin(uint32_t jobId) {
+  _jobId = jobId;
+  uint32_t* ends = batchLock != nullptr ? (uint32_t*)allocPreferPsram(PRINT_BATCH_MAX_LABELS * sizeof(uint32_t)) : nullptr;
+  if (ends == nullptr) {
+    return _error = BATCH_ERR_NO_MEMORY;
+  }
+  xSemaphoreTake(batchLock, portMAX_DELAY);
+  for (size_t i = 0; i < PRINT_BATCH_SLOTS && _slot < 0; i++) {
+    if (!slots[i].used) {
+      slots[i] = {true, jobId, ends, 0, 0};
+      _slot = i;
+    }
+  }
+  xSemaphoreGive(batchLock);
+  if (_slot < 0) {
+    heapFree(ends);
+    return _error = BATCH_ERR_NO_MEMORY;
+  }
+  return BATCH_OK;
+}
+
+// The label that began last is all in the job
+static void recordLabelEnd(int slot, uint32_t jobId, uint32_t offset) {
+  xSemaphoreTake(batchLock, portMAX_DELAY);
+  // The slot goes away with a job that already ended
+  BatchSlot& s = slots[slot];
+  if (s.used && s.jobId == jobId && s.count < PRINT_BATCH_MAX_LABELS) {
+    s.ends[s.count++] = offset;
+  }
+  xSemaphoreGive(batchLock);
+}
+
+PrintBatchError PrintBatch::feed(const uint8_t* data, size_t length, uint32_t timeoutMs) {
+  while (length > 0 && _error == BATCH_OK) {
+    // Length in front of the next label
+    if (_headerLength < sizeof(_header)) {
+      _header[_headerLength++] = *data++;
+      length--;
+      if (_headerLength < sizeof(_header)) {
+        continue;
+      }
+      if (_labels >= PRINT_BATCH_MAX_LABELS) {
+        return _error = BATCH_ERR_TOO_MANY;
+      }
+      _remaining = ((uint32_t)_header[0] << 24) | ((uint32_t)_header[1] << 16) | ((uint32_t)_header[2] << 8) | _header[3];
+    } else {
+      size_t n = length < _remaining ? length : _remaining;
+      size_t queued = appendPrintJob(_jobId, data, n, timeoutMs);
+      _offset += queued;
+      if (queued < n) {
+        return _error = BATCH_ERR_OUTPUT;
+      }
+      _remaining -= n;
+      data += n;
+      length -= n;
+    }
+    if (_remaining == 0) {
+      _labels++;
+      recordLabelEnd(_slot, _jobId, _offset);
+      _headerLength = 0;
+    }
+  }
+  return _error;
+}
+
+PrintBatchError PrintBatch::end() {
+  if (_error == BATCH_OK && _headerLength != 0) {
+    _error = BATCH_ERR_TRUNCATED;
+  }
+  return _error;
+}
+
+void servicePrintBatches(PrintBatchLabelCallback callback) {
+  if (batchLock == nullptr) {
+    return;
+  }
+  for (size_t i = 0; i < PRINT_BATCH_SLOTS; i++) {
+    PrintJobInfo info;
+    bool known = false;
+    uint32_t jobId = 0;
+    uint16_t from = 0;
+    uint16_t sentTo = 0;
+    uint16_t reportTo = 0;
+    uint32_t* released = nullptr;
+
+    xSemaphoreTake(batchLock, portMAX_DELAY);
+    BatchSlot& s = slots[i];
+    if (s.used) {
+      jobId = s.jobId;
+      known = getPrintJob(jobId, info);
+      from = s.reported;
+      sentTo = from;
+      // A job that is gone or done has nothing more to send
+      bool ended = !known || info.state == JOB_DONE || info.state == JOB_FAILED;
+      while (sentTo < s.count && known && (info.state == JOB_DONE || s.ends[sentTo] <= info.sent)) {
+        sentTo++;
+      }
+      reportTo = ended ? s.count : sentTo;
+      s.reported = reportTo;
+      if (ended) {
+        released = s.ends;
+        s.used = false;
+      }
+    }
+    xSemaphoreGive(batchLock);
+
+    for (uint16_t label = from; label < reportTo; label++) {
+      callback(jobId, label, label < sentTo);
+    }
+    heapFree(released);
+  }
+}
@@ -0,0 +1,489 @@
+#include "ble_link.h"
+
+#if !BLE_TRANSPORT_NIMBLE
+
+#include "ble_printer.h"
+
+#include <BLEDevice.h>
+#include <BLEClient.h>
+#include <BLERemoteCharacteristic.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gattc_api.h>
+
+// Bluedroid through the Arduino BLE library. The library connects and
+// discovers; the scanner, link parameters, and writes to cached handles go
+// through the GAP and GATTC API, whose events the custom handlers below see.
+
+// BLE Device Name characteristic (standard UUID)
+static BLEUUID deviceNameUUID(PRINTER_DEVICENAMEUUID);
+
+// Wait for the answer to a write with response this long
+const uint32_t GATT_WRITE_TIMEOUT = 1000;
+
+static BleScanResult scanResult = nullptr;
+static BleScanDone scanDone = nullptr;
+static BleLink* links[MAX_PRINTERS];
+static size_t linkCount = 0;
+// The data length event carries no address; it belongs to the last request
+static BleLink* volatile dataLengthRequester = nullptr;
+
+class LinkCallbacks : public BLEClientCallbacks {
+public:
+  explicit LinkCallbacks(BlePrinter* owner) : _owner(owner) {}
+  void onConnect(BLEClient* client) override {
+    log_i("onConnect callback");
+  }
+  void onDisconnect(BLEClient* client) override {
+    log_i("onDisconnect callback");
+    _owner->onClientDisconnect(client);
+  }
+private:
+  BlePrinter* _owner;
+};
+
+struct BleLinkStack {
+  static BleLink* forPeer(const uint8_t* bda) {
+    for (size_t i = 0; i < linkCount; i++) {
+      BLEClient* client = (BLEClient*)links[i]->_client;
+      if (memcmp(*client->getPeerAddress().getNative(), bda, sizeof(esp_bd_addr_t)) == 0) {
+        return links[i];
+      }
+    }
+    return nullptr;
+  }
+
+  static BleLink* forConnection(esp_gatt_if_t gattcIf, uint16_t connId) {
+    for (size_t i = 0; i < linkCount; i++) {
+      BLEClient* client = (BLEClient*)links[i]->_client;
+      if (client->getGattcIf() == gattcIf && client->getConnId() == connId) {
+        return links[i];
+      }
+    }
+    return nullptr;
+  }
+
+  static void gapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+  static void gattcEvent(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t* param);
+  static bool rawWrite(BleLink& link, uint16_t handle, bool descriptor, const uint8_t* data, size_t length, bool response);
+};
+
+void BleLinkStack::gapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+  BleLink* link = nullptr;
+
+  switch (event) {
+    case ESP_GAP_BLE_SCAN_RESULT_EVT:
+      if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT) {
+        scanResult(param->scan_rst.bda, param->scan_rst.ble_addr_type, param->scan_rst.rssi);
+      } else if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT) {
+        scanDone();
+      }
+      break;
+
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+      link = forPeer(param->update_conn_params.bda);
+      if (link == nullptr) {
+        break;
+      }
+      if (param->update_conn_params.status == ESP_BT_STATUS_SUCCESS) {
+        uint16_t interval = param->update_conn_params.conn_int;
+        link->_owner->onConnParams(interval);
+        log_i("%s: connection interval %d.%02d ms, latency %d, timeout %d ms", link->_owner->id().c_str(),
+              interval * 125 / 100, interval * 125 % 100,
+              param->update_conn_params.latency, param->update_conn_params.timeout * 10);
+      } else {
+        log_w("%s: printer rejected connection parameters (status %d)", link->_owner->id().c_str(),
+              param->update_conn_params.status);
+      }
+      break;
+
+    case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+      link = forPeer(param->phy_update.bda);
+      if (link == nullptr) {
+        break;
+      }
+      if (param->phy_update.status == ESP_BT_STATUS_SUCCESS) {
+        link->_owner->onPhy(param->phy_update.tx_phy, param->phy_update.rx_phy);
+        log_i("%s: PHY tx %dM, rx %dM", link->_owner->id().c_str(),
+              param->phy_update.tx_phy == ESP_BLE_GAP_PHY_2M ? 2 : 1,
+              param->phy_update.rx_phy == ESP_BLE_GAP_PHY_2M ? 2 : 1);
+      } else {
+        log_w("%s: PHY update failed (status %d), staying on 1M", link->_owner->id().c_str(),
+              param->phy_update.status);
+      }
+      break;
+
+    case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+      link = dataLengthRequester;
+      if (link == nullptr) {
+        break;
+      }
+      if (param->pkt_data_lenth_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+        link->_owner->onDataLength(param->pkt_data_lenth_cmpl.params.tx_len);
+        log_i("%s: data length tx %d, rx %d", link->_owner->id().c_str(),
+              param->pkt_data_lenth_cmpl.params.tx_len, param->pkt_data_lenth_cmpl.params.rx_len);
+      } else {
+        log_w("%s: data length extension refused (status %d)", link->_owner->id().c_str(),
+              param->pkt_data_lenth_cmpl.status);
+      }
+      break;
+
+    case ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT:
+      link = forPeer(param->read_rssi_cmpl.remote_addr);
+      if (link != nullptr && param->read_rssi_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+        link->_owner->onRssi(param->read_rssi_cmpl.rssi);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void BleLinkStack::gattcEvent(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t* param) {
+  BleLink* link;
+  switch (event) {
+    case ESP_GATTC_WRITE_CHAR_EVT:
+    case ESP_GATTC_WRITE_DESCR_EVT:
+      link = forConnection(gattcIf, param->write.conn_id);
+      // Completion of raw writes; library characteristics wait for their own
+      if (link != nullptr && link->_pendingWrite != 0 && param->write.handle == link->_pendingWrite) {
+        link->_pendingWrite = 0;
+        link->_writeStatus = param->write.status;
+        xSemaphoreGive(link->_writeDone);
+      }
+      break;
+    case ESP_GATTC_NOTIFY_EVT:
+      link = forConnection(gattcIf, param->notify.conn_id);
+      if (link != nullptr) {
+        link->_owner->onNotify(param->notify.handle, param->notify.value, param->notify.value_len);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// Write a characteristic value or descriptor through the GATTC API
+bool BleLinkStack::rawWrite(BleLink& link, uint16_t handle, bool descriptor, const uint8_t* data, size_t length,
+                            bool response) {
+  BLEClient* client = (BLEClient*)link._client;
+  if (response) {
+    xSemaphoreTake(link._writeDone, 0);
+    link._pendingWrite = handle;
+  }
+  esp_gatt_write_type_t type = response ? ESP_GATT_WRITE_TYPE_RSP : ESP_GATT_WRITE_TYPE_NO_RSP;
+  esp_err_t err = descriptor
+      ? esp_ble_gattc_write_char_descr(client->getGattcIf(), client->getConnId(), handle, length,
+                                       const_cast<uint8_t*>(data), type, ESP_GATT_AUTH_REQ_NONE)
+      : esp_ble_gattc_write_char(client->getGattcIf(), client->getConnId(), handle, length,
+                                 const_cast<uint8_t*>(data), type, ESP_GATT_AUTH_REQ_NONE);
+  if (err != ESP_OK) {
+    link._pendingWrite = 0;
+    return false;
+  }
+  if (!response) {
+    return true;
+  }
+  if (xSemaphoreTake(link._writeDone, pdMS_TO_TICKS(GATT_WRITE_TIMEOUT)) != pdTRUE) {
+    link._pendingWrite = 0;
+    return false;
+  }
+  return link._writeStatus == ESP_GATT_OK;
+}
+
+bool bleStackInit(const char* deviceName, const BleScanSettings& settings, BleScanResult result, BleScanDone done) {
+  scanResult = result;
+  scanDone = done;
+  BLEDevice::init(deviceName);
+
+  // Set security
+  // BLESecurity *pSecurity = new BLESecurity();
+  // pSecurity->setAuthenticationMode(ESP_LE_AUTH_BOND);
+  // pSecurity->setCapability(ESP_IO_CAP_NONE);
+  // pSecurity->setInitEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+
+  // TX power follows each link's quality, see tx_power.h
+
+  log_i("BLE initialized (Bluedroid)");
+
+  // Scan results and the outcome of PHY, connection parameter and DLE
+  // requests; BLEScan would allocate a device record for every advertisement
+  BLEDevice::setCustomGapHandler(BleLinkStack::gapEvent);
+
+  // Raw writes to a cached handle complete through the GATTC handler
+  BLEDevice::setCustomGattcHandler(BleLinkStack::gattcEvent);
+
+  // A device may use a public or a static random address, so both are listed
+  bool acceptList = settings.accept != nullptr;
+  if (acceptList) {
+    esp_ble_gap_clear_whitelist();
+    for (size_t i = 0; i < settings.acceptCount; i++) {
+      uint8_t* address = const_cast<uint8_t*>(settings.accept[i]);
+      if (esp_ble_gap_update_whitelist(true, address, BLE_WL_ADDR_TYPE_PUBLIC) != ESP_OK ||
+          esp_ble_gap_update_whitelist(true, address, BLE_WL_ADDR_TYPE_RANDOM) != ESP_OK) {
+        log_w("BLE accept list full, scanning for all devices");
+        acceptList = false;
+        break;
+      }
+    }
+  }
+
+  // Intervals are in 0.625 ms units
+  esp_ble_scan_params_t scanParams = {};
+  scanParams.scan_type = settings.active ? BLE_SCAN_TYPE_ACTIVE : BLE_SCAN_TYPE_PASSIVE;
+  scanParams.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+  scanParams.scan_filter_policy = acceptList ? BLE_SCAN_FILTER_ALLOW_ONLY_WLST : BLE_SCAN_FILTER_ALLOW_ALL;
+  scanParams.scan_interval = settings.intervalMs * 8 / 5;
+  scanParams.scan_window = settings.windowMs * 8 / 5;
+  scanParams.scan_duplicate = BLE_SCAN_DUPLICATE_ENABLE;
+  esp_err_t err = esp_ble_gap_set_scan_params(&scanParams);
+  if (err != ESP_OK) {
+    log_e("BLE scan parameters rejected: %s", esp_err_to_name(err));
+    return false;
+  }
+  return true;
+}
+
+bool bleStartScan(uint32_t seconds) {
+  esp_err_t err = esp_ble_gap_start_scanning(seconds);
+  if (err != ESP_OK) {
+    log_e("BLE scan start failed: %s", esp_err_to_name(err));
+    return false;
+  }
+  return true;
+}
+
+void bleStopScan() {
+  esp_ble_gap_stop_scanning();
+}
+
+String BleLink::canonicalUuid(const String& uuid) {
+  return BLEUUID(uuid).toString();
+}
+
+bool BleLink::begin(BlePrinter* owner) {
+  if (linkCount == MAX_PRINTERS) {
+    return false;
+  }
+  _owner = owner;
+  _writeDone = xSemaphoreCreateBinary();
+  BLEClient* client = BLEDevice::createClient();
+  if (client == nullptr || _writeDone == nullptr) {
+    return false;
+  }
+  client->setClientCallbacks(new LinkCallbacks(owner));
+  _client = client;
+  links[linkCount++] = this;
+  return true;
+}
+
+bool BleLink::connect(const uint8_t* address, uint8_t addressType, uint16_t mtu) {
+  BLEClient* client = (BLEClient*)_client;
+  _characteristic = nullptr;
+  if (client->isConnected()) {
+    client->disconnect();
+  }
+
+  if (!client->connect(BLEAddress(const_cast<uint8_t*>(address)), (esp_ble_addr_type_t)addressType)) {
+    client->disconnect();
+    return false;
+  }
+
+  // Request a large MTU; the chunk size follows from the negotiated result
+  client->setMTU(mtu);
+
+  // Authenticate/Bond if needed
+  // client->authenticate(); // Some devices require explicit call
+
+  delay(100); // Reduced delay
+
+  if (!client->isConnected()) {
+    log_e("❌ Disconnected after MTU update");
+    client->disconnect();
+    return false;
+  }
+  return true;
+}
+
+void BleLink::disconnect() {
+  BLEClient* client = (BLEClient*)_client;
+  if (client != nullptr && client->isConnected()) {
+    client->disconnect();
+  }
+  _characteristic = nullptr;
+}
+
+bool BleLink::connected() const {
+  return _client != nullptr && ((BLEClient*)_client)->isConnected();
+}
+
+uint16_t BleLink::mtu() const {
+  return ((BLEClient*)_client)->getMTU();
+}
+
+void BleLink::requestParameters(const BleLinkRequest& request) {
+  BLEAddress peerAddress = ((BLEClient*)_client)->getPeerAddress();
+  esp_bd_addr_t* peer = peerAddress.getNative();
+
+  uint8_t phyMask = request.phy == BLE_PHY_1M ? ESP_BLE_GAP_PHY_1M_PREF_MASK
+                  : request.phy == BLE_PHY_CODED ? ESP_BLE_GAP_PHY_CODED_PREF_MASK
+                  : ESP_BLE_GAP_PHY_2M_PREF_MASK;
+  esp_err_t err = esp_ble_gap_set_preferred_phy(*peer, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF, phyMask, phyMask,
+                                                ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+  if (err != ESP_OK) {
+    log_w("PHY request failed: %s", esp_err_to_name(err));
+  }
+
+  dataLengthRequester = this;
+  err = esp_ble_gap_set_pkt_data_len(*peer, request.dataLength);
+  if (err != ESP_OK) {
+    log_w("Data length extension request failed: %s", esp_err_to_name(err));
+  }
+
+  requestConnParams(request);
+}
+
+// The update takes no event length; the controller sizes events itself
+void BleLink::requestConnParams(const BleLinkRequest& request) {
+  BLEAddress peerAddress = ((BLEClient*)_client)->getPeerAddress();
+  esp_bd_addr_t* peer = peerAddress.getNative();
+  esp_ble_conn_update_params_t params = {};
+  memcpy(params.bda, *peer, sizeof(esp_bd_addr_t));
+  params.min_int = request.connIntervalMin;
+  params.max_int = request.connIntervalMax;
+  params.latency = request.latency;
+  params.timeout = request.supervisionTimeout;
+  esp_err_t err = esp_ble_gap_update_conn_params(&params);
+  if (err != ESP_OK) {
+    log_w("Connection parameter update request failed: %s", esp_err_to_name(err));
+  }
+}
+
+bool BleLink::discover(const String& service, const String& characteristic, BleGattHandles& handles, String& name) {
+  BLEClient* client = (BLEClient*)_client;
+  BLEUUID serviceUUID(service);
+  BLEUUID characteristicUUID(characteristic);
+
+  // Get service and characteristic
+  BLERemoteService* pRemoteService = client->getService(serviceUUID);
+  if (pRemoteService == nullptr) {
+    log_e("❌ Failed to find service: %s", serviceUUID.toString().c_str());
+    return false;
+  }
+
+  log_i("✅ Found service: %s", serviceUUID.toString().c_str());
+
+  BLERemoteCharacteristic* pCharacteristic = pRemoteService->getCharacteristic(characteristicUUID);
+  if (pCharacteristic == nullptr) {
+    log_e("❌ Failed to find characteristic: %s", characteristicUUID.toString().c_str());
+    return false;
+  }
+
+  log_i("✅ Found characteristic: %s", characteristicUUID.toString().c_str());
+  _characteristic = pCharacteristic;
+  _txHandle = pCharacteristic->getHandle();
+  handles.tx = _txHandle;
+  handles.txProperties = (pCharacteristic->canWrite() ? BLE_PROP_WRITE : 0) |
+                         (pCharacteristic->canWriteNoResponse() ? BLE_PROP_WRITE_NR : 0);
+
+  // Printers that report status do it on a notify or indicate characteristic
+  // of the same service
+  handles.notify = 0;
+  handles.cccd = 0;
+  handles.notifyProperties = 0;
+  std::map<std::string, BLERemoteCharacteristic*>* characteristics = pRemoteService->getCharacteristics();
+  for (auto& entry : *characteristics) {
+    BLERemoteCharacteristic* candidate = entry.second;
+    if (!candidate->canNotify() && !candidate->canIndicate()) {
+      continue;
+    }
+    BLERemoteDescriptor* cccd = candidate->getDescriptor(BLEUUID((uint16_t)0x2902));
+    if (cccd == nullptr) {
+      continue;
+    }
+    handles.notify = candidate->getHandle();
+    handles.cccd = cccd->getHandle();
+    handles.notifyProperties = (candidate->canNotify() ? BLE_PROP_NOTIFY : 0) |
+                               (candidate->canIndicate() ? BLE_PROP_INDICATE : 0);
+    log_i("✅ Found status characteristic %s", candidate->getUUID().toString().c_str());
+    break;
+  }
+
+  handles.psm = 0;
+  BLERemoteCharacteristic* psmCharacteristic = pRemoteService->getCharacteristic(BLEUUID(BLE_L2CAP_PSM_UUID));
+  if (psmCharacteristic != nullptr && psmCharacteristic->canRead()) {
+    handles.psm = psmCharacteristic->readUInt16();
+    log_i("✅ Printer offers L2CAP on PSM 0x%04x", handles.psm);
+  }
+
+  // Try to read printer name from device name characteristic (00002a00-0000-1000-8000-00805f9b34fb)
+  // First, check if we can find the generic access service (00001800-0000-1000-8000-00805f9b34fb)
+  BLEUUID genericAccessServiceUUID("00001800-0000-1000-8000-00805f9b34fb");
+  BLERemoteService* pGenericAccessService = client->getService(genericAccessServiceUUID);
+
+  if (pGenericAccessService != nullptr) {
+    log_i("✅ Found Generic Access service");
+
+    BLERemoteCharacteristic* pDeviceNameCharacteristic = pGenericAccessService->getCharacteristic(deviceNameUUID);
+
+    if (pDeviceNameCharacteristic != nullptr) {
+      log_i("✅ Found Device Name characteristic");
+
+      if (pDeviceNameCharacteristic->canRead()) {
+        name = pDeviceNameCharacteristic->readValue();
+        log_i("✅ Printer name: %s", name.c_str());
+      } else {
+        log_w("❌ Device Name characteristic is not readable");
+      }
+    } else {
+      log_w("❌ Did not find Device Name characteristic");
+    }
+  } else {
+    log_w("❌ Did not find Generic Access service");
+  }
+  return true;
+}
+
+// The library object writes the characteristic it discovered; handles that
+// came from the cache go through the GATTC API
+bool BleLink::write(uint16_t handle, const uint8_t* data, size_t length, bool response) {
+  if (_characteristic != nullptr && handle == _txHandle) {
+    ((BLERemoteCharacteristic*)_characteristic)->writeValue(const_cast<uint8_t*>(data), length, response);
+    return true;
+  }
+  return BleLinkStack::rawWrite(*this, handle, false, data, length, response);
+}
+
+bool BleLink::subscribe(const BleGattHandles& handles) {
+  BLEClient* client = (BLEClient*)_client;
+  esp_err_t err = esp_ble_gattc_register_for_notify(client->getGattcIf(), *client->getPeerAddress().getNative(),
+                                                    handles.notify);
+  if (err != ESP_OK) {
+    log_w("Notify registration failed: %s", esp_err_to_name(err));
+    return false;
+  }
+
+  // Notifications when offered, indications otherwise
+  uint8_t enable[2] = {(uint8_t)((handles.notifyProperties & BLE_PROP_NOTIFY) ? 0x01 : 0x02), 0x00};
+  return BleLinkStack::rawWrite(*this, handles.cccd, true, enable, sizeof(enable), true);
+}
+
+// Bluedroid has no LE credit-based channels for clients; GATT carries all
+bool BleLink::openChannel(uint16_t psm) {
+  log_w("L2CAP PSM 0x%04x ignored: channels need the NimBLE build", psm);
+  return false;
+}
+
+bool BleLink::sendChannel(const uint8_t* first, size_t firstLength, const uint8_t* second, size_t secondLength) {
+  return false;
+}
+
+int BleLink::sendableBuffers() const {
+  return esp_ble_get_cur_sendable_packets_num(((BLEClient*)_client)->getConnId());
+}
+
+void BleLink::requestRssi() {
+  esp_ble_gap_read_rssi(*((BLEClient*)_client)->getPeerAddress().getNative());
+}
+
+#endif
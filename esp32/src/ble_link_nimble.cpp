@@ -0,0 +1,543 @@
+#include "ble_link.h"
+
+#if BLE_TRANSPORT_NIMBLE
+
+#include "ble_printer.h"
+
+#include <NimBLEDevice.h>
+#include <host/ble_hs_mbuf.h>
+
+// NimBLE through NimBLE-Arduino. The library connects and discovers; the
+// scanner, link parameters, writes and status notifications go through the
+// host API. Writes without response go straight into the host's buffers,
+// so there is no TX credit to count: a full pool answers BLE_HS_ENOMEM and
+// the write is retried once a buffer has gone out.
+
+// BLE Device Name characteristic (standard UUID)
+static NimBLEUUID deviceNameUUID(PRINTER_DEVICENAMEUUID);
+
+// Wait for the answer to a write with response this long
+const uint32_t GATT_WRITE_TIMEOUT = 1000;
+
+// L2CAP channels need CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM channels configured
+#if defined(CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM) && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0
+#define NIMBLE_L2CAP_COC 1
+#else
+#define NIMBLE_L2CAP_COC 0
+#endif
+const uint32_t L2CAP_CONNECT_TIMEOUT = 3000;
+// A channel that gets no credits for this long is taken as dead
+const uint32_t L2CAP_CREDIT_TIMEOUT = 5000;
+
+static BleScanResult scanResult = nullptr;
+static BleScanDone scanDone = nullptr;
+static ble_gap_disc_params scanParams = {};
+static BleLink* links[MAX_PRINTERS];
+static size_t linkCount = 0;
+
+class LinkCallbacks : public NimBLEClientCallbacks {
+public:
+  explicit LinkCallbacks(BlePrinter* owner) : _owner(owner) {}
+  void onConnect(NimBLEClient* client) override {
+    log_i("onConnect callback");
+  }
+  void onDisconnect(NimBLEClient* client) override {
+    log_i("onDisconnect callback");
+    _owner->onClientDisconnect(client);
+  }
+private:
+  BlePrinter* _owner;
+};
+
+// NimBLE keeps addresses least significant byte first
+static void reverseAddress(uint8_t* to, const uint8_t* from) {
+  for (size_t i = 0; i < 6; i++) {
+    to[i] = from[5 - i];
+  }
+}
+
+struct BleLinkStack {
+  static BleLink* forConnection(uint16_t connHandle) {
+    for (size_t i = 0; i < linkCount; i++) {
+      if (links[i]->_connHandle == connHandle && links[i]->connected()) {
+        return links[i];
+      }
+    }
+    return nullptr;
+  }
+
+  static int scanEvent(ble_gap_event* event, void* arg);
+  static int gapEvent(ble_gap_event* event, void* arg);
+  static int writeDone(uint16_t connHandle, const ble_gatt_error* error, ble_gatt_attr* attr, void* arg);
+#if NIMBLE_L2CAP_COC
+  static int channelEvent(ble_l2cap_event* event, void* arg);
+#endif
+};
+
+// Runs in the host task for each advertisement the controller passes on
+int BleLinkStack::scanEvent(ble_gap_event* event, void* arg) {
+  if (event->type == BLE_GAP_EVENT_DISC) {
+    uint8_t address[6];
+    reverseAddress(address, event->disc.addr.val);
+    scanResult(address, event->disc.addr.type, event->disc.rssi);
+  } else if (event->type == BLE_GAP_EVENT_DISC_COMPLETE) {
+    scanDone();
+  }
+  return 0;
+}
+
+// Listener for the events of every connection, next to the library's own
+int BleLinkStack::gapEvent(ble_gap_event* event, void* arg) {
+  BleLink* link;
+  ble_gap_conn_desc desc;
+
+  switch (event->type) {
+    case BLE_GAP_EVENT_CONN_UPDATE:
+      link = forConnection(event->conn_update.conn_handle);
+      if (link == nullptr) {
+        break;
+      }
+      if (event->conn_update.status == 0 && ble_gap_conn_find(event->conn_update.conn_handle, &desc) == 0) {
+        link->_owner->onConnParams(desc.conn_itvl);
+        log_i("%s: connection interval %d.%02d ms, latency %d, timeout %d ms", link->_owner->id().c_str(),
+              desc.conn_itvl * 125 / 100, desc.conn_itvl * 125 % 100,
+              desc.conn_latency, desc.supervision_timeout * 10);
+      } else {
+        log_w("%s: printer rejected connection parameters (status %d)", link->_owner->id().c_str(),
+              event->conn_update.status);
+      }
+      break;
+
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+      link = forConnection(event->phy_updated.conn_handle);
+      if (link == nullptr) {
+        break;
+      }
+      if (event->phy_updated.status == 0) {
+        link->_owner->onPhy(event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+        log_i("%s: PHY tx %dM, rx %dM", link->_owner->id().c_str(),
+              event->phy_updated.tx_phy == BLE_GAP_LE_PHY_2M ? 2 : 1,
+              event->phy_updated.rx_phy == BLE_GAP_LE_PHY_2M ? 2 : 1);
+      } else {
+        log_w("%s: PHY update failed (status %d), staying on 1M", link->_owner->id().c_str(),
+              event->phy_updated.status);
+      }
+      break;
+
+    case BLE_GAP_EVENT_NOTIFY_RX: {
+      link = forConnection(event->notify_rx.conn_handle);
+      if (link == nullptr) {
+        break;
+      }
+      // Status reports are a few bytes; anything longer is cut
+      uint8_t value[64];
+      uint16_t length = 0;
+      ble_hs_mbuf_to_flat(event->notify_rx.om, value, sizeof(value), &length);
+      link->_owner->onNotify(event->notify_rx.attr_handle, value, length);
+      break;
+    }
+
+    default:
+      break;
+  }
+  return 0;
+}
+
+int BleLinkStack::writeDone(uint16_t connHandle, const ble_gatt_error* error, ble_gatt_attr* attr, void* arg) {
+  BleLink* link = (BleLink*)arg;
+  if (link->_pendingWrite != 0) {
+    link->_pendingWrite = 0;
+    link->_writeStatus = error->status;
+    xSemaphoreGive(link->_writeDone);
+  }
+  return 0;
+}
+
+#if NIMBLE_L2CAP_COC
+int BleLinkStack::channelEvent(ble_l2cap_event* event, void* arg) {
+  BleLink* link = (BleLink*)arg;
+  ble_l2cap_chan_info info;
+
+  switch (event->type) {
+    case BLE_L2CAP_EVENT_COC_CONNECTED:
+      if (event->connect.status == 0 && ble_l2cap_get_chan_info(event->connect.chan, &info) == 0) {
+        link->_channelMtu = info.peer_coc_mtu < BLE_L2CAP_SDU_MAX ? info.peer_coc_mtu : BLE_L2CAP_SDU_MAX;
+        link->_channelStalled = false;
+        link->_channel = event->connect.chan;
+      }
+      xSemaphoreGive(link->_channelEvent);
+      break;
+
+    case BLE_L2CAP_EVENT_COC_DISCONNECTED:
+      link->_channel = nullptr;
+      xSemaphoreGive(link->_channelEvent);
+      break;
+
+    case BLE_L2CAP_EVENT_COC_TX_UNSTALLED:
+      link->_channelStalled = false;
+      xSemaphoreGive(link->_channelEvent);
+      break;
+
+    case BLE_L2CAP_EVENT_COC_DATA_RECEIVED:
+      // Printers report status over GATT; anything on the channel is dropped
+      os_mbuf_free_chain(event->receive.sdu_rx);
+      ble_l2cap_recv_ready(event->receive.chan, os_msys_get_pkthdr(0, 0));
+      break;
+
+    default:
+      break;
+  }
+  return 0;
+}
+#endif
+
+bool bleStackInit(const char* deviceName, const BleScanSettings& settings, BleScanResult result, BleScanDone done) {
+  scanResult = result;
+  scanDone = done;
+  NimBLEDevice::init(deviceName);
+  log_i("BLE initialized (NimBLE)");
+
+  // Outcome of PHY and connection parameter requests, and notifications
+  NimBLEDevice::setCustomGapHandler(BleLinkStack::gapEvent);
+
+  // A device may use a public or a static random address, so both are listed
+  bool acceptList = settings.accept != nullptr;
+  if (acceptList) {
+    ble_addr_t list[2 * MAX_PRINTERS];
+    size_t count = 0;
+    for (size_t i = 0; i < settings.acceptCount && count + 2 <= 2 * MAX_PRINTERS; i++) {
+      list[count].type = BLE_ADDR_PUBLIC;
+      reverseAddress(list[count].val, settings.accept[i]);
+      list[count + 1] = list[count];
+      list[count + 1].type = BLE_ADDR_RANDOM;
+      count += 2;
+    }
+    if (count < 2 * settings.acceptCount || ble_gap_wl_set(list, count) != 0) {
+      log_w("BLE accept list full, scanning for all devices");
+      acceptList = false;
+    }
+  }
+
+  // Results aren't kept: BLE_GAP_EVENT_DISC hands each one over as it
+  // comes. Intervals are in 0.625 ms units.
+  scanParams.itvl = settings.intervalMs * 8 / 5;
+  scanParams.window = settings.windowMs * 8 / 5;
+  scanParams.filter_policy = acceptList ? BLE_HCI_SCAN_FILT_USE_WL : BLE_HCI_SCAN_FILT_NO_WL;
+  scanParams.limited = 0;
+  scanParams.passive = settings.active ? 0 : 1;
+  scanParams.filter_duplicates = 1;
+  return true;
+}
+
+bool bleStartScan(uint32_t seconds) {
+  int rc = ble_gap_disc(BLE_OWN_ADDR_PUBLIC, seconds * 1000, &scanParams, BleLinkStack::scanEvent, nullptr);
+  if (rc != 0) {
+    log_e("BLE scan start failed: %d", rc);
+    return false;
+  }
+  return true;
+}
+
+// Cancelling reports no DISC_COMPLETE
+void bleStopScan() {
+  ble_gap_disc_cancel();
+}
+
+String BleLink::canonicalUuid(const String& uuid) {
+  // The 128-bit form, as Bluedroid prints it, so the NVS cache reads the same
+  NimBLEUUID full(uuid.c_str());
+  full.to128();
+  return String(full.toString().c_str());
+}
+
+bool BleLink::begin(BlePrinter* owner) {
+  if (linkCount == MAX_PRINTERS) {
+    return false;
+  }
+  _owner = owner;
+  _writeDone = xSemaphoreCreateBinary();
+  _channelEvent = xSemaphoreCreateBinary();
+  NimBLEClient* client = NimBLEDevice::createClient();
+  if (client == nullptr || _writeDone == nullptr || _channelEvent == nullptr) {
+    return false;
+  }
+  client->setClientCallbacks(new LinkCallbacks(owner), false);
+  _client = client;
+  links[linkCount++] = this;
+  return true;
+}
+
+bool BleLink::connect(const uint8_t* address, uint8_t addressType, uint16_t mtu) {
+  NimBLEClient* client = (NimBLEClient*)_client;
+  _channel = nullptr;
+  if (client->isConnected()) {
+    client->disconnect();
+  }
+
+  // NimBLE exchanges the MTU as part of connecting, so it is set first
+  NimBLEDevice::setMTU(mtu);
+
+  ble_addr_t peer;
+  peer.type = addressType;
+  reverseAddress(peer.val, address);
+  if (!client->connect(NimBLEAddress(peer))) {
+    return false;
+  }
+  _connHandle = client->getConnId();
+  return true;
+}
+
+// Dropping the connection closes the channel with it
+void BleLink::disconnect() {
+  NimBLEClient* client = (NimBLEClient*)_client;
+  if (client != nullptr && client->isConnected()) {
+    client->disconnect();
+  }
+  _channel = nullptr;
+}
+
+bool BleLink::connected() const {
+  return _client != nullptr && ((NimBLEClient*)_client)->isConnected();
+}
+
+uint16_t BleLink::mtu() const {
+  return ((NimBLEClient*)_client)->getMTU();
+}
+
+void BleLink::requestParameters(const BleLinkRequest& request) {
+  uint8_t phyMask = request.phy == BLE_PHY_1M ? BLE_GAP_LE_PHY_1M_MASK
+                  : request.phy == BLE_PHY_CODED ? BLE_GAP_LE_PHY_CODED_MASK
+                  : BLE_GAP_LE_PHY_2M_MASK;
+  int rc = ble_gap_set_prefered_le_phy(_connHandle, phyMask, phyMask, BLE_GAP_LE_PHY_CODED_ANY);
+  if (rc != 0) {
+    log_w("PHY request failed: %d", rc);
+  }
+
+  // The host reports no outcome of the data length request; the length is
+  // taken as set once the controller has accepted it. 2120 us is the air
+  // time of 251 octets on 1M.
+  rc = ble_gap_set_data_len(_connHandle, request.dataLength, 2120);
+  if (rc != 0) {
+    log_w("Data length extension request failed: %d", rc);
+  } else {
+    _owner->onDataLength(request.dataLength);
+  }
+
+  requestConnParams(request);
+}
+
+void BleLink::requestConnParams(const BleLinkRequest& request) {
+  if (request.eventLength == 0) {
+    ((NimBLEClient*)_client)->updateConnParams(request.connIntervalMin, request.connIntervalMax,
+                                               request.latency, request.supervisionTimeout);
+    return;
+  }
+  struct ble_gap_upd_params params = {};
+  params.itvl_min = request.connIntervalMin;
+  params.itvl_max = request.connIntervalMax;
+  params.latency = request.latency;
+  params.supervision_timeout = request.supervisionTimeout;
+  params.min_ce_len = request.eventLength;
+  params.max_ce_len = request.eventLength;
+  int rc = ble_gap_update_params(_connHandle, &params);
+  if (rc != 0) {
+    log_w("Connection parameter update request failed: %d", rc);
+  }
+}
+
+bool BleLink::discover(const String& service, const String& characteristic, BleGattHandles& handles, String& name) {
+  NimBLEClient* client = (NimBLEClient*)_client;
+  NimBLEUUID serviceUUID(service.c_str());
+  NimBLEUUID characteristicUUID(characteristic.c_str());
+
+  NimBLERemoteService* remoteService = client->getService(serviceUUID);
+  if (remoteService == nullptr) {
+    log_e("❌ Failed to find service: %s", service.c_str());
+    return false;
+  }
+  log_i("✅ Found service: %s", service.c_str());
+
+  NimBLERemoteCharacteristic* remoteCharacteristic = remoteService->getCharacteristic(characteristicUUID);
+  if (remoteCharacteristic == nullptr) {
+    log_e("❌ Failed to find characteristic: %s", characteristic.c_str());
+    return false;
+  }
+  log_i("✅ Found characteristic: %s", characteristic.c_str());
+  _txHandle = remoteCharacteristic->getHandle();
+  handles.tx = _txHandle;
+  handles.txProperties = (remoteCharacteristic->canWrite() ? BLE_PROP_WRITE : 0) |
+                         (remoteCharacteristic->canWriteNoResponse() ? BLE_PROP_WRITE_NR : 0);
+
+  // Printers that report status do it on a notify or indicate characteristic
+  // of the same service
+  handles.notify = 0;
+  handles.cccd = 0;
+  handles.notifyProperties = 0;
+  std::vector<NimBLERemoteCharacteristic*>* characteristics = remoteService->getCharacteristics(true);
+  for (NimBLERemoteCharacteristic* candidate : *characteristics) {
+    if (!candidate->canNotify() && !candidate->canIndicate()) {
+      continue;
+    }
+    NimBLERemoteDescriptor* cccd = candidate->getDescriptor(NimBLEUUID((uint16_t)0x2902));
+    if (cccd == nullptr) {
+      continue;
+    }
+    handles.notify = candidate->getHandle();
+    handles.cccd = cccd->getHandle();
+    handles.notifyProperties = (candidate->canNotify() ? BLE_PROP_NOTIFY : 0) |
+                               (candidate->canIndicate() ? BLE_PROP_INDICATE : 0);
+    log_i("✅ Found status characteristic %s", candidate->getUUID().toString().c_str());
+    break;
+  }
+
+  handles.psm = 0;
+  NimBLERemoteCharacteristic* psmCharacteristic = remoteService->getCharacteristic(NimBLEUUID(BLE_L2CAP_PSM_UUID));
+  if (psmCharacteristic != nullptr && psmCharacteristic->canRead()) {
+    handles.psm = psmCharacteristic->readValue<uint16_t>();
+    log_i("✅ Printer offers L2CAP on PSM 0x%04x", handles.psm);
+  }
+
+  NimBLERemoteService* genericAccess = client->getService(NimBLEUUID((uint16_t)0x1800));
+  NimBLERemoteCharacteristic* deviceName = genericAccess != nullptr ? genericAccess->getCharacteristic(deviceNameUUID)
+                                                                    : nullptr;
+  if (deviceName != nullptr && deviceName->canRead()) {
+    name = String(deviceName->readValue().c_str());
+    log_i("✅ Printer name: %s", name.c_str());
+  } else {
+    log_w("❌ No readable Device Name characteristic");
+  }
+  return true;
+}
+
+bool BleLink::write(uint16_t handle, const uint8_t* data, size_t length, bool response) {
+  if (!response) {
+    for (;;) {
+      int rc = ble_gattc_write_no_rsp_flat(_connHandle, handle, data, length);
+      if (rc != BLE_HS_ENOMEM) {
+        return rc == 0;
+      }
+      if (!connected()) {
+        return false;
+      }
+      vTaskDelay(1);
+    }
+  }
+
+  xSemaphoreTake(_writeDone, 0);
+  _pendingWrite = handle;
+  if (ble_gattc_write_flat(_connHandle, handle, data, length, BleLinkStack::writeDone, this) != 0) {
+    _pendingWrite = 0;
+    return false;
+  }
+  if (xSemaphoreTake(_writeDone, pdMS_TO_TICKS(GATT_WRITE_TIMEOUT)) != pdTRUE) {
+    _pendingWrite = 0;
+    return false;
+  }
+  return _writeStatus == 0;
+}
+
+// The notifications reach the GAP listener whatever the library knows of
+// the subscription, so writing the descriptor is all it takes
+bool BleLink::subscribe(const BleGattHandles& handles) {
+  uint8_t enable[2] = {(uint8_t)((handles.notifyProperties & BLE_PROP_NOTIFY) ? 0x01 : 0x02), 0x00};
+  return write(handles.cccd, enable, sizeof(enable), true);
+}
+
+#if NIMBLE_L2CAP_COC
+bool BleLink::openChannel(uint16_t psm) {
+  // Our receive side gets nothing but needs a buffer to start with
+  os_mbuf* receive = os_msys_get_pkthdr(0, 0);
+  if (receive == nullptr) {
+    return false;
+  }
+  xSemaphoreTake(_channelEvent, 0);
+  int rc = ble_l2cap_connect(_connHandle, psm, BLE_L2CAP_SDU_MAX, receive, BleLinkStack::channelEvent, this);
+  if (rc != 0) {
+    os_mbuf_free_chain(receive);
+    log_w("L2CAP connect to PSM 0x%04x failed: %d", psm, rc);
+    return false;
+  }
+  if (xSemaphoreTake(_channelEvent, pdMS_TO_TICKS(L2CAP_CONNECT_TIMEOUT)) != pdTRUE || _channel == nullptr) {
+    log_w("L2CAP channel on PSM 0x%04x refused, staying on GATT", psm);
+    return false;
+  }
+  return true;
+}
+
+bool BleLink::sendChannel(const uint8_t* first, size_t firstLength, const uint8_t* second, size_t secondLength) {
+  // The previous SDU went out of credits; this one waits until the printer
+  // grants more
+  while (_channelStalled) {
+    if (_channel == nullptr) {
+      return false;
+    }
+    if (xSemaphoreTake(_channelEvent, pdMS_TO_TICKS(L2CAP_CREDIT_TIMEOUT)) != pdTRUE) {
+      log_w("No L2CAP credits after %u ms", L2CAP_CREDIT_TIMEOUT);
+      return false;
+    }
+  }
+
+  os_mbuf* sdu = os_msys_get_pkthdr(firstLength + secondLength, 0);
+  while (sdu == nullptr) {
+    if (_channel == nullptr) {
+      return false;
+    }
+    vTaskDelay(1);
+    sdu = os_msys_get_pkthdr(firstLength + secondLength, 0);
+  }
+  if (os_mbuf_append(sdu, first, firstLength) != 0 ||
+      (secondLength > 0 && os_mbuf_append(sdu, second, secondLength) != 0)) {
+    os_mbuf_free_chain(sdu);
+    return false;
+  }
+
+  for (;;) {
+    ble_l2cap_chan* channel = (ble_l2cap_chan*)_channel;
+    if (channel == nullptr) {
+      os_mbuf_free_chain(sdu);
+      return false;
+    }
+    xSemaphoreTake(_channelEvent, 0);
+    _channelStalled = true;
+    int rc = ble_l2cap_send(channel, sdu);
+    if (rc == 0) {
+      _channelStalled = false;
+      return true;
+    }
+    if (rc == BLE_HS_ESTALLED) {
+      // Taken; the rest waits for credits and TX_UNSTALLED clears the flag
+      return true;
+    }
+    _channelStalled = false;
+    // The stack keeps the SDU only when it took it
+    if (rc != BLE_HS_ENOMEM && rc != BLE_HS_EBUSY) {
+      os_mbuf_free_chain(sdu);
+      return false;
+    }
+    vTaskDelay(1);
+  }
+}
+#else
+bool BleLink::openChannel(uint16_t psm) {
+  log_w("L2CAP PSM 0x%04x ignored: built without CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM", psm);
+  return false;
+}
+
+bool BleLink::sendChannel(const uint8_t* first, size_t firstLength, const uint8_t* second, size_t secondLength) {
+  return false;
+}
+#endif
+
+int BleLink::sendableBuffers() const {
+  return -1;
+}
+
+// The host answers from the controller right away
+void BleLink::requestRssi() {
+  int8_t rssi = 0;
+  if (ble_gap_conn_rssi(_connHandle, &rssi) == 0) {
+    _owner->onRssi(rssi);
+  }
+}
+
+#endif
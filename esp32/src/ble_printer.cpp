@@ -0,0 +1,1533 @@
+#include "ble_printer.h"
+#include "heap_stats.h"
+#include "bridge_config.h"
+#include "trace.h"
+#include "stall_watch.h"
+#include "hot_path.h"
+
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <esp_bt.h>
+
+const uint32_t BLE_SCAN_SECONDS = 5;       // One scan window
+const uint32_t BLE_BACKOFF_MIN = 250;      // ms, doubled per failed attempt
+const uint32_t BLE_BACKOFF_MAX = 8000;
+
+// Give up waiting for a TX credit after this long and send acknowledged
+const unsigned long bleCreditTimeout = 2000;
+
+// Software flow control bytes sent by the printer
+const uint8_t ASCII_XON = 0x11;
+const uint8_t ASCII_XOFF = 0x13;
+// Paper end bits of the GS r 1 paper sensor status
+const uint8_t STATUS_PAPER_END = 0x0C;
+
+const uint16_t ATT_HEADER_SIZE = 3;
+const uint16_t ATT_DEFAULT_MTU = 23;
+const size_t ATT_MAX_VALUE_SIZE = 512;
+
+// The connection parameters come from bridgeConfig()
+const uint16_t BLE_DLE_TX_OCTETS = 251;
+
+// Print characteristic as cached in NVS, so a reconnect can connect straight
+// to the printer's address and skip service discovery. The cache is keyed by
+// address and UUIDs; changing any of them in the config invalidates it.
+const char* GATT_CACHE_NAMESPACE = "gattcache";
+
+static BlePrinter printers[MAX_PRINTERS];
+static size_t registrySize = 0;
+static String poolNames[MAX_PRINTERS];
+static size_t poolCount = 0;
+// Drain rate assumed for a printer that hasn't printed anything yet
+static const uint32_t POOL_DEFAULT_THROUGHPUT = 16384;
+
+// The scanner is shared by all printers that are looking for their device
+static SemaphoreHandle_t scanLock = nullptr;
+static bool scanRunning = false;
+// Both stacks set up one connection at a time reliably, so link tasks take
+// turns connecting and discovering
+static SemaphoreHandle_t connectLock = nullptr;
+// Set before the link tasks start
+static BleLinkListener linkListener = nullptr;
+
+static void stopSharedScan(BlePrinter* found);
+
+#if TX_POWER_POLICY
+// Controller levels of the TxPowerPolicy steps
+static const esp_power_level_t TX_POWER_LEVELS[TX_POWER_STEPS] = {
+  ESP_PWR_LVL_N12, ESP_PWR_LVL_N9, ESP_PWR_LVL_N6, ESP_PWR_LVL_N3,
+  ESP_PWR_LVL_N0, ESP_PWR_LVL_P3, ESP_PWR_LVL_P6, ESP_PWR_LVL_P9
+};
+static portMUX_TYPE txPowerMux = portMUX_INITIALIZER_UNLOCKED;
+static int txPowerStep = -1;   // Last one set
+#endif
+
+// The client APIs don't tell which controller connection belongs to which
+// printer, so one level covers them all: the highest any link that is up
+// or coming up asks for
+static void applyTxPower() {
+#if TX_POWER_POLICY
+  int step = -1;
+  for (size_t i = 0; i < registrySize; i++) {
+    BleLinkState state = printers[i].linkState();
+    bool linked = state == LINK_CONNECTING || state == LINK_DISCOVERING || state == LINK_READY;
+    if (linked && !printers[i].usb() && !printers[i].spp() && (int)printers[i].txPowerStep() > step) {
+      step = printers[i].txPowerStep();
+    }
+  }
+  if (step < 0) {
+    return;
+  }
+  portENTER_CRITICAL(&txPowerMux);
+  bool changed = step != txPowerStep;
+  txPowerStep = step;
+  portEXIT_CRITICAL(&txPowerMux);
+  if (!changed) {
+    return;
+  }
+  esp_power_level_t level = TX_POWER_LEVELS[step];
+  esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_DEFAULT, level);
+  for (int type = ESP_BLE_PWR_TYPE_CONN_HDL0; type <= ESP_BLE_PWR_TYPE_CONN_HDL8; type++) {
+    esp_ble_tx_power_set((esp_ble_power_type_t)type, level);
+  }
+  log_i("BLE TX power %d dBm", -12 + 3 * step);
+#endif
+}
+
+// BLE links with work, which share the radio between them
+static uint8_t busyLinks() {
+  uint8_t busy = 0;
+  for (size_t i = 0; i < registrySize; i++) {
+    busy += printers[i].connBusy() ? 1 : 0;
+  }
+  return busy;
+}
+
+// Runs in the BLE stack task for each advertisement the controller passes on
+static void onScanResult(const uint8_t* bda, uint8_t addressType, int rssi) {
+  for (size_t i = 0; i < registrySize; i++) {
+    if (printers[i].wantsAdvertisement(bda, addressType, rssi)) {
+      stopSharedScan(&printers[i]);
+      return;
+    }
+  }
+}
+
+static void onSharedScanComplete() {
+  xSemaphoreTake(scanLock, portMAX_DELAY);
+  scanRunning = false;
+  xSemaphoreGive(scanLock);
+
+  for (size_t i = 0; i < registrySize; i++) {
+    if (printers[i].linkState() == LINK_SCANNING) {
+      printers[i].postEvent(LINK_EVT_SCAN_DONE, nullptr);
+    }
+  }
+}
+
+// Start a scan window unless one is already running for another printer
+static void startSharedScan() {
+  xSemaphoreTake(scanLock, portMAX_DELAY);
+  if (!scanRunning) {
+    // Non-blocking; a sighting or the end of the window posts an event
+    scanRunning = bleStartScan(BLE_SCAN_SECONDS);
+  }
+  xSemaphoreGive(scanLock);
+}
+
+// Connecting while scanning is unreliable, so a sighting ends the window.
+// The printers still looking scan again after a short backoff.
+static void stopSharedScan(BlePrinter* found) {
+  xSemaphoreTake(scanLock, portMAX_DELAY);
+  if (scanRunning) {
+    bleStopScan();
+    scanRunning = false;
+  }
+  xSemaphoreGive(scanLock);
+
+  for (size_t i = 0; i < registrySize; i++) {
+    if (&printers[i] != found && printers[i].linkState() == LINK_SCANNING) {
+      printers[i].postEvent(LINK_EVT_SCAN_DONE, nullptr);
+    }
+  }
+}
+
+const char* linkStateName(BleLinkState state) {
+  switch (state) {
+    case LINK_IDLE: return "idle";
+    case LINK_SCANNING: return "scanning";
+    case LINK_CONNECTING: return "connecting";
+    case LINK_DISCOVERING: return "discovering";
+    case LINK_READY: return "ready";
+    case LINK_BACKOFF: return "backoff";
+  }
+  return "unknown";
+}
+
+void setBleLinkListener(BleLinkListener listener) {
+  linkListener = listener;
+}
+
+BlePrinter::BlePrinter() {
+  _pipeline.setStage(STAGE_RESAMPLE, resampleStage, this);
+  _pipeline.setStage(STAGE_RECODE, recodeStage, this);
+  _pipeline.setStage(STAGE_SEND, sendStage, this);
+}
+
+// "AA:BB:CC:DD:EE:FF" in either case
+static bool parseMac(const String& text, uint8_t* address) {
+  if (text.length() != 17) {
+    return false;
+  }
+  for (size_t i = 0; i < 6; i++) {
+    const char* field = text.c_str() + i * 3;
+    if (!isxdigit(field[0]) || !isxdigit(field[1]) || (i < 5 && field[2] != ':')) {
+      return false;
+    }
+    char hex[3] = {field[0], field[1], '\0'};
+    address[i] = (uint8_t)strtoul(hex, nullptr, 16);
+  }
+  return true;
+}
+
+void BlePrinter::configure(uint8_t index, const String& id, const String& mac,
+                           const String& serviceUUID, const String& characteristicUUID) {
+  _index = index;
+  _id = id;
+  _mac = mac;
+  _usb = mac.equalsIgnoreCase("usb");
+  _spp = mac.substring(0, 4).equalsIgnoreCase("spp:");
+  // A Classic address is kept out of the BLE scan and accept list
+  bool addressValid = !_usb && parseMac(_spp ? mac.substring(4) : mac, _macAddress);
+  _macValid = addressValid && !_spp;
+  if (!addressValid && !_usb) {
+    log_e("Printer %s: %s is not a MAC address", id.c_str(), mac.c_str());
+  }
+  _serviceUUID = BleLink::canonicalUuid(serviceUUID);
+  _characteristicUUID = BleLink::canonicalUuid(characteristicUUID);
+  configurePipeline();
+}
+
+bool BlePrinter::begin() {
+  if (_usb) {
+    // No link task: the USB client task reports the printer coming and going
+    return initUsbPrinter(usbEvent, this);
+  }
+  if (_spp) {
+    // The SPP link task connects and reconnects on its own
+    return initSppPrinter(_macAddress, sppEvent, this);
+  }
+
+  _events = xQueueCreate(8, sizeof(BleLinkEvent));
+  loadGattCache();
+
+  // The client is created once and kept for every reconnect, so the link
+  // allocates no client or callbacks after boot
+  if (!_link.begin(this)) {
+    log_e("Failed to create BLE client for %s", _id.c_str());
+    return false;
+  }
+
+  char name[16];
+  snprintf(name, sizeof(name), "bleLink%u", _index);
+  if (_events == nullptr ||
+      xTaskCreatePinnedToCore(linkTask, name, 6144, this, 2, nullptr, BLE_LINK_CORE) != pdPASS) {
+    log_e("Failed to start BLE link task for %s", _id.c_str());
+    return false;
+  }
+  return true;
+}
+
+void BlePrinter::postEvent(BleLinkEventType type, const void* client) {
+  if (_events == nullptr) {
+    return;
+  }
+  BleLinkEvent event = { type, client };
+  if (xQueueSend(_events, &event, 0) != pdTRUE) {
+    log_w("%s: BLE link event %d dropped", _id.c_str(), type);
+  }
+}
+
+// Compares the raw address, so a scan hit allocates nothing
+bool BlePrinter::wantsAdvertisement(const uint8_t* bda, uint8_t addressType, int rssi) {
+  if (_linkState != LINK_SCANNING || !_macValid || memcmp(bda, _macAddress, sizeof(_macAddress)) != 0) {
+    return false;
+  }
+
+  memcpy(_foundAddress, bda, sizeof(_foundAddress));
+  _foundAddressType = addressType;
+  _found = true;
+  postEvent(LINK_EVT_FOUND, nullptr);
+
+  log_i("✅ PRINTER DETECTED: %s, RSSI %d dBm", _id.c_str(), rssi);
+  return true;
+}
+
+void BlePrinter::onClientDisconnect(const void* client) {
+  if (client == _link.client()) {
+    if (_connected) {
+      _metrics.recordDisconnect();
+    }
+    _connected = false;
+  }
+  postEvent(LINK_EVT_DISCONNECTED, client);
+}
+
+void BlePrinter::onNotify(uint16_t handle, const uint8_t* data, size_t length) {
+  if (handle != _handles.notify) {
+    return;
+  }
+  log_d("%s: status notify, %d bytes, first 0x%02x", _id.c_str(), length, length > 0 ? data[0] : 0);
+
+  // A report made up of XON/XOFF only is flow control. GS r status bytes
+  // always have bit 4 clear, so they never look like either.
+  bool flowControl = length > 0;
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] == ASCII_XOFF) {
+      _txPaused = true;
+    } else if (data[i] == ASCII_XON) {
+      _txPaused = false;
+    } else {
+      flowControl = false;
+    }
+  }
+  if (flowControl) {
+    return;
+  }
+
+  // Status is answered in order, so the printer got through the whole job
+  if (_idleQueryPending) {
+    _idleQueryPending = false;
+    if (length == 1) {
+      _paperOut = (data[0] & STATUS_PAPER_END) != 0;
+    }
+    markPrinterIdle(_index);
+  }
+}
+
+void BlePrinter::usbEvent(void* context, bool attached) {
+  // Bulk transfers have no MTU; chunks are what one transfer holds
+  ((BlePrinter*)context)->streamLinkChanged(attached, usbPrinterName(), USB_PRINTER_TRANSFER_SIZE);
+}
+
+void BlePrinter::sppEvent(void* context, bool connected) {
+  // The remote name isn't read over SPP, so the default raster profile applies
+  ((BlePrinter*)context)->streamLinkChanged(connected, "SPP printer", SPP_CHUNK_SIZE);
+}
+
+// A USB or SPP printer coming or going; there is no link task behind them
+void BlePrinter::streamLinkChanged(bool up, const char* name, size_t chunkSize) {
+  if (up) {
+    _name = name;
+    _mtu = 0;
+    _chunkSize = chunkSize;
+    _dataLength = 0;
+    matchProfile();
+    configurePipeline();
+    _recoder.begin(rasterProfile(), PrintPipeline::output(), _pipeline.outputContext(STAGE_RECODE));
+    _connected = true;
+    _linkState = LINK_READY;
+    _metrics.recordConnect(true);
+  } else {
+    if (_connected) {
+      _metrics.recordDisconnect();
+    }
+    _connected = false;
+    _linkState = LINK_IDLE;
+  }
+  TRACE_INSTANT(TRACE_LINK_STATE, _index << 8 | _linkState);
+  if (linkListener) {
+    linkListener(_index, _linkState);
+  }
+}
+
+void BlePrinter::linkTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  ((BlePrinter*)param)->runLink();
+}
+
+void BlePrinter::startScan() {
+  log_i("Scanning for printer %s (%s)", _id.c_str(), _mac.c_str());
+  _linkState = LINK_SCANNING;
+  startSharedScan();
+}
+
+void BlePrinter::enterBackoff() {
+  _failures++;
+  _linkState = LINK_BACKOFF;
+}
+
+uint32_t BlePrinter::backoffDelay() const {
+  uint32_t delayMs = BLE_BACKOFF_MIN << (_failures > 6 ? 6 : _failures);
+  return delayMs > BLE_BACKOFF_MAX ? BLE_BACKOFF_MAX : delayMs;
+}
+
+// A printer with cached handles is connected to directly; scanning is the
+// fallback when it doesn't answer
+void BlePrinter::beginAttempt() {
+  if (_cacheValid && _failures == 0) {
+    bool connected = connect(true);
+    _metrics.recordConnect(connected);
+    if (connected) {
+      _linkState = LINK_READY;
+      return;
+    }
+    log_i("%s: direct connect failed, scanning", _id.c_str());
+  }
+  startScan();
+}
+
+void BlePrinter::runLink() {
+  beginAttempt();
+
+  BleLinkState reported = LINK_IDLE;
+  for (;;) {
+    if (_linkState != reported) {
+      reported = _linkState;
+      TRACE_INSTANT(TRACE_LINK_STATE, _index << 8 | reported);
+      applyTxPower();
+      if (linkListener) {
+        linkListener(_index, reported);
+      }
+    }
+
+    bool connected;
+    TickType_t wait = (_linkState == LINK_BACKOFF) ? pdMS_TO_TICKS(backoffDelay())
+                    : (CONN_SCHEDULE && _linkState == LINK_READY) ? pdMS_TO_TICKS(CONN_SCHEDULE_PERIOD_MS)
+                    : portMAX_DELAY;
+    BleLinkEvent event;
+    if (xQueueReceive(_events, &event, wait) != pdTRUE) {
+      if (_linkState == LINK_READY) {
+        scheduleConnection();
+        continue;
+      }
+      // Backoff elapsed
+      startScan();
+      continue;
+    }
+
+    switch (event.type) {
+      case LINK_EVT_FOUND:
+        if (_linkState != LINK_SCANNING) {
+          break;
+        }
+        // Connecting blocks this task only; the main loop keeps running
+        connected = connect(false);
+        _metrics.recordConnect(connected);
+        if (connected) {
+          _linkState = LINK_READY;
+          _failures = 0;
+        } else {
+          enterBackoff();
+        }
+        break;
+
+      case LINK_EVT_SCAN_DONE:
+        if (_linkState == LINK_SCANNING) {
+          // Give the radio back to Wi-Fi for a moment before the next window
+          enterBackoff();
+        }
+        break;
+
+      case LINK_EVT_DISCONNECTED:
+        // Ignore late callbacks from clients of earlier attempts
+        if (event.client != _link.client() || _linkState != LINK_READY) {
+          break;
+        }
+        log_i("%s: printer dropped, reconnecting", _id.c_str());
+        if (_autoConnect) {
+          beginAttempt();
+        } else {
+          _linkState = LINK_IDLE;
+        }
+        break;
+
+      case LINK_EVT_CONNECT:
+        _autoConnect = true;
+        if (_linkState == LINK_IDLE || _linkState == LINK_BACKOFF) {
+          _failures = 0;
+          beginAttempt();
+        }
+        break;
+
+      case LINK_EVT_DISCONNECT:
+        _autoConnect = false;
+        _linkState = LINK_IDLE;
+        disconnect();
+        break;
+
+      case LINK_EVT_JOB:
+        // The job is spooled or held while this runs; a scan or connect
+        // already under way is left to finish
+        if (_autoConnect && _linkState == LINK_BACKOFF) {
+          log_i("%s: job waiting, connecting now", _id.c_str());
+          _failures = 0;
+          beginAttempt();
+        }
+        break;
+    }
+  }
+}
+
+// Connect to the device found by the last scan, or with direct straight to
+// the configured address without scanning first
+bool BlePrinter::connect(bool direct) {
+  STALL_SECTION("ble connect");
+  if (_connected) {
+    log_i("Printer already connected");
+    return true;
+  }
+
+  if (!direct && !_found) {
+    log_i("Printer not found in scan yet");
+    return false;
+  }
+
+  xSemaphoreTake(connectLock, portMAX_DELAY);
+  log_i("Connecting to printer %s at %s%s", _id.c_str(), _mac.c_str(), direct ? " (direct)" : "");
+  _linkState = LINK_CONNECTING;
+  // Full power until the link has shown it needs less
+  _txPower.begin();
+  applyTxPower();
+
+  // The name is the one cached from the last connect, if any; discovery
+  // may still change the profile below
+  matchProfile();
+
+  // The client from begin() is reused; deleting it would race callbacks
+  // still queued in the BLE task. A large MTU is asked for and our chunks
+  // are sized from the negotiated result.
+  uint16_t mtu = _profile != nullptr && _profile->mtu != 0 ? _profile->mtu : bridgeConfig().mtu;
+  bool connected = direct ? _link.connect(_macAddress, BLE_ADDRESS_PUBLIC, mtu)
+                          : _link.connect(_foundAddress, _foundAddressType, mtu);
+  if (!connected) {
+    log_e("❌ Connection failed");
+    xSemaphoreGive(connectLock);
+    return false;
+  }
+
+  log_i("✅ Connected to printer %s", _id.c_str());
+
+  _mtu = _link.mtu();
+  if (_mtu < ATT_DEFAULT_MTU) {
+    _mtu = ATT_DEFAULT_MTU;
+  }
+  sizeChunks();
+
+  negotiateLinkParameters();
+
+  // Skip discovery when the cached handle still takes writes
+  _linkState = LINK_DISCOVERING;
+  _cacheUsed = restoreCachedHandles();
+  if (!_cacheUsed && !discover()) {
+    _link.disconnect();
+    xSemaphoreGive(connectLock);
+    return false;
+  }
+  // A first connect learns the name only now
+  uint8_t phy = _profile != nullptr ? _profile->phy : 0;
+  if (matchProfile()) {
+    sizeChunks();
+    if ((_profile != nullptr ? _profile->phy : 0) != phy) {
+      negotiateLinkParameters();
+    }
+  }
+  _notifyActive = subscribeNotify();
+
+  // Stream over an L2CAP channel when the printer offers one
+  uint16_t psm = _psm != 0 ? _psm : _handles.psm;
+  if (psm != 0 && _link.openChannel(psm)) {
+    log_i("✅ L2CAP channel on PSM 0x%04x, SDUs of %u bytes", psm, _link.channelMtu());
+  }
+  xSemaphoreGive(connectLock);
+
+  // Re-encode raster data for models known to take merged bands
+  configurePipeline();
+  RasterProfile raster = rasterProfile();
+  _recoder.begin(raster, PrintPipeline::output(), _pipeline.outputContext(STAGE_RECODE));
+  log_i("Raster re-encoding %s (caps 0x%02x)", _recoder.active() ? "on" : "off", raster.caps);
+
+  _txPeakCredits = 0;
+  // A printer that just connected holds nothing yet; the registry's buffer
+  // goes before the profile's
+  if (_bufferBytes == 0 && _profile != nullptr && _profile->bufferBytes != 0) {
+    _bufferModel.begin(_profile->bufferBytes, _profile->linesPerSecond, _dpi);
+  } else {
+    _bufferModel.begin(_bufferBytes, _linesPerSecond, _dpi);
+  }
+  if (paced()) {
+    log_i("%s: no status channel, paced by its buffer model", _id.c_str());
+  }
+  // Job data that comes in first waits for the probe
+  _probing = true;
+  _connected = true;
+  probeLink();
+  _probing = false;
+  log_i("✅ Printer %s connection established successfully!", _id.c_str());
+  return true;
+}
+
+// Full service discovery. Fills in the print characteristic and the printer
+// name and refreshes the NVS cache.
+bool BlePrinter::discover() {
+  STALL_SECTION("gatt discovery");
+  if (!_link.discover(_serviceUUID, _characteristicUUID, _handles, _name)) {
+    return false;
+  }
+  saveGattCache();
+  return true;
+}
+
+// Fast path: reuse the characteristic handle from NVS. A zero-length
+// acknowledged write proves the handle still points at a writable
+// characteristic; if it fails the cache is dropped and discovery runs.
+bool BlePrinter::restoreCachedHandles() {
+  if (!_cacheValid) {
+    return false;
+  }
+
+  if (!writeHandle(nullptr, 0, true)) {
+    log_w("Cached handle 0x%04x rejected, running discovery", _handles.tx);
+    clearGattCache();
+    return false;
+  }
+
+  log_i("✅ Using cached handle 0x%04x, discovery skipped", _handles.tx);
+  return true;
+}
+
+void BlePrinter::disconnect() {
+  // The client is kept for the next connect
+  _link.disconnect();
+  _connected = false;
+  _notifyActive = false;
+  _idleQueryPending = false;
+  _txPaused = false;
+  log_i("Printer %s disconnected", _id.c_str());
+}
+
+// Turn on status reports from the notify characteristic, if there is one
+bool BlePrinter::subscribeNotify() {
+  _idleQueryPending = false;
+  _txPaused = false;
+  _paperOut = false;
+  if (_handles.notify == 0 || _handles.cccd == 0) {
+    return false;
+  }
+
+  if (!_link.subscribe(_handles)) {
+    log_w("Enabling status notifications on 0x%04x failed", _handles.notify);
+    return false;
+  }
+
+  log_i("✅ Status notifications on 0x%04x", _handles.notify);
+  return true;
+}
+
+void BlePrinter::negotiateLinkParameters() {
+  _connInterval = 0;
+  _txPhy = BLE_PHY_1M;
+  _rxPhy = BLE_PHY_1M;
+  _dataLength = 27;
+
+  // A link connects for a job, so it starts out busy
+  _busyAt = millis();
+  _connBusy = true;
+  _connRequested = connTarget();
+
+  // All three are requests: the printer may refuse any of them, in which case
+  // the link simply stays on the defaults
+  BleLinkRequest request;
+  request.connIntervalMin = _connRequested.intervalMin;
+  request.connIntervalMax = _connRequested.intervalMax;
+  request.latency = _connRequested.latency;
+  request.supervisionTimeout = _connRequested.supervisionTimeout;
+  request.eventLength = _connRequested.eventLength;
+  request.dataLength = BLE_DLE_TX_OCTETS;
+  request.phy = _profile != nullptr && _profile->phy != 0 ? _profile->phy : BLE_PHY_2M;
+  _link.requestParameters(request);
+}
+
+// Parameters the link should have now: the /config ones, spread over the
+// busy links by the connection schedule
+ConnSchedule BlePrinter::connTarget() const {
+  const BridgeConfig& config = bridgeConfig();
+  ConnSchedule configured;
+  configured.intervalMin = config.connIntervalMin;
+  configured.intervalMax = config.connIntervalMax < config.connIntervalMin ? config.connIntervalMin : config.connIntervalMax;
+  configured.latency = config.connLatency;
+  configured.supervisionTimeout = config.supervisionTimeout;
+  configured.eventLength = 0;
+#if CONN_SCHEDULE
+  return connSchedule(_connBusy, busyLinks(), configured);
+#else
+  return configured;
+#endif
+}
+
+// Every CONN_SCHEDULE_PERIOD_MS on a ready link: follow the printer's own
+// demand and that of the others
+void BlePrinter::scheduleConnection() {
+  if (!_connected || _usb || _spp) {
+    return;
+  }
+  if (_probing || printWriterPending(_index) > 0) {
+    _busyAt = millis();
+  }
+  _connBusy = millis() - _busyAt < CONN_IDLE_AFTER_MS;
+  ConnSchedule schedule = connTarget();
+  if (schedule == _connRequested) {
+    return;
+  }
+  _connRequested = schedule;
+  BleLinkRequest request = {};
+  request.connIntervalMin = schedule.intervalMin;
+  request.connIntervalMax = schedule.intervalMax;
+  request.latency = schedule.latency;
+  request.supervisionTimeout = schedule.supervisionTimeout;
+  request.eventLength = schedule.eventLength;
+  _link.requestConnParams(request);
+  log_i("%s: %s, asking for %.2f-%.2f ms connection interval", _id.c_str(), _connBusy ? "busy" : "idle",
+        schedule.intervalMin * 1.25f, schedule.intervalMax * 1.25f);
+}
+
+// Pick the profile for the current name and print service. True when it
+// changed.
+bool BlePrinter::matchProfile() {
+  const PrinterProfile* profile = findPrinterProfile(_name.c_str(), _serviceUUID.c_str());
+  if (profile == _profile) {
+    return false;
+  }
+  _profile = profile;
+  if (profile != nullptr) {
+    log_i("%s: profile '%s' for %s", _id.c_str(), profile->pattern, _name.c_str());
+  }
+  return true;
+}
+
+// The profile's chain, or PRINTER_PIPELINE, ending in the link
+void BlePrinter::configurePipeline() {
+  uint8_t chain[PIPELINE_MAX_STAGES];
+  uint8_t length = 0;
+  if (_profile != nullptr && _profile->pipelineLength >= 0) {
+    length = _profile->pipelineLength;
+    memcpy(chain, _profile->pipeline, length);
+  } else if (!parsePipeline(PRINTER_PIPELINE, chain, length)) {
+    log_w("PRINTER_PIPELINE '%s' not understood, printing unprocessed", PRINTER_PIPELINE);
+    length = 0;
+  }
+  if (length == 0 || chain[length - 1] != STAGE_SEND) {
+    chain[length++] = STAGE_SEND;
+  }
+  _pipeline.configure(chain, length);
+  log_d("%s: pipeline %s", _id.c_str(), pipelineName().c_str());
+}
+
+String BlePrinter::pipelineName() const {
+  String names;
+  for (uint8_t i = 0; i < _pipeline.length(); i++) {
+    names += i > 0 ? "," : "";
+    names += pipelineStageName(_pipeline.stage(i));
+  }
+  return names;
+}
+
+// GATT chunks from the negotiated MTU, within the profile's and the
+// bridge's limits
+void BlePrinter::sizeChunks() {
+  uint16_t mtu = _mtu;
+  if (_profile != nullptr && _profile->mtu != 0 && _profile->mtu < mtu) {
+    mtu = _profile->mtu;
+  }
+  _chunkSize = mtu - ATT_HEADER_SIZE;
+  if (_chunkSize > ATT_MAX_VALUE_SIZE) {
+    _chunkSize = ATT_MAX_VALUE_SIZE;
+  }
+  if (_profile != nullptr && _profile->chunk != 0 && _chunkSize > _profile->chunk) {
+    _chunkSize = _profile->chunk;
+  }
+  if (_chunkSize > bridgeConfig().maxChunk) {
+    _chunkSize = bridgeConfig().maxChunk;
+  }
+  log_i("✅ MTU %d, chunk size %d bytes", _mtu, _chunkSize);
+  _control.begin(_chunkSize, bridgeConfig().txWindow);
+}
+
+// Raster re-encoding from the profile, or else the built-in table
+RasterProfile BlePrinter::rasterProfile() const {
+  RasterProfile raster = lookupRasterProfile(_name.c_str());
+  if (_profile != nullptr && _profile->rasterCaps >= 0) {
+    raster.caps = _profile->rasterCaps;
+    if (_profile->bandRows != 0) {
+      raster.maxBandRows = _profile->bandRows;
+    }
+  }
+  return raster;
+}
+
+// The first printer keeps the original namespace so existing caches survive
+String BlePrinter::cacheNamespace() const {
+  return _index == 0 ? String(GATT_CACHE_NAMESPACE) : String(GATT_CACHE_NAMESPACE) + String(_index);
+}
+
+void BlePrinter::loadGattCache() {
+  Preferences prefs;
+  _cacheValid = false;
+  if (!prefs.begin(cacheNamespace().c_str(), true)) {
+    return;
+  }
+  if (prefs.getString("mac").equalsIgnoreCase(_mac) &&
+      prefs.getString("service") == _serviceUUID &&
+      prefs.getString("char") == _characteristicUUID) {
+    _handles.tx = prefs.getUShort("handle");
+    _handles.txProperties = prefs.getUChar("props");
+    _handles.notify = prefs.getUShort("notify");
+    _handles.cccd = prefs.getUShort("cccd");
+    _handles.notifyProperties = prefs.getUChar("nprops");
+    _handles.psm = prefs.getUShort("psm");
+    _name = prefs.getString("name", _name);
+    _cacheValid = (_handles.tx != 0);
+  }
+  prefs.end();
+
+  if (_cacheValid) {
+    log_i("GATT cache: handle 0x%04x for %s", _handles.tx, _mac.c_str());
+  }
+}
+
+void BlePrinter::saveGattCache() {
+  Preferences prefs;
+  if (!prefs.begin(cacheNamespace().c_str(), false)) {
+    return;
+  }
+  prefs.putString("mac", _mac);
+  prefs.putString("service", _serviceUUID);
+  prefs.putString("char", _characteristicUUID);
+  prefs.putUShort("handle", _handles.tx);
+  prefs.putUChar("props", _handles.txProperties);
+  prefs.putUShort("notify", _handles.notify);
+  prefs.putUShort("cccd", _handles.cccd);
+  prefs.putUChar("nprops", _handles.notifyProperties);
+  prefs.putUShort("psm", _handles.psm);
+  prefs.putString("name", _name);
+  prefs.end();
+  _cacheValid = true;
+}
+
+void BlePrinter::clearGattCache() {
+  Preferences prefs;
+  if (prefs.begin(cacheNamespace().c_str(), false)) {
+    prefs.clear();
+    prefs.end();
+  }
+  _cacheValid = false;
+}
+
+bool BlePrinter::write(const PrintSlice& slice) {
+  if (_jobStart && slice.total() > 0) {
+    _jobStart = false;
+    _bufferModel.startJob();
+    uint16_t jobDpi = printWriterJobDpi(_index);
+    if (_pipeline.contains(STAGE_RESAMPLE) &&
+        _resampler.begin(jobDpi, _dpi, _dots, PrintPipeline::output(), _pipeline.outputContext(STAGE_RESAMPLE))) {
+      log_i("Job rasters rescaled from %u to %u dpi, %u dots wide at most", jobDpi, _dpi, _dots);
+    }
+  }
+  if (slice.total() == 0) {
+    _jobStart = true;
+  }
+  return _pipeline.process(slice);
+}
+
+// Stages without work for this job pass the data straight on; the pipeline
+// carries the end of the job to the next stage itself
+bool BlePrinter::resampleStage(void* context, const PrintSlice& slice) {
+  BlePrinter* printer = (BlePrinter*)context;
+  if (printer->_resampler.active()) {
+    return printer->_resampler.feed(slice);
+  }
+  return slice.total() == 0 || PrintPipeline::output()(printer->_pipeline.outputContext(STAGE_RESAMPLE), slice);
+}
+
+bool BlePrinter::recodeStage(void* context, const PrintSlice& slice) {
+  BlePrinter* printer = (BlePrinter*)context;
+  if (printer->_recoder.active()) {
+    return printer->_recoder.feed(slice);
+  }
+  return slice.total() == 0 || PrintPipeline::output()(printer->_pipeline.outputContext(STAGE_RECODE), slice);
+}
+
+bool BlePrinter::sendStage(void* context, const PrintSlice& slice) {
+  BlePrinter* printer = (BlePrinter*)context;
+  if (slice.total() > 0) {
+    return printer->send(slice);
+  }
+  bool ok = printer->_connected;
+
+#if PRINTER_IDLE_QUERY
+  // End of job: the status answer comes back once the printer has worked
+  // through everything before it
+  if (ok && printer->_notifyActive) {
+    static const uint8_t statusQuery[] = {0x1D, 0x72, 0x01};
+    PrintSlice query = {{statusQuery, nullptr}, {sizeof(statusQuery), 0}};
+    printer->_idleQueryPending = true;
+    if (!printer->send(query)) {
+      printer->_idleQueryPending = false;
+    }
+  }
+#endif
+  return ok;
+}
+
+bool HOT_PATH BlePrinter::send(const PrintSlice& slice) {
+  if (_usb) {
+    return sendStream(slice, usbPrinterWrite);
+  }
+  if (_spp) {
+    return sendStream(slice, sppPrinterWrite);
+  }
+  if (!_connected || _handles.tx == 0) {
+    log_e("Cannot print: printer %s not connected", _id.c_str());
+    return false;
+  }
+
+  // An L2CAP channel takes whole SDUs under the printer's credits, so there
+  // is no write mode and no TX window to manage
+  bool channel = _link.channelOpen();
+  bool noResponse = channel;
+  uint8_t writeMode = _profile != nullptr && _profile->writeMode >= 0 ? _profile->writeMode : bridgeConfig().writeMode;
+  if (!channel && (writeMode == WRITE_MODE_NO_RESPONSE || writeMode == WRITE_MODE_AUTO)) {
+    noResponse = (_handles.txProperties & BLE_PROP_WRITE_NR) != 0;
+  }
+  // The probe found acknowledged writes faster, or the only clean ones
+  if (!channel && writeMode == WRITE_MODE_AUTO && _probeRate > 0) {
+    noResponse = _probeNoResponse;
+  }
+
+  if (!channel && !noResponse && !(_handles.txProperties & BLE_PROP_WRITE)) {
+    log_e("Characteristic cannot be written");
+    return false;
+  }
+  while (_probing && _connected) {
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+
+  // Manual chunking to avoid BLE library "long write" issues. Each chunk
+  // fits a single ATT write of the negotiated MTU (payload is MTU - 3), or
+  // one SDU of the channel. Chunks point straight into the job buffer; only
+  // a GATT chunk that straddles the end of the ring is gathered into
+  // _gather, while the channel takes both pieces into one SDU.
+  // GATT chunks are sized by the link controller, within the MTU.
+  _control.setLimits(_chunkSize, bridgeConfig().txWindow);
+  const size_t length = slice.total();
+  size_t offset = 0;
+  unsigned long started = millis();
+  bool paced = this->paced();
+
+  while (offset < length) {
+    size_t remaining = length - offset;
+    size_t chunkLimit = channel ? _link.channelMtu() : _control.chunkSize();
+    size_t currentChunkSize = (remaining > chunkLimit) ? chunkLimit : remaining;
+
+    const uint8_t* chunk;
+    size_t firstLength = currentChunkSize;
+    size_t secondLength = 0;
+    if (offset + currentChunkSize <= slice.length[0]) {
+      chunk = slice.data[0] + offset;
+    } else if (offset >= slice.length[0]) {
+      chunk = slice.data[1] + (offset - slice.length[0]);
+    } else {
+      chunk = slice.data[0] + offset;
+      firstLength = slice.length[0] - offset;
+      secondLength = currentChunkSize - firstLength;
+    }
+
+    // Hold the data back while the printer has nowhere to put it
+    if (_txPaused && !waitForXon()) {
+      return false;
+    }
+    if (paced && !waitForBufferRoom(currentChunkSize)) {
+      return false;
+    }
+
+    uint32_t chunkStart = micros();
+    bool response = false;
+    bool ok;
+    if (channel) {
+      ok = _link.sendChannel(chunk, firstLength, slice.data[1], secondLength);
+    } else {
+      if (secondLength > 0) {
+        memcpy(_gather, chunk, firstLength);
+        memcpy(_gather + firstLength, slice.data[1], secondLength);
+        chunk = _gather;
+        firstLength = currentChunkSize;
+        secondLength = 0;
+      }
+      // Without a write response nothing stops us from flooding the stack, so
+      // only send while the controller has a free TX buffer inside our window
+      response = !noResponse || !waitForTxCredit();
+      ok = writeHandle(chunk, currentChunkSize, response);
+    }
+    if (!ok) {
+      _metrics.recordWriteError();
+      // A channel that lost an SDU has lost its place in the stream
+      if (channel) {
+        return false;
+      }
+    }
+    uint32_t chunkUs = micros() - chunkStart;
+    _metrics.recordChunk(currentChunkSize, chunkUs, response);
+    if (!channel) {
+      // Each round of the controller also reads the RSSI for the next
+      if (_control.chunkDone(currentChunkSize, chunkUs, ok)) {
+        _link.requestRssi();
+#if TX_POWER_POLICY
+        if (_txPower.round(_control.lastRssi(), _control.degraded())) {
+          applyTxPower();
+        }
+#endif
+      }
+      if (_control.gapMs() > 0) {
+        vTaskDelay(pdMS_TO_TICKS(_control.gapMs()));
+      }
+    }
+    if (paced) {
+      _bufferModel.written(chunk, firstLength, micros());
+      if (secondLength > 0) {
+        _bufferModel.written(slice.data[1], secondLength, micros());
+      }
+    }
+    offset += currentChunkSize;
+  }
+  log_d("%s: printed %d bytes in chunks (%s)", _id.c_str(), length,
+        channel ? "L2CAP" : noResponse ? "no response" : "acknowledged");
+
+  updateThroughput(length, millis() - started);
+
+  // A disconnect during the writes means the tail of the data was lost
+  return _connected;
+}
+
+// USB bulk transfers and RFCOMM credits pace the data, so the slice goes
+// out as it is
+bool HOT_PATH BlePrinter::sendStream(const PrintSlice& slice, bool (*write)(const uint8_t*, size_t)) {
+  if (!_connected) {
+    log_e("Cannot print: printer %s not connected", _id.c_str());
+    return false;
+  }
+  unsigned long started = millis();
+  uint32_t writeStart = micros();
+  for (size_t piece = 0; piece < 2; piece++) {
+    if (slice.length[piece] > 0 && !write(slice.data[piece], slice.length[piece])) {
+      _metrics.recordWriteError();
+      return false;
+    }
+  }
+  _metrics.recordChunk(slice.total(), micros() - writeStart, false);
+  updateThroughput(slice.total(), millis() - started);
+  return _connected;
+}
+
+// Smoothed drain rate for pool dispatch; tiny slices say little about it
+void BlePrinter::updateThroughput(size_t length, unsigned long elapsedMs) {
+  if (length >= 1024 && elapsedMs > 0) {
+    uint32_t rate = length * 1000 / elapsedMs;
+    _throughput = (_throughput == 0) ? rate : (_throughput * 3 + rate) / 4;
+  }
+}
+
+bool BlePrinter::benchWrite(size_t bytes, size_t chunk, bool noResponse, LinkMetrics& metrics) {
+  static const uint8_t filler[sizeof(_gather)] = {};
+  uint8_t property = noResponse ? BLE_PROP_WRITE_NR : BLE_PROP_WRITE;
+  if (!_connected || _handles.tx == 0 || !(_handles.txProperties & property)) {
+    return false;
+  }
+  chunk = min(chunk, _chunkSize);
+
+  for (size_t offset = 0; offset < bytes && _connected; ) {
+    size_t length = min(chunk, bytes - offset);
+    if (_txPaused && !waitForXon()) {
+      return false;
+    }
+    uint32_t chunkStart = micros();
+    bool response = !noResponse || !waitForTxCredit();
+    if (!writeHandle(filler, length, response)) {
+      metrics.recordWriteError();
+    }
+    metrics.recordChunk(length, micros() - chunkStart, response);
+    offset += length;
+  }
+  if (noResponse && _connected && !writeHandle(filler, 1, true)) {
+    metrics.recordWriteError();
+  }
+  return _connected;
+}
+
+void BlePrinter::probeLink() {
+  _probeRate = 0;
+  _probeChunk = 0;
+  _probeNoResponse = false;
+  size_t bytes = bridgeConfig().probeBytes;
+  uint8_t fill = _profile != nullptr ? _profile->probe : PROBE_NUL;
+  if (bytes == 0 || fill == PROBE_OFF || _link.channelOpen() || _handles.tx == 0) {
+    return;
+  }
+
+  // No job is sending yet, so the gather buffer holds the filler
+  for (size_t i = 0; i < sizeof(_gather); i++) {
+    _gather[i] = fill == PROBE_INIT ? (i % 2 == 0 ? 0x1B : 0x40) : 0x00;
+  }
+  size_t chunks[2] = {_chunkSize, _chunkSize / 2};
+  if (fill == PROBE_INIT) {
+    // Whole ESC @ pairs only
+    bytes &= ~(size_t)1;
+    chunks[0] &= ~(size_t)1;
+    chunks[1] &= ~(size_t)1;
+  }
+
+  for (uint8_t mode = 0; mode < 2; mode++) {
+    bool noResponse = mode == 0;
+    if (!(_handles.txProperties & (noResponse ? BLE_PROP_WRITE_NR : BLE_PROP_WRITE))) {
+      continue;
+    }
+    for (size_t chunk : chunks) {
+      if (chunk < ATT_DEFAULT_MTU - ATT_HEADER_SIZE || (chunk == chunks[1] && chunks[1] == chunks[0])) {
+        continue;
+      }
+      uint32_t rate = probeRun(_gather, bytes, chunk, noResponse);
+      log_i("%s: probe %u byte chunks %s, %u bytes/s", _id.c_str(), (unsigned)chunk,
+            noResponse ? "without response" : "acknowledged", (unsigned)rate);
+      if (rate > _probeRate) {
+        _probeRate = rate;
+        _probeChunk = chunk;
+        _probeNoResponse = noResponse;
+      }
+    }
+  }
+  if (_probeRate == 0) {
+    return;
+  }
+
+  if (_probeChunk < _chunkSize) {
+    _chunkSize = _probeChunk;
+    _control.begin(_chunkSize, bridgeConfig().txWindow);
+  }
+  if (_throughput == 0) {
+    _throughput = _probeRate;
+  }
+  log_i("%s: link probe best %u bytes/s, %u byte chunks %s", _id.c_str(), (unsigned)_probeRate,
+        (unsigned)_probeChunk, _probeNoResponse ? "without response" : "acknowledged");
+}
+
+// One probe run; bytes/s, 0 when a write failed or the link went
+uint32_t BlePrinter::probeRun(const uint8_t* filler, size_t bytes, size_t chunk, bool noResponse) {
+  uint32_t started = micros();
+  for (size_t offset = 0; offset < bytes; offset += chunk) {
+    if (_txPaused && !waitForXon()) {
+      return 0;
+    }
+    bool response = !noResponse || !waitForTxCredit();
+    if (!_connected || !writeHandle(filler, min(chunk, bytes - offset), response)) {
+      return 0;
+    }
+  }
+  // An empty write request is answered after everything queued before it
+  if (noResponse && !writeHandle(nullptr, 0, true)) {
+    return 0;
+  }
+  uint32_t elapsed = micros() - started;
+  return elapsed > 0 ? (uint64_t)bytes * 1000000 / elapsed : 0;
+}
+
+bool BlePrinter::keepAlive() {
+  static const uint8_t statusQuery[] = {0x1D, 0x72, 0x01};
+  static const uint8_t modelQuery[] = {'~', '!', 'T'};
+  if (_usb || _spp || !_connected || _handles.tx == 0 || _txPaused) {
+    return false;
+  }
+  bool ok;
+  if (_keepAlive == KEEPALIVE_PING) {
+    // An ATT write request the printer has to answer, with nothing to print
+    ok = writeHandle(statusQuery, 0, true);
+  } else {
+    PrintSlice query = {{_keepAlive == KEEPALIVE_STATUS ? statusQuery : modelQuery, nullptr},
+                        {_keepAlive == KEEPALIVE_STATUS ? sizeof(statusQuery) : sizeof(modelQuery), 0}};
+    ok = send(query);
+  }
+  if (!ok) {
+    log_w("%s: keep-alive not sent", _id.c_str());
+  }
+  return true;
+}
+
+// Write to the print characteristic
+bool HOT_PATH BlePrinter::writeHandle(const uint8_t* data, size_t length, bool response) {
+  STALL_SECTION("ble write");
+  TRACE_BEGIN(TRACE_BLE_WRITE, length);
+  bool ok = _link.write(_handles.tx, data, length, response);
+  TRACE_END(TRACE_BLE_WRITE, length);
+  return ok;
+}
+
+bool HOT_PATH BlePrinter::waitForTxCredit() {
+  unsigned long start = millis();
+  TRACE_BEGIN(TRACE_TX_CREDIT, _index);
+  for (;;) {
+    if (!_connected) {
+      TRACE_END(TRACE_TX_CREDIT, _index);
+      return false;
+    }
+
+    int sendable = _link.sendableBuffers();
+    if (sendable < 0) {
+      // The stack holds the write back itself until it has a buffer
+      TRACE_END(TRACE_TX_CREDIT, _index);
+      return true;
+    }
+    uint16_t credits = sendable;
+    if (credits > _txPeakCredits) {
+      _txPeakCredits = credits;
+    }
+
+    // The difference to the highest count seen is what is still queued
+    if (credits > 0 && (uint16_t)(_txPeakCredits - credits) < _control.window()) {
+      TRACE_END(TRACE_TX_CREDIT, _index);
+      return true;
+    }
+
+    if (millis() - start > bleCreditTimeout) {
+      log_w("No BLE TX credit after %lu ms, sending acknowledged", bleCreditTimeout);
+      _metrics.recordCreditTimeout();
+      _control.creditTimeout();
+      TRACE_END(TRACE_TX_CREDIT, _index);
+      return false;
+    }
+    vTaskDelay(1);
+  }
+}
+
+bool BlePrinter::waitForXon() {
+  unsigned long start = millis();
+  log_i("%s: XOFF, pausing", _id.c_str());
+  while (_txPaused) {
+    if (!_connected) {
+      return false;
+    }
+    if (millis() - start > PRINTER_XOFF_TIMEOUT) {
+      log_e("%s: no XON after %d ms%s", _id.c_str(), PRINTER_XOFF_TIMEOUT, _paperOut ? ", paper out" : "");
+      _metrics.recordFlowPause(millis() - start);
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+  _metrics.recordFlowPause(millis() - start);
+  log_i("%s: XON after %lu ms", _id.c_str(), millis() - start);
+  return true;
+}
+
+// Wait for the modelled buffer of a printer without status to have room
+// for the next chunk
+bool BlePrinter::waitForBufferRoom(size_t length) {
+  uint32_t waitUs = _bufferModel.delayUs(length, micros());
+  if (waitUs == 0) {
+    return true;
+  }
+  unsigned long start = millis();
+  while (waitUs > 0) {
+    if (!_connected) {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(waitUs / 1000 + 1));
+    waitUs = _bufferModel.delayUs(length, micros());
+  }
+  _metrics.recordPacing(millis() - start);
+  return true;
+}
+
+// Split a registry line at whitespace. Returns the number of fields found.
+static size_t splitFields(const String& line, String* fields, size_t maxFields) {
+  size_t count = 0;
+  int pos = 0;
+  int length = line.length();
+  while (pos < length) {
+    while (pos < length && isspace((unsigned char)line[pos])) {
+      pos++;
+    }
+    int start = pos;
+    while (pos < length && !isspace((unsigned char)line[pos])) {
+      pos++;
+    }
+    if (pos > start) {
+      if (count == maxFields) {
+        return maxFields + 1;
+      }
+      fields[count++] = line.substring(start, pos);
+    }
+  }
+  return count;
+}
+
+static bool usbPrinterListed() {
+  for (size_t i = 0; i < registrySize; i++) {
+    if (printers[i].usb()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool sppPrinterListed() {
+  for (size_t i = 0; i < registrySize; i++) {
+    if (printers[i].spp()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t loadPrinterRegistry() {
+  registrySize = 0;
+  poolCount = 0;
+
+  File file = LittleFS.open(PRINTER_REGISTRY_PATH, "r");
+  if (file) {
+    while (file.available()) {
+      String line = file.readStringUntil('\n');
+      line.trim();
+      if (line.length() == 0 || line.startsWith("#")) {
+        continue;
+      }
+
+      String fields[11];
+      size_t count = splitFields(line, fields, 11);
+      if (count > 11) {
+        count = 0;                 // Too many fields, reported as malformed below
+      }
+
+      // pool=, dpi=, dots=, buffer=, lines=, psm= and keepalive= may come
+      // anywhere after the ID
+      String pool;
+      String keepAlive = "ping";
+      long dpi = 0;
+      long dots = 0;
+      long buffer = 0;
+      long lines = 0;
+      long psm = 0;
+      for (size_t i = 1; i < count;) {
+        if (fields[i].startsWith("pool=")) {
+          pool = fields[i].substring(5);
+        } else if (fields[i].startsWith("dpi=")) {
+          dpi = fields[i].substring(4).toInt();
+        } else if (fields[i].startsWith("dots=")) {
+          dots = fields[i].substring(5).toInt();
+        } else if (fields[i].startsWith("buffer=")) {
+          buffer = fields[i].substring(7).toInt();
+        } else if (fields[i].startsWith("lines=")) {
+          lines = fields[i].substring(6).toInt();
+        } else if (fields[i].startsWith("psm=")) {
+          psm = strtol(fields[i].c_str() + 4, nullptr, 0);
+        } else if (fields[i].startsWith("keepalive=")) {
+          keepAlive = fields[i].substring(10);
+        } else {
+          i++;
+          continue;
+        }
+        for (size_t j = i + 1; j < count; j++) {
+          fields[j - 1] = fields[j];
+        }
+        count--;
+      }
+      if (dpi < 0 || dpi > 1200 || dots < 0 || dots > RESAMPLE_MAX_DOTS) {
+        log_w("%s: ignoring bad dpi or dots on '%s'", PRINTER_REGISTRY_PATH, line.c_str());
+        dpi = 0;
+        dots = 0;
+      }
+      if (buffer < 0 || lines < 0 || lines > 0xFFFF) {
+        log_w("%s: ignoring bad buffer or lines on '%s'", PRINTER_REGISTRY_PATH, line.c_str());
+        buffer = 0;
+        lines = 0;
+      }
+      // LE PSMs are one byte; 0x80 and up are the dynamic ones
+      if (psm < 0 || psm > 0xFF) {
+        log_w("%s: ignoring bad psm on '%s'", PRINTER_REGISTRY_PATH, line.c_str());
+        psm = 0;
+      }
+      PrinterKeepAlive keepAliveMode = KEEPALIVE_PING;
+      if (keepAlive == "status") {
+        keepAliveMode = KEEPALIVE_STATUS;
+      } else if (keepAlive == "tspl") {
+        keepAliveMode = KEEPALIVE_TSPL;
+      } else if (keepAlive != "ping") {
+        log_w("%s: ignoring bad keepalive on '%s'", PRINTER_REGISTRY_PATH, line.c_str());
+      }
+
+      bool usb = fields[1].equalsIgnoreCase("usb");
+      bool spp = fields[1].length() == 21 && fields[1].substring(0, 4).equalsIgnoreCase("spp:");
+      if ((count != 2 && count != 4) || (fields[1].length() != 17 && !usb && !spp)) {
+        log_w("%s: ignoring malformed line '%s'", PRINTER_REGISTRY_PATH, line.c_str());
+        continue;
+      }
+      if (usb && usbPrinterListed()) {
+        log_w("%s: only one USB printer, '%s' ignored", PRINTER_REGISTRY_PATH, fields[0].c_str());
+        continue;
+      }
+      if (spp && sppPrinterListed()) {
+        log_w("%s: only one SPP printer, '%s' ignored", PRINTER_REGISTRY_PATH, fields[0].c_str());
+        continue;
+      }
+      if (findPrinter(fields[0]) != nullptr) {
+        log_w("%s: duplicate printer '%s' ignored", PRINTER_REGISTRY_PATH, fields[0].c_str());
+        continue;
+      }
+      if (registrySize == MAX_PRINTERS) {
+        log_w("%s: more than %d printers, '%s' ignored", PRINTER_REGISTRY_PATH, MAX_PRINTERS, fields[0].c_str());
+        continue;
+      }
+
+      printers[registrySize].configure(registrySize, fields[0], fields[1],
+                                       count == 4 ? fields[2] : String(PRINTER_SERVICEUUID),
+                                       count == 4 ? fields[3] : String(PRINTER_CHARACTERISTICUUID));
+      if (pool.length() > 0) {
+        uint8_t index;
+        if (!findPool(pool, index)) {
+          index = poolCount;
+          poolNames[poolCount++] = pool;
+        }
+        printers[registrySize].setPool(index);
+      }
+      printers[registrySize].setHead(dpi, dots);
+      printers[registrySize].setBuffer(buffer, lines);
+      printers[registrySize].setPsm(psm);
+      printers[registrySize].setKeepAlive(keepAliveMode);
+      registrySize++;
+    }
+    file.close();
+  }
+
+  if (registrySize == 0) {
+    printers[0].configure(0, "default", PRINTER_MAC, PRINTER_SERVICEUUID, PRINTER_CHARACTERISTICUUID);
+    printers[0].setHead(PRINTER_DPI, PRINTER_DOTS);
+    printers[0].setBuffer(PRINTER_BUFFER_BYTES, PRINTER_LINES_PER_SEC);
+    printers[0].setPsm(PRINTER_L2CAP_PSM);
+    printers[0].setKeepAlive((PrinterKeepAlive)PRINTER_KEEPALIVE);
+    registrySize = 1;
+  }
+
+  for (size_t i = 0; i < registrySize; i++) {
+    log_i("Printer %s: %s%s%s", printers[i].id().c_str(), printers[i].mac().c_str(),
+          printers[i].pool() != PRINT_NO_POOL ? ", pool " : "", poolName(printers[i].pool()));
+  }
+  return registrySize;
+}
+
+bool initBlePrinters() {
+  scanLock = xSemaphoreCreateMutex();
+  connectLock = xSemaphoreCreateMutex();
+  if (scanLock == nullptr || connectLock == nullptr) {
+    log_e("Failed to create BLE locks");
+    return false;
+  }
+
+  // Only the registered printers get past the controller
+  static uint8_t accept[MAX_PRINTERS][6];
+  size_t acceptCount = 0;
+  for (size_t i = 0; i < registrySize; i++) {
+    if (printers[i].macAddress() != nullptr) {
+      memcpy(accept[acceptCount++], printers[i].macAddress(), 6);
+    }
+  }
+  BleScanSettings scan;
+  scan.active = BLE_SCAN_ACTIVE;
+  scan.intervalMs = BLE_SCAN_INTERVAL_MS;
+  scan.windowMs = BLE_SCAN_WINDOW_MS;
+  scan.accept = BLE_SCAN_ACCEPT_LIST ? accept : nullptr;
+  scan.acceptCount = acceptCount;
+  if (!bleStackInit("ESP32_Printer", scan, onScanResult, onSharedScanComplete)) {
+    return false;
+  }
+#if TX_POWER_POLICY
+  // Scan requests and connection requests reach printers at the edge of range
+  esp_ble_tx_power_set(ESP_BLE_PWR_TYPE_SCAN, TX_POWER_LEVELS[TX_POWER_STEPS - 1]);
+#endif
+
+  bool started = true;
+  for (size_t i = 0; i < registrySize; i++) {
+    started = printers[i].begin() && started;
+  }
+  return started;
+}
+
+size_t printerCount() {
+  return registrySize;
+}
+
+BlePrinter* getPrinter(size_t index) {
+  return index < registrySize ? &printers[index] : nullptr;
+}
+
+BlePrinter* findPrinter(const String& id) {
+  if (id.length() == 0) {
+    return getPrinter(0);
+  }
+  for (size_t i = 0; i < registrySize; i++) {
+    if (printers[i].id() == id) {
+      return &printers[i];
+    }
+  }
+  return nullptr;
+}
+
+bool findPool(const String& name, uint8_t& pool) {
+  for (size_t i = 0; i < poolCount; i++) {
+    if (poolNames[i] == name) {
+      pool = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* poolName(uint8_t pool) {
+  return pool < poolCount ? poolNames[pool].c_str() : "";
+}
+
+// Least busy connected member: the one that would drain its backlog first at
+// its measured rate, then the one with the fewest jobs waiting
+BlePrinter* selectPoolPrinter(uint8_t pool, uint8_t exclude) {
+  BlePrinter* best = nullptr;
+  uint32_t bestDrainMs = 0;
+  size_t bestDepth = 0;
+
+  for (size_t i = 0; i < registrySize; i++) {
+    BlePrinter& printer = printers[i];
+    if (printer.pool() != pool || i == exclude || !printer.connected()) {
+      continue;
+    }
+    uint32_t rate = printer.throughput() > 0 ? printer.throughput() : POOL_DEFAULT_THROUGHPUT;
+    uint32_t drainMs = (uint64_t)printWriterPending(i) * 1000 / rate;
+    size_t depth = printQueueDepth(i);
+    if (best == nullptr || drainMs < bestDrainMs || (drainMs == bestDrainMs && depth < bestDepth)) {
+      best = &printer;
+      bestDrainMs = drainMs;
+      bestDepth = depth;
+    }
+  }
+  return best;
+}
+
+void requestPoolConnect(uint8_t pool) {
+  for (size_t i = 0; i < registrySize; i++) {
+    if (printers[i].pool() == pool) {
+      printers[i].requestJobConnect();
+    }
+  }
+}
+
+uint8_t reroutePoolJob(uint8_t pool, uint8_t failedPrinter) {
+  BlePrinter* printer = selectPoolPrinter(pool, failedPrinter);
+  return printer != nullptr ? printer->index() : PRINT_ALL_PRINTERS;
+}
+
+uint32_t printerDrainRate(uint8_t printer) {
+  return printer < registrySize ? printers[printer].throughput() : 0;
+}
@@ -0,0 +1,35 @@
+#include "boot_timing.h"
+
+static volatile uint32_t phases[BOOT_PHASES];
+
+const char* bootPhaseName(BootPhase phase) {
+  switch (phase) {
+    case BOOT_FILESYSTEM: return "filesystem";
+    case BOOT_BLE: return "ble";
+    case BOOT_WEB: return "web";
+    case BOOT_DISPLAY: return "display";
+    case BOOT_WIFI: return "wifi";
+    case BOOT_PRINTER: return "printer";
+    case BOOT_READY: return "ready";
+    case BOOT_PHASES: break;
+  }
+  return "unknown";
+}
+
+void markBootPhase(BootPhase phase) {
+  if (phase >= BOOT_PHASES || phases[phase] != 0) {
+    return;
+  }
+  // Never 0, which means not reached
+  uint32_t now = millis();
+  phases[phase] = now != 0 ? now : 1;
+  log_i("Boot: %s after %u ms", bootPhaseName(phase), phases[phase]);
+
+  if (phase != BOOT_READY && phases[BOOT_WIFI] != 0 && phases[BOOT_PRINTER] != 0) {
+    markBootPhase(BOOT_READY);
+  }
+}
+
+uint32_t bootPhaseMs(BootPhase phase) {
+  return phase < BOOT_PHASES ? phases[phase] : 0;
+}
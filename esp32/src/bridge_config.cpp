@@ -0,0 +1,216 @@
+#include "bridge_config.h"
+#include "ble_printer.h"
+#include "deferred_log.h"
+#include "eth_link.h"
+#include "printer_keepalive.h"
+
+#include <Preferences.h>
+
+static const char* CONFIG_NAMESPACE = "config";
+
+// Link parameters requested after connecting
+static const uint16_t DEFAULT_CONN_INTERVAL_MIN = 6;      // 7.5 ms
+static const uint16_t DEFAULT_CONN_INTERVAL_MAX = 12;     // 15 ms
+static const uint16_t DEFAULT_CONN_LATENCY = 0;
+static const uint16_t DEFAULT_SUPERVISION_TIMEOUT = 400;  // 4 s
+
+static BridgeConfig config;
+
+// Numeric settings: /config name, NVS key and the range the stack accepts
+struct NumericSetting {
+  const char* name;
+  const char* key;
+  uint16_t BridgeConfig::*field;
+  uint16_t min;
+  uint16_t max;
+};
+
+static const NumericSetting NUMERIC_SETTINGS[] = {
+  {"mtu", "mtu", &BridgeConfig::mtu, 23, 517},
+  {"max_chunk", "chunk", &BridgeConfig::maxChunk, 20, 512},
+  {"tx_window", "txwin", &BridgeConfig::txWindow, 1, 64},
+  {"conn_interval_min", "cimin", &BridgeConfig::connIntervalMin, 6, 3200},
+  {"conn_interval_max", "cimax", &BridgeConfig::connIntervalMax, 6, 3200},
+  {"conn_latency", "clat", &BridgeConfig::connLatency, 0, 499},
+  {"supervision_timeout", "ctimeout", &BridgeConfig::supervisionTimeout, 10, 3200},
+  {"queue_depth", "qdepth", &BridgeConfig::queueDepth, 1, PRINT_QUEUE_DEPTH},
+  {"keepalive_interval", "kaint", &BridgeConfig::keepAliveInterval, 0, 3600},
+  {"keepalive_start", "kastart", &BridgeConfig::keepAliveStart, 0, 1439},
+  {"keepalive_end", "kaend", &BridgeConfig::keepAliveEnd, 0, 1439},
+  {"probe_bytes", "probe", &BridgeConfig::probeBytes, 0, 16384},
+  {"fair_quantum", "fairq", &BridgeConfig::fairQuantum, 0, 65535},
+};
+static const size_t NUMERIC_SETTING_COUNT = sizeof(NUMERIC_SETTINGS) / sizeof(NUMERIC_SETTINGS[0]);
+
+static const char* const WRITE_MODE_NAMES[] = {"auto", "ack", "no_response"};
+static const char* const NETWORK_NAMES[] = {"auto", "wifi", "ethernet"};
+
+static void loadDefaults() {
+  memset(&config, 0, sizeof(config));
+  strlcpy(config.wifiSsid, WIFI_SSID, sizeof(config.wifiSsid));
+  strlcpy(config.wifiPassword, WIFI_PASS, sizeof(config.wifiPassword));
+  config.mtu = PRINTER_MTU;
+  config.maxChunk = PRINTER_MAX_CHUNK;
+  config.writeMode = PRINTER_WRITE_MODE;
+  config.txWindow = PRINTER_TX_WINDOW;
+  config.connIntervalMin = DEFAULT_CONN_INTERVAL_MIN;
+  config.connIntervalMax = DEFAULT_CONN_INTERVAL_MAX;
+  config.connLatency = DEFAULT_CONN_LATENCY;
+  config.supervisionTimeout = DEFAULT_SUPERVISION_TIMEOUT;
+  config.queueDepth = PRINT_QUEUE_DEPTH;
+  config.logLevel = CORE_DEBUG_LEVEL;
+  config.network = NETWORK_MODE;
+  config.keepAliveInterval = KEEPALIVE_INTERVAL;
+  config.keepAliveStart = KEEPALIVE_START;
+  config.keepAliveEnd = KEEPALIVE_END;
+  config.probeBytes = LINK_PROBE_BYTES;
+  config.fairQuantum = PRINT_FAIR_QUANTUM;
+  deferredLogLevel = config.logLevel;
+}
+
+void initBridgeConfig() {
+  loadDefaults();
+
+  Preferences prefs;
+  if (!prefs.begin(CONFIG_NAMESPACE, true)) {
+    // Nothing stored yet
+    return;
+  }
+  if (prefs.isKey("ssid")) {
+    prefs.getString("ssid", config.wifiSsid, sizeof(config.wifiSsid));
+    prefs.getString("pass", config.wifiPassword, sizeof(config.wifiPassword));
+  }
+  config.writeMode = prefs.getUChar("wmode", config.writeMode);
+  uint8_t network = prefs.getUChar("net", config.network);
+  if (network <= NETWORK_ETHERNET) {
+    config.network = network;
+  }
+  uint8_t logLevel = prefs.getUChar("loglvl", config.logLevel);
+  if (logLevel <= CORE_DEBUG_LEVEL) {
+    config.logLevel = logLevel;
+    deferredLogLevel = logLevel;
+  }
+  for (size_t i = 0; i < NUMERIC_SETTING_COUNT; i++) {
+    const NumericSetting& setting = NUMERIC_SETTINGS[i];
+    uint16_t value = prefs.getUShort(setting.key, config.*setting.field);
+    if (value >= setting.min && value <= setting.max) {
+      config.*setting.field = value;
+    }
+  }
+  prefs.end();
+  log_i("Configuration loaded from NVS");
+}
+
+const BridgeConfig& bridgeConfig() {
+  return config;
+}
+
+ConfigResult setConfigValue(BridgeConfig& target, const String& name, const String& value) {
+  if (name == "wifi_ssid") {
+    if (value.length() == 0 || value.length() >= sizeof(target.wifiSsid)) {
+      return CONFIG_INVALID;
+    }
+    strlcpy(target.wifiSsid, value.c_str(), sizeof(target.wifiSsid));
+    return CONFIG_OK;
+  }
+  if (name == "wifi_password") {
+    if (value.length() >= sizeof(target.wifiPassword)) {
+      return CONFIG_INVALID;
+    }
+    strlcpy(target.wifiPassword, value.c_str(), sizeof(target.wifiPassword));
+    return CONFIG_OK;
+  }
+  if (name == "write_mode") {
+    for (size_t mode = 0; mode < sizeof(WRITE_MODE_NAMES) / sizeof(WRITE_MODE_NAMES[0]); mode++) {
+      if (value == WRITE_MODE_NAMES[mode]) {
+        target.writeMode = mode;
+        return CONFIG_OK;
+      }
+    }
+    return CONFIG_INVALID;
+  }
+  if (name == "network") {
+    for (size_t mode = 0; mode < sizeof(NETWORK_NAMES) / sizeof(NETWORK_NAMES[0]); mode++) {
+      if (value == NETWORK_NAMES[mode]) {
+        target.network = mode;
+        return CONFIG_OK;
+      }
+    }
+    return CONFIG_INVALID;
+  }
+  if (name == "log_level") {
+    // Levels above the build's aren't compiled in
+    return parseLogLevel(value.c_str(), target.logLevel) ? CONFIG_OK : CONFIG_INVALID;
+  }
+  for (size_t i = 0; i < NUMERIC_SETTING_COUNT; i++) {
+    const NumericSetting& setting = NUMERIC_SETTINGS[i];
+    if (name != setting.name) {
+      continue;
+    }
+    char* end = nullptr;
+    unsigned long number = strtoul(value.c_str(), &end, 10);
+    if (value.length() == 0 || *end != '\0' || number < setting.min || number > setting.max) {
+      return CONFIG_INVALID;
+    }
+    target.*setting.field = number;
+    return CONFIG_OK;
+  }
+  return CONFIG_UNKNOWN;
+}
+
+bool applyBridgeConfig(const BridgeConfig& changed) {
+  config = changed;
+  deferredLogLevel = config.logLevel;
+
+  Preferences prefs;
+  if (!prefs.begin(CONFIG_NAMESPACE, false)) {
+    log_e("Configuration not saved: NVS unavailable");
+    return false;
+  }
+  prefs.putString("ssid", config.wifiSsid);
+  prefs.putString("pass", config.wifiPassword);
+  prefs.putUChar("wmode", config.writeMode);
+  prefs.putUChar("loglvl", config.logLevel);
+  prefs.putUChar("net", config.network);
+  for (size_t i = 0; i < NUMERIC_SETTING_COUNT; i++) {
+    prefs.putUShort(NUMERIC_SETTINGS[i].key, config.*NUMERIC_SETTINGS[i].field);
+  }
+  prefs.end();
+  return true;
+}
+
+void resetBridgeConfig() {
+  Preferences prefs;
+  if (prefs.begin(CONFIG_NAMESPACE, false)) {
+    prefs.clear();
+    prefs.end();
+  }
+  loadDefaults();
+}
+
+String getConfigJSON() {
+  String json = "{\"wifi_ssid\":\"";
+  for (const char* c = config.wifiSsid; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      json += '\\';
+    }
+    json += *c;
+  }
+  json += "\",\"wifi_password_set\":";
+  json += config.wifiPassword[0] != '\0' ? "true" : "false";
+  json += ",\"write_mode\":\"";
+  json += config.writeMode < 3 ? WRITE_MODE_NAMES[config.writeMode] : "auto";
+  json += "\",\"log_level\":\"";
+  json += logLevelName(config.logLevel);
+  json += "\",\"network\":\"";
+  json += config.network <= NETWORK_ETHERNET ? NETWORK_NAMES[config.network] : "auto";
+  json += "\"";
+  for (size_t i = 0; i < NUMERIC_SETTING_COUNT; i++) {
+    json += ",\"";
+    json += NUMERIC_SETTINGS[i].name;
+    json += "\":";
+    json += String(config.*NUMERIC_SETTINGS[i].field);
+  }
+  json += "}";
+  return json;
+}
@@ -0,0 +1,178 @@
+#include "buffer_model.h"
+
+#include <string.h>
+
+void PrinterBufferModel::begin(uint32_t capacity, uint16_t linesPerSecond, uint16_t dpi) {
+  _capacity = capacity;
+  _linesPerSecond = linesPerSecond != 0 ? linesPerSecond : BUFFER_MODEL_LINES_PER_SEC;
+  _dpi = dpi != 0 ? dpi : 203;
+  clear();
+  startJob();
+}
+
+void PrinterBufferModel::startJob() {
+  _parser.begin(PRINT_DIALECT_AUTO, streamEvent, this);
+  _rowBytes = 0;
+  _rowLines = 1;
+  _rowFill = 0;
+  _tsplLinesPerSecond = (uint32_t)BUFFER_MODEL_TSPL_SPEED * _dpi;
+  _labelLines = 0;
+}
+
+void PrinterBufferModel::clear() {
+  _head = 0;
+  _count = 0;
+  _occupancy = 0;
+}
+
+void PrinterBufferModel::drain(uint32_t nowUs) {
+  uint32_t elapsed = nowUs - _lastUs;
+  _lastUs = nowUs;
+  // Time the head was idle isn't banked: with _count reaching 0 it is lost
+  while (_count > 0) {
+    Segment& segment = _segments[_head];
+    if (segment.us > elapsed) {
+      uint32_t consumed = (uint64_t)segment.bytes * elapsed / segment.us;
+      segment.bytes -= consumed;
+      segment.us -= elapsed;
+      _occupancy -= consumed;
+      return;
+    }
+    elapsed -= segment.us;
+    _occupancy -= segment.bytes;
+    _head = (_head + 1) % BUFFER_MODEL_SEGMENTS;
+    _count--;
+  }
+}
+
+uint32_t PrinterBufferModel::delayUs(size_t length, uint32_t nowUs) {
+  drain(nowUs);
+  if (_capacity == 0 || _occupancy + length <= _capacity) {
+    return 0;
+  }
+  // A write larger than the whole buffer waits for it to be empty
+  uint32_t excess = length >= _capacity ? _occupancy : _occupancy + length - _capacity;
+  uint64_t wait = 0;
+  for (size_t i = 0; i < _count && excess > 0; i++) {
+    const Segment& segment = _segments[(_head + i) % BUFFER_MODEL_SEGMENTS];
+    if (segment.bytes <= excess) {
+      wait += segment.us;
+      excess -= segment.bytes;
+    } else {
+      wait += ((uint64_t)segment.us * excess + segment.bytes - 1) / segment.bytes;
+      excess = 0;
+    }
+  }
+  return wait > UINT32_MAX ? UINT32_MAX : (uint32_t)wait;
+}
+
+void PrinterBufferModel::written(const uint8_t* data, size_t length, uint32_t nowUs) {
+  if (_capacity == 0 || length == 0) {
+    return;
+  }
+  drain(nowUs);
+  _cost = 0;
+  _parser.feed(data, length);
+  uint32_t us = _cost > UINT32_MAX ? UINT32_MAX : (uint32_t)_cost;
+
+  if (_count == BUFFER_MODEL_SEGMENTS) {
+    // Out of segments: the last one takes these bytes too, which spreads
+    // their cost over both
+    Segment& last = _segments[(_head + _count - 1) % BUFFER_MODEL_SEGMENTS];
+    last.bytes += length;
+    last.us = (uint64_t)last.us + us > UINT32_MAX ? UINT32_MAX : last.us + us;
+  } else {
+    _segments[(_head + _count) % BUFFER_MODEL_SEGMENTS] = {(uint32_t)length, us};
+    _count++;
+  }
+  _occupancy += length;
+}
+
+void PrinterBufferModel::addLines(uint32_t lines, uint32_t linesPerSecond) {
+  if (linesPerSecond != 0) {
+    _cost += (uint64_t)lines * 1000000 / linesPerSecond;
+  }
+}
+
+// SPEED n or SPEED n.n, in inches per second
+void PrinterBufferModel::tsplSpeed(const uint8_t* line, size_t length) {
+  static const char KEYWORD[] = "SPEED";
+  size_t pos = sizeof(KEYWORD) - 1;
+  if (length <= pos || memcmp(line, KEYWORD, pos) != 0) {
+    return;
+  }
+  while (pos < length && line[pos] == ' ') {
+    pos++;
+  }
+  uint32_t tenths = 0;
+  bool digits = false;
+  for (; pos < length && line[pos] >= '0' && line[pos] <= '9'; pos++) {
+    tenths = tenths * 10 + (line[pos] - '0');
+    digits = true;
+  }
+  tenths *= 10;
+  if (pos + 1 < length && line[pos] == '.' && line[pos + 1] >= '0' && line[pos + 1] <= '9') {
+    tenths += line[pos + 1] - '0';
+  }
+  if (digits && tenths > 0 && tenths < 1000) {
+    _tsplLinesPerSecond = tenths * _dpi / 10;
+  }
+}
+
+bool PrinterBufferModel::streamEvent(void* context, const PrintEvent& event) {
+  PrinterBufferModel* self = (PrinterBufferModel*)context;
+  bool tspl = self->_parser.dialect() == PRINT_DIALECT_TSPL;
+
+  if (event.type == PRINT_EVENT_BYTES) {
+    // ESC/POS text prints a line at each line feed
+    if (!tspl) {
+      for (size_t i = 0; i < event.length; i++) {
+        if (event.data[i] == '\n') {
+          self->addLines(BUFFER_MODEL_TEXT_LINE, self->_linesPerSecond);
+        }
+      }
+    }
+    return true;
+  }
+
+  if (event.type == PRINT_EVENT_DATA && event.command == PRINT_CMD_RASTER && self->_rowBytes != 0) {
+    self->_rowFill += event.length;
+    uint32_t rows = self->_rowFill / self->_rowBytes;
+    self->_rowFill %= self->_rowBytes;
+    self->addLines(rows * self->_rowLines, self->_linesPerSecond);
+    return true;
+  }
+  if (event.type != PRINT_EVENT_COMMAND) {
+    return true;
+  }
+
+  const PrintCommandArgs& args = *event.args;
+  switch (event.command) {
+    case PRINT_CMD_RASTER:
+      self->_rowBytes = args.width;
+      self->_rowLines = (args.mode & 2) ? 2 : 1;
+      self->_rowFill = 0;
+      break;
+    case PRINT_CMD_FEED:
+    case PRINT_CMD_CUT:
+      self->addLines(args.count, self->_linesPerSecond);
+      break;
+    case PRINT_CMD_FEED_LINES:
+      self->addLines((uint32_t)args.count * BUFFER_MODEL_TEXT_LINE, self->_linesPerSecond);
+      break;
+    case PRINT_CMD_TSPL_SIZE:
+      self->_labelLines = (uint32_t)args.height * self->_dpi / 254;
+      break;
+    case PRINT_CMD_TSPL_PRINT:
+      self->addLines(self->_labelLines * (args.count != 0 ? args.count : 1), self->_tsplLinesPerSecond);
+      break;
+    case PRINT_CMD_OTHER:
+      if (tspl) {
+        self->tsplSpeed(event.data, event.length);
+      }
+      break;
+    default:
+      break;
+  }
+  return true;
+}
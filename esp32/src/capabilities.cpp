@@ -0,0 +1,159 @@
+#include "capabilities.h"
+
+#include <LittleFS.h>
+
+#include "batch_print.h"
+#include "ble_printer.h"
+#include "image_raster.h"
+#include "ipp_server.h"
+#include "job_cache.h"
+#include "label_template.h"
+#include "raw_print_server.h"
+#include "ws_print.h"
+
+static const char TEMPLATE_SUFFIX[] = ".tpl";
+
+static void appendEscaped(String& json, const char* text) {
+  for (const char* c = text; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      json += '\\';
+    }
+    json += *c;
+  }
+}
+
+static void appendTemplates(String& json) {
+  json += "\"templates\":[";
+  File dir = LittleFS.open(LABEL_TEMPLATE_DIR);
+  if (dir && dir.isDirectory()) {
+    bool first = true;
+    for (File file = dir.openNextFile(); file; file = dir.openNextFile()) {
+      String name = file.name();
+      file.close();
+      if (!name.endsWith(TEMPLATE_SUFFIX)) {
+        continue;
+      }
+      json += first ? "\"" : ",\"";
+      first = false;
+      appendEscaped(json, name.substring(0, name.length() - strlen(TEMPLATE_SUFFIX)).c_str());
+      json += "\"";
+    }
+    dir.close();
+  }
+  json += "]";
+}
+
+static void appendCachedJob(const char* hash, size_t length, void* context) {
+  String& json = *(String*)context;
+  json += json.endsWith("[") ? "{\"hash\":\"" : ",{\"hash\":\"";
+  json += hash;
+  json += "\",\"bytes\":";
+  json += String(length);
+  json += "}";
+}
+
+static const char* commandSet(uint8_t caps) {
+  if (caps & RASTER_CAP_TSPL_BITMAP) {
+    return "\"tspl\"";
+  }
+  return caps != RASTER_CAP_NONE ? "\"escpos\"" : "null";
+}
+
+static void appendRasterCaps(String& json, uint8_t caps) {
+  static const struct {
+    uint8_t cap;
+    const char* name;
+  } NAMES[] = {
+    {RASTER_CAP_MERGE_ROWS, "merge_rows"},
+    {RASTER_CAP_FEED_BLANK, "feed_blank"},
+    {RASTER_CAP_TSPL_BITMAP, "tspl_bitmap"},
+    {RASTER_CAP_CROP, "crop"},
+    {RASTER_CAP_SPLIT_BANDS, "split_bands"},
+  };
+  json += "\"raster\":[";
+  bool first = true;
+  for (const auto& entry : NAMES) {
+    if (caps & entry.cap) {
+      json += first ? "\"" : ",\"";
+      first = false;
+      json += entry.name;
+      json += "\"";
+    }
+  }
+  json += "]";
+}
+
+static void appendPrinter(String& json, const BlePrinter& printer) {
+  uint8_t caps = printer.recoder().caps();
+  json += "{\"id\":\"";
+  appendEscaped(json, printer.id().c_str());
+  json += "\",\"name\":\"";
+  appendEscaped(json, printer.name().c_str());
+  json += "\",\"connected\":";
+  json += printer.connected() ? "true" : "false";
+  json += ",\"transport\":\"";
+  json += printer.usb() ? "usb" : printer.spp() ? "spp" : printer.l2cap() ? "l2cap" : "ble";
+  json += "\",\"dpi\":";
+  json += printer.dpi() != 0 ? String(printer.dpi()) : String("null");
+  json += ",\"dots\":";
+  json += printer.dots() != 0 ? String(printer.dots()) : String("null");
+  json += ",\"pool\":";
+  if (printer.pool() != PRINT_NO_POOL) {
+    json += "\"";
+    appendEscaped(json, poolName(printer.pool()));
+    json += "\"";
+  } else {
+    json += "null";
+  }
+  json += ",\"commands\":";
+  json += commandSet(caps);
+  json += ",";
+  appendRasterCaps(json, caps);
+  json += ",\"pipeline\":\"";
+  json += printer.pipelineName();
+  json += "\",\"ipp\":\"";
+  json += IPP_PATH;
+  if (printer.index() > 0) {
+    json += "/";
+    appendEscaped(json, printer.id().c_str());
+  }
+  json += "\",\"rawPort\":";
+  json += RAW_PRINT_PORT != 0 ? String(RAW_PRINT_PORT + printer.index()) : String("null");
+  json += ",\"chunk\":";
+  json += String(printer.chunkSize());
+  json += ",\"bytesPerSec\":";
+  json += String(printer.throughput() != 0 ? printer.throughput() : printer.probeRate());
+  json += ",\"queue\":";
+  json += String(printQueueDepth(printer.index()));
+  json += "}";
+}
+
+String getCapabilitiesJSON() {
+  String json = "{\"encodings\":[\"identity\",\"deflate\"],\"endpoints\":{\"raw\":\"/print\",";
+  json += "\"image\":\"/print/image\",\"template\":\"/print/template/{name}\",";
+  json += "\"series\":\"/print/template/{name}/series\",";
+  if (JOB_CACHE_BUDGET > 0) {
+    json += "\"cached\":\"/print/cached/{hash}\",";
+  }
+  json += "\"batch\":\"/print/batch\",\"zpl\":\"/print/zpl\",\"pdf\":\"/print/pdf\",\"ws\":\"" WS_PRINT_PATH "\"},";
+  json += "\"image\":{\"types\":[\"pbm\",\"pgm\",\"png\"],\"maxWidth\":";
+  json += String(IMAGE_MAX_WIDTH);
+  json += ",\"dither\":[\"none\",\"bayer\",\"atkinson\",\"fs\"],\"commands\":[\"escpos\",\"tspl\"]},";
+  json += "\"batchMaxLabels\":";
+  json += String(PRINT_BATCH_MAX_LABELS);
+  json += ",\"maxCopies\":";
+  json += String(PRINT_MAX_COPIES);
+  json += ",";
+  appendTemplates(json);
+  json += ",\"cachedJobs\":[";
+  forEachCachedJob(appendCachedJob, &json);
+  json += "],\"printers\":[";
+  for (size_t i = 0; i < printerCount(); i++) {
+    if (i > 0) {
+      json += ",";
+    }
+    appendPrinter(json, *getPrinter(i));
+  }
+  json += "]}";
+  return json;
+}
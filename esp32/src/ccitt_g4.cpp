@@ -0,0 +1,270 @@
+#include "ccitt_g4.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Run length codes of T.4, terminating (0..63) and makeup (64..2560), by
+// code length
+struct G4Code {
+  uint16_t code;
+  uint8_t bits;
+  uint16_t run;
+};
+
+static const G4Code WHITE_CODES[] = {
+  {0x007, 4, 2}, {0x008, 4, 3}, {0x00b, 4, 4}, {0x00c, 4, 5},
+  {0x00e, 4, 6}, {0x00f, 4, 7}, {0x007, 5, 10}, {0x008, 5, 11},
+  {0x012, 5, 128}, {0x013, 5, 8}, {0x014, 5, 9}, {0x01b, 5, 64},
+  {0x003, 6, 13}, {0x007, 6, 1}, {0x008, 6, 12}, {0x017, 6, 192},
+  {0x018, 6, 1664}, {0x02a, 6, 16}, {0x02b, 6, 17}, {0x034, 6, 14},
+  {0x035, 6, 15}, {0x003, 7, 22}, {0x004, 7, 23}, {0x008, 7, 20},
+  {0x00c, 7, 19}, {0x013, 7, 26}, {0x017, 7, 21}, {0x018, 7, 28},
+  {0x024, 7, 27}, {0x027, 7, 18}, {0x028, 7, 24}, {0x02b, 7, 25},
+  {0x037, 7, 256}, {0x002, 8, 29}, {0x003, 8, 30}, {0x004, 8, 45},
+  {0x005, 8, 46}, {0x00a, 8, 47}, {0x00b, 8, 48}, {0x012, 8, 33},
+  {0x013, 8, 34}, {0x014, 8, 35}, {0x015, 8, 36}, {0x016, 8, 37},
+  {0x017, 8, 38}, {0x01a, 8, 31}, {0x01b, 8, 32}, {0x024, 8, 53},
+  {0x025, 8, 54}, {0x028, 8, 39}, {0x029, 8, 40}, {0x02a, 8, 41},
+  {0x02b, 8, 42}, {0x02c, 8, 43}, {0x02d, 8, 44}, {0x032, 8, 61},
+  {0x033, 8, 62}, {0x034, 8, 63}, {0x035, 8, 0}, {0x036, 8, 320},
+  {0x037, 8, 384}, {0x04a, 8, 59}, {0x04b, 8, 60}, {0x052, 8, 49},
+  {0x053, 8, 50}, {0x054, 8, 51}, {0x055, 8, 52}, {0x058, 8, 55},
+  {0x059, 8, 56}, {0x05a, 8, 57}, {0x05b, 8, 58}, {0x064, 8, 448},
+  {0x065, 8, 512}, {0x067, 8, 640}, {0x068, 8, 576}, {0x098, 9, 1472},
+  {0x099, 9, 1536}, {0x09a, 9, 1600}, {0x09b, 9, 1728}, {0x0cc, 9, 704},
+  {0x0cd, 9, 768}, {0x0d2, 9, 832}, {0x0d3, 9, 896}, {0x0d4, 9, 960},
+  {0x0d5, 9, 1024}, {0x0d6, 9, 1088}, {0x0d7, 9, 1152}, {0x0d8, 9, 1216},
+  {0x0d9, 9, 1280}, {0x0da, 9, 1344}, {0x0db, 9, 1408}, {0x008, 11, 1792},
+  {0x00c, 11, 1856}, {0x00d, 11, 1920}, {0x012, 12, 1984}, {0x013, 12, 2048},
+  {0x014, 12, 2112}, {0x015, 12, 2176}, {0x016, 12, 2240}, {0x017, 12, 2304},
+  {0x01c, 12, 2368}, {0x01d, 12, 2432}, {0x01e, 12, 2496}, {0x01f, 12, 2560},
+};
+
+static const G4Code BLACK_CODES[] = {
+  {0x002, 2, 3}, {0x003, 2, 2}, {0x002, 3, 1}, {0x003, 3, 4},
+  {0x002, 4, 6}, {0x003, 4, 5}, {0x003, 5, 7}, {0x004, 6, 9},
+  {0x005, 6, 8}, {0x004, 7, 10}, {0x005, 7, 11}, {0x007, 7, 12},
+  {0x004, 8, 13}, {0x007, 8, 14}, {0x018, 9, 15}, {0x008, 10, 18},
+  {0x00f, 10, 64}, {0x017, 10, 16}, {0x018, 10, 17}, {0x037, 10, 0},
+  {0x008, 11, 1792}, {0x00c, 11, 1856}, {0x00d, 11, 1920}, {0x017, 11, 24},
+  {0x018, 11, 25}, {0x028, 11, 23}, {0x037, 11, 22}, {0x067, 11, 19},
+  {0x068, 11, 20}, {0x06c, 11, 21}, {0x012, 12, 1984}, {0x013, 12, 2048},
+  {0x014, 12, 2112}, {0x015, 12, 2176}, {0x016, 12, 2240}, {0x017, 12, 2304},
+  {0x01c, 12, 2368}, {0x01d, 12, 2432}, {0x01e, 12, 2496}, {0x01f, 12, 2560},
+  {0x024, 12, 52}, {0x027, 12, 55}, {0x028, 12, 56}, {0x02b, 12, 59},
+  {0x02c, 12, 60}, {0x033, 12, 320}, {0x034, 12, 384}, {0x035, 12, 448},
+  {0x037, 12, 53}, {0x038, 12, 54}, {0x052, 12, 50}, {0x053, 12, 51},
+  {0x054, 12, 44}, {0x055, 12, 45}, {0x056, 12, 46}, {0x057, 12, 47},
+  {0x058, 12, 57}, {0x059, 12, 58}, {0x05a, 12, 61}, {0x05b, 12, 256},
+  {0x064, 12, 48}, {0x065, 12, 49}, {0x066, 12, 62}, {0x067, 12, 63},
+  {0x068, 12, 30}, {0x069, 12, 31}, {0x06a, 12, 32}, {0x06b, 12, 33},
+  {0x06c, 12, 40}, {0x06d, 12, 41}, {0x0c8, 12, 128}, {0x0c9, 12, 192},
+  {0x0ca, 12, 26}, {0x0cb, 12, 27}, {0x0cc, 12, 28}, {0x0cd, 12, 29},
+  {0x0d2, 12, 34}, {0x0d3, 12, 35}, {0x0d4, 12, 36}, {0x0d5, 12, 37},
+  {0x0d6, 12, 38}, {0x0d7, 12, 39}, {0x0da, 12, 42}, {0x0db, 12, 43},
+  {0x04a, 13, 640}, {0x04b, 13, 704}, {0x04c, 13, 768}, {0x04d, 13, 832},
+  {0x052, 13, 1280}, {0x053, 13, 1344}, {0x054, 13, 1408}, {0x055, 13, 1472},
+  {0x05a, 13, 1536}, {0x05b, 13, 1600}, {0x064, 13, 1664}, {0x065, 13, 1728},
+  {0x06c, 13, 512}, {0x06d, 13, 576}, {0x072, 13, 896}, {0x073, 13, 960},
+  {0x074, 13, 1024}, {0x075, 13, 1088}, {0x076, 13, 1152}, {0x077, 13, 1216},
+};
+
+static const size_t WHITE_COUNT = sizeof(WHITE_CODES) / sizeof(WHITE_CODES[0]);
+static const size_t BLACK_COUNT = sizeof(BLACK_CODES) / sizeof(BLACK_CODES[0]);
+static const uint8_t LONGEST_CODE = 13;
+
+enum G4Mode {
+  MODE_PASS,
+  MODE_HORIZONTAL,
+  MODE_VERTICAL,
+  MODE_END,
+  MODE_ERROR
+};
+
+G4Decoder::~G4Decoder() {
+  end();
+}
+
+bool G4Decoder::begin(const uint8_t* data, size_t length, uint16_t columns) {
+  end();
+  _data = data;
+  _bits = length * 8;
+  _pos = 0;
+  _columns = columns;
+  // Two entries per mode code at most, around the ones a row can have
+  _ref = (uint16_t*)malloc((columns + 4) * sizeof(uint16_t));
+  _cur = (uint16_t*)malloc((columns + 4) * sizeof(uint16_t));
+  _refCount = 0;
+  _curCount = 0;
+  if (_ref == nullptr || _cur == nullptr) {
+    end();
+    return false;
+  }
+  return columns > 0;
+}
+
+void G4Decoder::end() {
+  free(_ref);
+  free(_cur);
+  _ref = nullptr;
+  _cur = nullptr;
+}
+
+int G4Decoder::bit() {
+  if (_pos >= _bits) {
+    return -1;
+  }
+  int b = (_data[_pos >> 3] >> (7 - (_pos & 7))) & 1;
+  _pos++;
+  return b;
+}
+
+// Makeup codes up to the terminating one; -1 for a code not in the table
+int G4Decoder::run(bool black) {
+  const G4Code* table = black ? BLACK_CODES : WHITE_CODES;
+  const size_t count = black ? BLACK_COUNT : WHITE_COUNT;
+  int total = 0;
+  for (;;) {
+    uint16_t code = 0;
+    uint8_t length = 0;
+    size_t first = 0;
+    const G4Code* found = nullptr;
+    while (found == nullptr && length < LONGEST_CODE) {
+      int b = bit();
+      if (b < 0) {
+        return -1;
+      }
+      code = code << 1 | b;
+      length++;
+      while (first < count && table[first].bits < length) {
+        first++;
+      }
+      for (size_t i = first; i < count && table[i].bits == length; i++) {
+        if (table[i].code == code) {
+          found = &table[i];
+          break;
+        }
+      }
+    }
+    if (found == nullptr) {
+      return -1;
+    }
+    total += found->run;
+    if (found->run < 64) {
+      return total;
+    }
+  }
+}
+
+void G4Decoder::addChange(uint16_t position) {
+  if (_curCount < (size_t)_columns + 4) {
+    _cur[_curCount++] = position;
+  }
+}
+
+// Set the bits from..to-1 of a packed row
+static void fillBlack(uint8_t* bits, int from, int to) {
+  while (from < to && (from & 7) != 0) {
+    bits[from >> 3] |= 0x80 >> (from & 7);
+    from++;
+  }
+  if (to - from >= 8) {
+    memset(bits + (from >> 3), 0xFF, (to - from) >> 3);
+    from += (to - from) & ~7;
+  }
+  while (from < to) {
+    bits[from >> 3] |= 0x80 >> (from & 7);
+    from++;
+  }
+}
+
+G4Status G4Decoder::row(uint8_t* bits) {
+  if (_ref == nullptr) {
+    return G4_ERROR;
+  }
+  memset(bits, 0, (_columns + 7) / 8);
+  _curCount = 0;
+  int a0 = -1;
+  bool black = false;
+  size_t refPos = 0;
+
+  while (a0 < _columns) {
+    // Mode code by its leading zeros
+    G4Mode mode = MODE_ERROR;
+    int delta = 0;
+    int zeros = 0;
+    int b;
+    while ((b = bit()) == 0) {
+      zeros++;
+    }
+    if (b < 0) {
+      // Out of data: all of it was used, or only padding was left
+      return a0 < 0 ? G4_END : G4_ERROR;
+    }
+    switch (zeros) {
+      case 0: mode = MODE_VERTICAL; break;
+      case 1: mode = MODE_VERTICAL; delta = bit() == 1 ? 1 : -1; break;
+      case 2: mode = MODE_HORIZONTAL; break;
+      case 3: mode = MODE_PASS; break;
+      case 4: mode = MODE_VERTICAL; delta = bit() == 1 ? 2 : -2; break;
+      case 5: mode = MODE_VERTICAL; delta = bit() == 1 ? 3 : -3; break;
+      case 11: mode = MODE_END; break;      // EOL, the first half of EOFB
+      default: break;                       // Extensions and anything else
+    }
+    if (mode == MODE_END) {
+      return a0 < 0 ? G4_END : G4_ERROR;
+    }
+    if (mode == MODE_ERROR) {
+      return G4_ERROR;
+    }
+
+    // b1: the first change on the row above right of a0 to the colour
+    // a0 isn't; b2 the one after it
+    while (refPos < _refCount && (int)_ref[refPos] <= a0) {
+      refPos++;
+    }
+    size_t k = refPos + (((refPos & 1) != 0) != black ? 1 : 0);
+    int b1 = k < _refCount ? _ref[k] : _columns;
+    int b2 = k + 1 < _refCount ? _ref[k + 1] : _columns;
+    int start = a0 < 0 ? 0 : a0;
+
+    if (mode == MODE_PASS) {
+      if (b2 > _columns) {
+        return G4_ERROR;
+      }
+      if (black) {
+        fillBlack(bits, start, b2);
+      }
+      a0 = b2;
+    } else if (mode == MODE_HORIZONTAL) {
+      int first = run(black);
+      int second = first < 0 ? -1 : run(!black);
+      int a1 = start + first;
+      int a2 = a1 + second;
+      if (second < 0 || a2 > _columns) {
+        return G4_ERROR;
+      }
+      fillBlack(bits, black ? start : a1, black ? a1 : a2);
+      addChange(a1);
+      addChange(a2);
+      a0 = a2;
+    } else {
+      int a1 = b1 + delta;
+      if (a1 < start || a1 > _columns) {
+        return G4_ERROR;
+      }
+      if (black) {
+        fillBlack(bits, start, a1);
+      }
+      addChange(a1);
+      black = !black;
+      a0 = a1;
+    }
+  }
+
+  uint16_t* line = _ref;
+  _ref = _cur;
+  _cur = line;
+  _refCount = _curCount;
+  return G4_ROW;
+}
@@ -0,0 +1,403 @@
+#include "cluster.h"
+
+#include <ESPmDNS.h>
+#include <mdns.h>
+
+#include "ble_printer.h"
+#include "eth_link.h"
+#include "heap_stats.h"
+#include "ipp_server.h"
+
+static const char* CLUSTER_SERVICE = "_printbridge";
+static const char* CLUSTER_PROTO = "_tcp";
+// Answer of a peer kept for the client; longer bodies are cut
+static const size_t FORWARD_BODY_MAX = 1024;
+
+struct ClusterPrinter {
+  char id[CLUSTER_PRINTER_ID_MAX];
+  uint8_t depth;
+};
+
+struct ClusterPeer {
+  uint32_t address;            // 0 for a free slot
+  uint16_t port;
+  uint32_t seen;
+  char name[24];
+  uint8_t printerCount;
+  ClusterPrinter printers[MAX_PRINTERS];
+};
+
+static ClusterPeer peers[CLUSTER_MAX_PEERS];
+static SemaphoreHandle_t peerLock = nullptr;
+static bool mdnsStarted = false;
+static bool advertised = false;
+static uint32_t lastAdvertise = 0;
+static String advertisedTxt;
+
+bool beginMdns() {
+  if (mdnsStarted) {
+    return true;
+  }
+  const char* hostname = strlen(IPP_MDNS_HOSTNAME) > 0 ? IPP_MDNS_HOSTNAME : "print-bridge";
+  if (!MDNS.begin(hostname)) {
+    log_e("mDNS failed to start");
+    return false;
+  }
+  mdnsStarted = true;
+  return true;
+}
+
+// p<n>=<id>,<depth> for the connected printers, joined for comparison
+static size_t connectedPrinters(char values[][CLUSTER_PRINTER_ID_MAX + 8], String& joined) {
+  size_t count = 0;
+  for (size_t i = 0; i < printerCount() && count < MAX_PRINTERS; i++) {
+    BlePrinter* printer = getPrinter(i);
+    if (!printer->connected()) {
+      continue;
+    }
+    snprintf(values[count], sizeof(values[count]), "%s,%u", printer->id().c_str(),
+             (unsigned)printQueueDepth(printer->index()));
+    joined += values[count];
+    joined += ';';
+    count++;
+  }
+  return count;
+}
+
+static void advertise() {
+  char values[MAX_PRINTERS][CLUSTER_PRINTER_ID_MAX + 8];
+  String joined;
+  size_t count = connectedPrinters(values, joined);
+  if (advertised && joined == advertisedTxt) {
+    return;
+  }
+
+  char keys[MAX_PRINTERS][4];
+  mdns_txt_item_t items[MAX_PRINTERS];
+  for (size_t i = 0; i < count; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "p%u", (unsigned)i);
+    items[i].key = keys[i];
+    items[i].value = values[i];
+  }
+  if (mdns_service_txt_set(CLUSTER_SERVICE, CLUSTER_PROTO, items, count) == ESP_OK) {
+    advertisedTxt = joined;
+    advertised = true;
+  }
+}
+
+static void storePeer(const mdns_result_t* result, uint32_t self) {
+  if (result->addr == nullptr || result->addr->addr.type != ESP_IPADDR_TYPE_V4) {
+    return;
+  }
+  uint32_t address = result->addr->addr.u_addr.ip4.addr;
+  if (address == self) {
+    return;
+  }
+
+  // The same address again, a free slot, or the peer seen longest ago
+  ClusterPeer* slot = &peers[0];
+  for (size_t i = 0; i < CLUSTER_MAX_PEERS; i++) {
+    if (peers[i].address == address) {
+      slot = &peers[i];
+      break;
+    }
+    if (slot->address != 0 && (peers[i].address == 0 || peers[i].seen < slot->seen)) {
+      slot = &peers[i];
+    }
+  }
+  slot->address = address;
+  slot->port = result->port;
+  slot->seen = millis();
+  strlcpy(slot->name, result->instance_name != nullptr ? result->instance_name : "", sizeof(slot->name));
+  slot->printerCount = 0;
+  for (size_t i = 0; i < result->txt_count && slot->printerCount < MAX_PRINTERS; i++) {
+    const char* value = result->txt[i].value;
+    const char* comma = value != nullptr ? strrchr(value, ',') : nullptr;
+    if (result->txt[i].key[0] != 'p' || comma == nullptr) {
+      continue;
+    }
+    ClusterPrinter& printer = slot->printers[slot->printerCount++];
+    size_t length = comma - value < CLUSTER_PRINTER_ID_MAX - 1 ? comma - value : CLUSTER_PRINTER_ID_MAX - 1;
+    memcpy(printer.id, value, length);
+    printer.id[length] = '\0';
+    printer.depth = atoi(comma + 1);
+  }
+}
+
+// Browsing blocks for the query time, so it runs apart from the service task
+static void browseTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  for (;;) {
+    mdns_result_t* results = nullptr;
+    if (mdns_query_ptr(CLUSTER_SERVICE, CLUSTER_PROTO, 3000, CLUSTER_MAX_PEERS, &results) == ESP_OK) {
+      uint32_t self = networkAddress();
+      xSemaphoreTake(peerLock, portMAX_DELAY);
+      for (mdns_result_t* result = results; result != nullptr; result = result->next) {
+        storePeer(result, self);
+      }
+      uint32_t now = millis();
+      for (size_t i = 0; i < CLUSTER_MAX_PEERS; i++) {
+        if (peers[i].address != 0 && now - peers[i].seen > CLUSTER_PEER_TTL_MS) {
+          log_i("Peer bridge %s gone", peers[i].name);
+          peers[i].address = 0;
+        }
+      }
+      xSemaphoreGive(peerLock);
+      mdns_query_results_free(results);
+    }
+    vTaskDelay(pdMS_TO_TICKS(CLUSTER_QUERY_MS));
+  }
+}
+
+void initCluster(uint16_t httpPort) {
+  if (!CLUSTER_ENABLED || !beginMdns()) {
+    return;
+  }
+  peerLock = xSemaphoreCreateMutex();
+  if (peerLock == nullptr) {
+    return;
+  }
+
+  // Hostnames may clash between bridges; the instance name doesn't
+  char instance[24];
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(instance, sizeof(instance), "bridge-%02x%02x%02x", (uint8_t)(mac >> 24), (uint8_t)(mac >> 32),
+           (uint8_t)(mac >> 40));
+  if (mdns_service_add(instance, CLUSTER_SERVICE, CLUSTER_PROTO, httpPort, nullptr, 0) != ESP_OK) {
+    log_e("Cluster service not advertised");
+    return;
+  }
+  advertise();
+  lastAdvertise = millis();
+
+  if (xTaskCreatePinnedToCore(browseTask, "cluster", 4096, nullptr, 1, nullptr, 0) != pdPASS) {
+    log_e("Failed to start cluster browse task");
+    return;
+  }
+  log_i("Cluster: advertised as %s", instance);
+}
+
+void serviceCluster() {
+  if (peerLock == nullptr || millis() - lastAdvertise < CLUSTER_ADVERTISE_MS) {
+    return;
+  }
+  lastAdvertise = millis();
+  advertise();
+}
+
+bool findClusterPrinter(const String& id, IPAddress& address, uint16_t& port) {
+  if (peerLock == nullptr) {
+    return false;
+  }
+  bool found = false;
+  uint8_t bestDepth = 0;
+  xSemaphoreTake(peerLock, portMAX_DELAY);
+  for (size_t i = 0; i < CLUSTER_MAX_PEERS; i++) {
+    const ClusterPeer& peer = peers[i];
+    if (peer.address == 0) {
+      continue;
+    }
+    for (size_t j = 0; j < peer.printerCount; j++) {
+      if (id == peer.printers[j].id && (!found || peer.printers[j].depth < bestDepth)) {
+        found = true;
+        bestDepth = peer.printers[j].depth;
+        address = IPAddress(peer.address);
+        port = peer.port;
+      }
+    }
+  }
+  xSemaphoreGive(peerLock);
+  return found;
+}
+
+static void appendEscaped(String& json, const char* text) {
+  for (const char* c = text; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      json += '\\';
+    }
+    json += *c;
+  }
+}
+
+String getClusterJSON() {
+  String json = "{\"peers\":[";
+  if (peerLock != nullptr) {
+    uint32_t now = millis();
+    bool first = true;
+    xSemaphoreTake(peerLock, portMAX_DELAY);
+    for (size_t i = 0; i < CLUSTER_MAX_PEERS; i++) {
+      const ClusterPeer& peer = peers[i];
+      if (peer.address == 0) {
+        continue;
+      }
+      json += first ? "{\"name\":\"" : ",{\"name\":\"";
+      first = false;
+      appendEscaped(json, peer.name);
+      json += "\",\"seenMs\":";
+      json += String(now - peer.seen);
+      json += ",\"printers\":[";
+      for (size_t j = 0; j < peer.printerCount; j++) {
+        json += j == 0 ? "{\"id\":\"" : ",{\"id\":\"";
+        appendEscaped(json, peer.printers[j].id);
+        json += "\",\"queue\":";
+        json += String(peer.printers[j].depth);
+        json += "}";
+      }
+      json += "]}";
+    }
+    xSemaphoreGive(peerLock);
+  }
+  json += "]}";
+  return json;
+}
+
+// ---------------------------------------------------------------------------
+
+static void appendUrlEncoded(String& out, const String& text) {
+  static const char HEX_DIGITS[] = "0123456789ABCDEF";
+  for (size_t i = 0; i < text.length(); i++) {
+    char c = text[i];
+    if (isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.' || c == '~') {
+      out += c;
+    } else {
+      out += '%';
+      out += HEX_DIGITS[(uint8_t)c >> 4];
+      out += HEX_DIGITS[(uint8_t)c & 0x0F];
+    }
+  }
+}
+
+void ClusterForward::begin(AsyncWebServerRequest* request, IPAddress peer, uint16_t port, size_t total) {
+  if (!_client.connect(peer, port, CLUSTER_FORWARD_TIMEOUT_MS)) {
+    log_w("Peer bridge for %s unreachable", request->url().c_str());
+    _failed = true;
+    return;
+  }
+  _client.setNoDelay(true);
+
+  String head = "POST " + request->url();
+  char separator = '?';
+  for (size_t i = 0; i < request->params(); i++) {
+    AsyncWebParameter* param = request->getParam(i);
+    if (param->isPost() || param->isFile()) {
+      continue;
+    }
+    head += separator;
+    separator = '&';
+    appendUrlEncoded(head, param->name());
+    head += '=';
+    appendUrlEncoded(head, param->value());
+  }
+  head += " HTTP/1.1\r\nHost: " + peer.toString() + "\r\nConnection: close\r\nX-Bridge-Forwarded: 1\r\n";
+  head += "Content-Length: " + String(total) + "\r\n";
+  static const char* const PASSED_HEADERS[] = {"Content-Type", "Content-Encoding", "X-Job-Hash"};
+  for (const char* name : PASSED_HEADERS) {
+    if (request->hasHeader(name)) {
+      head += String(name) + ": " + request->header(name) + "\r\n";
+    }
+  }
+  // The peer shares its printer by station, not by this bridge
+  String station = request->hasHeader("X-Station") ? request->header("X-Station")
+                                                   : request->client()->remoteIP().toString();
+  head += "X-Station: " + station + "\r\n";
+  head += "\r\n";
+  write((const uint8_t*)head.c_str(), head.length());
+}
+
+void ClusterForward::write(const uint8_t* data, size_t length) {
+  if (_failed) {
+    return;
+  }
+  size_t offset = 0;
+  while (offset < length) {
+    size_t written = _client.write(data + offset, length - offset);
+    if (written == 0) {
+      log_w("Forwarded upload cut off by the peer");
+      _failed = true;
+      return;
+    }
+    offset += written;
+  }
+}
+
+void ClusterForward::finish(AsyncWebServerRequest* request) {
+  int code = 0;
+  String contentType = "text/plain";
+  String retryAfter;
+  String jobCache;
+  size_t contentLength = FORWARD_BODY_MAX;
+
+  if (!_failed) {
+    _client.setTimeout(CLUSTER_FORWARD_TIMEOUT_MS / 1000);
+    String status = _client.readStringUntil('\n');
+    int space = status.indexOf(' ');
+    code = space > 0 ? status.substring(space + 1).toInt() : 0;
+    for (;;) {
+      String line = _client.readStringUntil('\n');
+      line.trim();
+      if (line.length() == 0) {
+        break;
+      }
+      int colon = line.indexOf(':');
+      if (colon <= 0) {
+        continue;
+      }
+      String name = line.substring(0, colon);
+      String value = line.substring(colon + 1);
+      value.trim();
+      if (name.equalsIgnoreCase("Content-Type")) {
+        contentType = value;
+      } else if (name.equalsIgnoreCase("Content-Length")) {
+        contentLength = min((size_t)value.toInt(), FORWARD_BODY_MAX);
+      } else if (name.equalsIgnoreCase("Retry-After")) {
+        retryAfter = value;
+      } else if (name.equalsIgnoreCase("X-Job-Cache")) {
+        jobCache = value;
+      }
+    }
+  }
+  if (code < 100 || code > 599) {
+    _client.stop();
+    request->send(502, "text/plain", "Peer bridge did not answer");
+    return;
+  }
+
+  String body;
+  body.reserve(contentLength);
+  uint8_t buffer[128];
+  while (body.length() < contentLength) {
+    size_t want = min(sizeof(buffer), contentLength - body.length());
+    size_t got = _client.readBytes(buffer, want);
+    if (got == 0) {
+      break;
+    }
+    body.concat((const char*)buffer, got);
+  }
+  _client.stop();
+
+  // The job lives on the peer, so its Location would point nowhere
+  AsyncWebServerResponse* response = request->beginResponse(code, contentType, body);
+  response->addHeader("X-Job-Forwarded", "1");
+  if (retryAfter.length() > 0) {
+    response->addHeader("Retry-After", retryAfter);
+  }
+  if (jobCache.length() > 0) {
+    response->addHeader("X-Job-Cache", jobCache);
+  }
+  request->send(response);
+}
+
+ClusterForward* startClusterForward(AsyncWebServerRequest* request, size_t total) {
+  if (!request->hasParam("printer") || request->hasHeader("X-Bridge-Forwarded")) {
+    return nullptr;
+  }
+  IPAddress peer;
+  uint16_t port;
+  if (!findClusterPrinter(request->getParam("printer")->value(), peer, port)) {
+    return nullptr;
+  }
+  log_i("Forwarding job for %s to %s", request->getParam("printer")->value().c_str(), peer.toString().c_str());
+  ClusterForward* forward = new ClusterForward();
+  forward->begin(request, peer, port, total);
+  return forward;
+}
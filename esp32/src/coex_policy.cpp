@@ -0,0 +1,65 @@
+#include "coex_policy.h"
+#include "http_admission.h"
+
+#include <esp_idf_version.h>
+#if ESP_IDF_VERSION_MAJOR < 5
+#include <esp_coexist.h>
+#endif
+
+static volatile bool favourBle = false;
+static uint32_t lastPrinting = 0;
+// Only touched from the AsyncTCP task, which runs every handler
+static uint8_t busyResponses = 0;
+static uint32_t deferred = 0;
+
+static void setPreference(bool ble) {
+  favourBle = ble;
+#if ESP_IDF_VERSION_MAJOR < 5
+  esp_err_t err = esp_coex_preference_set(ble ? ESP_COEX_PREFER_BT : ESP_COEX_PREFER_BALANCE);
+  if (err != ESP_OK) {
+    log_w("Coexistence preference: %s", esp_err_to_name(err));
+    return;
+  }
+#endif
+  // IDF 5 dropped the preference and schedules by itself; the HTTP limit
+  // still applies
+  log_d("Coexistence %s", ble ? "favours BLE" : "balanced");
+}
+
+void serviceCoexPolicy(bool printing) {
+  if (!COEX_POLICY) {
+    return;
+  }
+  uint32_t now = millis();
+  if (printing) {
+    lastPrinting = now;
+    if (!favourBle) {
+      setPreference(true);
+    }
+  } else if (favourBle && now - lastPrinting >= COEX_IDLE_HOLD_MS) {
+    setPreference(false);
+    if (deferred > 0) {
+      log_i("%u web requests deferred while printing", deferred);
+      deferred = 0;
+    }
+  }
+}
+
+bool coexFavoursBle() {
+  return favourBle;
+}
+
+bool coexAdmit(AsyncWebServerRequest* request) {
+  if (favourBle && busyResponses >= COEX_HTTP_BUSY_MAX) {
+    deferred++;
+    AsyncWebServerResponse* response = request->beginResponse(503, "text/plain", "Busy printing");
+    response->addHeader("Retry-After", "1");
+    request->send(response);
+    return false;
+  }
+  busyResponses++;
+  onRequestEnd(request, []() {
+    busyResponses--;
+  });
+  return true;
+}
@@ -0,0 +1,31 @@
+#include "conn_schedule.h"
+
+static const uint16_t MAX_INTERVAL = 3200;  // 4 s, the most the spec allows
+
+ConnSchedule connSchedule(bool busy, uint8_t busyLinks, const ConnSchedule& configured) {
+  ConnSchedule schedule = configured;
+  uint16_t spread = configured.intervalMax > configured.intervalMin
+                        ? configured.intervalMax - configured.intervalMin : 0;
+  if (busy) {
+    uint32_t interval = (uint32_t)CONN_BUSY_EVENT * (busyLinks > 0 ? busyLinks : 1);
+    if (interval < configured.intervalMin) {
+      interval = configured.intervalMin;
+    }
+    schedule.intervalMin = interval < MAX_INTERVAL ? interval : MAX_INTERVAL;
+    // Its share of every interval, in half the units
+    schedule.eventLength = schedule.intervalMin * 2 / (busyLinks > 0 ? busyLinks : 1);
+  } else {
+    schedule.intervalMin = CONN_IDLE_INTERVAL > configured.intervalMin ? CONN_IDLE_INTERVAL : configured.intervalMin;
+    schedule.eventLength = 2;
+  }
+  uint32_t intervalMax = (uint32_t)schedule.intervalMin + spread;
+  schedule.intervalMax = intervalMax < MAX_INTERVAL ? intervalMax : MAX_INTERVAL;
+
+  // The link must outlast two intervals of missed events with the latency
+  // on top: intervalMax * 1.25 ms * (1 + latency) * 2 in 10 ms units
+  uint32_t timeout = (uint32_t)schedule.intervalMax * (1 + schedule.latency) / 4 + 1;
+  if (schedule.supervisionTimeout < timeout) {
+    schedule.supervisionTimeout = timeout < 3200 ? timeout : 3200;
+  }
+  return schedule;
+}
@@ -0,0 +1,441 @@
+#include "cpu_profile.h"
+#include "heap_stats.h"
+#include "http_admission.h"
+
+#if PROFILE_HZ
+
+#include <esp_heap_caps.h>
+#include <soc/soc_memory_layout.h>
+
+static_assert((PROFILE_SLOTS & (PROFILE_SLOTS - 1)) == 0, "PROFILE_SLOTS must be a power of two");
+static_assert(portNUM_PROCESSORS <= 2, "core labels are named for two cores");
+
+// Slots tried from the hash of a sample before it counts as dropped
+static const uint32_t PROFILE_PROBES = 8;
+// Tasks told apart by name in one profile; past that they share "other"
+static const size_t PROFILE_TASKS = 32;
+static const uint64_t PERIOD_NS = 1000000000ull / PROFILE_HZ;
+
+// Start of the XtExcFrame the interrupt entry saves on the stack of the
+// task it interrupted
+struct InterruptedFrame {
+  uint32_t exit;
+  uint32_t pc;
+  uint32_t ps;
+  uint32_t a0;
+};
+
+// Where a core was: the PC, its caller (0 when a0 held none) and the task
+struct ProfileSlot {
+  uint32_t pc;
+  uint32_t caller;
+  TaskHandle_t task;
+  uint32_t count;              // 0 for a free slot
+};
+
+// Written only by its core's timer interrupt while sampling
+struct ProfileTable {
+  uint32_t samples;
+  uint32_t dropped;            // Found no free slot near their hash
+  ProfileSlot slots[PROFILE_SLOTS];
+};
+
+struct ProfileTask {
+  TaskHandle_t handle;
+  char name[24];
+};
+
+// Worst cases of one encoded sample and location, key and length included
+static const size_t SAMPLE_BYTES = 48;
+static const size_t LOCATION_BYTES = 16;
+static const size_t PROFILE_ADDRESSES = 2 * portNUM_PROCESSORS * PROFILE_SLOTS;
+
+// The profile being taken or sent. Only the AsyncTCP task touches it.
+struct ProfileDump {
+  uint32_t started;
+  uint32_t ms;                 // Sampling time asked for
+  uint32_t sampledMs;          // Sampling time it got
+  bool built;
+  size_t length;
+  uint32_t addresses[PROFILE_ADDRESSES];
+  size_t addressCount;
+  ProfileTask tasks[PROFILE_TASKS];
+  size_t taskCount;
+  uint8_t data[portNUM_PROCESSORS * PROFILE_SLOTS * SAMPLE_BYTES + PROFILE_ADDRESSES * LOCATION_BYTES +
+               PROFILE_TASKS * (sizeof(ProfileTask::name) + 2) + 1024];
+};
+
+static ProfileTable* tables[portNUM_PROCESSORS];
+static hw_timer_t* timers[portNUM_PROCESSORS];
+static SemaphoreHandle_t timerDone = nullptr;
+static ProfileDump* dump = nullptr;
+
+// Tasks that aren't ours but show up in profiles, named by looking them up
+static const char* const SYSTEM_TASKS[] = {"async_tcp", "loopTask", "BTC_TASK", "BTU_TASK", "btController",
+                                           "tiT", "wifi", "sys_evt", "esp_timer", "ipc0", "ipc1"};
+
+static void ARDUINO_ISR_ATTR takeSample() {
+  uint8_t core = xPortGetCoreID();
+  ProfileTable* table = tables[core];
+  // On entry the interrupt left the task's stack pointer, which points at
+  // the frame it saved, in the first word of the task's control block
+  TaskHandle_t task = xTaskGetCurrentTaskHandleForCPU(core);
+  const InterruptedFrame* frame = *(const InterruptedFrame* const*)task;
+  uint32_t pc = frame->pc;
+  // The top two bits of a0 hold the window increment of the call instead
+  uint32_t caller = (frame->a0 & 0x3FFFFFFF) | (pc & 0xC0000000);
+  if (!esp_ptr_executable((const void*)(uintptr_t)caller)) {
+    caller = 0;
+  }
+
+  table->samples++;
+  uint32_t hash = ((pc >> 1) ^ (caller << 3) ^ (uint32_t)(uintptr_t)task) * 2654435761u;
+  for (uint32_t i = 0; i < PROFILE_PROBES; i++) {
+    ProfileSlot& slot = table->slots[((hash >> 16) + i) & (PROFILE_SLOTS - 1)];
+    if (slot.count == 0) {
+      slot.pc = pc;
+      slot.caller = caller;
+      slot.task = task;
+      slot.count = 1;
+      return;
+    }
+    if (slot.pc == pc && slot.caller == caller && slot.task == task) {
+      slot.count++;
+      return;
+    }
+  }
+  table->dropped++;
+}
+
+// A timer interrupt is served by the core that attached it, so each core
+// starts and stops its own from a short task pinned to it
+static void timerTask(void* param) {
+  bool start = (bool)(uintptr_t)param;
+  uint8_t core = xPortGetCoreID();
+  if (start) {
+    // 1 MHz off the 80 MHz APB clock
+    timers[core] = timerBegin(PROFILE_TIMER + core, 80, true);
+    if (timers[core] != nullptr) {
+      timerAttachInterrupt(timers[core], takeSample, true);
+      timerAlarmWrite(timers[core], 1000000 / PROFILE_HZ, true);
+      timerAlarmEnable(timers[core]);
+    }
+  } else if (timers[core] != nullptr) {
+    timerAlarmDisable(timers[core]);
+    timerDetachInterrupt(timers[core]);
+    timerEnd(timers[core]);
+    timers[core] = nullptr;
+  }
+  xSemaphoreGive(timerDone);
+  vTaskDelete(nullptr);
+}
+
+static bool runOnCores(bool start) {
+  bool ran = true;
+  for (BaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+    if (xTaskCreatePinnedToCore(timerTask, "profileTimer", 3072, (void*)(uintptr_t)start,
+                                configMAX_PRIORITIES - 1, nullptr, core) != pdPASS ||
+        xSemaphoreTake(timerDone, pdMS_TO_TICKS(1000)) != pdTRUE) {
+      ran = false;
+    }
+  }
+  return ran;
+}
+
+static void freeTables() {
+  for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+    if (tables[core] != nullptr) {
+      heap_caps_free(tables[core]);
+      heapRelease(HEAP_SITE_TRACE, sizeof(ProfileTable));
+      tables[core] = nullptr;
+    }
+  }
+}
+
+static void stopSampling() {
+  runOnCores(false);
+  freeTables();
+}
+
+// The interrupt reads its table without a check, so the tables are in
+// internal RAM, which stays reachable while flash is written
+static bool startSampling() {
+  for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+    if (!heapReserve(HEAP_SITE_TRACE, sizeof(ProfileTable))) {
+      freeTables();
+      return false;
+    }
+    tables[core] = (ProfileTable*)heap_caps_calloc(1, sizeof(ProfileTable), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (tables[core] == nullptr) {
+      heapRelease(HEAP_SITE_TRACE, sizeof(ProfileTable));
+      freeTables();
+      return false;
+    }
+  }
+  bool running = runOnCores(true);
+  for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+    running = running && timers[core] != nullptr;
+  }
+  if (!running) {
+    stopSampling();
+  }
+  return running;
+}
+
+static void endProfile() {
+  if (dump == nullptr) {
+    return;
+  }
+  if (!dump->built) {
+    stopSampling();
+  }
+  heapFree(dump);
+  dump = nullptr;
+}
+
+// Protocol buffer encoding, into space sized for the worst case
+static uint8_t* putVarint(uint8_t* p, uint64_t value) {
+  while (value >= 0x80) {
+    *p++ = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  *p++ = (uint8_t)value;
+  return p;
+}
+
+static uint8_t* putInt(uint8_t* p, uint32_t field, uint64_t value) {
+  p = putVarint(p, field << 3);
+  return putVarint(p, value);
+}
+
+static uint8_t* putBytes(uint8_t* p, uint32_t field, const void* data, size_t length) {
+  p = putVarint(p, (field << 3) | 2);
+  p = putVarint(p, length);
+  memcpy(p, data, length);
+  return p + length;
+}
+
+static uint8_t* putString(uint8_t* p, const char* text) {
+  return putBytes(p, 6, text, strlen(text));
+}
+
+static int compareAddresses(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+// Location IDs are the places of the addresses in the sorted list, from 1
+static uint32_t locationId(uint32_t address) {
+  const uint32_t* found = (const uint32_t*)bsearch(&address, dump->addresses, dump->addressCount,
+                                                   sizeof(uint32_t), compareAddresses);
+  return found - dump->addresses + 1;
+}
+
+static void taskName(TaskHandle_t task, char* name, size_t size) {
+  for (size_t i = 0; i < trackedTaskCount(); i++) {
+    if (trackedTaskHandle(i) == task) {
+      snprintf(name, size, "%s", trackedTaskName(i));
+      return;
+    }
+  }
+  for (const char* system : SYSTEM_TASKS) {
+    if (xTaskGetHandle(system) == task) {
+      snprintf(name, size, "%s", system);
+      return;
+    }
+  }
+  for (BaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+    if (xTaskGetIdleTaskHandleForCPU(core) == task) {
+      snprintf(name, size, "IDLE%d", core);
+      return;
+    }
+  }
+  // May have ended since, so its own name can't be read safely
+  snprintf(name, size, "task %08x", (uint32_t)(uintptr_t)task);
+}
+
+static size_t taskIndex(TaskHandle_t task) {
+  for (size_t i = 0; i < dump->taskCount; i++) {
+    if (dump->tasks[i].handle == task) {
+      return i;
+    }
+  }
+  if (dump->taskCount == PROFILE_TASKS) {
+    ProfileTask& other = dump->tasks[PROFILE_TASKS - 1];
+    other.handle = nullptr;
+    snprintf(other.name, sizeof(other.name), "other");
+    return PROFILE_TASKS - 1;
+  }
+  ProfileTask& entry = dump->tasks[dump->taskCount];
+  entry.handle = task;
+  taskName(task, entry.name, sizeof(entry.name));
+  return dump->taskCount++;
+}
+
+// Strings before the task names. The core label is a string, since pprof
+// drops numeric labels of 0.
+enum ProfileString { STR_EMPTY, STR_SAMPLES, STR_COUNT, STR_CPU, STR_NANOSECONDS, STR_FILE, STR_TASK, STR_CORE,
+                     STR_COMMENT, STR_CORE0, STR_CORE1, STR_TASKS };
+
+static void buildProfile() {
+  // Callers are return addresses; one byte back is still in the call
+  dump->addressCount = 0;
+  for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+    for (const ProfileSlot& slot : tables[core]->slots) {
+      if (slot.count != 0) {
+        dump->addresses[dump->addressCount++] = slot.pc;
+        if (slot.caller != 0) {
+          dump->addresses[dump->addressCount++] = slot.caller - 1;
+        }
+      }
+    }
+  }
+  qsort(dump->addresses, dump->addressCount, sizeof(uint32_t), compareAddresses);
+  size_t unique = 0;
+  for (size_t i = 0; i < dump->addressCount; i++) {
+    if (unique == 0 || dump->addresses[i] != dump->addresses[unique - 1]) {
+      dump->addresses[unique++] = dump->addresses[i];
+    }
+  }
+  dump->addressCount = unique;
+
+  uint8_t* p = dump->data;
+  uint8_t message[SAMPLE_BYTES];
+  uint8_t field[24];
+
+  // sample_type: samples/count and cpu/nanoseconds
+  uint8_t* m = putInt(putInt(message, 1, STR_SAMPLES), 2, STR_COUNT);
+  p = putBytes(p, 1, message, m - message);
+  m = putInt(putInt(message, 1, STR_CPU), 2, STR_NANOSECONDS);
+  p = putBytes(p, 1, message, m - message);
+
+  uint32_t samples = 0;
+  uint32_t dropped = 0;
+  dump->taskCount = 0;
+  for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+    samples += tables[core]->samples;
+    dropped += tables[core]->dropped;
+    for (const ProfileSlot& slot : tables[core]->slots) {
+      if (slot.count == 0) {
+        continue;
+      }
+      // Leaf first
+      uint8_t* f = putVarint(field, locationId(slot.pc));
+      if (slot.caller != 0) {
+        f = putVarint(f, locationId(slot.caller - 1));
+      }
+      m = putBytes(message, 1, field, f - field);
+      f = putVarint(putVarint(field, slot.count), slot.count * PERIOD_NS);
+      m = putBytes(m, 2, field, f - field);
+      f = putInt(putInt(field, 1, STR_TASK), 2, STR_TASKS + taskIndex(slot.task));
+      m = putBytes(m, 3, field, f - field);
+      f = putInt(putInt(field, 1, STR_CORE), 2, STR_CORE0 + core);
+      m = putBytes(m, 3, field, f - field);
+      p = putBytes(p, 2, message, m - message);
+    }
+  }
+
+  // One mapping over the whole address space: the ELF is linked at the
+  // addresses it runs at, so pprof symbolizes them as they are
+  m = putInt(message, 1, 1);
+  m = putInt(m, 3, UINT64_MAX);
+  m = putInt(m, 5, STR_FILE);
+  p = putBytes(p, 3, message, m - message);
+
+  for (size_t i = 0; i < dump->addressCount; i++) {
+    m = putInt(message, 1, i + 1);
+    m = putInt(m, 2, 1);
+    m = putInt(m, 3, dump->addresses[i]);
+    p = putBytes(p, 4, message, m - message);
+  }
+
+  char comment[96];
+  snprintf(comment, sizeof(comment), "%u Hz per core, %u samples over %u ms, %u dropped", PROFILE_HZ,
+           samples, dump->sampledMs, dropped);
+  const char* const strings[STR_TASKS] = {"", "samples", "count", "cpu", "nanoseconds", "firmware.elf",
+                                          "task", "core", comment, "0", "1"};
+  for (const char* text : strings) {
+    p = putString(p, text);
+  }
+  for (size_t i = 0; i < dump->taskCount; i++) {
+    p = putString(p, dump->tasks[i].name);
+  }
+
+  p = putInt(p, 10, (uint64_t)dump->sampledMs * 1000000);
+  m = putInt(putInt(message, 1, STR_CPU), 2, STR_NANOSECONDS);
+  p = putBytes(p, 11, message, m - message);
+  p = putInt(p, 12, PERIOD_NS);
+  p = putInt(p, 13, STR_COMMENT);
+
+  dump->length = p - dump->data;
+  dump->built = true;
+  log_i("Profile of %u samples, %u locations, %u bytes", samples, dump->addressCount, dump->length);
+}
+
+static void sendProfile(AsyncWebServerRequest* request) {
+  if (dump != nullptr) {
+    request->send(409, "text/plain", "A profile is being taken");
+    return;
+  }
+  long seconds = PROFILE_DEFAULT_SECONDS;
+  if (request->hasParam("seconds")) {
+    seconds = request->getParam("seconds")->value().toInt();
+    if (seconds < 1 || seconds > PROFILE_MAX_SECONDS) {
+      request->send(400, "text/plain", "seconds out of range");
+      return;
+    }
+  }
+
+  dump = (ProfileDump*)heapAlloc(HEAP_SITE_TRACE, sizeof(ProfileDump));
+  if (dump == nullptr || !startSampling()) {
+    heapFree(dump);
+    dump = nullptr;
+    request->send(503, "text/plain", "No memory or timers for the profile");
+    return;
+  }
+  dump->started = millis();
+  dump->ms = seconds * 1000;
+  dump->built = false;
+  log_i("Profiling both cores for %ld s", seconds);
+
+  onRequestEnd(request, []() {
+    endProfile();
+  });
+  // Held open while the samples come in, then sent in one go
+  AsyncWebServerResponse* response = request->beginChunkedResponse(
+      "application/octet-stream", [](uint8_t* out, size_t maxLen, size_t index) -> size_t {
+        if (dump == nullptr) {
+          return 0;
+        }
+        if (!dump->built) {
+          uint32_t elapsed = millis() - dump->started;
+          if (elapsed < dump->ms) {
+            return RESPONSE_TRY_AGAIN;
+          }
+          runOnCores(false);
+          dump->sampledMs = elapsed;
+          buildProfile();
+          freeTables();
+        }
+        size_t take = min(maxLen, dump->length - index);
+        memcpy(out, dump->data + index, take);
+        return take;
+      });
+  response->addHeader("Content-Disposition", "attachment; filename=\"profile.pb\"");
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+void initCpuProfile(AsyncWebServer& server) {
+  timerDone = xSemaphoreCreateBinary();
+  server.on(PROFILE_PATH, HTTP_GET, sendProfile);
+  log_i("CPU profiles at %u Hz at %s", PROFILE_HZ, PROFILE_PATH);
+}
+
+#else
+
+void initCpuProfile(AsyncWebServer& server) {
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include "deferred_log.h"
+#include "heap_stats.h"
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_log.h>
+#include <freertos/ringbuf.h>
+
+uint8_t deferredLogLevel = CORE_DEBUG_LEVEL;
+
+static RingbufHandle_t ring = nullptr;
+static std::atomic<uint32_t> lines{0};
+static std::atomic<uint32_t> dropped{0};
+static std::atomic<uint32_t> truncated{0};
+
+static const char* const LEVEL_NAMES[] = {"none", "error", "warn", "info", "debug", "verbose"};
+
+static void queueLine(const char* format, va_list args) {
+  char line[LOG_LINE_MAX];
+  int length = vsnprintf(line, sizeof(line), format, args);
+  if (length < 0) {
+    return;
+  }
+  if ((size_t)length >= sizeof(line)) {
+    // Keep the line break of the cut line
+    line[sizeof(line) - 2] = '\n';
+    length = sizeof(line) - 1;
+    truncated.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (ring == nullptr) {
+    log_printf("%s", line);
+    return;
+  }
+  if (xRingbufferSend(ring, line, length, 0) == pdTRUE) {
+    lines.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+extern "C" void deferredLog(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  queueLine(format, args);
+  va_end(args);
+}
+
+// ESP-IDF's log output, already filtered by its own levels
+static int queueIdfLine(const char* format, va_list args) {
+  queueLine(format, args);
+  return 0;
+}
+
+static void logTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  while (true) {
+    size_t length = 0;
+    char* item = (char*)xRingbufferReceive(ring, &length, portMAX_DELAY);
+    if (item == nullptr) {
+      continue;
+    }
+    Serial.write((const uint8_t*)item, length);
+    vRingbufferReturnItem(ring, item);
+  }
+}
+
+bool initDeferredLog() {
+  ring = xRingbufferCreate(LOG_BUFFER_SIZE, RINGBUF_TYPE_NOSPLIT);
+  if (ring == nullptr) {
+    log_e("Deferred log: out of memory, logging to the port directly");
+    return false;
+  }
+  if (xTaskCreatePinnedToCore(logTask, "log", 3072, nullptr, LOG_TASK_PRIORITY, nullptr, LOG_TASK_CORE) != pdPASS) {
+    RingbufHandle_t unused = ring;
+    ring = nullptr;
+    vRingbufferDelete(unused);
+    log_e("Deferred log: task not started, logging to the port directly");
+    return false;
+  }
+  esp_log_set_vprintf(queueIdfLine);
+  return true;
+}
+
+void getDeferredLogStats(DeferredLogStats& stats) {
+  stats.lines = lines.load(std::memory_order_relaxed);
+  stats.dropped = dropped.load(std::memory_order_relaxed);
+  stats.truncated = truncated.load(std::memory_order_relaxed);
+  stats.pending = 0;
+  if (ring != nullptr) {
+    stats.pending = LOG_BUFFER_SIZE - xRingbufferGetCurFreeSize(ring);
+  }
+}
+
+const char* logLevelName(uint8_t level) {
+  return level < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]) ? LEVEL_NAMES[level] : "verbose";
+}
+
+bool parseLogLevel(const char* name, uint8_t& level) {
+  for (uint8_t i = 0; i <= CORE_DEBUG_LEVEL && i < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]); i++) {
+    if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+      level = i;
+      return true;
+    }
+  }
+  return false;
+}
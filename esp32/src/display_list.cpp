@@ -0,0 +1,194 @@
+#include "display_list.h"
+
+bool DisplayList::begin(TFT_eSPI* tft, int16_t rows) {
+  _tft = tft;
+  clear();
+  return _bands.begin(tft, rows);
+}
+
+void DisplayList::end() {
+  _bands.end();
+  clear();
+}
+
+void DisplayList::clear() {
+  _count = 0;
+  _textUsed = 0;
+  _warned = false;
+}
+
+DisplayList::Command* DisplayList::add(Op op, int16_t x, int16_t y, int16_t w, int16_t h, int16_t top,
+                                       int16_t bottom, uint16_t color) {
+  if (bottom <= top) {
+    return nullptr;
+  }
+  if (_count == DISPLAY_LIST_COMMANDS) {
+    if (!_warned) {
+      log_w("Display list full, %u commands", DISPLAY_LIST_COMMANDS);
+      _warned = true;
+    }
+    return nullptr;
+  }
+  Command& command = _commands[_count++];
+  command = {};
+  command.op = op;
+  command.x = x;
+  command.y = y;
+  command.w = w;
+  command.h = h;
+  command.top = top;
+  command.bottom = bottom;
+  command.color = color;
+  return &command;
+}
+
+void DisplayList::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  add(OP_FILL_RECT, x, y, w, h, y, y + h, color);
+}
+
+void DisplayList::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  add(OP_DRAW_RECT, x, y, w, h, y, y + h, color);
+}
+
+void DisplayList::fillRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t r, uint16_t color) {
+  Command* command = add(OP_FILL_ROUND_RECT, x, y, w, h, y, y + h, color);
+  if (command) {
+    command->arg = r;
+  }
+}
+
+void DisplayList::drawRoundRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t r, uint16_t color) {
+  Command* command = add(OP_DRAW_ROUND_RECT, x, y, w, h, y, y + h, color);
+  if (command) {
+    command->arg = r;
+  }
+}
+
+void DisplayList::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) {
+  add(OP_HLINE, x, y, w, 1, y, y + 1, color);
+}
+
+void DisplayList::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) {
+  add(OP_VLINE, x, y, 1, h, y, y + h, color);
+}
+
+void DisplayList::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+  add(OP_LINE, x0, y0, x1, y1, min(y0, y1), max(y0, y1) + 1, color);
+}
+
+void DisplayList::drawString(const char* text, int16_t x, int16_t y, uint8_t font, uint8_t size, uint16_t color,
+                             uint16_t bg) {
+  size_t length = strlen(text) + 1;
+  if (_textUsed + length > sizeof(_text)) {
+    if (!_warned) {
+      log_w("Display list text full, %u bytes", DISPLAY_LIST_TEXT);
+      _warned = true;
+    }
+    return;
+  }
+  // Rows from the font's height at that size, leaving the panel's text settings alone
+  uint8_t oldSize = _tft->textsize;
+  _tft->textsize = size;
+  int16_t height = _tft->fontHeight(font);
+  _tft->textsize = oldSize;
+
+  Command* command = add(OP_TEXT, x, y, 0, 0, y, y + height, color);
+  if (!command) {
+    return;
+  }
+  command->arg = size;
+  command->font = font;
+  command->bg = bg;
+  command->text = _textUsed;
+  memcpy(_text + _textUsed, text, length);
+  _textUsed += length;
+}
+
+// Commands reaching the band, in recorded order so later ones paint over
+// earlier ones as they would on the panel
+void DisplayList::replay(TFT_eSPI& canvas) {
+  // The canvas origin is minus the band's top row
+  int16_t top = -canvas.getOriginY();
+  int16_t bottom = top + canvas.height();
+  for (size_t i = 0; i < _count; i++) {
+    const Command& c = _commands[i];
+    if (c.bottom <= top || c.top >= bottom) {
+      continue;
+    }
+    switch (c.op) {
+      case OP_FILL_RECT:
+        canvas.fillRect(c.x, c.y, c.w, c.h, c.color);
+        break;
+      case OP_DRAW_RECT:
+        canvas.drawRect(c.x, c.y, c.w, c.h, c.color);
+        break;
+      case OP_FILL_ROUND_RECT:
+        canvas.fillRoundRect(c.x, c.y, c.w, c.h, c.arg, c.color);
+        break;
+      case OP_DRAW_ROUND_RECT:
+        canvas.drawRoundRect(c.x, c.y, c.w, c.h, c.arg, c.color);
+        break;
+      case OP_HLINE:
+        canvas.drawFastHLine(c.x, c.y, c.w, c.color);
+        break;
+      case OP_VLINE:
+        canvas.drawFastVLine(c.x, c.y, c.h, c.color);
+        break;
+      case OP_LINE:
+        canvas.drawLine(c.x, c.y, c.w, c.h, c.color);
+        break;
+      case OP_TEXT:
+        canvas.setTextFont(c.font);
+        canvas.setTextSize(c.arg);
+        canvas.setTextColor(c.color, c.bg);
+        canvas.setTextDatum(TL_DATUM);
+        canvas.drawString(_text + c.text, c.x, c.y);
+        break;
+    }
+  }
+}
+
+void DisplayList::drawBand(TFT_eSPI& canvas, void* context) {
+  ((DisplayList*)context)->replay(canvas);
+}
+
+void DisplayList::flush(uint16_t background) {
+  if (!_bands.ready() || _count == 0) {
+    clear();
+    return;
+  }
+
+  // Rows touched, sorted by their top and merged where they overlap or
+  // meet; rows between runs keep what the panel shows
+  struct Run {
+    int16_t top;
+    int16_t bottom;
+  };
+  Run runs[DISPLAY_LIST_COMMANDS];
+  size_t count = 0;
+  for (size_t i = 0; i < _count; i++) {
+    Run run = {max<int16_t>(_commands[i].top, 0), min<int16_t>(_commands[i].bottom, _tft->height())};
+    if (run.bottom <= run.top) {
+      continue;
+    }
+    size_t at = count++;
+    while (at > 0 && runs[at - 1].top > run.top) {
+      runs[at] = runs[at - 1];
+      at--;
+    }
+    runs[at] = run;
+  }
+  size_t merged = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (merged > 0 && runs[i].top <= runs[merged - 1].bottom) {
+      runs[merged - 1].bottom = max(runs[merged - 1].bottom, runs[i].bottom);
+    } else {
+      runs[merged++] = runs[i];
+    }
+  }
+
+  for (size_t i = 0; i < merged; i++) {
+    _bands.render(drawBand, this, runs[i].top, runs[i].bottom, background);
+  }
+  clear();
+}
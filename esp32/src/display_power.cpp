@@ -0,0 +1,65 @@
+#include "display_power.h"
+
+// MIPI DCS commands, the same on every panel driver TFT_eSPI has
+static const uint8_t CMD_SLPIN = 0x10;
+static const uint8_t CMD_SLPOUT = 0x11;
+static const uint8_t CMD_DISPOFF = 0x28;
+static const uint8_t CMD_DISPON = 0x29;
+// The controller ignores a sleep command within 120 ms of the last one and
+// needs that long after SLPOUT before it shows the frame
+static const uint32_t PANEL_SLEEP_SETTLE_MS = 120;
+
+static const uint32_t LEDC_FREQUENCY = 5000;
+static const uint8_t LEDC_BITS = 8;
+
+static TFT_eSPI* panel = nullptr;
+static volatile DisplayPower power = DISPLAY_POWER_ON;
+static uint32_t lastSleepCommand = 0;
+
+static void settle() {
+  uint32_t elapsed = millis() - lastSleepCommand;
+  if (elapsed < PANEL_SLEEP_SETTLE_MS) {
+    vTaskDelay(pdMS_TO_TICKS(PANEL_SLEEP_SETTLE_MS - elapsed));
+  }
+}
+
+void initDisplayPower(TFT_eSPI* tft, uint8_t backlightPin) {
+  panel = tft;
+  ledcSetup(DISPLAY_LEDC_CHANNEL, LEDC_FREQUENCY, LEDC_BITS);
+  ledcAttachPin(backlightPin, DISPLAY_LEDC_CHANNEL);
+  ledcWrite(DISPLAY_LEDC_CHANNEL, DISPLAY_BRIGHTNESS);
+  power = DISPLAY_POWER_ON;
+  // tft->init() ended with a sleep-out
+  lastSleepCommand = millis();
+}
+
+void setDisplayPower(DisplayPower next) {
+  if (!panel || next == power) {
+    return;
+  }
+
+  if (next == DISPLAY_POWER_SLEEP) {
+    ledcWrite(DISPLAY_LEDC_CHANNEL, 0);
+    settle();
+    panel->writecommand(CMD_DISPOFF);
+    panel->writecommand(CMD_SLPIN);
+    lastSleepCommand = millis();
+    power = next;
+    return;
+  }
+
+  if (power == DISPLAY_POWER_SLEEP) {
+    settle();
+    panel->writecommand(CMD_SLPOUT);
+    lastSleepCommand = millis();
+    // Backlight on only once the panel shows its frame again
+    settle();
+    panel->writecommand(CMD_DISPON);
+  }
+  ledcWrite(DISPLAY_LEDC_CHANNEL, next == DISPLAY_POWER_DIM ? DISPLAY_DIM_BRIGHTNESS : DISPLAY_BRIGHTNESS);
+  power = next;
+}
+
+DisplayPower displayPower() {
+  return power;
+}
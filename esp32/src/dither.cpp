@@ -0,0 +1,62 @@
+#include "dither.h"
+
+#include <esp_heap_caps.h>
+
+bool parseDitherMode(const String& name, DitherMode& mode) {
+  if (name.equalsIgnoreCase("none") || name.equalsIgnoreCase("threshold")) {
+    mode = DITHER_THRESHOLD;
+  } else if (name.equalsIgnoreCase("bayer")) {
+    mode = DITHER_BAYER;
+  } else if (name.equalsIgnoreCase("atkinson")) {
+    mode = DITHER_ATKINSON;
+  } else if (name.equalsIgnoreCase("fs") || name.equalsIgnoreCase("floyd-steinberg")) {
+    mode = DITHER_FLOYD_STEINBERG;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+DitherEngine::~DitherEngine() {
+  end();
+}
+
+bool DitherEngine::begin(DitherMode mode, uint16_t width, uint8_t threshold) {
+  end();
+  _mode = mode;
+  _width = width;
+  _threshold = threshold;
+  _row = 0;
+  if (mode != DITHER_ATKINSON && mode != DITHER_FLOYD_STEINBERG) {
+    return true;
+  }
+
+  // Error rows are read and written once per pixel, so keep them in
+  // internal RAM when there is room
+  size_t bytes = encodeErrorRowBytes(width);
+  _rows.errors = (int16_t*)heap_caps_calloc(1, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  _rows.next = (int16_t*)heap_caps_calloc(1, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (_rows.errors == nullptr || _rows.next == nullptr) {
+    free(_rows.errors);
+    free(_rows.next);
+    _rows.errors = (int16_t*)calloc(1, bytes);
+    _rows.next = (int16_t*)calloc(1, bytes);
+  }
+  if (_rows.errors == nullptr || _rows.next == nullptr) {
+    end();
+    return false;
+  }
+  return true;
+}
+
+void DitherEngine::end() {
+  free(_rows.errors);
+  free(_rows.next);
+  _rows.errors = nullptr;
+  _rows.next = nullptr;
+}
+
+void DitherEngine::row(const uint8_t* gray, uint8_t* packed) {
+  encodeDitherRow((EncodeDither)_mode, gray, _width, _threshold, _row, &_rows, packed);
+  _row++;
+}
@@ -0,0 +1,262 @@
+#include "espnow_trigger.h"
+
+#include <Preferences.h>
+#include <WiFi.h>
+#include <esp_idf_version.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <mbedtls/md.h>
+
+#include "ble_printer.h"
+#include "heap_stats.h"
+#include "job_cache.h"
+#include "label_template.h"
+#include "print_writer.h"
+
+static const uint8_t TRIGGER_VERSION = 1;
+static const size_t TRIGGER_HEADER = 24;
+static const size_t TRIGGER_TAG = 16;
+static const size_t TRIGGER_PRINTER_ID = 16;
+static const size_t TRIGGER_MAX = 250;       // ESP-NOW payload
+
+enum TriggerType : uint8_t {
+  TRIGGER_CACHED = 1,
+  TRIGGER_TEMPLATE = 2,
+  TRIGGER_TEMPLATE_TSPL = 3                  // The same, as TSPL commands
+};
+
+struct Trigger {
+  uint8_t sender[6];
+  uint8_t length;
+  uint8_t data[TRIGGER_MAX];
+};
+
+static const char* const RESULT_NAMES[ESPNOW_RESULTS] = {"printed", "invalid", "auth", "replay", "refused"};
+
+static QueueHandle_t triggers = nullptr;
+static ImageOutput labelOutput = nullptr;
+static uint32_t counts[ESPNOW_RESULTS];
+static portMUX_TYPE countMux = portMUX_INITIALIZER_UNLOCKED;
+
+const char* espNowResultName(EspNowResult result) {
+  return result < ESPNOW_RESULTS ? RESULT_NAMES[result] : "unknown";
+}
+
+bool espNowTriggerEnabled() {
+  return ESPNOW_TRIGGER_KEY[0] != '\0';
+}
+
+uint32_t espNowTriggerCount(EspNowResult result) {
+  return result < ESPNOW_RESULTS ? counts[result] : 0;
+}
+
+static void count(EspNowResult result) {
+  portENTER_CRITICAL(&countMux);
+  counts[result]++;
+  portEXIT_CRITICAL(&countMux);
+}
+
+// Runs in the Wi-Fi task: copy the packet out and leave
+static void queueTrigger(const uint8_t* sender, const uint8_t* data, int length) {
+  if (length <= 0 || length > (int)TRIGGER_MAX) {
+    count(ESPNOW_INVALID);
+    return;
+  }
+  Trigger trigger;
+  memcpy(trigger.sender, sender, sizeof(trigger.sender));
+  trigger.length = length;
+  memcpy(trigger.data, data, length);
+  if (xQueueSend(triggers, &trigger, 0) != pdTRUE) {
+    count(ESPNOW_REFUSED);
+  }
+}
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+static void onReceive(const esp_now_recv_info_t* info, const uint8_t* data, int length) {
+  queueTrigger(info->src_addr, data, length);
+}
+#else
+static void onReceive(const uint8_t* sender, const uint8_t* data, int length) {
+  queueTrigger(sender, data, length);
+}
+#endif
+
+static bool tagValid(const Trigger& trigger) {
+  uint8_t tag[32];
+  size_t signedLength = trigger.length - TRIGGER_TAG;
+  if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t*)ESPNOW_TRIGGER_KEY,
+                      strlen(ESPNOW_TRIGGER_KEY), trigger.data, signedLength, tag) != 0) {
+    return false;
+  }
+  // Every byte compared, so the time says nothing about where it differs
+  uint8_t difference = 0;
+  for (size_t i = 0; i < TRIGGER_TAG; i++) {
+    difference |= tag[i] ^ trigger.data[signedLength + i];
+  }
+  return difference == 0;
+}
+
+// Take the counter when it is above the sender's last, and keep it
+static bool counterFresh(const Trigger& trigger, uint32_t counter) {
+  char key[13];
+  snprintf(key, sizeof(key), "%02x%02x%02x%02x%02x%02x", trigger.sender[0], trigger.sender[1], trigger.sender[2],
+           trigger.sender[3], trigger.sender[4], trigger.sender[5]);
+  Preferences prefs;
+  if (!prefs.begin("espnow", false)) {
+    return false;
+  }
+  bool fresh = !prefs.isKey(key) || counter > prefs.getUInt(key);
+  if (fresh) {
+    prefs.putUInt(key, counter);
+  }
+  prefs.end();
+  return fresh;
+}
+
+static EspNowResult printCached(BlePrinter& printer, const uint8_t* digest, size_t length) {
+  if (length != 32) {
+    return ESPNOW_INVALID;
+  }
+  char hex[JOB_HASH_LENGTH + 1];
+  for (size_t i = 0; i < 32; i++) {
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  }
+  String hash(hex);
+  size_t jobLength = 0;
+  if (!jobCacheLookup(hash, jobLength)) {
+    log_w("ESP-NOW: job %.12s not cached", hex);
+    return ESPNOW_REFUSED;
+  }
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t jobId = createPrintJob(printer.index(), jobLength, reject);
+  if (jobId == 0) {
+    log_w("ESP-NOW: job refused (%d)", reject);
+    return ESPNOW_REFUSED;
+  }
+  if (!replayCachedJob(hash, jobId)) {
+    abortPrintJob(jobId);
+    log_w("ESP-NOW: job cache busy");
+    return ESPNOW_REFUSED;
+  }
+  log_i("ESP-NOW: reprinting %.12s as job %u on %s", hex, jobId, printer.id().c_str());
+  return ESPNOW_PRINTED;
+}
+
+static EspNowResult printTemplate(BlePrinter& printer, const uint8_t* payload, size_t length, bool tspl) {
+  const uint8_t* end = (const uint8_t*)memchr(payload, '\0', length);
+  if (end == nullptr || end == payload) {
+    return ESPNOW_INVALID;
+  }
+  String name((const char*)payload);
+  const char* json = (const char*)end + 1;
+  size_t jsonLength = length - (end + 1 - payload);
+  if (jsonLength == 0) {
+    json = "{}";
+    jsonLength = 2;
+  }
+
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t jobId = createPrintJob(printer.index(), PRINT_JOB_LENGTH_UNKNOWN, reject);
+  if (jobId == 0) {
+    log_w("ESP-NOW: job refused (%d)", reject);
+    return ESPNOW_REFUSED;
+  }
+  ImageRasterOptions options;
+  if (tspl) {
+    options.commands = IMAGE_TSPL;
+  }
+  LabelPrinter target = {printer.index(), printer.mac(), false};
+  String detail;
+  LabelResult result = printLabelTemplate(name, json, jsonLength, options, &target, labelOutput, &jobId, detail);
+  if (result != LABEL_OK) {
+    abortPrintJob(jobId);
+    log_w("ESP-NOW: template %s: %s %s", name.c_str(), labelResultName(result), detail.c_str());
+    return result == LABEL_NOT_FOUND || result == LABEL_NO_MEMORY || result == LABEL_OUTPUT ? ESPNOW_REFUSED
+                                                                                             : ESPNOW_INVALID;
+  }
+  finishPrintJob(jobId);
+  log_i("ESP-NOW: template %s as job %u on %s", name.c_str(), jobId, printer.id().c_str());
+  return ESPNOW_PRINTED;
+}
+
+static EspNowResult runTrigger(const Trigger& trigger) {
+  const uint8_t* data = trigger.data;
+  if (trigger.length < TRIGGER_HEADER + TRIGGER_TAG || data[0] != 'L' || data[1] != 'B' ||
+      data[2] != TRIGGER_VERSION) {
+    return ESPNOW_INVALID;
+  }
+  if (!tagValid(trigger)) {
+    log_w("ESP-NOW: trigger from %02x:%02x:%02x:%02x:%02x:%02x with a wrong tag", trigger.sender[0],
+          trigger.sender[1], trigger.sender[2], trigger.sender[3], trigger.sender[4], trigger.sender[5]);
+    return ESPNOW_AUTH;
+  }
+  uint32_t counter = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+  if (!counterFresh(trigger, counter)) {
+    return ESPNOW_REPLAY;
+  }
+
+  char printerId[TRIGGER_PRINTER_ID + 1];
+  memcpy(printerId, data + 8, TRIGGER_PRINTER_ID);
+  printerId[TRIGGER_PRINTER_ID] = '\0';
+  BlePrinter* printer = findPrinter(printerId);
+  if (printer == nullptr) {
+    log_w("ESP-NOW: unknown printer '%s'", printerId);
+    return ESPNOW_REFUSED;
+  }
+  if (!printer->connected()) {
+    printer->requestJobConnect();
+    log_w("ESP-NOW: printer %s not connected", printer->id().c_str());
+    return ESPNOW_REFUSED;
+  }
+
+  const uint8_t* payload = data + TRIGGER_HEADER;
+  size_t payloadLength = trigger.length - TRIGGER_HEADER - TRIGGER_TAG;
+  switch (data[3]) {
+    case TRIGGER_CACHED:
+      return printCached(*printer, payload, payloadLength);
+    case TRIGGER_TEMPLATE:
+    case TRIGGER_TEMPLATE_TSPL:
+      return printTemplate(*printer, payload, payloadLength, data[3] == TRIGGER_TEMPLATE_TSPL);
+  }
+  return ESPNOW_INVALID;
+}
+
+static void triggerTask(void* param) {
+  (void)param;
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  Trigger trigger;
+  for (;;) {
+    if (xQueueReceive(triggers, &trigger, portMAX_DELAY) == pdTRUE) {
+      count(runTrigger(trigger));
+    }
+  }
+}
+
+void initEspNowTrigger(ImageOutput output) {
+  if (!espNowTriggerEnabled()) {
+    return;
+  }
+  labelOutput = output;
+  // Ethernet alone leaves the station off; ESP-NOW needs the radio up
+  if (WiFi.getMode() == WIFI_OFF) {
+    WiFi.mode(WIFI_STA);
+    esp_wifi_set_channel(ESPNOW_TRIGGER_CHANNEL, WIFI_SECOND_CHAN_NONE);
+  }
+
+  triggers = xQueueCreate(ESPNOW_TRIGGER_QUEUE, sizeof(Trigger));
+  if (triggers == nullptr || esp_now_init() != ESP_OK || esp_now_register_recv_cb(onReceive) != ESP_OK) {
+    log_e("ESP-NOW triggers not started");
+    return;
+  }
+  // Templates render on this task, as deep as a web request's
+  if (xTaskCreatePinnedToCore(triggerTask, "espNow", 8192, nullptr, ESPNOW_TRIGGER_PRIORITY, nullptr,
+                              ESPNOW_TRIGGER_CORE) != pdPASS) {
+    log_e("Failed to start ESP-NOW trigger task");
+    esp_now_deinit();
+    return;
+  }
+  uint8_t channel = 0;
+  wifi_second_chan_t second;
+  esp_wifi_get_channel(&channel, &second);
+  log_i("ESP-NOW triggers on channel %u", channel);
+}
@@ -0,0 +1,148 @@
+#include "eth_link.h"
+
+#include <WiFi.h>
+#include <esp_idf_version.h>
+
+#if ETH_LINK == ETH_LINK_W5500
+#include <driver/gpio.h>
+#include <driver/spi_master.h>
+#include <esp_eth.h>
+#include <esp_mac.h>
+#include <esp_netif.h>
+
+#ifndef ETH_W5500_SPI_HOST
+#define ETH_W5500_SPI_HOST SPI3_HOST    // Arduino's SPI object keeps the other one
+#endif
+
+// Brings up the Arduino event task and esp_netif, as WiFi.mode() and
+// ETH.begin() do; the W5500 is driven below them
+bool tcpipInit();
+#elif ETH_LINK == ETH_LINK_RMII
+#include <ETH.h>
+#if !CONFIG_ETH_USE_ESP32_EMAC
+#error "ETH_LINK_RMII needs the EMAC of the original ESP32; use ETH_LINK_W5500"
+#endif
+#endif
+
+static volatile bool ethUp = false;
+static IPAddress ethAddress;
+
+// Runs in the Arduino event task
+static void onEthEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  switch (event) {
+    case ARDUINO_EVENT_ETH_CONNECTED:
+      log_i("Ethernet link up");
+      break;
+    case ARDUINO_EVENT_ETH_GOT_IP:
+      ethAddress = IPAddress(info.got_ip.ip_info.ip.addr);
+      ethUp = true;
+      log_i("✅ Ethernet connected, IP %s", ethAddress.toString().c_str());
+      break;
+    case ARDUINO_EVENT_ETH_DISCONNECTED:
+    case ARDUINO_EVENT_ETH_STOP:
+      if (ethUp) {
+        log_w("Ethernet lost");
+      }
+      ethUp = false;
+      break;
+    default:
+      break;
+  }
+}
+
+#if ETH_LINK == ETH_LINK_W5500
+static bool startW5500() {
+  tcpipInit();
+
+  spi_bus_config_t bus = {};
+  bus.mosi_io_num = ETH_W5500_MOSI;
+  bus.miso_io_num = ETH_W5500_MISO;
+  bus.sclk_io_num = ETH_W5500_SCK;
+  bus.quadwp_io_num = -1;
+  bus.quadhd_io_num = -1;
+  if (spi_bus_initialize(ETH_W5500_SPI_HOST, &bus, SPI_DMA_CH_AUTO) != ESP_OK) {
+    log_e("Ethernet: SPI bus busy");
+    return false;
+  }
+  // Already installed by attachInterrupt() users is fine
+  gpio_install_isr_service(0);
+
+  spi_device_interface_config_t device = {};
+  device.command_bits = 16;           // W5500 frame: 16 address bits, 8 control bits
+  device.address_bits = 8;
+  device.mode = 0;
+  device.clock_speed_hz = ETH_W5500_MHZ * 1000 * 1000;
+  device.spics_io_num = ETH_W5500_CS;
+  device.queue_size = 20;
+#if ESP_IDF_VERSION_MAJOR >= 5
+  eth_w5500_config_t w5500 = ETH_W5500_DEFAULT_CONFIG(ETH_W5500_SPI_HOST, &device);
+#else
+  spi_device_handle_t spi = nullptr;
+  if (spi_bus_add_device(ETH_W5500_SPI_HOST, &device, &spi) != ESP_OK) {
+    log_e("Ethernet: no SPI device for the W5500");
+    return false;
+  }
+  eth_w5500_config_t w5500 = ETH_W5500_DEFAULT_CONFIG(spi);
+#endif
+  w5500.int_gpio_num = ETH_W5500_INT;
+
+  eth_mac_config_t macConfig = ETH_MAC_DEFAULT_CONFIG();
+  eth_phy_config_t phyConfig = ETH_PHY_DEFAULT_CONFIG();
+  phyConfig.reset_gpio_num = ETH_W5500_RST;
+  esp_eth_mac_t* mac = esp_eth_mac_new_w5500(&w5500, &macConfig);
+  esp_eth_phy_t* phy = esp_eth_phy_new_w5500(&phyConfig);
+  esp_eth_handle_t handle = nullptr;
+  esp_eth_config_t config = ETH_DEFAULT_CONFIG(mac, phy);
+  if (mac == nullptr || phy == nullptr || esp_eth_driver_install(&config, &handle) != ESP_OK) {
+    log_e("❌ Ethernet: W5500 not answering");
+    return false;
+  }
+
+  // The W5500 has no address of its own; it gets the chip's Ethernet MAC
+  uint8_t address[6];
+  esp_read_mac(address, ESP_MAC_ETH);
+  esp_eth_ioctl(handle, ETH_CMD_S_MAC_ADDR, address);
+
+  esp_netif_config_t netifConfig = ESP_NETIF_DEFAULT_ETH();
+  esp_netif_t* netif = esp_netif_new(&netifConfig);
+  if (netif == nullptr || esp_netif_attach(netif, esp_eth_new_netif_glue(handle)) != ESP_OK) {
+    log_e("Ethernet: no network interface");
+    return false;
+  }
+  return esp_eth_start(handle) == ESP_OK;
+}
+#endif
+
+bool initEthLink() {
+#if ETH_LINK == ETH_LINK_NONE
+  return false;
+#else
+  WiFi.onEvent(onEthEvent);
+#if ETH_LINK == ETH_LINK_W5500
+  bool started = startW5500();
+#else
+  // PHY type, address, MDC/MDIO, power pin and clock from the ETH_PHY_* flags
+  bool started = ETH.begin();
+#endif
+  if (started) {
+    log_i("Ethernet started, waiting for DHCP");
+  } else {
+    log_e("❌ Ethernet failed to start");
+  }
+  return started;
+#endif
+}
+
+bool ethLinkUp() {
+  return ethUp;
+}
+
+IPAddress networkAddress() {
+  if (ethUp) {
+    return ethAddress;
+  }
+  if (WiFi.status() == WL_CONNECTED) {
+    return WiFi.localIP();
+  }
+  return IPAddress();
+}
@@ -0,0 +1,142 @@
+#include "event_stream.h"
+#include "ble_printer.h"
+#include "print_writer.h"
+#include "batch_print.h"
+
+static AsyncEventSource events(EVENTS_PATH);
+
+// What the subscribers were last told
+static bool printerConnected[MAX_PRINTERS];
+static BleLinkState printerLink[MAX_PRINTERS];
+static uint32_t printerBytes[MAX_PRINTERS];
+static PrintJobInfo trackedJobs[PRINT_JOB_SLOTS];
+static size_t trackedCount = 0;
+static uint32_t lastProgress = 0;
+static uint32_t lastSample = 0;
+
+static void printerJSON(char* out, size_t size, const BlePrinter& printer) {
+  snprintf(out, size, "{\"id\":\"%s\",\"status\":\"%s\",\"link\":\"%s\"}", printer.id().c_str(),
+           printer.connected() ? "connected" : "disconnected", linkStateName(printer.linkState()));
+}
+
+static void sendJob(const PrintJobInfo& info) {
+  BlePrinter* printer = getPrinter(info.printer);
+  char json[160];
+  snprintf(json, sizeof(json), "{\"id\":%u,\"printer\":\"%s\",\"status\":\"%s\",\"total\":%u,\"received\":%u,\"sent\":%u}",
+           info.id, printer != nullptr ? printer->id().c_str() : "", printJobStateName(info.state), (unsigned)info.total,
+           (unsigned)info.received, (unsigned)info.sent);
+  events.send(json, "job");
+}
+
+static void sendLabel(uint32_t jobId, uint16_t label, bool done) {
+  if (events.count() == 0) {
+    return;
+  }
+  char json[80];
+  snprintf(json, sizeof(json), "{\"job\":%u,\"label\":%u,\"status\":\"%s\"}", jobId, label,
+           done ? "done" : "failed");
+  events.send(json, "label");
+}
+
+static const PrintJobInfo* findTracked(uint32_t id) {
+  for (size_t i = 0; i < trackedCount; i++) {
+    if (trackedJobs[i].id == id) {
+      return &trackedJobs[i];
+    }
+  }
+  return nullptr;
+}
+
+void initEventStream(AsyncWebServer& server) {
+  // A new subscriber starts from the current state of every printer
+  events.onConnect([](AsyncEventSourceClient* client) {
+    char json[128];
+    for (size_t i = 0; i < printerCount(); i++) {
+      printerJSON(json, sizeof(json), *getPrinter(i));
+      client->send(json, "printer");
+    }
+  });
+  server.addHandler(&events);
+}
+
+static void servicePrinters(bool listening) {
+  char json[128];
+  for (size_t i = 0; i < printerCount() && i < MAX_PRINTERS; i++) {
+    const BlePrinter& printer = *getPrinter(i);
+    if (printer.connected() == printerConnected[i] && printer.linkState() == printerLink[i]) {
+      continue;
+    }
+    printerConnected[i] = printer.connected();
+    printerLink[i] = printer.linkState();
+    if (listening) {
+      printerJSON(json, sizeof(json), printer);
+      events.send(json, "printer");
+    }
+  }
+}
+
+static void serviceJobs() {
+  PrintJobInfo pending[PRINT_JOB_SLOTS];
+  size_t count = getPendingPrintJobs(pending, PRINT_JOB_SLOTS);
+
+  for (size_t i = 0; i < count; i++) {
+    const PrintJobInfo* last = findTracked(pending[i].id);
+    if (last == nullptr || last->state != pending[i].state || last->received != pending[i].received ||
+        last->sent != pending[i].sent) {
+      sendJob(pending[i]);
+    }
+  }
+
+  // Jobs that left the queue get one last event with how they ended
+  for (size_t i = 0; i < trackedCount; i++) {
+    bool stillPending = false;
+    for (size_t j = 0; j < count && !stillPending; j++) {
+      stillPending = pending[j].id == trackedJobs[i].id;
+    }
+    PrintJobInfo info;
+    if (!stillPending && getPrintJob(trackedJobs[i].id, info)) {
+      sendJob(info);
+    }
+  }
+
+  memcpy(trackedJobs, pending, count * sizeof(PrintJobInfo));
+  trackedCount = count;
+}
+
+static void serviceThroughput() {
+  char json[160];
+  for (size_t i = 0; i < printerCount() && i < MAX_PRINTERS; i++) {
+    const BlePrinter& printer = *getPrinter(i);
+    uint32_t bytes = printer.metrics().bytes();
+    uint32_t rate = printer.metrics().rate(10);
+    // Idle printers stay quiet once their rate has dropped to 0
+    if (bytes == printerBytes[i] && rate == 0) {
+      continue;
+    }
+    printerBytes[i] = bytes;
+    snprintf(json, sizeof(json), "{\"printer\":\"%s\",\"bytes\":%u,\"rate10s\":%u,\"throughput\":%u}",
+             printer.id().c_str(), bytes, rate, printer.throughput());
+    events.send(json, "throughput");
+  }
+}
+
+void serviceEventStream() {
+  bool listening = events.count() > 0;
+  servicePrinters(listening);
+  // Batches are let go of once their job ends, listened to or not
+  servicePrintBatches(sendLabel);
+  if (!listening) {
+    trackedCount = 0;
+    return;
+  }
+
+  uint32_t now = millis();
+  if (now - lastProgress >= EVENTS_PROGRESS_MS) {
+    lastProgress = now;
+    serviceJobs();
+  }
+  if (now - lastSample >= EVENTS_SAMPLE_MS) {
+    lastSample = now;
+    serviceThroughput();
+  }
+}
@@ -0,0 +1,141 @@
+#include "firmware_update.h"
+
+#include <Update.h>
+#include <mbedtls/sha256.h>
+
+// Hex digits of a SHA-256
+static const size_t DIGEST_HEX_LENGTH = 64;
+// Lets the upload's HTTP answer reach the client before the restart
+static const uint32_t RESTART_DELAY_MS = 1000;
+
+// Only the HTTP task of the upload touches these
+static bool running = false;
+static mbedtls_sha256_context sha;
+static char expected[DIGEST_HEX_LENGTH + 1];
+static size_t written = 0;
+static size_t expectedSize = 0;
+static uint32_t session = 0;
+
+static volatile bool restartPending = false;
+static volatile uint32_t restartAt = 0;
+
+static void abortRunning() {
+  Update.abort();
+  mbedtls_sha256_free(&sha);
+  running = false;
+  log_w("Update aborted after %u bytes", written);
+}
+
+FirmwareUpdateError beginFirmwareUpdate(FirmwareTarget target, size_t size, const char* sha256Hex) {
+  if (running || restartPending) {
+    return UPDATE_ERR_BUSY;
+  }
+  if (strlen(sha256Hex) != DIGEST_HEX_LENGTH) {
+    return UPDATE_ERR_DIGEST;
+  }
+  for (size_t i = 0; i < DIGEST_HEX_LENGTH; i++) {
+    if (!isxdigit(sha256Hex[i])) {
+      return UPDATE_ERR_DIGEST;
+    }
+  }
+  if (!Update.begin(size, target == UPDATE_FILESYSTEM ? U_SPIFFS : U_FLASH)) {
+    log_e("Update of %u bytes refused: %s", size, Update.errorString());
+    return UPDATE_ERR_BEGIN;
+  }
+
+  memcpy(expected, sha256Hex, sizeof(expected));
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  written = 0;
+  expectedSize = size;
+  session++;
+  running = true;
+  log_i("%s update started, %u bytes", target == UPDATE_FILESYSTEM ? "Filesystem" : "Firmware", size);
+  return UPDATE_OK;
+}
+
+FirmwareUpdateError writeFirmwareUpdate(const uint8_t* data, size_t length) {
+  if (!running) {
+    return UPDATE_ERR_WRITE;
+  }
+  mbedtls_sha256_update(&sha, data, length);
+  if (Update.write((uint8_t*)data, length) != length) {
+    log_e("Update write failed at %u: %s", written, Update.errorString());
+    abortRunning();
+    return UPDATE_ERR_WRITE;
+  }
+  written += length;
+  return UPDATE_OK;
+}
+
+FirmwareUpdateError endFirmwareUpdate() {
+  if (!running) {
+    return UPDATE_ERR_INCOMPLETE;
+  }
+  if (written != expectedSize) {
+    abortRunning();
+    return UPDATE_ERR_INCOMPLETE;
+  }
+
+  uint8_t digest[32];
+  mbedtls_sha256_finish(&sha, digest);
+  char hex[DIGEST_HEX_LENGTH + 1];
+  for (size_t i = 0; i < sizeof(digest); i++) {
+    snprintf(hex + i * 2, 3, "%02x", digest[i]);
+  }
+  if (strcasecmp(hex, expected) != 0) {
+    log_e("Update hashes to %.12s, expected %.12s", hex, expected);
+    abortRunning();
+    return UPDATE_ERR_MISMATCH;
+  }
+
+  mbedtls_sha256_free(&sha);
+  running = false;
+  // Marks the new slot bootable; the running image stays until the restart
+  if (!Update.end()) {
+    log_e("Update not accepted: %s", Update.errorString());
+    return UPDATE_ERR_WRITE;
+  }
+  restartAt = millis() + RESTART_DELAY_MS;
+  restartPending = true;
+  log_i("Update verified, restarting once idle");
+  return UPDATE_OK;
+}
+
+void abortFirmwareUpdate(uint32_t abortSession) {
+  if (running && abortSession == session) {
+    abortRunning();
+  }
+}
+
+uint32_t firmwareUpdateSession() {
+  return session;
+}
+
+size_t firmwareUpdateProgress() {
+  return running ? written : 0;
+}
+
+bool firmwareRestartPending() {
+  return restartPending;
+}
+
+void serviceFirmwareUpdate(bool idle) {
+  if (restartPending && idle && (int32_t)(millis() - restartAt) >= 0) {
+    log_i("Restarting into the update");
+    ESP.restart();
+  }
+}
+
+const char* firmwareUpdateErrorText(FirmwareUpdateError error) {
+  switch (error) {
+    case UPDATE_OK: return "ok";
+    case UPDATE_ERR_BUSY: return "Another update is in progress";
+    case UPDATE_ERR_DIGEST: return "X-Update-SHA256 must be 64 hex digits";
+    case UPDATE_ERR_BEGIN: return "Image doesn't fit the partition";
+    case UPDATE_ERR_WRITE: return "Flash write failed";
+    case UPDATE_ERR_MISMATCH: return "Image doesn't match X-Update-SHA256";
+    case UPDATE_ERR_INCOMPLETE: return "Upload ended early";
+  }
+  return "unknown";
+}
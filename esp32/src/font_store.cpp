@@ -0,0 +1,179 @@
+#include "font_store.h"
+
+#include <LittleFS.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+
+// The first sector is a directory, written slot by slot into erased flash;
+// the copies follow it, each on a word boundary. The entry for a copy is
+// written after the copy, and a later entry for a path replaces earlier ones.
+static const uint32_t DIRECTORY_SIZE = 4096;
+static const uint32_t SECTOR_SIZE = 4096;
+static const uint32_t ENTRY_MAGIC = 0x544E4F46;  // "FONT"
+static const size_t COPY_CHUNK = 1024;
+
+struct FontEntry {
+  uint32_t magic;
+  uint32_t offset;
+  uint32_t size;
+  uint32_t crc;
+  char path[48];
+};
+
+static const size_t SLOTS = DIRECTORY_SIZE / sizeof(FontEntry);
+
+static bool opened = false;
+static const esp_partition_t* partition = nullptr;
+static const uint8_t* mapped = nullptr;
+static esp_partition_mmap_handle_t mapHandle;
+static size_t usedSlots = 0;
+static uint32_t dataEnd = DIRECTORY_SIZE;
+static bool checked[SLOTS];               // Matched against LittleFS this boot
+static uint8_t copyBuffer[COPY_CHUNK];
+
+static const FontEntry* entry(size_t slot) {
+  return (const FontEntry*)(mapped + slot * sizeof(FontEntry));
+}
+
+static bool openPartition() {
+  if (opened) {
+    return mapped != nullptr;
+  }
+  opened = true;
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, FONT_PARTITION_LABEL);
+  if (partition == nullptr) {
+    log_i("No %s partition, smooth fonts load from LittleFS", FONT_PARTITION_LABEL);
+    return false;
+  }
+  const void* address = nullptr;
+  if (esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &address, &mapHandle) != ESP_OK) {
+    log_e("Font partition can't be mapped");
+    return false;
+  }
+  mapped = (const uint8_t*)address;
+
+  // Entries up to the first slot that isn't one; anything else there is
+  // erased on the first copy
+  while (usedSlots < SLOTS && entry(usedSlots)->magic == ENTRY_MAGIC) {
+    const FontEntry* e = entry(usedSlots++);
+    dataEnd = max<uint32_t>(dataEnd, (e->offset + e->size + 3) & ~3u);
+  }
+  log_i("Font partition: %u copies, %u of %u bytes", usedSlots, dataEnd, partition->size);
+  return true;
+}
+
+static bool erased(uint32_t offset, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (mapped[offset + i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Erase the start of the partition, directory included
+static bool eraseFront(uint32_t length) {
+  length = min<uint32_t>((length + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1), partition->size);
+  log_i("Erasing font partition, %u bytes", length);
+  if (esp_partition_erase_range(partition, 0, length) != ESP_OK) {
+    log_e("Font partition erase failed");
+    return false;
+  }
+  usedSlots = 0;
+  dataEnd = DIRECTORY_SIZE;
+  memset(checked, 0, sizeof(checked));
+  return true;
+}
+
+// CRC of the first size bytes of a file
+static bool fileCrc(File& file, size_t size, uint32_t& crc) {
+  crc = 0;
+  size_t done = 0;
+  while (done < size) {
+    size_t chunk = min(size - done, COPY_CHUNK);
+    if (file.read(copyBuffer, chunk) != chunk) {
+      return false;
+    }
+    crc = esp_rom_crc32_le(crc, copyBuffer, chunk);
+    done += chunk;
+  }
+  return true;
+}
+
+static const uint8_t* copyFont(File& file, const String& path, size_t size) {
+  if (size > partition->size - DIRECTORY_SIZE) {
+    log_w("Font %s doesn't fit the font partition", path.c_str());
+    return nullptr;
+  }
+  // Out of slots or room: start over where the copies were
+  if (usedSlots == SLOTS || dataEnd + size > partition->size) {
+    if (!eraseFront(dataEnd)) {
+      return nullptr;
+    }
+  }
+  // Flash left over from an interrupted copy or from before the partition
+  // existed
+  if (!erased(dataEnd, size) || !erased(usedSlots * sizeof(FontEntry), sizeof(FontEntry))) {
+    if (!eraseFront(partition->size)) {
+      return nullptr;
+    }
+  }
+
+  FontEntry e = {};
+  e.magic = ENTRY_MAGIC;
+  e.offset = dataEnd;
+  e.size = size;
+  strlcpy(e.path, path.c_str(), sizeof(e.path));
+
+  file.seek(0);
+  size_t done = 0;
+  while (done < size) {
+    size_t chunk = min(size - done, COPY_CHUNK);
+    if (file.read(copyBuffer, chunk) != chunk ||
+        esp_partition_write(partition, e.offset + done, copyBuffer, chunk) != ESP_OK) {
+      log_e("Copying font %s failed at %u", path.c_str(), done);
+      return nullptr;
+    }
+    e.crc = esp_rom_crc32_le(e.crc, copyBuffer, chunk);
+    done += chunk;
+  }
+  if (esp_partition_write(partition, usedSlots * sizeof(FontEntry), &e, sizeof(e)) != ESP_OK) {
+    return nullptr;
+  }
+  checked[usedSlots++] = true;
+  dataEnd = (e.offset + size + 3) & ~3u;
+  log_i("Font %s copied to flash, %u bytes", path.c_str(), size);
+  return mapped + e.offset;
+}
+
+const uint8_t* mappedFont(const String& path) {
+  if (path.length() >= sizeof(FontEntry::path) || !openPartition()) {
+    return nullptr;
+  }
+
+  // The latest copy of the path
+  size_t slot = SLOTS;
+  for (size_t i = usedSlots; i-- > 0; ) {
+    if (strcmp(entry(i)->path, path.c_str()) == 0) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < SLOTS && checked[slot]) {
+    return mapped + entry(slot)->offset;
+  }
+
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return nullptr;
+  }
+  size_t size = file.size();
+  if (slot < SLOTS && entry(slot)->size == size) {
+    uint32_t crc;
+    if (fileCrc(file, size, crc) && crc == entry(slot)->crc) {
+      checked[slot] = true;
+      return mapped + entry(slot)->offset;
+    }
+  }
+  return copyFont(file, path, size);
+}
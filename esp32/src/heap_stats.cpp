@@ -0,0 +1,245 @@
+#include "heap_stats.h"
+
+#include <esp_heap_caps.h>
+
+struct SiteBudget {
+  const char* name;
+  size_t quota;
+  HeapRegion region;
+};
+
+// Job memory is bulky and streamed through once, which PSRAM keeps up
+// with; a PDF upload never fits internal RAM and must not starve it trying
+static const SiteBudget SITES[HEAP_SITES] = {
+  {"inflate", HEAP_BUDGET_INFLATE, HEAP_PSRAM_FIRST},
+  {"image", HEAP_BUDGET_IMAGE, HEAP_PSRAM_FIRST},
+  {"template", HEAP_BUDGET_TEMPLATE, HEAP_PSRAM_FIRST},
+  {"batch", HEAP_BUDGET_BATCH, HEAP_PSRAM_FIRST},
+  {"preview", HEAP_BUDGET_PREVIEW, HEAP_PSRAM_FIRST},
+  {"trace", HEAP_BUDGET_TRACE, HEAP_PSRAM_FIRST},
+  {"zpl", HEAP_BUDGET_ZPL, HEAP_PSRAM_FIRST},
+  {"pdf", HEAP_BUDGET_PDF, HEAP_PSRAM_ONLY},
+  {"jobs", HEAP_BUDGET_JOBS, HEAP_PSRAM_FIRST},
+  {"spool", HEAP_BUDGET_SPOOL, HEAP_PSRAM_ONLY},
+};
+
+static const char* const REGION_NAMES[] = {"psram_first", "internal_first", "psram_only", "internal_only"};
+
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t tasks[HEAP_STAT_TASKS];
+static size_t taskCount = 0;
+
+#if HEAP_TRACK_ALLOC
+// Keeps the block 8-byte aligned
+struct AllocHeader {
+  uint32_t size;
+  uint32_t site;
+};
+
+static size_t siteBytes[HEAP_SITES];
+static size_t sitePeak[HEAP_SITES];
+static uint32_t siteRefused[HEAP_SITES];
+#endif
+
+#if HEAP_TRACK_ALLOC
+// Internal RAM only while the radios keep their reserve
+static void* allocInternal(size_t size) {
+  if (heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) < size + HEAP_INTERNAL_RESERVE) {
+    return nullptr;
+  }
+  return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+static void* allocIn(HeapRegion region, size_t size) {
+  void* p = nullptr;
+  switch (region) {
+    case HEAP_PSRAM_FIRST:
+      p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      return p != nullptr ? p : allocInternal(size);
+    case HEAP_INTERNAL_FIRST:
+      p = allocInternal(size);
+      return p != nullptr ? p : heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    case HEAP_PSRAM_ONLY:
+      return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    case HEAP_INTERNAL_ONLY:
+      return allocInternal(size);
+  }
+  return nullptr;
+}
+
+// Book size against the site's quota; counts a refusal when it won't fit
+static bool book(HeapSite site, size_t size) {
+  portENTER_CRITICAL(&statsMux);
+  const size_t quota = SITES[site].quota;
+  bool fits = quota == 0 || siteBytes[site] + size <= quota;
+  if (fits) {
+    siteBytes[site] += size;
+    if (siteBytes[site] > sitePeak[site]) {
+      sitePeak[site] = siteBytes[site];
+    }
+  } else {
+    siteRefused[site]++;
+  }
+  portEXIT_CRITICAL(&statsMux);
+  return fits;
+}
+
+static void unbook(HeapSite site, size_t size) {
+  portENTER_CRITICAL(&statsMux);
+  siteBytes[site] -= size <= siteBytes[site] ? size : siteBytes[site];
+  portEXIT_CRITICAL(&statsMux);
+}
+#else
+static void* allocPreferPsram(size_t size) {
+  void* p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  return (p != nullptr) ? p : malloc(size);
+}
+#endif
+
+void* heapAlloc(HeapSite site, size_t size) {
+#if HEAP_TRACK_ALLOC
+  if (!book(site, size)) {
+    log_w("%s buffer of %u bytes refused, %u of %u held", SITES[site].name, (unsigned)size,
+          (unsigned)siteBytes[site], (unsigned)SITES[site].quota);
+    return nullptr;
+  }
+  AllocHeader* header = (AllocHeader*)allocIn(SITES[site].region, sizeof(AllocHeader) + size);
+  if (header == nullptr) {
+    unbook(site, size);
+    portENTER_CRITICAL(&statsMux);
+    siteRefused[site]++;
+    portEXIT_CRITICAL(&statsMux);
+    log_w("%s buffer of %u bytes refused, no room in %s", SITES[site].name, (unsigned)size,
+          heapRegionName(SITES[site].region));
+    return nullptr;
+  }
+  header->size = size;
+  header->site = site;
+  return header + 1;
+#else
+  return allocPreferPsram(size);
+#endif
+}
+
+void heapFree(void* p) {
+  if (p == nullptr) {
+    return;
+  }
+#if HEAP_TRACK_ALLOC
+  AllocHeader* header = (AllocHeader*)p - 1;
+  unbook((HeapSite)header->site, header->size);
+  free(header);
+#else
+  free(p);
+#endif
+}
+
+bool heapReserve(HeapSite site, size_t size) {
+#if HEAP_TRACK_ALLOC
+  if (!book(site, size)) {
+    log_w("%s reservation of %u bytes refused, %u of %u held", SITES[site].name, (unsigned)size,
+          (unsigned)siteBytes[site], (unsigned)SITES[site].quota);
+    return false;
+  }
+#else
+  (void)site;
+  (void)size;
+#endif
+  return true;
+}
+
+void heapRelease(HeapSite site, size_t size) {
+#if HEAP_TRACK_ALLOC
+  unbook(site, size);
+#else
+  (void)site;
+  (void)size;
+#endif
+}
+
+size_t heapSiteBytes(HeapSite site) {
+#if HEAP_TRACK_ALLOC
+  return siteBytes[site];
+#else
+  return 0;
+#endif
+}
+
+size_t heapSitePeak(HeapSite site) {
+#if HEAP_TRACK_ALLOC
+  return sitePeak[site];
+#else
+  return 0;
+#endif
+}
+
+size_t heapSiteQuota(HeapSite site) {
+  return site < HEAP_SITES ? SITES[site].quota : 0;
+}
+
+uint32_t heapSiteRefused(HeapSite site) {
+#if HEAP_TRACK_ALLOC
+  return siteRefused[site];
+#else
+  return 0;
+#endif
+}
+
+HeapRegion heapSiteRegion(HeapSite site) {
+  return site < HEAP_SITES ? SITES[site].region : HEAP_PSRAM_FIRST;
+}
+
+const char* heapSiteName(HeapSite site) {
+  return site < HEAP_SITES ? SITES[site].name : "unknown";
+}
+
+const char* heapRegionName(HeapRegion region) {
+  return region <= HEAP_INTERNAL_ONLY ? REGION_NAMES[region] : "unknown";
+}
+
+static void getRegionStats(uint32_t caps, HeapRegionStats& stats) {
+  stats.total = heap_caps_get_total_size(caps);
+  stats.free = heap_caps_get_free_size(caps);
+  stats.minFree = heap_caps_get_minimum_free_size(caps);
+  stats.largestBlock = heap_caps_get_largest_free_block(caps);
+}
+
+void getInternalHeapStats(HeapRegionStats& stats) {
+  getRegionStats(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, stats);
+}
+
+void getPsramStats(HeapRegionStats& stats) {
+  getRegionStats(MALLOC_CAP_SPIRAM, stats);
+}
+
+void trackTaskStack(TaskHandle_t task) {
+  if (task == nullptr) {
+    return;
+  }
+  portENTER_CRITICAL(&statsMux);
+  bool added = taskCount < HEAP_STAT_TASKS;
+  if (added) {
+    tasks[taskCount++] = task;
+  }
+  portEXIT_CRITICAL(&statsMux);
+  if (!added) {
+    log_w("Stack of %s not watched, raise HEAP_STAT_TASKS", pcTaskGetName(task));
+  }
+}
+
+size_t trackedTaskCount() {
+  return taskCount;
+}
+
+TaskHandle_t trackedTaskHandle(size_t index) {
+  return tasks[index];
+}
+
+const char* trackedTaskName(size_t index) {
+  return pcTaskGetName(tasks[index]);
+}
+
+uint32_t trackedTaskStackFree(size_t index) {
+  // The stack type is a byte on the ESP32 port, so this is in bytes
+  return uxTaskGetStackHighWaterMark(tasks[index]);
+}
@@ -0,0 +1,185 @@
+#include "http_admission.h"
+
+#include "event_stream.h"
+#include "ipp_server.h"
+#include "screen_mirror.h"
+#include "ws_print.h"
+
+static const char* const LANE_NAMES[HTTP_LANE_COUNT] = {"print", "status", "static", "other"};
+
+static uint8_t inFlight[HTTP_LANE_COUNT];
+static uint32_t rejected[HTTP_LANE_COUNT];
+
+#if HTTP_ADMISSION
+
+static const uint8_t LANE_MAX[HTTP_LANE_COUNT] = {HTTP_PRINT_MAX, HTTP_STATUS_MAX, HTTP_STATIC_MAX, HTTP_OTHER_MAX};
+
+// Requests of the API read by dashboards and the web UI while it is open
+static const char* const STATUS_PATHS[] = {"/status", "/metrics", "/capabilities", "/cluster", "/jobs", "/spool"};
+
+static uint8_t inFlightTotal = 0;
+
+// An admitted request, until its client goes. Everything here runs in the
+// AsyncTCP task, so the table needs no lock.
+struct HttpSlot {
+  AsyncWebServerRequest* request;
+  HttpLane lane;
+  std::function<void()> then;          // From onRequestEnd()
+};
+
+static HttpSlot slots[HTTP_MAX_IN_FLIGHT];
+
+static HttpSlot* findSlot(AsyncWebServerRequest* request) {
+  for (size_t i = 0; i < HTTP_MAX_IN_FLIGHT; i++) {
+    if (slots[i].request == request) {
+      return &slots[i];
+    }
+  }
+  return nullptr;
+}
+
+// url is path or below it
+static bool under(const String& url, const char* path) {
+  size_t len = strlen(path);
+  return url.startsWith(path) && (url.length() == len || url[len] == '/');
+}
+
+static HttpLane laneOf(AsyncWebServerRequest* request) {
+  const String& url = request->url();
+  WebRequestMethodComposite method = request->method();
+  if (under(url, WS_PRINT_PATH) || under(url, EVENTS_PATH) || under(url, SCREEN_MIRROR_PATH)) {
+    return HTTP_LANE_NONE;
+  }
+  if ((method == HTTP_POST && (under(url, "/print") || under(url, IPP_PATH))) ||
+      ((method == HTTP_PUT || method == HTTP_DELETE) && under(url, "/jobs"))) {
+    return HTTP_LANE_PRINT;
+  }
+  if (method != HTTP_GET && method != HTTP_HEAD) {
+    return HTTP_LANE_OTHER;
+  }
+  for (const char* path : STATUS_PATHS) {
+    if (under(url, path)) {
+      return HTTP_LANE_STATUS;
+    }
+  }
+  // The web UI and anything else serveStatic() might find: a file name
+  int slash = url.lastIndexOf('/');
+  return (url == "/" || url.indexOf('.', slash) >= 0) ? HTTP_LANE_STATIC : HTTP_LANE_OTHER;
+}
+
+// Room in the lane, and outside the reserve unless it is the print lane
+static bool hasRoom(HttpLane lane) {
+  if (inFlight[lane] >= LANE_MAX[lane] || inFlightTotal >= HTTP_MAX_IN_FLIGHT) {
+    return false;
+  }
+  return lane == HTTP_LANE_PRINT || inFlightTotal - inFlight[HTTP_LANE_PRINT] < HTTP_MAX_IN_FLIGHT - HTTP_PRINT_RESERVED;
+}
+
+static void release(AsyncWebServerRequest* request) {
+  HttpSlot* slot = findSlot(request);
+  if (slot == nullptr) {
+    return;
+  }
+  std::function<void()> then = std::move(slot->then);
+  inFlight[slot->lane]--;
+  inFlightTotal--;
+  slot->request = nullptr;
+  slot->then = nullptr;
+  if (then) {
+    then();
+  }
+}
+
+static bool admit(AsyncWebServerRequest* request, HttpLane lane) {
+  if (!hasRoom(lane)) {
+    return false;
+  }
+  HttpSlot* slot = findSlot(nullptr);
+  slot->request = request;
+  slot->lane = lane;
+  inFlight[lane]++;
+  inFlightTotal++;
+  request->onDisconnect([request]() {
+    release(request);
+  });
+  return true;
+}
+
+static void sendBusy(AsyncWebServerRequest* request) {
+  AsyncWebServerResponse* response = request->beginResponse(503, "text/plain", "Too many requests");
+  response->addHeader("Retry-After", "1");
+  request->send(response);
+}
+
+// Claims the requests it turns away and those of the status fast lane;
+// every other admitted one goes on to its route
+class AdmissionHandler : public AsyncWebHandler {
+public:
+  explicit AdmissionHandler(ArRequestHandlerFunction statusHandler) : _statusHandler(statusHandler) {}
+
+  bool canHandle(AsyncWebServerRequest* request) override {
+    HttpLane lane = laneOf(request);
+    if (lane == HTTP_LANE_NONE) {
+      return false;
+    }
+    if (!admit(request, lane)) {
+      rejected[lane]++;
+      return true;
+    }
+    if (request->method() == HTTP_GET && request->url() == "/status") {
+      request->addInterestingHeader("If-None-Match");
+      return true;
+    }
+    return false;
+  }
+
+  // A turned away body is read and dropped, and answered at its end
+  void handleRequest(AsyncWebServerRequest* request) override {
+    if (findSlot(request) != nullptr) {
+      _statusHandler(request);
+    } else {
+      sendBusy(request);
+    }
+  }
+
+private:
+  ArRequestHandlerFunction _statusHandler;
+};
+
+void initHttpAdmission(AsyncWebServer& server, ArRequestHandlerFunction statusHandler) {
+  server.addHandler(new AdmissionHandler(statusHandler));
+  log_i("At most %u HTTP requests at once, %u of them kept for print uploads", HTTP_MAX_IN_FLIGHT,
+        HTTP_PRINT_RESERVED);
+}
+
+void onRequestEnd(AsyncWebServerRequest* request, std::function<void()> fn) {
+  HttpSlot* slot = findSlot(request);
+  if (slot != nullptr) {
+    slot->then = std::move(fn);
+  } else {
+    request->onDisconnect(fn);
+  }
+}
+
+#else
+
+void initHttpAdmission(AsyncWebServer& server, ArRequestHandlerFunction statusHandler) {
+}
+
+void onRequestEnd(AsyncWebServerRequest* request, std::function<void()> fn) {
+  request->onDisconnect(fn);
+}
+
+#endif
+
+const char* httpLaneName(HttpLane lane) {
+  return lane < HTTP_LANE_COUNT ? LANE_NAMES[lane] : "none";
+}
+
+uint8_t httpLaneInFlight(HttpLane lane) {
+  return lane < HTTP_LANE_COUNT ? inFlight[lane] : 0;
+}
+
+uint32_t httpLaneRejected(HttpLane lane) {
+  return lane < HTTP_LANE_COUNT ? rejected[lane] : 0;
+}
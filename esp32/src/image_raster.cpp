@@ -0,0 +1,677 @@
+#include "image_raster.h"
+
+#include "heap_stats.h"
+#include "printer_encoder.h"
+
+static const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+static const uint32_t PNG_IHDR = 0x49484452;
+static const uint32_t PNG_PLTE = 0x504C5445;
+static const uint32_t PNG_TRNS = 0x74524E53;
+static const uint32_t PNG_IDAT = 0x49444154;
+static const uint32_t PNG_IEND = 0x49454E44;
+static const size_t PNG_IHDR_SIZE = 13;
+
+static const uint8_t PNG_COLOR_GRAY = 0;
+static const uint8_t PNG_COLOR_PALETTE = 3;
+
+// ESC/POS framing as the web UI sends it
+static const uint8_t ESCPOS_PREAMBLE[] = {0x1B, 0x40, 0x1B, 0x33, 0x00}; // ESC @, ESC 3 0
+static const uint8_t ESCPOS_CUT[] = {0x1D, 0x56, 0x42, 0x01};            // GS V 66 1
+static const uint8_t ESCPOS_NO_MARGIN[] = {0x1D, 0x4C, 0x00, 0x00};      // GS L 0
+static const size_t ESCPOS_ROW_HEADER = ENCODE_ESCPOS_ROW_HEADER;
+
+// Columns [lo, hi) of the band rows where any byte isn't blank; lo == hi
+// for a blank band
+static void inkedColumns(const uint8_t* band, size_t rows, size_t stride, size_t width, uint8_t blank,
+                         size_t& lo, size_t& hi) {
+  lo = width;
+  hi = 0;
+  for (size_t r = 0; r < rows; r++) {
+    const uint8_t* row = band + r * stride;
+    for (size_t i = 0; i < lo; i++) {
+      if (row[i] != blank) {
+        lo = i;
+        break;
+      }
+    }
+    for (size_t i = width; i > hi && i > lo; i--) {
+      if (row[i - 1] != blank) {
+        hi = i;
+        break;
+      }
+    }
+  }
+  if (lo > hi) {
+    lo = hi;
+  }
+}
+
+static void* allocPreferPsram(size_t size) {
+  return heapAlloc(HEAP_SITE_IMAGE, size);
+}
+
+static uint32_t readBigEndian32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+  int p = (int)a + b - c;
+  int pa = abs(p - a);
+  int pb = abs(p - b);
+  int pc = abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+const char* imageErrorName(ImageError error) {
+  switch (error) {
+    case IMAGE_OK: return "ok";
+    case IMAGE_ERR_FORMAT: return "Unsupported image format";
+    case IMAGE_ERR_CORRUPT: return "Corrupt image";
+    case IMAGE_ERR_TOO_LARGE: return "Image too wide";
+    case IMAGE_ERR_NO_MEMORY: return "Out of memory for image";
+    case IMAGE_ERR_OUTPUT: return "Print job buffer full";
+  }
+  return "unknown";
+}
+
+ImageRasterizer::~ImageRasterizer() {
+  end();
+}
+
+void ImageRasterizer::begin(const ImageRasterOptions& options, ImageOutput output, void* context) {
+  end();
+  _options = options;
+  _output = output;
+  _context = context;
+  _status = IMAGE_MORE_INPUT;
+  _error = IMAGE_OK;
+  _state = SIGNATURE;
+  _width = 0;
+  _height = 0;
+  _headerLen = 0;
+  _pgm = false;
+  _pbmField = 0;
+  _pbmValue = 0;
+  _pbmDigits = false;
+  _pbmComment = false;
+  _seenHeader = false;
+  _paletteSize = 0;
+  _transparentGray = -1;
+  memset(_luma, 0, sizeof(_luma));
+  memset(_alpha, 0xFF, sizeof(_alpha));
+}
+
+void ImageRasterizer::end() {
+  _inflater.end();
+  _dither.end();
+  _writer.end();
+  heapFree(_scan);
+  heapFree(_prevScan);
+  heapFree(_packed);
+  heapFree(_grayRow);
+  _scan = nullptr;
+  _prevScan = nullptr;
+  _packed = nullptr;
+  _grayRow = nullptr;
+}
+
+ImageStatus ImageRasterizer::fail(ImageError error) {
+  _error = error;
+  _status = IMAGE_ERROR;
+  return _status;
+}
+
+ImageStatus ImageRasterizer::feed(const uint8_t* data, size_t length) {
+  size_t i = 0;
+  while (i < length && _status == IMAGE_MORE_INPUT) {
+    switch (_state) {
+      case SIGNATURE:
+        _header[_headerLen++] = data[i++];
+        if (_header[0] == 'P') {
+          if (_headerLen == 2) {
+            if (_header[1] != '4' && _header[1] != '5') {
+              return fail(IMAGE_ERR_FORMAT);
+            }
+            _pgm = (_header[1] == '5');
+            _state = PBM_HEADER;
+          }
+        } else if (_header[_headerLen - 1] != PNG_SIGNATURE[_headerLen - 1]) {
+          return fail(IMAGE_ERR_FORMAT);
+        } else if (_headerLen == sizeof(PNG_SIGNATURE)) {
+          _state = PNG_CHUNK_HEADER;
+          _headerLen = 0;
+        }
+        break;
+
+      case PBM_HEADER:
+        pbmHeaderByte(data[i++]);
+        break;
+
+      case PBM_ROWS: {
+        // P4 rows are packed 1-bit, 1 is black, exactly what the printer takes
+        size_t n = min(_scanBytes - _scanLen, length - i);
+        memcpy(_scan + _scanLen, data + i, n);
+        _scanLen += n;
+        i += n;
+        if (_scanLen == _scanBytes) {
+          _scanLen = 0;
+          if (_pgm) {
+            packScan(_scan, 8);
+            emitRow(_packed);
+          } else {
+            emitRow(_scan);
+          }
+        }
+        break;
+      }
+
+      case PNG_CHUNK_HEADER:
+        _header[_headerLen++] = data[i++];
+        if (_headerLen == 8) {
+          _chunkLeft = readBigEndian32(_header);
+          _chunkType = readBigEndian32(_header + 4);
+          _chunkPos = 0;
+          _headerLen = 0;
+          if ((_chunkType == PNG_IHDR) != !_seenHeader || (_chunkType == PNG_IHDR && _chunkLeft != PNG_IHDR_SIZE)) {
+            return fail(IMAGE_ERR_CORRUPT);
+          }
+          if (_chunkType == PNG_IEND) {
+            // Done is reached with the last row, so the pixel data fell short
+            return fail(IMAGE_ERR_CORRUPT);
+          }
+          if (_chunkType == PNG_IDAT && _scan == nullptr && !startImage(_bitDepth)) {
+            return _status;
+          }
+          _state = (_chunkLeft == 0) ? PNG_CHUNK_CRC : PNG_CHUNK_DATA;
+        }
+        break;
+
+      case PNG_CHUNK_DATA: {
+        size_t n = min((size_t)_chunkLeft, length - i);
+        if (_chunkType == PNG_IDAT) {
+          if (_inflater.feed(data + i, n) == INFLATE_ERROR && _status == IMAGE_MORE_INPUT) {
+            return fail(IMAGE_ERR_CORRUPT);
+          }
+        } else {
+          for (size_t k = 0; k < n; k++) {
+            pngChunkByte(data[i + k]);
+          }
+        }
+        i += n;
+        _chunkLeft -= n;
+        if (_chunkLeft == 0) {
+          if (!pngChunkEnd()) {
+            return _status;
+          }
+          _state = PNG_CHUNK_CRC;
+        }
+        break;
+      }
+
+      case PNG_CHUNK_CRC:
+        // The zlib checksum already covers the pixel data
+        i++;
+        if (++_headerLen == 4) {
+          _headerLen = 0;
+          _state = PNG_CHUNK_HEADER;
+        }
+        break;
+
+      case FINISHED:
+        i = length;
+        break;
+    }
+  }
+  return _status;
+}
+
+// "P4 <width> <height>" or "P5 <width> <height> <maxval>" with # comments,
+// then a single whitespace byte
+void ImageRasterizer::pbmHeaderByte(uint8_t b) {
+  if (_pbmComment) {
+    _pbmComment = (b != '\n' && b != '\r');
+    return;
+  }
+  if (b == '#' && !_pbmDigits) {
+    _pbmComment = true;
+    return;
+  }
+  if (isdigit(b)) {
+    _pbmValue = _pbmValue * 10 + (b - '0');
+    _pbmDigits = true;
+    if (_pbmValue > 0xFFFF) {
+      fail(IMAGE_ERR_TOO_LARGE);
+    }
+    return;
+  }
+  if (!isspace(b)) {
+    fail(IMAGE_ERR_CORRUPT);
+    return;
+  }
+  if (!_pbmDigits) {
+    return;
+  }
+
+  switch (_pbmField++) {
+    case 0: _width = _pbmValue; break;
+    case 1: _height = _pbmValue; break;
+    default:
+      // Only one byte per sample
+      if (_pbmValue == 0 || _pbmValue > 255) {
+        fail(IMAGE_ERR_FORMAT);
+        return;
+      }
+      for (uint16_t s = 0; s < 256; s++) {
+        _luma[s] = s >= _pbmValue ? 0xFF : s * 255 / _pbmValue;
+      }
+      break;
+  }
+  _pbmValue = 0;
+  _pbmDigits = false;
+  if (_pbmField == (_pgm ? 3 : 2) && startImage(_pgm ? 8 : 1)) {
+    _state = PBM_ROWS;
+  }
+}
+
+void ImageRasterizer::pngChunkByte(uint8_t b) {
+  uint32_t pos = _chunkPos++;
+  switch (_chunkType) {
+    case PNG_IHDR:
+      _header[pos] = b;
+      break;
+    case PNG_PLTE:
+      // Luma of each RGB entry, Rec. 601 weights in 8-bit fixed point
+      if (pos / 3 < 256) {
+        switch (pos % 3) {
+          case 0: _lumaAcc = b * 77; break;
+          case 1: _lumaAcc += b * 150; break;
+          case 2: _luma[pos / 3] = (_lumaAcc + b * 29) >> 8; _paletteSize = pos / 3 + 1; break;
+        }
+      }
+      break;
+    case PNG_TRNS:
+      if (_colorType == PNG_COLOR_PALETTE && pos < 256) {
+        _alpha[pos] = b;
+      } else if (_colorType == PNG_COLOR_GRAY && pos < 2) {
+        _transparentGray = (pos == 0) ? (b << 8) : (_transparentGray | b);
+      }
+      break;
+    default:
+      break;  // Ancillary chunks are skipped
+  }
+}
+
+bool ImageRasterizer::pngChunkEnd() {
+  if (_chunkType != PNG_IHDR) {
+    return true;
+  }
+
+  _seenHeader = true;
+  uint32_t width = readBigEndian32(_header);
+  uint32_t height = readBigEndian32(_header + 4);
+  _bitDepth = _header[8];
+  _colorType = _header[9];
+  if (width > 0xFFFF || height > 0xFFFF) {
+    fail(IMAGE_ERR_TOO_LARGE);
+    return false;
+  }
+  _width = width;
+  _height = height;
+
+  // Only one sample per pixel of up to 8 bits, which keeps unfiltering byte wise
+  bool depthOk = _bitDepth == 1 || _bitDepth == 2 || _bitDepth == 4 || _bitDepth == 8;
+  if ((_colorType != PNG_COLOR_GRAY && _colorType != PNG_COLOR_PALETTE) || !depthOk ||
+      _header[10] != 0 || _header[11] != 0 || _header[12] != 0) {
+    fail(IMAGE_ERR_FORMAT);
+    return false;
+  }
+  return true;
+}
+
+bool ImageRasterizer::startImage(uint8_t bitDepth) {
+  if (_width == 0 || _height == 0) {
+    fail(IMAGE_ERR_CORRUPT);
+    return false;
+  }
+  if (_width > IMAGE_MAX_WIDTH) {
+    fail(IMAGE_ERR_TOO_LARGE);
+    return false;
+  }
+
+  _widthBytes = (_width + 7) / 8;
+  _scanBytes = ((size_t)_width * bitDepth + 7) / 8;
+  _scanLen = 0;
+  bool png = _seenHeader;
+  bool gray = png || _pgm;
+
+  // Gray level per sample value, fixed for the whole image
+  if (png) {
+    if (_colorType == PNG_COLOR_PALETTE && _paletteSize == 0) {
+      fail(IMAGE_ERR_CORRUPT);
+      return false;
+    }
+    uint16_t levels = 1 << _bitDepth;
+    for (uint16_t s = 0; s < 256; s++) {
+      uint8_t luma = _luma[s];
+      bool opaque = _alpha[s] >= 128;
+      if (_colorType == PNG_COLOR_GRAY) {
+        luma = (s < levels) ? s * 255 / (levels - 1) : 0xFF;
+        opaque = (int32_t)s != _transparentGray;
+      }
+      _gray[s] = opaque ? luma : 0xFF;
+    }
+  } else if (_pgm) {
+    memcpy(_gray, _luma, sizeof(_gray));
+  }
+
+  _scan = (uint8_t*)allocPreferPsram(_scanBytes + 1);
+  if (png) {
+    _prevScan = (uint8_t*)allocPreferPsram(_scanBytes + 1);
+  }
+  if (gray) {
+    _packed = (uint8_t*)allocPreferPsram(_widthBytes);
+    _grayRow = (uint8_t*)allocPreferPsram(_width);
+  }
+  if (_scan == nullptr || (png && _prevScan == nullptr) ||
+      (gray && (_packed == nullptr || _grayRow == nullptr)) ||
+      (gray && !_dither.begin(_options.dither, _width, IMAGE_THRESHOLD)) ||
+      (png && !_inflater.begin(true, pngOutput, this))) {
+    end();
+    fail(IMAGE_ERR_NO_MEMORY);
+    return false;
+  }
+  if (png) {
+    memset(_prevScan, 0, _scanBytes + 1);
+  }
+
+  if (!_writer.begin(_options, _width, _height, _output, _context)) {
+    fail(_writer.outputFailed() ? IMAGE_ERR_OUTPUT : IMAGE_ERR_NO_MEMORY);
+    return false;
+  }
+  return true;
+}
+
+bool ImageRasterizer::pngOutput(void* context, const uint8_t* data, size_t length) {
+  return ((ImageRasterizer*)context)->pngScanData(data, length);
+}
+
+// Decoded PNG data: a filter type byte and the filtered samples per scanline
+bool ImageRasterizer::pngScanData(const uint8_t* data, size_t length) {
+  while (length > 0 && _status == IMAGE_MORE_INPUT) {
+    size_t n = min(_scanBytes + 1 - _scanLen, length);
+    memcpy(_scan + _scanLen, data, n);
+    _scanLen += n;
+    data += n;
+    length -= n;
+    if (_scanLen < _scanBytes + 1) {
+      break;
+    }
+
+    _scanLen = 0;
+    if (!unfilterScan()) {
+      fail(IMAGE_ERR_CORRUPT);
+      return false;
+    }
+    packScan(_scan + 1, _bitDepth);
+    emitRow(_packed);
+
+    uint8_t* previous = _prevScan;
+    _prevScan = _scan;
+    _scan = previous;
+  }
+  // Trailing data after the last row is ignored
+  return _status != IMAGE_ERROR;
+}
+
+// Undo the PNG row filter in place. Every supported format has at most one
+// byte per pixel, so the left neighbour is always the previous byte.
+bool ImageRasterizer::unfilterScan() {
+  uint8_t filter = _scan[0];
+  uint8_t* cur = _scan + 1;
+  const uint8_t* prev = _prevScan + 1;
+
+  switch (filter) {
+    case 0:
+      break;
+    case 1:
+      for (size_t x = 1; x < _scanBytes; x++) {
+        cur[x] += cur[x - 1];
+      }
+      break;
+    case 2:
+      for (size_t x = 0; x < _scanBytes; x++) {
+        cur[x] += prev[x];
+      }
+      break;
+    case 3:
+      cur[0] += prev[0] >> 1;
+      for (size_t x = 1; x < _scanBytes; x++) {
+        cur[x] += (cur[x - 1] + prev[x]) >> 1;
+      }
+      break;
+    case 4:
+      cur[0] += prev[0];
+      for (size_t x = 1; x < _scanBytes; x++) {
+        cur[x] += paeth(cur[x - 1], prev[x], prev[x - 1]);
+      }
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+// Map a scanline of samples to gray levels and dither it into packed 1-bit
+// pixels, 1 is black
+void ImageRasterizer::packScan(const uint8_t* samples, uint8_t bitDepth) {
+  if (bitDepth == 8) {
+    for (uint16_t x = 0; x < _width; x++) {
+      _grayRow[x] = _gray[samples[x]];
+    }
+  } else {
+    const uint8_t mask = (1 << bitDepth) - 1;
+    for (uint16_t x = 0; x < _width; x++) {
+      size_t bit = (size_t)x * bitDepth;
+      _grayRow[x] = _gray[(samples[bit >> 3] >> (8 - bitDepth - (bit & 7))) & mask];
+    }
+  }
+  _dither.row(_grayRow, _packed);
+}
+
+bool ImageRasterizer::emitRow(const uint8_t* bits) {
+  if (!_writer.row(bits)) {
+    fail(IMAGE_ERR_OUTPUT);
+    return false;
+  }
+  if (_writer.done()) {
+    _state = FINISHED;
+    _status = IMAGE_DONE;
+  }
+  return true;
+}
+
+RasterCommandWriter::~RasterCommandWriter() {
+  end();
+}
+
+bool RasterCommandWriter::begin(const ImageRasterOptions& options, uint16_t width, uint16_t height,
+                                ImageOutput output, void* context) {
+  end();
+  _options = options;
+  _output = output;
+  _context = context;
+  _outputFailed = false;
+  _width = width;
+  _height = height;
+  _row = 0;
+  _widthBytes = (width + 7) / 8;
+  _margin = 0;
+  _holdEnd = false;
+
+  const size_t budget = psramFound() ? IMAGE_BAND_BYTES : IMAGE_BAND_BYTES_INTERNAL;
+  _rowCost = _widthBytes + (_options.commands == IMAGE_ESCPOS ? ESCPOS_ROW_HEADER : 0);
+  _bandRows = budget / _rowCost;
+  if (_bandRows == 0) {
+    _bandRows = 1;
+  }
+  if (_bandRows > _height) {
+    _bandRows = _height;
+  }
+  _bandFill = 0;
+  _band = (uint8_t*)allocPreferPsram(_bandRows * _rowCost);
+  if (_band == nullptr) {
+    return false;
+  }
+
+  if (_options.commands == IMAGE_ESCPOS) {
+    return emit(ESCPOS_PREAMBLE, sizeof(ESCPOS_PREAMBLE));
+  }
+
+  // TSPL label sized from the image at 8 dots/mm unless given
+  uint16_t widthMm = _options.paperWidthMm != 0 ? _options.paperWidthMm : (_width + 7) / 8;
+  uint16_t heightMm = _options.paperHeightMm;
+  if (heightMm == 0) {
+    heightMm = _height / 8 < 10 ? 10 : _height / 8;
+  }
+  String setup = "SIZE " + String(widthMm) + " mm," + String(heightMm) + " mm\r\n";
+  setup += "GAP 2 mm,0 mm\r\nDIRECTION 1\r\n";
+  setup += "SPEED " + String(_options.speed) + "\r\n";
+  setup += "DENSITY " + String(_options.density) + "\r\nCLS\r\n";
+  return emit(setup);
+}
+
+void RasterCommandWriter::end() {
+  heapFree(_band);
+  _band = nullptr;
+  _height = 0;
+}
+
+bool RasterCommandWriter::row(const uint8_t* bits) {
+  uint8_t* dest = _band + _bandFill * _rowCost;
+  if (_options.commands == IMAGE_ESCPOS) {
+    // One GS v 0 block per row like the client encoders send; the raster
+    // re-encoder merges rows for printers that take bands
+    dest += encodeEscPosRasterHeader(dest, 0, _widthBytes, 1);
+  }
+
+  // TSPL BITMAP prints 0 bits, GS v 0 prints 1 bits
+  bool tspl = _options.commands == IMAGE_TSPL;
+  memcpy(dest, bits, _widthBytes);
+  if (_options.invert != tspl) {
+    encodeInvert(dest, _widthBytes);
+  }
+  // Padding past the right edge stays white
+  if (_width & 7) {
+    uint8_t padding = 0xFF >> (_width & 7);
+    if (tspl) {
+      dest[_widthBytes - 1] |= padding;
+    } else {
+      dest[_widthBytes - 1] &= ~padding;
+    }
+  }
+
+  _bandFill++;
+  _row++;
+  if (_bandFill < _bandRows && _row < _height) {
+    return true;
+  }
+  if (!flushBand()) {
+    return false;
+  }
+  return _row < _height || _holdEnd || finish();
+}
+
+bool RasterCommandWriter::insert(const uint8_t* data, size_t length, uint16_t rows) {
+  if (_bandFill > 0 && !flushBand()) {
+    return false;
+  }
+  if (_margin != 0) {
+    _margin = 0;
+    if (!emit(ESCPOS_NO_MARGIN, sizeof(ESCPOS_NO_MARGIN))) {
+      return false;
+    }
+  }
+  if (!emit(data, length)) {
+    return false;
+  }
+  _row = (_row + rows < _height) ? _row + rows : _height;
+  return _row < _height || _holdEnd || finish();
+}
+
+bool RasterCommandWriter::finish() {
+  if (_bandFill > 0 && !flushBand()) {
+    return false;
+  }
+  if (_options.commands == IMAGE_TSPL) {
+    return emit(String("PRINT 1,1\r\n"));
+  }
+  if (_margin != 0) {
+    if (!emit(ESCPOS_NO_MARGIN, sizeof(ESCPOS_NO_MARGIN))) {
+      return false;
+    }
+  }
+  return emit(ESCPOS_CUT, sizeof(ESCPOS_CUT));
+}
+
+bool RasterCommandWriter::flushBand() {
+  size_t rows = _bandFill;
+  _bandFill = 0;
+  if (_options.commands == IMAGE_TSPL) {
+    size_t lo = 0;
+    size_t hi = _widthBytes;
+    if (_options.crop) {
+      // A white band is left out: the label was cleared with CLS
+      inkedColumns(_band, rows, _rowCost, _widthBytes, 0xFF, lo, hi);
+      if (lo == hi) {
+        return true;
+      }
+      for (size_t r = 0; r < rows; r++) {
+        memmove(_band + r * (hi - lo), _band + r * _rowCost + lo, hi - lo);
+      }
+    }
+    char bitmap[48];
+    size_t len = encodeTsplBitmapHeader(bitmap, sizeof(bitmap), lo * 8, _row - rows, hi - lo, rows, 0);
+    return emit((const uint8_t*)bitmap, len) && emit(_band, rows * (hi - lo)) && emit(String("\r\n"));
+  }
+  if (!_options.crop) {
+    return emit(_band, rows * _rowCost);
+  }
+
+  // GS v 0 rows narrowed in place, a blank band to one byte per row
+  size_t lo, hi;
+  inkedColumns(_band + ESCPOS_ROW_HEADER, rows, _rowCost, _widthBytes, 0x00, lo, hi);
+  if (lo == hi) {
+    lo = 0;
+    hi = 1;
+  }
+  uint16_t margin = lo * 8;
+  if (margin != _margin) {
+    uint8_t setMargin[] = {0x1D, 0x4C, (uint8_t)(margin & 0xFF), (uint8_t)(margin >> 8)};
+    _margin = margin;
+    if (!emit(setMargin, sizeof(setMargin))) {
+      return false;
+    }
+  }
+  size_t width = hi - lo;
+  size_t cost = ESCPOS_ROW_HEADER + width;
+  for (size_t r = 0; r < rows; r++) {
+    uint8_t* dest = _band + r * cost;
+    memmove(dest, _band + r * _rowCost, ESCPOS_ROW_HEADER);
+    dest[4] = width & 0xFF;
+    dest[5] = width >> 8;
+    memmove(dest + ESCPOS_ROW_HEADER, _band + r * _rowCost + ESCPOS_ROW_HEADER + lo, width);
+  }
+  return emit(_band, rows * cost);
+}
+
+bool RasterCommandWriter::emit(const uint8_t* data, size_t length) {
+  if (!_output(_context, data, length)) {
+    _outputFailed = true;
+    return false;
+  }
+  return true;
+}
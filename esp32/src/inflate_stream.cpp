@@ -0,0 +1,90 @@
+#include "inflate_stream.h"
+
+#include <stdlib.h>
+#include <sdkconfig.h>
+#include "heap_stats.h"
+#if CONFIG_IDF_TARGET_ESP32S3
+#include <esp32s3/rom/miniz.h>
+#else
+#include <esp32/rom/miniz.h>
+#endif
+
+static void* allocPreferPsram(size_t size) {
+  return heapAlloc(HEAP_SITE_INFLATE, size);
+}
+
+InflateStream::~InflateStream() {
+  end();
+}
+
+bool InflateStream::begin(bool zlib, InflateOutput output, void* context) {
+  end();
+
+  _decompressor = allocPreferPsram(sizeof(tinfl_decompressor));
+  _window = (uint8_t*)allocPreferPsram(TINFL_LZ_DICT_SIZE);
+  if (_decompressor == nullptr || _window == nullptr) {
+    end();
+    return false;
+  }
+
+  tinfl_init((tinfl_decompressor*)_decompressor);
+  _windowPos = 0;
+  _flags = TINFL_FLAG_HAS_MORE_INPUT | (zlib ? TINFL_FLAG_PARSE_ZLIB_HEADER : 0);
+  _status = INFLATE_MORE_INPUT;
+  _decoded = 0;
+  _output = output;
+  _context = context;
+  return true;
+}
+
+void InflateStream::end() {
+  if (_decompressor != nullptr) {
+    heapFree(_decompressor);
+    _decompressor = nullptr;
+  }
+  if (_window != nullptr) {
+    heapFree(_window);
+    _window = nullptr;
+  }
+  _status = INFLATE_ERROR;
+}
+
+InflateStatus InflateStream::feed(const uint8_t* data, size_t length) {
+  if (_status != INFLATE_MORE_INPUT) {
+    // Trailing bytes after the final block are ignored
+    return _status;
+  }
+
+  for (;;) {
+    // The window doubles as the output buffer: tinfl wraps around it and
+    // back-references stay valid as long as it is exactly the dictionary size
+    size_t inSize = length;
+    size_t outSize = TINFL_LZ_DICT_SIZE - _windowPos;
+    tinfl_status result = tinfl_decompress((tinfl_decompressor*)_decompressor, data, &inSize,
+                                           _window, _window + _windowPos, &outSize, _flags);
+    data += inSize;
+    length -= inSize;
+
+    if (outSize > 0) {
+      if (!_output(_context, _window + _windowPos, outSize)) {
+        _status = INFLATE_ERROR;
+        return _status;
+      }
+      _decoded += outSize;
+      _windowPos = (_windowPos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+
+    if (result < TINFL_STATUS_DONE) {
+      _status = INFLATE_ERROR;
+      return _status;
+    }
+    if (result == TINFL_STATUS_DONE) {
+      _status = INFLATE_DONE;
+      return _status;
+    }
+    if (result == TINFL_STATUS_NEEDS_MORE_INPUT && length == 0) {
+      return _status;
+    }
+    // TINFL_STATUS_HAS_MORE_OUTPUT: the window wrapped, keep going
+  }
+}
@@ -0,0 +1,629 @@
+#include "ipp_server.h"
+#include "pwg_raster.h"
+#include "print_writer.h"
+#include "ble_printer.h"
+#include "cluster.h"
+#include "http_admission.h"
+
+#include <ESPmDNS.h>
+
+// Port of the web server the route is registered on
+static const uint16_t IPP_PORT = 80;
+
+// Operations
+static const uint16_t IPP_OP_PRINT_JOB = 0x0002;
+static const uint16_t IPP_OP_VALIDATE_JOB = 0x0004;
+static const uint16_t IPP_OP_CANCEL_JOB = 0x0008;
+static const uint16_t IPP_OP_GET_JOB_ATTRIBUTES = 0x0009;
+static const uint16_t IPP_OP_GET_JOBS = 0x000A;
+static const uint16_t IPP_OP_GET_PRINTER_ATTRIBUTES = 0x000B;
+
+// Status codes
+static const uint16_t IPP_OK = 0x0000;
+static const uint16_t IPP_BAD_REQUEST = 0x0400;
+static const uint16_t IPP_NOT_POSSIBLE = 0x0404;
+static const uint16_t IPP_NOT_FOUND = 0x0406;
+static const uint16_t IPP_FORMAT_NOT_SUPPORTED = 0x040A;
+static const uint16_t IPP_DOCUMENT_FORMAT_ERROR = 0x0411;
+static const uint16_t IPP_OPERATION_NOT_SUPPORTED = 0x0501;
+static const uint16_t IPP_VERSION_NOT_SUPPORTED = 0x0503;
+static const uint16_t IPP_DEVICE_ERROR = 0x0504;
+static const uint16_t IPP_TEMPORARY_ERROR = 0x0505;
+static const uint16_t IPP_NOT_ACCEPTING_JOBS = 0x0506;
+static const uint16_t IPP_BUSY = 0x0507;
+
+// Delimiter tags
+static const uint8_t TAG_OPERATION = 0x01;
+static const uint8_t TAG_JOB = 0x02;
+static const uint8_t TAG_END = 0x03;
+static const uint8_t TAG_PRINTER = 0x04;
+// Value tags
+static const uint8_t TAG_INTEGER = 0x21;
+static const uint8_t TAG_BOOLEAN = 0x22;
+static const uint8_t TAG_ENUM = 0x23;
+static const uint8_t TAG_RESOLUTION = 0x32;
+static const uint8_t TAG_RANGE = 0x33;
+static const uint8_t TAG_TEXT = 0x41;
+static const uint8_t TAG_NAME = 0x42;
+static const uint8_t TAG_KEYWORD = 0x44;
+static const uint8_t TAG_URI = 0x45;
+static const uint8_t TAG_CHARSET = 0x47;
+static const uint8_t TAG_LANGUAGE = 0x48;
+static const uint8_t TAG_MIME = 0x49;
+
+// printer-state and job-state enums
+static const int32_t PRINTER_IDLE = 3;
+static const int32_t PRINTER_PROCESSING = 4;
+static const int32_t PRINTER_STOPPED = 5;
+static const int32_t IPP_JOB_PENDING = 3;
+static const int32_t IPP_JOB_PROCESSING = 5;
+static const int32_t IPP_JOB_ABORTED = 8;
+static const int32_t IPP_JOB_COMPLETED = 9;
+
+// Version, operation and request ID
+static const size_t IPP_HEADER_SIZE = 8;
+
+// Per-request state, freed together with the request
+struct IppRequestContext {
+  uint8_t printer;
+  bool unknownPrinter;
+  bool parsed;               // Attributes complete; the rest of the body is the document
+  bool tooLarge;
+  bool malformed;
+  uint8_t versionMajor;
+  uint8_t versionMinor;
+  uint16_t operation;
+  uint32_t requestId;
+  uint32_t jobIdAttribute;   // job-id or the job-uri's ID, 0 without
+  char format[48];           // document-format, empty without
+  uint16_t copies;           // Job template copies, 0 without
+  uint16_t status;           // Print-Job failure, IPP_OK while it goes well
+  uint32_t jobId;
+  PwgRasterDecoder* decoder; // Freed on disconnect
+  size_t length;
+  uint8_t attributes[IPP_MAX_ATTRIBUTES];
+};
+
+static ImageOutput ippOutput = nullptr;
+
+static uint16_t be16(const uint8_t* p) {
+  return (uint16_t)p[0] << 8 | p[1];
+}
+
+static uint32_t be32(const uint8_t* p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// ---------------------------------------------------------------------------
+// Request
+
+// Walk the buffered attributes. Returns the offset of the document after
+// the end-of-attributes tag, 0 while it hasn't arrived and -1 when the
+// encoding is broken.
+static int parseAttributes(IppRequestContext* ctx) {
+  const uint8_t* p = ctx->attributes;
+  size_t length = ctx->length;
+  if (length < IPP_HEADER_SIZE) {
+    return 0;
+  }
+  ctx->versionMajor = p[0];
+  ctx->versionMinor = p[1];
+  ctx->operation = be16(p + 2);
+  ctx->requestId = be32(p + 4);
+
+  uint8_t group = 0;
+  size_t pos = IPP_HEADER_SIZE;
+  while (pos < length) {
+    uint8_t tag = p[pos];
+    if (tag == TAG_END) {
+      return pos + 1;
+    }
+    if (tag < 0x10) {
+      group = tag;
+      pos++;
+      continue;
+    }
+    if (pos + 3 > length) {
+      return 0;
+    }
+    size_t nameLength = be16(p + pos + 1);
+    if (pos + 3 + nameLength + 2 > length) {
+      return 0;
+    }
+    const char* name = (const char*)p + pos + 3;
+    size_t valueLength = be16(p + pos + 3 + nameLength);
+    const uint8_t* value = p + pos + 5 + nameLength;
+    if (value + valueLength > p + length) {
+      return 0;
+    }
+    if (tag == 0x7F) {
+      // Extension tags carry a 32-bit tag first, nothing this server reads
+      return -1;
+    }
+
+    if (group == TAG_OPERATION && nameLength > 0) {
+      String attribute(name, nameLength);
+      if (attribute == "document-format" && valueLength < sizeof(ctx->format)) {
+        memcpy(ctx->format, value, valueLength);
+        ctx->format[valueLength] = '\0';
+      } else if (attribute == "job-id" && tag == TAG_INTEGER && valueLength == 4) {
+        ctx->jobIdAttribute = be32(value);
+      } else if (attribute == "job-uri" && valueLength > 0) {
+        String uri((const char*)value, valueLength);
+        ctx->jobIdAttribute = uri.substring(uri.lastIndexOf('/') + 1).toInt();
+      }
+    } else if (group == TAG_JOB && tag == TAG_INTEGER && valueLength == 4 &&
+               nameLength == 6 && memcmp(name, "copies", 6) == 0) {
+      uint32_t copies = be32(value);
+      ctx->copies = copies <= PRINT_MAX_COPIES ? copies : 0;
+    }
+    pos += 5 + nameLength + valueLength;
+  }
+  return 0;
+}
+
+static bool formatSupported(const char* format) {
+  return format[0] == '\0' || strcmp(format, "image/pwg-raster") == 0 || strcmp(format, "image/urf") == 0 ||
+         strcmp(format, "application/octet-stream") == 0;
+}
+
+static uint16_t decoderStatus(PwgRasterError error) {
+  switch (error) {
+    case PWG_OK: return IPP_OK;
+    case PWG_ERR_FORMAT:
+    case PWG_ERR_CORRUPT: return IPP_DOCUMENT_FORMAT_ERROR;
+    case PWG_ERR_NO_MEMORY: return IPP_TEMPORARY_ERROR;
+    case PWG_ERR_OUTPUT: return IPP_DEVICE_ERROR;
+  }
+  return IPP_DEVICE_ERROR;
+}
+
+// Print-Job with its attributes read: admit the job the document streams into
+static void startPrintJob(AsyncWebServerRequest* request, IppRequestContext* ctx) {
+  BlePrinter* printer = getPrinter(ctx->printer);
+  if (!formatSupported(ctx->format)) {
+    ctx->status = IPP_FORMAT_NOT_SUPPORTED;
+    return;
+  }
+  if (printer == nullptr || !printer->connected()) {
+    // Connecting while the client backs off lets its retry through
+    if (printer != nullptr) {
+      printer->requestJobConnect();
+    }
+    ctx->status = IPP_NOT_ACCEPTING_JOBS;
+    return;
+  }
+  PrintJobReject reject = JOB_ACCEPTED;
+  ctx->jobId = createPrintJob(ctx->printer, PRINT_JOB_LENGTH_UNKNOWN, reject);
+  if (ctx->jobId == 0) {
+    ctx->status = reject == JOB_REJECT_QUEUE_FULL ? IPP_BUSY : IPP_TEMPORARY_ERROR;
+    return;
+  }
+  setPrintJobClient(ctx->jobId, printClientKey(request->client()->remoteIP().toString().c_str()));
+  if (ctx->copies > 1 && !setPrintJobCopies(ctx->jobId, ctx->copies)) {
+    abortPrintJob(ctx->jobId);
+    ctx->jobId = 0;
+    ctx->status = IPP_TEMPORARY_ERROR;
+    return;
+  }
+
+  ImageRasterOptions options;
+  options.commands = IPP_COMMAND_SET;
+  options.dither = IPP_DITHER;
+  ctx->decoder = new PwgRasterDecoder();
+  ctx->decoder->begin(options, printer->dots() != 0 ? printer->dots() : IPP_DEFAULT_DOTS, ippOutput,
+                      &ctx->jobId);
+  log_i("IPP job %u for printer %s, %s", ctx->jobId, printer->id().c_str(),
+        ctx->format[0] != '\0' ? ctx->format : "format unnamed");
+  uint32_t jobId = ctx->jobId;
+  PwgRasterDecoder* decoder = ctx->decoder;
+  // A client that goes away mid-document fails its job
+  onRequestEnd(request, [jobId, decoder]() {
+    abortPrintJob(jobId);
+    delete decoder;
+  });
+}
+
+static void feedDocument(IppRequestContext* ctx, const uint8_t* data, size_t length) {
+  if (ctx->decoder == nullptr || ctx->status != IPP_OK || length == 0) {
+    return;
+  }
+  PwgRasterError error = ctx->decoder->feed(data, length);
+  if (error != PWG_OK) {
+    log_e("IPP job %u rejected after %u pages: %s", ctx->jobId, ctx->decoder->pages(),
+          pwgRasterErrorName(error));
+    ctx->status = decoderStatus(error);
+    abortPrintJob(ctx->jobId);
+  }
+}
+
+// Body chunks: the attributes are buffered up to their end tag, then the
+// document is decoded as it arrives
+static void handleIppBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+  IppRequestContext* ctx = (IppRequestContext*)request->_tempObject;
+  if (index == 0 && ctx == nullptr) {
+    // Freed together with the request
+    ctx = (IppRequestContext*)malloc(sizeof(IppRequestContext));
+    if (ctx == nullptr) {
+      return;
+    }
+    memset(ctx, 0, offsetof(IppRequestContext, attributes));
+    String url = request->url();
+    BlePrinter* printer = url.length() > strlen(IPP_PATH) + 1
+                              ? findPrinter(url.substring(strlen(IPP_PATH) + 1))
+                              : getPrinter(0);
+    ctx->unknownPrinter = printer == nullptr;
+    ctx->printer = printer != nullptr ? printer->index() : 0;
+    request->_tempObject = ctx;
+  }
+  if (ctx == nullptr || ctx->tooLarge || ctx->malformed) {
+    return;
+  }
+  if (ctx->parsed) {
+    feedDocument(ctx, data, len);
+    return;
+  }
+
+  size_t take = IPP_MAX_ATTRIBUTES - ctx->length;
+  if (take > len) {
+    take = len;
+  }
+  memcpy(ctx->attributes + ctx->length, data, take);
+  ctx->length += take;
+  int end = parseAttributes(ctx);
+  if (end < 0) {
+    ctx->malformed = true;
+    return;
+  }
+  if (end == 0) {
+    ctx->tooLarge = ctx->length == IPP_MAX_ATTRIBUTES;
+    return;
+  }
+  ctx->parsed = true;
+  if (ctx->operation != IPP_OP_PRINT_JOB || ctx->unknownPrinter) {
+    return;
+  }
+  startPrintJob(request, ctx);
+  // Document bytes that came with the last of the attributes
+  feedDocument(ctx, ctx->attributes + end, ctx->length - end);
+  feedDocument(ctx, data + take, len - take);
+}
+
+// ---------------------------------------------------------------------------
+// Response
+
+static void write16(Print& out, uint16_t value) {
+  out.write((uint8_t)(value >> 8));
+  out.write((uint8_t)value);
+}
+
+static void write32(Print& out, uint32_t value) {
+  write16(out, value >> 16);
+  write16(out, value);
+}
+
+// One value; an empty name adds another value to the attribute before
+static void ippValue(Print& out, uint8_t tag, const char* name, const uint8_t* value, size_t length) {
+  size_t nameLength = strlen(name);
+  out.write(tag);
+  write16(out, nameLength);
+  out.write((const uint8_t*)name, nameLength);
+  write16(out, length);
+  out.write(value, length);
+}
+
+static void ippString(Print& out, uint8_t tag, const char* name, const String& value) {
+  ippValue(out, tag, name, (const uint8_t*)value.c_str(), value.length());
+}
+
+static void ippInteger(Print& out, uint8_t tag, const char* name, int32_t value) {
+  const uint8_t bytes[] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+  ippValue(out, tag, name, bytes, sizeof(bytes));
+}
+
+static void ippBoolean(Print& out, const char* name, bool value) {
+  uint8_t byte = value ? 1 : 0;
+  ippValue(out, TAG_BOOLEAN, name, &byte, 1);
+}
+
+static void ippResolution(Print& out, const char* name, uint16_t dpi) {
+  // Cross feed, feed, 3 for dots per inch
+  const uint8_t bytes[] = {0, 0, (uint8_t)(dpi >> 8), (uint8_t)dpi, 0, 0, (uint8_t)(dpi >> 8), (uint8_t)dpi, 3};
+  ippValue(out, TAG_RESOLUTION, name, bytes, sizeof(bytes));
+}
+
+static void ippRange(Print& out, const char* name, int32_t low, int32_t high) {
+  const uint8_t bytes[] = {(uint8_t)(low >> 24), (uint8_t)(low >> 16), (uint8_t)(low >> 8), (uint8_t)low,
+                           (uint8_t)(high >> 24), (uint8_t)(high >> 16), (uint8_t)(high >> 8), (uint8_t)high};
+  ippValue(out, TAG_RANGE, name, bytes, sizeof(bytes));
+}
+
+// Version, status and the operation attributes every response starts with
+static void beginResponse(Print& out, const IppRequestContext* ctx, uint16_t status, const char* message) {
+  out.write(ctx->versionMajor >= 2 ? 2 : 1);
+  out.write(ctx->versionMajor >= 2 ? 0 : 1);
+  write16(out, status);
+  write32(out, ctx->requestId);
+  out.write(TAG_OPERATION);
+  ippString(out, TAG_CHARSET, "attributes-charset", "utf-8");
+  ippString(out, TAG_LANGUAGE, "attributes-natural-language", "en");
+  if (message != nullptr) {
+    ippString(out, TAG_TEXT, "status-message", message);
+  }
+}
+
+static String printerUri(AsyncWebServerRequest* request, const BlePrinter* printer) {
+  String uri = "ipp://" + request->host() + IPP_PATH;
+  if (printer->index() != 0) {
+    uri += "/" + printer->id();
+  }
+  return uri;
+}
+
+static uint16_t printerDpi(const BlePrinter* printer) {
+  return printer->dpi() != 0 ? printer->dpi() : IPP_DEFAULT_DPI;
+}
+
+// The one roll size: the head's width by IPP_MEDIA_LENGTH_MM
+static String mediaName(const BlePrinter* printer) {
+  uint16_t dots = printer->dots() != 0 ? printer->dots() : IPP_DEFAULT_DOTS;
+  uint32_t widthMm = ((uint32_t)dots * 254 + printerDpi(printer) * 5) / (printerDpi(printer) * 10);
+  return "oe_roll_" + String(widthMm) + "x" + String(IPP_MEDIA_LENGTH_MM) + "mm";
+}
+
+static void printerAttributes(Print& out, AsyncWebServerRequest* request, const BlePrinter* printer) {
+  uint16_t dpi = printerDpi(printer);
+  String media = mediaName(printer);
+  size_t queued = printQueueDepth(printer->index());
+  bool paused = printWriterPaused(printer->index());
+
+  out.write(TAG_PRINTER);
+  ippString(out, TAG_URI, "printer-uri-supported", printerUri(request, printer));
+  ippString(out, TAG_KEYWORD, "uri-security-supported", "none");
+  ippString(out, TAG_KEYWORD, "uri-authentication-supported", "none");
+  ippString(out, TAG_NAME, "printer-name", printer->id());
+  ippString(out, TAG_TEXT, "printer-info", printer->id());
+  ippString(out, TAG_TEXT, "printer-make-and-model",
+            printer->name().length() > 0 ? printer->name() : String("Thermal printer"));
+  ippString(out, TAG_TEXT, "printer-location", "");
+
+  int32_t state = PRINTER_IDLE;
+  const char* reason = "none";
+  if (!printer->connected()) {
+    state = PRINTER_STOPPED;
+    reason = "offline-report";
+  } else if (paused) {
+    state = PRINTER_STOPPED;
+    reason = "paused";
+  } else if (printer->paperOut()) {
+    state = PRINTER_STOPPED;
+    reason = "media-empty-error";
+  } else if (queued > 0) {
+    state = PRINTER_PROCESSING;
+  }
+  ippInteger(out, TAG_ENUM, "printer-state", state);
+  ippString(out, TAG_KEYWORD, "printer-state-reasons", reason);
+  ippBoolean(out, "printer-is-accepting-jobs", printer->connected());
+  ippInteger(out, TAG_INTEGER, "queued-job-count", queued);
+  ippInteger(out, TAG_INTEGER, "printer-up-time", millis() / 1000);
+
+  ippString(out, TAG_KEYWORD, "ipp-versions-supported", "1.1");
+  ippString(out, TAG_KEYWORD, "", "2.0");
+  const uint16_t operations[] = {IPP_OP_PRINT_JOB, IPP_OP_VALIDATE_JOB, IPP_OP_CANCEL_JOB,
+                                 IPP_OP_GET_JOB_ATTRIBUTES, IPP_OP_GET_JOBS, IPP_OP_GET_PRINTER_ATTRIBUTES};
+  for (size_t i = 0; i < sizeof(operations) / sizeof(operations[0]); i++) {
+    ippInteger(out, TAG_ENUM, i == 0 ? "operations-supported" : "", operations[i]);
+  }
+  ippString(out, TAG_CHARSET, "charset-configured", "utf-8");
+  ippString(out, TAG_CHARSET, "charset-supported", "utf-8");
+  ippString(out, TAG_LANGUAGE, "natural-language-configured", "en");
+  ippString(out, TAG_LANGUAGE, "generated-natural-language-supported", "en");
+  ippString(out, TAG_KEYWORD, "compression-supported", "none");
+  ippString(out, TAG_KEYWORD, "pdl-override-supported", "not-attempted");
+
+  ippString(out, TAG_MIME, "document-format-default", "image/pwg-raster");
+  ippString(out, TAG_MIME, "document-format-supported", "image/pwg-raster");
+  ippString(out, TAG_MIME, "", "image/urf");
+  ippString(out, TAG_MIME, "", "application/octet-stream");
+  ippResolution(out, "pwg-raster-document-resolution-supported", dpi);
+  ippString(out, TAG_KEYWORD, "pwg-raster-document-type-supported", "black_1");
+  ippString(out, TAG_KEYWORD, "", "sgray_8");
+  ippString(out, TAG_KEYWORD, "", "srgb_8");
+  ippString(out, TAG_KEYWORD, "pwg-raster-document-sheet-back", "normal");
+  ippString(out, TAG_KEYWORD, "urf-supported", "V1.4");
+  ippString(out, TAG_KEYWORD, "", "W8");
+  ippString(out, TAG_KEYWORD, "", "SRGB24");
+  ippString(out, TAG_KEYWORD, "", "CP1");
+  ippString(out, TAG_KEYWORD, "", "RS" + String(dpi));
+
+  ippBoolean(out, "color-supported", false);
+  ippString(out, TAG_KEYWORD, "print-color-mode-default", "monochrome");
+  ippString(out, TAG_KEYWORD, "print-color-mode-supported", "monochrome");
+  ippResolution(out, "printer-resolution-default", dpi);
+  ippResolution(out, "printer-resolution-supported", dpi);
+  ippInteger(out, TAG_ENUM, "print-quality-default", 4);
+  ippInteger(out, TAG_ENUM, "print-quality-supported", 4);
+  ippString(out, TAG_KEYWORD, "sides-default", "one-sided");
+  ippString(out, TAG_KEYWORD, "sides-supported", "one-sided");
+  ippInteger(out, TAG_INTEGER, "copies-default", 1);
+  ippRange(out, "copies-supported", 1, PRINT_MAX_COPIES);
+  ippString(out, TAG_KEYWORD, "media-default", media);
+  ippString(out, TAG_KEYWORD, "media-supported", media);
+  ippString(out, TAG_KEYWORD, "media-ready", media);
+}
+
+static int32_t jobState(const PrintJobInfo& info) {
+  switch (info.state) {
+    case JOB_QUEUED: return IPP_JOB_PENDING;
+    case JOB_STREAMING: return IPP_JOB_PROCESSING;
+    case JOB_DONE: return IPP_JOB_COMPLETED;
+    case JOB_FAILED: return IPP_JOB_ABORTED;
+  }
+  return IPP_JOB_ABORTED;
+}
+
+static void jobAttributes(Print& out, AsyncWebServerRequest* request, const PrintJobInfo& info) {
+  out.write(TAG_JOB);
+  ippInteger(out, TAG_INTEGER, "job-id", info.id);
+  // The bridge's own status URL of the job
+  ippString(out, TAG_URI, "job-uri", "ipp://" + request->host() + "/jobs/" + String(info.id));
+  BlePrinter* printer = getPrinter(info.printer);
+  if (printer != nullptr) {
+    ippString(out, TAG_URI, "job-printer-uri", printerUri(request, printer));
+  }
+  int32_t state = jobState(info);
+  ippInteger(out, TAG_ENUM, "job-state", state);
+  const char* reason = "none";
+  if (state == IPP_JOB_COMPLETED) {
+    reason = "job-completed-successfully";
+  } else if (state == IPP_JOB_ABORTED) {
+    reason = "aborted-by-system";
+  }
+  ippString(out, TAG_KEYWORD, "job-state-reasons", reason);
+}
+
+// Completion of Print-Job: the last of the document is decoded and the job
+// handed over or failed
+static uint16_t completePrintJob(IppRequestContext* ctx) {
+  if (ctx->status != IPP_OK) {
+    return ctx->status;
+  }
+  PwgRasterError error = ctx->decoder->end();
+  if (error != PWG_OK) {
+    abortPrintJob(ctx->jobId);
+    return decoderStatus(error);
+  }
+  finishPrintJob(ctx->jobId);
+  log_i("IPP job %u received, %u pages", ctx->jobId, ctx->decoder->pages());
+  return IPP_OK;
+}
+
+static void handleIppRequest(AsyncWebServerRequest* request) {
+  IppRequestContext* ctx = (IppRequestContext*)request->_tempObject;
+  if (ctx == nullptr || ctx->malformed || (!ctx->parsed && !ctx->tooLarge)) {
+    request->send(400, "text/plain", "Invalid IPP request");
+    return;
+  }
+  if (ctx->tooLarge) {
+    request->send(413, "text/plain", "IPP attributes too large");
+    return;
+  }
+  if (ctx->unknownPrinter) {
+    request->send(404, "text/plain", "Unknown printer");
+    return;
+  }
+
+  BlePrinter* printer = getPrinter(ctx->printer);
+  AsyncResponseStream* response = request->beginResponseStream("application/ipp");
+  if (response == nullptr) {
+    return;
+  }
+  Print& out = *response;
+  if (ctx->versionMajor < 1 || ctx->versionMajor > 2) {
+    beginResponse(out, ctx, IPP_VERSION_NOT_SUPPORTED, nullptr);
+    out.write(TAG_END);
+    request->send(response);
+    return;
+  }
+
+  PrintJobInfo info;
+  switch (ctx->operation) {
+    case IPP_OP_PRINT_JOB: {
+      uint16_t status = completePrintJob(ctx);
+      beginResponse(out, ctx, status, nullptr);
+      if (status == IPP_OK && getPrintJob(ctx->jobId, info)) {
+        jobAttributes(out, request, info);
+      }
+      break;
+    }
+
+    case IPP_OP_VALIDATE_JOB:
+      if (!formatSupported(ctx->format)) {
+        beginResponse(out, ctx, IPP_FORMAT_NOT_SUPPORTED, nullptr);
+      } else if (!printer->connected()) {
+        printer->requestJobConnect();
+        beginResponse(out, ctx, IPP_NOT_ACCEPTING_JOBS, "Printer not connected");
+      } else {
+        beginResponse(out, ctx, IPP_OK, nullptr);
+      }
+      break;
+
+    case IPP_OP_GET_PRINTER_ATTRIBUTES:
+      beginResponse(out, ctx, IPP_OK, nullptr);
+      printerAttributes(out, request, printer);
+      break;
+
+    case IPP_OP_GET_JOB_ATTRIBUTES:
+      if (ctx->jobIdAttribute == 0) {
+        beginResponse(out, ctx, IPP_BAD_REQUEST, "Missing job-id");
+      } else if (!getPrintJob(ctx->jobIdAttribute, info)) {
+        beginResponse(out, ctx, IPP_NOT_FOUND, nullptr);
+      } else {
+        beginResponse(out, ctx, IPP_OK, nullptr);
+        jobAttributes(out, request, info);
+      }
+      break;
+
+    case IPP_OP_GET_JOBS: {
+      // Jobs not completed, the default of which-jobs
+      PrintJobInfo jobs[PRINT_JOB_SLOTS];
+      size_t count = getPendingPrintJobs(jobs, PRINT_JOB_SLOTS);
+      beginResponse(out, ctx, IPP_OK, nullptr);
+      for (size_t i = 0; i < count; i++) {
+        if (jobs[i].printer == ctx->printer) {
+          jobAttributes(out, request, jobs[i]);
+        }
+      }
+      break;
+    }
+
+    case IPP_OP_CANCEL_JOB:
+      if (ctx->jobIdAttribute == 0) {
+        beginResponse(out, ctx, IPP_BAD_REQUEST, "Missing job-id");
+      } else if (cancelPrintJob(ctx->jobIdAttribute)) {
+        beginResponse(out, ctx, IPP_OK, nullptr);
+      } else {
+        bool known = getPrintJob(ctx->jobIdAttribute, info);
+        beginResponse(out, ctx, known ? IPP_NOT_POSSIBLE : IPP_NOT_FOUND, nullptr);
+      }
+      break;
+
+    default:
+      beginResponse(out, ctx, IPP_OPERATION_NOT_SUPPORTED, nullptr);
+      break;
+  }
+  out.write(TAG_END);
+  request->send(response);
+}
+
+// ---------------------------------------------------------------------------
+
+// _ipp._tcp with the TXT keys of IPP Everywhere, for the first printer
+static void advertiseIpp() {
+  BlePrinter* printer = getPrinter(0);
+  if (strlen(IPP_MDNS_HOSTNAME) == 0 || printer == nullptr) {
+    return;
+  }
+  if (!beginMdns()) {
+    log_e("mDNS failed to start, IPP not advertised");
+    return;
+  }
+  String path = IPP_PATH;
+  MDNS.addService("ipp", "tcp", IPP_PORT);
+  MDNS.addServiceTxt("ipp", "tcp", "txtvers", "1");
+  MDNS.addServiceTxt("ipp", "tcp", "qtotal", "1");
+  MDNS.addServiceTxt("ipp", "tcp", "rp", path.substring(1).c_str());
+  MDNS.addServiceTxt("ipp", "tcp", "ty", printer->id().c_str());
+  MDNS.addServiceTxt("ipp", "tcp", "pdl", "image/pwg-raster,image/urf");
+  MDNS.addServiceTxt("ipp", "tcp", "URF", ("V1.4,W8,SRGB24,CP1,RS" + String(printerDpi(printer))).c_str());
+  MDNS.addServiceTxt("ipp", "tcp", "Color", "F");
+  MDNS.addServiceTxt("ipp", "tcp", "Duplex", "F");
+  log_i("IPP printer %s advertised as %s.local", printer->id().c_str(), IPP_MDNS_HOSTNAME);
+}
+
+void initIppServer(AsyncWebServer& server, ImageOutput output) {
+  ippOutput = output;
+  // Also matches IPP_PATH/<printer id>
+  server.on(IPP_PATH, HTTP_POST, handleIppRequest, NULL, handleIppBody);
+  advertiseIpp();
+}
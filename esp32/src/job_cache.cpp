@@ -0,0 +1,401 @@
+#include "job_cache.h"
+#include "print_writer.h"
+#include "heap_stats.h"
+
+#include <LittleFS.h>
+
+// Files start with the full hash in hex; they are named by its first digits
+// to stay well within LittleFS name limits
+static const size_t CACHE_NAME_DIGITS = 24;
+// Read from flash and appended to the job per step
+static const size_t REPLAY_CHUNK = 4096;
+
+struct CacheEntry {
+  bool used;
+  char hash[JOB_HASH_LENGTH + 1];
+  size_t length;     // Command stream, without the hash in front
+  uint32_t lastUse;
+  uint8_t readers;   // Replays queued or running; not evicted while set
+};
+
+struct ReplayRequest {
+  uint32_t jobId;
+  uint8_t entry;
+};
+
+static CacheEntry entries[JOB_CACHE_ENTRIES];
+static uint32_t useCounter = 0;
+static uint32_t tempCounter = 0;
+static SemaphoreHandle_t cacheLock = nullptr;
+static QueueHandle_t replayQueue = nullptr;
+static uint8_t replayBuffer[REPLAY_CHUNK];
+
+static String entryPath(const char* hash) {
+  return String(JOB_CACHE_DIR) + "/" + String(hash).substring(0, CACHE_NAME_DIGITS) + ".job";
+}
+
+static void lowerHash(const String& text, char* hash) {
+  for (size_t i = 0; i < JOB_HASH_LENGTH; i++) {
+    hash[i] = tolower(text[i]);
+  }
+  hash[JOB_HASH_LENGTH] = '\0';
+}
+
+bool isJobHash(const String& text) {
+  if (text.length() != JOB_HASH_LENGTH) {
+    return false;
+  }
+  for (size_t i = 0; i < JOB_HASH_LENGTH; i++) {
+    if (!isxdigit(text[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Caller holds cacheLock
+static CacheEntry* findEntry(const char* hash) {
+  for (size_t i = 0; i < JOB_CACHE_ENTRIES; i++) {
+    if (entries[i].used && strcmp(entries[i].hash, hash) == 0) {
+      return &entries[i];
+    }
+  }
+  return nullptr;
+}
+
+// Caller holds cacheLock
+static size_t cachedBytes() {
+  size_t bytes = 0;
+  for (size_t i = 0; i < JOB_CACHE_ENTRIES; i++) {
+    if (entries[i].used) {
+      bytes += entries[i].length + JOB_HASH_LENGTH;
+    }
+  }
+  return bytes;
+}
+
+// Drop least recently used jobs until one of fileSize bytes fits. Returns
+// the free entry, null when the jobs in the way are being replayed. Caller
+// holds cacheLock.
+static CacheEntry* makeRoom(size_t fileSize) {
+  while (true) {
+    CacheEntry* empty = nullptr;
+    CacheEntry* oldest = nullptr;
+    for (size_t i = 0; i < JOB_CACHE_ENTRIES; i++) {
+      CacheEntry& entry = entries[i];
+      if (!entry.used) {
+        empty = empty != nullptr ? empty : &entry;
+      } else if (entry.readers == 0 && (oldest == nullptr || entry.lastUse < oldest->lastUse)) {
+        oldest = &entry;
+      }
+    }
+    if (empty != nullptr && cachedBytes() + fileSize <= JOB_CACHE_BUDGET) {
+      return empty;
+    }
+    if (oldest == nullptr) {
+      return nullptr;
+    }
+    log_i("Job cache evicting %.12s, %u bytes", oldest->hash, oldest->length);
+    LittleFS.remove(entryPath(oldest->hash));
+    oldest->used = false;
+  }
+}
+
+// Copy one entry into its job, waiting on the job buffer like the raw
+// print listener does
+static bool replayEntry(const char* hash, size_t length, uint32_t jobId) {
+  File file = LittleFS.open(entryPath(hash), "r");
+  if (!file || !file.seek(JOB_HASH_LENGTH)) {
+    return false;
+  }
+  size_t done = 0;
+  while (done < length) {
+    size_t chunk = length - done < REPLAY_CHUNK ? length - done : REPLAY_CHUNK;
+    if (file.read(replayBuffer, chunk) != chunk) {
+      file.close();
+      return false;
+    }
+    if (!appendPrintJobWait(jobId, replayBuffer, chunk)) {
+      file.close();
+      return true;
+    }
+    done += chunk;
+  }
+  file.close();
+  return true;
+}
+
+// Replays run one after another: a job that waits behind others holds its
+// whole body in its buffer, so only the job streaming to a printer blocks
+static void replayTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  ReplayRequest request;
+  while (true) {
+    if (xQueueReceive(replayQueue, &request, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    CacheEntry& entry = entries[request.entry];
+    if (replayEntry(entry.hash, entry.length, request.jobId)) {
+      finishPrintJob(request.jobId);
+    } else {
+      log_e("Job %u replay of cached %.12s failed", request.jobId, entry.hash);
+      abortPrintJob(request.jobId);
+    }
+    xSemaphoreTake(cacheLock, portMAX_DELAY);
+    entry.readers--;
+    xSemaphoreGive(cacheLock);
+  }
+}
+
+// Index one file of the cache directory, removing leftovers
+static void indexFile(File& file) {
+  String name = file.name();
+  String path = String(JOB_CACHE_DIR) + "/" + name;
+  char header[JOB_HASH_LENGTH + 1];
+  bool valid = name.endsWith(".job") && file.size() >= JOB_HASH_LENGTH &&
+               file.read((uint8_t*)header, JOB_HASH_LENGTH) == JOB_HASH_LENGTH;
+  size_t length = file.size() - JOB_HASH_LENGTH;
+  file.close();
+
+  header[JOB_HASH_LENGTH] = '\0';
+  valid = valid && isJobHash(header);
+  CacheEntry* slot = nullptr;
+  if (valid) {
+    lowerHash(header, header);
+    valid = entryPath(header) == path && findEntry(header) == nullptr;
+  }
+  for (size_t i = 0; valid && slot == nullptr && i < JOB_CACHE_ENTRIES; i++) {
+    slot = entries[i].used ? nullptr : &entries[i];
+  }
+  if (slot == nullptr) {
+    LittleFS.remove(path);
+    return;
+  }
+  slot->used = true;
+  memcpy(slot->hash, header, sizeof(slot->hash));
+  slot->length = length;
+  slot->lastUse = 0;
+  slot->readers = 0;
+}
+
+bool initJobCache() {
+  if (JOB_CACHE_BUDGET == 0) {
+    log_i("Job cache disabled");
+    return true;
+  }
+  cacheLock = xSemaphoreCreateMutex();
+  replayQueue = xQueueCreate(PRINT_QUEUE_DEPTH * MAX_PRINTERS, sizeof(ReplayRequest));
+  if (cacheLock == nullptr || replayQueue == nullptr) {
+    log_e("Job cache: out of memory");
+    return false;
+  }
+
+  if (!LittleFS.exists(JOB_CACHE_DIR)) {
+    LittleFS.mkdir(JOB_CACHE_DIR);
+  }
+  File dir = LittleFS.open(JOB_CACHE_DIR);
+  if (dir && dir.isDirectory()) {
+    for (File file = dir.openNextFile(); file; file = dir.openNextFile()) {
+      indexFile(file);
+    }
+    dir.close();
+  }
+
+  // Keep within a budget that shrank since the jobs were stored
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  if (cachedBytes() > JOB_CACHE_BUDGET) {
+    makeRoom(0);
+  }
+  size_t count = 0;
+  for (size_t i = 0; i < JOB_CACHE_ENTRIES; i++) {
+    count += entries[i].used;
+  }
+  log_i("Job cache: %u jobs, %u of %u bytes", count, cachedBytes(), JOB_CACHE_BUDGET);
+  xSemaphoreGive(cacheLock);
+
+  if (xTaskCreatePinnedToCore(replayTask, "jobReplay", 4096, nullptr, JOB_CACHE_PRIORITY, nullptr,
+                              JOB_CACHE_CORE) != pdPASS) {
+    log_e("Failed to start job replay task");
+    return false;
+  }
+  return true;
+}
+
+bool jobCacheLookup(const String& hash, size_t& length) {
+  if (cacheLock == nullptr || !isJobHash(hash)) {
+    return false;
+  }
+  char key[JOB_HASH_LENGTH + 1];
+  lowerHash(hash, key);
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  CacheEntry* entry = findEntry(key);
+  if (entry != nullptr) {
+    length = entry->length;
+  }
+  xSemaphoreGive(cacheLock);
+  return entry != nullptr;
+}
+
+bool lastCachedJob(String& hash) {
+  if (cacheLock == nullptr) {
+    return false;
+  }
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  const CacheEntry* latest = nullptr;
+  for (size_t i = 0; i < JOB_CACHE_ENTRIES; i++) {
+    if (entries[i].used && (latest == nullptr || entries[i].lastUse > latest->lastUse)) {
+      latest = &entries[i];
+    }
+  }
+  if (latest != nullptr) {
+    hash = latest->hash;
+  }
+  xSemaphoreGive(cacheLock);
+  return latest != nullptr;
+}
+
+void forEachCachedJob(void (*fn)(const char* hash, size_t length, void* context), void* context) {
+  if (cacheLock == nullptr) {
+    return;
+  }
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  // Insertion sort of the used entries; those indexed at boot all share lastUse 0
+  uint8_t order[JOB_CACHE_ENTRIES];
+  size_t count = 0;
+  for (size_t i = 0; i < JOB_CACHE_ENTRIES; i++) {
+    if (!entries[i].used) {
+      continue;
+    }
+    size_t at = count++;
+    while (at > 0 && entries[order[at - 1]].lastUse < entries[i].lastUse) {
+      order[at] = order[at - 1];
+      at--;
+    }
+    order[at] = i;
+  }
+  for (size_t i = 0; i < count; i++) {
+    fn(entries[order[i]].hash, entries[order[i]].length, context);
+  }
+  xSemaphoreGive(cacheLock);
+}
+
+bool replayCachedJob(const String& hash, uint32_t jobId) {
+  if (cacheLock == nullptr || !isJobHash(hash)) {
+    return false;
+  }
+  char key[JOB_HASH_LENGTH + 1];
+  lowerHash(hash, key);
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  CacheEntry* entry = findEntry(key);
+  if (entry == nullptr) {
+    xSemaphoreGive(cacheLock);
+    return false;
+  }
+  entry->readers++;
+  entry->lastUse = ++useCounter;
+  size_t length = entry->length;
+  ReplayRequest request = {jobId, (uint8_t)(entry - entries)};
+  bool queued = xQueueSend(replayQueue, &request, 0) == pdTRUE;
+  if (!queued) {
+    entry->readers--;
+  }
+  xSemaphoreGive(cacheLock);
+  if (queued) {
+    log_i("Job %u replays cached %.12s, %u bytes", jobId, key, length);
+  }
+  return queued;
+}
+
+JobCacheRecorder::~JobCacheRecorder() {
+  discard();
+}
+
+bool JobCacheRecorder::begin(const String& hash) {
+  discard();
+  if (cacheLock == nullptr || !isJobHash(hash)) {
+    return false;
+  }
+  lowerHash(hash, _hash);
+
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  _path = String(JOB_CACHE_DIR) + "/" + String(tempCounter++) + ".tmp";
+  xSemaphoreGive(cacheLock);
+  _file = LittleFS.open(_path, "w");
+  if (!_file || _file.write((const uint8_t*)_hash, JOB_HASH_LENGTH) != JOB_HASH_LENGTH) {
+    _file.close();
+    LittleFS.remove(_path);
+    return false;
+  }
+
+  mbedtls_sha256_init(&_sha);
+  mbedtls_sha256_starts(&_sha, 0);
+  _length = 0;
+  _active = true;
+  return true;
+}
+
+void JobCacheRecorder::write(const uint8_t* data, size_t length) {
+  if (!_active) {
+    return;
+  }
+  if (_length + length + JOB_HASH_LENGTH > JOB_CACHE_BUDGET || _file.write(data, length) != length) {
+    discard();
+    return;
+  }
+  mbedtls_sha256_update(&_sha, data, length);
+  _length += length;
+}
+
+bool JobCacheRecorder::commit() {
+  if (!_active) {
+    return false;
+  }
+  uint8_t digest[32];
+  mbedtls_sha256_finish(&_sha, digest);
+  char hex[JOB_HASH_LENGTH + 1];
+  for (size_t i = 0; i < sizeof(digest); i++) {
+    snprintf(hex + i * 2, 3, "%02x", digest[i]);
+  }
+  if (strcmp(hex, _hash) != 0) {
+    log_w("Job hash %.12s doesn't match the upload (%.12s), not cached", _hash, hex);
+    discard();
+    return false;
+  }
+  _file.close();
+
+  xSemaphoreTake(cacheLock, portMAX_DELAY);
+  bool cached = findEntry(_hash) != nullptr;
+  String path = entryPath(_hash);
+  CacheEntry* slot = nullptr;
+  // Another job that shares the file name keeps its place
+  if (!cached && !LittleFS.exists(path)) {
+    slot = makeRoom(_length + JOB_HASH_LENGTH);
+  }
+  if (slot != nullptr && LittleFS.rename(_path, path)) {
+    slot->used = true;
+    memcpy(slot->hash, _hash, sizeof(slot->hash));
+    slot->length = _length;
+    slot->lastUse = ++useCounter;
+    slot->readers = 0;
+    cached = true;
+    log_i("Job cache stored %.12s, %u bytes", _hash, _length);
+  }
+  xSemaphoreGive(cacheLock);
+
+  if (slot == nullptr || !cached) {
+    LittleFS.remove(_path);
+  }
+  mbedtls_sha256_free(&_sha);
+  _active = false;
+  return cached;
+}
+
+void JobCacheRecorder::discard() {
+  if (!_active) {
+    return;
+  }
+  _file.close();
+  LittleFS.remove(_path);
+  mbedtls_sha256_free(&_sha);
+  _active = false;
+}
@@ -0,0 +1,105 @@
+#include "job_panel.h"
+
+static const int16_t TITLE_HEIGHT = 22;
+static const int16_t ROW_HEIGHT = 12;
+static const int16_t BUTTON_HEIGHT = 40;
+static const int16_t BUTTON_GAP = 6;
+static const JobPanelAction ACTIONS[] = {PANEL_CANCEL, PANEL_PAUSE, PANEL_REPRINT};
+
+void JobPanel::begin(TFT_eSPI* tft) {
+  _tft = tft;
+  strcpy(_labels[0], "Cancel");
+  strcpy(_labels[1], "Pause");
+  strcpy(_labels[2], "Reprint");
+  int16_t width = (tft->width() - BUTTON_GAP * (CONTROLS + 1)) / CONTROLS;
+  int16_t top = tft->height() - BUTTON_HEIGHT - BUTTON_GAP;
+  for (uint8_t i = 0; i < CONTROLS; i++) {
+    _buttons[i].initButtonUL(tft, BUTTON_GAP + i * (width + BUTTON_GAP), top, width, BUTTON_HEIGHT,
+                             TFT_WHITE, TFT_DARKGREY, TFT_WHITE, _labels[i], 2);
+  }
+}
+
+void JobPanel::open() {
+  _open = true;
+  _fresh = true;
+  _selected = 0;
+  _lastInput = millis();
+}
+
+void JobPanel::next() {
+  _selected = (_selected + 1) % CONTROLS;
+  _lastInput = millis();
+}
+
+JobPanelAction JobPanel::activate() {
+  _lastInput = millis();
+  return ACTIONS[_selected];
+}
+
+JobPanelAction JobPanel::touch(bool pressed, int16_t x, int16_t y) {
+  if (pressed) {
+    _lastInput = millis();
+  }
+  JobPanelAction action = PANEL_NONE;
+  for (uint8_t i = 0; i < CONTROLS; i++) {
+    _buttons[i].press(pressed && _buttons[i].contains(x, y));
+    if (_buttons[i].justPressed()) {
+      _selected = i;
+    }
+    if (_buttons[i].justReleased()) {
+      action = ACTIONS[i];
+    }
+  }
+  return action;
+}
+
+void JobPanel::draw(const PrintJobInfo* jobs, size_t count, bool paused) {
+  if (!_tft) {
+    return;
+  }
+  if (_fresh) {
+    _tft->fillScreen(TFT_BLACK);
+    _title.invalidate();
+    for (TextRun& row : _rows) {
+      row.invalidate();
+    }
+    _drawnSelected = 0xFF;
+    _drawnPaused = -1;
+    _fresh = false;
+  }
+
+  // Title and queue; each line rewrites only the glyphs that changed
+  _tft->setTextSize(2);
+  char line[48];
+  snprintf(line, sizeof(line), "Jobs: %u%s", (unsigned)count, paused ? " (paused)" : "");
+  _title.set(line);
+  _title.draw(*_tft, 0, 0, TL_DATUM, paused ? TFT_YELLOW : TFT_WHITE, TFT_BLACK);
+
+  _tft->setTextSize(1);
+  for (uint8_t row = 0; row < JOB_PANEL_ROWS; row++) {
+    line[0] = '\0';
+    if (row < count) {
+      const PrintJobInfo& job = jobs[row];
+      if (job.total > 0) {
+        snprintf(line, sizeof(line), "#%u  printer %u  %s  %u/%u KB", (unsigned)job.id, (unsigned)job.printer,
+                 printJobStateName(job.state), (unsigned)(job.sent / 1024), (unsigned)(job.total / 1024));
+      } else {
+        snprintf(line, sizeof(line), "#%u  printer %u  %s  %u KB", (unsigned)job.id, (unsigned)job.printer,
+                 printJobStateName(job.state), (unsigned)(job.sent / 1024));
+      }
+    }
+    _rows[row].set(line);
+    _rows[row].draw(*_tft, 0, TITLE_HEIGHT + row * ROW_HEIGHT, TL_DATUM,
+                    row == 0 && count > 0 ? TFT_GREEN : TFT_WHITE, TFT_BLACK);
+  }
+
+  // Controls only when the selection or the pause label changed
+  if (_drawnSelected != _selected || _drawnPaused != (int8_t)paused) {
+    for (uint8_t i = 0; i < CONTROLS; i++) {
+      bool pauseLabel = i == 1;
+      _buttons[i].drawButton(i == _selected, pauseLabel ? String(paused ? "Resume" : "Pause") : String(""));
+    }
+    _drawnSelected = _selected;
+    _drawnPaused = paused;
+  }
+}
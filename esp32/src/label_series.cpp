@@ -0,0 +1,148 @@
+#include "label_series.h"
+#include "heap_stats.h"
+#include "print_writer.h"
+
+static QueueHandle_t pending = nullptr;
+
+bool validSeriesFormat(const char* format) {
+  size_t counters = 0;
+  for (const char* p = format; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\') {
+      return false;
+    }
+    if (*p != '%') {
+      continue;
+    }
+    p++;
+    if (*p == '%') {
+      continue;
+    }
+    if (*p == '0') {
+      p++;
+    }
+    for (size_t digits = 0; isdigit((unsigned char)*p); p++) {
+      if (++digits > 2) {
+        return false;
+      }
+    }
+    if (*p != 'd') {
+      return false;
+    }
+    counters++;
+  }
+  return counters == 1;
+}
+
+// The format with its %d replaced by value; only for a valid format
+static String formatCounter(const char* format, int32_t value) {
+  String out;
+  for (const char* p = format; *p != '\0'; p++) {
+    if (*p != '%') {
+      out += *p;
+      continue;
+    }
+    p++;
+    if (*p == '%') {
+      out += '%';
+      continue;
+    }
+    bool zero = *p == '0';
+    if (zero) {
+      p++;
+    }
+    int width = 0;
+    for (; isdigit((unsigned char)*p); p++) {
+      width = width * 10 + (*p - '0');
+    }
+    char number[24];
+    snprintf(number, sizeof(number), zero ? "%0*ld" : "%*ld", width, (long)value);
+    out += number;
+  }
+  return out;
+}
+
+LabelResult printSeriesLabel(const LabelSeries& series, uint32_t index, ImageOutput output, void* context,
+                             String& detail) {
+  // The counter goes in front, where it wins over a field of the same name
+  const char* rest = series.body;
+  const char* end = series.body + series.length;
+  while (rest < end && isspace((unsigned char)*rest)) {
+    rest++;
+  }
+  if (rest == end || *rest != '{') {
+    detail = "fields";
+    return LABEL_INVALID;
+  }
+  rest++;
+  const char* next = rest;
+  while (next < end && isspace((unsigned char)*next)) {
+    next++;
+  }
+
+  String json = "{\"" + series.field + "\":\"" +
+                formatCounter(series.format, series.start + (int32_t)index * series.step) + "\"";
+  if (next < end && *next != '}') {
+    json += ",";
+  }
+  json.concat(rest, end - rest);
+  return printLabelTemplate(series.name, json.c_str(), json.length(), series.options,
+                            series.hasPrinter ? &series.printer : nullptr, output, context, detail);
+}
+
+// Waits on the job buffer for as long as the printer takes, like the job
+// cache replay, until the job fails or is cancelled
+static bool appendSeries(void* context, const uint8_t* data, size_t length) {
+  return appendPrintJobWait(*(uint32_t*)context, data, length);
+}
+
+static void runSeries(LabelSeries& series) {
+  uint32_t jobId = series.jobId;
+  for (uint32_t i = 1; i < series.count; i++) {
+    if (printJobFailed(jobId)) {
+      log_i("Job %u series stopped after %u of %u labels", jobId, i, series.count);
+      return;
+    }
+    String detail;
+    LabelResult result = printSeriesLabel(series, i, appendSeries, &jobId, detail);
+    if (result != LABEL_OK) {
+      if (!printJobFailed(jobId)) {
+        log_e("Job %u series label %u: %s %s", jobId, i, labelResultName(result), detail.c_str());
+        abortPrintJob(jobId);
+      }
+      return;
+    }
+  }
+  finishPrintJob(jobId);
+  log_i("Job %u series of %u labels rendered", jobId, series.count);
+}
+
+static void seriesTask(void* param) {
+  (void)param;
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  LabelSeries* series;
+  for (;;) {
+    if (xQueueReceive(pending, &series, portMAX_DELAY) == pdTRUE) {
+      runSeries(*series);
+      delete series;
+    }
+  }
+}
+
+bool initLabelSeries() {
+  pending = xQueueCreate(LABEL_SERIES_QUEUE, sizeof(LabelSeries*));
+  if (pending == nullptr) {
+    log_e("Label series: out of memory");
+    return false;
+  }
+  // Templates render on this task, as deep as a web request's
+  if (xTaskCreatePinnedToCore(seriesTask, "labelSeries", 8192, nullptr, LABEL_SERIES_PRIORITY, nullptr,
+                              LABEL_SERIES_CORE) != pdPASS) {
+    log_e("Failed to start label series task");
+    return false;
+  }
+  return true;
+}
+
+bool queueLabelSeries(LabelSeries* series) {
+  return pending != nullptr && xQueueSend(pending, &series, 0) == pdTRUE;
+}
@@ -0,0 +1,1085 @@
+#include "label_template.h"
+
+#include <LittleFS.h>
+#include "heap_stats.h"
+#include "barcode.h"
+#include "sprite_raster.h"
+#include "font_store.h"
+#include "printer_artwork.h"
+
+// Ink colour for the 1-bit sprite. Smooth fonts blend it with black, and the
+// green channel of the blend only stays nonzero from half coverage up, which
+// thresholds anti-aliased edges at 50%.
+static const uint16_t LABEL_INK = 0x0040;
+
+enum LabelElementType : uint8_t {
+  ELEMENT_TEXT,
+  ELEMENT_BARCODE
+};
+
+struct LabelElement {
+  LabelElementType type;
+  int16_t x;
+  int16_t y;
+  String field;
+  String fontName;       // Smooth font on LittleFS, empty for built-in fonts
+  uint8_t font;
+  uint8_t size;
+  uint8_t datum;
+  BarcodeType barcode;
+  uint16_t height;
+  uint8_t module;        // 0 until the default for the type is filled in
+  uint8_t tsplFont;      // Resident TSPL font 1-8 for a text, 0 to rasterize
+  bool tsplBarcode;      // TSPL BARCODE, QRCODE or DMATRIX instead of bars in the raster
+};
+
+// Cell of the resident TSPL fonts 1-8 at 203 dpi; they are fixed pitch, so
+// a text's width is its length in cells. Other resolutions scale them.
+static const struct {
+  uint8_t width;
+  uint8_t height;
+} tsplFontCells[8] = {{8, 12}, {12, 20}, {16, 24}, {24, 32}, {32, 48}, {14, 19}, {21, 27}, {14, 25}};
+
+// Static bitmap that printers keep in their own memory
+struct LabelArtwork {
+  uint16_t x;
+  uint16_t y;
+  PrinterArtwork image;
+  uint8_t* bits;             // Owned; image.bits points here
+};
+
+struct LabelTemplate {
+  String name;
+  time_t lastWrite = 0;
+  size_t fileSize = 0;
+  uint32_t lastUse = 0;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  uint16_t dpi = LABEL_DEFAULT_DPI;
+  bool turn = false;         // Drawn upright, printed turned clockwise
+  uint8_t* base = nullptr;   // Static bitmaps, packed rows of (width + 7) / 8
+  LabelElement elements[LABEL_MAX_ELEMENTS];
+  size_t elementCount = 0;
+  LabelArtwork artwork[LABEL_MAX_ARTWORK];
+  size_t artworkCount = 0;
+  uint32_t generation = 0;   // Changes with every load, 0 while empty
+};
+
+// Rows an element covered when it was last drawn, top <= y < bottom
+struct ElementRows {
+  int32_t top;
+  int32_t bottom;
+};
+
+static LabelTemplate cache[LABEL_CACHED_TEMPLATES];
+static uint32_t useCounter = 0;
+static uint32_t generationCounter = 0;
+
+// The sprite stays composed between jobs. The next label of the same
+// template only recomposes the rows of fields whose values changed.
+static uint32_t renderedGeneration = 0;    // Template in the sprite, 0 for none
+static uint32_t renderedNative = 0;        // Elements the printer draws, left out of the sprite
+static uint32_t nativeElements = 0;        // Those of the label being composed
+static String renderedValues[LABEL_MAX_ELEMENTS];
+static ElementRows renderedRows[LABEL_MAX_ELEMENTS];
+static TFT_eSprite* sprite = nullptr;
+// The sprite's pixels. It only grows, so labels of the usual sizes are
+// composed without allocating once the largest has been seen.
+static uint8_t* spriteArena = nullptr;
+static size_t spriteArenaSize = 0;
+static SemaphoreHandle_t renderLock = nullptr;
+
+const char* labelResultName(LabelResult result) {
+  switch (result) {
+    case LABEL_OK: return "OK";
+    case LABEL_NOT_FOUND: return "Unknown template";
+    case LABEL_INVALID: return "Invalid template or fields";
+    case LABEL_MISSING_FIELD: return "Missing field";
+    case LABEL_NO_MEMORY: return "Out of memory for label";
+    case LABEL_OUTPUT: return "Print job refused label";
+  }
+  return "Unknown error";
+}
+
+void initLabelTemplates(TFT_eSPI* display) {
+  renderLock = xSemaphoreCreateMutex();
+  sprite = new TFT_eSprite(display);
+  sprite->setColorDepth(1);
+}
+
+static void* allocPreferPsram(size_t size) {
+  return heapAlloc(HEAP_SITE_TEMPLATE, size);
+}
+
+// Names from requests and template files stay inside the template directory
+static bool validFileName(const String& name) {
+  if (name.length() == 0 || name.length() > 32 || name[0] == '.') {
+    return false;
+  }
+  for (size_t i = 0; i < name.length(); i++) {
+    char c = name[i];
+    if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Split a template line at whitespace. Returns the number of fields found.
+static size_t splitFields(const String& line, String* fields, size_t maxFields) {
+  size_t count = 0;
+  int pos = 0;
+  int length = line.length();
+  while (pos < length) {
+    while (pos < length && isspace((unsigned char)line[pos])) {
+      pos++;
+    }
+    int start = pos;
+    while (pos < length && !isspace((unsigned char)line[pos])) {
+      pos++;
+    }
+    if (pos > start) {
+      if (count == maxFields) {
+        return maxFields + 1;
+      }
+      fields[count++] = line.substring(start, pos);
+    }
+  }
+  return count;
+}
+
+// Whitespace separated decimal field of a PBM header, skipping comments
+static bool readPbmNumber(File& file, uint32_t& value) {
+  int c = file.read();
+  while (c == '#' || isspace(c)) {
+    if (c == '#') {
+      while (c >= 0 && c != '\n') {
+        c = file.read();
+      }
+    }
+    c = file.read();
+  }
+  if (!isdigit(c)) {
+    return false;
+  }
+  value = 0;
+  while (isdigit(c)) {
+    value = value * 10 + (c - '0');
+    if (value > 0xFFFF) {
+      return false;
+    }
+    c = file.read();
+  }
+  // The single whitespace after the height is the last header byte
+  return isspace(c);
+}
+
+// A PBM (P4) from the template directory, read up to its rows
+static bool openPbm(const String& fileName, File& file, uint32_t& width, uint32_t& height) {
+  file = LittleFS.open(String(LABEL_TEMPLATE_DIR) + "/" + fileName, "r");
+  if (!file) {
+    return false;
+  }
+  width = 0;
+  height = 0;
+  if (file.read() != 'P' || file.read() != '4' || !readPbmNumber(file, width) || !readPbmNumber(file, height) ||
+      width == 0 || height == 0) {
+    file.close();
+    return false;
+  }
+  return true;
+}
+
+// OR a PBM (P4) into the base raster with its top left corner at x, y,
+// clipped to the label
+static bool drawPbm(LabelTemplate& entry, const String& fileName, int32_t x, int32_t y) {
+  File file;
+  uint32_t width, height;
+  if (!openPbm(fileName, file, width, height)) {
+    return false;
+  }
+  if (x < 0 || y < 0) {
+    file.close();
+    return false;
+  }
+
+  size_t srcBytes = (width + 7) / 8;
+  size_t destBytes = (entry.width + 7) / 8;
+  uint8_t* row = (uint8_t*)malloc(srcBytes);
+  if (row == nullptr) {
+    file.close();
+    return false;
+  }
+  uint8_t shift = x & 7;
+  size_t firstByte = x / 8;
+  bool ok = true;
+  for (uint32_t r = 0; r < height && y + r < entry.height; r++) {
+    if (file.read(row, srcBytes) != srcBytes) {
+      ok = false;
+      break;
+    }
+    if (width & 7) {
+      row[srcBytes - 1] &= 0xFF << (8 - (width & 7));
+    }
+    uint8_t* dest = entry.base + (y + r) * destBytes;
+    for (size_t b = 0; b < srcBytes && firstByte + b < destBytes; b++) {
+      dest[firstByte + b] |= row[b] >> shift;
+      if (shift != 0 && firstByte + b + 1 < destBytes) {
+        dest[firstByte + b + 1] |= row[b] << (8 - shift);
+      }
+    }
+  }
+  // Ink past the right edge of the label is dropped
+  if (entry.width & 7) {
+    uint8_t mask = 0xFF << (8 - (entry.width & 7));
+    for (uint16_t r = 0; r < entry.height; r++) {
+      entry.base[r * destBytes + destBytes - 1] &= mask;
+    }
+  }
+  free(row);
+  file.close();
+  return ok;
+}
+
+// Read a PBM as stored artwork. It has to lie wholly on the label.
+static bool loadArtwork(LabelTemplate& entry, const String& fileName, int32_t x, int32_t y) {
+  File file;
+  uint32_t width, height;
+  if (entry.artworkCount == LABEL_MAX_ARTWORK || !openPbm(fileName, file, width, height)) {
+    return false;
+  }
+  if (x < 0 || y < 0 || x + width > entry.width || y + height > entry.height) {
+    file.close();
+    return false;
+  }
+  size_t bytes = (width + 7) / 8 * height;
+  uint8_t* bits = (uint8_t*)allocPreferPsram(bytes);
+  bool ok = bits != nullptr && file.read(bits, bytes) == bytes;
+  file.close();
+  if (!ok) {
+    heapFree(bits);
+    return false;
+  }
+  if (width & 7) {
+    size_t rowBytes = (width + 7) / 8;
+    for (uint32_t r = 0; r < height; r++) {
+      bits[r * rowBytes + rowBytes - 1] &= 0xFF << (8 - (width & 7));
+    }
+  }
+  LabelArtwork& art = entry.artwork[entry.artworkCount++];
+  art.x = x;
+  art.y = y;
+  art.bits = bits;
+  art.image = {(uint16_t)width, (uint16_t)height, bits, artworkHash(width, height, bits)};
+  return true;
+}
+
+// Length in dots, or in mm with an "mm" suffix
+static bool parseDots(const String& value, uint16_t dpi, uint32_t& dots) {
+  if (value.endsWith("mm")) {
+    float mm = value.substring(0, value.length() - 2).toFloat();
+    if (mm <= 0) {
+      return false;
+    }
+    dots = barcodeDots(mm, dpi);
+    return true;
+  }
+  dots = value.toInt();
+  return dots > 0;
+}
+
+// key=value options after the field name of text and barcode lines
+static bool parseElementOption(LabelElement& element, const String& option, uint16_t dpi) {
+  int eq = option.indexOf('=');
+  if (eq <= 0) {
+    return false;
+  }
+  String key = option.substring(0, eq);
+  String value = option.substring(eq + 1);
+  if (element.type == ELEMENT_TEXT && key == "font") {
+    if (value.length() > 0 && isdigit((unsigned char)value[0])) {
+      element.font = value.toInt();
+      return element.font >= 1 && element.font <= 8;
+    }
+    element.fontName = value;
+    return LittleFS.exists("/" + value + ".vlw");
+  }
+  if (element.type == ELEMENT_TEXT && key == "size") {
+    element.size = value.toInt();
+    return element.size >= 1 && element.size <= 7;
+  }
+  if (element.type == ELEMENT_TEXT && key == "align") {
+    if (value == "left") {
+      element.datum = TL_DATUM;
+    } else if (value == "center") {
+      element.datum = TC_DATUM;
+    } else if (value == "right") {
+      element.datum = TR_DATUM;
+    } else {
+      return false;
+    }
+    return true;
+  }
+  if (element.type == ELEMENT_TEXT && key == "tspl_font") {
+    element.tsplFont = value.toInt();
+    return element.tsplFont >= 1 && element.tsplFont <= 8;
+  }
+  if (element.type == ELEMENT_BARCODE && key == "type") {
+    return parseBarcodeType(value, element.barcode);
+  }
+  if (element.type == ELEMENT_BARCODE && key == "tspl") {
+    element.tsplBarcode = value == "1";
+    return value == "0" || value == "1";
+  }
+  uint32_t dots = 0;
+  if (element.type == ELEMENT_BARCODE && key == "height") {
+    if (!parseDots(value, dpi, dots) || dots > LABEL_MAX_DOTS) {
+      return false;
+    }
+    element.height = dots;
+    return true;
+  }
+  if (element.type == ELEMENT_BARCODE && key == "module") {
+    if (!parseDots(value, dpi, dots) || dots > 16) {
+      return false;
+    }
+    element.module = dots;
+    return true;
+  }
+  return false;
+}
+
+static void releaseTemplate(LabelTemplate& entry) {
+  heapFree(entry.base);
+  entry.base = nullptr;
+  for (size_t a = 0; a < entry.artworkCount; a++) {
+    heapFree(entry.artwork[a].bits);
+  }
+  entry.artworkCount = 0;
+  entry.name = String();
+  entry.elementCount = 0;
+  entry.generation = 0;
+}
+
+// Parse the template file and compose its static bitmaps
+static LabelResult loadTemplate(LabelTemplate& entry, File& file, String& detail) {
+  entry.width = 0;
+  entry.height = 0;
+  entry.elementCount = 0;
+  entry.artworkCount = 0;
+  uint16_t lineNumber = 0;
+
+  while (file.available()) {
+    String line = file.readStringUntil('\n');
+    lineNumber++;
+    line.trim();
+    if (line.length() == 0 || line.startsWith("#")) {
+      continue;
+    }
+    detail = "line " + String(lineNumber);
+
+    String fields[8];
+    size_t count = splitFields(line, fields, 8);
+    if (count > 8) {
+      return LABEL_INVALID;
+    }
+
+    if (fields[0] == "size") {
+      uint32_t width = fields[1].toInt();
+      uint32_t height = fields[2].toInt();
+      entry.dpi = LABEL_DEFAULT_DPI;
+      entry.turn = false;
+      for (size_t i = 3; i < count; i++) {
+        if (fields[i].startsWith("dpi=")) {
+          entry.dpi = fields[i].substring(4).toInt();
+        } else if (fields[i] == "rotate=90") {
+          entry.turn = true;
+        } else {
+          return LABEL_INVALID;
+        }
+      }
+      if (count < 3 || count > 5 || entry.base != nullptr || width == 0 || height == 0 ||
+          width > LABEL_MAX_DOTS || height > LABEL_MAX_DOTS || entry.dpi < 100 || entry.dpi > 600) {
+        return LABEL_INVALID;
+      }
+      entry.width = width;
+      entry.height = height;
+      size_t bytes = (width + 7) / 8 * height;
+      entry.base = (uint8_t*)allocPreferPsram(bytes);
+      if (entry.base == nullptr) {
+        return LABEL_NO_MEMORY;
+      }
+      memset(entry.base, 0, bytes);
+      continue;
+    }
+
+    // Everything else is placed on a label of known size
+    if (entry.base == nullptr || count < 4) {
+      return LABEL_INVALID;
+    }
+    int32_t x = fields[1].toInt();
+    int32_t y = fields[2].toInt();
+
+    if (fields[0] == "bitmap") {
+      // Stored artwork is placed by the printer, which doesn't turn it
+      bool stored = count == 5 && fields[4] == "stored";
+      if ((count != 4 && !stored) || !validFileName(fields[3]) || (stored && entry.turn)) {
+        return LABEL_INVALID;
+      }
+      if (!(stored ? loadArtwork(entry, fields[3], x, y) : drawPbm(entry, fields[3], x, y))) {
+        return LABEL_INVALID;
+      }
+      continue;
+    }
+
+    if ((fields[0] != "text" && fields[0] != "barcode") || entry.elementCount == LABEL_MAX_ELEMENTS) {
+      return LABEL_INVALID;
+    }
+    LabelElement& element = entry.elements[entry.elementCount];
+    element.type = fields[0] == "text" ? ELEMENT_TEXT : ELEMENT_BARCODE;
+    element.x = x;
+    element.y = y;
+    element.field = fields[3];
+    element.fontName = String();
+    element.font = 2;
+    element.size = 1;
+    element.datum = TL_DATUM;
+    element.barcode = BARCODE_CODE128;
+    element.height = barcodeDots(LABEL_BARCODE_HEIGHT_MM, entry.dpi);
+    element.module = 0;
+    element.tsplFont = 0;
+    element.tsplBarcode = false;
+    for (size_t i = 4; i < count; i++) {
+      if (!parseElementOption(element, fields[i], entry.dpi)) {
+        return LABEL_INVALID;
+      }
+    }
+    // Scanners need wider modules for 2D symbols than for bars
+    if (element.module == 0) {
+      bool matrix = element.barcode == BARCODE_QR || element.barcode == BARCODE_DATAMATRIX;
+      element.module = barcodeDots(matrix ? LABEL_MATRIX_MODULE_MM : LABEL_BAR_MODULE_MM, entry.dpi);
+    }
+    entry.elementCount++;
+  }
+
+  detail = String();
+  return entry.base != nullptr ? LABEL_OK : LABEL_INVALID;
+}
+
+// Cached template of that name, reloaded when its file changed
+static LabelResult findTemplate(const String& name, LabelTemplate*& found, String& detail) {
+  if (!validFileName(name)) {
+    return LABEL_NOT_FOUND;
+  }
+  File file = LittleFS.open(String(LABEL_TEMPLATE_DIR) + "/" + name + ".tpl", "r");
+  if (!file) {
+    return LABEL_NOT_FOUND;
+  }
+  time_t lastWrite = file.getLastWrite();
+  size_t fileSize = file.size();
+
+  LabelTemplate* slot = &cache[0];
+  for (size_t i = 0; i < LABEL_CACHED_TEMPLATES; i++) {
+    if (cache[i].base != nullptr && cache[i].name == name) {
+      slot = &cache[i];
+      break;
+    }
+    if (cache[i].lastUse < slot->lastUse) {
+      slot = &cache[i];
+    }
+  }
+  slot->lastUse = ++useCounter;
+  found = slot;
+
+  if (slot->base != nullptr && slot->name == name && slot->lastWrite == lastWrite && slot->fileSize == fileSize) {
+    file.close();
+    return LABEL_OK;
+  }
+
+  releaseTemplate(*slot);
+  LabelResult result = loadTemplate(*slot, file, detail);
+  file.close();
+  if (result != LABEL_OK) {
+    releaseTemplate(*slot);
+    return result;
+  }
+  slot->name = name;
+  slot->lastWrite = lastWrite;
+  slot->fileSize = fileSize;
+  slot->generation = ++generationCounter;
+  log_i("Label template '%s' loaded: %ux%u dots, %u fields", name.c_str(), slot->width, slot->height,
+        slot->elementCount);
+  return LABEL_OK;
+}
+
+// Four hex digits of a \u escape
+static bool readHex4(const char* p, const char* end, uint32_t& value) {
+  if (end - p < 4) {
+    return false;
+  }
+  value = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    char c = p[i];
+    value <<= 4;
+    if (c >= '0' && c <= '9') {
+      value |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      value |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      value |= c - 'A' + 10;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void appendUtf8(String& text, uint32_t code) {
+  if (code < 0x80) {
+    text += (char)code;
+  } else if (code < 0x800) {
+    text += (char)(0xC0 | (code >> 6));
+    text += (char)(0x80 | (code & 0x3F));
+  } else {
+    text += (char)(0xE0 | (code >> 12));
+    text += (char)(0x80 | ((code >> 6) & 0x3F));
+    text += (char)(0x80 | (code & 0x3F));
+  }
+}
+
+static const char* skipSpace(const char* p, const char* end) {
+  while (p < end && isspace((unsigned char)*p)) {
+    p++;
+  }
+  return p;
+}
+
+// JSON string at p, which points at the opening quote
+static const char* parseString(const char* p, const char* end, String& out) {
+  out = String();
+  p++;
+  while (p < end && *p != '"') {
+    if (*p != '\\') {
+      out += *p++;
+      continue;
+    }
+    if (++p == end) {
+      return nullptr;
+    }
+    char c = *p++;
+    switch (c) {
+      case 'n': out += '\n'; break;
+      case 't': out += '\t'; break;
+      case 'r': out += '\r'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'u': {
+        uint32_t code;
+        if (!readHex4(p, end, code)) {
+          return nullptr;
+        }
+        p += 4;
+        appendUtf8(out, code);
+        break;
+      }
+      default: out += c; break;
+    }
+  }
+  return p < end ? p + 1 : nullptr;
+}
+
+// Flat JSON object of string or number values
+static bool parseFields(const char* json, size_t length, String* names, String* values, size_t& count) {
+  const char* p = json;
+  const char* end = json + length;
+  count = 0;
+  p = skipSpace(p, end);
+  if (p == end || *p++ != '{') {
+    return false;
+  }
+  p = skipSpace(p, end);
+  if (p < end && *p == '}') {
+    return true;
+  }
+  while (p < end) {
+    if (*p != '"' || count == LABEL_MAX_FIELDS) {
+      return false;
+    }
+    p = parseString(p, end, names[count]);
+    if (p == nullptr) {
+      return false;
+    }
+    p = skipSpace(p, end);
+    if (p == end || *p++ != ':') {
+      return false;
+    }
+    p = skipSpace(p, end);
+    if (p < end && *p == '"') {
+      p = parseString(p, end, values[count]);
+      if (p == nullptr) {
+        return false;
+      }
+    } else {
+      const char* start = p;
+      while (p < end && (isdigit((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')) {
+        p++;
+      }
+      if (p == start) {
+        return false;
+      }
+      values[count] = String();
+      values[count].concat(start, p - start);
+    }
+    count++;
+    p = skipSpace(p, end);
+    if (p < end && *p == ',') {
+      p = skipSpace(p + 1, end);
+      continue;
+    }
+    return p < end && *p == '}';
+  }
+  return false;
+}
+
+// Draw one variable element over what the sprite holds and note its rows
+static LabelResult drawElement(const LabelElement& element, const String& value, ElementRows& rows,
+                               String& detail) {
+  if (element.type == ELEMENT_BARCODE) {
+    uint16_t height = 0;
+    if (!drawBarcode(*sprite, element.barcode, element.x, element.y, value, element.module, element.height,
+                     nullptr, &height)) {
+      detail = element.field;
+      return LABEL_INVALID;
+    }
+    rows.top = element.y;
+    rows.bottom = element.y + height;
+    return LABEL_OK;
+  }
+
+  // Smooth fonts are drawn from their copy in the font partition, or read
+  // from LittleFS while drawing without one
+  if (element.fontName.length() > 0) {
+    const uint8_t* mapped = mappedFont("/" + element.fontName + ".vlw");
+    if (mapped != nullptr) {
+      sprite->loadFont(mapped);
+    } else {
+      sprite->loadFont(element.fontName, LittleFS);
+    }
+    if (!sprite->fontLoaded) {
+      detail = element.fontName;
+      return LABEL_INVALID;
+    }
+  } else {
+    sprite->setTextFont(element.font);
+    sprite->setTextSize(element.size);
+  }
+  sprite->setTextColor(LABEL_INK, TFT_BLACK);
+  sprite->setTextDatum(element.datum);
+  sprite->drawString(value, element.x, element.y);
+  rows.top = element.y;
+  rows.bottom = element.y + sprite->fontHeight();
+  if (element.fontName.length() > 0) {
+    sprite->unloadFont();
+  }
+  return LABEL_OK;
+}
+
+static bool rowsOverlap(const ElementRows& a, const ElementRows& b) {
+  return a.top < b.bottom && b.top < a.bottom;
+}
+
+// Copy rows of the base raster back over the sprite
+static void restoreRows(const LabelTemplate& entry, const ElementRows& rows) {
+  int32_t top = rows.top < 0 ? 0 : rows.top;
+  int32_t bottom = rows.bottom > entry.height ? entry.height : rows.bottom;
+  if (top >= bottom) {
+    return;
+  }
+  size_t rowBytes = (entry.width + 7) / 8;
+  memcpy((uint8_t*)sprite->getPointer() + top * rowBytes, entry.base + top * rowBytes, (bottom - top) * rowBytes);
+}
+
+// Compose the whole label: the base raster and every element over it
+static LabelResult composeLabel(const LabelTemplate& entry, const String** values, String& detail) {
+  memcpy(sprite->getPointer(), entry.base, (entry.width + 7) / 8 * entry.height);
+  for (size_t e = 0; e < entry.elementCount; e++) {
+    if (nativeElements & (1u << e)) {
+      renderedRows[e] = {0, 0};
+      continue;
+    }
+    LabelResult result = drawElement(entry.elements[e], *values[e], renderedRows[e], detail);
+    if (result != LABEL_OK) {
+      return result;
+    }
+    renderedValues[e] = *values[e];
+  }
+  return LABEL_OK;
+}
+
+// Recompose only the rows of changed elements on the label of the last job.
+// Elements sharing rows with a changed one are redrawn too, and so on, so
+// every element that is redrawn lies wholly inside the restored rows and
+// the rest of the sprite stays as it was. Returns false when an element now
+// reaches outside its old rows; the caller composes the whole label then.
+static bool updateLabel(const LabelTemplate& entry, const String** values, LabelResult& result, String& detail) {
+  bool redraw[LABEL_MAX_ELEMENTS];
+  size_t count = 0;
+  for (size_t e = 0; e < entry.elementCount; e++) {
+    redraw[e] = !(nativeElements & (1u << e)) && renderedValues[e] != *values[e];
+    count += redraw[e];
+  }
+  if (count == 0) {
+    result = LABEL_OK;
+    return true;
+  }
+
+  bool grown = true;
+  while (grown) {
+    grown = false;
+    for (size_t e = 0; e < entry.elementCount; e++) {
+      for (size_t other = 0; !redraw[e] && other < entry.elementCount; other++) {
+        if (redraw[other] && rowsOverlap(renderedRows[e], renderedRows[other])) {
+          redraw[e] = true;
+          grown = true;
+        }
+      }
+    }
+  }
+
+  for (size_t e = 0; e < entry.elementCount; e++) {
+    if (redraw[e]) {
+      restoreRows(entry, renderedRows[e]);
+    }
+  }
+  for (size_t e = 0; e < entry.elementCount; e++) {
+    if (!redraw[e]) {
+      continue;
+    }
+    ElementRows rows;
+    result = drawElement(entry.elements[e], *values[e], rows, detail);
+    if (result != LABEL_OK) {
+      return true;
+    }
+    if (rows.top < renderedRows[e].top || rows.bottom > renderedRows[e].bottom) {
+      return false;
+    }
+    renderedRows[e] = rows;
+    renderedValues[e] = *values[e];
+  }
+  return true;
+}
+
+// OR stored artwork into the sprite, to be sent with the raster
+static void drawArtwork(const LabelTemplate& entry, const LabelArtwork& art) {
+  uint8_t* image = (uint8_t*)sprite->getPointer();
+  size_t destBytes = (entry.width + 7) / 8;
+  size_t srcBytes = (art.image.width + 7) / 8;
+  uint8_t shift = art.x & 7;
+  for (uint16_t r = 0; r < art.image.height; r++) {
+    const uint8_t* src = art.bits + r * srcBytes;
+    uint8_t* dest = image + (art.y + r) * destBytes + art.x / 8;
+    for (size_t b = 0; b < srcBytes; b++) {
+      dest[b] |= src[b] >> shift;
+      if (shift != 0 && art.x / 8 + b + 1 < destBytes) {
+        dest[b + 1] |= src[b] << (8 - shift);
+      }
+    }
+  }
+}
+
+// ESC/POS prints stored artwork as a block between raster rows: nothing
+// else may share its rows
+static bool rowsFree(const LabelTemplate& entry, size_t a, const bool* stored) {
+  const LabelArtwork& art = entry.artwork[a];
+  for (size_t other = 0; other < entry.artworkCount; other++) {
+    const LabelArtwork& o = entry.artwork[other];
+    if (other != a && stored[other] && o.y < art.y + art.image.height && art.y < o.y + o.image.height) {
+      return false;
+    }
+  }
+  size_t rowBytes = (entry.width + 7) / 8;
+  const uint8_t* rows = (const uint8_t*)sprite->getPointer() + art.y * rowBytes;
+  for (size_t i = 0; i < art.image.height * rowBytes; i++) {
+    if (rows[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Text and barcodes the TSPL printer draws itself, with its resident fonts
+// and symbologies. Turned labels and negatives are rasterized whole.
+static bool nativeElement(const LabelTemplate& entry, const LabelElement& element,
+                          const ImageRasterOptions& options) {
+  if (options.commands != IMAGE_TSPL || entry.turn || options.invert) {
+    return false;
+  }
+  return element.type == ELEMENT_TEXT ? element.tsplFont != 0 : element.tsplBarcode;
+}
+
+static bool nativeValueValid(const LabelElement& element, const String& value) {
+  if (element.type == ELEMENT_TEXT) {
+    return true;
+  }
+  switch (element.barcode) {
+    case BARCODE_EAN13:
+      for (size_t i = 0; i < value.length(); i++) {
+        if (!isdigit((unsigned char)value[i])) {
+          return false;
+        }
+      }
+      return value.length() == 12 || value.length() == 13;
+    case BARCODE_CODE128:
+      return value.length() > 0 && value.length() <= BARCODE_MAX_LENGTH;
+    default:
+      return value.length() > 0 && value.length() <= BARCODE_MAX_2D_LENGTH;
+  }
+}
+
+// A TSPL string literal; a quote inside is written \["]
+static String tsplString(const String& value) {
+  String quoted = "\"";
+  for (size_t i = 0; i < value.length(); i++) {
+    if (value[i] == '"') {
+      quoted += "\\[\"]";
+    } else if (value[i] != '\r' && value[i] != '\n') {
+      quoted += value[i];
+    }
+  }
+  return quoted + "\"";
+}
+
+static String nativeCommand(const LabelTemplate& entry, const LabelElement& element, const String& value) {
+  String x = String(element.x);
+  String at = "," + String(element.y) + ",";
+  if (element.type == ELEMENT_TEXT) {
+    // Characters, not UTF-8 continuation bytes, take a cell each
+    size_t chars = 0;
+    for (size_t i = 0; i < value.length(); i++) {
+      chars += ((uint8_t)value[i] & 0xC0) != 0x80;
+    }
+    uint32_t cell = (uint32_t)tsplFontCells[element.tsplFont - 1].width * entry.dpi / 203;
+    int32_t width = chars * cell * element.size;
+    int32_t left = element.x;
+    if (element.datum == TC_DATUM) {
+      left -= width / 2;
+    } else if (element.datum == TR_DATUM) {
+      left -= width;
+    }
+    return "TEXT " + String(left < 0 ? 0 : left) + at + "\"" + String(element.tsplFont) + "\",0," +
+           String(element.size) + "," + String(element.size) + "," + tsplString(value) + "\r\n";
+  }
+  String module = String(element.module);
+  switch (element.barcode) {
+    case BARCODE_CODE128:
+      return "BARCODE " + x + at + "\"128\"," + String(element.height) + ",0,0," + module + "," + module + "," +
+             tsplString(value) + "\r\n";
+    case BARCODE_EAN13:
+      return "BARCODE " + x + at + "\"EAN13\"," + String(element.height) + ",0,0," + module + "," + module + "," +
+             tsplString(value) + "\r\n";
+    case BARCODE_QR:
+      return "QRCODE " + x + at + "M," + module + ",A,0," + tsplString(value) + "\r\n";
+    case BARCODE_DATAMATRIX:
+      // The symbol is sized to the data inside a box reaching the label edge
+      return "DMATRIX " + x + at + String(entry.width - element.x) + "," + String(entry.height - element.y) + ",x" +
+             module + "," + tsplString(value) + "\r\n";
+  }
+  return String();
+}
+
+static bool insertOutput(void* context, const uint8_t* data, size_t length) {
+  return ((RasterCommandWriter*)context)->insert(data, length, 0);
+}
+
+// Send the composed label with its stored artwork printed from the
+// printer's memory and the native elements drawn by the printer after the
+// raster. Returns false when artwork was drawn into the sprite instead,
+// which then no longer matches the base raster.
+static bool writeWithPrinterContent(const LabelTemplate& entry, const String** values,
+                                    const ImageRasterOptions& options, const LabelPrinter* printer,
+                                    ImageOutput output, void* context, ImageError& error) {
+  bool tspl = options.commands == IMAGE_TSPL;
+  bool stored[LABEL_MAX_ARTWORK] = {};
+  int found[LABEL_MAX_ARTWORK] = {};
+  bool resident[LABEL_MAX_ARTWORK] = {};
+  uint8_t slots[LABEL_MAX_ARTWORK] = {};
+  bool clean = true;
+  uint32_t used = 0;
+
+  // A negative would need the artwork inverted as well
+  for (size_t a = 0; a < entry.artworkCount; a++) {
+    stored[a] = printer != nullptr && !options.invert;
+  }
+  for (size_t a = 0; a < entry.artworkCount; a++) {
+    if (stored[a] && !tspl && !rowsFree(entry, a, stored)) {
+      stored[a] = false;
+    }
+    if (!stored[a]) {
+      drawArtwork(entry, entry.artwork[a]);
+      clean = false;
+      continue;
+    }
+    found[a] = findArtworkSlot(printer->index, printer->mac, entry.artwork[a].image.hash);
+    if (found[a] >= 0) {
+      slots[a] = found[a];
+      resident[a] = !printer->resend;
+      used |= 1u << found[a];
+    }
+  }
+  // New artwork only takes slots this label doesn't print from
+  for (size_t a = 0; a < entry.artworkCount; a++) {
+    if (stored[a] && found[a] < 0) {
+      slots[a] = claimArtworkSlot(printer->index, printer->mac, entry.artwork[a].image.hash, used);
+      used |= 1u << slots[a];
+    }
+  }
+
+  RasterCommandWriter writer;
+  if (!writer.begin(options, entry.width, entry.height, output, context)) {
+    error = writer.outputFailed() ? IMAGE_ERR_OUTPUT : IMAGE_ERR_NO_MEMORY;
+    return clean;
+  }
+  if (tspl) {
+    writer.holdEnd();
+  }
+  bool ok = true;
+  for (size_t a = 0; ok && a < entry.artworkCount; a++) {
+    if (stored[a] && !resident[a]) {
+      ok = writeArtworkDefine(options.commands, slots[a], entry.artwork[a].image, insertOutput, &writer);
+    }
+  }
+
+  const uint8_t* image = (const uint8_t*)sprite->getPointer();
+  size_t rowBytes = (entry.width + 7) / 8;
+  uint8_t command[64];
+  for (uint16_t y = 0; ok && y < entry.height;) {
+    size_t a = entry.artworkCount;
+    for (size_t i = 0; !tspl && i < entry.artworkCount; i++) {
+      if (stored[i] && entry.artwork[i].y == y) {
+        a = i;
+      }
+    }
+    if (a == entry.artworkCount) {
+      ok = writer.row(image + y * rowBytes);
+      y++;
+      continue;
+    }
+    const LabelArtwork& art = entry.artwork[a];
+    size_t length = artworkPrintCommand(options.commands, slots[a], art.x, art.y, command, sizeof(command));
+    ok = writer.insert(command, length, art.image.height);
+    y += art.image.height;
+  }
+  for (size_t a = 0; ok && tspl && a < entry.artworkCount; a++) {
+    if (stored[a]) {
+      const LabelArtwork& art = entry.artwork[a];
+      size_t length = artworkPrintCommand(options.commands, slots[a], art.x, art.y, command, sizeof(command));
+      ok = writer.insert(command, length, 0);
+    }
+  }
+  for (size_t e = 0; ok && e < entry.elementCount; e++) {
+    if (nativeElements & (1u << e)) {
+      String command = nativeCommand(entry, entry.elements[e], *values[e]);
+      ok = writer.insert((const uint8_t*)command.c_str(), command.length(), 0);
+    }
+  }
+  if (ok && tspl) {
+    ok = writer.finish();
+  }
+  error = ok ? IMAGE_OK : IMAGE_ERR_OUTPUT;
+  return clean;
+}
+
+LabelResult printLabelTemplate(const String& name, const char* json, size_t length,
+                               const ImageRasterOptions& options, const LabelPrinter* printer,
+                               ImageOutput output, void* context, String& detail) {
+  String names[LABEL_MAX_FIELDS];
+  String values[LABEL_MAX_FIELDS];
+  size_t fieldCount = 0;
+  if (!parseFields(json, length, names, values, fieldCount)) {
+    detail = "fields";
+    return LABEL_INVALID;
+  }
+
+  xSemaphoreTake(renderLock, portMAX_DELAY);
+  LabelTemplate* entry = nullptr;
+  LabelResult result = findTemplate(name, entry, detail);
+  if (result != LABEL_OK) {
+    xSemaphoreGive(renderLock);
+    return result;
+  }
+
+  // Every field is checked before the sprite is touched
+  const String* elementValues[LABEL_MAX_ELEMENTS];
+  for (size_t e = 0; e < entry->elementCount; e++) {
+    const LabelElement& element = entry->elements[e];
+    elementValues[e] = nullptr;
+    for (size_t f = 0; f < fieldCount && elementValues[e] == nullptr; f++) {
+      if (names[f] == element.field) {
+        elementValues[e] = &values[f];
+      }
+    }
+    if (elementValues[e] == nullptr) {
+      detail = element.field;
+      xSemaphoreGive(renderLock);
+      return LABEL_MISSING_FIELD;
+    }
+  }
+
+  // Elements the printer draws are checked here, the rest when drawn
+  nativeElements = 0;
+  for (size_t e = 0; e < entry->elementCount; e++) {
+    if (!nativeElement(*entry, entry->elements[e], options)) {
+      continue;
+    }
+    if (!nativeValueValid(entry->elements[e], *elementValues[e])) {
+      detail = entry->elements[e].field;
+      xSemaphoreGive(renderLock);
+      return LABEL_INVALID;
+    }
+    nativeElements |= 1u << e;
+  }
+  bool reuse = renderedGeneration == entry->generation && renderedNative == nativeElements && sprite->created();
+  if (!reuse) {
+    renderedGeneration = 0;
+    sprite->deleteSprite();
+    size_t bytes = TFT_eSprite::spriteBytes(entry->width, entry->height, 1);
+    if (bytes > spriteArenaSize) {
+      heapFree(spriteArena);
+      spriteArenaSize = 0;
+      spriteArena = (uint8_t*)heapAlloc(HEAP_SITE_TEMPLATE, bytes);
+      if (spriteArena) {
+        spriteArenaSize = bytes;
+      }
+    }
+    if (sprite->createSprite(entry->width, entry->height, spriteArena, spriteArenaSize) == nullptr) {
+      xSemaphoreGive(renderLock);
+      return LABEL_NO_MEMORY;
+    }
+  }
+
+  // The sprite only counts as composed again once every element is drawn
+  renderedGeneration = 0;
+  if (!reuse || !updateLabel(*entry, elementValues, result, detail)) {
+    result = composeLabel(*entry, elementValues, detail);
+  }
+  if (result == LABEL_OK) {
+    renderedGeneration = entry->generation;
+    renderedNative = nativeElements;
+    ImageError error;
+    if (entry->artworkCount == 0 && nativeElements == 0) {
+      error = writeSpriteRaster(*sprite, entry->turn ? SPRITE_RASTER_TURN_90 : SPRITE_RASTER_AS_STORED, options,
+                                output, context);
+    } else if (!writeWithPrinterContent(*entry, elementValues, options, printer, output, context, error)) {
+      renderedGeneration = 0;
+    }
+
+    if (error == IMAGE_ERR_NO_MEMORY) {
+      result = LABEL_NO_MEMORY;
+    } else if (error != IMAGE_OK) {
+      result = LABEL_OUTPUT;
+    }
+  }
+
+  xSemaphoreGive(renderLock);
+  return result;
+}
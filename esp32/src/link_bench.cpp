@@ -0,0 +1,609 @@
+#include "link_bench.h"
+#include "ble_printer.h"
+#include "heap_stats.h"
+#include "print_writer.h"
+
+enum BenchState {
+  BENCH_IDLE,
+  BENCH_RUNNING,
+  BENCH_DONE,
+  BENCH_FAILED          // Lost the link or the printer refused the mode
+};
+
+struct BenchRun {
+  uint16_t chunk;       // Asked for; the result says what was sent
+  bool noResponse;
+  bool done;
+  bool ok;
+  uint16_t sentChunk;
+  uint32_t bytes;
+  uint32_t elapsedUs;
+  uint32_t p50Us;
+  uint32_t p90Us;
+  uint32_t p99Us;
+  uint32_t writeErrors;
+};
+
+// Written by the bench task, read by the HTTP handler under benchLock
+static SemaphoreHandle_t benchLock = nullptr;
+static BenchState state = BENCH_IDLE;
+static uint8_t benchPrinter = 0;
+static size_t runBytes = BENCH_DEFAULT_BYTES;
+static BenchRun runs[BENCH_MAX_RUNS];
+static size_t runCount = 0;
+
+// The job run of BENCH_PATH "/ble", apart from the sweep
+enum JobPattern {
+  PATTERN_NUL,
+  PATTERN_CALIBRATION,
+  PATTERN_DENSITY
+};
+
+static const char* const PATTERN_NAMES[] = {"nul", "calibration", "density"};
+
+struct JobBench {
+  BenchState state;
+  uint8_t printer;
+  JobPattern pattern;
+  uint16_t widthMm;
+  uint16_t heightMm;
+  uint8_t speed;
+  uint8_t density;
+  int16_t marginX;
+  int16_t marginY;
+  size_t requested;     // 0: one copy of the pattern
+  uint32_t jobId;
+  PrintJobState jobState;
+  size_t generated;
+  size_t bytes;         // Written to the printer
+  uint32_t elapsedMs;   // First to last write
+  uint32_t p50Us;
+  uint32_t p90Us;
+  uint32_t p99Us;
+  uint32_t writeErrors;
+};
+
+static JobBench job = {};
+static PrintJobTimeline timelines[PRINT_HISTORY_SIZE];
+
+static const char* benchStateName(BenchState s) {
+  switch (s) {
+    case BENCH_IDLE: return "idle";
+    case BENCH_RUNNING: return "running";
+    case BENCH_DONE: return "done";
+    case BENCH_FAILED: return "failed";
+  }
+  return "idle";
+}
+
+static void benchTask(void* param) {
+  BlePrinter* printer = getPrinter(benchPrinter);
+  pausePrintWriter(benchPrinter, true);
+
+  bool ok = true;
+  for (size_t i = 0; i < runCount && ok; i++) {
+    LinkMetrics metrics;
+    size_t linkChunk = printer->chunkSize();
+    uint32_t started = micros();
+    ok = printer->benchWrite(runBytes, runs[i].chunk, runs[i].noResponse, metrics);
+    uint32_t elapsed = micros() - started;
+
+    xSemaphoreTake(benchLock, portMAX_DELAY);
+    BenchRun& run = runs[i];
+    run.done = true;
+    run.ok = ok;
+    run.sentChunk = min<size_t>(run.chunk, linkChunk);
+    run.bytes = metrics.bytes();
+    run.elapsedUs = elapsed;
+    run.p50Us = metrics.latencyPercentileUs(0.5f);
+    run.p90Us = metrics.latencyPercentileUs(0.9f);
+    run.p99Us = metrics.latencyPercentileUs(0.99f);
+    run.writeErrors = metrics.writeErrors();
+    xSemaphoreGive(benchLock);
+    log_i("Bench %s: %u byte chunks %s, %u bytes in %u us", printer->id().c_str(), run.sentChunk,
+          run.noResponse ? "without response" : "acknowledged", run.bytes, elapsed);
+  }
+
+  pausePrintWriter(benchPrinter, false);
+  xSemaphoreTake(benchLock, portMAX_DELAY);
+  state = ok ? BENCH_DONE : BENCH_FAILED;
+  xSemaphoreGive(benchLock);
+  vTaskDelete(nullptr);
+}
+
+// TSPL of the Go tool's calibration label: a bounding box, a centre cross,
+// 5 mm ruler ticks and the size
+static void appendCalibration(String& out, const JobBench& bench) {
+  char line[80];
+  int w = bench.widthMm * 8;  // 203 dpi
+  int h = bench.heightMm * 8;
+  int mx = bench.marginX;
+  int my = bench.marginY;
+  snprintf(line, sizeof(line), "SIZE %u mm,%u mm\r\nGAP 2 mm,0 mm\r\nDIRECTION 1\r\n", bench.widthMm,
+           bench.heightMm);
+  out += line;
+  snprintf(line, sizeof(line), "SPEED %u\r\nDENSITY %u\r\nCLS\r\n", bench.speed, bench.density);
+  out += line;
+  snprintf(line, sizeof(line), "BOX %d,%d,%d,%d,4\r\n", 2 + mx, 2 + my, w - 2 + mx, h - 2 + my);
+  out += line;
+  snprintf(line, sizeof(line), "BAR %d,%d,2,20\r\nBAR %d,%d,20,2\r\n", w / 2 - 1 + mx, h / 2 - 10 + my,
+           w / 2 - 10 + mx, h / 2 - 1 + my);
+  out += line;
+  for (int x = 0; x < w; x += 40) {
+    snprintf(line, sizeof(line), "BAR %d,%d,2,10\r\n", x + mx, my);
+    out += line;
+  }
+  for (int y = 0; y < h; y += 40) {
+    snprintf(line, sizeof(line), "BAR %d,%d,10,2\r\n", mx, y + my);
+    out += line;
+  }
+  snprintf(line, sizeof(line), "TEXT %d,%d,\"3\",0,1,1,\"Size: %ux%u mm\"\r\n", 50 + mx, 50 + my, bench.widthMm,
+           bench.heightMm);
+  out += line;
+  snprintf(line, sizeof(line), "TEXT %d,%d,\"3\",0,1,1,\"Check margins\"\r\nPRINT 1,1\r\n", 50 + mx, 80 + my);
+  out += line;
+}
+
+// And its density label: bars at densities 0 to 14, line widths, font sizes
+// and a checkerboard, the last two where the label has room
+static void appendDensity(String& out, const JobBench& bench) {
+  char line[80];
+  int w = bench.widthMm * 8;
+  int h = bench.heightMm * 8;
+  int mx = bench.marginX;
+  int my = bench.marginY;
+  snprintf(line, sizeof(line), "SIZE %u mm,%u mm\r\nGAP 2 mm,0 mm\r\nDIRECTION 1\r\n", bench.widthMm,
+           bench.heightMm);
+  out += line;
+  snprintf(line, sizeof(line), "SPEED %u\r\nCLS\r\n", bench.speed);
+  out += line;
+  snprintf(line, sizeof(line), "TEXT %d,%d,\"3\",0,1,1,\"DPI/Density Test\"\r\n", 10 + mx, 10 + my);
+  out += line;
+  snprintf(line, sizeof(line), "TEXT %d,%d,\"2\",0,1,1,\"Find best print quality\"\r\n", 10 + mx, 30 + my);
+  out += line;
+
+  const int densities = 8;
+  int boxWidth = w / (densities + 1);
+  int y1 = 60 + my;
+  for (int i = 0; i < densities; i++) {
+    int x = mx + i * boxWidth + 5;
+    snprintf(line, sizeof(line), "DENSITY %d\r\nBAR %d,%d,%d,20\r\n", i * 2, x, y1, boxWidth - 10);
+    out += line;
+    snprintf(line, sizeof(line), "TEXT %d,%d,\"1\",0,1,1,\"D=%d\"\r\n", x, y1 + 25, i * 2);
+    out += line;
+  }
+  out += "DENSITY 8\r\n";
+
+  int y2 = y1 + 60;
+  snprintf(line, sizeof(line), "TEXT %d,%d,\"2\",0,1,1,\"Line width test\"\r\n", 10 + mx, y2 - 20);
+  out += line;
+  for (int i = 0; i < 6; i++) {
+    int x = mx + 20 + i * 30;
+    snprintf(line, sizeof(line), "BAR %d,%d,%d,30\r\nTEXT %d,%d,\"1\",0,1,1,\"%d\"\r\n", x, y2, i + 1, x, y2 + 35,
+             i + 1);
+    out += line;
+  }
+
+  int y3 = y2 + 80;
+  if (y3 + 60 < h + my) {
+    snprintf(line, sizeof(line), "TEXT %d,%d,\"2\",0,1,1,\"DPI scaling (font size)\"\r\n", 10 + mx, y3 - 20);
+    out += line;
+    for (int size = 1; size <= 5; size++) {
+      snprintf(line, sizeof(line), "TEXT %d,%d,\"%d\",0,1,1,\"%dpt\"\r\n", mx + 20 + (size - 1) * 60, y3, size,
+               size);
+      out += line;
+    }
+    snprintf(line, sizeof(line), "TEXT %d,%d,\"1\",0,1,1,\"Higher DPI = sharper\"\r\n", 10 + mx, y3 + 40);
+    out += line;
+  }
+
+  int y4 = y3 + 100;
+  if (y4 + 20 < h + my) {
+    snprintf(line, sizeof(line), "TEXT %d,%d,\"2\",0,1,1,\"Checkerboard\"\r\n", 10 + mx, y4 - 20);
+    out += line;
+    for (int row = 0; row < 8; row++) {
+      for (int col = row % 2; col < 8; col += 2) {
+        snprintf(line, sizeof(line), "BAR %d,%d,4,4\r\n", mx + 20 + col * 4, y4 + row * 4);
+        out += line;
+      }
+    }
+  }
+  out += "PRINT 1,1\r\n";
+}
+
+void appendBenchLabel(String& out, bool density, uint16_t widthMm, uint16_t heightMm) {
+  JobBench bench = {};
+  bench.widthMm = widthMm;
+  bench.heightMm = heightMm;
+  bench.speed = 4;
+  bench.density = 8;
+  if (density) {
+    appendDensity(out, bench);
+  } else {
+    appendCalibration(out, bench);
+  }
+}
+
+// Whole copies of data until at least total bytes went in; false when the
+// writer gave up on the job
+static bool appendRepeated(uint32_t id, const uint8_t* data, size_t length, size_t total, size_t& generated) {
+  generated = 0;
+  do {
+    if (!appendPrintJobWait(id, data, length)) {
+      return false;
+    }
+    generated += length;
+  } while (generated < total);
+  return true;
+}
+
+static void jobBenchTask(void* param) {
+  (void)param;
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  BlePrinter* printer = getPrinter(job.printer);
+  const LinkMetrics& metrics = printer->metrics();
+  uint32_t before[LINK_LATENCY_BUCKETS];
+  for (size_t b = 0; b < LINK_LATENCY_BUCKETS; b++) {
+    before[b] = metrics.bucketCount(b);
+  }
+  uint32_t errorsBefore = metrics.writeErrors();
+
+  bool ok;
+  size_t generated = 0;
+  if (job.pattern == PATTERN_NUL) {
+    static const uint8_t zeros[512] = {};
+    size_t total = job.requested > 0 ? job.requested : BENCH_DEFAULT_BYTES;
+    ok = true;
+    while (ok && generated < total) {
+      size_t part = 0;
+      ok = appendRepeated(job.jobId, zeros, min(sizeof(zeros), total - generated), 0, part);
+      generated += part;
+    }
+  } else {
+    String commands;
+    if (job.pattern == PATTERN_CALIBRATION) {
+      appendCalibration(commands, job);
+    } else {
+      appendDensity(commands, job);
+    }
+    ok = appendRepeated(job.jobId, (const uint8_t*)commands.c_str(), commands.length(), job.requested, generated);
+  }
+  if (ok) {
+    finishPrintJob(job.jobId);
+  } else {
+    abortPrintJob(job.jobId);
+  }
+
+  // Through the writer, whose timeline has the time on the link
+  PrintJobInfo info;
+  while (getPrintJob(job.jobId, info) && (info.state == JOB_QUEUED || info.state == JOB_STREAMING)) {
+    vTaskDelay(pdMS_TO_TICKS(20));
+  }
+  const PrintJobTimeline* timeline = nullptr;
+  size_t count = getPrintHistory(timelines, PRINT_HISTORY_SIZE);
+  for (size_t i = 0; i < count && timeline == nullptr; i++) {
+    if (timelines[i].id == job.jobId) {
+      timeline = &timelines[i];
+    }
+  }
+
+  uint32_t delta[LINK_LATENCY_BUCKETS];
+  for (size_t b = 0; b < LINK_LATENCY_BUCKETS; b++) {
+    delta[b] = metrics.bucketCount(b) - before[b];
+  }
+  xSemaphoreTake(benchLock, portMAX_DELAY);
+  job.generated = generated;
+  job.jobState = timeline != nullptr ? timeline->state : JOB_FAILED;
+  job.bytes = timeline != nullptr ? timeline->bytes : 0;
+  job.elapsedMs = timeline != nullptr && timeline->firstWrite != 0 ? timeline->lastWrite - timeline->firstWrite : 0;
+  job.p50Us = LinkMetrics::percentileUs(delta, 0.5f);
+  job.p90Us = LinkMetrics::percentileUs(delta, 0.9f);
+  job.p99Us = LinkMetrics::percentileUs(delta, 0.99f);
+  job.writeErrors = metrics.writeErrors() - errorsBefore;
+  job.state = ok && job.jobState == JOB_DONE ? BENCH_DONE : BENCH_FAILED;
+  xSemaphoreGive(benchLock);
+  log_i("Bench %s: %s job %u, %u bytes in %u ms", printer->id().c_str(), PATTERN_NAMES[job.pattern], job.jobId,
+        job.bytes, job.elapsedMs);
+  vTaskDelete(nullptr);
+}
+
+// Comma separated numbers into out, at most max; false when one doesn't parse
+static bool parseList(const String& text, uint16_t* out, size_t max, size_t& count) {
+  count = 0;
+  int from = 0;
+  while (from <= (int)text.length()) {
+    int comma = text.indexOf(',', from);
+    String item = text.substring(from, comma < 0 ? text.length() : comma);
+    item.trim();
+    long value = item.toInt();
+    if (value <= 0 || value > UINT16_MAX || count == max) {
+      return false;
+    }
+    out[count++] = value;
+    if (comma < 0) {
+      break;
+    }
+    from = comma + 1;
+  }
+  return count > 0;
+}
+
+static void handleStart(AsyncWebServerRequest* request) {
+  BlePrinter* printer = findPrinter(request->hasParam("printer") ? request->getParam("printer")->value() : String());
+  if (printer == nullptr) {
+    request->send(404, "text/plain", "Unknown printer");
+    return;
+  }
+  if (!printer->connected()) {
+    request->send(409, "text/plain", "Printer not connected");
+    return;
+  }
+
+  size_t bytes = BENCH_DEFAULT_BYTES;
+  if (request->hasParam("bytes")) {
+    bytes = request->getParam("bytes")->value().toInt();
+    if (bytes == 0 || bytes > BENCH_MAX_BYTES) {
+      request->send(400, "text/plain", "bytes out of range");
+      return;
+    }
+  }
+  uint16_t chunks[BENCH_MAX_RUNS];
+  size_t chunkCount = 0;
+  if (request->hasParam("chunks")) {
+    if (!parseList(request->getParam("chunks")->value(), chunks, BENCH_MAX_RUNS, chunkCount)) {
+      request->send(400, "text/plain", "Malformed chunks");
+      return;
+    }
+  } else {
+    chunks[chunkCount++] = printer->chunkSize();
+  }
+  String modes = request->hasParam("modes") ? request->getParam("modes")->value() : String("ack,nr");
+  bool ack = modes.indexOf("ack") >= 0;
+  bool nr = modes.indexOf("nr") >= 0;
+  if (!ack && !nr) {
+    request->send(400, "text/plain", "modes takes ack and nr");
+    return;
+  }
+  if (chunkCount * ((ack ? 1 : 0) + (nr ? 1 : 0)) > BENCH_MAX_RUNS) {
+    request->send(400, "text/plain", "Too many runs");
+    return;
+  }
+
+  xSemaphoreTake(benchLock, portMAX_DELAY);
+  if (state == BENCH_RUNNING || job.state == BENCH_RUNNING) {
+    xSemaphoreGive(benchLock);
+    request->send(409, "text/plain", "Benchmark running");
+    return;
+  }
+  if (printQueueDepth(printer->index()) > 0 || printWriterPending(printer->index()) > 0) {
+    xSemaphoreGive(benchLock);
+    request->send(409, "text/plain", "Printer busy");
+    return;
+  }
+  benchPrinter = printer->index();
+  runBytes = bytes;
+  runCount = 0;
+  for (size_t i = 0; i < chunkCount; i++) {
+    for (uint8_t mode = 0; mode < 2; mode++) {
+      if ((mode == 0 && ack) || (mode == 1 && nr)) {
+        runs[runCount] = BenchRun();
+        runs[runCount].chunk = chunks[i];
+        runs[runCount].noResponse = mode == 1;
+        runCount++;
+      }
+    }
+  }
+  state = BENCH_RUNNING;
+  xSemaphoreGive(benchLock);
+
+  if (xTaskCreatePinnedToCore(benchTask, "linkBench", 4096, nullptr, PRINT_WRITER_PRIORITY, nullptr,
+                              PRINT_WRITER_CORE) != pdPASS) {
+    xSemaphoreTake(benchLock, portMAX_DELAY);
+    state = BENCH_FAILED;
+    xSemaphoreGive(benchLock);
+    request->send(503, "text/plain", "No memory for the benchmark");
+    return;
+  }
+  request->send(202, "text/plain", "Benchmark started");
+}
+
+// Number parameter within [low, high], or fallback without it; false when
+// it is out of range
+static bool numberParam(AsyncWebServerRequest* request, const char* name, long low, long high, long fallback,
+                        long& value) {
+  value = fallback;
+  if (!request->hasParam(name)) {
+    return true;
+  }
+  const String& text = request->getParam(name)->value();
+  value = text.toInt();
+  return (value != 0 || text == "0") && value >= low && value <= high;
+}
+
+static void handleJobStart(AsyncWebServerRequest* request) {
+  BlePrinter* printer = findPrinter(request->hasParam("printer") ? request->getParam("printer")->value() : String());
+  if (printer == nullptr) {
+    request->send(404, "text/plain", "Unknown printer");
+    return;
+  }
+  if (!printer->connected()) {
+    request->send(409, "text/plain", "Printer not connected");
+    return;
+  }
+  String name = request->hasParam("pattern") ? request->getParam("pattern")->value() : String("nul");
+  size_t pattern = 0;
+  while (pattern < sizeof(PATTERN_NAMES) / sizeof(PATTERN_NAMES[0]) && name != PATTERN_NAMES[pattern]) {
+    pattern++;
+  }
+  if (pattern == sizeof(PATTERN_NAMES) / sizeof(PATTERN_NAMES[0])) {
+    request->send(400, "text/plain", "pattern takes nul, calibration or density");
+    return;
+  }
+  long bytes, width, height, speed, density, marginX, marginY;
+  if (!numberParam(request, "bytes", 1, BENCH_MAX_BYTES, 0, bytes) ||
+      !numberParam(request, "width", 10, 120, 58, width) || !numberParam(request, "height", 10, 300, 30, height) ||
+      !numberParam(request, "speed", 1, 15, 4, speed) || !numberParam(request, "density", 0, 15, 8, density) ||
+      !numberParam(request, "marginX", -200, 200, 0, marginX) ||
+      !numberParam(request, "marginY", -200, 200, 0, marginY)) {
+    request->send(400, "text/plain", "Parameter out of range");
+    return;
+  }
+
+  xSemaphoreTake(benchLock, portMAX_DELAY);
+  if (state == BENCH_RUNNING || job.state == BENCH_RUNNING) {
+    xSemaphoreGive(benchLock);
+    request->send(409, "text/plain", "Benchmark running");
+    return;
+  }
+  if (printQueueDepth(printer->index()) > 0 || printWriterPending(printer->index()) > 0) {
+    xSemaphoreGive(benchLock);
+    request->send(409, "text/plain", "Printer busy");
+    return;
+  }
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t jobId = createPrintJob(printer->index(), PRINT_JOB_LENGTH_UNKNOWN, reject);
+  if (jobId == 0) {
+    xSemaphoreGive(benchLock);
+    request->send(503, "text/plain", "Job refused");
+    return;
+  }
+  job = JobBench();
+  job.state = BENCH_RUNNING;
+  job.printer = printer->index();
+  job.pattern = (JobPattern)pattern;
+  job.widthMm = width;
+  job.heightMm = height;
+  job.speed = speed;
+  job.density = density;
+  job.marginX = marginX;
+  job.marginY = marginY;
+  job.requested = bytes;
+  job.jobId = jobId;
+  xSemaphoreGive(benchLock);
+
+  if (xTaskCreatePinnedToCore(jobBenchTask, "jobBench", 4096, nullptr, 1, nullptr, 1) != pdPASS) {
+    abortPrintJob(jobId);
+    xSemaphoreTake(benchLock, portMAX_DELAY);
+    job.state = BENCH_FAILED;
+    xSemaphoreGive(benchLock);
+    request->send(503, "text/plain", "No memory for the benchmark");
+    return;
+  }
+  request->send(202, "text/plain", "Benchmark started");
+}
+
+static String jobResultJSON() {
+  xSemaphoreTake(benchLock, portMAX_DELAY);
+  BlePrinter* printer = getPrinter(job.printer);
+  String json = "{\"state\":\"";
+  json += benchStateName(job.state);
+  json += "\"";
+  if (job.state != BENCH_IDLE && printer != nullptr) {
+    json += ",\"printer\":\"";
+    json += printer->id();
+    json += "\",\"pattern\":\"";
+    json += PATTERN_NAMES[job.pattern];
+    json += "\",\"job\":";
+    json += String(job.jobId);
+    json += ",\"pipeline\":\"";
+    json += printer->pipelineName();
+    json += "\"";
+  }
+  if (job.state == BENCH_DONE || job.state == BENCH_FAILED) {
+    json += ",\"jobState\":\"";
+    json += printJobStateName(job.jobState);
+    json += "\",\"generated\":";
+    json += String(job.generated);
+    json += ",\"bytes\":";
+    json += String(job.bytes);
+    json += ",\"ms\":";
+    json += String(job.elapsedMs);
+    json += ",\"bytesPerSec\":";
+    json += String(job.elapsedMs > 0 ? (uint32_t)((uint64_t)job.bytes * 1000 / job.elapsedMs) : 0);
+    json += ",\"p50Us\":";
+    json += String(job.p50Us);
+    json += ",\"p90Us\":";
+    json += String(job.p90Us);
+    json += ",\"p99Us\":";
+    json += String(job.p99Us);
+    json += ",\"writeErrors\":";
+    json += String(job.writeErrors);
+  }
+  json += "}";
+  xSemaphoreGive(benchLock);
+  return json;
+}
+
+static String resultsJSON() {
+  xSemaphoreTake(benchLock, portMAX_DELAY);
+  BlePrinter* printer = getPrinter(benchPrinter);
+  String json = "{\"state\":\"";
+  json += benchStateName(state);
+  json += "\"";
+  if (state != BENCH_IDLE && printer != nullptr) {
+    json += ",\"printer\":\"";
+    json += printer->id();
+    json += "\",\"mtu\":";
+    json += String(printer->mtu());
+    json += ",\"phy2M\":";
+    json += printer->phy2M() ? "true" : "false";
+    json += ",\"connIntervalMs\":";
+    json += String(printer->connIntervalMs(), 2);
+    json += ",\"dataLength\":";
+    json += String(printer->dataLength());
+    json += ",\"bytes\":";
+    json += String(runBytes);
+    json += ",\"runs\":[";
+    bool first = true;
+    for (size_t i = 0; i < runCount; i++) {
+      const BenchRun& run = runs[i];
+      if (!run.done) {
+        continue;
+      }
+      json += first ? "{" : ",{";
+      first = false;
+      json += "\"chunk\":";
+      json += String(run.sentChunk);
+      json += ",\"mode\":\"";
+      json += run.noResponse ? "nr" : "ack";
+      json += "\",\"bytes\":";
+      json += String(run.bytes);
+      json += ",\"ms\":";
+      json += String(run.elapsedUs / 1000);
+      json += ",\"bytesPerSec\":";
+      json += String(run.elapsedUs > 0 ? (uint32_t)((uint64_t)run.bytes * 1000000 / run.elapsedUs) : 0);
+      json += ",\"p50Us\":";
+      json += String(run.p50Us);
+      json += ",\"p90Us\":";
+      json += String(run.p90Us);
+      json += ",\"p99Us\":";
+      json += String(run.p99Us);
+      json += ",\"writeErrors\":";
+      json += String(run.writeErrors);
+      json += ",\"ok\":";
+      json += run.ok ? "true" : "false";
+      json += "}";
+    }
+    json += "]";
+  }
+  json += "}";
+  xSemaphoreGive(benchLock);
+  return json;
+}
+
+void initLinkBench(AsyncWebServer& server) {
+  benchLock = xSemaphoreCreateMutex();
+  if (benchLock == nullptr) {
+    log_e("No memory for the link benchmark");
+    return;
+  }
+  // Ahead of BENCH_PATH, which would take its requests too
+  server.on(BENCH_PATH "/ble", HTTP_POST, handleJobStart);
+  server.on(BENCH_PATH "/ble", HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send(200, "application/json", jobResultJSON());
+  });
+  server.on(BENCH_PATH, HTTP_POST, handleStart);
+  server.on(BENCH_PATH, HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send(200, "application/json", resultsJSON());
+  });
+}
@@ -0,0 +1,104 @@
+#include "link_control.h"
+
+void LinkController::begin(size_t maxChunk, uint16_t maxWindow) {
+  _rssi = 0;
+  _bestNsPerByte = 0;
+  _roundChunks = 0;
+  _roundBytes = 0;
+  _roundUs = 0;
+  _roundErrors = 0;
+  _roundCreditTimeouts = 0;
+  _gapMs = 0;
+  _degraded = false;
+  setLimits(maxChunk, maxWindow);
+  _chunk = _maxChunk;
+  _window = windowLimit();
+}
+
+void LinkController::setLimits(size_t maxChunk, uint16_t maxWindow) {
+  _maxChunk = maxChunk < LINK_CONTROL_MIN_CHUNK ? LINK_CONTROL_MIN_CHUNK : maxChunk;
+  _maxWindow = maxWindow < 1 ? 1 : maxWindow;
+#if !LINK_CONTROL
+  _chunk = _maxChunk;
+  _window = _maxWindow;
+#else
+  if (_chunk > _maxChunk) {
+    _chunk = _maxChunk;
+  }
+  if (_window > windowLimit()) {
+    _window = windowLimit();
+  }
+#endif
+}
+
+uint16_t LinkController::windowLimit() const {
+  if (_rssi != 0 && _rssi < LINK_CONTROL_WEAK_RSSI && _maxWindow > 1) {
+    return _maxWindow / 2;
+  }
+  return _maxWindow;
+}
+
+void LinkController::growGap() {
+  uint8_t gap = _gapMs == 0 ? 1 : _gapMs * 2;
+  _gapMs = gap > LINK_CONTROL_MAX_GAP_MS ? LINK_CONTROL_MAX_GAP_MS : gap;
+}
+
+bool LinkController::chunkDone(size_t bytes, uint32_t elapsedUs, bool ok) {
+  _roundChunks++;
+  _roundBytes += bytes;
+  _roundUs += elapsedUs;
+  _roundErrors += ok ? 0 : 1;
+  if (_roundChunks < LINK_CONTROL_ROUND) {
+    return false;
+  }
+  endRound();
+  _roundChunks = 0;
+  _roundBytes = 0;
+  _roundUs = 0;
+  _roundErrors = 0;
+  _roundCreditTimeouts = 0;
+  return true;
+}
+
+void LinkController::endRound() {
+#if LINK_CONTROL
+  // The writer loops on chunks, so time per byte is the inverse of the
+  // throughput. The best creeps up by 1/64 a round, so a lasting slowdown
+  // becomes the new normal instead of holding the window down.
+  uint32_t nsPerByte = _roundBytes > 0 ? (uint32_t)(_roundUs * 1000 / _roundBytes) : 0;
+  if (_bestNsPerByte == 0 || nsPerByte < _bestNsPerByte) {
+    _bestNsPerByte = nsPerByte;
+  } else {
+    _bestNsPerByte += _bestNsPerByte / 64 + 1;
+  }
+  bool slow = (uint64_t)nsPerByte * 100 > (uint64_t)_bestNsPerByte * LINK_CONTROL_SLOWDOWN_PCT;
+  _degraded = _roundErrors > 0 || _roundCreditTimeouts > 0 || slow;
+
+  // The chunk size changes the time per byte by itself, so the best starts
+  // over with each new size
+  if (_roundErrors > 0) {
+    _window = _window > 1 ? _window / 2 : 1;
+    _chunk = _chunk / 2 < LINK_CONTROL_MIN_CHUNK ? LINK_CONTROL_MIN_CHUNK : _chunk / 2;
+    _bestNsPerByte = 0;
+    growGap();
+  } else if (_roundCreditTimeouts > 0) {
+    if (_window > 1) {
+      _window /= 2;
+    } else {
+      growGap();
+    }
+  } else if (slow && _window > 1) {
+    _window /= 2;
+  } else if (_gapMs > 0) {
+    _gapMs--;
+  } else if (_chunk < _maxChunk) {
+    _chunk = _chunk + LINK_CONTROL_CHUNK_STEP > _maxChunk ? _maxChunk : _chunk + LINK_CONTROL_CHUNK_STEP;
+    _bestNsPerByte = 0;
+  } else if (_window < windowLimit()) {
+    _window++;
+  }
+  if (_window > windowLimit()) {
+    _window = windowLimit();
+  }
+#endif
+}
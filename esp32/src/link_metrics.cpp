@@ -0,0 +1,83 @@
+#include "link_metrics.h"
+
+void LinkMetrics::recordChunk(size_t bytes, uint32_t latencyUs, bool acknowledged) {
+  size_t bucket = 0;
+  while (bucket < LINK_LATENCY_BUCKETS - 1 && latencyUs > LINK_LATENCY_BOUNDS_US[bucket]) {
+    bucket++;
+  }
+  _buckets[bucket]++;
+  _latencySumUs += latencyUs;
+
+  // Clear the slots of the seconds that passed without traffic
+  uint32_t now = millis() / 1000;
+  if (now != _second) {
+    uint32_t passed = now - _second;
+    if (passed > LINK_RATE_SECONDS) {
+      passed = LINK_RATE_SECONDS;
+    }
+    for (uint32_t i = 1; i <= passed; i++) {
+      _perSecond[(_second + i) % LINK_RATE_SECONDS] = 0;
+    }
+    _second = now;
+  }
+  _perSecond[now % LINK_RATE_SECONDS] += bytes;
+
+  _bytes += bytes;
+  if (acknowledged) {
+    _ackWrites++;
+  } else {
+    _noResponseWrites++;
+  }
+}
+
+uint32_t LinkMetrics::rate(size_t seconds) const {
+  if (seconds == 0) {
+    return 0;
+  }
+  if (seconds > LINK_RATE_SECONDS - 1) {
+    seconds = LINK_RATE_SECONDS - 1;
+  }
+
+  // Slots after the last recorded second are stale; those seconds saw nothing
+  uint32_t now = millis() / 1000;
+  uint32_t last = _second;
+  uint64_t total = 0;
+  for (uint32_t t = now - seconds; t < now; t++) {
+    if (t <= last && last - t < LINK_RATE_SECONDS) {
+      total += _perSecond[t % LINK_RATE_SECONDS];
+    }
+  }
+  return total / seconds;
+}
+
+uint32_t LinkMetrics::latencyPercentileUs(float share) const {
+  uint32_t buckets[LINK_LATENCY_BUCKETS];
+  for (size_t i = 0; i < LINK_LATENCY_BUCKETS; i++) {
+    buckets[i] = _buckets[i];
+  }
+  return percentileUs(buckets, share);
+}
+
+uint32_t LinkMetrics::percentileUs(const uint32_t* buckets, float share) {
+  uint32_t count = 0;
+  for (size_t i = 0; i < LINK_LATENCY_BUCKETS; i++) {
+    count += buckets[i];
+  }
+  if (count == 0) {
+    return 0;
+  }
+
+  uint32_t target = (uint32_t)(count * share + 0.5f);
+  if (target == 0) {
+    target = 1;
+  }
+  uint32_t seen = 0;
+  for (size_t i = 0; i < LINK_LATENCY_BUCKETS - 1; i++) {
+    seen += buckets[i];
+    if (seen >= target) {
+      return LINK_LATENCY_BOUNDS_US[i];
+    }
+  }
+  // Beyond the last bound; report that bound as a floor
+  return LINK_LATENCY_BOUNDS_US[LINK_LATENCY_BUCKETS - 2];
+}
@@ -3,114 +3,276 @@
 #include <ESPAsyncWebServer.h>
 #include <LittleFS.h>
 #include <TFT_eSPI.h>
-#include <BLEDevice.h>
-#include <BLEClient.h>
-#include <BLERemoteCharacteristic.h>
-#include <BLEScan.h>
-
-// WiFi credentials
-const char* ssid = WIFI_SSID;
-const char* password = WIFI_PASS;
-
-// Printer configuration
-const char* printerMac = PRINTER_MAC;
-// Updated UUIDs based on device discovery
-static BLEUUID serviceUUID(PRINTER_SERVICEUUID);
-static BLEUUID characteristicUUID(PRINTER_CHARACTERISTICUUID); 
-// BLE Device Name characteristic (standard UUID)
-static BLEUUID deviceNameUUID(PRINTER_DEVICENAMEUUID);
-// Storage for printer name
-String printerName = "Unknown"; 
-
-// BLE scan variables
-BLEScan* pBLEScan = nullptr;
-BLEAdvertisedDevice* myDevice = nullptr;
-bool printerFound = false;
-int scanCount = 0;
-bool printerConnected = false;
-
-// Client callback class
-class MyClientCallback : public BLEClientCallbacks {
-  void onConnect(BLEClient* pclient) {
-    log_i("onConnect callback");
-  }
-
-  void onDisconnect(BLEClient* pclient) {
-    printerConnected = false;
-    log_i("onDisconnect callback");
-  }
-};
-
-// Custom scan callback class
-class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
-    void onResult(BLEAdvertisedDevice advertisedDevice) {
-        scanCount++;
-        
-        if (advertisedDevice.getAddress().toString().equalsIgnoreCase("dd:0d:30:02:63:42")) {
-            log_i("✅ PRINTER DETECTED!");
-            
-            // Stop scanning
-            BLEDevice::getScan()->stop();
-            
-            // Store the device
-            if (myDevice != nullptr) {
-                delete myDevice;
-            }
-            myDevice = new BLEAdvertisedDevice(advertisedDevice);
-            printerFound = true;
-            
-            log_i("  RSSI: %d dBm", advertisedDevice.getRSSI());
-            
-            if (advertisedDevice.haveServiceUUID()) {
-                log_i("  Service UUID: %s", advertisedDevice.getServiceUUID().toString().c_str());
-            } else {
-                log_i("  No service UUID in advertisement");
-            }
-            
-            if (advertisedDevice.haveAppearance()) {
-                log_i("  Appearance: 0x%04X", advertisedDevice.getAppearance());
-            }
-            
-            log_i("  TX Power: %d dBm", advertisedDevice.getTXPower());
-        }
-    }
-};
+#include <driver/gpio.h>
+#include "ble_printer.h"
+#include "print_writer.h"
+#include "raw_print_server.h"
+#include "ws_print.h"
+#include "inflate_stream.h"
+#include "image_raster.h"
+#include "label_template.h"
+#include "label_series.h"
+#include "zpl_label.h"
+#include "pdf_label.h"
+#include "ipp_server.h"
+#include "job_cache.h"
+#include "static_assets.h"
+#include "status_json.h"
+#include "event_stream.h"
+#include "batch_print.h"
+#include "capabilities.h"
+#include "print_spool.h"
+#include "printer_keepalive.h"
+#include "resumable_upload.h"
+#include "wifi_link.h"
+#include "eth_link.h"
+#include "coex_policy.h"
+#include "http_admission.h"
+#include "cluster.h"
+#include "mqtt_ingest.h"
+#include "espnow_trigger.h"
+#include "telemetry_export.h"
+#include "boot_timing.h"
+#include "power_profile.h"
+#include "heap_stats.h"
+#include "firmware_update.h"
+#include "bridge_config.h"
+#include "status_view.h"
+#include "display_power.h"
+#include "print_preview.h"
+#include "job_panel.h"
+#include "link_bench.h"
+#include "soak_test.h"
+#include "screen_mirror.h"
+#include "trace.h"
+#include "cpu_profile.h"
+#include "deferred_log.h"
+#include "stall_watch.h"
+#include "printer_profile.h"
+
+// Task layout. AsyncTCP (pinned with CONFIG_ASYNC_TCP_RUNNING_CORE), the
+// BLE stack and the link, raw print and spool tasks run on core 0; the
+// print writers own core 1, where only the display task runs below them.
+#ifndef SERVICE_TASK_CORE
+#define SERVICE_TASK_CORE 0
+#endif
+#ifndef SERVICE_TASK_PRIORITY
+#define SERVICE_TASK_PRIORITY 2
+#endif
+#ifndef SERVICE_INTERVAL_MS
+#define SERVICE_INTERVAL_MS 20         // WebSocket credit, SSE and upload upkeep
+#endif
+#ifndef DISPLAY_TASK_CORE
+#define DISPLAY_TASK_CORE 1
+#endif
+#ifndef PRINTER_LIST_MAX
+#define PRINTER_LIST_MAX 2048          // Largest printer list POST /config/printers takes
+#endif
+#ifndef DISPLAY_TASK_PRIORITY
+#define DISPLAY_TASK_PRIORITY 1        // Below the print writers, so a redraw never holds up a job
+#endif
+#ifndef BUTTON_DEBOUNCE_MS
+#define BUTTON_DEBOUNCE_MS 30          // Edges this close to the last one are contact bounce
+#endif
+#ifndef BUTTON_LONG_PRESS_MS
+#define BUTTON_LONG_PRESS_MS 1500      // Held this long, the button reprints the last cached job
+#endif
+#ifndef DISPLAY_MIN_FRAME_MS
+#define DISPLAY_MIN_FRAME_MS 200       // Shortest gap between frames; changes in between are coalesced
+#endif
 
 // Global variables
 AsyncWebServer server(80);
-BLEClient* pClient = nullptr;
-BLERemoteCharacteristic* pRemoteCharacteristic = nullptr;
-String wifiIP = "";
 TFT_eSPI tft = TFT_eSPI();
+StatusView statusView;
+JobPanel jobPanel;
 unsigned long previousMillis = 0;
 const long lcdUpdateInterval = 1000; // 1 second
-const long bleScanInterval = 10000; // 10 seconds
-unsigned long previousBLEMillis = 0;
+// Longest time the HTTP body callback waits for ring buffer space. Kept well
+// below the AsyncTCP task watchdog timeout.
+const uint32_t printQueueTimeout = 2000;
+// Ethernet came up in auto mode: Wi-Fi only runs while the cable is down
+bool wifiStandby = false;
 
 // Screen timeout variables
+#if CONFIG_IDF_TARGET_ESP32
+// LilyGo T-Display (ESP32), the board env:esp32dev sets TFT_eSPI up for
+const int PIN_BUTTON = 35;
+const int PIN_BACKLIGHT = 4;
+#else
 const int PIN_BUTTON = 14;
 const int PIN_BACKLIGHT = 38;
+#endif
 const unsigned long SCREEN_TIMEOUT = 30000; // 30 seconds
-unsigned long lastActivityTime = 0;
-bool isScreenOn = true;
+volatile unsigned long lastActivityTime = 0;
+volatile bool isScreenOn = true;
+// Requests for the display task; holds at most one, the latest
+enum DisplayRequest : uint8_t {
+  DISPLAY_WAKE,                        // Screen off: turn it on and draw
+  DISPLAY_CHANGED                      // Screen on: state changed, draw soon
+};
+QueueHandle_t displayQueue = nullptr;
+// Presses of the button, reported on release to the display task
+enum ButtonPress : uint8_t {
+  BUTTON_SHORT,
+  BUTTON_LONG
+};
+struct ButtonEvent {
+  ButtonPress press;
+  bool screenWasOn;                    // Otherwise the press only woke it
+};
+QueueHandle_t buttonQueue = nullptr;
+// Set at the end of setup(); the LCD shows "Booting..." until then
+volatile bool bootDone = false;
+
+// Per-request state for /print uploads, freed together with the request
+struct PrintRequestContext {
+  uint32_t jobId;
+  uint8_t printer;
+  uint8_t pool;              // PRINT_NO_POOL unless sent with ?pool=
+  PrintJobReject reject;
+  bool unknownPrinter;
+  bool printerOffline;
+  bool unsupportedEncoding;
+  bool invalidHash;
+  bool invalidCopies;
+  bool cacheHit;             // The job is replayed from the job cache, the body is ignored
+  InflateStream* inflater;   // Set for Content-Encoding: deflate, freed on disconnect
+  ImageRasterizer* rasterizer; // Set for /print/image, freed on disconnect
+  JobCacheRecorder* recorder;  // Set for X-Job-Hash uploads, freed on disconnect
+  PrintSpoolWriter* spool;     // Set for spooled uploads, freed on disconnect
+  ClusterForward* forward;     // Set for uploads to a peer's printer, freed on disconnect
+};
+
+// Per-request state for /print/batch uploads, freed together with the request
+struct BatchRequestContext {
+  uint32_t jobId;
+  uint8_t printer;
+  PrintJobReject reject;
+  bool unknownPrinter;
+  bool printerOffline;
+  PrintBatch* batch;         // Freed on disconnect
+};
+
+// Per-request state for /print/zpl uploads, freed together with the request
+struct ZplRequestContext {
+  uint32_t jobId;
+  uint8_t printer;
+  PrintJobReject reject;
+  bool unknownPrinter;
+  bool printerOffline;
+  bool invalidCopies;
+  ZplInterpreter* zpl;       // Freed on disconnect
+};
+
+// Per-request state for /print/pdf uploads, freed together with the request
+struct PdfRequestContext {
+  size_t length;
+  bool tooLarge;
+  uint8_t* body;             // The whole file, freed on disconnect
+};
+
+// Per-request state for PUT /jobs/{id} segments, freed together with the request
+struct SegmentRequestContext {
+  uint32_t jobId;
+  size_t start;              // Job offset of the first byte of the body
+  size_t received;           // Contiguous job length after the last chunk
+  size_t length;             // Job size the range names, PRINT_JOB_LENGTH_UNKNOWN for *
+  bool badRange;
+  UploadSegmentResult result;
+};
+
+// Per-request state for POST /update, freed together with the request
+struct UpdateRequestContext {
+  bool started;              // This request owns the running update
+  FirmwareUpdateError result;
+};
+
+// Body of POST /config/printers, freed together with the request
+struct PrinterListContext {
+  size_t length;
+  bool tooLarge;
+  char body[PRINTER_LIST_MAX];
+};
+
+// Field values of a /print/template upload, freed together with the request
+struct TemplateRequestContext {
+  size_t length;
+  bool tooLarge;
+  char body[LABEL_MAX_REQUEST];
+};
 
 // Function declarations
-void connectToWiFi();
 void initLittleFS();
 void setupWebServer();
-void initBLE();
-bool connectToPrinter();
-void disconnectFromPrinter();
-void printToBLEPrinter(const uint8_t* data, size_t length);
+bool writeToBLEPrinter(void* context, const PrintSlice& slice);
+bool rawPrinterReady(uint8_t printer);
+bool rawPrinterAdmit(uint8_t printer);
+bool spoolTarget(uint8_t pool, uint8_t& printer);
+bool routeWsPrint(const String& printerId, uint8_t& printer, const char*& error);
+BlePrinter* requestedPrinter(AsyncWebServerRequest* request);
+bool requestedPrintTarget(AsyncWebServerRequest* request, BlePrinter*& printer, uint8_t& pool);
+void connectPrintTarget(BlePrinter* printer, uint8_t pool);
+void handlePrintRequest(AsyncWebServerRequest* request);
+void handlePrintBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total, bool image);
+void handleTemplateRequest(AsyncWebServerRequest* request);
+void handleSeriesRequest(AsyncWebServerRequest* request, TemplateRequestContext* ctx);
+void handleTemplateBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+void handleCachedRequest(AsyncWebServerRequest* request);
+void handleBatchRequest(AsyncWebServerRequest* request);
+void handleZplRequest(AsyncWebServerRequest* request);
+void handlePdfRequest(AsyncWebServerRequest* request);
+void handlePdfBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+void startResumableJob(AsyncWebServerRequest* request);
+void handleSegmentRequest(AsyncWebServerRequest* request);
+void handleSegmentBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+void sendUploadOffset(AsyncWebServerRequest* request, int code, uint32_t jobId, size_t offset);
+void handleUpdateRequest(AsyncWebServerRequest* request);
+void handleConfigRequest(AsyncWebServerRequest* request);
+void handlePrinterListRequest(AsyncWebServerRequest* request);
+void handlePrinterListBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+void handleUpdateBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+void handleBatchBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+void handleZplBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+void startCachedJob(AsyncWebServerRequest* request, const String& hash);
+void sendJobAccepted(AsyncWebServerRequest* request, uint32_t jobId, const char* cache = nullptr);
+AsyncWebServerResponse* jobAcceptedResponse(AsyncWebServerRequest* request, uint32_t jobId);
+void sendQueueRejected(AsyncWebServerRequest* request, PrintJobReject reject, uint8_t printer);
+void sendSpooled(AsyncWebServerRequest* request, uint32_t spoolId);
+ImageRasterOptions imageOptions(AsyncWebServerRequest* request);
+void applyJobDpi(AsyncWebServerRequest* request, uint32_t jobId);
+bool validJobCopies(AsyncWebServerRequest* request);
+bool applyJobCopies(AsyncWebServerRequest* request, uint32_t jobId);
+void applyJobScheduling(AsyncWebServerRequest* request, uint32_t jobId, PrintJobPriority fallback);
 void updateLCD();
-String getStatusJSON();
-void startBLEScan();
+String getMetricsText();
+String getJobJSON(const PrintJobInfo& info);
+String getHistoryJSON();
+String getSpoolJSON();
+bool appendInflated(void* context, const uint8_t* data, size_t length);
+bool appendRasterized(void* context, const uint8_t* data, size_t length);
+bool appendLabel(void* context, const uint8_t* data, size_t length);
 void wakeScreen();
+void requestRedraw();
+void onPrinterLinkState(uint8_t printer, BleLinkState state);
 void checkScreenTimeout();
+void serviceTask(void* param);
+void displayTask(void* param);
+void IRAM_ATTR onButtonChange();
+void reprintLastJob();
+void handleButton(const ButtonEvent& event);
+bool sampleTouch();
+void drawJobPanel();
+bool printersPaused();
+void runPanelAction(JobPanelAction action);
 
 void setup() {
   Serial.begin(115200);
-  
+  // Log lines wait in a ring for the port instead of holding up the caller
+  initDeferredLog();
+  // Longest blocking per task, and what blocked before a watchdog reset
+  initStallWatch();
+
   // Initialize Button
   pinMode(PIN_BUTTON, INPUT_PULLUP);
 
@@ -119,116 +281,449 @@ void setup() {
   digitalWrite(PIN_BACKLIGHT, HIGH); // Turn on backlight initially
   lastActivityTime = millis();
 
-  // Initialize LCD
-  tft.init();
-  tft.setRotation(1); // Landscape orientation
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextColor(TFT_WHITE);
-  tft.setTextSize(2);
-  tft.setCursor(50, 80);
-  tft.println("Booting...");
+  // The LCD comes up in the display task while the radios and flash do
+  buttonQueue = xQueueCreate(4, sizeof(ButtonEvent));
+  displayQueue = xQueueCreate(1, sizeof(DisplayRequest));
+  if (displayQueue == nullptr ||
+      xTaskCreatePinnedToCore(displayTask, "display", 4096, nullptr, DISPLAY_TASK_PRIORITY, nullptr,
+                              DISPLAY_TASK_CORE) != pdPASS) {
+    log_e("Failed to start display task");
+  }
+
+  // CPU scaling and light sleep, before the radios start
+  initPowerProfile(PIN_BUTTON);
 
-  // Connect to WiFi
-  connectToWiFi();
+  // Settings changed through /config, over the build flags
+  initBridgeConfig();
+
+  // Ethernet when built in and wanted; Wi-Fi unless the wire alone is asked
+  // for and came up. Boot goes on while they connect.
+  NetworkMode network = (NetworkMode)bridgeConfig().network;
+  bool wired = network != NETWORK_WIFI && initEthLink();
+  if (!wired || network != NETWORK_ETHERNET) {
+    initWifiLink(bridgeConfig().wifiSsid, bridgeConfig().wifiPassword);
+  }
+  // ESP-NOW buttons need the radio even while the cable carries the bridge
+  wifiStandby = wired && network == NETWORK_AUTO && !espNowTriggerEnabled();
 
-  // Initialize LittleFS
+  // Initialize LittleFS and read the printers to drive and their models
   initLittleFS();
+  loadPrinterRegistry();
+  loadPrinterProfiles();
+  markBootPhase(BOOT_FILESYSTEM);
 
-  // Setup web server
-  setupWebServer();
+  // BLE next, so the link tasks connect while the rest starts
+  setBleLinkListener(onPrinterLinkState);
+  initBlePrinters();
+
+  // Jobs sent to a pool move to another member when theirs can't print them
+  setPrintJobReroute(reroutePoolJob);
+  // Rejected clients are told to wait as long as their printer takes to drain
+  setPrintWriterRate(printerDrainRate);
+
+  for (size_t i = 0; i < printerCount(); i++) {
+    // One writer task per printer drains that printer's job buffers
+    initPrintWriter(i, writeToBLEPrinter, getPrinter(i));
+
+    // Raw socket printing for spoolers, one port per printer from RAW_PRINT_PORT
+    initRawPrintServer(i, RAW_PRINT_PORT == 0 ? 0 : RAW_PRINT_PORT + i, rawPrinterAdmit);
+  }
+  // Idle printers stay awake during working hours
+  initPrinterKeepAlive();
+  markBootPhase(BOOT_BLE);
+
+  // Label templates and ZPL labels render into sprites of the display driver
+  initLabelTemplates(&tft);
+  initLabelSeries();
+  initZplLabels(&tft);
+
+  // Repeat jobs replay from flash
+  initJobCache();
+
+  // Labels shown on the LCD as they print, with -DPRINT_PREVIEW=1
+  initPrintPreview(requestRedraw);
+
+  // Batch uploads report each of their labels
+  initPrintBatches();
+
+  // Jobs uploaded in Content-Range segments
+  initResumableUploads();
+
+  // Jobs for printers that are away wait on flash
+  initPrintSpool(spoolTarget);
+
+  // Reprints from button modules over ESP-NOW, see espnow_trigger.h
+  initEspNowTrigger(appendLabel);
 
-  // Initialize BLE and connect to printer
-  initBLE();
-  
-  // Perform initial BLE scan
-  // startBLEScan(); // Don't scan in setup, let loop handle it to avoid race conditions
+  // Counters pushed to a fleet collector over UDP, see telemetry_export.h
+  initTelemetryExport();
 
-  // Start server
+  // Setup and start web server
+  setupWebServer();
   server.begin();
   log_i("Web server started");
-
-  // Show initial status on LCD
-  updateLCD();
+  // AsyncTCP starts its task with the first server
+  trackTaskStack(xTaskGetHandle("async_tcp"));
+  markBootPhase(BOOT_WEB);
+
+  // Web upkeep and Wi-Fi on the network core
+  if (xTaskCreatePinnedToCore(serviceTask, "service", 4096, nullptr, SERVICE_TASK_PRIORITY, nullptr,
+                              SERVICE_TASK_CORE) != pdPASS) {
+    log_e("Failed to start service task");
+  }
+  bootDone = true;
+  requestRedraw();
 }
 
-void startBLEScan() {
-  log_i("\n=== STARTING BLE SCAN ===");
-  scanCount = 0;
-  printerFound = false;
-  
-  // Clear previous scan results
-  pBLEScan->clearResults();
-  
-  // Start active scan with our callback
-  pBLEScan->start(5, false); // 5 second scan, passive
-  
-  log_i("=== SCAN INITIATED ===\n");
+// Everything runs in the tasks started by setup()
+void loop() {
+  vTaskDelete(nullptr);
 }
 
-void loop() {
-  unsigned long currentMillis = millis();
+// Periodic work of the web layer, and Wi-Fi reconnects that don't block it
+void serviceTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  while (true) {
+    // Grant WebSocket print clients the buffer space the writer freed
+    serviceWsPrint();
+
+    // Push status changes to /events subscribers
+    serviceEventStream();
+
+    // Fail segmented uploads whose client gave up
+    serviceResumableUploads();
+
+    // Wi-Fi off while the cable carries the bridge, so the radio is BLE's
+    if (wifiStandby) {
+      suspendWifiLink(ethLinkUp());
+    }
+    // Next Wi-Fi attempt once its backoff has passed
+    serviceWifiLink();
+    // Radio time goes to BLE while jobs print
+    serviceCoexPolicy(printQueueDepth() > 0);
+    // Printers and queue depths peers see
+    serviceCluster();
+    // Outcomes of MQTT jobs, published in batches
+    serviceMqttIngest();
+    // Back to the low clock once uploads went quiet
+    servicePowerProfile();
+
+    // A verified update waits for the last queued job
+    serviceFirmwareUpdate(printQueueDepth() == 0);
+
+    // Time to ready for /status, until it is reached
+    if (bootPhaseMs(BOOT_READY) == 0) {
+      if (wifiLinkUp() || ethLinkUp()) {
+        markBootPhase(BOOT_WIFI);
+      }
+      for (size_t i = 0; i < printerCount(); i++) {
+        if (getPrinter(i)->connected()) {
+          markBootPhase(BOOT_PRINTER);
+        }
+      }
+    }
 
-  // Check button press to wake screen
-  if (digitalRead(PIN_BUTTON) == LOW) {
-    wakeScreen();
+    // With nothing queued, the power profile lets the CPU sleep longer
+    vTaskDelay(pdMS_TO_TICKS(idleIntervalMs(SERVICE_INTERVAL_MS, printQueueDepth() == 0)));
   }
+}
 
-  // Check screen timeout
-  checkScreenTimeout();
+// Both edges of the button. Pressing wakes the display task, which
+// otherwise sleeps while the screen is off; releasing reports the press
+// with its length to it.
+void IRAM_ATTR onButtonChange() {
+  static bool pressed = false;
+  static unsigned long lastEdge = 0;
+  static unsigned long pressedAt = 0;
+  static bool screenWasOn = false;
+
+  unsigned long now = millis();
+  bool down = gpio_get_level((gpio_num_t)PIN_BUTTON) == 0;
+  if (down == pressed || now - lastEdge < BUTTON_DEBOUNCE_MS) {
+    return;
+  }
+  pressed = down;
+  lastEdge = now;
+
+  BaseType_t woken = pdFALSE;
+  if (down) {
+    pressedAt = now;
+    screenWasOn = isScreenOn;
+    lastActivityTime = now;
+  } else if (buttonQueue != nullptr) {
+    ButtonEvent event = {now - pressedAt >= BUTTON_LONG_PRESS_MS ? BUTTON_LONG : BUTTON_SHORT, screenWasOn};
+    xQueueSendFromISR(buttonQueue, &event, &woken);
+  }
+  DisplayRequest wake = DISPLAY_WAKE;
+  xQueueOverwriteFromISR(displayQueue, &wake, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
 
-  // Update LCD periodically only if screen is on
-  if (isScreenOn && currentMillis - previousMillis >= lcdUpdateInterval) {
-    previousMillis = currentMillis;
-    updateLCD();
+// Hardware button. A long press reprints, or with the job panel open uses
+// its selected control; a short one opens the panel and moves through it.
+void handleButton(const ButtonEvent& event) {
+  if (!jobPanel.isOpen()) {
+    if (event.press == BUTTON_LONG) {
+      reprintLastJob();
+    } else if (event.screenWasOn) {
+      jobPanel.open();
+    }
+    return;
+  }
+  if (event.press == BUTTON_SHORT) {
+    jobPanel.next();
+  } else {
+    runPanelAction(jobPanel.activate());
   }
+}
 
-  // Scan for printer periodically
-  if (currentMillis - previousBLEMillis >= bleScanInterval) {
-    previousBLEMillis = currentMillis;
-    startBLEScan();
+#ifdef TOUCH_CS
+bool touchHeld = false;                // Last sample was pressed
+
+#ifdef TOUCH_IRQ
+// Pen down on the touch controller: wakes the display task to sample it
+void IRAM_ATTR onTouchIrq() {
+  BaseType_t woken = pdFALSE;
+  DisplayRequest wake = DISPLAY_WAKE;
+  xQueueOverwriteFromISR(displayQueue, &wake, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+#endif
+
+// One touch sample; true when the screen needs a frame
+bool sampleTouch() {
+  static bool consumed = false;        // Touch that woke or opened, until lifted
+  uint16_t x = 0;
+  uint16_t y = 0;
+  bool pressed = tft.getTouch(&x, &y);
+  touchHeld = pressed;
+  if (!pressed) {
+    bool wasConsumed = consumed;
+    consumed = false;
+    if (jobPanel.isOpen() && !wasConsumed) {
+      runPanelAction(jobPanel.touch(false, 0, 0));
+      return true;
+    }
+    return false;
   }
 
-  // Reconnect to printer if disconnected and we found it
-  if (!printerConnected && printerFound) {
-    log_i("Printer disconnected, attempting to reconnect...");
-    if (connectToPrinter()) {
-        printerFound = false; // Reset so we don't keep trying if successful
-    } else {
-        // If connection failed, we might need to scan again
-        printerFound = false;
+  lastActivityTime = millis();
+  if (!isScreenOn) {
+    setDisplayPower(DISPLAY_POWER_ON);
+    isScreenOn = true;
+    consumed = true;
+    return true;
+  }
+  if (!jobPanel.isOpen()) {
+    if (!consumed) {
+      jobPanel.open();
+      consumed = true;
+      return true;
+    }
+    return false;
+  }
+  if (!consumed) {
+    jobPanel.touch(true, x, y);
+  }
+  return true;
+}
+#endif
+
+// Pending jobs by ID, the one printing first
+size_t sortedPendingJobs(PrintJobInfo* jobs, size_t max) {
+  size_t count = getPendingPrintJobs(jobs, max);
+  for (size_t i = 1; i < count; i++) {
+    PrintJobInfo job = jobs[i];
+    size_t j = i;
+    while (j > 0 && jobs[j - 1].id > job.id) {
+      jobs[j] = jobs[j - 1];
+      j--;
     }
-    delay(2000); // Wait before retrying
+    jobs[j] = job;
   }
+  return count;
+}
 
-  // Reconnect to WiFi if disconnected
-  if (WiFi.status() != WL_CONNECTED) {
-    log_i("WiFi disconnected, attempting to reconnect...");
-    connectToWiFi();
+bool printersPaused() {
+  for (size_t i = 0; i < printerCount(); i++) {
+    if (printWriterPaused(i)) {
+      return true;
+    }
   }
+  return false;
+}
+
+void drawJobPanel() {
+  PrintJobInfo jobs[PRINT_JOB_SLOTS];
+  size_t count = sortedPendingJobs(jobs, PRINT_JOB_SLOTS);
+  jobPanel.draw(jobs, count, printersPaused());
+}
 
-  delay(100);
+void runPanelAction(JobPanelAction action) {
+  switch (action) {
+    case PANEL_NONE:
+      break;
+    case PANEL_CANCEL: {
+      // The job printing, or else the next one
+      PrintJobInfo jobs[PRINT_JOB_SLOTS];
+      size_t count = sortedPendingJobs(jobs, PRINT_JOB_SLOTS);
+      const PrintJobInfo* target = count > 0 ? &jobs[0] : nullptr;
+      for (size_t i = 0; i < count; i++) {
+        if (jobs[i].state == JOB_STREAMING) {
+          target = &jobs[i];
+          break;
+        }
+      }
+      if (target && cancelPrintJob(target->id)) {
+        log_i("Panel: cancelled job %u", target->id);
+      }
+      break;
+    }
+    case PANEL_PAUSE: {
+      bool pause = !printersPaused();
+      for (size_t i = 0; i < printerCount(); i++) {
+        pausePrintWriter(i, pause);
+      }
+      break;
+    }
+    case PANEL_REPRINT:
+      reprintLastJob();
+      break;
+  }
 }
 
-void connectToWiFi() {
-  Serial.print("Connecting to WiFi ");
-  Serial.println(ssid);
-  
-  WiFi.begin(ssid, password);
-  
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
+// Long press: print the job cached or replayed last again, on the first
+// printer
+void reprintLastJob() {
+  String hash;
+  size_t length = 0;
+  if (!lastCachedJob(hash) || !jobCacheLookup(hash, length)) {
+    log_i("Long press: no cached job to reprint");
+    return;
   }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    wifiIP = WiFi.localIP().toString();
-    Serial.println("\nWiFi connected");
-    Serial.println("IP address: " + wifiIP);
-  } else {
-    Serial.println("\nWiFi connection failed");
-    wifiIP = "";
+  BlePrinter* printer = findPrinter("");
+  if (printer == nullptr || !printer->connected()) {
+    if (printer != nullptr) {
+      printer->requestJobConnect();
+    }
+    log_w("Long press: printer not connected");
+    return;
+  }
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t jobId = createPrintJob(printer->index(), length, reject);
+  if (jobId == 0) {
+    log_w("Long press: job refused (%d)", reject);
+    return;
+  }
+  if (!replayCachedJob(hash, jobId)) {
+    abortPrintJob(jobId);
+    log_w("Long press: job cache busy");
+    return;
+  }
+  log_i("Long press: reprinting %.12s as job %u", hash.c_str(), jobId);
+}
+
+// Button, backlight and LCD. Wakes for wakeScreen() and the button at once,
+// draws a state change from requestRedraw() at most every
+// DISPLAY_MIN_FRAME_MS, and otherwise redraws once per lcdUpdateInterval
+// while the screen is on.
+void displayTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  // Presses during the panel's init sequence wait in the queues for the loop
+  attachInterrupt(PIN_BUTTON, onButtonChange, CHANGE);
+  tft.init();
+  tft.setRotation(1); // Landscape orientation
+  initDisplayPower(&tft, PIN_BACKLIGHT);
+  tft.fillScreen(TFT_BLACK);
+  tft.setTextColor(TFT_WHITE);
+  tft.setTextSize(2);
+  tft.setCursor(50, 80);
+  tft.println("Booting...");
+  // Replaces the boot message with the first frame
+  statusView.begin(&tft);
+  jobPanel.begin(&tft);
+  markBootPhase(BOOT_DISPLAY);
+#if defined(TOUCH_CS) && defined(TOUCH_IRQ)
+  tft.setTouchIrqCallback(onTouchIrq);
+#endif
+
+  bool redraw = true;
+  bool previewShown = false;
+  bool panelShown = false;
+  while (true) {
+    TickType_t wait = portMAX_DELAY;
+    if (isScreenOn && bootDone) {
+      unsigned long due = previousMillis + (redraw ? DISPLAY_MIN_FRAME_MS : lcdUpdateInterval);
+      long left = (long)(due - millis());
+      wait = pdMS_TO_TICKS(left > 0 ? left : 0);
+    } else if (isScreenOn) {
+      wait = pdMS_TO_TICKS(DISPLAY_MIN_FRAME_MS);
+    }
+#ifdef TOUCH_CS
+    // Touch is sampled, at a fixed low rate; with the pen interrupt only
+    // from pen down until the lift is seen
+#ifdef TOUCH_IRQ
+    bool sampling = touchHeld || tft.touchPending();
+#else
+    bool sampling = true;
+#endif
+    if (sampling && wait > pdMS_TO_TICKS(JOB_PANEL_TOUCH_MS)) {
+      wait = pdMS_TO_TICKS(JOB_PANEL_TOUCH_MS);
+    }
+#endif
+
+    DisplayRequest request;
+    if (xQueueReceive(displayQueue, &request, wait) == pdTRUE) {
+      if (request == DISPLAY_WAKE && !isScreenOn) {
+        // The panel kept its frame while asleep; the next frame pushes what changed
+        setDisplayPower(DISPLAY_POWER_ON);
+        isScreenOn = true;
+        log_i("Screen woke up");
+      }
+      redraw = true;
+    }
+
+    ButtonEvent button;
+    while (xQueueReceive(buttonQueue, &button, 0) == pdTRUE) {
+      handleButton(button);
+      redraw = true;
+    }
+#ifdef TOUCH_CS
+    redraw |= sampleTouch();
+#endif
+
+    checkScreenTimeout();
+
+    unsigned long since = millis() - previousMillis;
+    if (bootDone && isScreenOn &&
+        ((redraw && since >= DISPLAY_MIN_FRAME_MS) || since >= lcdUpdateInterval)) {
+      previousMillis = millis();
+      redraw = false;
+      TRACE_BEGIN(TRACE_DISPLAY, 0);
+      STALL_SECTION("display frame");
+      if (jobPanel.expired()) {
+        jobPanel.close();
+      }
+      if (jobPanel.isOpen()) {
+        drawJobPanel();
+        panelShown = true;
+      } else if (servicePrintPreview(&tft)) {
+        previewShown = true;
+      } else {
+        if (previewShown || panelShown) {
+          statusView.invalidate();
+          previewShown = false;
+          panelShown = false;
+        }
+        updateLCD();
+        screenMirrorFrame(statusView.sprite());
+      }
+      TRACE_END(TRACE_DISPLAY, 0);
+    }
   }
 }
 
@@ -241,298 +736,2117 @@ void initLittleFS() {
 }
 
 void setupWebServer() {
-  // Serve static files from LittleFS
+  // In-flight limits per kind of route, with room kept for print uploads,
+  // and the /status fast lane; ahead of every other handler
+  initHttpAdmission(server, sendStatus);
+
+  // Packed web UI assets with ETags, then any other file from LittleFS
+  initStaticAssets(server);
   server.serveStatic("/", LittleFS, "/").setDefaultFile("index.html");
 
-  // Status endpoint
-  server.on("/status", HTTP_GET, [](AsyncWebServerRequest* request) {
-    String json = getStatusJSON();
-    request->send(200, "application/json", json);
+  // Status endpoint, with ETag and ?since= long polling. The admission
+  // handler answers it first; the route serves builds without it.
+  server.on("/status", HTTP_GET, sendStatus);
+
+  // What the bridge and its printers take, so clients pick the cheapest payload
+  server.on("/capabilities", HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send(200, "application/json", getCapabilitiesJSON());
+  });
+
+  // Prometheus scrape endpoint
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send(200, "text/plain; version=0.0.4", getMetricsText());
+  });
+
+  // Print endpoints: admit the upload as a job and answer 202 with its ID.
+  // The response is only sent once the whole body has been received.
+  // /print/image, /print/template, /print/cached, /print/batch, /print/zpl and /print/pdf
+  // go first because /print matches every path below it.
+  server.on("/print/image", HTTP_POST, handlePrintRequest, NULL,
+            [](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    handlePrintBody(request, data, len, index, total, true);
+  });
+  // Stored label layout: /print/template/{name} with a JSON object of field values
+  server.on("/print/template", HTTP_POST, handleTemplateRequest, NULL, handleTemplateBody);
+  // Replay of a job cached under its hash: /print/cached/{hash}
+  server.on("/print/cached", HTTP_POST, handleCachedRequest);
+  // Many length-prefixed labels printed back to back as one job
+  server.on("/print/batch", HTTP_POST, handleBatchRequest, NULL, handleBatchBody);
+  // ZPL rendered on the bridge, label by label as the body arrives
+  server.on("/print/zpl", HTTP_POST, handleZplRequest, NULL, handleZplBody);
+  // Carrier-label PDFs whose pages are one bitmap each, see pdf_label.h
+  server.on("/print/pdf", HTTP_POST, handlePdfRequest, NULL, handlePdfBody);
+  server.on("/print", HTTP_POST, handlePrintRequest, NULL,
+            [](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    handlePrintBody(request, data, len, index, total, false);
+  });
+
+  // Driverless printing from phones and laptops, see ipp_server.h
+  initIppServer(server, appendLabel);
+
+  // Peer bridges, and uploads for their printers passed through to them
+  initCluster(80);
+  server.on("/cluster", HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send(200, "application/json", getClusterJSON());
+  });
+
+  // Jobs published by a warehouse system, see mqtt_ingest.h
+  initMqttIngest();
+
+  // WebSocket print channel for streaming from the web UI while it renders
+  initWsPrint(server, routeWsPrint);
+  initEventStream(server);
+
+  // Throughput sweeps of one printer's link, see link_bench.h
+  initLinkBench(server);
+  // Hours of traffic against the fake printer, with -DSOAK_TEST=1
+  initSoakTest(server);
+  initScreenMirror(server);
+
+  // Event timeline of the last moments, see trace.h
+  initTrace(server);
+  initCpuProfile(server);
+
+  // Timelines of the last finished jobs, newest first. Must be registered
+  // before /jobs, which matches every path below it.
+  server.on("/jobs/history", HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send(200, "application/json", getHistoryJSON());
+  });
+
+  // Jobs waiting in the print spool, oldest first
+  server.on("/spool", HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send(200, "application/json", getSpoolJSON());
   });
 
-  // Print endpoint
-  server.on("/print", HTTP_POST, [](AsyncWebServerRequest* request) {
-    if (!printerConnected) {
-      request->send(500, "text/plain", "Printer not connected");
+  // Job status endpoint: /jobs/{id}
+  server.on("/jobs", HTTP_GET, [](AsyncWebServerRequest* request) {
+    String url = request->url();
+    PrintJobInfo info;
+    if (!url.startsWith("/jobs/") || !getPrintJob(url.substring(6).toInt(), info)) {
+      request->send(404, "text/plain", "Unknown job");
       return;
     }
+    request->send(200, "application/json", getJobJSON(info));
+  });
 
-    AsyncWebServerResponse* response = request->beginResponse(200, "text/plain", "Print successful");
-    request->send(response);
-  }, NULL, [](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
-    printToBLEPrinter(data, len);
+  // Cancel a job: /jobs/{id}. A queued job is dropped at once; one printing
+  // stops after the raster band it is in, and the label is ended cleanly.
+  server.on("/jobs", HTTP_DELETE, [](AsyncWebServerRequest* request) {
+    String url = request->url();
+    uint32_t jobId = url.startsWith("/jobs/") ? url.substring(6).toInt() : 0;
+    PrintJobInfo info;
+    if (!getPrintJob(jobId, info)) {
+      request->send(404, "text/plain", "Unknown job");
+      return;
+    }
+    if (!cancelPrintJob(jobId)) {
+      request->send(409, "text/plain", "Job already finished");
+      return;
+    }
+    log_i("Job %u cancelled over HTTP", jobId);
+    getPrintJob(jobId, info);
+    request->send(200, "application/json", getJobJSON(info));
   });
 
-  // Connect printer endpoint
+  // Next Content-Range segment of a job opened with Upload-Length: /jobs/{id}
+  server.on("/jobs", HTTP_PUT, handleSegmentRequest, NULL, handleSegmentBody);
+
+  // Connect printer endpoint. Connecting happens in the printer's BLE link
+  // task, so this only starts it; /status reports the progress.
   server.on("/connect", HTTP_GET, [](AsyncWebServerRequest* request) {
-    if (connectToPrinter()) {
+    BlePrinter* printer = requestedPrinter(request);
+    if (printer == nullptr) {
+      request->send(404, "text/plain", "Unknown printer");
+      return;
+    }
+    if (printer->connected()) {
       request->send(200, "text/plain", "Printer connected");
-    } else {
-      request->send(500, "text/plain", "Failed to connect to printer");
+      return;
+    }
+    printer->requestConnect();
+    request->send(202, "text/plain", "Connecting to printer");
+  });
+
+  // Runtime settings. The printer list route comes first, as /config
+  // also matches everything below it.
+  server.on("/config/printers", HTTP_GET, [](AsyncWebServerRequest* request) {
+    if (!LittleFS.exists(PRINTER_REGISTRY_PATH)) {
+      request->send(404, "text/plain", "No printer list, using the build flags");
+      return;
     }
+    request->send(LittleFS, PRINTER_REGISTRY_PATH, "text/plain");
   });
+  server.on("/config/printers", HTTP_POST, handlePrinterListRequest, NULL, handlePrinterListBody);
+  server.on("/config", HTTP_GET, [](AsyncWebServerRequest* request) {
+    request->send(200, "application/json", getConfigJSON());
+  });
+  server.on("/config", HTTP_POST, handleConfigRequest);
+
+  // Firmware (or with ?target=fs, LittleFS) image streamed to flash
+  server.on("/update", HTTP_POST, handleUpdateRequest, NULL, handleUpdateBody);
 
-  // Disconnect printer endpoint
+  // Disconnect printer endpoint. Stays disconnected until /connect.
   server.on("/disconnect", HTTP_GET, [](AsyncWebServerRequest* request) {
-    disconnectFromPrinter();
+    BlePrinter* printer = requestedPrinter(request);
+    if (printer == nullptr) {
+      request->send(404, "text/plain", "Unknown printer");
+      return;
+    }
+    printer->requestDisconnect();
     request->send(200, "text/plain", "Printer disconnected");
   });
 
   log_i("Web server routes configured");
 }
 
-void initBLE() {
-  BLEDevice::init("ESP32_Printer");
-  
-  // Set security
-  // BLESecurity *pSecurity = new BLESecurity();
-  // pSecurity->setAuthenticationMode(ESP_LE_AUTH_BOND);
-  // pSecurity->setCapability(ESP_IO_CAP_NONE);
-  // pSecurity->setInitEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
-  
-  // Set connection parameters
-  // BLEDevice::setPower(ESP_PWR_LVL_P9); // Increase power if needed
-  
-  log_i("BLE initialized");
-
-  // Initialize BLE scan with our custom callback
-  pBLEScan = BLEDevice::getScan();
-  pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
-  pBLEScan->setActiveScan(true); // Active scan for better discovery
-  pBLEScan->setInterval(100);
-  pBLEScan->setWindow(99);
-}
-
-bool connectToPrinter() {
-  if (printerConnected) {
-    log_i("Printer already connected");
-    return true;
+// Printer selected with ?printer=<id>, the first one without it
+BlePrinter* requestedPrinter(AsyncWebServerRequest* request) {
+  return findPrinter(request->hasParam("printer") ? request->getParam("printer")->value() : String());
+}
+
+// Completion of a /print or /print/image upload
+void handlePrintRequest(AsyncWebServerRequest* request) {
+  PrintRequestContext* ctx = (PrintRequestContext*)request->_tempObject;
+  if (ctx == nullptr) {
+    // Without a body the job can only come from the cache, or be opened
+    // for segments
+    if (request->hasHeader("X-Job-Hash")) {
+      startCachedJob(request, request->header("X-Job-Hash"));
+      return;
+    }
+    if (request->hasHeader("Upload-Length") || request->hasHeader("Upload-Defer-Length")) {
+      startResumableJob(request);
+      return;
+    }
+    request->send(400, "text/plain", "Empty print job");
+    return;
   }
 
-  if (!printerFound || myDevice == nullptr) {
-    log_i("Printer not found in scan yet");
-    return false;
+  if (ctx->forward != nullptr) {
+    ctx->forward->finish(request);
+    return;
   }
 
-  log_i("Connecting to printer %s", myDevice->getAddress().toString().c_str());
+  if (ctx->unknownPrinter) {
+    request->send(404, "text/plain", request->hasParam("pool") ? "Unknown pool" : "Unknown printer");
+    return;
+  }
 
-  // Clean up any existing client
-  if (pClient != nullptr) {
-    if (pClient->isConnected()) {
-      pClient->disconnect();
-    }
-    // delete pClient; // Avoid deleting to prevent crashes if callbacks are pending
-    pClient = nullptr;
+  if (ctx->unsupportedEncoding) {
+    request->send(415, "text/plain", "Unsupported Content-Encoding");
+    return;
   }
 
-  // Create new client
-  pClient = BLEDevice::createClient();
-  if (pClient == nullptr) {
-    log_e("Failed to create BLE client");
-    return false;
+  // Spooled without a job: the spool task prints it once it can
+  if (ctx->spool != nullptr && ctx->jobId == 0) {
+    uint32_t spoolId = ctx->spool->commit(0);
+    if (spoolId != 0) {
+      sendSpooled(request, spoolId);
+      return;
+    }
   }
-  pClient->setClientCallbacks(new MyClientCallback());
 
-  log_i("Created BLE client");
+  if (ctx->printerOffline) {
+    request->send(500, "text/plain", "Printer not connected");
+    return;
+  }
 
-  // Try connection using the advertised device object
-  bool connected = pClient->connect(myDevice);
-  
-  if (!connected) {
-    log_e("❌ Connection failed");
-    pClient->disconnect();
-    pClient = nullptr;
-    printerConnected = false;
-    return false;
+  if (ctx->invalidHash) {
+    request->send(400, "text/plain", "X-Job-Hash is not a SHA-256");
+    return;
   }
 
-  log_i("✅ Connected to printer");
-  
-  // Set MTU
-  pClient->setMTU(247); 
-  
-  // Authenticate/Bond if needed
-  // pClient->authenticate(); // Some devices require explicit call
-  
-  delay(100); // Reduced delay
-
-  if (!pClient->isConnected()) {
-      log_e("❌ Disconnected after MTU update");
-      pClient->disconnect();
-      pClient = nullptr;
-      printerConnected = false;
-      return false;
+  if (ctx->invalidCopies) {
+    request->send(400, "text/plain", "Invalid copies");
+    return;
   }
 
-  // Get service and characteristic
-  BLERemoteService* pRemoteService = pClient->getService(serviceUUID);
-  if (pRemoteService == nullptr) {
-    log_e("❌ Failed to find service: %s", serviceUUID.toString().c_str());
-    pClient->disconnect();
-    pClient = nullptr;
-    printerConnected = false;
-    return false;
+  if (ctx->jobId == 0) {
+    sendQueueRejected(request, ctx->reject, ctx->printer);
+    return;
   }
 
-  log_i("✅ Found service: %s", serviceUUID.toString().c_str());
+  // The replay finishes the job by itself
+  if (ctx->cacheHit) {
+    sendJobAccepted(request, ctx->jobId, "hit");
+    return;
+  }
 
-  pRemoteCharacteristic = pRemoteService->getCharacteristic(characteristicUUID);
-  if (pRemoteCharacteristic == nullptr) {
-    log_e("❌ Failed to find characteristic: %s", characteristicUUID.toString().c_str());
-    
-    pClient->disconnect();
-    pClient = nullptr;
-    printerConnected = false;
-    return false;
+  if (ctx->inflater != nullptr && ctx->inflater->status() != INFLATE_DONE) {
+    abortPrintJob(ctx->jobId);
+    request->send(400, "text/plain", "Incomplete or corrupt compressed data");
+    return;
   }
 
-  log_i("✅ Found characteristic: %s", characteristicUUID.toString().c_str());
-
-  // Try to read printer name from device name characteristic (00002a00-0000-1000-8000-00805f9b34fb)
-  // First, check if we can find the generic access service (00001800-0000-1000-8000-00805f9b34fb)
-  BLEUUID genericAccessServiceUUID("00001800-0000-1000-8000-00805f9b34fb");
-  BLERemoteService* pGenericAccessService = pClient->getService(genericAccessServiceUUID);
-  
-  if (pGenericAccessService != nullptr) {
-    log_i("✅ Found Generic Access service");
-    
-    BLERemoteCharacteristic* pDeviceNameCharacteristic = pGenericAccessService->getCharacteristic(deviceNameUUID);
-    
-    if (pDeviceNameCharacteristic != nullptr) {
-      log_i("✅ Found Device Name characteristic");
-      
-      if (pDeviceNameCharacteristic->canRead()) {
-        printerName = pDeviceNameCharacteristic->readValue();
-        log_i("✅ Printer name: %s", printerName.c_str());
-      } else {
-        log_w("❌ Device Name characteristic is not readable");
-      }
-    } else {
-      log_w("❌ Did not find Device Name characteristic");
+  if (ctx->rasterizer != nullptr && ctx->rasterizer->status() != IMAGE_DONE) {
+    abortPrintJob(ctx->jobId);
+    ImageError error = ctx->rasterizer->error();
+    int code = 400;
+    if (error == IMAGE_ERR_FORMAT) {
+      code = 415;
+    } else if (error == IMAGE_ERR_TOO_LARGE) {
+      code = 413;
+    } else if (error == IMAGE_ERR_NO_MEMORY || error == IMAGE_ERR_OUTPUT) {
+      code = 503;
     }
-  } else {
-    log_w("❌ Did not find Generic Access service");
+    request->send(code, "text/plain", error == IMAGE_OK ? "Incomplete image" : imageErrorName(error));
+    return;
   }
 
-  printerConnected = true;
-  log_i("✅ Printer connection established successfully!");
-  return true;
-}
-
-void disconnectFromPrinter() {
-  if (pClient && pClient->isConnected()) {
-    pClient->disconnect();
+  finishPrintJob(ctx->jobId);
+  const char* cache = nullptr;
+  if (ctx->recorder != nullptr) {
+    cache = ctx->recorder->commit() ? "stored" : "miss";
+  }
+  // ?spool=1 keeps a copy until the job printed, to send it again after a
+  // dropped link
+  uint32_t spoolId = ctx->spool != nullptr ? ctx->spool->commit(ctx->jobId) : 0;
+  AsyncWebServerResponse* response = jobAcceptedResponse(request, ctx->jobId);
+  if (response == nullptr) {
+    return;
+  }
+  if (cache != nullptr) {
+    response->addHeader("X-Job-Cache", cache);
   }
-  // We don't delete pClient here to avoid race conditions with callbacks
-  pRemoteCharacteristic = nullptr;
-  printerConnected = false;
-  log_i("Printer disconnected");
+  if (spoolId != 0) {
+    response->addHeader("X-Spool-Id", String(spoolId));
+  }
+  request->send(response);
 }
 
-void printToBLEPrinter(const uint8_t* data, size_t length) {
-  wakeScreen(); // Wake screen on print activity
+// 202 for an upload that waits in the spool for its printer
+void sendSpooled(AsyncWebServerRequest* request, uint32_t spoolId) {
+  String json = "{\"spool\":" + String(spoolId) + ",\"status\":\"spooled\"}";
+  AsyncWebServerResponse* response = request->beginResponse(202, "application/json", json);
+  response->addHeader("Location", "/spool");
+  response->addHeader("X-Spool-Id", String(spoolId));
+  request->send(response);
+}
 
-  if (!printerConnected || !pRemoteCharacteristic) {
-    log_e("Cannot print: printer not connected");
+// 202 with the job of an accepted print. cache goes into X-Job-Cache for
+// uploads that named their hash.
+void sendJobAccepted(AsyncWebServerRequest* request, uint32_t jobId, const char* cache) {
+  AsyncWebServerResponse* response = jobAcceptedResponse(request, jobId);
+  if (response == nullptr) {
     return;
   }
-
-  if (pRemoteCharacteristic->canWrite()) {
-    // Manual chunking to avoid BLE library "long write" issues
-    // MTU is set to 247. Max payload is MTU - 3 = 244.
-    // We use 240 to be safe.
-    const size_t CHUNK_SIZE = 240; 
-    size_t offset = 0;
-    
-    while (offset < length) {
-      size_t remaining = length - offset;
-      size_t currentChunkSize = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-      
-      pRemoteCharacteristic->writeValue(const_cast<uint8_t*>(data + offset), currentChunkSize, true);
-      offset += currentChunkSize;
-    }
-    log_i("Printed %d bytes in chunks", length);
-  } else {
-    log_e("Characteristic cannot be written");
+  if (cache != nullptr) {
+    response->addHeader("X-Job-Cache", cache);
   }
+  request->send(response);
 }
 
-void updateLCD() {
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextSize(2);
-  
-  // WiFi status
-  tft.setTextColor(TFT_GREEN);
-  tft.setCursor(0, 0);
-  if (WiFi.status() == WL_CONNECTED) {
-    tft.print("WiFi: ");
-    tft.print(wifiIP);
-  } else {
-    tft.setTextColor(TFT_RED);
-    tft.println("WiFi: Disconnected");
-  }
-
-  // Printer status
-  tft.setTextSize(2);
-  tft.setCursor(0, 30);
-  if (printerConnected) {
-    tft.setTextColor(TFT_GREEN);
-    tft.println("Printer: Connected");
-    tft.setTextSize(1);
-    tft.setCursor(0, 60);
-    tft.setTextColor(TFT_WHITE);
-    tft.print("Name: ");
-    tft.println(printerName);
-  } else {
-    tft.setTextColor(TFT_RED);
-    tft.println("Printer: Disconnected");
+// The 202 of sendJobAccepted() for the caller to add headers to. Null
+// after answering 500 when the job is gone.
+AsyncWebServerResponse* jobAcceptedResponse(AsyncWebServerRequest* request, uint32_t jobId) {
+  PrintJobInfo info;
+  if (!getPrintJob(jobId, info)) {
+    request->send(500, "text/plain", "Print job lost");
+    return nullptr;
   }
 
-  // Last action (default to idle)
-  tft.setTextSize(1);
-  tft.setTextColor(TFT_WHITE);
-  tft.setCursor(0, 80);
-  tft.println("Last Action: Idle");
+  AsyncWebServerResponse* response = request->beginResponse(202, "application/json", getJobJSON(info));
+  response->addHeader("Location", "/jobs/" + String(info.id));
+  return response;
+}
 
-  // Uptime
-  tft.setTextSize(1);
-  tft.setCursor(0, 100);
-  unsigned long uptime = millis() / 1000;
-  tft.print("Uptime: ");
-  tft.print(uptime);
-  tft.println(" sec");
+// 503 for a job the queue didn't take, with a hint when to retry
+void sendQueueRejected(AsyncWebServerRequest* request, PrintJobReject reject, uint8_t printer) {
+  AsyncWebServerResponse* response = request->beginResponse(503, "text/plain",
+    reject == JOB_REJECT_NO_MEMORY ? "Out of memory for print job"
+    : reject == JOB_REJECT_TOO_LARGE ? "Print job too large to hold" : "Print queue full");
+  response->addHeader("Retry-After", String(printQueueRetryAfter(printer)));
+  request->send(response);
 }
 
-String getStatusJSON() {
-  String json = "{";
-  json += "\"wifi\":\"";
-  json += (WiFi.status() == WL_CONNECTED) ? "connected" : "disconnected";
-  json += "\",";
-  json += "\"ip\":\"" + wifiIP + "\",";
-  json += "\"printer\":\"";
-  json += printerConnected ? "connected" : "disconnected";
-  json += "\",";
-  json += "\"printerName\":\"" + printerName + "\",";
-  json += "\"uptime\":";
-  json += String(millis() / 1000);
-  json += "}";
-  return json;
+// Printer a print request goes to: ?pool=<name> picks the least busy
+// connected member of the pool, otherwise ?printer=<id> or the first one.
+// printer is null when no member of the pool is connected. False for an
+// unknown pool or printer.
+bool requestedPrintTarget(AsyncWebServerRequest* request, BlePrinter*& printer, uint8_t& pool) {
+  printer = nullptr;
+  pool = PRINT_NO_POOL;
+  if (request->hasParam("pool")) {
+    if (!findPool(request->getParam("pool")->value(), pool)) {
+      pool = PRINT_NO_POOL;
+      return false;
+    }
+    printer = selectPoolPrinter(pool);
+    return true;
+  }
+  printer = requestedPrinter(request);
+  return printer != nullptr;
 }
 
-void wakeScreen() {
-  lastActivityTime = millis();
-  if (!isScreenOn) {
-    digitalWrite(PIN_BACKLIGHT, HIGH);
-    isScreenOn = true;
-    updateLCD(); // Refresh content immediately
-    log_i("Screen woke up");
+// A job for a target that isn't connected: start connecting while it is
+// received, so a spooled upload goes out as soon as the link is ready and a
+// refused one finds the printer there when it is sent again
+void connectPrintTarget(BlePrinter* printer, uint8_t pool) {
+  if (pool != PRINT_NO_POOL) {
+    requestPoolConnect(pool);
+  } else if (printer != nullptr) {
+    printer->requestJobConnect();
   }
 }
 
-void checkScreenTimeout() {
-  if (isScreenOn && (millis() - lastActivityTime > SCREEN_TIMEOUT)) {
-    digitalWrite(PIN_BACKLIGHT, LOW);
-    isScreenOn = false;
-    log_i("Screen timeout - backlight off");
+// Body chunks of a /print upload. The first chunk admits the job; images
+// are rasterized on their way into the job buffer.
+void handlePrintBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total, bool image) {
+  TRACE_INSTANT(TRACE_HTTP_BODY, len);
+  STALL_SECTION("http print body");
+  PrintRequestContext* ctx = (PrintRequestContext*)request->_tempObject;
+  if (index == 0 && ctx == nullptr) {
+    // Freed together with the request
+    ctx = (PrintRequestContext*)malloc(sizeof(PrintRequestContext));
+    if (ctx == nullptr) {
+      return;
+    }
+    BlePrinter* printer = nullptr;
+    ctx->unknownPrinter = !requestedPrintTarget(request, printer, ctx->pool);
+    ctx->jobId = 0;
+    ctx->printer = printer != nullptr ? printer->index() : 0;
+    ctx->reject = JOB_ACCEPTED;
+    ctx->printerOffline = !ctx->unknownPrinter && (printer == nullptr || !printer->connected());
+    if (ctx->printerOffline) {
+      connectPrintTarget(printer, ctx->pool);
+    }
+    ctx->unsupportedEncoding = false;
+    ctx->invalidHash = false;
+    ctx->invalidCopies = !validJobCopies(request);
+    ctx->cacheHit = false;
+    ctx->inflater = nullptr;
+    ctx->rasterizer = nullptr;
+    ctx->recorder = nullptr;
+    ctx->spool = nullptr;
+    // A printer held by a peer bridge gets the upload passed through
+    ctx->forward = ctx->unknownPrinter ? startClusterForward(request, total) : nullptr;
+    request->_tempObject = ctx;
+
+    // Compressed uploads are decoded on the fly; the decoded size is only
+    // known at the end, so the job is admitted with an unknown length
+    bool deflate = false;
+    if (request->hasHeader("Content-Encoding")) {
+      String encoding = request->header("Content-Encoding");
+      deflate = !image && encoding.equalsIgnoreCase("deflate");
+      ctx->unsupportedEncoding = !deflate && !encoding.equalsIgnoreCase("identity");
+    }
+
+    // Raw jobs may name the SHA-256 of their command stream; the decoded
+    // stream for deflate uploads
+    String hash;
+    if (!image && request->hasHeader("X-Job-Hash")) {
+      hash = request->header("X-Job-Hash");
+      ctx->invalidHash = !isJobHash(hash);
+    }
+
+    // A cached job starts printing from flash while the body is drained
+    size_t cachedLength = 0;
+    if (!ctx->unknownPrinter && !ctx->printerOffline && !ctx->unsupportedEncoding && !ctx->invalidHash &&
+        !ctx->invalidCopies && hash.length() > 0 && jobCacheLookup(hash, cachedLength)) {
+      ctx->jobId = createPrintJob(ctx->printer, cachedLength, ctx->reject, ctx->pool);
+      if (ctx->jobId == 0) {
+        return;
+      }
+      applyJobDpi(request, ctx->jobId);
+      applyJobScheduling(request, ctx->jobId, PRINT_PRIORITY_INTERACTIVE);
+      if (!applyJobCopies(request, ctx->jobId)) {
+        ctx->jobId = 0;
+        ctx->reject = JOB_REJECT_TOO_LARGE;
+        return;
+      }
+      if (replayCachedJob(hash, ctx->jobId)) {
+        ctx->cacheHit = true;
+        return;
+      }
+      // Evicted since the lookup or too many replays waiting: take the upload
+      abortPrintJob(ctx->jobId);
+      ctx->jobId = 0;
+    }
+
+    // Plain uploads wait on flash while their printer is away, and with
+    // ?spool=1 are kept there until printed
+    bool spoolRequested = request->hasParam("spool") && request->getParam("spool")->value() == "1";
+    if (!image && !deflate && hash.length() == 0 && !ctx->unknownPrinter && !ctx->unsupportedEncoding &&
+        !ctx->invalidCopies && (ctx->printerOffline || spoolRequested)) {
+      ctx->spool = new PrintSpoolWriter();
+      if (!ctx->spool->begin(ctx->printer, ctx->pool, total)) {
+        delete ctx->spool;
+        ctx->spool = nullptr;
+      }
+    }
+
+    if (!ctx->unknownPrinter && !ctx->printerOffline && !ctx->unsupportedEncoding && !ctx->invalidHash &&
+        !ctx->invalidCopies) {
+      if (hash.length() > 0) {
+        ctx->recorder = new JobCacheRecorder();
+        if (!ctx->recorder->begin(hash)) {
+          delete ctx->recorder;
+          ctx->recorder = nullptr;
+        }
+      }
+      if (deflate) {
+        ctx->inflater = new InflateStream();
+        if (!ctx->inflater->begin(true, appendInflated, ctx)) {
+          delete ctx->inflater;
+          ctx->inflater = nullptr;
+          ctx->reject = JOB_REJECT_NO_MEMORY;
+          return;
+        }
+      }
+
+      // Images become printer commands of a size only known at the end
+      if (image) {
+        ctx->rasterizer = new ImageRasterizer();
+        ctx->rasterizer->begin(imageOptions(request), appendRasterized, ctx);
+      }
+
+      bool unknownLength = deflate || image;
+      ctx->jobId = createPrintJob(ctx->printer, unknownLength ? PRINT_JOB_LENGTH_UNKNOWN : total, ctx->reject, ctx->pool);
+      applyJobDpi(request, ctx->jobId);
+      applyJobScheduling(request, ctx->jobId, PRINT_PRIORITY_INTERACTIVE);
+      if (!applyJobCopies(request, ctx->jobId)) {
+        ctx->jobId = 0;
+        ctx->reject = JOB_REJECT_TOO_LARGE;
+      }
+    }
+
+    uint32_t jobId = ctx->jobId;
+    InflateStream* inflater = ctx->inflater;
+    ImageRasterizer* rasterizer = ctx->rasterizer;
+    JobCacheRecorder* recorder = ctx->recorder;
+    PrintSpoolWriter* spool = ctx->spool;
+    ClusterForward* forward = ctx->forward;
+    // A client that goes away mid-upload fails its job
+    onRequestEnd(request, [jobId, inflater, rasterizer, recorder, spool, forward]() {
+      if (jobId != 0) {
+        abortPrintJob(jobId);
+      }
+      delete inflater;
+      delete rasterizer;
+      delete recorder;
+      delete spool;
+      delete forward;
+    });
+  }
+
+  if (ctx != nullptr && ctx->forward != nullptr) {
+    ctx->forward->write(data, len);
+    return;
+  }
+
+  if (ctx != nullptr && ctx->spool != nullptr) {
+    ctx->spool->write(data, len);
+  }
+
+  if (ctx == nullptr || ctx->jobId == 0 || ctx->cacheHit) {
+    return;
+  }
+
+  if (ctx->rasterizer != nullptr) {
+    if (ctx->rasterizer->status() == IMAGE_MORE_INPUT && ctx->rasterizer->feed(data, len) == IMAGE_ERROR) {
+      log_e("Job %u image rejected: %s", ctx->jobId, imageErrorName(ctx->rasterizer->error()));
+      abortPrintJob(ctx->jobId);
+    }
+    return;
+  }
+
+  if (ctx->inflater != nullptr) {
+    if (ctx->inflater->feed(data, len) == INFLATE_ERROR) {
+      log_e("Job %u compressed data rejected after %u decoded bytes", ctx->jobId, ctx->inflater->decoded());
+      abortPrintJob(ctx->jobId);
+    }
+    return;
+  }
+
+  if (ctx->recorder != nullptr) {
+    ctx->recorder->write(data, len);
+  }
+
+  // Only copy into the job buffer here; the writer task does the BLE writes
+  size_t queued = appendPrintJob(ctx->jobId, data, len, printQueueTimeout);
+  if (queued < len) {
+    log_e("Job %u buffer full, dropped %d of %d bytes", ctx->jobId, len - queued, len);
+    finishPrintJob(ctx->jobId);
+  }
+}
+
+// Body of a /print/template request, collected whole before rendering
+void handleTemplateBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+  TemplateRequestContext* ctx = (TemplateRequestContext*)request->_tempObject;
+  if (index == 0 && ctx == nullptr) {
+    // Freed together with the request
+    ctx = (TemplateRequestContext*)malloc(sizeof(TemplateRequestContext));
+    if (ctx == nullptr) {
+      return;
+    }
+    ctx->length = 0;
+    ctx->tooLarge = total > LABEL_MAX_REQUEST;
+    request->_tempObject = ctx;
+  }
+  if (ctx == nullptr || ctx->tooLarge) {
+    return;
+  }
+  if (ctx->length + len > LABEL_MAX_REQUEST) {
+    ctx->tooLarge = true;
+    return;
+  }
+  memcpy(ctx->body + ctx->length, data, len);
+  ctx->length += len;
+}
+
+// Answer a template that failed to render, and fail its job
+static void sendLabelRejected(AsyncWebServerRequest* request, uint32_t jobId, LabelResult result,
+                              const String& detail) {
+  abortPrintJob(jobId);
+  int code = 400;
+  if (result == LABEL_NOT_FOUND) {
+    code = 404;
+  } else if (result == LABEL_NO_MEMORY || result == LABEL_OUTPUT) {
+    code = 503;
+  }
+  String message = labelResultName(result);
+  if (detail.length() > 0) {
+    message += ": " + detail;
+  }
+  request->send(code, "text/plain", message);
+}
+
+// Completion of a /print/template/{name} request: render the label into a
+// job of its own. Takes the image options of /print/image.
+void handleTemplateRequest(AsyncWebServerRequest* request) {
+  TemplateRequestContext* ctx = (TemplateRequestContext*)request->_tempObject;
+  String url = request->url();
+  if (!url.startsWith("/print/template/")) {
+    request->send(404, "text/plain", "Unknown template");
+    return;
+  }
+  if (ctx != nullptr && ctx->tooLarge) {
+    request->send(413, "text/plain", "Field values too large");
+    return;
+  }
+  if (url.length() > 23 && url.endsWith("/series")) {
+    handleSeriesRequest(request, ctx);
+    return;
+  }
+
+  BlePrinter* printer = nullptr;
+  uint8_t pool = PRINT_NO_POOL;
+  if (!requestedPrintTarget(request, printer, pool)) {
+    request->send(404, "text/plain", request->hasParam("pool") ? "Unknown pool" : "Unknown printer");
+    return;
+  }
+  if (printer == nullptr || !printer->connected()) {
+    connectPrintTarget(printer, pool);
+    request->send(500, "text/plain", "Printer not connected");
+    return;
+  }
+  if (!validJobCopies(request)) {
+    request->send(400, "text/plain", "Invalid copies");
+    return;
+  }
+
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t jobId = createPrintJob(printer->index(), PRINT_JOB_LENGTH_UNKNOWN, reject, pool);
+  if (jobId == 0) {
+    sendQueueRejected(request, reject, printer->index());
+    return;
+  }
+  applyJobScheduling(request, jobId, PRINT_PRIORITY_INTERACTIVE);
+  if (!applyJobCopies(request, jobId)) {
+    sendQueueRejected(request, JOB_REJECT_TOO_LARGE, printer->index());
+    return;
+  }
+
+  // Stored bitmaps are kept per printer; a pool job may end up on another
+  LabelPrinter target = {printer->index(), printer->mac(),
+                         request->hasParam("resend") && request->getParam("resend")->value() == "1"};
+
+  // An empty body prints the template with no field values
+  String detail;
+  LabelResult result = printLabelTemplate(url.substring(16), ctx != nullptr ? ctx->body : "{}",
+                                          ctx != nullptr ? ctx->length : 2, imageOptions(request),
+                                          pool == PRINT_NO_POOL ? &target : nullptr, appendLabel, &jobId, detail);
+  if (result != LABEL_OK) {
+    sendLabelRejected(request, jobId, result, detail);
+    return;
+  }
+
+  finishPrintJob(jobId);
+  sendJobAccepted(request, jobId);
+}
+
+// /print/template/{name}/series: count labels of one template with a
+// counter field, as one bulk job. The first renders here, the rest on the
+// series task.
+void handleSeriesRequest(AsyncWebServerRequest* request, TemplateRequestContext* ctx) {
+  String url = request->url();
+  String name = url.substring(16, url.length() - 7);
+  String field = request->hasParam("field") ? request->getParam("field")->value() : String();
+  String format = request->hasParam("format") ? request->getParam("format")->value() : String("%d");
+  long count = request->hasParam("count") ? request->getParam("count")->value().toInt() : 0;
+  if (field.length() == 0 || field.indexOf('"') >= 0 || field.indexOf('\\') >= 0) {
+    request->send(400, "text/plain", "Invalid field");
+    return;
+  }
+  if (format.length() > LABEL_SERIES_FORMAT || !validSeriesFormat(format.c_str())) {
+    request->send(400, "text/plain", "Format needs one %d");
+    return;
+  }
+  if (count < 1 || count > LABEL_SERIES_MAX) {
+    request->send(400, "text/plain", "Invalid count");
+    return;
+  }
+
+  BlePrinter* printer = nullptr;
+  uint8_t pool = PRINT_NO_POOL;
+  if (!requestedPrintTarget(request, printer, pool)) {
+    request->send(404, "text/plain", request->hasParam("pool") ? "Unknown pool" : "Unknown printer");
+    return;
+  }
+  if (printer == nullptr || !printer->connected()) {
+    connectPrintTarget(printer, pool);
+    request->send(500, "text/plain", "Printer not connected");
+    return;
+  }
+
+  LabelSeries* series = new (std::nothrow) LabelSeries();
+  if (series == nullptr) {
+    request->send(503, "text/plain", "Out of memory for series");
+    return;
+  }
+  series->name = name;
+  series->field = field;
+  strlcpy(series->format, format.c_str(), sizeof(series->format));
+  series->start = request->hasParam("start") ? request->getParam("start")->value().toInt() : 1;
+  series->step = request->hasParam("step") ? request->getParam("step")->value().toInt() : 1;
+  series->count = count;
+  series->options = imageOptions(request);
+  // Stored bitmaps are kept per printer; a pool job may end up on another
+  series->printer = {printer->index(), printer->mac(),
+                     request->hasParam("resend") && request->getParam("resend")->value() == "1"};
+  series->hasPrinter = pool == PRINT_NO_POOL;
+  series->length = ctx != nullptr ? ctx->length : 2;
+  memcpy(series->body, ctx != nullptr ? ctx->body : "{}", series->length);
+
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t jobId = createPrintJob(printer->index(), PRINT_JOB_LENGTH_UNKNOWN, reject, pool);
+  if (jobId == 0) {
+    delete series;
+    sendQueueRejected(request, reject, printer->index());
+    return;
+  }
+  applyJobScheduling(request, jobId, PRINT_PRIORITY_BULK);
+  series->jobId = jobId;
+
+  String detail;
+  LabelResult result = printSeriesLabel(*series, 0, appendLabel, &jobId, detail);
+  if (result != LABEL_OK) {
+    delete series;
+    sendLabelRejected(request, jobId, result, detail);
+    return;
+  }
+  if (count == 1) {
+    delete series;
+    finishPrintJob(jobId);
+  } else if (!queueLabelSeries(series)) {
+    delete series;
+    abortPrintJob(jobId);
+    request->send(503, "text/plain", "Too many series waiting");
+    return;
+  }
+
+  AsyncWebServerResponse* response = jobAcceptedResponse(request, jobId);
+  if (response != nullptr) {
+    response->addHeader("X-Series-Labels", String(count));
+    request->send(response);
+  }
+}
+
+// Completion of a /print/cached/{hash} request
+void handleCachedRequest(AsyncWebServerRequest* request) {
+  String url = request->url();
+  if (!url.startsWith("/print/cached/")) {
+    request->send(404, "text/plain", "Unknown job hash");
+    return;
+  }
+  startCachedJob(request, url.substring(14));
+}
+
+// Body chunks of a /print/batch upload. The first chunk admits one job of
+// unknown length for all labels; the printer is only checked then.
+void handleBatchBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+  BatchRequestContext* ctx = (BatchRequestContext*)request->_tempObject;
+  if (index == 0 && ctx == nullptr) {
+    // Freed together with the request
+    ctx = (BatchRequestContext*)malloc(sizeof(BatchRequestContext));
+    if (ctx == nullptr) {
+      return;
+    }
+    BlePrinter* printer = nullptr;
+    uint8_t pool = PRINT_NO_POOL;
+    ctx->unknownPrinter = !requestedPrintTarget(request, printer, pool);
+    ctx->jobId = 0;
+    ctx->printer = printer != nullptr ? printer->index() : 0;
+    ctx->reject = JOB_ACCEPTED;
+    ctx->printerOffline = !ctx->unknownPrinter && (printer == nullptr || !printer->connected());
+    if (ctx->printerOffline) {
+      connectPrintTarget(printer, pool);
+    }
+    ctx->batch = nullptr;
+    request->_tempObject = ctx;
+
+    if (!ctx->unknownPrinter && !ctx->printerOffline) {
+      ctx->jobId = createPrintJob(ctx->printer, PRINT_JOB_LENGTH_UNKNOWN, ctx->reject, pool);
+      if (ctx->jobId == 0) {
+        return;
+      }
+      // Batches are waves unless the client says otherwise
+      applyJobScheduling(request, ctx->jobId, PRINT_PRIORITY_BULK);
+      ctx->batch = new PrintBatch();
+      ctx->batch->begin(ctx->jobId);
+      uint32_t jobId = ctx->jobId;
+      PrintBatch* batch = ctx->batch;
+      // A client that goes away mid-upload fails its job
+      onRequestEnd(request, [jobId, batch]() {
+        abortPrintJob(jobId);
+        delete batch;
+      });
+    }
+  }
+
+  if (ctx == nullptr || ctx->batch == nullptr || ctx->batch->error() != BATCH_OK) {
+    return;
+  }
+  if (ctx->batch->feed(data, len, printQueueTimeout) != BATCH_OK) {
+    log_e("Batch job %u rejected after %u labels: %s", ctx->jobId, ctx->batch->labels(),
+          printBatchErrorName(ctx->batch->error()));
+    abortPrintJob(ctx->jobId);
+  }
+}
+
+// Completion of a /print/batch upload: 202 with the job and the number of
+// labels in X-Batch-Labels. Each label's end comes as a "label" event on
+// /events.
+void handleBatchRequest(AsyncWebServerRequest* request) {
+  BatchRequestContext* ctx = (BatchRequestContext*)request->_tempObject;
+  if (ctx == nullptr) {
+    request->send(400, "text/plain", "Empty batch");
+    return;
+  }
+  if (ctx->unknownPrinter) {
+    request->send(404, "text/plain", request->hasParam("pool") ? "Unknown pool" : "Unknown printer");
+    return;
+  }
+  if (ctx->printerOffline) {
+    request->send(500, "text/plain", "Printer not connected");
+    return;
+  }
+  if (ctx->jobId == 0) {
+    sendQueueRejected(request, ctx->reject, ctx->printer);
+    return;
+  }
+
+  PrintBatchError error = ctx->batch->end();
+  if (error != BATCH_OK) {
+    abortPrintJob(ctx->jobId);
+    int code = 400;
+    if (error == BATCH_ERR_TOO_MANY) {
+      code = 413;
+    } else if (error == BATCH_ERR_NO_MEMORY || error == BATCH_ERR_OUTPUT) {
+      code = 503;
+    }
+    request->send(code, "text/plain", printBatchErrorName(error));
+    return;
+  }
+
+  finishPrintJob(ctx->jobId);
+  AsyncWebServerResponse* response = jobAcceptedResponse(request, ctx->jobId);
+  if (response != nullptr) {
+    response->addHeader("X-Batch-Labels", String(ctx->batch->labels()));
+    request->send(response);
+  }
+}
+
+// Body chunks of a /print/zpl upload. The first chunk admits one job of
+// unknown length for all labels; each label is rendered into it at its ^XZ.
+void handleZplBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+  ZplRequestContext* ctx = (ZplRequestContext*)request->_tempObject;
+  if (index == 0 && ctx == nullptr) {
+    // Freed together with the request
+    ctx = (ZplRequestContext*)malloc(sizeof(ZplRequestContext));
+    if (ctx == nullptr) {
+      return;
+    }
+    BlePrinter* printer = nullptr;
+    uint8_t pool = PRINT_NO_POOL;
+    ctx->unknownPrinter = !requestedPrintTarget(request, printer, pool);
+    ctx->jobId = 0;
+    ctx->printer = printer != nullptr ? printer->index() : 0;
+    ctx->reject = JOB_ACCEPTED;
+    ctx->printerOffline = !ctx->unknownPrinter && (printer == nullptr || !printer->connected());
+    if (ctx->printerOffline) {
+      connectPrintTarget(printer, pool);
+    }
+    ctx->invalidCopies = !validJobCopies(request);
+    ctx->zpl = nullptr;
+    request->_tempObject = ctx;
+
+    if (!ctx->unknownPrinter && !ctx->printerOffline && !ctx->invalidCopies) {
+      ctx->jobId = createPrintJob(ctx->printer, PRINT_JOB_LENGTH_UNKNOWN, ctx->reject, pool);
+      if (ctx->jobId == 0) {
+        return;
+      }
+      applyJobDpi(request, ctx->jobId);
+      applyJobScheduling(request, ctx->jobId, PRINT_PRIORITY_INTERACTIVE);
+      if (!applyJobCopies(request, ctx->jobId)) {
+        ctx->jobId = 0;
+        ctx->reject = JOB_REJECT_TOO_LARGE;
+        return;
+      }
+      ctx->zpl = new ZplInterpreter();
+      ctx->zpl->begin(imageOptions(request), printer->dots(), appendLabel, &ctx->jobId);
+      uint32_t jobId = ctx->jobId;
+      ZplInterpreter* zpl = ctx->zpl;
+      // A client that goes away mid-upload fails its job
+      onRequestEnd(request, [jobId, zpl]() {
+        abortPrintJob(jobId);
+        delete zpl;
+      });
+    }
+  }
+
+  if (ctx == nullptr || ctx->zpl == nullptr || ctx->zpl->error() != ZPL_OK) {
+    return;
+  }
+  if (ctx->zpl->feed(data, len) != ZPL_OK) {
+    log_e("ZPL job %u rejected after %u labels: %s", ctx->jobId, ctx->zpl->labels(),
+          zplResultName(ctx->zpl->error()));
+    abortPrintJob(ctx->jobId);
+  }
+}
+
+// Completion of a /print/zpl upload: 202 with the job and the number of
+// labels rendered in X-Zpl-Labels
+void handleZplRequest(AsyncWebServerRequest* request) {
+  ZplRequestContext* ctx = (ZplRequestContext*)request->_tempObject;
+  if (ctx == nullptr) {
+    request->send(400, "text/plain", "Empty ZPL");
+    return;
+  }
+  if (ctx->unknownPrinter) {
+    request->send(404, "text/plain", request->hasParam("pool") ? "Unknown pool" : "Unknown printer");
+    return;
+  }
+  if (ctx->printerOffline) {
+    request->send(500, "text/plain", "Printer not connected");
+    return;
+  }
+  if (ctx->invalidCopies) {
+    request->send(400, "text/plain", "Invalid copies");
+    return;
+  }
+  if (ctx->jobId == 0) {
+    sendQueueRejected(request, ctx->reject, ctx->printer);
+    return;
+  }
+
+  ZplResult result = ctx->zpl->end();
+  if (result != ZPL_OK) {
+    abortPrintJob(ctx->jobId);
+    int code = 400;
+    if (result == ZPL_TOO_MANY) {
+      code = 413;
+    } else if (result == ZPL_NO_MEMORY || result == ZPL_OUTPUT) {
+      code = 503;
+    }
+    String message = zplResultName(result);
+    if (ctx->zpl->detail().length() > 0) {
+      message += ": " + ctx->zpl->detail();
+    }
+    request->send(code, "text/plain", message);
+    return;
+  }
+
+  finishPrintJob(ctx->jobId);
+  AsyncWebServerResponse* response = jobAcceptedResponse(request, ctx->jobId);
+  if (response != nullptr) {
+    response->addHeader("X-Zpl-Labels", String(ctx->zpl->labels()));
+    request->send(response);
+  }
+}
+
+// Body of a /print/pdf upload, collected whole: objects are found all over
+// the file, the xref table at its end
+void handlePdfBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+  PdfRequestContext* ctx = (PdfRequestContext*)request->_tempObject;
+  if (index == 0 && ctx == nullptr) {
+    // Freed together with the request
+    ctx = (PdfRequestContext*)malloc(sizeof(PdfRequestContext));
+    if (ctx == nullptr) {
+      return;
+    }
+    ctx->length = 0;
+    ctx->tooLarge = total > PDF_MAX_BYTES;
+    ctx->body = ctx->tooLarge ? nullptr : (uint8_t*)heapAlloc(HEAP_SITE_PDF, total);
+    request->_tempObject = ctx;
+    if (ctx->body != nullptr) {
+      uint8_t* body = ctx->body;
+      onRequestEnd(request, [body]() {
+        heapFree(body);
+      });
+    }
+  }
+  if (ctx == nullptr || ctx->body == nullptr || index + len > total) {
+    return;
+  }
+  memcpy(ctx->body + index, data, len);
+  ctx->length = index + len;
+}
+
+// Completion of a /print/pdf upload: every page printed as one label of a
+// job, scaled to ?dots= or the printer's head width, turned by ?rotate=
+// (0, 90, 180, 270; landscape labels are turned otherwise). Takes the image
+// options of /print/image; 422 when the PDF needs a real renderer.
+void handlePdfRequest(AsyncWebServerRequest* request) {
+  PdfRequestContext* ctx = (PdfRequestContext*)request->_tempObject;
+  if (ctx == nullptr) {
+    request->send(400, "text/plain", "Empty PDF");
+    return;
+  }
+  if (ctx->tooLarge) {
+    request->send(413, "text/plain", pdfResultName(PDF_TOO_LARGE));
+    return;
+  }
+  if (ctx->body == nullptr) {
+    request->send(503, "text/plain", pdfResultName(PDF_NO_MEMORY));
+    return;
+  }
+
+  BlePrinter* printer = nullptr;
+  uint8_t pool = PRINT_NO_POOL;
+  if (!requestedPrintTarget(request, printer, pool)) {
+    request->send(404, "text/plain", request->hasParam("pool") ? "Unknown pool" : "Unknown printer");
+    return;
+  }
+  if (printer == nullptr || !printer->connected()) {
+    connectPrintTarget(printer, pool);
+    request->send(500, "text/plain", "Printer not connected");
+    return;
+  }
+  if (!validJobCopies(request)) {
+    request->send(400, "text/plain", "Invalid copies");
+    return;
+  }
+
+  PdfLabelOptions options;
+  options.raster = imageOptions(request);
+  options.width = printer->dots();
+  if (request->hasParam("dots")) {
+    long dots = request->getParam("dots")->value().toInt();
+    if (dots > 0 && dots <= IMAGE_MAX_WIDTH) {
+      options.width = dots;
+    }
+  }
+  if (request->hasParam("rotate")) {
+    long rotate = request->getParam("rotate")->value().toInt();
+    if (rotate == 0 || rotate == 90 || rotate == 180 || rotate == 270) {
+      options.rotate = rotate;
+    }
+  }
+
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t jobId = createPrintJob(printer->index(), PRINT_JOB_LENGTH_UNKNOWN, reject, pool);
+  if (jobId == 0) {
+    sendQueueRejected(request, reject, printer->index());
+    return;
+  }
+  applyJobScheduling(request, jobId, PRINT_PRIORITY_INTERACTIVE);
+  if (!applyJobCopies(request, jobId)) {
+    sendQueueRejected(request, JOB_REJECT_TOO_LARGE, printer->index());
+    return;
+  }
+
+  uint16_t pages = 0;
+  String detail;
+  PdfResult result = printPdfLabel(ctx->body, ctx->length, options, appendLabel, &jobId, pages, detail);
+  if (result != PDF_OK) {
+    log_e("PDF job %u rejected after %u pages: %s", jobId, pages, detail.c_str());
+    abortPrintJob(jobId);
+    int code = 400;
+    if (result == PDF_UNSUPPORTED) {
+      code = 422;
+    } else if (result == PDF_TOO_LARGE) {
+      code = 413;
+    } else if (result == PDF_NO_MEMORY || result == PDF_OUTPUT) {
+      code = 503;
+    }
+    String message = pdfResultName(result);
+    if (detail.length() > 0) {
+      message += ": " + detail;
+    }
+    request->send(code, "text/plain", message);
+    return;
+  }
+
+  finishPrintJob(jobId);
+  AsyncWebServerResponse* response = jobAcceptedResponse(request, jobId);
+  if (response != nullptr) {
+    response->addHeader("X-Pdf-Pages", String(pages));
+    request->send(response);
+  }
+}
+
+// POST /print with Upload-Length and no body: admit a job of that size for
+// PUT /jobs/{id} segments to fill. With Upload-Defer-Length: 1 the size
+// comes with a later segment.
+void startResumableJob(AsyncWebServerRequest* request) {
+  long length = PRINT_JOB_LENGTH_UNKNOWN;
+  if (request->hasHeader("Upload-Length")) {
+    length = request->header("Upload-Length").toInt();
+    if (length <= 0) {
+      request->send(400, "text/plain", "Invalid Upload-Length");
+      return;
+    }
+  } else if (request->header("Upload-Defer-Length") != "1") {
+    request->send(400, "text/plain", "Invalid Upload-Defer-Length");
+    return;
+  }
+
+  BlePrinter* printer = nullptr;
+  uint8_t pool = PRINT_NO_POOL;
+  if (!requestedPrintTarget(request, printer, pool)) {
+    request->send(404, "text/plain", request->hasParam("pool") ? "Unknown pool" : "Unknown printer");
+    return;
+  }
+  if (printer == nullptr || !printer->connected()) {
+    connectPrintTarget(printer, pool);
+    request->send(500, "text/plain", "Printer not connected");
+    return;
+  }
+  if (!validJobCopies(request)) {
+    request->send(400, "text/plain", "Invalid copies");
+    return;
+  }
+
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t jobId = createPrintJob(printer->index(), length, reject, pool);
+  if (jobId == 0) {
+    sendQueueRejected(request, reject, printer->index());
+    return;
+  }
+  applyJobScheduling(request, jobId, PRINT_PRIORITY_INTERACTIVE);
+  if (!applyJobCopies(request, jobId)) {
+    sendQueueRejected(request, JOB_REJECT_TOO_LARGE, printer->index());
+    return;
+  }
+  if (!openResumableUpload(jobId, length)) {
+    abortPrintJob(jobId);
+    request->send(503, "text/plain", "Too many open uploads");
+    return;
+  }
+  AsyncWebServerResponse* response = jobAcceptedResponse(request, jobId);
+  if (response != nullptr) {
+    response->addHeader("Upload-Offset", "0");
+    request->send(response);
+  }
+}
+
+// "bytes <first>-<last>/<total>", or "/*" with total PRINT_JOB_LENGTH_UNKNOWN
+static bool parseContentRange(const String& header, size_t& first, size_t& last, size_t& total) {
+  unsigned long a = 0;
+  unsigned long b = 0;
+  unsigned long c = 0;
+  if (sscanf(header.c_str(), "bytes %lu-%lu/%lu", &a, &b, &c) == 3 && b >= a && b < c) {
+    total = c;
+  } else if (header.endsWith("/*") && sscanf(header.c_str(), "bytes %lu-%lu/", &a, &b) == 2 && b >= a) {
+    total = PRINT_JOB_LENGTH_UNKNOWN;
+  } else {
+    return false;
+  }
+  first = a;
+  last = b;
+  return true;
+}
+
+// "bytes */<total>" of an empty PUT that ends an upload of deferred length
+static bool parseContentEnd(const String& header, size_t& total) {
+  unsigned long c = 0;
+  if (sscanf(header.c_str(), "bytes */%lu", &c) != 1 || c == 0) {
+    return false;
+  }
+  total = c;
+  return true;
+}
+
+// Body chunks of a PUT /jobs/{id} segment, appended as far as they continue
+// the received data
+void handleSegmentBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+  SegmentRequestContext* ctx = (SegmentRequestContext*)request->_tempObject;
+  if (index == 0 && ctx == nullptr) {
+    // Freed together with the request
+    ctx = (SegmentRequestContext*)malloc(sizeof(SegmentRequestContext));
+    if (ctx == nullptr) {
+      return;
+    }
+    String url = request->url();
+    ctx->jobId = url.startsWith("/jobs/") ? url.substring(6).toInt() : 0;
+    ctx->start = 0;
+    ctx->received = 0;
+    ctx->result = SEGMENT_OK;
+    request->_tempObject = ctx;
+
+    // The range has to cover exactly the body; the size it names is checked
+    // against the upload's
+    size_t first = 0;
+    size_t last = 0;
+    ctx->length = PRINT_JOB_LENGTH_UNKNOWN;
+    ctx->badRange = !request->hasHeader("Content-Range") ||
+                    !parseContentRange(request->header("Content-Range"), first, last, ctx->length) ||
+                    last - first + 1 != total;
+    ctx->start = first;
+  }
+  if (ctx == nullptr || ctx->badRange || ctx->result != SEGMENT_OK) {
+    return;
+  }
+  ctx->result = writeUploadSegment(ctx->jobId, ctx->start + index, data, len, ctx->length, printQueueTimeout,
+                                   ctx->received);
+}
+
+// Completion of a PUT /jobs/{id} segment. Every answer carries the offset
+// to send the next segment from; an empty PUT only asks for it, or with
+// "Content-Range: bytes */<size>" ends an upload of deferred length.
+void handleSegmentRequest(AsyncWebServerRequest* request) {
+  SegmentRequestContext* ctx = (SegmentRequestContext*)request->_tempObject;
+  String url = request->url();
+  uint32_t jobId = url.startsWith("/jobs/") ? url.substring(6).toInt() : 0;
+  PrintJobInfo info;
+  UploadSegmentResult result;
+  size_t received = 0;
+
+  if (ctx == nullptr) {
+    size_t length = 0;
+    if (request->hasHeader("Content-Range") && parseContentEnd(request->header("Content-Range"), length)) {
+      result = endUploadAt(jobId, length, received);
+    } else if (!isResumableUpload(jobId) || !getPrintJob(jobId, info)) {
+      result = SEGMENT_UNKNOWN;
+    } else {
+      result = SEGMENT_OK;
+      received = info.received;
+    }
+  } else if (ctx->badRange) {
+    request->send(416, "text/plain", "Content-Range must cover the body and give the job size or *");
+    return;
+  } else {
+    result = ctx->result;
+    received = ctx->received;
+  }
+
+  switch (result) {
+    case SEGMENT_UNKNOWN:
+      request->send(404, "text/plain", "No open upload for job");
+      return;
+    case SEGMENT_GAP:
+      sendUploadOffset(request, 409, jobId, received);
+      return;
+    case SEGMENT_FULL:
+      sendUploadOffset(request, 503, jobId, received);
+      return;
+    case SEGMENT_LENGTH:
+      request->send(416, "text/plain", "Content-Range gives another job size");
+      return;
+    case SEGMENT_OK:
+      sendUploadOffset(request, 200, jobId, received);
+      return;
+  }
+}
+
+// POST /config: every parameter names a setting. All of them are checked
+// before any takes effect; ?reset=1 goes back to the build flags.
+void handleConfigRequest(AsyncWebServerRequest* request) {
+  const BridgeConfig& current = bridgeConfig();
+  if (request->hasParam("reset") || request->hasParam("reset", true)) {
+    resetBridgeConfig();
+  } else {
+    BridgeConfig changed = current;
+    for (size_t i = 0; i < request->params(); i++) {
+      AsyncWebParameter* param = request->getParam(i);
+      ConfigResult result = setConfigValue(changed, param->name(), param->value());
+      if (result != CONFIG_OK) {
+        request->send(400, "text/plain",
+                      (result == CONFIG_UNKNOWN ? "Unknown setting " : "Invalid value for ") + param->name());
+        return;
+      }
+    }
+    bool wifiChanged = strcmp(changed.wifiSsid, current.wifiSsid) != 0 ||
+                       strcmp(changed.wifiPassword, current.wifiPassword) != 0;
+    if (!applyBridgeConfig(changed)) {
+      request->send(500, "text/plain", "Settings applied but not saved");
+      return;
+    }
+    if (wifiChanged) {
+      // Switches after a short delay, so this answer still goes out
+      setWifiCredentials(changed.wifiSsid, changed.wifiPassword);
+    }
+  }
+  request->send(200, "application/json", getConfigJSON());
+}
+
+// Body chunks of POST /config/printers, collected up to PRINTER_LIST_MAX
+void handlePrinterListBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+  PrinterListContext* ctx = (PrinterListContext*)request->_tempObject;
+  if (index == 0 && ctx == nullptr) {
+    // Freed together with the request
+    ctx = (PrinterListContext*)malloc(sizeof(PrinterListContext));
+    if (ctx == nullptr) {
+      return;
+    }
+    ctx->length = 0;
+    ctx->tooLarge = total > PRINTER_LIST_MAX;
+    request->_tempObject = ctx;
+  }
+  if (ctx == nullptr || ctx->tooLarge) {
+    return;
+  }
+  if (ctx->length + len > PRINTER_LIST_MAX) {
+    ctx->tooLarge = true;
+    return;
+  }
+  memcpy(ctx->body + ctx->length, data, len);
+  ctx->length += len;
+}
+
+// Completion of POST /config/printers. The writers are tied to the printers
+// they start with, so the list takes effect at the next restart.
+void handlePrinterListRequest(AsyncWebServerRequest* request) {
+  PrinterListContext* ctx = (PrinterListContext*)request->_tempObject;
+  if (ctx == nullptr) {
+    request->send(400, "text/plain", "Empty printer list");
+    return;
+  }
+  if (ctx->tooLarge) {
+    request->send(413, "text/plain", "Printer list too large");
+    return;
+  }
+  File file = LittleFS.open(PRINTER_REGISTRY_PATH, "w");
+  if (!file || file.write((const uint8_t*)ctx->body, ctx->length) != ctx->length) {
+    request->send(500, "text/plain", "Printer list not saved");
+    return;
+  }
+  file.close();
+  request->send(200, "text/plain", "Printer list saved, takes effect after restart");
+}
+
+// Body chunks of POST /update, hashed and written to flash as they arrive.
+// The first chunk starts the update with the size of the whole body.
+void handleUpdateBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+  UpdateRequestContext* ctx = (UpdateRequestContext*)request->_tempObject;
+  if (index == 0 && ctx == nullptr) {
+    // Freed together with the request
+    ctx = (UpdateRequestContext*)malloc(sizeof(UpdateRequestContext));
+    if (ctx == nullptr) {
+      return;
+    }
+    request->_tempObject = ctx;
+    FirmwareTarget target = UPDATE_FIRMWARE;
+    if (request->hasParam("target") && request->getParam("target")->value() == "fs") {
+      target = UPDATE_FILESYSTEM;
+    }
+    String digest = request->hasHeader("X-Update-SHA256") ? request->header("X-Update-SHA256") : String();
+    ctx->result = beginFirmwareUpdate(target, total, digest.c_str());
+    ctx->started = (ctx->result == UPDATE_OK);
+    if (ctx->started) {
+      // The running image stays if the client goes away mid-upload
+      uint32_t session = firmwareUpdateSession();
+      onRequestEnd(request, [session]() {
+        abortFirmwareUpdate(session);
+      });
+    }
+  }
+  if (ctx == nullptr || ctx->result != UPDATE_OK) {
+    return;
+  }
+  ctx->result = writeFirmwareUpdate(data, len);
+}
+
+// Completion of POST /update: 200 once the image is verified, after which
+// the bridge restarts as soon as no job is queued
+void handleUpdateRequest(AsyncWebServerRequest* request) {
+  UpdateRequestContext* ctx = (UpdateRequestContext*)request->_tempObject;
+  if (ctx == nullptr) {
+    request->send(400, "text/plain", "Empty image");
+    return;
+  }
+  if (ctx->result == UPDATE_OK) {
+    ctx->result = endFirmwareUpdate();
+  }
+  switch (ctx->result) {
+    case UPDATE_OK:
+      request->send(200, "text/plain", "Update verified, restarting when idle");
+      return;
+    case UPDATE_ERR_BUSY:
+      request->send(409, "text/plain", firmwareUpdateErrorText(ctx->result));
+      return;
+    case UPDATE_ERR_BEGIN:
+      request->send(413, "text/plain", firmwareUpdateErrorText(ctx->result));
+      return;
+    case UPDATE_ERR_WRITE:
+      request->send(500, "text/plain", firmwareUpdateErrorText(ctx->result));
+      return;
+    default:
+      request->send(400, "text/plain", firmwareUpdateErrorText(ctx->result));
+      return;
+  }
+}
+
+// The job with the contiguous length received so far in Upload-Offset
+void sendUploadOffset(AsyncWebServerRequest* request, int code, uint32_t jobId, size_t offset) {
+  PrintJobInfo info;
+  if (!getPrintJob(jobId, info)) {
+    request->send(404, "text/plain", "Unknown job");
+    return;
+  }
+  AsyncWebServerResponse* response = request->beginResponse(code, "application/json", getJobJSON(info));
+  response->addHeader("Upload-Offset", String(offset));
+  if (code == 503) {
+    response->addHeader("Retry-After", "1");
+  }
+  request->send(response);
+}
+
+// Admit a job replayed from the job cache, for a client that skips the
+// upload. 404 when the job isn't cached, so the client uploads it instead.
+void startCachedJob(AsyncWebServerRequest* request, const String& hash) {
+  if (!isJobHash(hash)) {
+    request->send(400, "text/plain", "Job hash is not a SHA-256");
+    return;
+  }
+  size_t length = 0;
+  if (!jobCacheLookup(hash, length)) {
+    request->send(404, "text/plain", "Job not cached");
+    return;
+  }
+
+  BlePrinter* printer = nullptr;
+  uint8_t pool = PRINT_NO_POOL;
+  if (!requestedPrintTarget(request, printer, pool)) {
+    request->send(404, "text/plain", request->hasParam("pool") ? "Unknown pool" : "Unknown printer");
+    return;
+  }
+  if (printer == nullptr || !printer->connected()) {
+    connectPrintTarget(printer, pool);
+    request->send(500, "text/plain", "Printer not connected");
+    return;
+  }
+  if (!validJobCopies(request)) {
+    request->send(400, "text/plain", "Invalid copies");
+    return;
+  }
+
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t jobId = createPrintJob(printer->index(), length, reject, pool);
+  if (jobId == 0) {
+    sendQueueRejected(request, reject, printer->index());
+    return;
+  }
+  applyJobScheduling(request, jobId, PRINT_PRIORITY_INTERACTIVE);
+  if (!applyJobCopies(request, jobId)) {
+    sendQueueRejected(request, JOB_REJECT_TOO_LARGE, printer->index());
+    return;
+  }
+  if (!replayCachedJob(hash, jobId)) {
+    abortPrintJob(jobId);
+    request->send(503, "text/plain", "Job cache busy");
+    return;
+  }
+  sendJobAccepted(request, jobId, "hit");
+}
+
+// /print/image options: ?commands=tspl, ?invert=1, ?dither=, ?crop=1, and for TSPL ?width= and
+// ?height= in mm, ?speed= and ?density=
+ImageRasterOptions imageOptions(AsyncWebServerRequest* request) {
+  ImageRasterOptions options;
+  if (request->hasParam("commands") && request->getParam("commands")->value().equalsIgnoreCase("tspl")) {
+    options.commands = IMAGE_TSPL;
+  }
+  options.invert = request->hasParam("invert") && request->getParam("invert")->value() == "1";
+  options.crop = request->hasParam("crop") && request->getParam("crop")->value() == "1";
+  if (request->hasParam("dither")) {
+    parseDitherMode(request->getParam("dither")->value(), options.dither);
+  }
+  if (request->hasParam("width")) {
+    options.paperWidthMm = request->getParam("width")->value().toInt();
+  }
+  if (request->hasParam("height")) {
+    options.paperHeightMm = request->getParam("height")->value().toInt();
+  }
+  if (request->hasParam("speed")) {
+    options.speed = request->getParam("speed")->value().toInt();
+  }
+  if (request->hasParam("density")) {
+    options.density = request->getParam("density")->value().toInt();
+  }
+  return options;
+}
+
+// ?dpi=: resolution the job was made for, rescaled on printers with another
+void applyJobDpi(AsyncWebServerRequest* request, uint32_t jobId) {
+  if (jobId != 0 && request->hasParam("dpi")) {
+    long dpi = request->getParam("dpi")->value().toInt();
+    if (dpi > 0 && dpi <= 1200) {
+      setPrintJobDpi(jobId, dpi);
+    }
+  }
+}
+
+// ?copies=N is a whole number from 1 to PRINT_MAX_COPIES, or absent.
+// Checked before the job is admitted; anything else is answered 400.
+bool validJobCopies(AsyncWebServerRequest* request) {
+  if (!request->hasParam("copies")) {
+    return true;
+  }
+  const String& value = request->getParam("copies")->value();
+  if (value.length() == 0 || value.length() > 4) {
+    return false;
+  }
+  for (size_t i = 0; i < value.length(); i++) {
+    if (!isdigit((unsigned char)value[i])) {
+      return false;
+    }
+  }
+  long copies = value.toInt();
+  return copies >= 1 && copies <= PRINT_MAX_COPIES;
+}
+
+// ?copies=N, checked by validJobCopies(): the job prints N times over from
+// one upload. False when it can't be held whole for that, and the job is
+// aborted.
+bool applyJobCopies(AsyncWebServerRequest* request, uint32_t jobId) {
+  if (jobId == 0 || !request->hasParam("copies")) {
+    return true;
+  }
+  if (setPrintJobCopies(jobId, request->getParam("copies")->value().toInt())) {
+    return true;
+  }
+  abortPrintJob(jobId);
+  return false;
+}
+
+// ?priority=bulk|interactive: the job's class, fallback without it. The
+// client it shares the printer as is the X-Station header, or the address
+// the request came from.
+void applyJobScheduling(AsyncWebServerRequest* request, uint32_t jobId, PrintJobPriority fallback) {
+  PrintJobPriority priority = fallback;
+  if (request->hasParam("priority")) {
+    parsePrintJobPriority(request->getParam("priority")->value().c_str(), priority);
+  }
+  if (jobId != 0) {
+    setPrintJobPriority(jobId, priority);
+    String station = request->hasHeader("X-Station") ? request->header("X-Station")
+                                                     : request->client()->remoteIP().toString();
+    setPrintJobClient(jobId, printClientKey(station.c_str()));
+  }
+}
+
+bool rawPrinterReady(uint8_t printer) {
+  BlePrinter* target = getPrinter(printer);
+  return target != nullptr && target->connected();
+}
+
+// A raw connection for a printer that is away holds its data in the socket
+// while the printer connects, for up to RAW_PRINT_CONNECT_WAIT
+bool rawPrinterAdmit(uint8_t printer) {
+  BlePrinter* target = getPrinter(printer);
+  if (target == nullptr) {
+    return false;
+  }
+  target->requestJobConnect();
+  uint32_t started = millis();
+  while (!target->connected() && millis() - started < RAW_PRINT_CONNECT_WAIT) {
+    vTaskDelay(pdMS_TO_TICKS(RAW_PRINT_CONNECT_POLL));
+  }
+  return target->connected();
+}
+
+// A spooled job goes to its printer, or the least busy connected member
+// of its pool
+bool spoolTarget(uint8_t pool, uint8_t& printer) {
+  if (pool != PRINT_NO_POOL) {
+    BlePrinter* member = selectPoolPrinter(pool);
+    if (member == nullptr) {
+      return false;
+    }
+    printer = member->index();
+    return true;
+  }
+  return rawPrinterReady(printer);
+}
+
+// WebSocket "start <id>"
+bool routeWsPrint(const String& printerId, uint8_t& printer, const char*& error) {
+  BlePrinter* target = findPrinter(printerId);
+  if (target == nullptr) {
+    error = "Unknown printer";
+    return false;
+  }
+  if (!target->connected()) {
+    target->requestJobConnect();
+    error = "Printer not connected";
+    return false;
+  }
+  printer = target->index();
+  return true;
+}
+
+// Print writer sink of each printer
+bool writeToBLEPrinter(void* context, const PrintSlice& slice) {
+  BlePrinter* printer = (BlePrinter*)context;
+  // The job line changes when a job starts and when it ends
+  static bool printing[MAX_PRINTERS] = {};
+  bool active = slice.total() > 0;
+  if (active != printing[printer->index()]) {
+    printing[printer->index()] = active;
+    requestRedraw();
+  }
+  if (active) {
+    wakeScreen(); // Wake screen on print activity
+  }
+  previewJobData(printer->index(), slice);
+  return printer->write(slice);
+}
+
+void updateLCD() {
+  statusView.beginFrame();
+
+  // Network status
+  if (ethLinkUp()) {
+    statusView.set(0, 0, 2, TFT_GREEN, "Eth: %s", networkAddress().toString().c_str());
+  } else if (WiFi.status() == WL_CONNECTED) {
+    statusView.set(0, 0, 2, TFT_GREEN, "WiFi: %s", WiFi.localIP().toString().c_str());
+  } else {
+    statusView.set(0, 0, 2, TFT_RED, "WiFi: Disconnected");
+  }
+
+  // Printer status
+  int y = 80;
+  if (printerCount() == 1) {
+    BlePrinter* printer = getPrinter(0);
+    if (printer->connected()) {
+      statusView.set(1, 30, 2, TFT_GREEN, "Printer: Connected");
+      statusView.set(2, 60, 1, TFT_WHITE, "Name: %s", printer->name().c_str());
+    } else {
+      statusView.set(1, 30, 2, TFT_RED, "Printer: Disconnected");
+    }
+  } else {
+    // Summary line, then one line per printer
+    size_t ready = 0;
+    for (size_t i = 0; i < printerCount(); i++) {
+      ready += getPrinter(i)->connected() ? 1 : 0;
+    }
+    statusView.set(1, 30, 2, ready == printerCount() ? TFT_GREEN : (ready > 0 ? TFT_YELLOW : TFT_RED),
+                   "Printers: %u/%u ready", (unsigned)ready, (unsigned)printerCount());
+    for (size_t i = 0; i < printerCount(); i++) {
+      BlePrinter* printer = getPrinter(i);
+      statusView.set(2 + i, 55 + i * 10, 1, TFT_WHITE, "%s: %s", printer->id().c_str(),
+                     printer->connected() ? printer->name().c_str() : linkStateName(printer->linkState()));
+    }
+    y = 60 + printerCount() * 10;
+  }
+
+  // Job being printed, or idle
+  PrintJobInfo jobs[PRINT_JOB_SLOTS];
+  size_t pending = getPendingPrintJobs(jobs, PRINT_JOB_SLOTS);
+  const PrintJobInfo* job = nullptr;
+  for (size_t i = 0; i < pending && !job; i++) {
+    if (jobs[i].state == JOB_STREAMING) {
+      job = &jobs[i];
+    }
+  }
+  if (job) {
+    BlePrinter* printer = getPrinter(job->printer);
+    uint32_t rate = printer ? printer->metrics().rate(5) : 0;
+    if (job->total > 0) {
+      size_t left = job->total > job->sent ? job->total - job->sent : 0;
+      // Until the job has been sending for a moment, at the probed link rate
+      uint32_t etaRate = rate > 0 || !printer ? rate : printer->probeRate();
+      char eta[12] = "-";
+      if (etaRate > 0) {
+        snprintf(eta, sizeof(eta), "%u s", (unsigned)(left / etaRate));
+      }
+      statusView.set(2 + MAX_PRINTERS, y, 1, TFT_YELLOW, "Job %u: %u/%u KB %u.%u KB/s ETA %s",
+                     (unsigned)job->id, (unsigned)(job->sent / 1024), (unsigned)(job->total / 1024),
+                     (unsigned)(rate / 1024), (unsigned)(rate % 1024 * 10 / 1024), eta);
+    } else {
+      statusView.set(2 + MAX_PRINTERS, y, 1, TFT_YELLOW, "Job %u: %u KB %u.%u KB/s",
+                     (unsigned)job->id, (unsigned)(job->sent / 1024),
+                     (unsigned)(rate / 1024), (unsigned)(rate % 1024 * 10 / 1024));
+    }
+  } else if (pending > 0) {
+    statusView.set(2 + MAX_PRINTERS, y, 1, TFT_WHITE, "%s: %u jobs", printersPaused() ? "Paused" : "Queued",
+                   (unsigned)pending);
+  } else {
+    statusView.set(2 + MAX_PRINTERS, y, 1, TFT_WHITE, "Last Action: Idle");
+  }
+
+  // Uptime
+  statusView.set(3 + MAX_PRINTERS, y + 20, 1, TFT_WHITE, "Uptime: %lu sec", millis() / 1000);
+
+  // Bytes/s to all printers since the last frame
+  static uint32_t lastBytes = 0;
+  static unsigned long lastSample = 0;
+  uint32_t bytes = 0;
+  for (size_t i = 0; i < printerCount(); i++) {
+    bytes += getPrinter(i)->metrics().bytes();
+  }
+  unsigned long now = millis();
+  if (lastSample != 0 && now > lastSample) {
+    statusView.addSample((uint64_t)(bytes - lastBytes) * 1000 / (now - lastSample));
+  }
+  lastBytes = bytes;
+  lastSample = now;
+
+  statusView.render();
+}
+
+// One sample line of a per-printer metric
+static void appendSample(String& text, const char* name, const BlePrinter& printer,
+                         const String& value, const char* labels = nullptr) {
+  text += name;
+  text += "{printer=\"" + printer.id() + "\"";
+  if (labels != nullptr) {
+    text += ",";
+    text += labels;
+  }
+  text += "} ";
+  text += value;
+  text += "\n";
+}
+
+// One sample line of a bridge-wide metric
+static void appendValue(String& text, const char* name, const char* labels, const String& value) {
+  text += name;
+  text += "{";
+  text += labels;
+  text += "} ";
+  text += value;
+  text += "\n";
+}
+
+static void appendFamily(String& text, const char* name, const char* type, const char* help) {
+  text += "# HELP ";
+  text += name;
+  text += " ";
+  text += help;
+  text += "\n# TYPE ";
+  text += name;
+  text += " ";
+  text += type;
+  text += "\n";
+}
+
+// Prometheus text exposition of every printer's link and job telemetry
+String getMetricsText() {
+  String text;
+  text.reserve(8192);
+
+  appendFamily(text, "bridge_uptime_seconds", "gauge", "Seconds since boot");
+  text += "bridge_uptime_seconds " + String(millis() / 1000) + "\n";
+
+  DeferredLogStats logStats;
+  getDeferredLogStats(logStats);
+  appendFamily(text, "bridge_log_lines_total", "counter", "Log lines queued for the serial port");
+  text += "bridge_log_lines_total " + String(logStats.lines) + "\n";
+  appendFamily(text, "bridge_log_dropped_total", "counter", "Log lines dropped because the serial port fell behind");
+  text += "bridge_log_dropped_total " + String(logStats.dropped) + "\n";
+  appendFamily(text, "bridge_log_truncated_total", "counter", "Log lines cut at LOG_LINE_MAX");
+  text += "bridge_log_truncated_total " + String(logStats.truncated) + "\n";
+  appendFamily(text, "bridge_log_pending_bytes", "gauge", "Log bytes waiting for the serial port");
+  text += "bridge_log_pending_bytes " + String(logStats.pending) + "\n";
+
+  HeapRegionStats regions[2];
+  getInternalHeapStats(regions[0]);
+  getPsramStats(regions[1]);
+  const char* regionLabels[2] = {"region=\"internal\"", "region=\"psram\""};
+  appendFamily(text, "bridge_heap_size_bytes", "gauge", "Heap size");
+  for (size_t r = 0; r < 2; r++) {
+    appendValue(text, "bridge_heap_size_bytes", regionLabels[r], String(regions[r].total));
+  }
+  appendFamily(text, "bridge_heap_free_bytes", "gauge", "Free heap");
+  for (size_t r = 0; r < 2; r++) {
+    appendValue(text, "bridge_heap_free_bytes", regionLabels[r], String(regions[r].free));
+  }
+  appendFamily(text, "bridge_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+  for (size_t r = 0; r < 2; r++) {
+    appendValue(text, "bridge_heap_min_free_bytes", regionLabels[r], String(regions[r].minFree));
+  }
+  appendFamily(text, "bridge_heap_largest_free_block_bytes", "gauge", "Largest block that can be allocated");
+  for (size_t r = 0; r < 2; r++) {
+    appendValue(text, "bridge_heap_largest_free_block_bytes", regionLabels[r], String(regions[r].largestBlock));
+  }
+
+  appendFamily(text, "bridge_task_stack_free_bytes", "gauge", "Stack a task has never used");
+  for (size_t i = 0; i < trackedTaskCount(); i++) {
+    appendValue(text, "bridge_task_stack_free_bytes", ("task=\"" + String(trackedTaskName(i)) + "\"").c_str(),
+                String(trackedTaskStackFree(i)));
+  }
+
+#ifdef TFT_STATS
+  // Bus share of the display: rate(bridge_display_busy_microseconds_total) / 1e6
+  tft_stats_t display = tft.getStats();
+  appendFamily(text, "bridge_display_transactions_total", "counter", "Times the panel was selected for writing");
+  text += "bridge_display_transactions_total " + String(display.transactions) + "\n";
+  appendFamily(text, "bridge_display_windows_total", "counter", "Address windows set on the panel");
+  text += "bridge_display_windows_total " + String(display.windows) + "\n";
+  appendFamily(text, "bridge_display_pixels_total", "counter", "Pixels written to the panel");
+  text += "bridge_display_pixels_total " + String(display.pixels + display.dmaPixels) + "\n";
+  appendFamily(text, "bridge_display_bytes_total", "counter", "Bus bytes written to the panel");
+  text += "bridge_display_bytes_total " + String(display.bytes) + "\n";
+  appendFamily(text, "bridge_display_busy_microseconds_total", "counter", "Time the panel held the bus");
+  text += "bridge_display_busy_microseconds_total " + String(display.heldUs) + "\n";
+#endif
+
+#if HEAP_TRACK_ALLOC
+  appendFamily(text, "bridge_heap_site_bytes", "gauge", "Heap held by a subsystem");
+  for (size_t site = 0; site < HEAP_SITES; site++) {
+    String label = "site=\"" + String(heapSiteName((HeapSite)site)) + "\"";
+    appendValue(text, "bridge_heap_site_bytes", label.c_str(), String(heapSiteBytes((HeapSite)site)));
+  }
+  appendFamily(text, "bridge_heap_site_peak_bytes", "gauge", "Most heap a subsystem held at once");
+  for (size_t site = 0; site < HEAP_SITES; site++) {
+    String label = "site=\"" + String(heapSiteName((HeapSite)site)) + "\"";
+    appendValue(text, "bridge_heap_site_peak_bytes", label.c_str(), String(heapSitePeak((HeapSite)site)));
+  }
+  appendFamily(text, "bridge_heap_site_quota_bytes", "gauge", "Budget of a subsystem, 0 for none");
+  for (size_t site = 0; site < HEAP_SITES; site++) {
+    String label = "site=\"" + String(heapSiteName((HeapSite)site)) + "\",region=\"" +
+                   heapRegionName(heapSiteRegion((HeapSite)site)) + "\"";
+    appendValue(text, "bridge_heap_site_quota_bytes", label.c_str(), String(heapSiteQuota((HeapSite)site)));
+  }
+  appendFamily(text, "bridge_heap_site_refused_total", "counter", "Buffers refused for the budget or region");
+  for (size_t site = 0; site < HEAP_SITES; site++) {
+    String label = "site=\"" + String(heapSiteName((HeapSite)site)) + "\"";
+    appendValue(text, "bridge_heap_site_refused_total", label.c_str(), String(heapSiteRefused((HeapSite)site)));
+  }
+#endif
+
+  appendFamily(text, "bridge_http_in_flight", "gauge", "Admitted HTTP requests whose client is still connected");
+  for (uint8_t lane = 0; lane < HTTP_LANE_COUNT; lane++) {
+    String label = "lane=\"" + String(httpLaneName((HttpLane)lane)) + "\"";
+    appendValue(text, "bridge_http_in_flight", label.c_str(), String(httpLaneInFlight((HttpLane)lane)));
+  }
+  appendFamily(text, "bridge_http_rejected_total", "counter", "HTTP requests answered 503 for their lane's limit");
+  for (uint8_t lane = 0; lane < HTTP_LANE_COUNT; lane++) {
+    String label = "lane=\"" + String(httpLaneName((HttpLane)lane)) + "\"";
+    appendValue(text, "bridge_http_rejected_total", label.c_str(), String(httpLaneRejected((HttpLane)lane)));
+  }
+
+  appendFamily(text, "bridge_printer_connected", "gauge", "1 while the printer link is ready");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_printer_connected", *getPrinter(i), getPrinter(i)->connected() ? "1" : "0");
+  }
+
+  appendFamily(text, "bridge_ble_bytes_total", "counter", "Bytes written to the printer characteristic");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_ble_bytes_total", *getPrinter(i), String(getPrinter(i)->metrics().bytes()));
+  }
+
+  appendFamily(text, "bridge_ble_throughput_bytes_per_second", "gauge", "BLE write rate over a sliding window");
+  for (size_t i = 0; i < printerCount(); i++) {
+    const LinkMetrics& metrics = getPrinter(i)->metrics();
+    appendSample(text, "bridge_ble_throughput_bytes_per_second", *getPrinter(i), String(metrics.rate(10)), "window=\"10s\"");
+    appendSample(text, "bridge_ble_throughput_bytes_per_second", *getPrinter(i),
+                 String(metrics.rate(LINK_RATE_SECONDS)), "window=\"60s\"");
+  }
+
+  appendFamily(text, "bridge_ble_writes_total", "counter", "Chunks written, by write type");
+  for (size_t i = 0; i < printerCount(); i++) {
+    const LinkMetrics& metrics = getPrinter(i)->metrics();
+    appendSample(text, "bridge_ble_writes_total", *getPrinter(i), String(metrics.ackWrites()), "mode=\"ack\"");
+    appendSample(text, "bridge_ble_writes_total", *getPrinter(i), String(metrics.noResponseWrites()),
+                 "mode=\"no_response\"");
+  }
+
+  appendFamily(text, "bridge_ble_write_latency_seconds", "histogram", "Time to get one chunk into the BLE stack");
+  for (size_t i = 0; i < printerCount(); i++) {
+    const LinkMetrics& metrics = getPrinter(i)->metrics();
+    uint32_t cumulative = 0;
+    for (size_t b = 0; b < LINK_LATENCY_BUCKETS; b++) {
+      cumulative += metrics.bucketCount(b);
+      String le = (b < LINK_LATENCY_BUCKETS - 1) ? String(LINK_LATENCY_BOUNDS_US[b] / 1e6f, 6) : String("+Inf");
+      appendSample(text, "bridge_ble_write_latency_seconds_bucket", *getPrinter(i), String(cumulative),
+                   ("le=\"" + le + "\"").c_str());
+    }
+    appendSample(text, "bridge_ble_write_latency_seconds_sum", *getPrinter(i),
+                 String(metrics.latencySumUs() / 1e6, 6));
+    appendSample(text, "bridge_ble_write_latency_seconds_count", *getPrinter(i), String(cumulative));
+  }
+
+  appendFamily(text, "bridge_ble_credit_timeouts_total", "counter", "Writes that fell back to acknowledged for lack of a TX credit");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_ble_credit_timeouts_total", *getPrinter(i), String(getPrinter(i)->metrics().creditTimeouts()));
+  }
+
+  appendFamily(text, "bridge_ble_write_errors_total", "counter", "Writes the BLE stack refused");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_ble_write_errors_total", *getPrinter(i), String(getPrinter(i)->metrics().writeErrors()));
+  }
+
+  appendFamily(text, "bridge_ble_flow_pauses_total", "counter", "Times the printer stopped the writer with XOFF");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_ble_flow_pauses_total", *getPrinter(i), String(getPrinter(i)->metrics().flowPauses()));
+  }
+
+  appendFamily(text, "bridge_ble_flow_paused_seconds_total", "counter", "Time spent waiting for XON");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_ble_flow_paused_seconds_total", *getPrinter(i),
+                 String(getPrinter(i)->metrics().flowPausedMs() / 1000.0f, 3));
+  }
+
+  appendFamily(text, "bridge_ble_paced_seconds_total", "counter", "Time held back by the modelled printer buffer");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_ble_paced_seconds_total", *getPrinter(i),
+                 String(getPrinter(i)->metrics().pacedMs() / 1000.0f, 3));
+  }
+
+  appendFamily(text, "bridge_ble_connects_total", "counter", "Connection attempts, by outcome");
+  for (size_t i = 0; i < printerCount(); i++) {
+    const LinkMetrics& metrics = getPrinter(i)->metrics();
+    appendSample(text, "bridge_ble_connects_total", *getPrinter(i), String(metrics.connects()), "result=\"ok\"");
+    appendSample(text, "bridge_ble_connects_total", *getPrinter(i), String(metrics.connectFailures()), "result=\"failed\"");
+  }
+
+  appendFamily(text, "bridge_ble_disconnects_total", "counter", "Ready links that dropped");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_ble_disconnects_total", *getPrinter(i), String(getPrinter(i)->metrics().disconnects()));
+  }
+
+  appendFamily(text, "bridge_pipeline_stage_seconds_total", "counter",
+               "Time in each pipeline stage, without the stages after it");
+  for (size_t i = 0; i < printerCount(); i++) {
+    const PrintPipeline& pipeline = getPrinter(i)->pipeline();
+    for (uint8_t stage = 0; stage < PIPELINE_STAGE_KINDS; stage++) {
+      String label = "stage=\"" + String(pipelineStageName((PipelineStage)stage)) + "\"";
+      appendSample(text, "bridge_pipeline_stage_seconds_total", *getPrinter(i),
+                   String(pipeline.stats((PipelineStage)stage).micros / 1e6, 6), label.c_str());
+    }
+  }
+
+  appendFamily(text, "bridge_pipeline_stage_bytes_total", "counter", "Bytes into each pipeline stage");
+  for (size_t i = 0; i < printerCount(); i++) {
+    const PrintPipeline& pipeline = getPrinter(i)->pipeline();
+    for (uint8_t stage = 0; stage < PIPELINE_STAGE_KINDS; stage++) {
+      String label = "stage=\"" + String(pipelineStageName((PipelineStage)stage)) + "\"";
+      appendSample(text, "bridge_pipeline_stage_bytes_total", *getPrinter(i),
+                   String((double)pipeline.stats((PipelineStage)stage).bytes, 0), label.c_str());
+    }
+  }
+
+  appendFamily(text, "bridge_print_jobs_total", "counter", "Jobs the printer's writer finished, by result");
+  for (size_t i = 0; i < printerCount(); i++) {
+    PrintWriterStats stats;
+    getPrintWriterStats(i, stats);
+    appendSample(text, "bridge_print_jobs_total", *getPrinter(i), String(stats.done), "result=\"done\"");
+    appendSample(text, "bridge_print_jobs_total", *getPrinter(i), String(stats.failed), "result=\"failed\"");
+    appendSample(text, "bridge_print_jobs_total", *getPrinter(i), String(stats.moved), "result=\"moved\"");
+  }
+
+  if (espNowTriggerEnabled()) {
+    appendFamily(text, "bridge_espnow_triggers_total", "counter", "ESP-NOW trigger packets, by result");
+    for (uint8_t result = 0; result < ESPNOW_RESULTS; result++) {
+      String label = "result=\"" + String(espNowResultName((EspNowResult)result)) + "\"";
+      appendValue(text, "bridge_espnow_triggers_total", label.c_str(), String(espNowTriggerCount((EspNowResult)result)));
+    }
+  }
+
+  if (telemetryExportEnabled()) {
+    appendFamily(text, "bridge_telemetry_packets_total", "counter", "Telemetry datagrams, by outcome");
+    appendValue(text, "bridge_telemetry_packets_total", "result=\"sent\"", String(telemetryPacketsSent()));
+    appendValue(text, "bridge_telemetry_packets_total", "result=\"dropped\"", String(telemetryPacketsDropped()));
+  }
+
+  appendFamily(text, "bridge_print_queue_depth", "gauge", "Jobs queued or streaming");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_print_queue_depth", *getPrinter(i), String(printQueueDepth(i)));
+  }
+
+  appendFamily(text, "bridge_print_pending_bytes", "gauge", "Bytes accepted but not yet written to the printer");
+  for (size_t i = 0; i < printerCount(); i++) {
+    appendSample(text, "bridge_print_pending_bytes", *getPrinter(i), String(printWriterPending(i)));
+  }
+
+  return text;
+}
+
+// Decoded output of a compressed /print upload
+bool appendInflated(void* context, const uint8_t* data, size_t length) {
+  PrintRequestContext* ctx = (PrintRequestContext*)context;
+  if (ctx->recorder != nullptr) {
+    ctx->recorder->write(data, length);
+  }
+  size_t queued = appendPrintJob(ctx->jobId, data, length, printQueueTimeout);
+  if (queued < length) {
+    log_e("Job %u buffer full, dropped %d of %d decoded bytes", ctx->jobId, length - queued, length);
+    return false;
+  }
+  return true;
+}
+
+// Printer commands generated from a /print/image upload
+bool appendRasterized(void* context, const uint8_t* data, size_t length) {
+  PrintRequestContext* ctx = (PrintRequestContext*)context;
+  size_t queued = appendPrintJob(ctx->jobId, data, length, printQueueTimeout);
+  if (queued < length) {
+    log_e("Job %u buffer full, dropped %d of %d raster bytes", ctx->jobId, length - queued, length);
+    return false;
+  }
+  return true;
+}
+
+// Printer commands of a rendered label template
+bool appendLabel(void* context, const uint8_t* data, size_t length) {
+  uint32_t jobId = *(uint32_t*)context;
+  size_t queued = appendPrintJob(jobId, data, length, printQueueTimeout);
+  if (queued < length) {
+    log_e("Job %u buffer full, dropped %d of %d label bytes", jobId, length - queued, length);
+    return false;
+  }
+  return true;
+}
+
+String getJobJSON(const PrintJobInfo& info) {
+  String json = "{";
+  json += "\"id\":";
+  json += String(info.id);
+  json += ",";
+  json += "\"printer\":\"";
+  json += getPrinter(info.printer) != nullptr ? getPrinter(info.printer)->id() : String();
+  json += "\",";
+  json += "\"status\":\"";
+  json += printJobStateName(info.state);
+  json += "\",";
+  json += "\"priority\":\"";
+  json += printJobPriorityName(info.priority);
+  json += "\",";
+  json += "\"total\":";
+  json += String(info.total);
+  json += ",";
+  json += "\"received\":";
+  json += String(info.received);
+  json += ",";
+  json += "\"sent\":";
+  json += String(info.sent);
+  json += ",";
+  json += "\"copies\":";
+  json += String(info.copies);
+  json += ",";
+  json += "\"copiesDone\":";
+  json += String(info.copiesDone);
+  json += "}";
+  return json;
+}
+
+String getSpoolJSON() {
+  static PrintSpoolInfo spooled[PRINT_SPOOL_JOBS];
+  size_t count = getSpooledJobs(spooled, PRINT_SPOOL_JOBS);
+
+  String json = "[";
+  for (size_t i = 0; i < count; i++) {
+    const PrintSpoolInfo& entry = spooled[i];
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":" + String(entry.id);
+    json += ",\"printer\":\"";
+    json += getPrinter(entry.printer) != nullptr ? getPrinter(entry.printer)->id() : String();
+    json += "\",\"bytes\":" + String(entry.length);
+    json += ",\"job\":" + (entry.jobId != 0 ? String(entry.jobId) : String("null"));
+    json += ",\"failures\":" + String(entry.failures);
+    json += ",\"tier\":\"";
+    json += entry.onFlash ? "flash" : "psram";
+    json += "\"}";
+  }
+  json += "]";
+  return json;
+}
+
+// Milliseconds from the job's creation to a step, null when it never happened
+static String timelineOffset(const PrintJobTimeline& entry, uint32_t at) {
+  return at == 0 ? String("null") : String(at - entry.created);
+}
+
+String getHistoryJSON() {
+  static PrintJobTimeline timelines[PRINT_HISTORY_SIZE];
+  size_t count = getPrintHistory(timelines, PRINT_HISTORY_SIZE);
+
+  String json = "[";
+  for (size_t i = 0; i < count; i++) {
+    const PrintJobTimeline& entry = timelines[i];
+    if (i > 0) {
+      json += ",";
+    }
+    json += "{\"id\":";
+    json += String(entry.id);
+    json += ",\"printer\":\"";
+    json += getPrinter(entry.printer) != nullptr ? getPrinter(entry.printer)->id() : String();
+    json += "\",\"status\":\"";
+    json += printJobStateName(entry.state);
+    json += "\",\"bytes\":";
+    json += String(entry.bytes);
+    json += ",\"created\":";
+    json += String(entry.created);
+    json += ",\"firstByte\":";
+    json += timelineOffset(entry, entry.firstByte);
+    json += ",\"lastByte\":";
+    json += timelineOffset(entry, entry.lastByte);
+    json += ",\"firstWrite\":";
+    json += timelineOffset(entry, entry.firstWrite);
+    json += ",\"lastWrite\":";
+    json += timelineOffset(entry, entry.lastWrite);
+    json += ",\"printerIdle\":";
+    json += timelineOffset(entry, entry.printerIdle);
+    json += "}";
+  }
+  json += "]";
+  return json;
+}
+
+// Called from the print writers too, so it only asks the display task
+void wakeScreen() {
+  lastActivityTime = millis();
+  if ((!isScreenOn || displayPower() == DISPLAY_POWER_DIM) && displayQueue != nullptr) {
+    DisplayRequest wake = DISPLAY_WAKE;
+    xQueueOverwrite(displayQueue, &wake);
+  }
+}
+
+// Draw a state change without waiting for the next periodic frame. Never
+// blocks; requests before the frame is drawn make one frame.
+void requestRedraw() {
+  if (isScreenOn && displayQueue != nullptr) {
+    DisplayRequest changed = DISPLAY_CHANGED;
+    xQueueOverwrite(displayQueue, &changed);
+  }
+}
+
+// Link state listener of the printers
+void onPrinterLinkState(uint8_t printer, BleLinkState state) {
+  // Spooled jobs go out as soon as the handles are ready
+  if (state == LINK_READY) {
+    wakePrintSpool();
+  }
+  requestRedraw();
+}
+
+// Dims the backlight, then turns it off and puts the panel to sleep
+void checkScreenTimeout() {
+  if (!isScreenOn) {
+    return;
+  }
+  unsigned long idle = millis() - lastActivityTime;
+  if (idle > SCREEN_TIMEOUT) {
+    setDisplayPower(DISPLAY_POWER_SLEEP);
+    isScreenOn = false;
+    log_i("Screen timeout - panel asleep");
+  } else {
+    setDisplayPower(idle > DISPLAY_DIM_MS ? DISPLAY_POWER_DIM : DISPLAY_POWER_ON);
   }
 }
@@ -0,0 +1,315 @@
+#include "mqtt_ingest.h"
+
+#include <esp_idf_version.h>
+#include <mqtt_client.h>
+
+#include "ble_printer.h"
+#include "print_spool.h"
+#include "print_writer.h"
+
+static const uint32_t MQTT_ADMIT_POLL_MS = 100;
+
+enum MqttOutcome : uint8_t {
+  OUTCOME_JOB,                   // Queued; reported once it printed or failed
+  OUTCOME_SPOOLED,
+  OUTCOME_REJECTED
+};
+
+struct MqttReport {
+  MqttOutcome outcome;
+  uint8_t printer;
+  uint32_t id;                   // Job or spool ID
+  const char* reason;            // For rejections, a literal
+};
+
+// The message being received. The MQTT task delivers one at a time.
+struct MqttMessage {
+  bool active;
+  uint8_t printer;
+  uint32_t jobId;
+  PrintSpoolWriter* spool;
+};
+
+static esp_mqtt_client_handle_t client = nullptr;
+static volatile bool connected = false;
+static char clientId[32];
+static MqttMessage message;
+static MqttReport reports[MQTT_TRACKED_JOBS];
+static size_t reportCount = 0;
+static SemaphoreHandle_t reportLock = nullptr;
+static uint32_t lastPublish = 0;
+
+static void addReport(MqttOutcome outcome, uint8_t printer, uint32_t id, const char* reason) {
+  xSemaphoreTake(reportLock, portMAX_DELAY);
+  if (reportCount == MQTT_TRACKED_JOBS) {
+    log_w("MQTT: outcome of %s %u not reported, %u pending", outcome == OUTCOME_SPOOLED ? "spool" : "job", id,
+          MQTT_TRACKED_JOBS);
+  } else {
+    reports[reportCount++] = {outcome, printer, id, reason};
+  }
+  xSemaphoreGive(reportLock);
+}
+
+// Printer of <prefix>/<id>/jobs, null for any other topic
+static BlePrinter* topicPrinter(const char* topic, int length) {
+  static const size_t PREFIX_LENGTH = strlen(MQTT_TOPIC_PREFIX "/");
+  static const size_t SUFFIX_LENGTH = strlen("/jobs");
+  if (length <= (int)(PREFIX_LENGTH + SUFFIX_LENGTH) || strncmp(topic, MQTT_TOPIC_PREFIX "/", PREFIX_LENGTH) != 0 ||
+      strncmp(topic + length - SUFFIX_LENGTH, "/jobs", SUFFIX_LENGTH) != 0) {
+    return nullptr;
+  }
+  String id;
+  id.concat(topic + PREFIX_LENGTH, length - PREFIX_LENGTH - SUFFIX_LENGTH);
+  return findPrinter(id);
+}
+
+// Holding the message here keeps its PUBACK back and stops the client
+// reading, which is the back-pressure towards the broker
+static void startMessage(BlePrinter* printer, size_t total) {
+  message.active = true;
+  message.printer = printer->index();
+  message.jobId = 0;
+  message.spool = nullptr;
+
+  // Connecting overlaps the admit wait
+  printer->requestJobConnect();
+  PrintJobReject reject = JOB_REJECT_QUEUE_FULL;
+  uint32_t started = millis();
+  for (;;) {
+    if (printer->connected()) {
+      message.jobId = createPrintJob(message.printer, total, reject);
+      if (message.jobId != 0 || reject != JOB_REJECT_QUEUE_FULL) {
+        break;
+      }
+    }
+    if (millis() - started >= MQTT_ADMIT_WAIT_MS) {
+      break;
+    }
+    vTaskDelay(pdMS_TO_TICKS(MQTT_ADMIT_POLL_MS));
+  }
+  if (message.jobId != 0) {
+    log_i("MQTT job %u for %s, %u bytes", message.jobId, printer->id().c_str(), total);
+    return;
+  }
+
+  // Waits on flash for a printer that stayed away
+  if (!printer->connected()) {
+    message.spool = new PrintSpoolWriter();
+    if (message.spool->begin(message.printer, PRINT_NO_POOL, total)) {
+      return;
+    }
+    delete message.spool;
+    message.spool = nullptr;
+  }
+  const char* reason = !printer->connected() ? "printer not connected"
+                     : reject == JOB_REJECT_TOO_LARGE ? "job too large"
+                     : reject == JOB_REJECT_NO_MEMORY ? "out of memory"
+                     : "queue full";
+  log_w("MQTT job for %s refused: %s", printer->id().c_str(), reason);
+  addReport(OUTCOME_REJECTED, message.printer, 0, reason);
+}
+
+static void feedMessage(const uint8_t* data, size_t length) {
+  if (message.spool != nullptr) {
+    message.spool->write(data, length);
+    return;
+  }
+  if (message.jobId == 0) {
+    return;
+  }
+  if (!appendPrintJobWait(message.jobId, data, length)) {
+    // Cancelled or the printer dropped; the rest of the payload is drained
+    message.jobId = 0;
+  }
+}
+
+static void endMessage() {
+  if (message.spool != nullptr) {
+    uint32_t spoolId = message.spool->commit(0);
+    delete message.spool;
+    message.spool = nullptr;
+    if (spoolId != 0) {
+      addReport(OUTCOME_SPOOLED, message.printer, spoolId, nullptr);
+    } else {
+      addReport(OUTCOME_REJECTED, message.printer, 0, "spool full");
+    }
+  } else if (message.jobId != 0) {
+    finishPrintJob(message.jobId);
+    addReport(OUTCOME_JOB, message.printer, message.jobId, nullptr);
+  }
+  message.active = false;
+}
+
+static void subscribeJobs() {
+  for (size_t i = 0; i < printerCount(); i++) {
+    String topic = String(MQTT_TOPIC_PREFIX "/") + getPrinter(i)->id() + "/jobs";
+    if (esp_mqtt_client_subscribe(client, topic.c_str(), 1) < 0) {
+      log_e("MQTT: subscribing to %s failed", topic.c_str());
+    }
+  }
+}
+
+// Runs in the esp-mqtt task
+static void onMqttEvent(void* args, esp_event_base_t base, int32_t eventId, void* data) {
+  esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)data;
+  switch ((esp_mqtt_event_id_t)eventId) {
+    case MQTT_EVENT_CONNECTED:
+      connected = true;
+      log_i("✅ MQTT connected, %s session", event->session_present ? "resumed" : "new");
+      // A resumed session keeps its subscriptions, but the registry may
+      // have changed since
+      subscribeJobs();
+      break;
+    case MQTT_EVENT_DISCONNECTED:
+      if (connected) {
+        log_w("MQTT disconnected");
+      }
+      connected = false;
+      // A message cut off here is sent again by the broker, unacknowledged
+      if (message.active) {
+        if (message.jobId != 0) {
+          abortPrintJob(message.jobId);
+        }
+        delete message.spool;
+        message = {};
+      }
+      break;
+    case MQTT_EVENT_DATA: {
+      // The topic only comes with the first piece of a message
+      if (event->current_data_offset == 0) {
+        BlePrinter* printer = topicPrinter(event->topic, event->topic_len);
+        message = {};
+        if (printer == nullptr || event->total_data_len == 0) {
+          break;
+        }
+        startMessage(printer, event->total_data_len);
+      }
+      if (!message.active) {
+        break;
+      }
+      feedMessage((const uint8_t*)event->data, event->data_len);
+      if (event->current_data_offset + event->data_len >= event->total_data_len) {
+        endMessage();
+      }
+      break;
+    }
+    case MQTT_EVENT_ERROR:
+      log_w("MQTT error");
+      break;
+    default:
+      break;
+  }
+}
+
+void initMqttIngest() {
+  if (strlen(MQTT_BROKER_URI) == 0) {
+    return;
+  }
+  reportLock = xSemaphoreCreateMutex();
+  if (reportLock == nullptr) {
+    return;
+  }
+
+  // A persistent session needs the same client ID on every connect
+  if (strlen(MQTT_CLIENT_ID) > 0) {
+    strlcpy(clientId, MQTT_CLIENT_ID, sizeof(clientId));
+  } else {
+    uint64_t mac = ESP.getEfuseMac();
+    snprintf(clientId, sizeof(clientId), "bridge-%02x%02x%02x", (uint8_t)(mac >> 24), (uint8_t)(mac >> 32),
+             (uint8_t)(mac >> 40));
+  }
+
+  esp_mqtt_client_config_t config = {};
+#if ESP_IDF_VERSION_MAJOR >= 5
+  config.broker.address.uri = MQTT_BROKER_URI;
+  config.credentials.client_id = clientId;
+  config.credentials.username = strlen(MQTT_USERNAME) > 0 ? MQTT_USERNAME : nullptr;
+  config.credentials.authentication.password = strlen(MQTT_PASSWORD) > 0 ? MQTT_PASSWORD : nullptr;
+  config.session.disable_clean_session = true;
+  config.session.keepalive = MQTT_KEEPALIVE_S;
+  config.buffer.size = MQTT_BUFFER_SIZE;
+  config.task.priority = 2;
+  config.task.stack_size = 6144;
+#else
+  config.uri = MQTT_BROKER_URI;
+  config.client_id = clientId;
+  config.username = strlen(MQTT_USERNAME) > 0 ? MQTT_USERNAME : nullptr;
+  config.password = strlen(MQTT_PASSWORD) > 0 ? MQTT_PASSWORD : nullptr;
+  config.disable_clean_session = true;
+  config.keepalive = MQTT_KEEPALIVE_S;
+  config.buffer_size = MQTT_BUFFER_SIZE;
+  config.task_prio = 2;
+  config.task_stack = 6144;
+#endif
+
+  client = esp_mqtt_client_init(&config);
+  if (client == nullptr) {
+    log_e("MQTT client could not be created");
+    return;
+  }
+  esp_mqtt_client_register_event(client, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, onMqttEvent, nullptr);
+  // Connects and reconnects in its own task
+  if (esp_mqtt_client_start(client) != ESP_OK) {
+    log_e("MQTT client failed to start");
+    return;
+  }
+  log_i("MQTT client %s connecting to %s", clientId, MQTT_BROKER_URI);
+}
+
+// Appends the finished outcomes of one printer to json and drops them.
+// Caller holds reportLock.
+static void collectReports(uint8_t printer, String& json) {
+  size_t kept = 0;
+  for (size_t i = 0; i < reportCount; i++) {
+    MqttReport& report = reports[i];
+    String entry;
+    if (report.printer != printer) {
+      reports[kept++] = report;
+      continue;
+    }
+    if (report.outcome == OUTCOME_JOB) {
+      PrintJobInfo info;
+      if (getPrintJob(report.id, info) && (info.state == JOB_QUEUED || info.state == JOB_STREAMING)) {
+        reports[kept++] = report;
+        continue;
+      }
+      // A job no longer in its slot was overtaken by newer ones; it ended
+      const char* state = getPrintJob(report.id, info) ? printJobStateName(info.state) : "unknown";
+      entry = "{\"job\":" + String(report.id) + ",\"state\":\"" + state + "\"}";
+    } else if (report.outcome == OUTCOME_SPOOLED) {
+      entry = "{\"spool\":" + String(report.id) + ",\"state\":\"spooled\"}";
+    } else {
+      entry = String("{\"state\":\"rejected\",\"reason\":\"") + report.reason + "\"}";
+    }
+    json += json.length() == 0 ? "" : ",";
+    json += entry;
+  }
+  reportCount = kept;
+}
+
+void serviceMqttIngest() {
+  if (reportLock == nullptr || millis() - lastPublish < MQTT_STATUS_INTERVAL_MS) {
+    return;
+  }
+  lastPublish = millis();
+  if (!connected) {
+    return;
+  }
+  for (size_t i = 0; i < printerCount(); i++) {
+    String jobs;
+    xSemaphoreTake(reportLock, portMAX_DELAY);
+    collectReports(i, jobs);
+    xSemaphoreGive(reportLock);
+    if (jobs.length() == 0) {
+      continue;
+    }
+    String topic = String(MQTT_TOPIC_PREFIX "/") + getPrinter(i)->id() + "/status";
+    String payload = "{\"jobs\":[" + jobs + "],\"queue\":" + String(printQueueDepth(i)) + "}";
+    // Queued for the MQTT task, so the service task never waits on the broker
+    esp_mqtt_client_enqueue(client, topic.c_str(), payload.c_str(), payload.length(), 1, 0, true);
+  }
+}
+
+bool mqttIngestConnected() {
+  return connected;
+}
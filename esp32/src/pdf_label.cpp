@@ -0,0 +1,1395 @@
+#include "pdf_label.h"
+#include "ccitt_g4.h"
+#include "heap_stats.h"
+#include "inflate_stream.h"
+
+static const uint8_t MAX_NESTING = 16;         // Arrays and dictionaries, page tree levels
+static const uint8_t MAX_OBJECT_STREAMS = 8;
+static const uint8_t MAX_GRAPHICS_STATES = 16; // q without Q
+
+static void* pdfAlloc(size_t size) {
+  return heapAlloc(HEAP_SITE_PDF, size);
+}
+
+const char* pdfResultName(PdfResult result) {
+  switch (result) {
+    case PDF_OK: return "OK";
+    case PDF_INVALID: return "Invalid PDF";
+    case PDF_UNSUPPORTED: return "PDF needs full rendering";
+    case PDF_TOO_LARGE: return "PDF too large";
+    case PDF_NO_MEMORY: return "Out of memory";
+    case PDF_OUTPUT: return "Output refused";
+  }
+  return "Unknown";
+}
+
+// Lexical helpers over a byte range
+
+static bool isSpace(uint8_t c) {
+  return c == 0 || c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+}
+
+static bool isDelimiter(uint8_t c) {
+  switch (c) {
+    case '(': case ')': case '<': case '>': case '[': case ']':
+    case '{': case '}': case '/': case '%':
+      return true;
+  }
+  return false;
+}
+
+static bool isDigit(uint8_t c) {
+  return c >= '0' && c <= '9';
+}
+
+static const uint8_t* skipSpace(const uint8_t* p, const uint8_t* end) {
+  while (p < end) {
+    if (*p == '%') {
+      while (p < end && *p != '\r' && *p != '\n') {
+        p++;
+      }
+    } else if (isSpace(*p)) {
+      p++;
+    } else {
+      break;
+    }
+  }
+  return p;
+}
+
+static const uint8_t* tokenEnd(const uint8_t* p, const uint8_t* end) {
+  while (p < end && !isSpace(*p) && !isDelimiter(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// The token at p is exactly word
+static bool isToken(const uint8_t* p, const uint8_t* end, const char* word) {
+  size_t n = strlen(word);
+  return (size_t)(end - p) >= n && memcmp(p, word, n) == 0 && tokenEnd(p + n, end) == p + n;
+}
+
+static const uint8_t* findBytes(const uint8_t* p, const uint8_t* end, const char* needle) {
+  size_t n = strlen(needle);
+  while ((size_t)(end - p) >= n) {
+    const uint8_t* hit = (const uint8_t*)memchr(p, needle[0], end - p - n + 1);
+    if (hit == nullptr) {
+      return nullptr;
+    }
+    if (memcmp(hit, needle, n) == 0) {
+      return hit;
+    }
+    p = hit + 1;
+  }
+  return nullptr;
+}
+
+// An unsigned integer token; p moves past it only when there is one
+static bool readInteger(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+  const uint8_t* q = p;
+  uint32_t v = 0;
+  while (q < end && isDigit(*q) && v < 100000000) {
+    v = v * 10 + (*q - '0');
+    q++;
+  }
+  if (q == p || tokenEnd(q, end) != q) {
+    return false;
+  }
+  value = v;
+  p = q;
+  return true;
+}
+
+// "N G R"; p moves past it only when there is one
+static bool readReference(const uint8_t*& p, const uint8_t* end, uint32_t& number) {
+  const uint8_t* q = skipSpace(p, end);
+  uint32_t generation = 0;
+  if (!readInteger(q, end, number)) {
+    return false;
+  }
+  q = skipSpace(q, end);
+  if (!readInteger(q, end, generation)) {
+    return false;
+  }
+  q = skipSpace(q, end);
+  if (!isToken(q, end, "R")) {
+    return false;
+  }
+  p = q + 1;
+  return true;
+}
+
+static bool readNumber(const uint8_t*& p, const uint8_t* end, float& value) {
+  const uint8_t* q = p;
+  bool negative = false;
+  if (q < end && (*q == '-' || *q == '+')) {
+    negative = *q == '-';
+    q++;
+  }
+  float v = 0;
+  bool digits = false;
+  while (q < end && isDigit(*q)) {
+    v = v * 10 + (*q - '0');
+    q++;
+    digits = true;
+  }
+  if (q < end && *q == '.') {
+    q++;
+    float scale = 0.1f;
+    while (q < end && isDigit(*q)) {
+      v += (*q - '0') * scale;
+      scale *= 0.1f;
+      q++;
+      digits = true;
+    }
+  }
+  if (!digits || tokenEnd(q, end) != q) {
+    return false;
+  }
+  value = negative ? -v : v;
+  p = q;
+  return true;
+}
+
+// Past one object at p: dictionary, array, string, name, number, keyword
+// or reference. nullptr when it is malformed.
+static const uint8_t* skipValue(const uint8_t* p, const uint8_t* end, uint8_t depth = 0) {
+  p = skipSpace(p, end);
+  if (p >= end || depth > MAX_NESTING) {
+    return nullptr;
+  }
+  if (*p == '<' && end - p >= 2 && p[1] == '<') {
+    p += 2;
+    while (true) {
+      p = skipSpace(p, end);
+      if (end - p >= 2 && p[0] == '>' && p[1] == '>') {
+        return p + 2;
+      }
+      p = skipValue(p, end, depth + 1);
+      if (p == nullptr) {
+        return nullptr;
+      }
+    }
+  }
+  if (*p == '<') {
+    const uint8_t* close = (const uint8_t*)memchr(p, '>', end - p);
+    return close != nullptr ? close + 1 : nullptr;
+  }
+  if (*p == '[') {
+    p++;
+    while (true) {
+      p = skipSpace(p, end);
+      if (p < end && *p == ']') {
+        return p + 1;
+      }
+      p = skipValue(p, end, depth + 1);
+      if (p == nullptr) {
+        return nullptr;
+      }
+    }
+  }
+  if (*p == '(') {
+    int nest = 0;
+    for (; p < end; p++) {
+      if (*p == '\\') {
+        p++;
+      } else if (*p == '(') {
+        nest++;
+      } else if (*p == ')' && --nest == 0) {
+        return p + 1;
+      }
+    }
+    return nullptr;
+  }
+  if (*p == '/') {
+    return tokenEnd(p + 1, end);
+  }
+  if (isDelimiter(*p)) {
+    return nullptr;
+  }
+  const uint8_t* q = p;
+  uint32_t number = 0;
+  if (readReference(q, end, number)) {
+    return q;
+  }
+  return tokenEnd(p, end);
+}
+
+// A value inside the file or a decoded object stream, parsed no further
+// than limit
+struct PdfValue {
+  const uint8_t* start = nullptr;
+  const uint8_t* limit = nullptr;
+
+  bool valid() const { return start != nullptr; }
+  bool isDict() const { return valid() && limit - start >= 2 && start[0] == '<' && start[1] == '<'; }
+  bool isArray() const { return valid() && start < limit && *start == '['; }
+  bool isName(const char* name) const {
+    return valid() && start < limit && *start == '/' && isToken(start + 1, limit, name);
+  }
+  bool isName() const { return valid() && start < limit && *start == '/'; }
+  bool number(float& value) const {
+    const uint8_t* p = start;
+    return valid() && readNumber(p, limit, value);
+  }
+  bool integer(long& value) const {
+    float v = 0;
+    if (!number(v)) {
+      return false;
+    }
+    value = (long)v;
+    return true;
+  }
+  bool boolean(bool fallback) const {
+    if (valid() && isToken(start, limit, "true")) {
+      return true;
+    }
+    if (valid() && isToken(start, limit, "false")) {
+      return false;
+    }
+    return fallback;
+  }
+  String name() const {
+    if (!isName()) {
+      return String();
+    }
+    const uint8_t* end = tokenEnd(start + 1, limit);
+    String text;
+    text.reserve(end - start - 1);
+    for (const uint8_t* p = start + 1; p < end; p++) {
+      text += (char)*p;
+    }
+    return text;
+  }
+};
+
+// Item of an array, or the value itself when it isn't one
+static PdfValue arrayItem(PdfValue array, size_t index) {
+  PdfValue item;
+  if (!array.isArray()) {
+    if (index == 0) {
+      item = array;
+    }
+    return item;
+  }
+  const uint8_t* p = array.start + 1;
+  for (size_t i = 0;; i++) {
+    p = skipSpace(p, array.limit);
+    if (p >= array.limit || *p == ']') {
+      return item;
+    }
+    if (i == index) {
+      item.start = p;
+      item.limit = array.limit;
+      return item;
+    }
+    p = skipValue(p, array.limit);
+    if (p == nullptr) {
+      return item;
+    }
+  }
+}
+
+static size_t arrayLength(PdfValue array) {
+  if (!array.isArray()) {
+    return array.valid() ? 1 : 0;
+  }
+  size_t n = 0;
+  while (arrayItem(array, n).valid()) {
+    n++;
+  }
+  return n;
+}
+
+// Value of a key of a dictionary, not resolved
+static PdfValue dictEntry(PdfValue dict, const char* key) {
+  PdfValue value;
+  if (!dict.isDict()) {
+    return value;
+  }
+  const uint8_t* p = dict.start + 2;
+  while (true) {
+    p = skipSpace(p, dict.limit);
+    if (p >= dict.limit || *p != '/') {
+      return value;
+    }
+    bool match = isToken(p + 1, dict.limit, key);
+    p = skipValue(p, dict.limit);
+    if (p == nullptr) {
+      return value;
+    }
+    p = skipSpace(p, dict.limit);
+    if (match) {
+      value.start = p;
+      value.limit = dict.limit;
+      return value;
+    }
+    p = skipValue(p, dict.limit);
+    if (p == nullptr) {
+      return value;
+    }
+  }
+}
+
+// Growing buffer for decoded streams
+struct PdfBuffer {
+  uint8_t* data = nullptr;
+  size_t length = 0;
+  size_t capacity = 0;
+  size_t limit = 0;
+  bool full = false;
+  bool noMemory = false;
+
+  explicit PdfBuffer(size_t max) : limit(max) {}
+  ~PdfBuffer() { heapFree(data); }
+  PdfBuffer(const PdfBuffer&) = delete;
+  PdfBuffer& operator=(const PdfBuffer&) = delete;
+
+  bool append(const uint8_t* bytes, size_t n) {
+    if (length + n > limit) {
+      full = true;
+      return false;
+    }
+    if (length + n > capacity) {
+      size_t grown = capacity == 0 ? 4096 : capacity * 2;
+      while (grown < length + n) {
+        grown *= 2;
+      }
+      if (grown > limit) {
+        grown = limit;
+      }
+      uint8_t* bigger = (uint8_t*)pdfAlloc(grown);
+      if (bigger == nullptr) {
+        noMemory = true;
+        return false;
+      }
+      if (length > 0) {
+        memcpy(bigger, data, length);
+      }
+      heapFree(data);
+      data = bigger;
+      capacity = grown;
+    }
+    memcpy(data + length, bytes, n);
+    length += n;
+    return true;
+  }
+
+  // Hand the data over to the caller, who frees it with heapFree()
+  uint8_t* release() {
+    uint8_t* p = data;
+    data = nullptr;
+    length = capacity = 0;
+    return p;
+  }
+};
+
+static bool bufferOutput(void* context, const uint8_t* data, size_t length) {
+  return ((PdfBuffer*)context)->append(data, length);
+}
+
+struct PdfObject {
+  uint32_t number;
+  const uint8_t* start;
+  const uint8_t* limit;
+};
+
+// 1-bit page image, 1 for ink
+struct PdfBitmap {
+  uint8_t* bits = nullptr;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  size_t widthBytes = 0;
+
+  ~PdfBitmap() { heapFree(bits); }
+  bool pixel(uint16_t x, uint16_t y) const {
+    return (bits[y * widthBytes + (x >> 3)] & (0x80 >> (x & 7))) != 0;
+  }
+  // Clear the padding bits past the last column
+  void trimRow(uint8_t* row) const {
+    if ((width & 7) != 0) {
+      row[widthBytes - 1] &= (uint8_t)(0xFF << (8 - (width & 7)));
+    }
+  }
+};
+
+// Image rows as they come out of FlateDecode, unpredicted and stored in
+// the bitmap
+struct ImageRows {
+  PdfBitmap* bitmap;
+  uint8_t components;
+  uint8_t bitsPerComponent;
+  bool inverted;           // Decode [1 0]: sample 0 is paper
+  bool predicted;          // PNG predictors, a tag byte per row
+  size_t rowBytes;         // Samples of one row
+  size_t pixelBytes;       // For the predictors, at least 1
+  uint8_t* scan;           // Tag byte and samples of the row being filled
+  uint8_t* prev;           // Samples of the row above
+  size_t fill;
+  uint16_t row;
+  bool badPredictor;
+};
+
+// Ink where the sample is black, so DeviceGray 0 and the painted
+// ImageMask samples, unless Decode swaps them
+static void storeRow(ImageRows& rows, const uint8_t* samples) {
+  PdfBitmap& bitmap = *rows.bitmap;
+  if (rows.row >= bitmap.height) {
+    return;
+  }
+  uint8_t* dest = bitmap.bits + rows.row * bitmap.widthBytes;
+  rows.row++;
+  if (rows.bitsPerComponent == 1) {
+    for (size_t i = 0; i < bitmap.widthBytes; i++) {
+      dest[i] = rows.inverted ? samples[i] : (uint8_t)~samples[i];
+    }
+    bitmap.trimRow(dest);
+    return;
+  }
+  memset(dest, 0, bitmap.widthBytes);
+  for (uint16_t x = 0; x < bitmap.width; x++) {
+    const uint8_t* s = samples + x * rows.components;
+    int level = rows.components == 1 ? s[0] : (s[0] * 77 + s[1] * 150 + s[2] * 29) >> 8;
+    if (rows.inverted) {
+      level = 255 - level;
+    }
+    if (level < IMAGE_THRESHOLD) {
+      dest[x >> 3] |= 0x80 >> (x & 7);
+    }
+  }
+}
+
+static uint8_t paeth(uint8_t a, uint8_t b, uint8_t c) {
+  int p = (int)a + b - c;
+  int pa = abs(p - a);
+  int pb = abs(p - b);
+  int pc = abs(p - c);
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+  return pb <= pc ? b : c;
+}
+
+static bool imageRowsOutput(void* context, const uint8_t* data, size_t length) {
+  ImageRows& rows = *(ImageRows*)context;
+  const size_t scanLength = rows.rowBytes + (rows.predicted ? 1 : 0);
+  while (length > 0 && rows.row < rows.bitmap->height) {
+    size_t n = scanLength - rows.fill;
+    if (n > length) {
+      n = length;
+    }
+    memcpy(rows.scan + rows.fill, data, n);
+    rows.fill += n;
+    data += n;
+    length -= n;
+    if (rows.fill < scanLength) {
+      break;
+    }
+    rows.fill = 0;
+    if (!rows.predicted) {
+      storeRow(rows, rows.scan);
+      continue;
+    }
+    uint8_t* cur = rows.scan + 1;
+    const size_t bpp = rows.pixelBytes;
+    for (size_t i = 0; i < rows.rowBytes; i++) {
+      uint8_t left = i >= bpp ? cur[i - bpp] : 0;
+      uint8_t up = rows.prev[i];
+      uint8_t upLeft = i >= bpp ? rows.prev[i - bpp] : 0;
+      switch (rows.scan[0]) {
+        case 0: break;
+        case 1: cur[i] += left; break;
+        case 2: cur[i] += up; break;
+        case 3: cur[i] += (uint8_t)(((int)left + up) >> 1); break;
+        case 4: cur[i] += paeth(left, up, upLeft); break;
+        default:
+          rows.badPredictor = true;
+          return false;
+      }
+    }
+    memcpy(rows.prev, cur, rows.rowBytes);
+    storeRow(rows, cur);
+  }
+  return true;
+}
+
+// Direction of an image axis on the paper, snapped to one of four
+struct Axis {
+  int8_t x;
+  int8_t y;
+};
+
+// Clockwise quarter turns, y pointing down
+static Axis turn(Axis a, uint8_t quarters) {
+  for (uint8_t i = 0; i < quarters; i++) {
+    Axis t = {(int8_t)-a.y, a.x};
+    a = t;
+  }
+  return a;
+}
+
+class PdfDocument {
+public:
+  PdfDocument(const uint8_t* data, size_t length, const PdfLabelOptions& options,
+              ImageOutput output, void* context, String& detail)
+    : _data(data), _end(data + length), _options(options), _output(output), _context(context),
+      _detail(detail) {}
+  ~PdfDocument();
+
+  PdfDocument(const PdfDocument&) = delete;
+  PdfDocument& operator=(const PdfDocument&) = delete;
+
+  PdfResult print();
+  uint16_t pages() const { return _pages; }
+
+private:
+  PdfResult fail(PdfResult result, const String& detail);
+  PdfResult indexObjects();
+  PdfResult indexObjectStream(PdfValue stream);
+  bool addObject(uint32_t number, const uint8_t* start, const uint8_t* limit);
+  PdfValue object(uint32_t number) const;
+  PdfValue resolve(PdfValue value) const;
+  PdfValue get(PdfValue dict, const char* key) const { return resolve(dictEntry(dict, key)); }
+  bool streamData(PdfValue object, const uint8_t*& data, size_t& length) const;
+  PdfResult decodeStream(PdfValue object, PdfBuffer& out, const char* what);
+
+  PdfResult walkPages(PdfValue node, PdfValue resources, int rotate, uint8_t depth);
+  PdfResult printPage(PdfValue page, PdfValue resources, int rotate);
+  PdfResult findImage(const PdfBuffer& content, PdfValue resources, PdfValue& image, float* matrix);
+  bool components(PdfValue space, PdfValue resources, uint8_t& count, uint8_t depth = 0) const;
+  PdfResult decodeImage(PdfValue image, PdfValue resources, PdfBitmap& bitmap);
+  PdfResult decodeFax(PdfValue parms, const uint8_t* data, size_t length,
+                      bool inverted, PdfBitmap& bitmap);
+  PdfResult emitLabel(const PdfBitmap& bitmap, const float* matrix, int rotate);
+
+  const uint8_t* _data;
+  const uint8_t* _end;
+  const PdfLabelOptions& _options;
+  ImageOutput _output;
+  void* _context;
+  String& _detail;
+
+  PdfObject* _objects = nullptr;
+  size_t _objectCount = 0;
+  uint8_t* _objectStreams[MAX_OBJECT_STREAMS] = {};
+  uint8_t _objectStreamCount = 0;
+  uint16_t _pages = 0;
+};
+
+PdfDocument::~PdfDocument() {
+  heapFree(_objects);
+  for (uint8_t i = 0; i < _objectStreamCount; i++) {
+    heapFree(_objectStreams[i]);
+  }
+}
+
+PdfResult PdfDocument::fail(PdfResult result, const String& detail) {
+  if (_detail.length() == 0) {
+    _detail = detail;
+  }
+  return result;
+}
+
+bool PdfDocument::addObject(uint32_t number, const uint8_t* start, const uint8_t* limit) {
+  if (_objectCount == PDF_MAX_OBJECTS) {
+    return false;
+  }
+  _objects[_objectCount].number = number;
+  _objects[_objectCount].start = start;
+  _objects[_objectCount].limit = limit;
+  _objectCount++;
+  return true;
+}
+
+// The last definition of an object wins, as with incremental updates
+PdfValue PdfDocument::object(uint32_t number) const {
+  PdfValue value;
+  for (size_t i = _objectCount; i-- > 0;) {
+    if (_objects[i].number == number) {
+      value.start = skipSpace(_objects[i].start, _objects[i].limit);
+      value.limit = _objects[i].limit;
+      break;
+    }
+  }
+  return value;
+}
+
+PdfValue PdfDocument::resolve(PdfValue value) const {
+  for (uint8_t i = 0; i < 4 && value.valid(); i++) {
+    const uint8_t* p = value.start;
+    uint32_t number = 0;
+    if (!readReference(p, value.limit, number)) {
+      return value;
+    }
+    value = object(number);
+  }
+  return value;
+}
+
+// Stream data after a dictionary, by its /Length, or up to endstream when
+// that is missing or wrong
+bool PdfDocument::streamData(PdfValue object, const uint8_t*& data, size_t& length) const {
+  if (!object.isDict()) {
+    return false;
+  }
+  const uint8_t* p = skipValue(object.start, object.limit);
+  if (p == nullptr) {
+    return false;
+  }
+  p = skipSpace(p, object.limit);
+  if (!isToken(p, object.limit, "stream")) {
+    return false;
+  }
+  p += 6;
+  if (p < object.limit && *p == '\r') {
+    p++;
+  }
+  if (p < object.limit && *p == '\n') {
+    p++;
+  }
+  long declared = -1;
+  if (_objects != nullptr) {
+    get(object, "Length").integer(declared);
+  } else {
+    dictEntry(object, "Length").integer(declared);
+  }
+  if (declared >= 0 && declared <= object.limit - p) {
+    const uint8_t* after = skipSpace(p + declared, object.limit);
+    if (isToken(after, object.limit, "endstream")) {
+      data = p;
+      length = declared;
+      return true;
+    }
+  }
+  const uint8_t* endstream = findBytes(p, object.limit, "endstream");
+  if (endstream == nullptr) {
+    return false;
+  }
+  const uint8_t* last = endstream;
+  if (last > p && last[-1] == '\n') {
+    last--;
+  }
+  if (last > p && last[-1] == '\r') {
+    last--;
+  }
+  data = p;
+  length = last - p;
+  return true;
+}
+
+// Objects are found by their "N G obj" headers rather than through the
+// xref table, which survives the broken offsets some generators write and
+// handles xref streams the same way. Stream data is skipped over. Objects
+// of object streams are added after that, unless defined directly.
+PdfResult PdfDocument::indexObjects() {
+  const uint8_t* header = findBytes(_data, _end - _data > 1024 ? _data + 1024 : _end, "%PDF-");
+  if (header == nullptr) {
+    return fail(PDF_INVALID, "no %PDF header");
+  }
+  _objects = (PdfObject*)pdfAlloc(PDF_MAX_OBJECTS * sizeof(PdfObject));
+  if (_objects == nullptr) {
+    return PDF_NO_MEMORY;
+  }
+  PdfObject* objects = _objects;
+  _objects = nullptr;  // Not resolvable until the scan is over
+
+  const uint8_t* p = header;
+  const uint8_t* hit = nullptr;
+  size_t count = 0;
+  while ((hit = findBytes(p, _end, "obj")) != nullptr) {
+    p = hit + 3;
+    if (tokenEnd(p, _end) != p) {
+      continue;
+    }
+    // Walk back over "N G "
+    const uint8_t* q = hit;
+    if (q == _data || !isSpace(q[-1])) {
+      continue;
+    }
+    while (q > _data && isSpace(q[-1])) {
+      q--;
+    }
+    const uint8_t* generationEnd = q;
+    while (q > _data && isDigit(q[-1])) {
+      q--;
+    }
+    if (q == generationEnd || q == _data || !isSpace(q[-1])) {
+      continue;
+    }
+    while (q > _data && isSpace(q[-1])) {
+      q--;
+    }
+    const uint8_t* numberEnd = q;
+    while (q > _data && isDigit(q[-1])) {
+      q--;
+    }
+    if (q == numberEnd || (q > _data && !isSpace(q[-1]) && !isDelimiter(q[-1]))) {
+      continue;
+    }
+    uint32_t number = 0;
+    if (!readInteger(q, numberEnd, number)) {
+      continue;
+    }
+    if (count == PDF_MAX_OBJECTS) {
+      heapFree(objects);
+      return fail(PDF_TOO_LARGE, "more than " + String(PDF_MAX_OBJECTS) + " objects");
+    }
+    objects[count].number = number;
+    objects[count].start = p;
+    objects[count].limit = _end;
+    count++;
+
+    // Binary stream data could hold anything that looks like a header
+    PdfValue value;
+    value.start = skipSpace(p, _end);
+    value.limit = _end;
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    if (streamData(value, data, length)) {
+      p = data + length;
+    }
+  }
+  _objects = objects;
+  _objectCount = count;
+  if (count == 0) {
+    return fail(PDF_INVALID, "no objects");
+  }
+
+  const size_t direct = _objectCount;
+  for (size_t i = 0; i < direct; i++) {
+    PdfValue value;
+    value.start = skipSpace(_objects[i].start, _objects[i].limit);
+    value.limit = _objects[i].limit;
+    if (value.isDict() && dictEntry(value, "Type").isName("ObjStm")) {
+      PdfResult result = indexObjectStream(value);
+      if (result != PDF_OK) {
+        return result;
+      }
+    }
+  }
+  return PDF_OK;
+}
+
+PdfResult PdfDocument::indexObjectStream(PdfValue stream) {
+  if (_objectStreamCount == MAX_OBJECT_STREAMS) {
+    return fail(PDF_TOO_LARGE, "more than " + String(MAX_OBJECT_STREAMS) + " object streams");
+  }
+  long count = 0;
+  long first = 0;
+  if (!get(stream, "N").integer(count) || !get(stream, "First").integer(first) || count < 0 || first < 0) {
+    return fail(PDF_INVALID, "object stream header");
+  }
+  PdfBuffer buffer(PDF_MAX_BYTES);
+  PdfResult result = decodeStream(stream, buffer, "object stream");
+  if (result != PDF_OK) {
+    return result;
+  }
+  if ((size_t)first > buffer.length) {
+    return fail(PDF_INVALID, "object stream header");
+  }
+  const size_t length = buffer.length;
+  uint8_t* data = buffer.release();
+  _objectStreams[_objectStreamCount++] = data;
+
+  const uint8_t* end = data + length;
+  const uint8_t* p = data;
+  for (long i = 0; i < count; i++) {
+    uint32_t number = 0;
+    uint32_t offset = 0;
+    p = skipSpace(p, end);
+    if (!readInteger(p, end, number)) {
+      return fail(PDF_INVALID, "object stream header");
+    }
+    p = skipSpace(p, end);
+    if (!readInteger(p, end, offset) || offset > length - first) {
+      return fail(PDF_INVALID, "object stream header");
+    }
+    if (!object(number).valid() && !addObject(number, data + first + offset, end)) {
+      return fail(PDF_TOO_LARGE, "more than " + String(PDF_MAX_OBJECTS) + " objects");
+    }
+  }
+  return PDF_OK;
+}
+
+// Data of a content or object stream, unfiltered or FlateDecode
+PdfResult PdfDocument::decodeStream(PdfValue object, PdfBuffer& out, const char* what) {
+  const uint8_t* data = nullptr;
+  size_t length = 0;
+  if (!streamData(object, data, length)) {
+    return fail(PDF_INVALID, String(what) + " without data");
+  }
+  PdfValue filter = get(object, "Filter");
+  if (arrayLength(filter) > 1) {
+    return fail(PDF_UNSUPPORTED, String(what) + " with several filters");
+  }
+  filter = resolve(arrayItem(filter, 0));
+  if (!filter.valid()) {
+    if (!out.append(data, length)) {
+      return out.full ? fail(PDF_TOO_LARGE, what) : PDF_NO_MEMORY;
+    }
+    return PDF_OK;
+  }
+  if (!filter.isName("FlateDecode")) {
+    return fail(PDF_UNSUPPORTED, String(what) + " filter " + filter.name());
+  }
+  long predictor = 1;
+  get(resolve(arrayItem(get(object, "DecodeParms"), 0)), "Predictor").integer(predictor);
+  if (predictor > 1) {
+    return fail(PDF_UNSUPPORTED, String(what) + " predictor");
+  }
+
+  InflateStream inflater;
+  if (!inflater.begin(true, bufferOutput, &out)) {
+    return PDF_NO_MEMORY;
+  }
+  // A stream cut short of its final block still gives what it has
+  if (inflater.feed(data, length) == INFLATE_ERROR) {
+    if (out.full) {
+      return fail(PDF_TOO_LARGE, what);
+    }
+    return out.noMemory ? PDF_NO_MEMORY : fail(PDF_INVALID, String(what) + " data");
+  }
+  return PDF_OK;
+}
+
+// Pages in order, with /Resources and /Rotate inherited down the tree
+PdfResult PdfDocument::walkPages(PdfValue node, PdfValue resources, int rotate, uint8_t depth) {
+  if (!node.isDict() || depth > MAX_NESTING) {
+    return fail(PDF_INVALID, "page tree");
+  }
+  PdfValue own = get(node, "Resources");
+  if (own.isDict()) {
+    resources = own;
+  }
+  long angle = 0;
+  if (get(node, "Rotate").integer(angle)) {
+    rotate = (int)angle;
+  }
+
+  PdfValue kids = get(node, "Kids");
+  if (!get(node, "Type").isName("Page") && kids.isArray()) {
+    for (size_t i = 0;; i++) {
+      PdfValue kid = arrayItem(kids, i);
+      if (!kid.valid()) {
+        return PDF_OK;
+      }
+      PdfResult result = walkPages(resolve(kid), resources, rotate, depth + 1);
+      if (result != PDF_OK) {
+        return result;
+      }
+    }
+  }
+
+  if (_pages == PDF_MAX_PAGES) {
+    return fail(PDF_TOO_LARGE, "more than " + String(PDF_MAX_PAGES) + " pages");
+  }
+  PdfResult result = printPage(node, resources, rotate);
+  if (result != PDF_OK) {
+    _detail = "page " + String(_pages + 1) + ": " + _detail;
+    return result;
+  }
+  _pages++;
+  return PDF_OK;
+}
+
+// Components of a colour space: a device space, an ICC profile of one,
+// or a name from the page's /ColorSpace resources
+bool PdfDocument::components(PdfValue space, PdfValue resources, uint8_t& count, uint8_t depth) const {
+  if (depth > 2) {
+    return false;
+  }
+  if (space.isArray()) {
+    PdfValue family = resolve(arrayItem(space, 0));
+    if (family.isName("ICCBased")) {
+      long n = 0;
+      if (!get(resolve(arrayItem(space, 1)), "N").integer(n) || (n != 1 && n != 3)) {
+        return false;
+      }
+      count = (uint8_t)n;
+      return true;
+    }
+    if (family.isName("CalGray") || family.isName("CalRGB")) {
+      space = family;
+    } else {
+      return false;
+    }
+  }
+  if (space.isName("DeviceGray") || space.isName("CalGray") || space.isName("G")) {
+    count = 1;
+    return true;
+  }
+  if (space.isName("DeviceRGB") || space.isName("CalRGB") || space.isName("RGB")) {
+    count = 3;
+    return true;
+  }
+  if (space.isName()) {
+    String name = space.name();
+    PdfValue named = get(get(resources, "ColorSpace"), name.c_str());
+    return named.valid() && components(named, resources, count, depth + 1);
+  }
+  return false;
+}
+
+// The content stream has to come down to a single image and what paints
+// nothing: graphics state, clipping, white fills, marked content. The CTM
+// in force at its Do places the image.
+PdfResult PdfDocument::findImage(const PdfBuffer& content, PdfValue resources, PdfValue& image, float* matrix) {
+  float stack[MAX_GRAPHICS_STATES][6];
+  uint8_t depth = 0;
+  float ctm[6] = {1, 0, 0, 1, 0, 0};
+  float operands[6];
+  uint8_t operandCount = 0;
+  PdfValue lastName;
+  bool fillWhite = false;
+  bool strokeWhite = false;
+
+  const uint8_t* p = content.data;
+  const uint8_t* end = content.data + content.length;
+  while (true) {
+    p = skipSpace(p, end);
+    if (p >= end) {
+      break;
+    }
+    uint8_t c = *p;
+    if (c == '/') {
+      lastName.start = p;
+      lastName.limit = end;
+      p = tokenEnd(p + 1, end);
+      continue;
+    }
+    if (c == '(' || c == '<' || c == '[') {
+      p = skipValue(p, end);
+      if (p == nullptr) {
+        return fail(PDF_INVALID, "content stream");
+      }
+      continue;
+    }
+    float value = 0;
+    if (isDigit(c) || c == '-' || c == '+' || c == '.') {
+      if (!readNumber(p, end, value)) {
+        return fail(PDF_INVALID, "content stream");
+      }
+      if (operandCount == 6) {
+        memmove(operands, operands + 1, 5 * sizeof(float));
+        operandCount--;
+      }
+      operands[operandCount++] = value;
+      continue;
+    }
+    const uint8_t* op = p;
+    p = tokenEnd(p, end);
+    if (p == op) {
+      return fail(PDF_INVALID, "content stream");
+    }
+    size_t n = p - op;
+    auto is = [op, n](const char* word) { return strlen(word) == n && memcmp(op, word, n) == 0; };
+
+    if (is("q")) {
+      if (depth == MAX_GRAPHICS_STATES) {
+        return fail(PDF_UNSUPPORTED, "graphics states nested too deep");
+      }
+      memcpy(stack[depth++], ctm, sizeof(ctm));
+    } else if (is("Q")) {
+      if (depth > 0) {
+        memcpy(ctm, stack[--depth], sizeof(ctm));
+      }
+    } else if (is("cm") && operandCount == 6) {
+      const float* m = operands;
+      float t[6] = {
+        m[0] * ctm[0] + m[1] * ctm[2], m[0] * ctm[1] + m[1] * ctm[3],
+        m[2] * ctm[0] + m[3] * ctm[2], m[2] * ctm[1] + m[3] * ctm[3],
+        m[4] * ctm[0] + m[5] * ctm[2] + ctm[4], m[4] * ctm[1] + m[5] * ctm[3] + ctm[5]
+      };
+      memcpy(ctm, t, sizeof(ctm));
+    } else if (is("g") || is("rg") || is("k") || is("sc") || is("scn")) {
+      bool white = operandCount > 0;
+      bool cmyk = is("k") || (operandCount == 4 && !is("rg"));
+      for (uint8_t i = 0; i < operandCount; i++) {
+        white = white && (cmyk ? operands[i] <= 0.01f : operands[i] >= 0.99f);
+      }
+      fillWhite = white;
+    } else if (is("G") || is("RG") || is("K") || is("SC") || is("SCN")) {
+      bool white = operandCount > 0;
+      bool cmyk = is("K") || (operandCount == 4 && !is("RG"));
+      for (uint8_t i = 0; i < operandCount; i++) {
+        white = white && (cmyk ? operands[i] <= 0.01f : operands[i] >= 0.99f);
+      }
+      strokeWhite = white;
+    } else if (is("cs")) {
+      fillWhite = false;
+    } else if (is("CS")) {
+      strokeWhite = false;
+    } else if (is("f") || is("F") || is("f*")) {
+      if (!fillWhite) {
+        return fail(PDF_UNSUPPORTED, "vector graphics");
+      }
+    } else if (is("S") || is("s")) {
+      if (!strokeWhite) {
+        return fail(PDF_UNSUPPORTED, "vector graphics");
+      }
+    } else if (is("B") || is("B*") || is("b") || is("b*")) {
+      if (!fillWhite || !strokeWhite) {
+        return fail(PDF_UNSUPPORTED, "vector graphics");
+      }
+    } else if (is("Tj") || is("TJ") || is("'") || is("\"")) {
+      return fail(PDF_UNSUPPORTED, "text");
+    } else if (is("BI")) {
+      return fail(PDF_UNSUPPORTED, "inline image");
+    } else if (is("sh")) {
+      return fail(PDF_UNSUPPORTED, "shading");
+    } else if (is("Do")) {
+      String name = lastName.name();
+      PdfValue xobject = get(get(resources, "XObject"), name.c_str());
+      if (!xobject.isDict()) {
+        return fail(PDF_INVALID, "missing XObject " + name);
+      }
+      PdfValue subtype = get(xobject, "Subtype");
+      if (subtype.isName("Form")) {
+        return fail(PDF_UNSUPPORTED, "form XObject " + name);
+      }
+      if (!subtype.isName("Image")) {
+        return fail(PDF_UNSUPPORTED, "XObject " + name);
+      }
+      if (image.valid()) {
+        return fail(PDF_UNSUPPORTED, "more than one image");
+      }
+      image = xobject;
+      memcpy(matrix, ctm, sizeof(ctm));
+    }
+    // Anything else sets state that doesn't change the image: paths,
+    // clipping, line style, text state, marked content
+    operandCount = 0;
+  }
+  if (!image.valid()) {
+    return fail(PDF_UNSUPPORTED, "no image");
+  }
+  return PDF_OK;
+}
+
+PdfResult PdfDocument::printPage(PdfValue page, PdfValue resources, int rotate) {
+  PdfBuffer content(PDF_MAX_CONTENT);
+  PdfValue contents = get(page, "Contents");
+  for (size_t i = 0;; i++) {
+    PdfValue stream = resolve(arrayItem(contents, i));
+    if (!stream.valid()) {
+      break;
+    }
+    PdfResult result = decodeStream(stream, content, "content stream");
+    if (result != PDF_OK) {
+      return result;
+    }
+    // Content streams of a page join at token boundaries
+    if (!content.append((const uint8_t*)"\n", 1)) {
+      return content.full ? fail(PDF_TOO_LARGE, "content stream") : PDF_NO_MEMORY;
+    }
+  }
+
+  PdfValue image;
+  float matrix[6];
+  PdfResult result = findImage(content, resources, image, matrix);
+  if (result != PDF_OK) {
+    return result;
+  }
+  PdfBitmap bitmap;
+  result = decodeImage(image, resources, bitmap);
+  if (result != PDF_OK) {
+    return result;
+  }
+  return emitLabel(bitmap, matrix, rotate);
+}
+
+PdfResult PdfDocument::decodeImage(PdfValue image, PdfValue resources, PdfBitmap& bitmap) {
+  long width = 0;
+  long height = 0;
+  if (!get(image, "Width").integer(width) || !get(image, "Height").integer(height) ||
+      width <= 0 || height <= 0) {
+    return fail(PDF_INVALID, "image size");
+  }
+  if (width > PDF_MAX_IMAGE_DOTS || height > PDF_MAX_IMAGE_DOTS) {
+    return fail(PDF_TOO_LARGE, "image of " + String(width) + "x" + String(height));
+  }
+
+  bool mask = get(image, "ImageMask").boolean(false);
+  long bits = 1;
+  uint8_t count = 1;
+  if (!mask) {
+    if (!get(image, "BitsPerComponent").integer(bits) ||
+        !components(get(image, "ColorSpace"), resources, count)) {
+      return fail(PDF_UNSUPPORTED, "colour space");
+    }
+  }
+  if (!((bits == 1 && count == 1) || bits == 8)) {
+    return fail(PDF_UNSUPPORTED, String(bits) + "-bit image");
+  }
+  float low = 0;
+  float high = 1;
+  PdfValue decode = get(image, "Decode");
+  bool inverted = resolve(arrayItem(decode, 0)).number(low) && resolve(arrayItem(decode, 1)).number(high) &&
+                  low > high;
+
+  const uint8_t* data = nullptr;
+  size_t length = 0;
+  if (!streamData(image, data, length)) {
+    return fail(PDF_INVALID, "image without data");
+  }
+
+  bitmap.width = (uint16_t)width;
+  bitmap.height = (uint16_t)height;
+  bitmap.widthBytes = (width + 7) / 8;
+  bitmap.bits = (uint8_t*)pdfAlloc(bitmap.widthBytes * bitmap.height);
+  if (bitmap.bits == nullptr) {
+    return PDF_NO_MEMORY;
+  }
+  memset(bitmap.bits, 0, bitmap.widthBytes * bitmap.height);
+
+  PdfValue filters = get(image, "Filter");
+  if (arrayLength(filters) > 1) {
+    return fail(PDF_UNSUPPORTED, "image with several filters");
+  }
+  PdfValue filter = resolve(arrayItem(filters, 0));
+  PdfValue parms = resolve(arrayItem(get(image, "DecodeParms"), 0));
+  if (filter.isName("CCITTFaxDecode") || filter.isName("CCF")) {
+    if (bits != 1) {
+      return fail(PDF_INVALID, "fax image of " + String(bits) + " bits");
+    }
+    return decodeFax(parms, data, length, inverted, bitmap);
+  }
+
+  ImageRows rows = {};
+  rows.bitmap = &bitmap;
+  rows.components = count;
+  rows.bitsPerComponent = (uint8_t)bits;
+  rows.inverted = inverted;
+  rows.rowBytes = (width * count * bits + 7) / 8;
+  rows.pixelBytes = bits == 8 ? count : 1;
+
+  if (!filter.valid()) {
+    if (length < rows.rowBytes * bitmap.height) {
+      return fail(PDF_INVALID, "image data too short");
+    }
+    for (uint16_t y = 0; y < bitmap.height; y++) {
+      storeRow(rows, data + y * rows.rowBytes);
+    }
+    return PDF_OK;
+  }
+  if (!filter.isName("FlateDecode") && !filter.isName("Fl")) {
+    return fail(PDF_UNSUPPORTED, filter.isName("DCTDecode") ? String("JPEG image") : "image filter " + filter.name());
+  }
+
+  long predictor = 1;
+  get(parms, "Predictor").integer(predictor);
+  if (predictor >= 10) {
+    rows.predicted = true;
+  } else if (predictor > 1) {
+    return fail(PDF_UNSUPPORTED, "TIFF predictor");
+  }
+  rows.scan = (uint8_t*)pdfAlloc(rows.rowBytes + 1);
+  rows.prev = (uint8_t*)pdfAlloc(rows.rowBytes);
+  PdfResult result = PDF_OK;
+  InflateStream inflater;
+  if (rows.scan == nullptr || rows.prev == nullptr || !inflater.begin(true, imageRowsOutput, &rows)) {
+    result = PDF_NO_MEMORY;
+  } else {
+    memset(rows.prev, 0, rows.rowBytes);
+    if (inflater.feed(data, length) == INFLATE_ERROR || rows.row < bitmap.height) {
+      result = fail(PDF_INVALID, rows.badPredictor ? "image predictor" : "image data");
+    }
+  }
+  heapFree(rows.scan);
+  heapFree(rows.prev);
+  return result;
+}
+
+PdfResult PdfDocument::decodeFax(PdfValue parms, const uint8_t* data, size_t length, bool inverted,
+                                 PdfBitmap& bitmap) {
+  long k = 0;
+  long columns = 1728;
+  get(parms, "K").integer(k);
+  get(parms, "Columns").integer(columns);
+  if (k >= 0) {
+    return fail(PDF_UNSUPPORTED, "CCITT group 3 image");
+  }
+  if (get(parms, "EncodedByteAlign").boolean(false)) {
+    return fail(PDF_UNSUPPORTED, "byte-aligned CCITT image");
+  }
+  if (columns != bitmap.width) {
+    return fail(PDF_INVALID, "CCITT columns differ from the image width");
+  }
+  // The filter gives 0 for black unless BlackIs1; ink is where the image
+  // sample is 0, or 1 with Decode [1 0]
+  const bool flip = get(parms, "BlackIs1").boolean(false) != inverted;
+
+  G4Decoder decoder;
+  if (!decoder.begin(data, length, (uint16_t)columns)) {
+    return PDF_NO_MEMORY;
+  }
+  for (uint16_t y = 0; y < bitmap.height; y++) {
+    uint8_t* row = bitmap.bits + y * bitmap.widthBytes;
+    G4Status status = decoder.row(row);
+    if (status == G4_END) {
+      // Rows the encoder left out are paper
+      if (flip) {
+        memset(row, 0xFF, (bitmap.height - y) * bitmap.widthBytes);
+        for (; y < bitmap.height; y++) {
+          bitmap.trimRow(bitmap.bits + y * bitmap.widthBytes);
+        }
+      }
+      break;
+    }
+    if (status == G4_ERROR) {
+      return fail(PDF_INVALID, "CCITT data at row " + String(y));
+    }
+    if (flip) {
+      for (size_t i = 0; i < bitmap.widthBytes; i++) {
+        row[i] = ~row[i];
+      }
+      bitmap.trimRow(row);
+    }
+  }
+  return PDF_OK;
+}
+
+// Turn the image the way it shows on the page, then as asked or a quarter
+// turn when it is landscape, and scale it to the width of the paper
+PdfResult PdfDocument::emitLabel(const PdfBitmap& bitmap, const float* matrix, int rotate) {
+  // Image columns run along (a, b) in user space and its rows down along
+  // (-c, -d); y points down on the paper
+  const float axes[2][2] = {{matrix[0], -matrix[1]}, {-matrix[2], matrix[3]}};
+  Axis snapped[2];
+  for (uint8_t i = 0; i < 2; i++) {
+    float x = axes[i][0];
+    float y = axes[i][1];
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    if (ax < 1e-6f && ay < 1e-6f) {
+      return fail(PDF_INVALID, "image placed with no size");
+    }
+    if ((ax < ay ? ax : ay) > 0.02f * (ax > ay ? ax : ay)) {
+      return fail(PDF_UNSUPPORTED, "image rotated by an odd angle");
+    }
+    snapped[i].x = ax >= ay ? (x > 0 ? 1 : -1) : 0;
+    snapped[i].y = ax >= ay ? 0 : (y > 0 ? 1 : -1);
+  }
+  if ((snapped[0].x != 0) == (snapped[1].x != 0)) {
+    return fail(PDF_UNSUPPORTED, "skewed image");
+  }
+
+  int page = ((rotate % 360) + 360) % 360;
+  const uint8_t pageQuarters = page % 90 == 0 ? page / 90 : 0;
+  Axis columnAxis = turn(snapped[0], pageQuarters);
+  Axis rowAxis = turn(snapped[1], pageQuarters);
+  uint8_t quarters = 0;
+  if (_options.rotate >= 0) {
+    quarters = (uint8_t)((_options.rotate / 90) & 3);
+  } else {
+    bool transposed = columnAxis.x == 0;
+    uint16_t shownWidth = transposed ? bitmap.height : bitmap.width;
+    uint16_t shownHeight = transposed ? bitmap.width : bitmap.height;
+    quarters = shownWidth > shownHeight ? 1 : 0;
+  }
+  columnAxis = turn(columnAxis, quarters);
+  rowAxis = turn(rowAxis, quarters);
+
+  // Label position (u, v) to image position: columns run across the label
+  // unless transposed, each axis possibly mirrored
+  const bool transposed = columnAxis.x == 0;
+  const bool mirrorU = transposed ? rowAxis.x < 0 : columnAxis.x < 0;
+  const bool mirrorV = transposed ? columnAxis.y < 0 : rowAxis.y < 0;
+  const uint16_t labelWidth = transposed ? bitmap.height : bitmap.width;
+  const uint16_t labelHeight = transposed ? bitmap.width : bitmap.height;
+
+  uint32_t outWidth = _options.width != 0 ? _options.width : labelWidth;
+  if (outWidth > IMAGE_MAX_WIDTH) {
+    outWidth = IMAGE_MAX_WIDTH;
+  }
+  uint32_t outHeight = ((uint32_t)labelHeight * outWidth + labelWidth / 2) / labelWidth;
+  if (outHeight == 0) {
+    outHeight = 1;
+  }
+  if (outHeight > UINT16_MAX) {
+    return fail(PDF_TOO_LARGE, "label of " + String(outHeight) + " rows");
+  }
+
+  const size_t outBytes = (outWidth + 7) / 8;
+  uint8_t* row = (uint8_t*)pdfAlloc(outBytes);
+  uint16_t* columnMap = (uint16_t*)pdfAlloc(outWidth * sizeof(uint16_t));
+  if (row == nullptr || columnMap == nullptr) {
+    heapFree(row);
+    heapFree(columnMap);
+    return PDF_NO_MEMORY;
+  }
+  for (uint32_t x = 0; x < outWidth; x++) {
+    uint16_t u = (uint16_t)(x * labelWidth / outWidth);
+    columnMap[x] = mirrorU ? labelWidth - 1 - u : u;
+  }
+
+  PdfResult result = PDF_OK;
+  RasterCommandWriter writer;
+  if (!writer.begin(_options.raster, (uint16_t)outWidth, (uint16_t)outHeight, _output, _context)) {
+    result = writer.outputFailed() ? PDF_OUTPUT : PDF_NO_MEMORY;
+  }
+  for (uint32_t y = 0; result == PDF_OK && y < outHeight; y++) {
+    uint16_t v = (uint16_t)(y * labelHeight / outHeight);
+    if (mirrorV) {
+      v = labelHeight - 1 - v;
+    }
+    memset(row, 0, outBytes);
+    for (uint32_t x = 0; x < outWidth; x++) {
+      uint16_t u = columnMap[x];
+      if (transposed ? bitmap.pixel(v, u) : bitmap.pixel(u, v)) {
+        row[x >> 3] |= 0x80 >> (x & 7);
+      }
+    }
+    if (!writer.row(row)) {
+      result = PDF_OUTPUT;
+    }
+  }
+  writer.end();
+  heapFree(row);
+  heapFree(columnMap);
+  return result;
+}
+
+PdfResult PdfDocument::print() {
+  PdfResult result = indexObjects();
+  if (result != PDF_OK) {
+    return result;
+  }
+  const uint8_t* encrypt = findBytes(_data, _end, "/Encrypt");
+  if (encrypt != nullptr && tokenEnd(encrypt + 8, _end) == encrypt + 8) {
+    return fail(PDF_UNSUPPORTED, "encrypted");
+  }
+
+  // The trailer or xref stream names the catalog; looking for it directly
+  // serves both, and an update's catalog comes last
+  PdfValue catalog;
+  for (size_t i = 0; i < _objectCount; i++) {
+    PdfValue value;
+    value.start = skipSpace(_objects[i].start, _objects[i].limit);
+    value.limit = _objects[i].limit;
+    if (value.isDict() && dictEntry(value, "Type").isName("Catalog")) {
+      catalog = value;
+    }
+  }
+  if (!catalog.valid()) {
+    return fail(PDF_INVALID, "no catalog");
+  }
+  result = walkPages(get(catalog, "Pages"), PdfValue(), 0, 0);
+  if (result == PDF_OK && _pages == 0) {
+    return fail(PDF_INVALID, "no pages");
+  }
+  return result;
+}
+
+PdfResult printPdfLabel(const uint8_t* pdf, size_t length, const PdfLabelOptions& options,
+                        ImageOutput output, void* context, uint16_t& pages, String& detail) {
+  pages = 0;
+  if (length > PDF_MAX_BYTES) {
+    return PDF_TOO_LARGE;
+  }
+  PdfDocument document(pdf, length, options, output, context, detail);
+  PdfResult result = document.print();
+  pages = document.pages();
+  return result;
+}
@@ -0,0 +1,125 @@
+#include "power_profile.h"
+
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_idf_version.h>
+#include <sdkconfig.h>
+#include <driver/gpio.h>
+#include <atomic>
+
+// One beacon interval is 100 TU of 1.024 ms on nearly every access point
+static const uint32_t BEACON_INTERVAL_MS = 102;
+
+static const esp_pm_lock_type_t LOCK_TYPES[POWER_USERS] = {
+  ESP_PM_CPU_FREQ_MAX, ESP_PM_APB_FREQ_MAX, ESP_PM_CPU_FREQ_MAX
+};
+static const char* const LOCK_NAMES[POWER_USERS] = { "writer", "display", "ingest" };
+
+// Null while the clock is fixed
+static esp_pm_lock_handle_t locks[POWER_USERS] = {};
+static std::atomic<bool> ingestHeld(false);
+static volatile uint32_t lastIngest = 0;
+
+static void createLocks() {
+  for (uint8_t i = 0; i < POWER_USERS; i++) {
+    esp_err_t err = esp_pm_lock_create(LOCK_TYPES[i], 0, LOCK_NAMES[i], &locks[i]);
+    if (err != ESP_OK) {
+      log_w("PM lock %s: %s", LOCK_NAMES[i], esp_err_to_name(err));
+      locks[i] = nullptr;
+    }
+  }
+}
+
+void initPowerProfile(uint8_t wakePin) {
+  if (!POWER_SAVE && !POWER_SCALING) {
+    return;
+  }
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t config = {};
+#elif CONFIG_IDF_TARGET_ESP32
+  esp_pm_config_esp32_t config = {};
+#else
+  esp_pm_config_esp32s3_t config = {};
+#endif
+  config.max_freq_mhz = getCpuFrequencyMhz();
+  config.min_freq_mhz = POWER_MIN_CPU_MHZ;
+  config.light_sleep_enable = POWER_SAVE;
+  esp_err_t err = esp_pm_configure(&config);
+  if (err != ESP_OK && config.light_sleep_enable) {
+    // Frameworks built without tickless idle still scale the clock
+    config.light_sleep_enable = false;
+    err = esp_pm_configure(&config);
+    log_w("Light sleep not available, CPU scaling %s", err == ESP_OK ? "only" : esp_err_to_name(err));
+  } else if (err != ESP_OK) {
+    log_w("CPU scaling not available: %s", esp_err_to_name(err));
+  } else if (POWER_SAVE) {
+    log_i("Power save: %u-%u MHz, light sleep, wake latency %u ms", config.min_freq_mhz, config.max_freq_mhz,
+          POWER_WAKE_LATENCY_MS);
+  } else {
+    log_i("CPU scaling: %u-%u MHz", config.min_freq_mhz, config.max_freq_mhz);
+  }
+  // Without scaling there is nothing to hold
+  if (err == ESP_OK) {
+    createLocks();
+  }
+
+  if (POWER_SAVE) {
+    // The button is active low
+    gpio_wakeup_enable((gpio_num_t)wakePin, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+  }
+}
+
+void powerHold(PowerUser user) {
+  if (locks[user] != nullptr) {
+    esp_pm_lock_acquire(locks[user]);
+  }
+}
+
+void powerRelease(PowerUser user) {
+  if (locks[user] != nullptr) {
+    esp_pm_lock_release(locks[user]);
+  }
+}
+
+void powerIngestActive() {
+  lastIngest = millis();
+  if (!ingestHeld.exchange(true)) {
+    powerHold(POWER_INGEST);
+  }
+}
+
+void servicePowerProfile() {
+  // A piece arriving right after this takes the hold again
+  if (ingestHeld && millis() - lastIngest >= POWER_INGEST_HOLD_MS && ingestHeld.exchange(false)) {
+    powerRelease(POWER_INGEST);
+  }
+}
+
+uint16_t wifiListenInterval() {
+  if (!POWER_SAVE) {
+    return 0;
+  }
+  uint32_t beacons = POWER_WAKE_LATENCY_MS / BEACON_INTERVAL_MS;
+  return beacons > 1 ? beacons : 0;
+}
+
+void applyWifiPowerSave() {
+  // BLE coexistence needs modem sleep, so the default already wakes for
+  // every DTIM; the battery profile may sleep through several
+  wifi_ps_type_t mode = wifiListenInterval() > 0 ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM;
+  esp_err_t err = esp_wifi_set_ps(mode);
+  if (err != ESP_OK) {
+    log_w("Wi-Fi power save: %s", esp_err_to_name(err));
+  }
+}
+
+uint32_t idleIntervalMs(uint32_t activeMs, bool idle) {
+  if (!POWER_SAVE || !idle) {
+    return activeMs;
+  }
+  return POWER_WAKE_LATENCY_MS > activeMs ? POWER_WAKE_LATENCY_MS : activeMs;
+}
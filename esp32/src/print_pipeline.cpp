@@ -0,0 +1,112 @@
+#include "print_pipeline.h"
+
+#include <Arduino.h>
+
+static const char* const STAGE_NAMES[PIPELINE_STAGE_KINDS] = {"resample", "recode", "send"};
+
+const char* pipelineStageName(PipelineStage stage) {
+  return stage < PIPELINE_STAGE_KINDS ? STAGE_NAMES[stage] : "unknown";
+}
+
+bool parsePipeline(const char* text, uint8_t* chain, uint8_t& length) {
+  length = 0;
+  if (strcmp(text, "none") == 0) {
+    return true;
+  }
+  bool seen[PIPELINE_STAGE_KINDS] = {};
+  while (*text != '\0') {
+    const char* end = strchr(text, ',');
+    size_t nameLength = end != nullptr ? (size_t)(end - text) : strlen(text);
+    uint8_t stage = 0;
+    while (stage < PIPELINE_STAGE_KINDS &&
+           (strlen(STAGE_NAMES[stage]) != nameLength || strncmp(STAGE_NAMES[stage], text, nameLength) != 0)) {
+      stage++;
+    }
+    if (stage == PIPELINE_STAGE_KINDS || seen[stage] || length == PIPELINE_MAX_STAGES) {
+      return false;
+    }
+    // Nothing comes after the link
+    if (length > 0 && chain[length - 1] == STAGE_SEND) {
+      return false;
+    }
+    seen[stage] = true;
+    chain[length++] = stage;
+    if (end == nullptr) {
+      break;
+    }
+    text = end + 1;
+    if (*text == '\0') {
+      return false;
+    }
+  }
+  return length > 0;
+}
+
+PrintPipeline::PrintPipeline() {
+  for (uint8_t stage = 0; stage < PIPELINE_STAGE_KINDS; stage++) {
+    _links[stage] = {this, (PipelineStage)stage};
+  }
+  configure(nullptr, 0);
+}
+
+void PrintPipeline::setStage(PipelineStage stage, PrintSink process, void* context) {
+  _process[stage] = process;
+  _context[stage] = context;
+}
+
+void PrintPipeline::configure(const uint8_t* chain, uint8_t length) {
+  if (length > PIPELINE_MAX_STAGES) {
+    length = PIPELINE_MAX_STAGES;
+  }
+  memset(_position, length, sizeof(_position));
+  for (uint8_t i = 0; i < length; i++) {
+    _chain[i] = chain[i];
+    _position[chain[i]] = i;
+  }
+  _length = length;
+}
+
+bool PrintPipeline::forward(void* context, const PrintSlice& slice) {
+  const Link* link = (const Link*)context;
+  PrintPipeline* pipeline = link->pipeline;
+  uint8_t next = pipeline->_position[link->from] + 1;
+  if (next >= pipeline->_length) {
+    return true;
+  }
+  return pipeline->run(next, slice);
+}
+
+bool PrintPipeline::process(const PrintSlice& slice) {
+  if (_length == 0) {
+    return true;
+  }
+  if (slice.total() > 0) {
+    return run(0, slice);
+  }
+  // Each stage flushes into the next before the next is told the job ended
+  bool ok = true;
+  for (uint8_t position = 0; position < _length; position++) {
+    ok = run(position, slice) && ok;
+  }
+  return ok;
+}
+
+bool PrintPipeline::run(uint8_t position, const PrintSlice& slice) {
+  PipelineStage stage = (PipelineStage)_chain[position];
+  if (_process[stage] == nullptr) {
+    return false;
+  }
+  uint32_t nestedBefore = _nestedMicros;
+  uint32_t start = micros();
+  bool ok = _process[stage](_context[stage], slice);
+  uint32_t elapsed = micros() - start;
+
+  // What the stages downstream took was counted for them already
+  uint32_t nested = _nestedMicros - nestedBefore;
+  PipelineStageStats& stats = _stats[stage];
+  stats.micros += elapsed > nested ? elapsed - nested : 0;
+  stats.bytes += slice.total();
+  stats.slices++;
+  _nestedMicros = nestedBefore + elapsed;
+  return ok;
+}
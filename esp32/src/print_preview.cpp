@@ -0,0 +1,297 @@
+#include "print_preview.h"
+
+#include "heap_stats.h"
+#include "print_stream.h"
+
+#include <new>
+
+struct PreviewBand {
+  uint16_t width;                      // Pixels per row
+  uint8_t rows;
+  bool first;                          // Starts a new job
+  uint8_t levels[PREVIEW_BAND_ROWS][PREVIEW_WIDTH / 2];  // 4 bpp, 0 = paper
+};
+
+// Raster of the previewed job, parsed in its printer's writer task
+struct PreviewRaster {
+  PrintStreamParser parser;
+  bool skip;                           // Block too wide to preview
+  size_t rowBytes;
+  size_t byteInRow;
+  uint16_t dots;                       // Width of the block
+  uint16_t width;                      // Of the preview rows
+  uint32_t sourceRow;                  // Rows of the job so far
+  uint16_t outRow;                     // Preview row the source rows go into
+  uint8_t rowsIn;                      // Source rows summed into it
+  bool dropRow;                        // No band free for it
+  bool first;
+  uint16_t sums[PREVIEW_WIDTH];
+};
+
+static const uint8_t NO_OWNER = 0xFF;
+static const uint8_t GREY_LEVELS = 16;
+
+static PreviewBand* bands = nullptr;
+static QueueHandle_t freeBands = nullptr;
+static QueueHandle_t readyBands = nullptr;
+static void (*bandReady)() = nullptr;
+static PreviewRaster* raster = nullptr;
+static int8_t openBand = -1;           // Being filled by the owner
+
+static portMUX_TYPE ownerMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint8_t owner = NO_OWNER;
+static volatile uint32_t endedAt = 0;
+static bool inJob[MAX_PRINTERS] = {};
+
+// Display task side
+static TFT_eSprite* sprite = nullptr;
+static bool showing = false;
+
+bool initPrintPreview(void (*notify)()) {
+  if (!PRINT_PREVIEW) {
+    return true;
+  }
+  bands = (PreviewBand*)heapAlloc(HEAP_SITE_PREVIEW, sizeof(PreviewBand) * PREVIEW_BANDS);
+  raster = (PreviewRaster*)heapAlloc(HEAP_SITE_PREVIEW, sizeof(PreviewRaster));
+  freeBands = xQueueCreate(PREVIEW_BANDS, sizeof(uint8_t));
+  readyBands = xQueueCreate(PREVIEW_BANDS, sizeof(uint8_t));
+  if (!bands || !raster || !freeBands || !readyBands) {
+    log_e("No memory for the print preview");
+    bands = nullptr;
+    return false;
+  }
+  for (uint8_t i = 0; i < PREVIEW_BANDS; i++) {
+    xQueueSend(freeBands, &i, 0);
+  }
+  bandReady = notify;
+  return true;
+}
+
+static void sendBand() {
+  if (openBand < 0) {
+    return;
+  }
+  uint8_t index = openBand;
+  openBand = -1;
+  if (bands[index].rows == 0) {
+    xQueueSend(freeBands, &index, 0);
+    return;
+  }
+  xQueueSend(readyBands, &index, 0);
+  if (bandReady) {
+    bandReady();
+  }
+}
+
+// Start of a preview row: find it a band, or drop it
+static void startRow() {
+  PreviewRaster& r = *raster;
+  memset(r.sums, 0, sizeof(r.sums));
+  r.rowsIn = 0;
+  if (openBand < 0) {
+    uint8_t index;
+    if (xQueueReceive(freeBands, &index, 0) != pdTRUE) {
+      r.dropRow = true;
+      return;
+    }
+    openBand = index;
+    bands[index].rows = 0;
+    bands[index].width = r.width;
+    bands[index].first = r.first;
+    r.first = false;
+  }
+  r.dropRow = false;
+}
+
+// Box filter: average the dots summed into each pixel
+static void finishRow() {
+  PreviewRaster& r = *raster;
+  if (r.dropRow || r.rowsIn == 0 || openBand < 0) {
+    return;
+  }
+  PreviewBand& band = bands[openBand];
+  if (band.width != r.width) {
+    sendBand();
+    return;
+  }
+  uint8_t* out = band.levels[band.rows];
+  memset(out, 0, PREVIEW_WIDTH / 2);
+  for (uint16_t x = 0; x < r.width; x++) {
+    // Dots that fall into pixel x
+    uint32_t span = ((uint32_t)(x + 1) * r.dots + r.width - 1) / r.width - ((uint32_t)x * r.dots + r.width - 1) / r.width;
+    uint32_t area = span * r.rowsIn;
+    uint8_t level = area ? (r.sums[x] * (GREY_LEVELS - 1) + area / 2) / area : 0;
+    out[x / 2] |= (x & 1) ? level : level << 4;
+  }
+  if (++band.rows == PREVIEW_BAND_ROWS) {
+    sendBand();
+  }
+}
+
+static void beginBlock(const PrintCommandArgs& args) {
+  PreviewRaster& r = *raster;
+  r.rowBytes = args.width;
+  r.byteInRow = 0;
+  r.skip = r.rowBytes == 0 || r.rowBytes * 8 > PREVIEW_MAX_DOTS;
+  if (r.skip) {
+    return;
+  }
+  uint16_t dots = r.rowBytes * 8;
+  if (dots != r.dots) {
+    // New width: the rows so far end where they are
+    finishRow();
+    r.dots = dots;
+    r.width = dots < PREVIEW_WIDTH ? dots : PREVIEW_WIDTH;
+    r.sourceRow = 0;
+    r.outRow = 0;
+    startRow();
+  }
+}
+
+static void rasterByte(uint8_t b) {
+  PreviewRaster& r = *raster;
+  if (!r.dropRow && b != 0) {
+    uint32_t dot = r.byteInRow * 8;
+    for (uint8_t bit = 0; bit < 8; bit++, dot++) {
+      if (b & (0x80 >> bit)) {
+        r.sums[dot * r.width / r.dots]++;
+      }
+    }
+  }
+  if (++r.byteInRow < r.rowBytes) {
+    return;
+  }
+
+  // Source row done; the same scale down the page
+  r.byteInRow = 0;
+  r.rowsIn++;
+  r.sourceRow++;
+  uint16_t next = (uint32_t)r.sourceRow * r.width / r.dots;
+  if (next != r.outRow) {
+    finishRow();
+    r.outRow = next;
+    startRow();
+  }
+}
+
+// Only GS v 0 rasters are drawn; everything else in the job is passed over
+static bool previewEvent(void* context, const PrintEvent& event) {
+  if (event.command != PRINT_CMD_RASTER) {
+    return true;
+  }
+  if (event.type == PRINT_EVENT_COMMAND) {
+    beginBlock(*event.args);
+  } else if (event.type == PRINT_EVENT_DATA && !raster->skip) {
+    for (size_t i = 0; i < event.length; i++) {
+      rasterByte(event.data[i]);
+    }
+  }
+  return true;
+}
+
+void previewJobData(uint8_t printer, const PrintSlice& slice) {
+  if (!bands || printer >= MAX_PRINTERS) {
+    return;
+  }
+
+  if (slice.total() == 0) {
+    inJob[printer] = false;
+    if (owner == printer) {
+      raster->parser.finish();
+      finishRow();
+      sendBand();
+      endedAt = millis();
+      owner = NO_OWNER;
+      if (bandReady) {
+        bandReady();
+      }
+    }
+    return;
+  }
+
+  if (!inJob[printer]) {
+    // A job is previewed whole or not at all
+    inJob[printer] = true;
+    portENTER_CRITICAL(&ownerMux);
+    bool claimed = owner == NO_OWNER;
+    if (claimed) {
+      owner = printer;
+    }
+    portEXIT_CRITICAL(&ownerMux);
+    if (claimed) {
+      new (raster) PreviewRaster();
+      raster->parser.begin(PRINT_DIALECT_AUTO, previewEvent, nullptr);
+      raster->first = true;
+      raster->dropRow = true;
+    }
+  }
+  if (owner != printer) {
+    return;
+  }
+
+  raster->parser.feed(slice);
+}
+
+static bool createSprite(TFT_eSPI* tft) {
+  sprite = new TFT_eSprite(tft);
+  sprite->setColorDepth(4);
+  sprite->setSpriteMemory(TFT_eSprite::SPRITE_MEM_PSRAM);
+  if (!sprite->createSprite(tft->width(), tft->height())) {
+    log_w("No memory for the preview sprite");
+    delete sprite;
+    sprite = nullptr;
+    return false;
+  }
+  // Paper white to ink black
+  uint16_t palette[GREY_LEVELS];
+  for (uint8_t i = 0; i < GREY_LEVELS; i++) {
+    uint8_t grey = 255 - i * 17;
+    palette[i] = tft->color565(grey, grey, grey);
+  }
+  sprite->createPalette(palette, GREY_LEVELS);
+  sprite->setScrollRect(0, 0, tft->width(), tft->height(), 0);
+  return true;
+}
+
+bool servicePrintPreview(TFT_eSPI* tft) {
+  if (!bands) {
+    return false;
+  }
+
+  uint8_t index;
+  bool drew = false;
+  while (xQueueReceive(readyBands, &index, 0) == pdTRUE) {
+    if (sprite || createSprite(tft)) {
+      const PreviewBand& band = bands[index];
+      if (band.first) {
+        sprite->fillSprite(0);
+      }
+      // New rows come in at the bottom, like paper out of the printer
+      int16_t top = sprite->height() - band.rows;
+      int16_t left = (sprite->width() - band.width) / 2;
+      sprite->scroll(0, -band.rows);
+      // Thousands of pixels a band, so they skip the Sprite's per pixel checks
+      TFT_eCanvas<4> canvas(*sprite);
+      for (uint8_t row = 0; row < band.rows; row++) {
+        for (uint16_t x = 0; x < band.width; x++) {
+          uint8_t packed = band.levels[row][x / 2];
+          uint8_t level = (x & 1) ? packed & 0x0F : packed >> 4;
+          if (level) {
+            canvas.drawPixel(left + x, top + row, level);
+          }
+        }
+      }
+      drew = true;
+      showing = true;
+    }
+    xQueueSend(freeBands, &index, 0);
+  }
+  if (drew) {
+    sprite->pushSprite(0, 0);
+  }
+
+  if (showing && owner == NO_OWNER && millis() - endedAt >= PREVIEW_HOLD_MS) {
+    showing = false;
+  }
+  return showing;
+}
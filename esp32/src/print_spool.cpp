@@ -0,0 +1,600 @@
+#include "print_spool.h"
+#include "print_writer.h"
+#include "heap_stats.h"
+#include "stall_watch.h"
+#include "power_profile.h"
+
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+
+// Read from flash and appended to the job per step
+static const size_t SPOOL_CHUNK = 4096;
+static const uint32_t SPOOL_MAGIC = 0x4C4F5053;  // "SPOL"
+
+// Written after the command stream; a file without a valid one is cut short
+struct SpoolTrailer {
+  uint32_t magic;
+  uint32_t length;
+  uint32_t crc;
+  uint8_t printer;
+  uint8_t pool;
+  uint8_t reserved[2];
+};
+
+struct SpoolEntry {
+  bool used;
+  uint32_t id;
+  uint8_t printer;
+  uint8_t pool;
+  size_t length;
+  uint32_t crc;
+  uint32_t jobId;    // Print job of the current attempt
+  uint8_t failures;
+  uint8_t* ram;      // The job in the PSRAM tier, nullptr once it is on flash
+  uint32_t since;    // millis() it was spooled
+  bool printed;      // Done; its file waits to be removed
+};
+
+static SpoolEntry entries[PRINT_SPOOL_JOBS];
+static uint32_t nextId = 1;
+static size_t reservedBytes = 0;  // Uploads still being written
+static SemaphoreHandle_t spoolLock = nullptr;
+static TaskHandle_t spoolTaskHandle = nullptr;
+static PrintSpoolTarget spoolTarget = nullptr;
+static uint8_t spoolBuffer[SPOOL_CHUNK];
+
+static String spoolPath(uint32_t id, const char* suffix) {
+  char name[32];
+  snprintf(name, sizeof(name), PRINT_SPOOL_DIR "/%08x%s", id, suffix);
+  return String(name);
+}
+
+// Flash taken or promised. Caller holds spoolLock.
+static size_t spooledBytes() {
+  size_t bytes = reservedBytes;
+  for (size_t i = 0; i < PRINT_SPOOL_JOBS; i++) {
+    if (entries[i].used && entries[i].ram == nullptr) {
+      bytes += entries[i].length + sizeof(SpoolTrailer);
+    }
+  }
+  return bytes;
+}
+
+// Caller holds spoolLock
+static SpoolEntry* findEntry(uint32_t id) {
+  for (size_t i = 0; i < PRINT_SPOOL_JOBS; i++) {
+    if (entries[i].used && !entries[i].printed && entries[i].id == id) {
+      return &entries[i];
+    }
+  }
+  return nullptr;
+}
+
+// Caller holds spoolLock
+static SpoolEntry* freeEntry() {
+  for (size_t i = 0; i < PRINT_SPOOL_JOBS; i++) {
+    if (!entries[i].used) {
+      return &entries[i];
+    }
+  }
+  return nullptr;
+}
+
+// A job in PSRAM goes at once; a file is left to trimPrinted()
+static void removeEntry(uint32_t id) {
+  xSemaphoreTake(spoolLock, portMAX_DELAY);
+  SpoolEntry* entry = findEntry(id);
+  uint8_t* ram = nullptr;
+  if (entry != nullptr) {
+    ram = entry->ram;
+    entry->ram = nullptr;
+    entry->printed = ram == nullptr;
+    entry->used = ram == nullptr;
+  }
+  xSemaphoreGive(spoolLock);
+  heapFree(ram);
+}
+
+// Remove the files of the jobs that are done. Only the spool task does,
+// between jobs.
+static void trimPrinted() {
+  for (size_t i = 0; i < PRINT_SPOOL_JOBS; i++) {
+    xSemaphoreTake(spoolLock, portMAX_DELAY);
+    bool printed = entries[i].used && entries[i].printed;
+    uint32_t id = entries[i].id;
+    xSemaphoreGive(spoolLock);
+    if (!printed) {
+      continue;
+    }
+    LittleFS.remove(spoolPath(id, ".job"));
+    xSemaphoreTake(spoolLock, portMAX_DELAY);
+    entries[i].used = false;
+    xSemaphoreGive(spoolLock);
+  }
+}
+
+// Write a job of the PSRAM tier to its file, a segment per write, and
+// free its memory. Only the spool task does, for a job with no attempt
+// running. False, leaving it in PSRAM, when there is no room on flash.
+static bool moveToFlash(const SpoolEntry& entry) {
+  const size_t reserve = entry.length + sizeof(SpoolTrailer);
+  xSemaphoreTake(spoolLock, portMAX_DELAY);
+  bool room = spooledBytes() + reserve <= PRINT_SPOOL_BUDGET;
+  if (room) {
+    reservedBytes += reserve;
+  }
+  xSemaphoreGive(spoolLock);
+  if (!room) {
+    return false;
+  }
+
+  String path = spoolPath(entry.id, ".tmp");
+  File file = LittleFS.open(path, "w");
+  bool written = (bool)file;
+  for (size_t done = 0; written && done < entry.length; done += PRINT_SPOOL_SEGMENT) {
+    size_t n = entry.length - done < PRINT_SPOOL_SEGMENT ? entry.length - done : PRINT_SPOOL_SEGMENT;
+    STALL_SECTION("spool flush");
+    written = file.write(entry.ram + done, n) == n;
+  }
+  SpoolTrailer trailer = {SPOOL_MAGIC, (uint32_t)entry.length, entry.crc, entry.printer, entry.pool, {0, 0}};
+  written = written && file.write((const uint8_t*)&trailer, sizeof(trailer)) == sizeof(trailer);
+  if (file) {
+    file.close();
+  }
+  written = written && LittleFS.rename(path, spoolPath(entry.id, ".job"));
+  if (!written) {
+    LittleFS.remove(path);
+  }
+
+  xSemaphoreTake(spoolLock, portMAX_DELAY);
+  reservedBytes -= reserve;
+  SpoolEntry* current = written ? findEntry(entry.id) : nullptr;
+  uint8_t* ram = nullptr;
+  if (current != nullptr) {
+    ram = current->ram;
+    current->ram = nullptr;
+  }
+  xSemaphoreGive(spoolLock);
+  heapFree(ram);
+  if (written) {
+    log_i("Spooled job %u moved to flash, %u bytes", entry.id, entry.length);
+  } else {
+    log_w("Spooled job %u could not be moved to flash", entry.id);
+  }
+  return written;
+}
+
+// CRC of the first length bytes of a file, from where it stands
+static bool fileCrc(File& file, size_t length, uint32_t& crc) {
+  crc = 0;
+  size_t done = 0;
+  while (done < length) {
+    size_t chunk = length - done < SPOOL_CHUNK ? length - done : SPOOL_CHUNK;
+    if (file.read(spoolBuffer, chunk) != chunk) {
+      return false;
+    }
+    crc = esp_rom_crc32_le(crc, spoolBuffer, chunk);
+    done += chunk;
+  }
+  return true;
+}
+
+// Copy a job of the PSRAM tier into its print job
+static void sendFromRam(const SpoolEntry& entry, uint32_t jobId) {
+  if (appendPrintJobWait(jobId, entry.ram, entry.length)) {
+    finishPrintJob(jobId);
+  }
+}
+
+// Copy a spooled job into its print job. Data that no longer matches its
+// CRC fails the job before it is finished.
+static void sendEntry(const SpoolEntry& entry, uint32_t jobId) {
+  if (entry.ram != nullptr) {
+    sendFromRam(entry, jobId);
+    return;
+  }
+  File file = LittleFS.open(spoolPath(entry.id, ".job"), "r");
+  if (!file) {
+    abortPrintJob(jobId);
+    return;
+  }
+  uint32_t crc = 0;
+  size_t done = 0;
+  while (done < entry.length) {
+    size_t chunk = entry.length - done < SPOOL_CHUNK ? entry.length - done : SPOOL_CHUNK;
+    if (file.read(spoolBuffer, chunk) != chunk) {
+      break;
+    }
+    crc = esp_rom_crc32_le(crc, spoolBuffer, chunk);
+    if (!appendPrintJobWait(jobId, spoolBuffer, chunk)) {
+      file.close();
+      return;
+    }
+    done += chunk;
+  }
+  file.close();
+
+  if (done < entry.length || crc != entry.crc) {
+    log_e("Spooled job %u is corrupt, dropped", entry.id);
+    abortPrintJob(jobId);
+    removeEntry(entry.id);
+    return;
+  }
+  finishPrintJob(jobId);
+}
+
+// A print job of the entry ended, or vanished. Done jobs leave the spool;
+// failed ones wait for their next attempt.
+static void checkAttempt(const SpoolEntry& entry) {
+  PrintJobInfo info;
+  bool known = getPrintJob(entry.jobId, info);
+  if (known && info.state != JOB_DONE && info.state != JOB_FAILED) {
+    return;
+  }
+  if (known && info.state == JOB_DONE) {
+    log_i("Spooled job %u printed as job %u", entry.id, entry.jobId);
+    removeEntry(entry.id);
+    return;
+  }
+
+  // Only failures with the printer still there count; a dropped link is
+  // what the spool is for
+  uint8_t printer = entry.printer;
+  bool counted = known && spoolTarget(entry.pool, printer);
+  xSemaphoreTake(spoolLock, portMAX_DELAY);
+  SpoolEntry* current = findEntry(entry.id);
+  uint8_t failures = 0;
+  if (current != nullptr) {
+    current->jobId = 0;
+    current->failures += counted ? 1 : 0;
+    failures = current->failures;
+  }
+  xSemaphoreGive(spoolLock);
+
+  if (failures >= PRINT_SPOOL_ATTEMPTS) {
+    log_e("Spooled job %u failed %u times, dropped", entry.id, failures);
+    removeEntry(entry.id);
+  } else {
+    log_w("Spooled job %u: job %u failed, will retry", entry.id, entry.jobId);
+  }
+}
+
+// Oldest first; a printer's jobs go out one after another, so a later one
+// never overtakes a job waiting for the reconnect
+static void spoolTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  static SpoolEntry pending[PRINT_SPOOL_JOBS];
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PRINT_SPOOL_POLL_MS));
+
+    xSemaphoreTake(spoolLock, portMAX_DELAY);
+    size_t count = 0;
+    for (size_t i = 0; i < PRINT_SPOOL_JOBS; i++) {
+      if (entries[i].used && !entries[i].printed) {
+        size_t at = count++;
+        while (at > 0 && pending[at - 1].id > entries[i].id) {
+          pending[at] = pending[at - 1];
+          at--;
+        }
+        pending[at] = entries[i];
+      }
+    }
+    xSemaphoreGive(spoolLock);
+
+    bool busy[MAX_PRINTERS] = {};
+    bool sending = false;
+    const SpoolEntry* waiting = nullptr;  // Oldest job in PSRAM that can't go now
+    for (size_t i = 0; i < count; i++) {
+      SpoolEntry& entry = pending[i];
+      if (entry.jobId != 0) {
+        sending = true;
+      }
+      if (entry.printer >= MAX_PRINTERS || busy[entry.printer]) {
+        if (entry.jobId == 0 && entry.ram != nullptr && waiting == nullptr) {
+          waiting = &entry;
+        }
+        continue;
+      }
+      busy[entry.printer] = true;
+      if (entry.jobId != 0) {
+        checkAttempt(entry);
+        continue;
+      }
+
+      uint8_t printer = entry.printer;
+      if (!spoolTarget(entry.pool, printer)) {
+        if (entry.ram != nullptr && waiting == nullptr) {
+          waiting = &entry;
+        }
+        continue;
+      }
+      PrintJobReject reject = JOB_ACCEPTED;
+      uint32_t jobId = createPrintJob(printer, entry.length, reject, entry.pool);
+      if (jobId == 0) {
+        continue;
+      }
+      sending = true;
+      xSemaphoreTake(spoolLock, portMAX_DELAY);
+      SpoolEntry* current = findEntry(entry.id);
+      if (current != nullptr) {
+        current->jobId = jobId;
+      }
+      xSemaphoreGive(spoolLock);
+      log_i("Spooled job %u sent as job %u, %u bytes", entry.id, jobId, entry.length);
+      sendEntry(entry, jobId);
+    }
+
+    // A job waits in PSRAM until its printer has been away long enough to
+    // be worth a reboot's worth of durability, or the tier runs short
+    if (waiting != nullptr) {
+      const size_t quota = heapSiteQuota(HEAP_SITE_SPOOL);
+      bool pressure = quota != 0 && heapSiteBytes(HEAP_SITE_SPOOL) * 100 > quota * PRINT_SPOOL_PRESSURE;
+      if (pressure || millis() - waiting->since >= PRINT_SPOOL_FLUSH_MS) {
+        moveToFlash(*waiting);
+      }
+    }
+    if (!sending) {
+      trimPrinted();
+    }
+  }
+}
+
+// Index one file of the spool directory, removing leftovers
+static void indexFile(File& file) {
+  String name = file.name();
+  String path = String(PRINT_SPOOL_DIR) + "/" + name;
+  SpoolTrailer trailer = {};
+  size_t size = file.size();
+  uint32_t id = strtoul(name.c_str(), nullptr, 16);
+  bool valid = name.endsWith(".job") && id != 0 && size >= sizeof(trailer) &&
+               file.seek(size - sizeof(trailer)) &&
+               file.read((uint8_t*)&trailer, sizeof(trailer)) == sizeof(trailer) &&
+               trailer.magic == SPOOL_MAGIC && trailer.length == size - sizeof(trailer);
+  uint32_t crc = 0;
+  valid = valid && file.seek(0) && fileCrc(file, trailer.length, crc) && crc == trailer.crc;
+  file.close();
+
+  SpoolEntry* entry = valid && findEntry(id) == nullptr ? freeEntry() : nullptr;
+  if (entry == nullptr) {
+    log_w("Spool: removing %s", name.c_str());
+    LittleFS.remove(path);
+    return;
+  }
+  *entry = {true, id, trailer.printer, trailer.pool, trailer.length, trailer.crc, 0, 0, nullptr, (uint32_t)millis(), false};
+  nextId = id >= nextId ? id + 1 : nextId;
+}
+
+bool initPrintSpool(PrintSpoolTarget target) {
+  if (PRINT_SPOOL_BUDGET == 0) {
+    log_i("Print spool disabled");
+    return true;
+  }
+  spoolTarget = target;
+  spoolLock = xSemaphoreCreateMutex();
+  if (spoolLock == nullptr) {
+    log_e("Print spool: out of memory");
+    return false;
+  }
+
+  if (!LittleFS.exists(PRINT_SPOOL_DIR)) {
+    LittleFS.mkdir(PRINT_SPOOL_DIR);
+  }
+  File dir = LittleFS.open(PRINT_SPOOL_DIR);
+  if (dir && dir.isDirectory()) {
+    for (File file = dir.openNextFile(); file; file = dir.openNextFile()) {
+      indexFile(file);
+    }
+    dir.close();
+  }
+
+  xSemaphoreTake(spoolLock, portMAX_DELAY);
+  size_t count = 0;
+  for (size_t i = 0; i < PRINT_SPOOL_JOBS; i++) {
+    count += entries[i].used;
+  }
+  log_i("Print spool: %u jobs waiting, %u of %u bytes", count, spooledBytes(), PRINT_SPOOL_BUDGET);
+  xSemaphoreGive(spoolLock);
+
+  if (xTaskCreatePinnedToCore(spoolTask, "printSpool", 4096, nullptr, PRINT_SPOOL_PRIORITY, &spoolTaskHandle,
+                              PRINT_SPOOL_CORE) != pdPASS) {
+    log_e("Failed to start print spool task");
+    return false;
+  }
+  return true;
+}
+
+void wakePrintSpool() {
+  if (spoolTaskHandle != nullptr) {
+    xTaskNotifyGive(spoolTaskHandle);
+  }
+}
+
+size_t getSpooledJobs(PrintSpoolInfo* out, size_t max) {
+  if (spoolLock == nullptr) {
+    return 0;
+  }
+  size_t count = 0;
+  xSemaphoreTake(spoolLock, portMAX_DELAY);
+  for (size_t i = 0; i < PRINT_SPOOL_JOBS; i++) {
+    const SpoolEntry& entry = entries[i];
+    if (!entry.used || entry.printed) {
+      continue;
+    }
+    // Insert by ID, keeping the oldest max
+    size_t at = count < max ? count++ : max;
+    while (at > 0 && out[at - 1].id > entry.id) {
+      if (at < max) {
+        out[at] = out[at - 1];
+      }
+      at--;
+    }
+    if (at < max) {
+      out[at] = {entry.id, entry.printer, entry.length, entry.jobId, entry.failures, entry.ram == nullptr};
+    }
+  }
+  xSemaphoreGive(spoolLock);
+  return count;
+}
+
+PrintSpoolWriter::~PrintSpoolWriter() {
+  discard();
+}
+
+bool PrintSpoolWriter::begin(uint8_t printer, uint8_t pool, size_t total) {
+  discard();
+  if (spoolLock == nullptr) {
+    return false;
+  }
+
+  // The PSRAM tier takes any job its budget has room for
+  uint8_t* ram = total > 0 && psramFound() ? (uint8_t*)heapAlloc(HEAP_SITE_SPOOL, total) : nullptr;
+  size_t reserve = ram != nullptr ? total : total + sizeof(SpoolTrailer);
+  xSemaphoreTake(spoolLock, portMAX_DELAY);
+  size_t waiting = 0;
+  for (size_t i = 0; i < PRINT_SPOOL_JOBS; i++) {
+    waiting += entries[i].used;
+  }
+  bool room = waiting < PRINT_SPOOL_JOBS && (ram != nullptr || spooledBytes() + reserve <= PRINT_SPOOL_BUDGET);
+  if (room) {
+    reservedBytes += ram != nullptr ? 0 : reserve;
+    _id = nextId++;
+  }
+  xSemaphoreGive(spoolLock);
+  if (!room) {
+    heapFree(ram);
+    log_w("Print spool full, %u bytes not spooled", total);
+    return false;
+  }
+
+  _reserved = reserve;
+  _ram = ram;
+  _active = true;
+  _printer = printer;
+  _pool = pool;
+  _length = 0;
+  _crc = 0;
+  if (_ram != nullptr) {
+    return true;
+  }
+  _file = LittleFS.open(spoolPath(_id, ".tmp"), "w");
+  if (!_file) {
+    discard();
+    return false;
+  }
+  // Without a segment buffer every piece is written as it comes
+  _segment = (uint8_t*)heapAlloc(HEAP_SITE_SPOOL, PRINT_SPOOL_SEGMENT);
+  _segmentFill = 0;
+  return true;
+}
+
+bool PrintSpoolWriter::flushSegment() {
+  if (_segmentFill == 0) {
+    return true;
+  }
+  STALL_SECTION("spool write");
+  bool written = _file.write(_segment, _segmentFill) == _segmentFill;
+  _segmentFill = 0;
+  return written;
+}
+
+bool PrintSpoolWriter::write(const uint8_t* data, size_t length) {
+  powerIngestActive();
+  if (!_active) {
+    return false;
+  }
+  if (_ram != nullptr) {
+    if (_length + length > _reserved) {
+      log_e("Spool write failed after %u bytes", _length);
+      discard();
+      return false;
+    }
+    memcpy(_ram + _length, data, length);
+  } else {
+    bool written = _length + length + sizeof(SpoolTrailer) <= _reserved;
+    size_t done = 0;
+    while (written && done < length) {
+      if (_segment == nullptr) {
+        STALL_SECTION("spool write");
+        written = _file.write(data, length) == length;
+        break;
+      }
+      size_t n = PRINT_SPOOL_SEGMENT - _segmentFill < length - done ? PRINT_SPOOL_SEGMENT - _segmentFill
+                                                                     : length - done;
+      memcpy(_segment + _segmentFill, data + done, n);
+      _segmentFill += n;
+      done += n;
+      if (_segmentFill == PRINT_SPOOL_SEGMENT) {
+        written = flushSegment();
+      }
+    }
+    if (!written) {
+      log_e("Spool write failed after %u bytes", _length);
+      discard();
+      return false;
+    }
+  }
+  _crc = esp_rom_crc32_le(_crc, data, length);
+  _length += length;
+  return true;
+}
+
+uint32_t PrintSpoolWriter::commit(uint32_t jobId) {
+  if (!_active) {
+    return 0;
+  }
+  bool written = true;
+  if (_ram == nullptr) {
+    SpoolTrailer trailer = {SPOOL_MAGIC, (uint32_t)_length, _crc, _printer, _pool, {0, 0}};
+    written = flushSegment() && _file.write((const uint8_t*)&trailer, sizeof(trailer)) == sizeof(trailer);
+    _file.close();
+    heapFree(_segment);
+    _segment = nullptr;
+    String path = spoolPath(_id, ".tmp");
+    if (!written || !LittleFS.rename(path, spoolPath(_id, ".job"))) {
+      LittleFS.remove(path);
+      written = false;
+    }
+  }
+
+  xSemaphoreTake(spoolLock, portMAX_DELAY);
+  reservedBytes -= _ram != nullptr ? 0 : _reserved;
+  SpoolEntry* entry = written ? freeEntry() : nullptr;
+  if (entry != nullptr) {
+    *entry = {true, _id, _printer, _pool, _length, _crc, jobId, 0, _ram, (uint32_t)millis(), false};
+    _ram = nullptr;
+  }
+  xSemaphoreGive(spoolLock);
+  _active = false;
+
+  if (entry == nullptr) {
+    heapFree(_ram);
+    _ram = nullptr;
+    LittleFS.remove(spoolPath(_id, ".job"));
+    return 0;
+  }
+  log_i("Spooled job %u, %u bytes, %s", _id, _length, entry->ram != nullptr ? "in PSRAM" : "on flash");
+  // The printer may have connected during the upload
+  if (jobId == 0) {
+    wakePrintSpool();
+  }
+  return _id;
+}
+
+void PrintSpoolWriter::discard() {
+  if (!_active) {
+    return;
+  }
+  _active = false;
+  if (_ram != nullptr) {
+    heapFree(_ram);
+    _ram = nullptr;
+    return;
+  }
+  _file.close();
+  heapFree(_segment);
+  _segment = nullptr;
+  LittleFS.remove(spoolPath(_id, ".tmp"));
+  xSemaphoreTake(spoolLock, portMAX_DELAY);
+  reservedBytes -= _reserved;
+  xSemaphoreGive(spoolLock);
+}
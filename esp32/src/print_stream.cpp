@@ -0,0 +1,482 @@
+#include "print_stream.h"
+
+#include <string.h>
+
+static const uint8_t DLE = 0x10;
+static const uint8_t ESC = 0x1B;
+static const uint8_t FS = 0x1C;
+static const uint8_t GS = 0x1D;
+
+// First words of TSPL lines, for telling a TSPL job from ESC/POS text.
+// Matched in upper case only, as printer drivers send them, so ordinary
+// words at the start of a receipt line aren't taken for commands.
+static const char* const TSPL_KEYWORDS[] = {
+  "SIZE", "GAP", "BLINE", "OFFSET", "SPEED", "DENSITY", "DIRECTION", "REFERENCE", "SHIFT", "CODEPAGE",
+  "CLS", "FEED", "BACKFEED", "BACKUP", "FORMFEED", "HOME", "PRINT", "SOUND", "CUT", "LIMITFEED",
+  "SELFTEST", "SET", "BAR", "BOX", "CIRCLE", "ELLIPSE", "BITMAP", "PUTBMP", "PUTPCX", "TEXT", "BLOCK",
+  "BARCODE", "QRCODE", "DMATRIX", "ERASE", "REVERSE", "DOWNLOAD", "EOP", "KILL", "MOVE", "RUN",
+  "INITIALPRINTER", "EOJ"
+};
+
+static bool escposPrefix(uint8_t b) {
+  return b == ESC || b == GS || b == DLE || b == FS;
+}
+
+static bool letter(uint8_t b) {
+  return (b >= 'A' && b <= 'Z') || (b >= 'a' && b <= 'z');
+}
+
+static uint8_t upper(uint8_t b) {
+  return b >= 'a' && b <= 'z' ? b - 'a' + 'A' : b;
+}
+
+static uint16_t word(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+// Number in thousandths, with an optional TSPL unit: "58 mm", "2.25", "384 dot"
+static const uint8_t* parseNumber(const uint8_t* p, const uint8_t* end, uint32_t& milli, char& unit) {
+  while (p < end && *p == ' ') {
+    p++;
+  }
+  milli = 0;
+  uint32_t scale = 1000;
+  bool fraction = false;
+  for (; p < end && ((*p >= '0' && *p <= '9') || *p == '.'); p++) {
+    if (*p == '.') {
+      fraction = true;
+    } else if (!fraction) {
+      milli = milli * 10 + (*p - '0') * 1000;
+    } else if (scale > 1) {
+      scale /= 10;
+      milli += (*p - '0') * scale;
+    }
+  }
+  while (p < end && *p == ' ') {
+    p++;
+  }
+  unit = p < end && letter(*p) ? upper(*p) : 0;
+  while (p < end && *p != ',') {
+    p++;
+  }
+  return p < end ? p + 1 : p;
+}
+
+static uint16_t tenthsMm(uint32_t milli, char unit) {
+  switch (unit) {
+    case 'M': return milli / 100;
+    case 'D': return milli / 800;      // Dots at 203 dpi, 8 per mm
+    default: return milli * 254 / 1000;
+  }
+}
+
+void PrintStreamParser::begin(PrintDialect dialect, PrintStreamHook hook, void* context) {
+  _hook = hook;
+  _context = context;
+  _dialect = dialect;
+  _state = SCAN;
+  _lineStart = true;
+  _command = PRINT_CMD_NONE;
+  _headerLen = 0;
+  _left = 0;
+}
+
+bool PrintStreamParser::emit(PrintEventType type, const uint8_t* data, size_t length) {
+  PrintEvent event = {type, type == PRINT_EVENT_BYTES ? PRINT_CMD_NONE : _command, &_args, data, length};
+  return _hook(_context, event);
+}
+
+bool PrintStreamParser::feed(const uint8_t* data, size_t length) {
+  size_t run = 0;                    // Start of the bytes outside commands
+  size_t i = 0;
+  while (i < length) {
+    uint8_t b = data[i];
+    switch (_state) {
+      case SCAN: {
+        bool escpos = _dialect != PRINT_DIALECT_TSPL && escposPrefix(b);
+        bool tspl = _dialect != PRINT_DIALECT_ESCPOS && _lineStart && letter(b);
+        if (!escpos && !tspl) {
+          if (b == '\n') {
+            _lineStart = true;
+          } else if (b != '\r' && b != ' ' && b != '\t') {
+            _lineStart = false;
+          }
+          i++;
+          break;
+        }
+        if (i > run && !emit(PRINT_EVENT_BYTES, data + run, i - run)) {
+          return false;
+        }
+        if (escpos) {
+          _dialect = PRINT_DIALECT_ESCPOS;
+        }
+        _state = HEADER;
+        _headerLen = 0;
+        _keywordLen = 0;
+        _fieldStart = 0;
+        _commas = 0;
+        _quoted = false;
+        _named = false;
+        _command = PRINT_CMD_NONE;
+        memset(&_args, 0, sizeof(_args));
+        run = i;
+        break;
+      }
+      case HEADER:
+        i++;
+        if (!headerByte(b)) {
+          return false;
+        }
+        run = i;
+        break;
+      case PAYLOAD:
+      case TERMINATED: {
+        size_t n = length - i;
+        bool done = false;
+        if (_state == PAYLOAD && _left <= n) {
+          n = _left;
+          done = true;
+        } else if (_state == TERMINATED) {
+          const uint8_t* nul = (const uint8_t*)memchr(data + i, 0, n);
+          if (nul != nullptr) {
+            n = nul - (data + i) + 1;
+            done = true;
+          }
+        }
+        if (!emit(PRINT_EVENT_DATA, data + i, n)) {
+          return false;
+        }
+        i += n;
+        _left -= _state == PAYLOAD ? n : 0;
+        if (done) {
+          if (!emit(PRINT_EVENT_END, nullptr, 0)) {
+            return false;
+          }
+          // A TSPL command line goes on after its binary data
+          _state = _dialect == PRINT_DIALECT_TSPL ? LINE : SCAN;
+        }
+        run = i;
+        break;
+      }
+      case LINE:
+        i++;
+        if (b == '\n') {
+          _state = SCAN;
+          _lineStart = true;
+        }
+        break;
+    }
+  }
+  return run == length || emit(PRINT_EVENT_BYTES, data + run, length - run);
+}
+
+size_t PrintStreamParser::commandLeft() const {
+  switch (_state) {
+    case PAYLOAD:
+      return _left;
+    case TERMINATED:
+      return 1;
+    case HEADER:
+      return _dialect == PRINT_DIALECT_TSPL ? 0 : 1;
+    default:
+      return 0;
+  }
+}
+
+bool PrintStreamParser::finish() {
+  bool ok = true;
+  if (_state == HEADER && _headerLen > 0) {
+    ok = emit(PRINT_EVENT_BYTES, _header, _headerLen);
+  }
+  _state = SCAN;
+  _lineStart = true;
+  _headerLen = 0;
+  return ok;
+}
+
+bool PrintStreamParser::headerByte(uint8_t b) {
+  if (_headerLen == sizeof(_header)) {
+    // Too long to decode: what was collected and the rest pass as bytes
+    _command = PRINT_CMD_NONE;
+    if (!emit(PRINT_EVENT_BYTES, _header, _headerLen) || !emit(PRINT_EVENT_BYTES, &b, 1)) {
+      return false;
+    }
+    _state = _dialect == PRINT_DIALECT_TSPL && b != '\n' ? LINE : SCAN;
+    _lineStart = b == '\n';
+    return true;
+  }
+  _header[_headerLen++] = b;
+  Header result = _dialect == PRINT_DIALECT_ESCPOS ? escposHeader() : tsplHeader(b);
+
+  if (result == HEADER_MORE) {
+    return true;
+  }
+  if (result == HEADER_DONE) {
+    if (!emit(PRINT_EVENT_COMMAND, _header, _headerLen)) {
+      return false;
+    }
+    if (_state == HEADER) {
+      _state = _args.payload > 0 ? PAYLOAD : SCAN;
+      _left = _args.payload;
+    }
+    _lineStart = true;
+    if (_state == SCAN && _dialect == PRINT_DIALECT_TSPL && _header[_headerLen - 1] != '\n') {
+      _state = LINE;
+    }
+    return true;
+  }
+
+  // Not a command this parser knows. A prefix that cut it short starts
+  // the next one.
+  bool restart = _dialect == PRINT_DIALECT_ESCPOS && _headerLen > 1 && escposPrefix(b);
+  size_t length = restart ? _headerLen - 1 : _headerLen;
+  _command = PRINT_CMD_NONE;
+  if (!emit(PRINT_EVENT_BYTES, _header, length)) {
+    return false;
+  }
+  if (restart) {
+    _header[0] = b;
+    _headerLen = 1;
+    memset(&_args, 0, sizeof(_args));
+    return true;
+  }
+  _state = _dialect == PRINT_DIALECT_TSPL && b != '\n' ? LINE : SCAN;
+  _lineStart = b == '\n';
+  return true;
+}
+
+PrintStreamParser::Header PrintStreamParser::escposHeader() {
+  const uint8_t* h = _header;
+  size_t n = _headerLen;
+  if (n < 2) {
+    return HEADER_MORE;
+  }
+  uint8_t c = h[1];
+  size_t need = 0;
+  PrintCommand command = PRINT_CMD_OTHER;
+
+  switch (h[0]) {
+    case ESC:
+      switch (c) {
+        case '@': command = PRINT_CMD_INIT; need = 2; break;
+        case 'i': case 'm': command = PRINT_CMD_CUT; need = 2; break;
+        case '2': case '<': case 'S': case 'L': need = 2; break;
+        case 'J': command = PRINT_CMD_FEED; need = 3; break;
+        case 'd': command = PRINT_CMD_FEED_LINES; need = 3; break;
+        case ' ': case '!': case '%': case '-': case '3': case '=': case '?': case 'E': case 'G': case 'M':
+        case 'R': case 'T': case 'U': case 'V': case 'a': case 'e': case 'r': case 't': case '{':
+          need = 3;
+          break;
+        case '$': case '\\': case 'B': case 'c': need = 4; break;
+        case 'p': need = 5; break;
+        case 'W': need = 10; break;
+        case '*': command = PRINT_CMD_BIT_IMAGE; need = 5; break;
+        case 'D': need = 2; break;
+        default: return HEADER_UNKNOWN;
+      }
+      break;
+    case GS:
+      switch (c) {
+        case 'r': command = PRINT_CMD_STATUS; need = 3; break;
+        case '!': case 'B': case 'H': case 'h': case 'w': case 'f': case 'a': case 'b': case 'I': case 'E':
+          need = 3;
+          break;
+        case 'L': case 'W': case '$': case '\\': case 'P': case '*': need = 4; break;
+        case '(': need = 5; break;
+        case 'V':
+          command = PRINT_CMD_CUT;
+          if (n < 3) {
+            return HEADER_MORE;
+          }
+          need = h[2] >= 'A' ? 4 : 3;
+          break;
+        case 'v':
+          if (n >= 3 && h[2] != '0' && h[2] != 0) {
+            return HEADER_UNKNOWN;
+          }
+          command = PRINT_CMD_RASTER;
+          need = 8;
+          break;
+        case 'k':
+          if (n < 3) {
+            return HEADER_MORE;
+          }
+          need = h[2] <= 6 ? 3 : 4;
+          break;
+        default: return HEADER_UNKNOWN;
+      }
+      break;
+    case DLE:
+      switch (c) {
+        case 0x04: case 0x05: command = PRINT_CMD_STATUS; need = 3; break;
+        case 0x14: need = 5; break;
+        default: return HEADER_UNKNOWN;
+      }
+      break;
+    case FS:
+      switch (c) {
+        case '&': case '.': need = 2; break;
+        case '!': case '-': case 'C': need = 3; break;
+        case 'p': need = 4; break;
+        default: return HEADER_UNKNOWN;
+      }
+      break;
+    default:
+      return HEADER_UNKNOWN;
+  }
+  if (n < need) {
+    return HEADER_MORE;
+  }
+
+  _command = command;
+  switch (command) {
+    case PRINT_CMD_FEED:
+    case PRINT_CMD_FEED_LINES:
+      _args.count = h[2];
+      break;
+    case PRINT_CMD_CUT:
+      if (h[0] == GS) {
+        _args.mode = h[2];
+        _args.count = need == 4 ? h[3] : 0;
+      }
+      break;
+    case PRINT_CMD_RASTER:
+      _args.mode = h[3];
+      _args.width = word(h + 4);
+      _args.height = word(h + 6);
+      _args.payload = (uint32_t)_args.width * _args.height;
+      break;
+    case PRINT_CMD_BIT_IMAGE:
+      _args.mode = h[2];
+      _args.width = word(h + 3);
+      _args.payload = (uint32_t)_args.width * (_args.mode >= 32 ? 3 : 1);
+      break;
+    default:
+      break;
+  }
+  if (h[0] == ESC && c == 'D') {
+    _state = TERMINATED;               // Tab stops up to a NUL
+  } else if (h[0] == GS && c == 'k') {
+    if (need == 3) {
+      _state = TERMINATED;
+    } else {
+      _args.payload = h[3];
+    }
+  } else if (h[0] == GS && c == '(') {
+    _args.payload = word(h + 3);
+  } else if (h[0] == GS && c == '*') {
+    _args.payload = (uint32_t)h[2] * h[3] * 8;
+  }
+  return HEADER_DONE;
+}
+
+bool PrintStreamParser::isTsplKeyword() const {
+  for (size_t k = 0; k < sizeof(TSPL_KEYWORDS) / sizeof(TSPL_KEYWORDS[0]); k++) {
+    const char* keyword = TSPL_KEYWORDS[k];
+    size_t i = 0;
+    while (i < _keywordLen && keyword[i] != '\0' && _header[i] == (uint8_t)keyword[i]) {
+      i++;
+    }
+    if (i == _keywordLen && keyword[i] == '\0') {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether the keyword of the line is the given one
+static bool keywordIs(const uint8_t* header, size_t length, const char* keyword) {
+  size_t i = 0;
+  while (i < length && keyword[i] != '\0' && header[i] == (uint8_t)keyword[i]) {
+    i++;
+  }
+  return i == length && keyword[i] == '\0';
+}
+
+PrintStreamParser::Header PrintStreamParser::tsplHeader(uint8_t b) {
+  if (_keywordLen == _headerLen - 1) {
+    if (letter(b)) {
+      _keywordLen++;
+      return HEADER_MORE;
+    }
+    // b ends the keyword; a line of text isn't TSPL
+    bool known = isTsplKeyword();
+    if (_dialect == PRINT_DIALECT_AUTO) {
+      if (!known) {
+        _dialect = PRINT_DIALECT_ESCPOS;
+        return HEADER_UNKNOWN;
+      }
+      _dialect = PRINT_DIALECT_TSPL;
+    }
+    _fieldStart = _headerLen;
+  }
+
+  if (b == '"') {
+    _quoted = !_quoted;
+    _named |= !_quoted;
+  } else if (b == ',' && !_quoted) {
+    _commas++;
+    bool bitmap = keywordIs(_header, _keywordLen, "BITMAP");
+    bool download = keywordIs(_header, _keywordLen, "DOWNLOAD");
+    if (bitmap && _commas == 5) {
+      decodeTspl();
+      return HEADER_DONE;
+    }
+    if (download && _named) {
+      // "name",size, then the data
+      size_t digits = 0;
+      for (size_t i = _fieldStart; i < _headerLen - 1; i++) {
+        digits += _header[i] >= '0' && _header[i] <= '9';
+      }
+      if (digits > 0 && digits == _headerLen - 1 - _fieldStart) {
+        decodeTspl();
+        return HEADER_DONE;
+      }
+    }
+    _fieldStart = _headerLen;
+  } else if (b == '\n') {
+    decodeTspl();
+    return HEADER_DONE;
+  }
+  return HEADER_MORE;
+}
+
+void PrintStreamParser::decodeTspl() {
+  const uint8_t* end = _header + _headerLen;
+  const uint8_t* p = _header + _keywordLen;
+  uint32_t a = 0;
+  uint32_t b = 0;
+  char unitA = 0;
+  char unitB = 0;
+  _command = PRINT_CMD_OTHER;
+
+  if (keywordIs(_header, _keywordLen, "SIZE")) {
+    _command = PRINT_CMD_TSPL_SIZE;
+    p = parseNumber(p, end, a, unitA);
+    parseNumber(p, end, b, unitB);
+    _args.width = tenthsMm(a, unitA);
+    _args.height = tenthsMm(b, unitB);
+  } else if (keywordIs(_header, _keywordLen, "CLS")) {
+    _command = PRINT_CMD_TSPL_CLS;
+  } else if (keywordIs(_header, _keywordLen, "PRINT")) {
+    _command = PRINT_CMD_TSPL_PRINT;
+    parseNumber(p, end, a, unitA);
+    _args.count = a / 1000;
+  } else if (keywordIs(_header, _keywordLen, "BITMAP") && _header[_headerLen - 1] == ',') {
+    _command = PRINT_CMD_TSPL_BITMAP;
+    uint32_t values[5];
+    for (size_t i = 0; i < 5; i++) {
+      p = parseNumber(p, end, values[i], unitA);
+    }
+    _args.x = values[0] / 1000;
+    _args.y = values[1] / 1000;
+    _args.width = values[2] / 1000;
+    _args.height = values[3] / 1000;
+    _args.mode = values[4] / 1000;
+    _args.payload = (uint32_t)_args.width * _args.height;
+  } else if (keywordIs(_header, _keywordLen, "DOWNLOAD") && _header[_headerLen - 1] == ',') {
+    _command = PRINT_CMD_TSPL_DOWNLOAD;
+    parseNumber(_header + _fieldStart, end, a, unitA);
+    _args.payload = a / 1000;
+  }
+}
@@ -0,0 +1,1130 @@
+#include "print_writer.h"
+#include "ring_buffer.h"
+#include "print_stream.h"
+#include "hot_path.h"
+#include "heap_stats.h"
+#include "bridge_config.h"
+#include "trace.h"
+#include "power_profile.h"
+
+// Largest slice handed to the sink at once. The sink does its own MTU
+// chunking straight out of the job buffer; this only bounds how long the
+// buffer space stays reserved.
+static const size_t WRITER_SLICE_SIZE = 4096;
+// How long one append of appendPrintJobWait() may block before the job
+// state is checked again
+static const uint32_t APPEND_WAIT_TIMEOUT = 1000;
+// Drain rate assumed for a printer with nothing measured yet, in bytes/s
+static const uint32_t DEFAULT_DRAIN_RATE = 16384;
+
+struct PrintJob {
+  uint32_t id = 0;             // 0 marks a never used slot
+  uint8_t printer = 0;
+  uint8_t pool = PRINT_NO_POOL;
+  uint8_t moves = 0;           // Times the job changed printers
+  uint16_t dpi = 0;            // Resolution it was made for, 0 when unknown
+  PrintJobPriority priority = PRINT_PRIORITY_INTERACTIVE;
+  uint32_t client = 0;         // printClientKey() of where it came from
+  PrintDialect dialect = PRINT_DIALECT_AUTO; // As parsed up to where it was preempted
+  uint16_t copies = 1;
+  uint16_t copy = 0;           // Copies written in full before the current one
+  PrintJobState state = JOB_DONE;
+  size_t total = 0;
+  volatile size_t received = 0;
+  volatile size_t sent = 0;
+  volatile bool receiveComplete = false;
+  volatile bool cancelled = false; // The writer ends it before the next slice
+  RingBuffer ring;             // Released once the job has finished
+  // Timeline in ms since boot, copied into the history when the job ends
+  uint32_t created = 0;
+  volatile uint32_t firstByte = 0;
+  volatile uint32_t lastByte = 0;
+  uint32_t firstWrite = 0;
+};
+
+static PrintJob jobs[PRINT_JOB_SLOTS];
+static uint32_t nextJobId = 1;
+
+// Ring of finished job timelines; historyCount grows up to the size
+static PrintJobTimeline history[PRINT_HISTORY_SIZE];
+static size_t historyNext = 0;
+static size_t historyCount = 0;
+
+// A client with jobs pending on a printer, in its deficit round robin
+struct FairClient {
+  bool used = false;
+  uint32_t key = 0;
+  int32_t deficit = 0;         // Bytes it may still send this turn; below 0 it overshot
+  uint32_t turn = 0;           // When it last got a quantum, 0 for not yet
+};
+
+// One writer per printer, each draining only that printer's jobs
+struct PrintWriter {
+  PrintSink sink = nullptr;
+  void* context = nullptr;
+  TaskHandle_t task = nullptr;
+  volatile bool busy = false;
+  volatile bool paused = false;
+  PrintWriterStats stats = {};
+  uint32_t idleAt = 0;         // Idle report that arrived before the job was recorded
+  uint32_t lastWrite = 0;      // Last slice handed to the sink, or idle hook write
+  volatile uint16_t jobDpi = 0; // Of the job the sink is being handed
+  // Label boundaries of the job being written, as offsets into it
+  PrintStreamParser parser;
+  uint32_t parsedJob = 0;      // Job the parser is on, 0 for none
+  size_t parsed = 0;           // Bytes of it the parser has emitted
+  size_t scanned = 0;          // Bytes of it fed to the parser
+  size_t boundary = 0;         // Last safe place to hand the printer over
+  // No more clients than jobs can be pending
+  FairClient clients[PRINT_JOB_SLOTS];
+  uint32_t turns = 0;
+};
+
+static SemaphoreHandle_t jobLock = nullptr;
+static PrintWriter writers[MAX_PRINTERS];
+static SemaphoreHandle_t spaceAvailable = nullptr;
+static PrintJobReroute printReroute = nullptr;
+static PrintWriterIdle printIdle = nullptr;
+static PrintWriterRate printRate = nullptr;
+
+static bool matchesPrinter(const PrintJob& job, uint8_t printer) {
+  return printer == PRINT_ALL_PRINTERS || job.printer == printer;
+}
+
+static void notifyWriter(uint8_t printer) {
+  if (printer < MAX_PRINTERS && writers[printer].task != nullptr) {
+    xTaskNotifyGive(writers[printer].task);
+  }
+}
+
+// Job buffers count against the jobs budget, so a burst of uploads is
+// turned away before it takes the memory the rest of the bridge runs on
+static bool allocateRing(PrintJob& job, size_t size) {
+  if (!job.ring.begin(size)) {
+    return false;
+  }
+  if (!heapReserve(HEAP_SITE_JOBS, job.ring.capacity())) {
+    job.ring.end();
+    return false;
+  }
+  return true;
+}
+
+static void releaseRing(PrintJob& job) {
+  heapRelease(HEAP_SITE_JOBS, job.ring.capacity());
+  job.ring.end();
+}
+
+static bool isPending(const PrintJob& job) {
+  return job.id != 0 && (job.state == JOB_QUEUED || job.state == JOB_STREAMING);
+}
+
+// Bytes of the job that still have to reach the printer
+static size_t remaining(const PrintJob& job) {
+  size_t expected = (job.total == PRINT_JOB_LENGTH_UNKNOWN) ? job.received : job.total;
+  return expected - job.sent;
+}
+
+static PrintJob* findJob(uint32_t id) {
+  for (size_t i = 0; i < PRINT_JOB_SLOTS; i++) {
+    if (jobs[i].id == id && id != 0) {
+      return &jobs[i];
+    }
+  }
+  return nullptr;
+}
+
+// Data to print, or the end of it, has come in
+static bool hasData(const PrintJob& job) {
+  return job.received > job.sent || job.receiveComplete;
+}
+
+// Goes ahead of the other: a higher class, then the older one
+static bool precedes(const PrintJob& job, const PrintJob& other) {
+  return job.priority != other.priority ? job.priority > other.priority : job.id < other.id;
+}
+
+// The client's entry in the writer's round robin, made on first use
+static FairClient& fairClient(PrintWriter& writer, uint32_t key) {
+  FairClient* free = nullptr;
+  for (FairClient& client : writer.clients) {
+    if (client.used && client.key == key) {
+      return client;
+    }
+    if (!client.used && free == nullptr) {
+      free = &client;
+    }
+  }
+  // Entries go with a client's last pending job, so one is always free
+  *free = FairClient();
+  free->used = true;
+  free->key = key;
+  return *free;
+}
+
+// May take the printer over from the job being written, if any: while none
+// is, every pending job; otherwise that one and the jobs with data waiting
+static bool eligible(const PrintJob& job, uint8_t printer, const PrintJob* current) {
+  return job.printer == printer && isPending(job) && (current == nullptr || &job == current || hasData(job));
+}
+
+// Deficit round robin between the clients within the highest class waiting.
+// The client next in turn gets a quantum of bytes and its oldest job, and
+// one still in debt from a long label sits its turn out. Called with jobLock
+// held.
+static PrintJob* pickJob(PrintWriter& writer, uint8_t printer, PrintJob* current) {
+  int top = -1;
+  for (const PrintJob& job : jobs) {
+    if (eligible(job, printer, current) && job.priority > top) {
+      top = job.priority;
+    }
+  }
+  if (top < 0) {
+    return nullptr;
+  }
+
+  const int32_t quantum = bridgeConfig().fairQuantum;
+  if (current != nullptr && current->priority == top &&
+      (quantum == 0 || fairClient(writer, current->client).deficit > 0)) {
+    return current;
+  }
+  if (quantum != 0) {
+    // Rounds where every client is still in debt, all in one go
+    int32_t best = INT32_MIN;
+    for (const PrintJob& job : jobs) {
+      if (eligible(job, printer, current) && job.priority == top) {
+        int32_t deficit = fairClient(writer, job.client).deficit;
+        best = deficit > best ? deficit : best;
+      }
+    }
+    if (best + quantum <= 0) {
+      int32_t credit = (-best / quantum) * quantum;
+      for (FairClient& client : writer.clients) {
+        bool waiting = false;
+        for (size_t i = 0; i < PRINT_JOB_SLOTS && client.used && !waiting; i++) {
+          waiting = eligible(jobs[i], printer, current) && jobs[i].priority == top && jobs[i].client == client.key;
+        }
+        if (waiting) {
+          client.deficit += credit;
+        }
+      }
+    }
+  }
+  for (;;) {
+    PrintJob* next = nullptr;
+    FairClient* nextClient = nullptr;
+    for (PrintJob& job : jobs) {
+      if (!eligible(job, printer, current) || job.priority != top) {
+        continue;
+      }
+      FairClient& client = fairClient(writer, job.client);
+      if (next == nullptr || client.turn < nextClient->turn ||
+          (&client == nextClient && job.id < next->id)) {
+        next = &job;
+        nextClient = &client;
+      }
+    }
+    if (quantum == 0) {
+      // Off: by class and age alone
+      return next;
+    }
+    nextClient->turn = ++writer.turns;
+    nextClient->deficit += quantum;
+    if (nextClient->deficit > 0) {
+      return next;
+    }
+  }
+}
+
+// The job the printer's writer goes on with: the one it is writing until
+// that stands at a label boundary, then the pick of pickJob(). Also releases
+// the buffers of the printer's failed jobs whose upload has ended, and drops
+// the clients that have no job pending any more. Only called by that
+// printer's writer.
+static PrintJob* nextActiveJob(uint8_t printer) {
+  PrintWriter& writer = writers[printer];
+  PrintJob* current = nullptr;
+
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  for (size_t i = 0; i < PRINT_JOB_SLOTS; i++) {
+    PrintJob& job = jobs[i];
+    if (job.printer != printer) {
+      continue;
+    }
+    if (job.state == JOB_FAILED && job.receiveComplete && job.ring.capacity() != 0) {
+      releaseRing(job);
+    }
+    if (isPending(job) && job.id == writer.parsedJob) {
+      current = &job;
+    }
+  }
+  for (FairClient& client : writer.clients) {
+    bool pending = false;
+    for (size_t i = 0; i < PRINT_JOB_SLOTS && client.used && !pending; i++) {
+      pending = jobs[i].printer == printer && isPending(jobs[i]) && jobs[i].client == client.key;
+    }
+    client.used = pending;
+  }
+  PrintJob* active = current;
+  if (current == nullptr || current->sent == writer.boundary) {
+    active = pickJob(writer, printer, current);
+  }
+  xSemaphoreGive(jobLock);
+
+  return active;
+}
+
+// Another job should have the printer at the next boundary: one of a higher
+// class waits with data, or, once the client of the job being written has
+// used up its quantum, one of another client in the same class does
+static bool yieldWaiting(uint8_t printer, const PrintJob& current, bool exhausted) {
+  bool waiting = false;
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  for (size_t i = 0; i < PRINT_JOB_SLOTS && !waiting; i++) {
+    const PrintJob& job = jobs[i];
+    waiting = job.printer == printer && isPending(job) && hasData(job) &&
+              (job.priority > current.priority ||
+               (exhausted && job.priority == current.priority && job.client != current.client));
+  }
+  xSemaphoreGive(jobLock);
+  return waiting;
+}
+
+// Label boundaries: just past a cut, or past a TSPL PRINT line
+static bool boundaryEvent(void* context, const PrintEvent& event) {
+  PrintWriter* writer = (PrintWriter*)context;
+  writer->parsed += event.length;
+  if (event.type == PRINT_EVENT_COMMAND &&
+      (event.command == PRINT_CMD_CUT || event.command == PRINT_CMD_TSPL_PRINT)) {
+    writer->boundary = writer->parsed;
+  }
+  return true;
+}
+
+// Bytes from offset on of a slice, as a slice
+static PrintSlice sliceFrom(const PrintSlice& slice, size_t offset) {
+  PrintSlice rest = slice;
+  if (offset < slice.length[0]) {
+    rest.data[0] += offset;
+    rest.length[0] -= offset;
+  } else {
+    rest.data[0] = slice.data[1] + (offset - slice.length[0]);
+    rest.length[0] = slice.length[1] - (offset - slice.length[0]);
+    rest.data[1] = nullptr;
+    rest.length[1] = 0;
+  }
+  return rest;
+}
+
+// Cut a slice down to its first length bytes
+static void limitSlice(PrintSlice& slice, size_t length) {
+  if (slice.length[0] >= length) {
+    slice.length[0] = length;
+    slice.length[1] = 0;
+  } else {
+    slice.length[1] = length - slice.length[0];
+  }
+}
+
+// The writer moves on to another job. One it leaves unfinished was stopped
+// at a boundary and resumes there, parsed on in the dialect it had.
+static void switchJob(PrintWriter& writer, PrintJob* job, const PrintSlice& endOfJob) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* left = findJob(writer.parsedJob);
+  bool preempted = left != nullptr && left->printer == job->printer && isPending(*left) && left->sent > 0;
+  if (preempted) {
+    left->dialect = writer.parser.dialect();
+  }
+  xSemaphoreGive(jobLock);
+
+  if (preempted) {
+    log_i("Job %u held at %u bytes for job %u", left->id, left->sent, job->id);
+    writer.sink(writer.context, endOfJob);
+  } else if (job->sent > 0) {
+    log_i("Job %u resumed at %u bytes", job->id, job->sent);
+  }
+  writer.parsedJob = job->id;
+  writer.parser.begin(job->dialect, boundaryEvent, &writer);
+  writer.parsed = job->sent;
+  writer.scanned = job->sent;
+  writer.boundary = job->sent;
+}
+
+// The next copy of a job that was written in full: read it out of its ring
+// again, from the start, as if it had just been switched to. False when the
+// job outgrew its ring and its start has been written over.
+static bool replayJob(PrintWriter& writer, PrintJob* job) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  bool kept = job->received <= job->ring.capacity();
+  if (kept) {
+    job->ring.rewind(job->received);
+    job->sent = 0;
+    job->copy++;
+  }
+  xSemaphoreGive(jobLock);
+
+  if (!kept) {
+    log_e("Job %u of %u bytes no longer buffered for copy %u", job->id, job->received, job->copy + 2);
+    return false;
+  }
+  log_i("Job %u copy %u of %u", job->id, job->copy + 1, job->copies);
+  writer.parser.begin(job->dialect, boundaryEvent, &writer);
+  writer.parsed = 0;
+  writer.scanned = 0;
+  writer.boundary = 0;
+  return true;
+}
+
+// Called with jobLock held when the job leaves the pending states
+static void recordHistory(const PrintJob& job) {
+  PrintJobTimeline& entry = history[historyNext];
+  entry.id = job.id;
+  entry.printer = job.printer;
+  entry.state = job.state;
+  entry.bytes = job.copy * job.received + job.sent;
+  entry.created = job.created;
+  entry.firstByte = job.firstByte;
+  entry.lastByte = job.lastByte;
+  entry.firstWrite = job.firstWrite;
+  entry.lastWrite = (job.state == JOB_DONE || job.sent > 0) ? millis() : 0;
+  entry.printerIdle = (job.state == JOB_DONE) ? writers[job.printer].idleAt : 0;
+  writers[job.printer].idleAt = 0;
+
+  historyNext = (historyNext + 1) % PRINT_HISTORY_SIZE;
+  if (historyCount < PRINT_HISTORY_SIZE) {
+    historyCount++;
+  }
+}
+
+static void completeJob(PrintJob* job, bool flushed) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  job->state = (flushed && remaining(*job) == 0) ? JOB_DONE : JOB_FAILED;
+  releaseRing(*job);
+  recordHistory(*job);
+  xSemaphoreGive(jobLock);
+  TRACE_INSTANT(TRACE_JOB_DONE, job->id);
+
+  if (job->state == JOB_DONE) {
+    writers[job->printer].stats.done++;
+    log_i("Job %u done, %u bytes", job->id, job->sent);
+  } else {
+    writers[job->printer].stats.failed++;
+    log_e("Job %u failed after %u of %u bytes", job->id, job->sent, job->total);
+  }
+}
+
+// A job cancelled mid-label: blank out the rest of the command the printer
+// is in, the raster band it is printing, so it doesn't take the next job
+// for its data. Then end the label: ESC @ drops a half-built line and GS V
+// feeds it out to the cut, and for TSPL, CLS throws away the unprinted label
+// after closing the line that is open.
+static void terminateJob(PrintWriter& writer) {
+  static const uint8_t blank[256] = {};
+  static const uint8_t escposEnd[] = {0x1B, '@', 0x1D, 'V', 66, 0};
+  static const char tsplEnd[] = "\r\nCLS\r\n";
+  size_t blanked = 0;
+  for (size_t left = writer.parser.commandLeft(); left > 0; left = writer.parser.commandLeft()) {
+    PrintSlice pad = { { blank, nullptr }, { left < sizeof(blank) ? left : sizeof(blank), 0 } };
+    writer.parser.feed(pad);
+    if (!writer.sink(writer.context, pad)) {
+      return;
+    }
+    blanked += pad.length[0];
+  }
+
+  PrintSlice end = { { nullptr, nullptr }, { 0, 0 } };
+  if (writer.parser.dialect() == PRINT_DIALECT_ESCPOS) {
+    end.data[0] = escposEnd;
+    end.length[0] = sizeof(escposEnd);
+  } else if (writer.parser.dialect() == PRINT_DIALECT_TSPL) {
+    end.data[0] = (const uint8_t*)tsplEnd;
+    end.length[0] = sizeof(tsplEnd) - 1;
+  }
+  if (end.length[0] > 0) {
+    writer.sink(writer.context, end);
+  }
+  log_i("Job %u ended mid-label, %u blank bytes", writer.parsedJob, blanked);
+}
+
+// The writer's side of a failed job: drop its data and let the sink drop
+// whatever it held back
+static void failJob(PrintWriter& writer, PrintJob* job, const PrintSlice& endOfJob) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  job->state = JOB_FAILED;
+  job->ring.clear();
+  recordHistory(*job);
+  xSemaphoreGive(jobLock);
+  TRACE_INSTANT(TRACE_JOB_DONE, job->id);
+  writer.stats.failed++;
+  log_e("Job %u failed after %u of %u bytes", job->id, job->sent, job->total);
+  writer.sink(writer.context, endOfJob);
+}
+
+// Hand a pooled job that failed on its first slice to another pool member.
+// Nothing of it has been consumed yet, so the new printer gets all of it.
+static bool rerouteJob(PrintJob* job) {
+  if (job->pool == PRINT_NO_POOL || printReroute == nullptr || job->moves >= MAX_PRINTERS - 1) {
+    return false;
+  }
+  uint8_t from = job->printer;
+  uint8_t target = printReroute(job->pool, from);
+  if (target >= MAX_PRINTERS || target == from || writers[target].task == nullptr) {
+    return false;
+  }
+
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  job->printer = target;
+  job->state = JOB_QUEUED;
+  job->moves++;
+  xSemaphoreGive(jobLock);
+
+  writers[from].stats.moved++;
+  log_w("Job %u moved from printer %u to %u", job->id, from, target);
+  notifyWriter(target);
+  return true;
+}
+
+// Full CPU clock only while the writer moves data
+static void setBusy(PrintWriter& writer, bool busy) {
+  if (writer.busy != busy) {
+    busy ? powerHold(POWER_WRITER) : powerRelease(POWER_WRITER);
+  }
+  writer.busy = busy;
+}
+
+static void HOT_PATH printWriterTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  const uint8_t printer = (uint8_t)(uintptr_t)param;
+  PrintWriter& writer = writers[printer];
+  const PrintSlice endOfJob = { { nullptr, nullptr }, { 0, 0 } };
+
+  for (;;) {
+    PrintJob* job = writer.paused ? nullptr : nextActiveJob(printer);
+    if (job == nullptr) {
+      setBusy(writer, false);
+      if (printIdle != nullptr && printIdle(printer, millis() - writer.lastWrite)) {
+        writer.lastWrite = millis();
+      }
+      // Producers notify after each write; the timeout is only a safety net
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+      continue;
+    }
+    if (job->cancelled) {
+      // A job cancelled while queued has already been failed
+      if (job->state != JOB_FAILED) {
+        log_i("Job %u cancelled", job->id);
+        // One held at a boundary for another job, or stopped at one, left
+        // the printer clean
+        if (job->id == writer.parsedJob && job->sent != writer.boundary) {
+          terminateJob(writer);
+        }
+        failJob(writer, job, endOfJob);
+      }
+      continue;
+    }
+    if (job->id != writer.parsedJob) {
+      switchJob(writer, job, endOfJob);
+    }
+
+    writer.jobDpi = job->dpi;
+    PrintSlice slice;
+    size_t length = job->ring.peek(&slice.data[0], &slice.length[0], &slice.data[1], &slice.length[1]);
+
+    if (length == 0) {
+      if (job->receiveComplete) {
+        bool flushed = writer.sink(writer.context, endOfJob);
+        if (flushed && remaining(*job) == 0 && job->copy + 1 < job->copies && !job->cancelled) {
+          if (replayJob(writer, job)) {
+            continue;
+          }
+          flushed = false;
+        }
+        completeJob(job, flushed);
+        continue;
+      }
+      setBusy(writer, false);
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+      continue;
+    }
+
+    setBusy(writer, true);
+    if (job->state == JOB_QUEUED) {
+      if (job->firstWrite == 0) {
+        job->firstWrite = millis();
+      }
+      job->state = JOB_STREAMING;
+      TRACE_INSTANT(TRACE_JOB_STREAMING, job->id);
+      log_i("Job %u streaming", job->id);
+    }
+    if (length > WRITER_SLICE_SIZE) {
+      length = WRITER_SLICE_SIZE;
+      limitSlice(slice, length);
+    }
+
+    // Parse what the slice adds, and stop at the last boundary in it when
+    // a job of a higher class waits, or one of another client once this
+    // client's quantum runs out by then
+    size_t end = job->sent + length;
+    if (writer.scanned < end) {
+      writer.parser.feed(sliceFrom(slice, writer.scanned - job->sent));
+      writer.scanned = end;
+    }
+    FairClient& client = fairClient(writer, job->client);
+    if (writer.boundary > job->sent && writer.boundary < end) {
+      size_t toBoundary = writer.boundary - job->sent;
+      bool exhausted = bridgeConfig().fairQuantum != 0 && client.deficit <= (int32_t)toBoundary;
+      if (yieldWaiting(printer, *job, exhausted)) {
+        length = toBoundary;
+        limitSlice(slice, length);
+      }
+    }
+
+    bool firstSlice = (job->sent == 0);
+    TRACE_BEGIN(TRACE_WRITER_SLICE, length);
+    bool delivered = writer.sink(writer.context, slice);
+    TRACE_END(TRACE_WRITER_SLICE, length);
+    if (!delivered && firstSlice && rerouteJob(job)) {
+      writer.sink(writer.context, endOfJob);
+      continue;
+    }
+    job->ring.consume(length);
+    xSemaphoreGive(spaceAvailable);
+    writer.lastWrite = millis();
+    client.deficit -= length;
+
+    if (delivered) {
+      job->sent += length;
+    } else {
+      failJob(writer, job, endOfJob);
+    }
+  }
+}
+
+bool initPrintWriter(uint8_t printer, PrintSink sink, void* context) {
+  if (printer >= MAX_PRINTERS) {
+    return false;
+  }
+  PrintWriter& writer = writers[printer];
+  if (writer.task != nullptr) {
+    return true;
+  }
+
+  if (jobLock == nullptr) {
+    jobLock = xSemaphoreCreateMutex();
+    spaceAvailable = xSemaphoreCreateBinary();
+  }
+  if (jobLock == nullptr || spaceAvailable == nullptr) {
+    log_e("Failed to create print writer semaphores");
+    return false;
+  }
+
+  writer.sink = sink;
+  writer.context = context;
+  writer.lastWrite = millis();
+
+  char name[16];
+  snprintf(name, sizeof(name), "printWriter%u", printer);
+  if (xTaskCreatePinnedToCore(printWriterTask, name, 4096, (void*)(uintptr_t)printer,
+                              PRINT_WRITER_PRIORITY, &writer.task, PRINT_WRITER_CORE) != pdPASS) {
+    log_e("Failed to start print writer task %u", printer);
+    writer.task = nullptr;
+    return false;
+  }
+
+  log_i("Print writer %u started on core %d", printer, PRINT_WRITER_CORE);
+  return true;
+}
+
+void setPrintJobReroute(PrintJobReroute reroute) {
+  printReroute = reroute;
+}
+
+void setPrintWriterIdle(PrintWriterIdle idle) {
+  printIdle = idle;
+}
+
+void setPrintWriterRate(PrintWriterRate rate) {
+  printRate = rate;
+}
+
+uint32_t createPrintJob(uint8_t printer, size_t total, PrintJobReject& reject, uint8_t pool) {
+  // Every ingest path comes through here and appendPrintJob()
+  powerIngestActive();
+  const size_t streamSize = psramFound() ? PRINT_RING_SIZE : PRINT_RING_SIZE_INTERNAL;
+  const size_t stagedLimit = psramFound() ? PRINT_MAX_STAGED_JOB : PRINT_RING_SIZE_INTERNAL;
+
+  if (printer >= MAX_PRINTERS || writers[printer].task == nullptr) {
+    reject = JOB_REJECT_NO_MEMORY;
+    return 0;
+  }
+
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+
+  // The queue depth is per printer; the slots are shared
+  size_t pending = 0;
+  PrintJob* slot = nullptr;
+  for (size_t i = 0; i < PRINT_JOB_SLOTS; i++) {
+    PrintJob& job = jobs[i];
+    if (isPending(job)) {
+      if (job.printer == printer) {
+        pending++;
+      }
+    } else if (job.ring.capacity() == 0 && (slot == nullptr || job.id < slot->id)) {
+      // Reuse the oldest finished slot
+      slot = &job;
+    }
+  }
+
+  if (pending >= bridgeConfig().queueDepth || slot == nullptr) {
+    xSemaphoreGive(jobLock);
+    reject = JOB_REJECT_QUEUE_FULL;
+    return 0;
+  }
+
+  // A job behind others has to hold its whole body until its turn comes; the
+  // job that owns the printer only needs a streaming window
+  size_t bufferSize = total;
+  if (total == PRINT_JOB_LENGTH_UNKNOWN) {
+    bufferSize = streamSize;
+  } else if (pending > 0) {
+    if (total > stagedLimit) {
+      xSemaphoreGive(jobLock);
+      reject = JOB_REJECT_TOO_LARGE;
+      return 0;
+    }
+  } else if (bufferSize > streamSize) {
+    bufferSize = streamSize;
+  }
+
+  if (!allocateRing(*slot, bufferSize)) {
+    xSemaphoreGive(jobLock);
+    reject = JOB_REJECT_NO_MEMORY;
+    return 0;
+  }
+
+  slot->id = nextJobId++;
+  slot->printer = printer;
+  slot->pool = pool;
+  slot->moves = 0;
+  slot->dpi = 0;
+  slot->priority = PRINT_PRIORITY_INTERACTIVE;
+  slot->client = 0;
+  slot->dialect = PRINT_DIALECT_AUTO;
+  slot->copies = 1;
+  slot->copy = 0;
+  slot->created = millis();
+  slot->firstByte = 0;
+  slot->lastByte = 0;
+  slot->firstWrite = 0;
+  slot->state = JOB_QUEUED;
+  slot->total = total;
+  slot->received = 0;
+  slot->sent = 0;
+  slot->receiveComplete = false;
+  slot->cancelled = false;
+  uint32_t id = slot->id;
+
+  xSemaphoreGive(jobLock);
+
+  log_i("Job %u queued for printer %u, %u bytes, buffer %u bytes in %s", id, printer, total,
+        slot->ring.capacity(), slot->ring.inPsram() ? "PSRAM" : "internal RAM");
+  TRACE_INSTANT(TRACE_JOB_ADMIT, id);
+  reject = JOB_ACCEPTED;
+  return id;
+}
+
+bool setPrintJobCopies(uint32_t id, uint16_t copies) {
+  const size_t stagedLimit = psramFound() ? PRINT_MAX_STAGED_JOB : PRINT_RING_SIZE_INTERNAL;
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  bool held = job != nullptr && job->state == JOB_QUEUED && job->received == 0;
+  if (held && copies > 1) {
+    // The streaming window of a job may be smaller than the job; with
+    // nothing in it yet the writer only ever finds it empty
+    size_t needed = job->total == PRINT_JOB_LENGTH_UNKNOWN ? stagedLimit : job->total;
+    size_t window = job->ring.capacity();
+    if (needed > stagedLimit) {
+      held = false;
+    } else if (window < needed) {
+      releaseRing(*job);
+      held = allocateRing(*job, needed);
+      if (!held && !allocateRing(*job, window)) {
+        job->state = JOB_FAILED;
+        recordHistory(*job);
+      }
+    }
+  }
+  if (held) {
+    job->copies = copies;
+  }
+  xSemaphoreGive(jobLock);
+  return held;
+}
+
+void setPrintJobPriority(uint32_t id, PrintJobPriority priority) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  if (job != nullptr && job->state == JOB_QUEUED) {
+    job->priority = priority;
+  }
+  xSemaphoreGive(jobLock);
+}
+
+const char* printJobPriorityName(PrintJobPriority priority) {
+  return priority == PRINT_PRIORITY_BULK ? "bulk" : "interactive";
+}
+
+bool parsePrintJobPriority(const char* name, PrintJobPriority& priority) {
+  if (strcmp(name, "bulk") == 0) {
+    priority = PRINT_PRIORITY_BULK;
+  } else if (strcmp(name, "interactive") == 0) {
+    priority = PRINT_PRIORITY_INTERACTIVE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void setPrintJobClient(uint32_t id, uint32_t client) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  if (job != nullptr && job->state == JOB_QUEUED) {
+    job->client = client;
+  }
+  xSemaphoreGive(jobLock);
+}
+
+uint32_t printClientKey(const char* name) {
+  // FNV-1a
+  uint32_t key = 2166136261u;
+  for (; *name != '\0'; name++) {
+    key = (key ^ (uint8_t)*name) * 16777619u;
+  }
+  return key;
+}
+
+void setPrintJobDpi(uint32_t id, uint16_t dpi) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  if (job != nullptr && job->state == JOB_QUEUED) {
+    job->dpi = dpi;
+  }
+  xSemaphoreGive(jobLock);
+}
+
+uint16_t printWriterJobDpi(uint8_t printer) {
+  return printer < MAX_PRINTERS ? writers[printer].jobDpi : 0;
+}
+
+size_t appendPrintJob(uint32_t id, const uint8_t* data, size_t length, uint32_t timeoutMs) {
+  powerIngestActive();
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  bool accepting = job != nullptr && !job->receiveComplete;
+  bool discard = accepting && job->state == JOB_FAILED;
+  xSemaphoreGive(jobLock);
+
+  if (!accepting) {
+    return 0;
+  }
+  if (discard) {
+    // Keep draining the upload of a failed job so the client gets its answer
+    job->received += length;
+    return length;
+  }
+
+  size_t queued = 0;
+  TickType_t start = xTaskGetTickCount();
+  TickType_t timeout = pdMS_TO_TICKS(timeoutMs);
+  TRACE_BEGIN(TRACE_JOB_APPEND, length);
+
+  while (queued < length) {
+    size_t written = job->ring.write(data + queued, length - queued);
+    queued += written;
+    job->received += written;
+    if (written > 0) {
+      uint32_t now = millis();
+      if (job->firstByte == 0) {
+        job->firstByte = now;
+      }
+      job->lastByte = now;
+      notifyWriter(job->printer);
+    }
+    if (queued == length) {
+      break;
+    }
+
+    // Buffer is full: wait for the writer to free some space. Producers of
+    // different jobs share the signal, so re-check the ring periodically
+    // instead of relying on getting the wakeup.
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout) {
+      break;
+    }
+    TickType_t wait = timeout - elapsed;
+    if (wait > pdMS_TO_TICKS(10)) {
+      wait = pdMS_TO_TICKS(10);
+    }
+    xSemaphoreTake(spaceAvailable, wait);
+  }
+
+  TRACE_END(TRACE_JOB_APPEND, queued);
+  return queued;
+}
+
+bool appendPrintJobWait(uint32_t id, const uint8_t* data, size_t length) {
+  size_t queued = 0;
+  while (queued < length) {
+    queued += appendPrintJob(id, data + queued, length - queued, APPEND_WAIT_TIMEOUT);
+    if (queued < length && (printJobFailed(id) || !printJobAccepting(id))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool printJobFailed(uint32_t id) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  bool failed = job == nullptr || job->state == JOB_FAILED;
+  xSemaphoreGive(jobLock);
+  return failed;
+}
+
+bool printJobAccepting(uint32_t id) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  bool accepting = job != nullptr && !job->receiveComplete;
+  xSemaphoreGive(jobLock);
+  return accepting;
+}
+
+void finishPrintJob(uint32_t id) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  uint8_t printer = PRINT_ALL_PRINTERS;
+  if (job != nullptr && !job->receiveComplete) {
+    printer = job->printer;
+    if (job->total != PRINT_JOB_LENGTH_UNKNOWN && job->received < job->total && isPending(*job)) {
+      log_e("Job %u upload ended after %u of %u bytes", id, job->received, job->total);
+      job->state = JOB_FAILED;
+      recordHistory(*job);
+    }
+    job->receiveComplete = true;
+  }
+  xSemaphoreGive(jobLock);
+
+  notifyWriter(printer);
+}
+
+void abortPrintJob(uint32_t id) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  uint8_t printer = PRINT_ALL_PRINTERS;
+  if (job != nullptr && !job->receiveComplete) {
+    printer = job->printer;
+    if (isPending(*job)) {
+      log_e("Job %u aborted after %u bytes", id, job->received);
+      job->state = JOB_FAILED;
+      recordHistory(*job);
+    }
+    job->receiveComplete = true;
+  }
+  xSemaphoreGive(jobLock);
+
+  notifyWriter(printer);
+}
+
+size_t printJobSpace(uint32_t id) {
+  size_t space = 0;
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  if (job != nullptr && !job->receiveComplete && isPending(*job)) {
+    space = job->ring.space();
+  }
+  xSemaphoreGive(jobLock);
+  return space;
+}
+
+bool cancelPrintJob(uint32_t id) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  bool pending = job != nullptr && isPending(*job);
+  uint8_t printer = pending ? job->printer : PRINT_ALL_PRINTERS;
+  if (pending && job->state == JOB_QUEUED) {
+    // Nothing of it reached the sink yet; the flag covers a writer that
+    // just picked it
+    job->state = JOB_FAILED;
+    job->cancelled = true;
+    recordHistory(*job);
+    writers[printer].stats.failed++;
+    log_i("Job %u cancelled while queued", id);
+  } else if (pending) {
+    // The writer is inside it and ends it between slices
+    job->cancelled = true;
+  }
+  xSemaphoreGive(jobLock);
+
+  notifyWriter(printer);
+  return pending;
+}
+
+void pausePrintWriter(uint8_t printer, bool paused) {
+  if (printer >= MAX_PRINTERS) {
+    return;
+  }
+  writers[printer].paused = paused;
+  log_i("Printer %u %s", printer, paused ? "paused" : "resumed");
+  notifyWriter(printer);
+}
+
+bool printWriterPaused(uint8_t printer) {
+  return printer < MAX_PRINTERS && writers[printer].paused;
+}
+
+bool getPrintJob(uint32_t id, PrintJobInfo& info) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  PrintJob* job = findJob(id);
+  if (job != nullptr) {
+    info.id = job->id;
+    info.printer = job->printer;
+    info.state = job->state;
+    info.priority = job->priority;
+    info.total = job->total;
+    info.received = job->received;
+    info.sent = job->sent;
+    info.copies = job->copies;
+    info.copiesDone = job->copy;
+  }
+  xSemaphoreGive(jobLock);
+  return job != nullptr;
+}
+
+size_t getPendingPrintJobs(PrintJobInfo* out, size_t max) {
+  size_t count = 0;
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  for (size_t i = 0; i < PRINT_JOB_SLOTS && count < max; i++) {
+    const PrintJob& job = jobs[i];
+    if (isPending(job)) {
+      PrintJobInfo& info = out[count++];
+      info.id = job.id;
+      info.printer = job.printer;
+      info.state = job.state;
+      info.priority = job.priority;
+      info.total = job.total;
+      info.received = job.received;
+      info.sent = job.sent;
+      info.copies = job.copies;
+      info.copiesDone = job.copy;
+    }
+  }
+  xSemaphoreGive(jobLock);
+  return count;
+}
+
+size_t getPrintHistory(PrintJobTimeline* out, size_t max) {
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  size_t count = historyCount < max ? historyCount : max;
+  for (size_t i = 0; i < count; i++) {
+    out[i] = history[(historyNext + PRINT_HISTORY_SIZE - 1 - i) % PRINT_HISTORY_SIZE];
+  }
+  xSemaphoreGive(jobLock);
+  return count;
+}
+
+void markPrinterIdle(uint8_t printer) {
+  if (printer >= MAX_PRINTERS) {
+    return;
+  }
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  // The answer may beat the writer to recording the job it belongs to
+  for (size_t i = 0; i < PRINT_JOB_SLOTS; i++) {
+    if (jobs[i].id != 0 && jobs[i].printer == printer && jobs[i].state == JOB_STREAMING) {
+      writers[printer].idleAt = millis();
+      xSemaphoreGive(jobLock);
+      return;
+    }
+  }
+  for (size_t i = 0; i < historyCount; i++) {
+    PrintJobTimeline& entry = history[(historyNext + PRINT_HISTORY_SIZE - 1 - i) % PRINT_HISTORY_SIZE];
+    if (entry.printer == printer) {
+      if (entry.state == JOB_DONE && entry.printerIdle == 0) {
+        entry.printerIdle = millis();
+      }
+      break;
+    }
+  }
+  xSemaphoreGive(jobLock);
+}
+
+const char* printJobStateName(PrintJobState state) {
+  switch (state) {
+    case JOB_QUEUED: return "queued";
+    case JOB_STREAMING: return "streaming";
+    case JOB_DONE: return "done";
+    case JOB_FAILED: return "failed";
+  }
+  return "unknown";
+}
+
+static uint32_t drainSeconds(uint8_t printer) {
+  uint32_t rate = printRate != nullptr ? printRate(printer) : 0;
+  return 1 + printWriterPending(printer) / (rate > 0 ? rate : DEFAULT_DRAIN_RATE);
+}
+
+uint32_t printQueueRetryAfter(uint8_t printer) {
+  uint32_t seconds = 1;
+  if (printer < MAX_PRINTERS) {
+    seconds = drainSeconds(printer);
+  } else {
+    // The printers drain side by side; the slowest one frees up last
+    for (uint8_t i = 0; i < MAX_PRINTERS; i++) {
+      if (writers[i].task != nullptr) {
+        uint32_t s = drainSeconds(i);
+        seconds = s > seconds ? s : seconds;
+      }
+    }
+  }
+  return seconds > 60 ? 60 : seconds;
+}
+
+size_t printQueueDepth(uint8_t printer) {
+  size_t depth = 0;
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  for (size_t i = 0; i < PRINT_JOB_SLOTS; i++) {
+    if (isPending(jobs[i]) && matchesPrinter(jobs[i], printer)) {
+      depth++;
+    }
+  }
+  xSemaphoreGive(jobLock);
+  return depth;
+}
+
+size_t printWriterPending(uint8_t printer) {
+  size_t pending = 0;
+  xSemaphoreTake(jobLock, portMAX_DELAY);
+  for (size_t i = 0; i < PRINT_JOB_SLOTS; i++) {
+    if (isPending(jobs[i]) && matchesPrinter(jobs[i], printer)) {
+      pending += remaining(jobs[i]);
+    }
+  }
+  xSemaphoreGive(jobLock);
+  return pending;
+}
+
+bool getPrintWriterStats(uint8_t printer, PrintWriterStats& stats) {
+  if (printer >= MAX_PRINTERS) {
+    return false;
+  }
+  stats = writers[printer].stats;
+  return true;
+}
+
+bool printWriterIdle() {
+  for (size_t i = 0; i < MAX_PRINTERS; i++) {
+    if (writers[i].busy) {
+      return false;
+    }
+  }
+  return printQueueDepth() == 0;
+}
@@ -0,0 +1,187 @@
+#include "printer_artwork.h"
+
+#include <Preferences.h>
+
+static const char* ARTWORK_NAMESPACE = "artwork";
+static const uint8_t GS = 0x1D;
+static const uint8_t ESCPOS_KEY = 'N';  // First key code byte, the slot gives the second
+static const size_t BMP_HEADER = 62;    // File and info header, two colour palette
+
+uint32_t artworkHash(uint16_t width, uint16_t height, const uint8_t* bits) {
+  // FNV-1a over the size and the packed rows
+  uint32_t hash = 2166136261u;
+  uint8_t size[4] = {(uint8_t)width, (uint8_t)(width >> 8), (uint8_t)height, (uint8_t)(height >> 8)};
+  for (uint8_t b : size) {
+    hash = (hash ^ b) * 16777619u;
+  }
+  size_t bytes = (size_t)(width + 7) / 8 * height;
+  for (size_t i = 0; i < bytes; i++) {
+    hash = (hash ^ bits[i]) * 16777619u;
+  }
+  // 0 marks an empty slot
+  return hash != 0 ? hash : 1;
+}
+
+static String artworkNamespace(uint8_t printer) {
+  return printer == 0 ? String(ARTWORK_NAMESPACE) : String(ARTWORK_NAMESPACE) + String(printer);
+}
+
+static String slotKey(uint8_t slot) {
+  return "h" + String(slot);
+}
+
+// NVS of that printer, cleared when it was written for another one
+static bool openSlots(Preferences& prefs, uint8_t printer, const String& mac) {
+  if (!prefs.begin(artworkNamespace(printer).c_str(), false)) {
+    return false;
+  }
+  if (!prefs.getString("mac").equalsIgnoreCase(mac)) {
+    prefs.clear();
+    prefs.putString("mac", mac);
+  }
+  return true;
+}
+
+int findArtworkSlot(uint8_t printer, const String& mac, uint32_t hash) {
+  Preferences prefs;
+  if (!openSlots(prefs, printer, mac)) {
+    return -1;
+  }
+  int found = -1;
+  for (uint8_t slot = 0; slot < PRINTER_ARTWORK_SLOTS && found < 0; slot++) {
+    if (prefs.getUInt(slotKey(slot).c_str(), 0) == hash) {
+      found = slot;
+    }
+  }
+  prefs.end();
+  return found;
+}
+
+uint8_t claimArtworkSlot(uint8_t printer, const String& mac, uint32_t hash, uint32_t avoid) {
+  Preferences prefs;
+  if (!openSlots(prefs, printer, mac)) {
+    // Without NVS every label downloads its artwork again
+    for (uint8_t slot = 0; slot < PRINTER_ARTWORK_SLOTS; slot++) {
+      if (!(avoid & (1u << slot))) {
+        return slot;
+      }
+    }
+    return 0;
+  }
+  uint8_t slot = prefs.getUChar("next", 0) % PRINTER_ARTWORK_SLOTS;
+  for (uint8_t tries = 1; tries < PRINTER_ARTWORK_SLOTS && (avoid & (1u << slot)); tries++) {
+    slot = (slot + 1) % PRINTER_ARTWORK_SLOTS;
+  }
+  prefs.putUInt(slotKey(slot).c_str(), hash);
+  prefs.putUChar("next", (slot + 1) % PRINTER_ARTWORK_SLOTS);
+  prefs.end();
+  log_i("Artwork %08x goes into slot %u of printer %u", hash, slot, printer);
+  return slot;
+}
+
+static String tsplFileName(uint8_t slot) {
+  return "NVART" + String(slot) + ".BMP";
+}
+
+static void putLe(uint8_t* p, uint32_t value, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) {
+    p[i] = value >> (8 * i);
+  }
+}
+
+// Monochrome BMP: bottom-up rows padded to 4 bytes, palette entry 0 black,
+// so ink is a 0 bit
+static bool writeBmpDownload(uint8_t slot, const PrinterArtwork& art, ImageOutput output, void* context) {
+  size_t rowBytes = (art.width + 7) / 8;
+  size_t stride = (art.width + 31) / 32 * 4;
+  uint32_t fileSize = BMP_HEADER + stride * art.height;
+  String command = "DOWNLOAD F,\"" + tsplFileName(slot) + "\"," + String(fileSize) + ",";
+  if (!output(context, (const uint8_t*)command.c_str(), command.length())) {
+    return false;
+  }
+
+  uint8_t header[BMP_HEADER] = {'B', 'M'};
+  putLe(header + 2, fileSize, 4);
+  putLe(header + 10, BMP_HEADER, 4);
+  putLe(header + 14, 40, 4);
+  putLe(header + 18, art.width, 4);
+  putLe(header + 22, art.height, 4);
+  putLe(header + 26, 1, 2);               // Planes
+  putLe(header + 28, 1, 2);               // Bits per pixel
+  putLe(header + 34, stride * art.height, 4);
+  putLe(header + 46, 2, 4);               // Colours in the palette
+  memset(header + 58, 0xFF, 3);           // Entry 1 white, entry 0 stays black
+  if (!output(context, header, sizeof(header))) {
+    return false;
+  }
+
+  uint8_t* row = (uint8_t*)malloc(stride);
+  if (row == nullptr) {
+    return false;
+  }
+  bool ok = true;
+  for (int32_t y = art.height - 1; ok && y >= 0; y--) {
+    const uint8_t* src = art.bits + y * rowBytes;
+    memset(row, 0xFF, stride);
+    for (size_t b = 0; b < rowBytes; b++) {
+      row[b] = ~src[b];
+    }
+    if (art.width & 7) {
+      row[rowBytes - 1] |= 0xFF >> (art.width & 7);
+    }
+    ok = output(context, row, stride);
+  }
+  free(row);
+  return ok && output(context, (const uint8_t*)"\r\n", 2);
+}
+
+bool writeArtworkDefine(ImageCommandSet commands, uint8_t slot, const PrinterArtwork& art, ImageOutput output,
+                        void* context) {
+  if (commands == IMAGE_TSPL) {
+    return writeBmpDownload(slot, art, output, context);
+  }
+
+  // Function 67: define NV graphics in raster format, one colour
+  size_t bytes = (size_t)(art.width + 7) / 8 * art.height;
+  uint32_t p = 11 + bytes;
+  uint8_t header[17];
+  size_t len = 0;
+  header[len++] = GS;
+  if (p <= 0xFFFF) {
+    header[len++] = '(';
+    header[len++] = 'L';
+    putLe(header + len, p, 2);
+    len += 2;
+  } else {
+    header[len++] = '8';
+    header[len++] = 'L';
+    putLe(header + len, p, 4);
+    len += 4;
+  }
+  uint8_t function[] = {48, 67, 48, ESCPOS_KEY, (uint8_t)('A' + slot), 1,
+                        (uint8_t)art.width, (uint8_t)(art.width >> 8),
+                        (uint8_t)art.height, (uint8_t)(art.height >> 8), 49};
+  memcpy(header + len, function, sizeof(function));
+  len += sizeof(function);
+  return output(context, header, len) && output(context, art.bits, bytes);
+}
+
+size_t artworkPrintCommand(ImageCommandSet commands, uint8_t slot, uint16_t x, uint16_t y, uint8_t* out,
+                           size_t size) {
+  if (commands == IMAGE_TSPL) {
+    int len = snprintf((char*)out, size, "PUTBMP %u,%u,\"%s\"\r\n", x, y, tsplFileName(slot).c_str());
+    return (len > 0 && (size_t)len < size) ? len : 0;
+  }
+
+  // Function 69 at normal size, placed with the left margin
+  const uint8_t command[] = {
+    GS, 'L', (uint8_t)x, (uint8_t)(x >> 8),
+    GS, '(', 'L', 6, 0, 48, 69, ESCPOS_KEY, (uint8_t)('A' + slot), 1, 1,
+    GS, 'L', 0, 0
+  };
+  if (size < sizeof(command)) {
+    return 0;
+  }
+  memcpy(out, command, sizeof(command));
+  return sizeof(command);
+}
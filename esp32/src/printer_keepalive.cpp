@@ -0,0 +1,38 @@
+#include "printer_keepalive.h"
+#include "ble_printer.h"
+#include "bridge_config.h"
+#include "print_writer.h"
+
+#include <time.h>
+
+// Any earlier time means SNTP hasn't answered yet
+static const time_t CLOCK_VALID_AFTER = 1600000000;
+
+bool keepAliveWindowOpen() {
+  uint16_t start = bridgeConfig().keepAliveStart;
+  uint16_t end = bridgeConfig().keepAliveEnd;
+  time_t now = time(nullptr);
+  if (start == end || now < CLOCK_VALID_AFTER) {
+    return true;
+  }
+  struct tm local;
+  localtime_r(&now, &local);
+  uint16_t minute = local.tm_hour * 60 + local.tm_min;
+  return start < end ? minute >= start && minute < end : minute >= start || minute < end;
+}
+
+// Writer idle hook; keepAlive() only fails when there is no link, which
+// the link task is already bringing back
+static bool sendKeepAlive(uint8_t printer, uint32_t idleMs) {
+  uint16_t interval = bridgeConfig().keepAliveInterval;
+  if (interval == 0 || idleMs < interval * 1000UL || !keepAliveWindowOpen()) {
+    return false;
+  }
+  BlePrinter* target = getPrinter(printer);
+  return target != nullptr && target->keepAlive();
+}
+
+void initPrinterKeepAlive() {
+  configTzTime(BRIDGE_TIMEZONE, NTP_SERVER);
+  setPrintWriterIdle(sendKeepAlive);
+}
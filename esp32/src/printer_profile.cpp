@@ -0,0 +1,192 @@
+#include "printer_profile.h"
+#include "ble_printer.h"
+
+#include <LittleFS.h>
+
+static PrinterProfile profiles[MAX_PRINTER_PROFILES];
+static size_t profileCount = 0;
+
+bool profilePatternMatch(const char* pattern, const char* text) {
+  // Backtrack to just after the last * on a mismatch
+  const char* star = nullptr;
+  const char* resume = nullptr;
+  while (*text != '\0') {
+    if (*pattern == '*') {
+      star = pattern++;
+      resume = text;
+    } else if (*pattern == '?' || tolower((unsigned char)*pattern) == tolower((unsigned char)*text)) {
+      pattern++;
+      text++;
+    } else if (star != nullptr) {
+      pattern = star + 1;
+      text = ++resume;
+    } else {
+      return false;
+    }
+  }
+  while (*pattern == '*') {
+    pattern++;
+  }
+  return *pattern == '\0';
+}
+
+// One key=value option onto the profile. False when the key is unknown or
+// the value out of range.
+static bool parseOption(PrinterProfile& profile, const String& option) {
+  int equals = option.indexOf('=');
+  if (equals <= 0) {
+    return false;
+  }
+  String key = option.substring(0, equals);
+  String value = option.substring(equals + 1);
+  long number = strtol(value.c_str(), nullptr, 0);
+
+  if (key == "service") {
+    strlcpy(profile.service, BleLink::canonicalUuid(value).c_str(), sizeof(profile.service));
+  } else if (key == "mtu") {
+    if (number < 23 || number > 517) {
+      return false;
+    }
+    profile.mtu = number;
+  } else if (key == "chunk") {
+    if (number < 20 || number > 512) {
+      return false;
+    }
+    profile.chunk = number;
+  } else if (key == "write") {
+    if (value == "auto") {
+      profile.writeMode = WRITE_MODE_AUTO;
+    } else if (value == "ack") {
+      profile.writeMode = WRITE_MODE_ACK;
+    } else if (value == "noack") {
+      profile.writeMode = WRITE_MODE_NO_RESPONSE;
+    } else {
+      return false;
+    }
+  } else if (key == "phy") {
+    if (value == "1m") {
+      profile.phy = BLE_PHY_1M;
+    } else if (value == "2m") {
+      profile.phy = BLE_PHY_2M;
+    } else if (value == "coded") {
+      profile.phy = BLE_PHY_CODED;
+    } else {
+      return false;
+    }
+  } else if (key == "probe") {
+    if (value == "nul") {
+      profile.probe = PROBE_NUL;
+    } else if (value == "init") {
+      profile.probe = PROBE_INIT;
+    } else if (value == "off") {
+      profile.probe = PROBE_OFF;
+    } else {
+      return false;
+    }
+  } else if (key == "caps") {
+    if (number < 0 || number > 0xFF) {
+      return false;
+    }
+    profile.rasterCaps = number;
+  } else if (key == "band") {
+    if (number < 1 || number > 0xFFFF) {
+      return false;
+    }
+    profile.bandRows = number;
+  } else if (key == "buffer") {
+    if (number < 0) {
+      return false;
+    }
+    profile.bufferBytes = number;
+  } else if (key == "lines") {
+    if (number < 0 || number > 0xFFFF) {
+      return false;
+    }
+    profile.linesPerSecond = number;
+  } else if (key == "pipeline") {
+    uint8_t length;
+    if (!parsePipeline(value.c_str(), profile.pipeline, length)) {
+      return false;
+    }
+    profile.pipelineLength = length;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+size_t loadPrinterProfiles() {
+  profileCount = 0;
+  File file = LittleFS.open(PRINTER_PROFILE_PATH, "r");
+  if (!file) {
+    return 0;
+  }
+
+  while (file.available()) {
+    String line = file.readStringUntil('\n');
+    line.trim();
+    if (line.length() == 0 || line.startsWith("#")) {
+      continue;
+    }
+    if (profileCount == MAX_PRINTER_PROFILES) {
+      log_w("%s: more than %d profiles, '%s' ignored", PRINTER_PROFILE_PATH, MAX_PRINTER_PROFILES, line.c_str());
+      continue;
+    }
+
+    PrinterProfile& profile = profiles[profileCount];
+    profile = {};
+    profile.writeMode = -1;
+    profile.rasterCaps = -1;
+    profile.pipelineLength = -1;
+
+    // Pattern first, then options up to the end of the line
+    bool valid = true;
+    int pos = 0;
+    int length = line.length();
+    bool first = true;
+    while (pos < length && valid) {
+      while (pos < length && isspace((unsigned char)line[pos])) {
+        pos++;
+      }
+      int start = pos;
+      while (pos < length && !isspace((unsigned char)line[pos])) {
+        pos++;
+      }
+      if (pos == start) {
+        break;
+      }
+      String field = line.substring(start, pos);
+      if (first) {
+        valid = field.length() < sizeof(profile.pattern);
+        strlcpy(profile.pattern, field.c_str(), sizeof(profile.pattern));
+        first = false;
+      } else {
+        valid = parseOption(profile, field);
+      }
+    }
+    if (!valid) {
+      log_w("%s: ignoring malformed line '%s'", PRINTER_PROFILE_PATH, line.c_str());
+      continue;
+    }
+    profileCount++;
+  }
+  file.close();
+
+  if (profileCount > 0) {
+    log_i("%u printer profiles from %s", (unsigned)profileCount, PRINTER_PROFILE_PATH);
+  }
+  return profileCount;
+}
+
+const PrinterProfile* findPrinterProfile(const char* name, const char* service) {
+  for (size_t i = 0; i < profileCount; i++) {
+    const PrinterProfile& profile = profiles[i];
+    if (profile.service[0] != '\0' && strcasecmp(profile.service, service) != 0) {
+      continue;
+    }
+    if (profilePatternMatch(profile.pattern, name)) {
+      return &profile;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,290 @@
+#include "pwg_raster.h"
+
+#include "heap_stats.h"
+
+static const uint8_t PWG_SYNC[4] = {'R', 'a', 'S', '2'};
+static const uint8_t URF_SYNC[8] = {'U', 'N', 'I', 'R', 'A', 'S', 'T', 0};
+static const size_t URF_FILE_HEADER = 12;    // Sync and page count
+static const size_t PWG_PAGE_HEADER = 1796;
+static const size_t URF_PAGE_HEADER = 32;
+// PWG header fields the decoder reads, from cupsWidth to cupsColorSpace
+static const size_t PWG_FIELDS_OFFSET = 372;
+static const uint32_t MAX_PAGE_WIDTH = 8192;
+
+// cupsColorSpace values
+static const uint32_t CSPACE_W = 0;
+static const uint32_t CSPACE_RGB = 1;
+static const uint32_t CSPACE_K = 3;
+static const uint32_t CSPACE_SW = 18;
+static const uint32_t CSPACE_SRGB = 19;
+
+const char* pwgRasterErrorName(PwgRasterError error) {
+  switch (error) {
+    case PWG_OK: return "OK";
+    case PWG_ERR_FORMAT: return "Unsupported raster format";
+    case PWG_ERR_CORRUPT: return "Corrupt raster";
+    case PWG_ERR_NO_MEMORY: return "Out of memory for raster";
+    case PWG_ERR_OUTPUT: return "Print job refused raster";
+  }
+  return "Unknown error";
+}
+
+static uint32_t be32(const uint8_t* p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+void PwgRasterDecoder::begin(const ImageRasterOptions& options, uint16_t maxDots, ImageOutput output,
+                             void* context) {
+  release();
+  _options = options;
+  _maxDots = (maxDots == 0 || maxDots > IMAGE_MAX_WIDTH) ? IMAGE_MAX_WIDTH : maxDots;
+  _output = output;
+  _context = context;
+  _error = PWG_OK;
+  _pages = 0;
+  _format = FORMAT_UNKNOWN;
+  _state = SYNC;
+  _headerLen = 0;
+  _headerSize = sizeof(PWG_SYNC);
+}
+
+void PwgRasterDecoder::release() {
+  heapFree(_line);
+  heapFree(_gray);
+  heapFree(_packed);
+  _line = nullptr;
+  _gray = nullptr;
+  _packed = nullptr;
+  _dither.end();
+  _writer.end();
+}
+
+PwgRasterError PwgRasterDecoder::fail(PwgRasterError error) {
+  if (_error == PWG_OK) {
+    _error = error;
+    log_w("Page raster %u: %s", _pages + 1, pwgRasterErrorName(error));
+  }
+  _state = DONE;
+  return _error;
+}
+
+PwgRasterError PwgRasterDecoder::feed(const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length && _error == PWG_OK; i++) {
+    uint8_t b = data[i];
+    switch (_state) {
+      case SYNC:
+        _header[_headerLen++] = b;
+        if (_headerLen == sizeof(PWG_SYNC) && memcmp(_header, PWG_SYNC, sizeof(PWG_SYNC)) == 0) {
+          _format = FORMAT_PWG;
+        } else if (_headerLen == sizeof(PWG_SYNC) && memcmp(_header, URF_SYNC, sizeof(PWG_SYNC)) != 0) {
+          return fail(PWG_ERR_FORMAT);
+        } else if (_headerLen == sizeof(URF_SYNC) && memcmp(_header, URF_SYNC, sizeof(URF_SYNC)) != 0) {
+          return fail(PWG_ERR_FORMAT);
+        } else if (_headerLen == URF_FILE_HEADER) {
+          _format = FORMAT_URF;
+        }
+        if (_format != FORMAT_UNKNOWN) {
+          _state = PAGE_HEADER;
+          _headerLen = 0;
+          _headerSize = _format == FORMAT_PWG ? PWG_PAGE_HEADER : URF_PAGE_HEADER;
+        }
+        break;
+
+      case PAGE_HEADER:
+        // URF headers are kept whole, of PWG's only the fields read
+        if (_format == FORMAT_URF) {
+          _header[_headerLen] = b;
+        } else if (_headerLen >= PWG_FIELDS_OFFSET && _headerLen < PWG_FIELDS_OFFSET + sizeof(_header)) {
+          _header[_headerLen - PWG_FIELDS_OFFSET] = b;
+        }
+        if (++_headerLen == _headerSize && !startPage()) {
+          return _error;
+        }
+        break;
+
+      case LINE_REPEAT:
+        _repeat = b + 1;
+        _units = 0;
+        _state = RUN_COUNT;
+        break;
+
+      case RUN_COUNT:
+        if (b == 128) {
+          // White to the end of the row
+          uint8_t white = (_pixel == PIXEL_KEY || _pixel == PIXEL_BLACK_1) ? 0x00 : 0xFF;
+          memset(_line + _units * _pixelBytes, white, (_lineUnits - _units) * _pixelBytes);
+          _units = _lineUnits;
+          if (!finishLine()) {
+            return _error;
+          }
+          break;
+        }
+        _runLeft = b < 128 ? b + 1 : 257 - b;
+        if (_units + _runLeft > _lineUnits) {
+          return fail(PWG_ERR_CORRUPT);
+        }
+        _pixelLen = 0;
+        _state = b < 128 ? RUN_PIXEL : RUN_LITERAL;
+        break;
+
+      case RUN_PIXEL:
+      case RUN_LITERAL:
+        if (!pixelByte(b, _state == RUN_LITERAL)) {
+          return _error;
+        }
+        break;
+
+      case DONE:
+        break;
+    }
+  }
+  return _error;
+}
+
+// One byte of a repeated pixel or of a literal run
+bool PwgRasterDecoder::pixelByte(uint8_t b, bool literal) {
+  if (literal) {
+    _line[_units * _pixelBytes + _pixelLen] = b;
+  } else {
+    _pixelValue[_pixelLen] = b;
+  }
+  if (++_pixelLen < _pixelBytes) {
+    return true;
+  }
+  _pixelLen = 0;
+
+  if (literal) {
+    _units++;
+    _runLeft--;
+  } else {
+    for (; _runLeft > 0; _runLeft--, _units++) {
+      memcpy(_line + _units * _pixelBytes, _pixelValue, _pixelBytes);
+    }
+  }
+  if (_runLeft > 0) {
+    return true;
+  }
+  if (_units == _lineUnits) {
+    return finishLine();
+  }
+  _state = RUN_COUNT;
+  return true;
+}
+
+bool PwgRasterDecoder::startPage() {
+  uint32_t bitsPerPixel;
+  uint32_t colorSpace;
+  if (_format == FORMAT_PWG) {
+    _width = be32(_header);
+    _height = be32(_header + 4);
+    bitsPerPixel = be32(_header + 16);
+    colorSpace = be32(_header + 28);
+    if (bitsPerPixel == 8 && (colorSpace == CSPACE_SW || colorSpace == CSPACE_W)) {
+      _pixel = PIXEL_GRAY;
+    } else if (bitsPerPixel == 8 && colorSpace == CSPACE_K) {
+      _pixel = PIXEL_KEY;
+    } else if (bitsPerPixel == 1 && colorSpace == CSPACE_K) {
+      _pixel = PIXEL_BLACK_1;
+    } else if (bitsPerPixel == 24 && (colorSpace == CSPACE_SRGB || colorSpace == CSPACE_RGB)) {
+      _pixel = PIXEL_RGB;
+    } else {
+      fail(PWG_ERR_FORMAT);
+      return false;
+    }
+  } else {
+    // bpp, colour space, duplex, quality, two words, width, height, dpi
+    bitsPerPixel = _header[0];
+    _width = be32(_header + 12);
+    _height = be32(_header + 16);
+    if (bitsPerPixel == 8) {
+      _pixel = PIXEL_GRAY;
+    } else if (bitsPerPixel == 24) {
+      _pixel = PIXEL_RGB;
+    } else {
+      fail(PWG_ERR_FORMAT);
+      return false;
+    }
+  }
+  if (_width == 0 || _width > MAX_PAGE_WIDTH || _height > 0xFFFF) {
+    fail(PWG_ERR_FORMAT);
+    return false;
+  }
+
+  _pixelBytes = _pixel == PIXEL_RGB ? 3 : 1;
+  _lineUnits = _pixel == PIXEL_BLACK_1 ? (_width + 7) / 8 : _width;
+  _dots = _width > _maxDots ? _maxDots : _width;
+  _row = 0;
+  _headerLen = 0;
+  if (_height == 0) {
+    // Nothing to print; the next page header follows
+    return true;
+  }
+
+  release();
+  _lineBytes = _lineUnits * _pixelBytes;
+  _line = (uint8_t*)heapAlloc(HEAP_SITE_IMAGE, _lineBytes);
+  _gray = (uint8_t*)heapAlloc(HEAP_SITE_IMAGE, _dots);
+  _packed = (uint8_t*)heapAlloc(HEAP_SITE_IMAGE, (_dots + 7) / 8);
+  if (_line == nullptr || _gray == nullptr || _packed == nullptr ||
+      !_dither.begin(_options.dither, _dots, IMAGE_THRESHOLD)) {
+    fail(PWG_ERR_NO_MEMORY);
+    return false;
+  }
+  if (!_writer.begin(_options, _dots, _height, _output, _context)) {
+    fail(_writer.outputFailed() ? PWG_ERR_OUTPUT : PWG_ERR_NO_MEMORY);
+    return false;
+  }
+  log_i("Page raster %u: %ux%u, %u bpp, %u dots printed", _pages + 1, _width, _height, bitsPerPixel, _dots);
+  _state = LINE_REPEAT;
+  return true;
+}
+
+bool PwgRasterDecoder::finishLine() {
+  size_t packedBytes = (_dots + 7) / 8;
+  if (_pixel == PIXEL_BLACK_1) {
+    memcpy(_packed, _line, packedBytes);
+    // Dots past a page cut at the right
+    if (_dots % 8 != 0) {
+      _packed[packedBytes - 1] &= 0xFF << (8 - _dots % 8);
+    }
+  } else {
+    for (uint16_t x = 0; x < _dots; x++) {
+      const uint8_t* p = _line + x * _pixelBytes;
+      if (_pixel == PIXEL_GRAY) {
+        _gray[x] = p[0];
+      } else if (_pixel == PIXEL_KEY) {
+        _gray[x] = 255 - p[0];
+      } else {
+        _gray[x] = (77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8;
+      }
+    }
+  }
+
+  // Repeated rows are dithered one by one so the error keeps spreading
+  for (uint16_t r = 0; r < _repeat && _row < _height; r++, _row++) {
+    if (_pixel != PIXEL_BLACK_1) {
+      _dither.row(_gray, _packed);
+    }
+    if (!_writer.row(_packed)) {
+      fail(PWG_ERR_OUTPUT);
+      return false;
+    }
+  }
+
+  if (_row == _height) {
+    _pages++;
+    _state = PAGE_HEADER;
+    _headerLen = 0;
+  } else {
+    _state = LINE_REPEAT;
+  }
+  return true;
+}
+
+PwgRasterError PwgRasterDecoder::end() {
+  if (_error == PWG_OK && (_state != PAGE_HEADER || _headerLen != 0)) {
+    fail(_state == SYNC ? PWG_ERR_FORMAT : PWG_ERR_CORRUPT);
+  }
+  release();
+  return _error;
+}
@@ -0,0 +1,417 @@
+#include "raster_recoder.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "printer_encoder.h"
+
+// Known ESC/POS printers and what their raster engine accepts. Matched on the
+// start of the BLE device name; first match wins.
+static const RasterProfile rasterProfiles[] = {
+  { "PT-210", RASTER_CAP_MERGE_ROWS | RASTER_CAP_FEED_BLANK, 24 },
+  { "MTP-",   RASTER_CAP_MERGE_ROWS | RASTER_CAP_FEED_BLANK, 24 },
+  { "MPT-",   RASTER_CAP_MERGE_ROWS | RASTER_CAP_FEED_BLANK, 24 },
+};
+
+static const uint8_t GS = 0x1D;
+static const uint8_t ESC = 0x1B;
+
+RasterProfile lookupRasterProfile(const char* printerName) {
+  if (PRINTER_RASTER_CAPS >= 0) {
+    return { "", (uint8_t)PRINTER_RASTER_CAPS, PRINTER_BAND_ROWS };
+  }
+  for (const RasterProfile& profile : rasterProfiles) {
+    if (strncmp(printerName, profile.namePrefix, strlen(profile.namePrefix)) == 0) {
+      return profile;
+    }
+  }
+  return { "", RASTER_CAP_NONE, 1 };
+}
+
+void RasterRecoder::begin(const RasterProfile& profile, PrintSink output, void* context) {
+  _caps = profile.caps;
+  _maxBandRows = (profile.caps & (RASTER_CAP_MERGE_ROWS | RASTER_CAP_SPLIT_BANDS)) ? profile.maxBandRows : 1;
+  if (_maxBandRows < 1) {
+    _maxBandRows = 1;
+  } else if (_maxBandRows > RASTER_MAX_BAND_ROWS && (profile.caps & RASTER_CAP_MERGE_ROWS)) {
+    // Split bands are streamed, merged ones have to fit the buffer
+    _maxBandRows = RASTER_MAX_BAND_ROWS;
+  }
+  _output = output;
+  _context = context;
+  _bytesIn = 0;
+  _bytesOut = 0;
+  reset();
+}
+
+void RasterRecoder::reset() {
+  _state = PASS;
+  _rowLen = 0;
+  _rawLeft = 0;
+  _bandRows = 0;
+  _blankRows = 0;
+  _jobMargin = 0;
+  _margin = 0;
+  _outLen = 0;
+  _splitting = false;
+  if (_caps & RASTER_CAP_TSPL_BITMAP) {
+    _parser.begin(PRINT_DIALECT_TSPL, tsplEvent, this);
+  } else {
+    _parser.begin(PRINT_DIALECT_ESCPOS, escposEvent, this);
+  }
+}
+
+bool RasterRecoder::feed(const PrintSlice& slice) {
+  _bytesIn += slice.total();
+  if (slice.total() > 0) {
+    return _parser.feed(slice) && flushOutput();
+  }
+
+  // End of job: a header cut short is forwarded as it came, and rows of a
+  // BITMAP cut short still go out
+  bool ok = _parser.finish();
+  ok = ok && ((_caps & RASTER_CAP_TSPL_BITMAP) ? flushBitmap(false) : flushPending());
+  ok = ok && flushOutput();
+  reset();
+  return ok;
+}
+
+// Only GS v 0 blocks and the job's GS L are looked at. Every other command
+// goes through with its arguments and payload as the parser delimits them,
+// so a 1D byte inside an ESC * image, GS ( graphics or barcode data is
+// never taken for a command.
+bool RasterRecoder::escposEvent(void* context, const PrintEvent& event) {
+  RasterRecoder& recoder = *(RasterRecoder*)context;
+  if (event.command == PRINT_CMD_RASTER) {
+    return recoder.escposRaster(event);
+  }
+  if (!recoder.flushPending() || !recoder.emit(event.data, event.length)) {
+    return false;
+  }
+  if (event.type == PRINT_EVENT_COMMAND && event.length == 4 && event.data[0] == GS && event.data[1] == 'L') {
+    recoder._jobMargin = event.data[2] | (event.data[3] << 8);
+    recoder._margin = recoder._jobMargin;
+  }
+  return true;
+}
+
+bool RasterRecoder::escposRaster(const PrintEvent& event) {
+  switch (event.type) {
+    case PRINT_EVENT_COMMAND:
+      return rasterHeader(event);
+
+    case PRINT_EVENT_DATA: {
+      const uint8_t* data = event.data;
+      size_t len = event.length;
+      while (len > 0) {
+        size_t take = len;
+        if (_state == ROWS) {
+          take = _rowBytes - _rowLen;
+          if (take > len) {
+            take = len;
+          }
+          memcpy(_row + _rowLen, data, take);
+          _rowLen += take;
+          if (_rowLen == _rowBytes && !rowComplete()) {
+            return false;
+          }
+        } else if (_state == SPLIT_DATA) {
+          if (take > _rawLeft) {
+            take = _rawLeft;
+          }
+          if (!emit(data, take)) {
+            return false;
+          }
+          _rawLeft -= take;
+          if (_rawLeft == 0 && _rowsLeft > 0 && !splitBand()) {
+            return false;
+          }
+        } else if (!emit(data, take)) {
+          return false;
+        }
+        data += take;
+        len -= take;
+      }
+      return true;
+    }
+
+    case PRINT_EVENT_END:
+      _state = PASS;
+      return true;
+
+    default:
+      return emit(event.data, event.length);
+  }
+}
+
+// A GS v 0 m xL xH yL yH header: merged, split or forwarded as it is
+bool RasterRecoder::rasterHeader(const PrintEvent& event) {
+  const PrintCommandArgs& args = *event.args;
+  _mode = args.mode;
+  _rowBytes = args.width;
+  _rowsLeft = args.height;
+
+  bool rework = _caps & (RASTER_CAP_MERGE_ROWS | RASTER_CAP_FEED_BLANK | RASTER_CAP_CROP);
+  bool empty = _rowBytes == 0 || _rowsLeft == 0;
+  if (!empty && (_caps & RASTER_CAP_SPLIT_BANDS) && (!rework || _rowBytes > RASTER_MAX_WIDTH)) {
+    return flushPending() && splitBand();
+  }
+  if (empty || !rework || _rowBytes > RASTER_MAX_WIDTH) {
+    // Nothing we can merge: forward the block as it is
+    _state = empty ? PASS : RAW_DATA;
+    return flushPending() && emit(event.data, event.length);
+  }
+
+  _rowLen = 0;
+  _state = ROWS;
+  return true;
+}
+
+bool RasterRecoder::rowComplete() {
+  _rowLen = 0;
+  _rowsLeft--;
+  if (_rowsLeft == 0) {
+    _state = PASS;
+  }
+
+  bool blank = false;
+  if (_caps & RASTER_CAP_FEED_BLANK) {
+    blank = true;
+    for (size_t i = 0; i < _rowBytes && blank; i++) {
+      blank = (_row[i] == 0);
+    }
+  }
+
+  if (blank) {
+    // Double height modes print every row as two dots
+    _blankRows += (_mode & 2) ? 2 : 1;
+    return flushBand();
+  }
+
+  if (!flushFeed()) {
+    return false;
+  }
+  if (_bandRows > 0 && (_bandWidth != _rowBytes || _bandMode != _mode) && !flushBand()) {
+    return false;
+  }
+  memcpy(_band + _bandRows * _rowBytes, _row, _rowBytes);
+  _bandWidth = _rowBytes;
+  _bandMode = _mode;
+  _bandRows++;
+  return (_bandRows < _maxBandRows) || flushBand();
+}
+
+// Header of the next band of the block being split; its rows follow as they
+// come in
+bool RasterRecoder::splitBand() {
+  size_t rows = (_rowsLeft < _maxBandRows) ? _rowsLeft : _maxBandRows;
+  uint8_t header[ENCODE_ESCPOS_ROW_HEADER];
+  encodeEscPosRasterHeader(header, _mode, _rowBytes, rows);
+  _rowsLeft -= rows;
+  _rawLeft = rows * _rowBytes;
+  _state = SPLIT_DATA;
+  return emit(header, sizeof(header));
+}
+
+bool RasterRecoder::flushBand() {
+  if (_bandRows == 0) {
+    return true;
+  }
+  size_t width = _bandWidth;
+  if (_caps & RASTER_CAP_CROP) {
+    size_t left;
+    width = cropBand(width, 0x00, left);
+    // Double width modes print every bit as two dots
+    uint16_t margin = _jobMargin + left * ((_bandMode & 1) ? 16 : 8);
+    if (margin != _margin) {
+      uint8_t setMargin[4] = { GS, 'L', (uint8_t)(margin & 0xFF), (uint8_t)(margin >> 8) };
+      _margin = margin;
+      if (!emit(setMargin, sizeof(setMargin))) {
+        return false;
+      }
+    }
+  }
+  uint8_t header[ENCODE_ESCPOS_ROW_HEADER];
+  encodeEscPosRasterHeader(header, _bandMode, width, _bandRows);
+  size_t rows = _bandRows;
+  _bandRows = 0;
+  return emit(header, sizeof(header)) && emit(_band, rows * width);
+}
+
+// Narrows the rows in _band to the columns where any of them differs from
+// blank, in place. Returns the new width, at least one byte, and the bytes
+// cut off on the left.
+size_t RasterRecoder::cropBand(size_t width, uint8_t blank, size_t& left) {
+  size_t lo = width;
+  size_t hi = 0;
+  for (size_t r = 0; r < _bandRows; r++) {
+    const uint8_t* row = _band + r * width;
+    for (size_t i = 0; i < lo; i++) {
+      if (row[i] != blank) {
+        lo = i;
+        break;
+      }
+    }
+    for (size_t i = width; i > hi && i > lo; i--) {
+      if (row[i - 1] != blank) {
+        hi = i;
+        break;
+      }
+    }
+  }
+  if (lo >= hi) {
+    lo = 0;
+    hi = 1;
+  }
+  left = lo;
+  size_t cropped = hi - lo;
+  if (cropped == width) {
+    return width;
+  }
+  for (size_t r = 0; r < _bandRows; r++) {
+    memmove(_band + r * cropped, _band + r * width + lo, cropped);
+  }
+  return cropped;
+}
+
+bool RasterRecoder::restoreMargin() {
+  if (_margin == _jobMargin) {
+    return true;
+  }
+  uint8_t setMargin[4] = { GS, 'L', (uint8_t)(_jobMargin & 0xFF), (uint8_t)(_jobMargin >> 8) };
+  _margin = _jobMargin;
+  return emit(setMargin, sizeof(setMargin));
+}
+
+bool RasterRecoder::tsplEvent(void* context, const PrintEvent& event) {
+  RasterRecoder& recoder = *(RasterRecoder*)context;
+  if (event.command == PRINT_CMD_TSPL_BITMAP && (event.type == PRINT_EVENT_COMMAND || recoder._splitting)) {
+    return recoder.tsplBitmap(event);
+  }
+  return recoder.emit(event.data, event.length);
+}
+
+bool RasterRecoder::tsplBitmap(const PrintEvent& event) {
+  const PrintCommandArgs& args = *event.args;
+  switch (event.type) {
+    case PRINT_EVENT_COMMAND:
+      // Only overwrite bitmaps are split: in the other modes a white row
+      // isn't the same as leaving it out
+      _splitting = args.mode == 0 && args.width > 0 && args.width <= RASTER_MAX_WIDTH && args.height > 0;
+      if (!_splitting) {
+        return emit(event.data, event.length);
+      }
+      _bitmapX = args.x;
+      _bitmapY = args.y;
+      _rowBytes = args.width;
+      _mode = args.mode;
+      _rowLen = 0;
+      _bandRows = 0;
+      return true;
+
+    case PRINT_EVENT_DATA: {
+      const uint8_t* data = event.data;
+      size_t len = event.length;
+      while (len > 0) {
+        size_t take = _rowBytes - _rowLen;
+        if (take > len) {
+          take = len;
+        }
+        memcpy(_row + _rowLen, data, take);
+        _rowLen += take;
+        data += take;
+        len -= take;
+        if (_rowLen == _rowBytes && !tsplRow()) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    case PRINT_EVENT_END:
+      _splitting = false;
+      return flushBitmap(false);
+
+    default:
+      return emit(event.data, event.length);
+  }
+}
+
+// BITMAP prints 0 bits, so a white row is all ones
+bool RasterRecoder::tsplRow() {
+  _rowLen = 0;
+  uint16_t y = _bitmapY++;
+  bool white = true;
+  for (size_t i = 0; i < _rowBytes && white; i++) {
+    white = (_row[i] == 0xFF);
+  }
+  if (white) {
+    return flushBitmap(true);
+  }
+
+  if (_bandRows == 0) {
+    _bandY = y;
+  }
+  memcpy(_band + _bandRows * _rowBytes, _row, _rowBytes);
+  _bandRows++;
+  // The printer takes the whole label before printing, so pieces are as
+  // tall as the buffer allows
+  return (_bandRows < sizeof(_band) / _rowBytes) || flushBitmap(true);
+}
+
+// One piece of a split BITMAP. The line end of the original command follows
+// the last piece, the others get their own.
+bool RasterRecoder::flushBitmap(bool more) {
+  if (_bandRows == 0) {
+    return true;
+  }
+  size_t width = _rowBytes;
+  size_t left = 0;
+  if (_caps & RASTER_CAP_CROP) {
+    width = cropBand(width, 0xFF, left);
+  }
+  char header[48];
+  size_t len = encodeTsplBitmapHeader(header, sizeof(header), _bitmapX + left * 8, _bandY, width, _bandRows, _mode);
+  size_t rows = _bandRows;
+  _bandRows = 0;
+  return emit((const uint8_t*)header, len) && emit(_band, rows * width) &&
+         (!more || emit((const uint8_t*)"\r\n", 2));
+}
+
+bool RasterRecoder::flushFeed() {
+  while (_blankRows > 0) {
+    uint8_t dots = (_blankRows > 255) ? 255 : _blankRows;
+    uint8_t feed[3] = { ESC, 'J', dots };  // Print and feed n dots
+    _blankRows -= dots;
+    if (!emit(feed, sizeof(feed))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RasterRecoder::emit(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    size_t take = sizeof(_out) - _outLen;
+    if (take > len) {
+      take = len;
+    }
+    memcpy(_out + _outLen, data, take);
+    _outLen += take;
+    data += take;
+    len -= take;
+    if (_outLen == sizeof(_out) && !flushOutput()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RasterRecoder::flushOutput() {
+  if (_outLen == 0) {
+    return true;
+  }
+  PrintSlice slice = { { _out, nullptr }, { _outLen, 0 } };
+  _bytesOut += _outLen;
+  _outLen = 0;
+  return _output(_context, slice);
+}
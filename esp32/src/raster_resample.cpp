@@ -0,0 +1,259 @@
+#include "raster_resample.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "printer_encoder.h"
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+  while (b != 0) {
+    uint32_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Dots of the other grid needed to cover count dots of this one
+static uint32_t scaled(uint32_t count, uint32_t fromUnit, uint32_t toUnit) {
+  return (count * fromUnit + toUnit - 1) / toUnit;
+}
+
+bool RasterResampler::begin(uint16_t sourceDpi, uint16_t targetDpi, uint16_t maxDots, PrintSink output,
+                            void* context) {
+  _output = output;
+  _context = context;
+  _active = false;
+  _blocks = 0;
+  _block = BLOCK_NONE;
+  _outLen = 0;
+
+  bool scale = sourceDpi != 0 && targetDpi != 0 && sourceDpi != targetDpi;
+  if (!scale && maxDots == 0) {
+    return false;
+  }
+  if (scale) {
+    uint32_t common = gcd(sourceDpi, targetDpi);
+    _sourceUnit = targetDpi / common;
+    _outputUnit = sourceDpi / common;
+  } else {
+    _sourceUnit = 1;
+    _outputUnit = 1;
+  }
+  _maxDots = (maxDots == 0 || maxDots > RESAMPLE_MAX_DOTS) ? RESAMPLE_MAX_DOTS : maxDots;
+
+  if (_row == nullptr) {
+    _row = (uint8_t*)malloc(RESAMPLE_MAX_SOURCE_BYTES);
+    _cover = (uint16_t*)malloc(RESAMPLE_MAX_DOTS * sizeof(uint16_t));
+    _area = (uint32_t*)malloc(RESAMPLE_MAX_DOTS * sizeof(uint32_t));
+    _line = (uint8_t*)malloc(RESAMPLE_MAX_DOTS / 8);
+  }
+  if (_row == nullptr || _cover == nullptr || _area == nullptr || _line == nullptr) {
+    release();
+    return false;
+  }
+
+  _parser.begin(PRINT_DIALECT_AUTO, streamEvent, this);
+  _active = true;
+  return true;
+}
+
+void RasterResampler::release() {
+  free(_row);
+  free(_cover);
+  free(_area);
+  free(_line);
+  _row = nullptr;
+  _cover = nullptr;
+  _area = nullptr;
+  _line = nullptr;
+}
+
+bool RasterResampler::feed(const PrintSlice& slice) {
+  if (slice.total() > 0) {
+    return _parser.feed(slice) && flushOutput();
+  }
+
+  // End of job: a block cut short is filled up with white rows, so the
+  // header that already went out stays true
+  bool ok = _parser.finish();
+  if (_block == BLOCK_SCALE) {
+    ok = finishBlock() && ok;
+  }
+  ok = flushOutput() && ok;
+  _block = BLOCK_NONE;
+  _active = false;
+  // The row buffers stay for the next job, so a job never waits on the heap
+  return ok;
+}
+
+bool RasterResampler::streamEvent(void* context, const PrintEvent& event) {
+  RasterResampler* self = (RasterResampler*)context;
+  if (event.command != PRINT_CMD_RASTER || self->_parser.dialect() == PRINT_DIALECT_TSPL) {
+    return self->emit(event.data, event.length);
+  }
+
+  switch (event.type) {
+    case PRINT_EVENT_COMMAND:
+      return self->beginBlock(event);
+    case PRINT_EVENT_DATA:
+      if (self->_block == BLOCK_PASS) {
+        return self->emit(event.data, event.length);
+      }
+      for (size_t i = 0; i < event.length; i++) {
+        if (!self->sourceByte(event.data[i])) {
+          return false;
+        }
+      }
+      return true;
+    case PRINT_EVENT_END: {
+      bool ok = self->_block != BLOCK_SCALE || self->finishBlock();
+      self->_block = BLOCK_NONE;
+      return ok;
+    }
+    default:
+      return self->emit(event.data, event.length);
+  }
+}
+
+bool RasterResampler::beginBlock(const PrintEvent& event) {
+  const PrintCommandArgs& args = *event.args;
+  // Double width modes print every dot twice across
+  uint32_t maxDots = (args.mode & 1) ? _maxDots / 2 : _maxDots;
+  uint32_t sourceDots = (uint32_t)args.width * 8;
+  uint32_t outputDots = scaled(sourceDots, _sourceUnit, _outputUnit);
+  uint32_t outputRows = scaled(args.height, _sourceUnit, _outputUnit);
+  if (outputDots > maxDots) {
+    outputDots = maxDots & ~7u;
+  }
+
+  bool unchanged = _sourceUnit == _outputUnit && outputDots == sourceDots;
+  if (unchanged || args.width == 0 || args.height == 0 || args.width > RESAMPLE_MAX_SOURCE_BYTES ||
+      outputDots == 0 || outputRows > 0xFFFF) {
+    _block = BLOCK_PASS;
+    return emit(event.data, event.length);
+  }
+
+  _block = BLOCK_SCALE;
+  _blocks++;
+  _sourceBytes = args.width;
+  _sourceRows = args.height;
+  _sourceRow = 0;
+  _rowLen = 0;
+  _outputDots = outputDots;
+  _outputRows = outputRows;
+  _outputRow = 0;
+  memset(_area, 0, _outputDots * sizeof(uint32_t));
+
+  uint16_t outputBytes = (_outputDots + 7) / 8;
+  uint8_t header[ENCODE_ESCPOS_ROW_HEADER];
+  encodeEscPosRasterHeader(header, args.mode, outputBytes, _outputRows);
+  return emit(header, sizeof(header));
+}
+
+bool RasterResampler::sourceByte(uint8_t b) {
+  _row[_rowLen++] = b;
+  if (_rowLen < _sourceBytes) {
+    return true;
+  }
+  _rowLen = 0;
+  return sourceRow();
+}
+
+bool RasterResampler::sourceRow() {
+  // Inked length of this row under each output dot, from its inked source
+  // dots only
+  memset(_cover, 0, _outputDots * sizeof(uint16_t));
+  bool blank = true;
+  for (uint16_t byte = 0; byte < _sourceBytes; byte++) {
+    if (_row[byte] == 0) {
+      continue;
+    }
+    blank = false;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      if (!(_row[byte] & (0x80 >> bit))) {
+        continue;
+      }
+      uint32_t start = ((uint32_t)byte * 8 + bit) * _sourceUnit;
+      uint32_t end = start + _sourceUnit;
+      for (uint32_t dot = start / _outputUnit; dot < _outputDots && dot * _outputUnit < end; dot++) {
+        uint32_t from = dot * _outputUnit > start ? dot * _outputUnit : start;
+        uint32_t to = (dot + 1) * _outputUnit < end ? (dot + 1) * _outputUnit : end;
+        _cover[dot] += to - from;
+      }
+    }
+  }
+
+  // Spread it over the output rows this source row overlaps, putting out
+  // each one it completes
+  uint32_t start = (uint32_t)_sourceRow * _sourceUnit;
+  uint32_t end = start + _sourceUnit;
+  _sourceRow++;
+  while (_outputRow < _outputRows) {
+    uint32_t rowStart = (uint32_t)_outputRow * _outputUnit;
+    uint32_t rowEnd = rowStart + _outputUnit;
+    uint32_t from = rowStart > start ? rowStart : start;
+    uint32_t to = rowEnd < end ? rowEnd : end;
+    if (!blank && to > from) {
+      for (uint16_t dot = 0; dot < _outputDots; dot++) {
+        _area[dot] += (uint32_t)_cover[dot] * (to - from);
+      }
+    }
+    if (rowEnd > end) {
+      break;
+    }
+    if (!outputRow()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RasterResampler::outputRow() {
+  uint16_t outputBytes = (_outputDots + 7) / 8;
+  uint32_t full = _outputUnit * _outputUnit;
+  memset(_line, 0, outputBytes);
+  for (uint16_t dot = 0; dot < _outputDots; dot++) {
+    if (_area[dot] * 2 >= full) {
+      _line[dot / 8] |= 0x80 >> (dot % 8);
+    }
+  }
+  memset(_area, 0, _outputDots * sizeof(uint32_t));
+  _outputRow++;
+  return emit(_line, outputBytes);
+}
+
+bool RasterResampler::finishBlock() {
+  // Rows the source ended inside of, and those of a block cut short
+  while (_outputRow < _outputRows) {
+    if (!outputRow()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RasterResampler::emit(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    size_t take = sizeof(_out) - _outLen;
+    if (take > len) {
+      take = len;
+    }
+    memcpy(_out + _outLen, data, take);
+    _outLen += take;
+    data += take;
+    len -= take;
+    if (_outLen == sizeof(_out) && !flushOutput()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RasterResampler::flushOutput() {
+  if (_outLen == 0) {
+    return true;
+  }
+  PrintSlice slice = { { _out, nullptr }, { _outLen, 0 } };
+  _outLen = 0;
+  return _output(_context, slice);
+}
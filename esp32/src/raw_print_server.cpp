@@ -0,0 +1,134 @@
+#include "raw_print_server.h"
+#include "print_writer.h"
+#include "heap_stats.h"
+
+#include <lwip/sockets.h>
+
+// One TCP segment's worth at a time is plenty; the job ring does the buffering
+static const size_t RAW_RECV_SIZE = 2048;
+
+struct RawListener {
+  uint8_t printer;
+  uint16_t port;
+  TaskHandle_t task;
+  volatile uint32_t jobId;
+  uint8_t buffer[RAW_RECV_SIZE];
+};
+
+static RawListener listeners[MAX_PRINTERS];
+static RawPrintGate rawPrinterReady = nullptr;
+
+static void serveClient(RawListener& listener, int sock, const char* peer) {
+  if (rawPrinterReady != nullptr && !rawPrinterReady(listener.printer)) {
+    log_w("Raw print from %s refused, printer not connected", peer);
+    return;
+  }
+
+  PrintJobReject reject;
+  uint32_t id = createPrintJob(listener.printer, PRINT_JOB_LENGTH_UNKNOWN, reject);
+  if (id == 0) {
+    log_w("Raw print from %s refused, queue full", peer);
+    return;
+  }
+  setPrintJobClient(id, printClientKey(peer));
+  listener.jobId = id;
+  log_i("Raw print job %u from %s on port %u", id, peer, listener.port);
+
+  struct timeval timeout;
+  timeout.tv_sec = RAW_PRINT_IDLE_TIMEOUT / 1000;
+  timeout.tv_usec = (RAW_PRINT_IDLE_TIMEOUT % 1000) * 1000;
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  size_t received = 0;
+  for (;;) {
+    int n = recv(sock, listener.buffer, sizeof(listener.buffer), 0);
+    if (n <= 0) {
+      // 0 is the spooler closing the job, anything else an idle timeout or
+      // reset; either way the data so far is the whole job
+      break;
+    }
+    // While the job buffer is full this blocks, so the socket isn't read and
+    // the TCP window closes on the client: the back-pressure towards the
+    // spooler
+    if (!appendPrintJobWait(id, listener.buffer, n)) {
+      log_e("Raw print job %u failed, closing connection", id);
+      break;
+    }
+    received += n;
+  }
+
+  finishPrintJob(id);
+  listener.jobId = 0;
+  log_i("Raw print job %u received, %u bytes", id, received);
+}
+
+static void rawPrintTask(void* param) {
+  RawListener& rawListener = *(RawListener*)param;
+  int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  if (listener < 0) {
+    log_e("Raw print socket failed");
+    vTaskDelete(nullptr);
+    return;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(rawListener.port);
+
+  int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 2) != 0) {
+    log_e("Raw print listener could not bind port %u", rawListener.port);
+    close(listener);
+    vTaskDelete(nullptr);
+    return;
+  }
+  log_i("Raw print listener for printer %u on port %u", rawListener.printer, rawListener.port);
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+
+  for (;;) {
+    struct sockaddr_in peerAddr;
+    socklen_t peerLen = sizeof(peerAddr);
+    int sock = accept(listener, (struct sockaddr*)&peerAddr, &peerLen);
+    if (sock < 0) {
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+
+    char peer[16];
+    inet_ntoa_r(peerAddr.sin_addr, peer, sizeof(peer));
+    serveClient(rawListener, sock, peer);
+    close(sock);
+  }
+}
+
+bool initRawPrintServer(uint8_t printer, uint16_t port, RawPrintGate printerReady) {
+  if (printer >= MAX_PRINTERS) {
+    return false;
+  }
+  RawListener& listener = listeners[printer];
+  if (port == 0 || listener.task != nullptr) {
+    return listener.task != nullptr;
+  }
+
+  listener.printer = printer;
+  listener.port = port;
+  listener.jobId = 0;
+  rawPrinterReady = printerReady;
+
+  char name[16];
+  snprintf(name, sizeof(name), "rawPrint%u", printer);
+  if (xTaskCreatePinnedToCore(rawPrintTask, name, 4096, &listener,
+                              RAW_PRINT_PRIORITY, &listener.task, RAW_PRINT_CORE) != pdPASS) {
+    log_e("Failed to start raw print task for port %u", port);
+    listener.task = nullptr;
+    return false;
+  }
+  return true;
+}
+
+uint32_t rawPrintActiveJob(uint8_t printer) {
+  return printer < MAX_PRINTERS ? listeners[printer].jobId : 0;
+}
@@ -0,0 +1,162 @@
+#include "resumable_upload.h"
+#include "print_writer.h"
+
+struct OpenUpload {
+  uint32_t jobId;       // 0 marks a free slot
+  uint32_t lastSegment; // ms since boot
+  size_t total;         // PRINT_JOB_LENGTH_UNKNOWN until a segment names it
+};
+
+static OpenUpload uploads[UPLOAD_RESUME_SLOTS];
+static SemaphoreHandle_t uploadLock = nullptr;
+
+bool initResumableUploads() {
+  uploadLock = xSemaphoreCreateMutex();
+  return uploadLock != nullptr;
+}
+
+// Caller holds uploadLock
+static OpenUpload* findUpload(uint32_t jobId) {
+  for (size_t i = 0; i < UPLOAD_RESUME_SLOTS; i++) {
+    if (uploads[i].jobId == jobId && jobId != 0) {
+      return &uploads[i];
+    }
+  }
+  return nullptr;
+}
+
+static void closeUpload(uint32_t jobId) {
+  xSemaphoreTake(uploadLock, portMAX_DELAY);
+  OpenUpload* upload = findUpload(jobId);
+  if (upload != nullptr) {
+    upload->jobId = 0;
+  }
+  xSemaphoreGive(uploadLock);
+}
+
+bool openResumableUpload(uint32_t jobId, size_t length) {
+  if (uploadLock == nullptr) {
+    return false;
+  }
+  xSemaphoreTake(uploadLock, portMAX_DELAY);
+  OpenUpload* upload = nullptr;
+  for (size_t i = 0; i < UPLOAD_RESUME_SLOTS && upload == nullptr; i++) {
+    upload = uploads[i].jobId == 0 ? &uploads[i] : nullptr;
+  }
+  if (upload != nullptr) {
+    upload->jobId = jobId;
+    upload->lastSegment = millis();
+    upload->total = length;
+  }
+  xSemaphoreGive(uploadLock);
+  return upload != nullptr;
+}
+
+bool isResumableUpload(uint32_t jobId) {
+  if (uploadLock == nullptr) {
+    return false;
+  }
+  xSemaphoreTake(uploadLock, portMAX_DELAY);
+  bool open = findUpload(jobId) != nullptr;
+  xSemaphoreGive(uploadLock);
+  return open;
+}
+
+// Touch the upload and take the size total names, unless the upload has
+// another or more than that was received. False for an unknown upload.
+static bool touchUpload(uint32_t jobId, size_t total, size_t received, size_t& uploadTotal, bool& mismatch) {
+  if (uploadLock == nullptr) {
+    return false;
+  }
+  xSemaphoreTake(uploadLock, portMAX_DELAY);
+  OpenUpload* upload = findUpload(jobId);
+  if (upload != nullptr) {
+    upload->lastSegment = millis();
+    if (total != PRINT_JOB_LENGTH_UNKNOWN) {
+      mismatch = upload->total != PRINT_JOB_LENGTH_UNKNOWN ? total != upload->total : total < received;
+      if (!mismatch) {
+        upload->total = total;
+      }
+    }
+    uploadTotal = upload->total;
+  }
+  xSemaphoreGive(uploadLock);
+  return upload != nullptr;
+}
+
+static void completeUpload(uint32_t jobId, size_t received) {
+  log_i("Job %u resumable upload complete, %u bytes", jobId, received);
+  closeUpload(jobId);
+  finishPrintJob(jobId);
+}
+
+UploadSegmentResult writeUploadSegment(uint32_t jobId, size_t offset, const uint8_t* data, size_t length,
+                                       size_t total, uint32_t timeoutMs, size_t& received) {
+  size_t uploadTotal = PRINT_JOB_LENGTH_UNKNOWN;
+  bool mismatch = false;
+  PrintJobInfo info;
+  if (!getPrintJob(jobId, info) || !touchUpload(jobId, total, info.received, uploadTotal, mismatch)) {
+    return SEGMENT_UNKNOWN;
+  }
+  received = info.received;
+  bool known = uploadTotal != PRINT_JOB_LENGTH_UNKNOWN;
+  if (mismatch) {
+    return SEGMENT_LENGTH;
+  }
+  if (offset > received) {
+    return SEGMENT_GAP;
+  }
+
+  // Only what lies past the received data, and within the job
+  size_t skip = received - offset;
+  size_t fresh = length > skip ? length - skip : 0;
+  if (known && received + fresh > uploadTotal) {
+    fresh = uploadTotal - received;
+  }
+  size_t queued = fresh > 0 ? appendPrintJob(jobId, data + skip, fresh, timeoutMs) : 0;
+  received += queued;
+
+  if (known && received >= uploadTotal) {
+    completeUpload(jobId, received);
+  }
+  return queued < fresh ? SEGMENT_FULL : SEGMENT_OK;
+}
+
+UploadSegmentResult endUploadAt(uint32_t jobId, size_t total, size_t& received) {
+  size_t uploadTotal = PRINT_JOB_LENGTH_UNKNOWN;
+  bool mismatch = false;
+  PrintJobInfo info;
+  if (!getPrintJob(jobId, info) || !touchUpload(jobId, total, info.received, uploadTotal, mismatch)) {
+    return SEGMENT_UNKNOWN;
+  }
+  received = info.received;
+  if (mismatch) {
+    return SEGMENT_LENGTH;
+  }
+  if (received == uploadTotal) {
+    completeUpload(jobId, received);
+  }
+  return SEGMENT_OK;
+}
+
+void serviceResumableUploads() {
+  if (uploadLock == nullptr) {
+    return;
+  }
+  uint32_t now = millis();
+  uint32_t expired[UPLOAD_RESUME_SLOTS];
+  size_t count = 0;
+  xSemaphoreTake(uploadLock, portMAX_DELAY);
+  for (size_t i = 0; i < UPLOAD_RESUME_SLOTS; i++) {
+    if (uploads[i].jobId != 0 && now - uploads[i].lastSegment >= UPLOAD_RESUME_IDLE_MS) {
+      expired[count++] = uploads[i].jobId;
+      uploads[i].jobId = 0;
+    }
+  }
+  xSemaphoreGive(uploadLock);
+
+  for (size_t i = 0; i < count; i++) {
+    log_w("Job %u resumable upload idle, failing it", expired[i]);
+    abortPrintJob(expired[i]);
+  }
+}
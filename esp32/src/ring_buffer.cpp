@@ -0,0 +1,126 @@
+#include "ring_buffer.h"
+#include "hot_path.h"
+
+#include <string.h>
+#include <stdlib.h>
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+RingBuffer::~RingBuffer() {
+  end();
+}
+
+bool RingBuffer::begin(size_t capacity) {
+  end();
+
+  // Round up to a power of two so the free-running counters stay
+  // consistent with the storage index when they wrap around
+  size_t rounded = 1;
+  while (rounded < capacity) {
+    rounded <<= 1;
+  }
+  capacity = rounded;
+
+#ifdef ESP_PLATFORM
+  _buf = (uint8_t*)heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  _inPsram = (_buf != nullptr);
+#endif
+  if (_buf == nullptr) {
+    _buf = (uint8_t*)malloc(capacity);
+  }
+  if (_buf == nullptr) {
+    return false;
+  }
+
+  _capacity = capacity;
+  _head.store(0, std::memory_order_relaxed);
+  _tail.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+void RingBuffer::end() {
+  if (_buf != nullptr) {
+    free(_buf);
+    _buf = nullptr;
+  }
+  _capacity = 0;
+  _inPsram = false;
+}
+
+size_t HOT_PATH RingBuffer::write(const uint8_t* data, size_t len) {
+  size_t head = _head.load(std::memory_order_relaxed);
+  size_t tail = _tail.load(std::memory_order_acquire);
+  size_t free = _capacity - (head - tail);
+  if (len > free) {
+    len = free;
+  }
+  if (len == 0) {
+    return 0;
+  }
+
+  // Copy in at most two pieces: up to the end of storage, then from the start
+  size_t pos = head & (_capacity - 1);
+  size_t first = _capacity - pos;
+  if (first > len) {
+    first = len;
+  }
+  memcpy(_buf + pos, data, first);
+  memcpy(_buf, data + first, len - first);
+
+  _head.store(head + len, std::memory_order_release);
+  return len;
+}
+
+size_t HOT_PATH RingBuffer::peek(const uint8_t** data) const {
+  size_t tail = _tail.load(std::memory_order_relaxed);
+  size_t head = _head.load(std::memory_order_acquire);
+  size_t used = head - tail;
+  if (used == 0) {
+    *data = nullptr;
+    return 0;
+  }
+
+  size_t pos = tail & (_capacity - 1);
+  size_t contiguous = _capacity - pos;
+  *data = _buf + pos;
+  return (used < contiguous) ? used : contiguous;
+}
+
+size_t HOT_PATH RingBuffer::peek(const uint8_t** first, size_t* firstLen,
+                                 const uint8_t** second, size_t* secondLen) const {
+  // One snapshot of head: the producer may move it while this runs, and
+  // both spans have to come from the same one
+  size_t tail = _tail.load(std::memory_order_relaxed);
+  size_t head = _head.load(std::memory_order_acquire);
+  size_t used = head - tail;
+  size_t pos = tail & (_capacity - 1);
+  size_t contiguous = _capacity - pos;
+  *firstLen = (used < contiguous) ? used : contiguous;
+  *first = (used > 0) ? _buf + pos : nullptr;
+  *secondLen = used - *firstLen;
+  *second = (*secondLen > 0) ? _buf : nullptr;
+  return used;
+}
+
+void HOT_PATH RingBuffer::consume(size_t len) {
+  size_t tail = _tail.load(std::memory_order_relaxed);
+  _tail.store(tail + len, std::memory_order_release);
+}
+
+void RingBuffer::rewind(size_t len) {
+  size_t tail = _tail.load(std::memory_order_relaxed);
+  _tail.store(tail - len, std::memory_order_release);
+}
+
+void RingBuffer::clear() {
+  _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+size_t HOT_PATH RingBuffer::available() const {
+  return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+}
+
+size_t HOT_PATH RingBuffer::space() const {
+  return _capacity - available();
+}
@@ -0,0 +1,199 @@
+#include "screen_mirror.h"
+
+#include "heap_stats.h"
+
+static AsyncWebSocket screenSocket(SCREEN_MIRROR_PATH);
+static volatile bool keyframe = true;        // Send every tile next frame
+
+static uint32_t* tileHashes = nullptr;
+static int16_t hashedWidth = 0;
+static int16_t hashedHeight = 0;
+
+static uint8_t message[SCREEN_MIRROR_MESSAGE];
+static size_t messageUsed = 0;
+static uint16_t messageTiles = 0;
+
+static const size_t HEADER_BYTES = 6;
+static const size_t TILE_HEADER_BYTES = 8;
+// A tile of literals, one run byte per 128 words
+static const size_t TILE_MAX_BYTES =
+    TILE_HEADER_BYTES + SCREEN_MIRROR_TILE * SCREEN_MIRROR_TILE * 2 +
+    (SCREEN_MIRROR_TILE * SCREEN_MIRROR_TILE + 127) / 128;
+static_assert(HEADER_BYTES + TILE_MAX_BYTES <= SCREEN_MIRROR_MESSAGE, "SCREEN_MIRROR_MESSAGE under one tile");
+
+// Hashes of the tiles in the message, kept once it is sent
+static const size_t MESSAGE_MAX_TILES = SCREEN_MIRROR_MESSAGE / (TILE_HEADER_BYTES + 3);
+static uint16_t pendingTile[MESSAGE_MAX_TILES];
+static uint32_t pendingHash[MESSAGE_MAX_TILES];
+
+static void put16(uint8_t* at, uint16_t value) {
+  at[0] = value & 0xFF;
+  at[1] = value >> 8;
+}
+
+// Sprite pixels are in panel byte order
+static inline uint16_t pixelAt(const uint16_t* pixels, int16_t width, int16_t x, int16_t y) {
+  uint16_t raw = pixels[y * width + x];
+  return raw >> 8 | raw << 8;
+}
+
+static uint32_t hashTile(const uint16_t* pixels, int16_t width, int16_t x0, int16_t y0, int16_t w, int16_t h) {
+  uint32_t hash = 2166136261u;               // FNV-1a over the words
+  for (int16_t y = y0; y < y0 + h; y++) {
+    const uint16_t* row = pixels + y * width + x0;
+    for (int16_t x = 0; x < w; x++) {
+      hash = (hash ^ row[x]) * 16777619u;
+    }
+  }
+  return hash;
+}
+
+static void beginMessage(int16_t width, int16_t height) {
+  put16(message, width);
+  put16(message + 2, height);
+  messageUsed = HEADER_BYTES;
+  messageTiles = 0;
+}
+
+// False when a client can't take it; the message is dropped and its tiles
+// keep the hashes they had
+static bool sendMessage() {
+  if (messageTiles == 0) {
+    return true;
+  }
+  HeapRegionStats internal;
+  getInternalHeapStats(internal);
+  bool sent = internal.free >= HEAP_INTERNAL_RESERVE && screenSocket.availableForWriteAll();
+  if (sent) {
+    put16(message + 4, messageTiles);
+    screenSocket.binaryAll(message, messageUsed);
+    for (uint16_t i = 0; i < messageTiles; i++) {
+      tileHashes[pendingTile[i]] = pendingHash[i];
+    }
+  }
+  messageUsed = HEADER_BYTES;
+  messageTiles = 0;
+  return sent;
+}
+
+// The counts of runs go in their byte when the run ends
+static void encodeTile(const uint16_t* pixels, int16_t width, int16_t x0, int16_t y0, int16_t w, int16_t h,
+                       uint16_t index, uint32_t hash) {
+  pendingTile[messageTiles] = index;
+  pendingHash[messageTiles] = hash;
+  uint8_t* tile = message + messageUsed;
+  put16(tile, x0);
+  put16(tile + 2, y0);
+  tile[4] = w;
+  tile[5] = h;
+  uint8_t* out = tile + TILE_HEADER_BYTES;
+
+  int32_t count = w * h;
+  int32_t i = 0;
+  uint8_t* literal = nullptr;                // Run byte of the open literal run
+  while (i < count) {
+    uint16_t color = pixelAt(pixels, width, x0 + i % w, y0 + i / w);
+    int32_t repeat = 1;
+    while (i + repeat < count && repeat < 128 &&
+           pixelAt(pixels, width, x0 + (i + repeat) % w, y0 + (i + repeat) / w) == color) {
+      repeat++;
+    }
+    if (repeat >= 2) {
+      literal = nullptr;
+      *out++ = 0x80 | (repeat - 1);
+      put16(out, color);
+      out += 2;
+      i += repeat;
+      continue;
+    }
+    if (literal == nullptr || *literal == 127) {
+      literal = out++;
+      *literal = 0;
+    } else {
+      (*literal)++;
+    }
+    put16(out, color);
+    out += 2;
+    i++;
+  }
+
+  put16(tile + 6, out - tile - TILE_HEADER_BYTES);
+  messageUsed = out - message;
+  messageTiles++;
+}
+
+static void onScreenSocketEvent(AsyncWebSocket* socket, AsyncWebSocketClient* client,
+                                AwsEventType type, void* arg, uint8_t* data, size_t len) {
+  if (type != WS_EVT_CONNECT) {
+    return;
+  }
+  if (socket->count() > SCREEN_MIRROR_CLIENTS) {
+    client->close();
+    return;
+  }
+  keyframe = true;
+  log_i("Screen mirror client %u", client->id());
+}
+
+void initScreenMirror(AsyncWebServer& server) {
+  screenSocket.onEvent(onScreenSocketEvent);
+  server.addHandler(&screenSocket);
+}
+
+void screenMirrorFrame(TFT_eSprite* screen) {
+  screenSocket.cleanupClients(SCREEN_MIRROR_CLIENTS);
+  if (screen == nullptr || screenSocket.count() == 0) {
+    return;
+  }
+  const uint16_t* pixels = (const uint16_t*)screen->getPointer();
+  int16_t width = screen->width();
+  int16_t height = screen->height();
+  if (pixels == nullptr) {
+    return;
+  }
+
+  int16_t columns = (width + SCREEN_MIRROR_TILE - 1) / SCREEN_MIRROR_TILE;
+  int16_t rows = (height + SCREEN_MIRROR_TILE - 1) / SCREEN_MIRROR_TILE;
+  if (tileHashes == nullptr || width != hashedWidth || height != hashedHeight) {
+    free(tileHashes);
+    tileHashes = (uint32_t*)calloc(columns * rows, sizeof(uint32_t));
+    if (tileHashes == nullptr) {
+      log_w("No memory for the screen mirror");
+      return;
+    }
+    hashedWidth = width;
+    hashedHeight = height;
+    keyframe = true;
+  }
+
+  bool all = keyframe;
+  keyframe = false;
+  beginMessage(width, height);
+  for (int16_t row = 0; row < rows; row++) {
+    for (int16_t column = 0; column < columns; column++) {
+      int16_t x = column * SCREEN_MIRROR_TILE;
+      int16_t y = row * SCREEN_MIRROR_TILE;
+      int16_t w = min<int16_t>(SCREEN_MIRROR_TILE, width - x);
+      int16_t h = min<int16_t>(SCREEN_MIRROR_TILE, height - y);
+      uint16_t index = row * columns + column;
+      uint32_t hash = hashTile(pixels, width, x, y, w, h);
+      if (!all && hash == tileHashes[index]) {
+        continue;
+      }
+      bool full = messageUsed + TILE_MAX_BYTES > sizeof(message) || messageTiles == MESSAGE_MAX_TILES;
+      if (full && !sendMessage()) {
+        // The tiles not sent go with a later frame
+        keyframe = all;
+        return;
+      }
+      encodeTile(pixels, width, x, y, w, h, index, hash);
+    }
+  }
+  if (!sendMessage()) {
+    keyframe = all;
+  }
+}
+
+size_t screenMirrorClients() {
+  return screenSocket.count();
+}
@@ -0,0 +1,470 @@
+#include "soak_test.h"
+
+#if SOAK_TEST
+
+#include "ble_printer.h"
+#include "heap_stats.h"
+#include "http_admission.h"
+#include "link_bench.h"
+#include "print_writer.h"
+#include "status_json.h"
+
+#include <algorithm>
+
+static_assert(SOAK_WINDOW > 0 && SOAK_WINDOW <= 32, "SOAK_WINDOW takes 1 to 32 samples");
+static_assert(SOAK_SAMPLES >= SOAK_WINDOW, "SOAK_SAMPLES must hold a window");
+
+// Latency growth below these is noise whatever the percentage says
+static const uint32_t LATENCY_SLACK_MS = 50;
+static const uint32_t RECONNECT_SLACK_MS = 1000;
+
+// Job latencies of one sample interval kept for its p99; the rest of a
+// busier interval is left out
+static const size_t INTERVAL_JOBS = 64;
+
+struct SoakSample {
+  uint32_t uptimeS;
+  uint32_t largestBlock;
+  uint32_t minFree;
+  uint32_t freeHeap;
+  uint32_t p99Ms;        // 0 without jobs in the interval
+  uint32_t reconnectMs;  // Slowest of the interval, 0 without one
+  uint16_t jobs;
+  uint16_t errors;
+};
+
+enum SoakFailure : uint8_t {
+  SOAK_FAIL_BLOCK = 1,
+  SOAK_FAIL_MIN_FREE = 2,
+  SOAK_FAIL_FREE = 4,
+  SOAK_FAIL_LATENCY = 8,
+  SOAK_FAIL_RECONNECT = 16,
+  SOAK_FAIL_ERRORS = 32
+};
+
+static const char* const FAILURE_NAMES[] = {"largestBlock", "minFree", "freeHeap", "p99Ms", "reconnectMs", "errors"};
+static const size_t FAILURE_COUNT = sizeof(FAILURE_NAMES) / sizeof(FAILURE_NAMES[0]);
+
+// Written by the soak task, read by the HTTP handler under soakLock
+static SemaphoreHandle_t soakLock = nullptr;
+static SoakSample samples[SOAK_SAMPLES];
+static uint32_t sampleCount = 0;       // Ever taken; the ring keeps the last SOAK_SAMPLES
+static SoakSample baseline = {};
+static SoakSample current = {};
+static bool haveBaseline = false;
+static uint8_t failures = 0;
+static uint32_t jobCount = 0;
+static uint32_t reconnectCount = 0;
+static uint32_t errorCount = 0;
+
+// The interval being sampled, soak task only
+static uint32_t intervalLatencies[INTERVAL_JOBS];
+static size_t intervalJobs = 0;
+static uint32_t intervalReconnectMs = 0;
+static uint16_t intervalErrors = 0;
+
+static const SoakSample& sampleAt(uint32_t n) {
+  return samples[n % SOAK_SAMPLES];
+}
+
+// Median of one field over samples [from, from + SOAK_WINDOW), leaving out
+// the zeros of intervals without jobs or reconnects; 0 when all are zero
+static uint32_t medianOf(uint32_t from, uint32_t SoakSample::*field) {
+  uint32_t values[SOAK_WINDOW];
+  size_t n = 0;
+  for (uint32_t i = from; i < from + SOAK_WINDOW; i++) {
+    uint32_t v = sampleAt(i).*field;
+    if (v != 0) {
+      values[n++] = v;
+    }
+  }
+  if (n == 0) {
+    return 0;
+  }
+  std::nth_element(values, values + n / 2, values + n);
+  return values[n / 2];
+}
+
+static SoakSample windowMedians(uint32_t from) {
+  SoakSample m = {};
+  m.uptimeS = sampleAt(from + SOAK_WINDOW - 1).uptimeS;
+  m.largestBlock = medianOf(from, &SoakSample::largestBlock);
+  m.minFree = medianOf(from, &SoakSample::minFree);
+  m.freeHeap = medianOf(from, &SoakSample::freeHeap);
+  m.p99Ms = medianOf(from, &SoakSample::p99Ms);
+  m.reconnectMs = medianOf(from, &SoakSample::reconnectMs);
+  return m;
+}
+
+static bool grew(uint32_t now, uint32_t base, uint32_t pct, uint32_t slack) {
+  return base != 0 && now > base + slack && now > base + (uint64_t)base * pct / 100;
+}
+
+// Under soakLock
+static uint8_t findDrift() {
+  uint8_t found = errorCount > SOAK_MAX_ERRORS ? SOAK_FAIL_ERRORS : 0;
+  if (!haveBaseline) {
+    return found;
+  }
+  if (current.largestBlock < baseline.largestBlock - (uint64_t)baseline.largestBlock * SOAK_BLOCK_DRIFT_PCT / 100) {
+    found |= SOAK_FAIL_BLOCK;
+  }
+  if (current.minFree + SOAK_HEAP_DRIFT_BYTES < baseline.minFree) {
+    found |= SOAK_FAIL_MIN_FREE;
+  }
+  if (current.freeHeap + SOAK_HEAP_DRIFT_BYTES < baseline.freeHeap) {
+    found |= SOAK_FAIL_FREE;
+  }
+  if (grew(current.p99Ms, baseline.p99Ms, SOAK_LATENCY_DRIFT_PCT, LATENCY_SLACK_MS)) {
+    found |= SOAK_FAIL_LATENCY;
+  }
+  if (grew(current.reconnectMs, baseline.reconnectMs, SOAK_RECONNECT_DRIFT_PCT, RECONNECT_SLACK_MS)) {
+    found |= SOAK_FAIL_RECONNECT;
+  }
+  return found;
+}
+
+static String failureList(uint8_t set) {
+  String list;
+  for (size_t i = 0; i < FAILURE_COUNT; i++) {
+    if (set & (1 << i)) {
+      if (list.length() > 0) {
+        list += ", ";
+      }
+      list += FAILURE_NAMES[i];
+    }
+  }
+  return list;
+}
+
+static void takeSample() {
+  HeapRegionStats heap;
+  getInternalHeapStats(heap);
+  SoakSample s = {};
+  s.uptimeS = millis() / 1000;
+  s.largestBlock = heap.largestBlock;
+  s.minFree = heap.minFree;
+  s.freeHeap = heap.free;
+  if (intervalJobs > 0) {
+    // Nearest rank
+    size_t rank = (intervalJobs * 99 + 99) / 100 - 1;
+    std::nth_element(intervalLatencies, intervalLatencies + rank, intervalLatencies + intervalJobs);
+    s.p99Ms = max<uint32_t>(intervalLatencies[rank], 1);
+  }
+  s.reconnectMs = intervalReconnectMs;
+  s.jobs = intervalJobs;
+  s.errors = intervalErrors;
+  intervalJobs = 0;
+  intervalReconnectMs = 0;
+  intervalErrors = 0;
+
+  xSemaphoreTake(soakLock, portMAX_DELAY);
+  samples[sampleCount % SOAK_SAMPLES] = s;
+  sampleCount++;
+  if (sampleCount >= SOAK_WINDOW) {
+    current = windowMedians(sampleCount - SOAK_WINDOW);
+  }
+  if (!haveBaseline && sampleCount == SOAK_WARMUP_SAMPLES + SOAK_WINDOW) {
+    baseline = current;
+    haveBaseline = true;
+  }
+  uint8_t found = findDrift();
+  uint8_t fresh = found & ~failures;
+  failures |= found;
+  uint8_t failed = failures;
+  xSemaphoreGive(soakLock);
+
+  log_i("Soak %u min: largest block %u, lowest free %u, free %u, p99 %u ms, reconnect %u ms, %u jobs, %u errors",
+        s.uptimeS / 60, s.largestBlock, s.minFree, s.freeHeap, s.p99Ms, s.reconnectMs, s.jobs, s.errors);
+  if (fresh) {
+    log_e("SOAK FAILED at %u min, drifted: %s", s.uptimeS / 60, failureList(fresh).c_str());
+  } else if (failed) {
+    log_e("SOAK FAILED, drifted: %s", failureList(failed).c_str());
+  }
+}
+
+static void countError() {
+  intervalErrors++;
+  xSemaphoreTake(soakLock, portMAX_DELAY);
+  errorCount++;
+  xSemaphoreGive(soakLock);
+}
+
+// One job of the rotation, timed from creation until the writer is through
+static void runJob(uint8_t printer, uint32_t n) {
+  PrintWriterStats before = {};
+  getPrintWriterStats(printer, before);
+  uint32_t started = millis();
+  PrintJobReject reject = JOB_ACCEPTED;
+  uint32_t id = createPrintJob(printer, PRINT_JOB_LENGTH_UNKNOWN, reject);
+  if (id == 0) {
+    log_w("Soak job refused (%d)", reject);
+    countError();
+    return;
+  }
+
+  bool ok;
+  if (n % 3 == 2) {
+    static const uint8_t zeros[512] = {};
+    ok = true;
+    for (size_t sent = 0; ok && sent < SOAK_NUL_BYTES; sent += sizeof(zeros)) {
+      ok = appendPrintJobWait(id, zeros, min(sizeof(zeros), SOAK_NUL_BYTES - sent));
+    }
+  } else {
+    // Built anew each time like a client's, String churn included
+    String label;
+    appendBenchLabel(label, n % 3 == 1, 58, 30);
+    ok = appendPrintJobWait(id, (const uint8_t*)label.c_str(), label.length());
+  }
+  if (ok) {
+    finishPrintJob(id);
+  } else {
+    abortPrintJob(id);
+  }
+
+  PrintJobInfo info;
+  while (getPrintJob(id, info) && (info.state == JOB_QUEUED || info.state == JOB_STREAMING)) {
+    if (millis() - started > SOAK_JOB_TIMEOUT_MS) {
+      cancelPrintJob(id);
+      ok = false;
+      break;
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  uint32_t latency = millis() - started;
+
+  PrintWriterStats after = {};
+  getPrintWriterStats(printer, after);
+  if (!ok || after.failed != before.failed) {
+    log_w("Soak job %u failed after %u ms", id, latency);
+    countError();
+    return;
+  }
+  if (intervalJobs < INTERVAL_JOBS) {
+    intervalLatencies[intervalJobs++] = latency;
+  }
+  xSemaphoreTake(soakLock, portMAX_DELAY);
+  jobCount++;
+  xSemaphoreGive(soakLock);
+}
+
+// Wait for the link to reach connected, false after timeoutMs
+static bool waitConnected(BlePrinter* printer, bool connected, uint32_t timeoutMs) {
+  uint32_t started = millis();
+  while (printer->connected() != connected) {
+    if (millis() - started > timeoutMs) {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(20));
+  }
+  return true;
+}
+
+static void reconnect(BlePrinter* printer) {
+  printer->requestDisconnect();
+  if (!waitConnected(printer, false, SOAK_RECONNECT_TIMEOUT_MS)) {
+    log_w("Soak: %s did not disconnect", printer->id().c_str());
+    countError();
+    return;
+  }
+  uint32_t started = millis();
+  printer->requestConnect();
+  if (!waitConnected(printer, true, SOAK_RECONNECT_TIMEOUT_MS)) {
+    log_w("Soak: %s did not reconnect in %u ms", printer->id().c_str(), SOAK_RECONNECT_TIMEOUT_MS);
+    countError();
+    return;
+  }
+  intervalReconnectMs = max<uint32_t>(intervalReconnectMs, millis() - started);
+  xSemaphoreTake(soakLock, portMAX_DELAY);
+  reconnectCount++;
+  xSemaphoreGive(soakLock);
+}
+
+static void soakTask(void* param) {
+  (void)param;
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  vTaskDelay(pdMS_TO_TICKS(SOAK_START_DELAY_MS));
+  BlePrinter* printer = getPrinter(SOAK_PRINTER);
+  log_i("Soak test on %s, %u ms between jobs, samples every %u s", printer->id().c_str(), SOAK_JOB_INTERVAL_MS,
+        SOAK_SAMPLE_MS / 1000);
+
+  uint32_t nextSample = millis() + SOAK_SAMPLE_MS;
+  uint32_t jobs = 0;
+  while (true) {
+    if ((int32_t)(millis() - nextSample) >= 0) {
+      takeSample();
+      nextSample += SOAK_SAMPLE_MS;
+    }
+    if (!printer->connected()) {
+      // Dropped on its own; the link task is already at it
+      if (!waitConnected(printer, true, SOAK_RECONNECT_TIMEOUT_MS)) {
+        log_w("Soak: %s not connected", printer->id().c_str());
+        countError();
+      }
+      continue;
+    }
+    if (SOAK_RECONNECT_JOBS > 0 && jobs > 0 && jobs % SOAK_RECONNECT_JOBS == 0) {
+      reconnect(printer);
+    }
+    runJob(printer->index(), jobs++);
+    // The snapshot a /status poll takes
+    statusVersion();
+    vTaskDelay(pdMS_TO_TICKS(SOAK_JOB_INTERVAL_MS));
+  }
+}
+
+static void appendFigures(String& json, const SoakSample& s) {
+  json += "{\"largestBlock\":";
+  json += String(s.largestBlock);
+  json += ",\"minFree\":";
+  json += String(s.minFree);
+  json += ",\"freeHeap\":";
+  json += String(s.freeHeap);
+  json += ",\"p99Ms\":";
+  json += String(s.p99Ms);
+  json += ",\"reconnectMs\":";
+  json += String(s.reconnectMs);
+  json += "}";
+}
+
+enum DumpStage { DUMP_HEADER, DUMP_SAMPLES, DUMP_FOOTER, DUMP_END };
+
+// Copy of the samples taken when the request came in, formatted one at a
+// time as the response is sent
+struct SoakDump {
+  DumpStage stage;
+  uint32_t next;
+  uint32_t count;
+  char line[96];
+  size_t lineLength;
+  size_t linePos;
+  SoakSample samples[SOAK_SAMPLES];
+};
+
+// Put the next piece of the JSON into dump->line; false once all is out
+static bool nextLine(SoakDump* dump) {
+  dump->linePos = 0;
+  dump->lineLength = 0;
+  while (dump->lineLength == 0) {
+    switch (dump->stage) {
+      case DUMP_HEADER:
+        dump->lineLength = snprintf(dump->line, sizeof(dump->line), ",\"samples\":[");
+        dump->stage = DUMP_SAMPLES;
+        break;
+      case DUMP_SAMPLES:
+        if (dump->next < dump->count) {
+          const SoakSample& s = dump->samples[dump->next];
+          dump->lineLength = snprintf(dump->line, sizeof(dump->line), "%s[%u,%u,%u,%u,%u,%u,%u,%u]",
+                                      dump->next ? "," : "", s.uptimeS, s.largestBlock, s.minFree, s.freeHeap,
+                                      s.p99Ms, s.reconnectMs, s.jobs, s.errors);
+          dump->next++;
+        } else {
+          dump->stage = DUMP_FOOTER;
+        }
+        break;
+      case DUMP_FOOTER:
+        dump->lineLength = snprintf(dump->line, sizeof(dump->line), "]}");
+        dump->stage = DUMP_END;
+        break;
+      case DUMP_END:
+        return false;
+    }
+  }
+  return true;
+}
+
+static void sendSoak(AsyncWebServerRequest* request) {
+  SoakDump* dump = (SoakDump*)heapAlloc(HEAP_SITE_TRACE, sizeof(SoakDump));
+  if (dump == nullptr) {
+    request->send(503, "text/plain", "No memory for the soak results");
+    return;
+  }
+  memset(dump, 0, offsetof(SoakDump, samples));
+
+  BlePrinter* printer = getPrinter(SOAK_PRINTER);
+  xSemaphoreTake(soakLock, portMAX_DELAY);
+  uint32_t first = sampleCount > SOAK_SAMPLES ? sampleCount - SOAK_SAMPLES : 0;
+  for (uint32_t i = first; i < sampleCount; i++) {
+    dump->samples[dump->count++] = sampleAt(i);
+  }
+  uint8_t failed = failures;
+  // The part before the samples is short enough for one String
+  String head = "{\"state\":\"";
+  head += failed ? "failed" : (sampleCount > 0 ? "running" : "starting");
+  head += "\",\"printer\":\"";
+  head += printer != nullptr ? printer->id() : String();
+  head += "\",\"uptimeS\":";
+  head += String(millis() / 1000);
+  head += ",\"jobs\":";
+  head += String(jobCount);
+  head += ",\"reconnects\":";
+  head += String(reconnectCount);
+  head += ",\"errors\":";
+  head += String(errorCount);
+  head += ",\"failures\":[";
+  for (size_t i = 0, n = 0; i < FAILURE_COUNT; i++) {
+    if (failed & (1 << i)) {
+      head += n++ ? ",\"" : "\"";
+      head += FAILURE_NAMES[i];
+      head += "\"";
+    }
+  }
+  head += "]";
+  if (haveBaseline) {
+    head += ",\"baseline\":";
+    appendFigures(head, baseline);
+  }
+  if (sampleCount >= SOAK_WINDOW) {
+    head += ",\"current\":";
+    appendFigures(head, current);
+  }
+  xSemaphoreGive(soakLock);
+
+  onRequestEnd(request, [dump]() {
+    heapFree(dump);
+  });
+  AsyncWebServerResponse* response = request->beginChunkedResponse(
+      "application/json", [dump, head](uint8_t* out, size_t maxLen, size_t index) -> size_t {
+        size_t n = 0;
+        // The head first, then the samples line by line
+        if (index < head.length()) {
+          n = min(maxLen, head.length() - index);
+          memcpy(out, head.c_str() + index, n);
+        }
+        while (n < maxLen) {
+          if (dump->linePos == dump->lineLength && !nextLine(dump)) {
+            break;
+          }
+          size_t take = min(maxLen - n, dump->lineLength - dump->linePos);
+          memcpy(out + n, dump->line + dump->linePos, take);
+          dump->linePos += take;
+          n += take;
+        }
+        return n;
+      });
+  response->setCode(failed ? 500 : 200);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+void initSoakTest(AsyncWebServer& server) {
+  if (getPrinter(SOAK_PRINTER) == nullptr) {
+    log_e("Soak test: no printer %u", SOAK_PRINTER);
+    return;
+  }
+  soakLock = xSemaphoreCreateMutex();
+  if (soakLock == nullptr ||
+      xTaskCreatePinnedToCore(soakTask, "soak", 4096, nullptr, 1, nullptr, 1) != pdPASS) {
+    log_e("No memory for the soak test");
+    return;
+  }
+  server.on(SOAK_PATH, HTTP_GET, sendSoak);
+  log_i("Soak test starts in %u s, results at %s", SOAK_START_DELAY_MS / 1000, SOAK_PATH);
+}
+
+#else
+
+void initSoakTest(AsyncWebServer& server) {
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include "spp_printer.h"
+#include "heap_stats.h"
+
+#if SPP_PRINTER && defined(CONFIG_BT_SPP_ENABLED)
+
+#include <BluetoothSerial.h>
+
+static BluetoothSerial sppSerial;
+static uint8_t sppAddress[6];
+static SppPrinterListener sppListener = nullptr;
+static void* sppListenerContext = nullptr;
+static TaskHandle_t sppTask = nullptr;
+static volatile bool sppConnected = false;
+
+// Runs on the Bluedroid task next to BluetoothSerial's own handler
+static void onSppEvent(esp_spp_cb_event_t event, esp_spp_cb_param_t* param) {
+  if (event != ESP_SPP_CLOSE_EVT || !sppConnected) {
+    return;
+  }
+  sppConnected = false;
+  log_w("SPP printer link closed");
+  if (sppListener) {
+    sppListener(sppListenerContext, false);
+  }
+  xTaskNotifyGive(sppTask);
+}
+
+static uint32_t sppBackoff(uint8_t failures) {
+  uint32_t delayMs = SPP_BACKOFF_MIN << (failures > 6 ? 6 : failures);
+  return delayMs > SPP_BACKOFF_MAX ? SPP_BACKOFF_MAX : delayMs;
+}
+
+// connect() pages the printer and looks up its SPP channel over SDP, which
+// blocks for seconds, so it gets a task of its own
+static void sppLinkTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  uint8_t failures = 0;
+  for (;;) {
+    if (!sppConnected) {
+      if (sppSerial.connect(sppAddress)) {
+        failures = 0;
+        sppConnected = true;
+        log_i("✅ SPP printer %02x:%02x:%02x:%02x:%02x:%02x connected", sppAddress[0], sppAddress[1],
+              sppAddress[2], sppAddress[3], sppAddress[4], sppAddress[5]);
+        if (sppListener) {
+          sppListener(sppListenerContext, true);
+        }
+      } else {
+        log_w("❌ SPP connect failed, retrying in %u ms", sppBackoff(failures));
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sppBackoff(failures)));
+        if (failures < 255) {
+          failures++;
+        }
+        continue;
+      }
+    }
+    // Woken by the close event
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+bool initSppPrinter(const uint8_t address[6], SppPrinterListener listener, void* context) {
+  memcpy(sppAddress, address, sizeof(sppAddress));
+  sppListener = listener;
+  sppListenerContext = context;
+
+  // Master mode; Bluedroid is already up for BLE and is shared
+  if (!sppSerial.begin("ESP32_Printer", true)) {
+    log_e("Classic Bluetooth failed to start");
+    return false;
+  }
+  sppSerial.setPin(SPP_PRINTER_PIN);
+  sppSerial.register_callback(onSppEvent);
+
+  if (xTaskCreatePinnedToCore(sppLinkTask, "sppLink", 4096, nullptr, 2, &sppTask, SPP_LINK_CORE) != pdPASS) {
+    log_e("Failed to start SPP link task");
+    return false;
+  }
+  return true;
+}
+
+bool sppPrinterConnected() {
+  return sppConnected;
+}
+
+bool sppPrinterWrite(const uint8_t* data, size_t length) {
+  unsigned long progress = millis();
+  size_t offset = 0;
+  while (offset < length) {
+    if (!sppConnected) {
+      return false;
+    }
+    // Queued in RFCOMM frames; a short count means the TX queue is full
+    // because the printer is out of credits
+    size_t chunk = length - offset < SPP_CHUNK_SIZE ? length - offset : SPP_CHUNK_SIZE;
+    size_t written = sppSerial.write(data + offset, chunk);
+    if (written > 0) {
+      offset += written;
+      progress = millis();
+    } else if (millis() - progress > SPP_PRINTER_TIMEOUT_MS) {
+      log_e("SPP printer took nothing for %u ms", SPP_PRINTER_TIMEOUT_MS);
+      return false;
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+  }
+  return true;
+}
+
+#else
+
+bool initSppPrinter(const uint8_t address[6], SppPrinterListener listener, void* context) {
+  log_e("Printer \"spp:\" needs an ESP32 build with -DSPP_PRINTER=1");
+  return false;
+}
+
+bool sppPrinterConnected() {
+  return false;
+}
+
+bool sppPrinterWrite(const uint8_t* data, size_t length) {
+  return false;
+}
+
+#endif
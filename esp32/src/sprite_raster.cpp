@@ -0,0 +1,94 @@
+#include "sprite_raster.h"
+#include "printer_encoder.h"
+
+// Stored size; the 1-bit sprite swaps width() and height() at rotations 1 and 3
+static void storedSize(TFT_eSprite& sprite, uint16_t& width, uint16_t& height) {
+  if (sprite.getRotation() & 1) {
+    width = sprite.height();
+    height = sprite.width();
+  } else {
+    width = sprite.width();
+    height = sprite.height();
+  }
+}
+
+void spriteRasterSize(TFT_eSprite& sprite, SpriteRasterTurn turn, uint16_t& width, uint16_t& height) {
+  storedSize(sprite, width, height);
+  if (turn == SPRITE_RASTER_TURN_90) {
+    uint16_t stored = width;
+    width = height;
+    height = stored;
+  }
+}
+
+// Output row r is stored column r read bottom up. Each stored column byte
+// gives eight output rows, built a block of eight stored rows at a time, so
+// only those eight rows are held rather than the whole turned image that
+// encodeRotate() would fill.
+static bool writeTurned(RasterCommandWriter& writer, const uint8_t* image, uint16_t width, uint16_t height,
+                        uint8_t* rows) {
+  size_t storedBytes = encodeRowBytes(width);
+  size_t outBytes = encodeRowBytes(height);
+  uint8_t in[8];
+  uint8_t out[8];
+
+  for (size_t b = 0; b < storedBytes; b++) {
+    for (size_t k = 0; k < outBytes; k++) {
+      for (uint8_t i = 0; i < 8; i++) {
+        int32_t y = (int32_t)height - 1 - (int32_t)(k * 8 + i);
+        in[i] = y >= 0 ? image[y * storedBytes + b] : 0;
+      }
+      encodeTranspose8(in, out);
+      for (uint8_t c = 0; c < 8; c++) {
+        rows[c * outBytes + k] = out[c];
+      }
+    }
+    for (uint8_t c = 0; c < 8 && b * 8 + c < width; c++) {
+      if (!writer.row(rows + c * outBytes)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+ImageError writeSpriteRaster(TFT_eSprite& sprite, SpriteRasterTurn turn, const ImageRasterOptions& options,
+                             ImageOutput output, void* context) {
+  const uint8_t* image = (const uint8_t*)sprite.getPointer();
+  if (image == nullptr || sprite.getColorDepth() != 1) {
+    return IMAGE_ERR_FORMAT;
+  }
+  uint16_t storedWidth, storedHeight;
+  storedSize(sprite, storedWidth, storedHeight);
+  uint16_t width, height;
+  spriteRasterSize(sprite, turn, width, height);
+  if (width > IMAGE_MAX_WIDTH) {
+    return IMAGE_ERR_TOO_LARGE;
+  }
+
+  uint8_t* rows = nullptr;
+  if (turn == SPRITE_RASTER_TURN_90) {
+    rows = (uint8_t*)malloc(8 * ((width + 7) / 8));
+    if (rows == nullptr) {
+      return IMAGE_ERR_NO_MEMORY;
+    }
+  }
+
+  RasterCommandWriter writer;
+  if (!writer.begin(options, width, height, output, context)) {
+    free(rows);
+    return writer.outputFailed() ? IMAGE_ERR_OUTPUT : IMAGE_ERR_NO_MEMORY;
+  }
+
+  bool ok = true;
+  if (turn == SPRITE_RASTER_TURN_90) {
+    ok = writeTurned(writer, image, storedWidth, storedHeight, rows);
+  } else {
+    size_t rowBytes = (storedWidth + 7) / 8;
+    for (uint16_t y = 0; ok && y < storedHeight; y++) {
+      ok = writer.row(image + y * rowBytes);
+    }
+  }
+  free(rows);
+  return ok ? IMAGE_OK : IMAGE_ERR_OUTPUT;
+}
@@ -0,0 +1,204 @@
+#include "stall_watch.h"
+
+#include <atomic>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+
+static const uint32_t RTC_MAGIC = 0x5354414c;  // "STAL"
+
+// Written by its task only; the timer just reads it
+struct StallSlot {
+  std::atomic<TaskHandle_t> task;
+  const char* volatile tag;            // Innermost open section, nullptr when none
+  volatile uint32_t since;             // millis() when it opened
+  const char* longestTag;
+  uint32_t longestMs;
+  const char* reportedTag;             // Open section already logged as a stall
+  uint32_t reportedSince;
+};
+
+struct RtcStalls {
+  uint32_t magic;
+  bool hasWorst;
+  bool hasOpen;
+  StallRecord worst;
+  StallRecord open;
+  uint32_t check;
+};
+
+static StallSlot slots[STALL_TASKS];
+RTC_NOINIT_ATTR static RtcStalls rtc;
+static portMUX_TYPE rtcLock = portMUX_INITIALIZER_UNLOCKED;
+static StallReport previous;
+
+static uint32_t rtcCheck() {
+  const uint8_t* bytes = (const uint8_t*)&rtc;
+  uint32_t sum = 0;
+  for (size_t i = 0; i < offsetof(RtcStalls, check); i++) {
+    sum = sum * 31 + bytes[i];
+  }
+  return sum;
+}
+
+static void fillRecord(StallRecord& record, TaskHandle_t task, const char* tag, uint32_t ms) {
+  strlcpy(record.task, pcTaskGetName(task), sizeof(record.task));
+  strlcpy(record.tag, tag, sizeof(record.tag));
+  record.ms = ms;
+  record.uptime = millis() / 1000;
+}
+
+static StallSlot* taskSlot() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (size_t i = 0; i < STALL_TASKS; i++) {
+    TaskHandle_t owner = slots[i].task.load(std::memory_order_acquire);
+    if (owner == self) {
+      return &slots[i];
+    }
+    if (owner == nullptr) {
+      TaskHandle_t empty = nullptr;
+      if (slots[i].task.compare_exchange_strong(empty, self) || empty == self) {
+        return &slots[i];
+      }
+    }
+  }
+  return nullptr;
+}
+
+StallSection::StallSection(const char* tag) : _slot(taskSlot()), _outerTag(nullptr), _outerSince(0), _since(0) {
+  if (_slot == nullptr) {
+    return;
+  }
+  _outerTag = _slot->tag;
+  _outerSince = _slot->since;
+  _since = millis();
+  _slot->since = _since;
+  _slot->tag = tag;
+}
+
+StallSection::~StallSection() {
+  if (_slot == nullptr) {
+    return;
+  }
+  const char* tag = _slot->tag;
+  uint32_t ms = millis() - _since;
+  _slot->tag = _outerTag;
+  _slot->since = _outerSince;
+  if (ms <= _slot->longestMs) {
+    return;
+  }
+  _slot->longestMs = ms;
+  _slot->longestTag = tag;
+
+  if (ms >= STALL_REPORT_MS) {
+    portENTER_CRITICAL(&rtcLock);
+    if (!rtc.hasWorst || ms > rtc.worst.ms) {
+      fillRecord(rtc.worst, nullptr, tag, ms);
+      rtc.hasWorst = true;
+      rtc.check = rtcCheck();
+    }
+    portEXIT_CRITICAL(&rtcLock);
+  }
+}
+
+// Keeps the section open longest in RTC memory, so a reset in the middle
+// of it still tells what it was
+static void checkSections(void* arg) {
+  uint32_t now = millis();
+  StallSlot* longest = nullptr;
+  const char* longestTag = nullptr;
+  uint32_t longestMs = 0;
+  for (size_t i = 0; i < STALL_TASKS; i++) {
+    StallSlot& slot = slots[i];
+    const char* tag = slot.tag;
+    if (slot.task.load(std::memory_order_relaxed) == nullptr || tag == nullptr) {
+      continue;
+    }
+    uint32_t since = slot.since;
+    uint32_t ms = now - since;
+    if (ms >= STALL_REPORT_MS && (slot.reportedTag != tag || slot.reportedSince != since)) {
+      slot.reportedTag = tag;
+      slot.reportedSince = since;
+      log_w("%s blocked for %u ms in %s", pcTaskGetName(slot.task.load()), ms, tag);
+    }
+    if (ms > longestMs) {
+      longest = &slot;
+      longestTag = tag;
+      longestMs = ms;
+    }
+  }
+
+  portENTER_CRITICAL(&rtcLock);
+  rtc.hasOpen = longest != nullptr && longestMs >= STALL_CHECK_MS;
+  if (rtc.hasOpen) {
+    fillRecord(rtc.open, longest->task.load(), longestTag, longestMs);
+  }
+  rtc.check = rtcCheck();
+  portEXIT_CRITICAL(&rtcLock);
+}
+
+static const char* resetReasonName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON: return "power_on";
+    case ESP_RST_EXT: return "external";
+    case ESP_RST_SW: return "software";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT: return "int_wdt";
+    case ESP_RST_TASK_WDT: return "task_wdt";
+    case ESP_RST_WDT: return "wdt";
+    case ESP_RST_DEEPSLEEP: return "deep_sleep";
+    case ESP_RST_BROWNOUT: return "brownout";
+    case ESP_RST_SDIO: return "sdio";
+    default: return "unknown";
+  }
+}
+
+void initStallWatch() {
+  previous.resetReason = resetReasonName(esp_reset_reason());
+  // After a power cycle RTC memory holds noise, which the check rejects
+  if (rtc.magic == RTC_MAGIC && rtc.check == rtcCheck()) {
+    previous.hasWorst = rtc.hasWorst;
+    previous.worst = rtc.worst;
+    previous.hasOpen = rtc.hasOpen;
+    previous.open = rtc.open;
+    previous.worst.task[sizeof(previous.worst.task) - 1] = '\0';
+    previous.worst.tag[sizeof(previous.worst.tag) - 1] = '\0';
+    previous.open.task[sizeof(previous.open.task) - 1] = '\0';
+    previous.open.tag[sizeof(previous.open.tag) - 1] = '\0';
+  }
+  if (previous.hasOpen) {
+    log_w("Reset (%s) while %s was %u ms into %s", previous.resetReason, previous.open.task, previous.open.ms,
+          previous.open.tag);
+  }
+
+  memset(&rtc, 0, sizeof(rtc));
+  rtc.magic = RTC_MAGIC;
+  rtc.check = rtcCheck();
+
+  esp_timer_create_args_t args = {};
+  args.callback = checkSections;
+  args.name = "stalls";
+  esp_timer_handle_t timer;
+  if (esp_timer_create(&args, &timer) != ESP_OK || esp_timer_start_periodic(timer, STALL_CHECK_MS * 1000) != ESP_OK) {
+    log_e("Stall watch timer not started");
+  }
+}
+
+size_t getStallTasks(StallTaskInfo* out, size_t max) {
+  size_t count = 0;
+  for (size_t i = 0; i < STALL_TASKS && count < max; i++) {
+    TaskHandle_t task = slots[i].task.load(std::memory_order_acquire);
+    if (task == nullptr) {
+      continue;
+    }
+    out[count].task = task;
+    out[count].longestTag = slots[i].longestTag;
+    out[count].longestMs = slots[i].longestMs;
+    count++;
+  }
+  return count;
+}
+
+const StallReport& previousStallReport() {
+  return previous;
+}
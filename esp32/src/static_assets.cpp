@@ -0,0 +1,170 @@
+#include "static_assets.h"
+
+#include <LittleFS.h>
+
+#include "coex_policy.h"
+
+struct StaticAsset {
+  String path;
+  String etag;       // Quoted, as sent
+  bool immutable;    // The name changes with the content
+};
+
+static StaticAsset assets[STATIC_MAX_ASSETS];
+static size_t assetCount = 0;
+
+// An asset compiled into the firmware by scripts/pack_data.py
+struct BundledAsset {
+  const char* path;
+  const char* contentType;
+  const char* etag;  // Quoted, as sent
+  bool immutable;
+  const uint8_t* body; // Gzipped
+  size_t length;
+};
+
+#if STATIC_ASSET_BUNDLE
+#include "asset_bundle.h"
+static const size_t BUNDLED_COUNT = sizeof(BUNDLED_ASSETS) / sizeof(BUNDLED_ASSETS[0]);
+#else
+static const BundledAsset* const BUNDLED_ASSETS = nullptr;
+static const size_t BUNDLED_COUNT = 0;
+#endif
+// Bundled assets LittleFS holds a newer copy of
+static bool shadowed[BUNDLED_COUNT > 0 ? BUNDLED_COUNT : 1];
+
+static const char* cacheControl(bool immutable) {
+  return immutable ? "public, max-age=31536000, immutable" : "no-cache";
+}
+
+static const BundledAsset* findBundled(const String& url) {
+  const char* path = url == "/" ? "/index.html" : url.c_str();
+  for (size_t i = 0; i < BUNDLED_COUNT; i++) {
+    if (!shadowed[i] && strcmp(BUNDLED_ASSETS[i].path, path) == 0) {
+      return &BUNDLED_ASSETS[i];
+    }
+  }
+  return nullptr;
+}
+
+static const StaticAsset* findAsset(const String& url) {
+  const String& path = url == "/" ? String("/index.html") : url;
+  for (size_t i = 0; i < assetCount; i++) {
+    if (assets[i].path == path) {
+      return &assets[i];
+    }
+  }
+  return nullptr;
+}
+
+class StaticAssetHandler : public AsyncWebHandler {
+public:
+  bool canHandle(AsyncWebServerRequest* request) override {
+    if ((request->method() != HTTP_GET && request->method() != HTTP_HEAD) || findAsset(request->url()) == nullptr) {
+      return false;
+    }
+    request->addInterestingHeader("If-None-Match");
+    return true;
+  }
+
+  void handleRequest(AsyncWebServerRequest* request) override {
+    const StaticAsset* asset = findAsset(request->url());
+
+    AsyncWebServerResponse* response;
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset->etag) {
+      response = request->beginResponse(304);
+    } else if (!coexAdmit(request)) {
+      // Answered 503 while jobs print and the radio is busy
+      return;
+    } else {
+      // Finds <path>.gz and adds Content-Encoding: gzip, with the type of <path>
+      response = request->beginResponse(LittleFS, asset->path);
+    }
+    response->addHeader("ETag", asset->etag);
+    response->addHeader("Cache-Control", cacheControl(asset->immutable));
+    request->send(response);
+  }
+};
+
+class BundledAssetHandler : public AsyncWebHandler {
+public:
+  bool canHandle(AsyncWebServerRequest* request) override {
+    if ((request->method() != HTTP_GET && request->method() != HTTP_HEAD) || findBundled(request->url()) == nullptr) {
+      return false;
+    }
+    request->addInterestingHeader("If-None-Match");
+    return true;
+  }
+
+  void handleRequest(AsyncWebServerRequest* request) override {
+    const BundledAsset* asset = findBundled(request->url());
+
+    AsyncWebServerResponse* response;
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset->etag) {
+      response = request->beginResponse(304);
+    } else if (!coexAdmit(request)) {
+      return;
+    } else {
+      // Read from flash as the socket takes it
+      response = request->beginResponse_P(200, asset->contentType, asset->body, asset->length);
+      response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", asset->etag);
+    response->addHeader("Cache-Control", cacheControl(asset->immutable));
+    request->send(response);
+  }
+};
+
+// One asset per line: <path> <etag> immutable|revalidate
+static bool loadManifest() {
+  File file = LittleFS.open(STATIC_ASSET_MANIFEST, "r");
+  if (!file) {
+    return false;
+  }
+  assetCount = 0;
+  while (file.available() && assetCount < STATIC_MAX_ASSETS) {
+    String line = file.readStringUntil('\n');
+    line.trim();
+    int first = line.indexOf(' ');
+    int second = line.indexOf(' ', first + 1);
+    if (first <= 0 || second <= first + 1 || !line.startsWith("/")) {
+      continue;
+    }
+    StaticAsset& asset = assets[assetCount++];
+    asset.path = line.substring(0, first);
+    asset.etag = "\"" + line.substring(first + 1, second) + "\"";
+    asset.immutable = line.substring(second + 1) == "immutable";
+  }
+  if (file.available()) {
+    log_w("More than %u static assets, the rest is served uncached", STATIC_MAX_ASSETS);
+  }
+  file.close();
+  return true;
+}
+
+bool initStaticAssets(AsyncWebServer& server) {
+  bool manifest = loadManifest();
+
+  size_t bundled = 0;
+  for (size_t i = 0; i < BUNDLED_COUNT; i++) {
+    const BundledAsset& asset = BUNDLED_ASSETS[i];
+    for (size_t j = 0; j < assetCount && !shadowed[i]; j++) {
+      shadowed[i] = assets[j].path == asset.path && assets[j].etag != asset.etag;
+    }
+    bundled += shadowed[i] ? 0 : 1;
+  }
+  if (bundled > 0) {
+    // Ahead of the LittleFS handler
+    server.addHandler(new BundledAssetHandler());
+    log_i("Serving %u web assets from the firmware, %u from LittleFS", bundled,
+          (unsigned)(BUNDLED_COUNT - bundled));
+  }
+
+  if (!manifest) {
+    log_i("No %s, web UI served as stored", STATIC_ASSET_MANIFEST);
+    return bundled > 0;
+  }
+  server.addHandler(new StaticAssetHandler());
+  log_i("Serving %u packed web assets", assetCount);
+  return true;
+}
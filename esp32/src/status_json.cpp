@@ -0,0 +1,373 @@
+#include "status_json.h"
+#include "ble_printer.h"
+#include "boot_timing.h"
+#include "eth_link.h"
+
+#include <WiFi.h>
+#include <stdarg.h>
+
+struct PrinterSnapshot {
+  char id[32];
+  char mac[18];
+  char name[32];
+  char profile[33];
+  char pipeline[32];       // Stage names, comma-separated
+  const char* pool;
+  uint16_t dpi;
+  uint16_t dots;
+  bool connected;
+  BleLinkState link;
+  uint16_t mtu;
+  uint32_t chunkSize;
+  uint32_t txChunk;
+  uint16_t txWindow;
+  uint8_t txGapMs;
+  int8_t rssi;
+  int8_t txPower;
+  uint32_t probeRate;
+  uint16_t probeChunk;
+  bool probeNoResponse;
+  float connInterval;
+  bool phy2M;
+  uint16_t dataLength;
+  bool gattCached;
+  bool l2cap;
+  bool notifying;
+  bool flowPaused;
+  bool paperOut;
+  bool recoding;
+  uint32_t rasterIn;
+  uint32_t rasterOut;
+  uint32_t throughput;
+  uint32_t queueDepth;
+  // Link metrics and job results
+  uint32_t bytes;
+  uint32_t rate10s;
+  uint32_t rate60s;
+  uint32_t writes;
+  uint32_t latencyP50Us;
+  uint32_t latencyP99Us;
+  uint32_t creditTimeouts;
+  uint32_t writeErrors;
+  uint32_t flowPauses;
+  uint32_t flowPausedMs;
+  bool paced;
+  uint32_t pacedMs;
+  uint32_t connects;
+  uint32_t connectFailures;
+  uint32_t disconnects;
+  uint32_t jobsDone;
+  uint32_t jobsFailed;
+};
+
+struct StallSnapshot {
+  char task[16];
+  const char* tag;
+  uint32_t ms;
+};
+
+struct StatusSnapshot {
+  bool wifi;
+  bool ethernet;
+  char ip[16];
+  uint32_t queueDepth;
+  uint32_t boot[BOOT_PHASES];
+  size_t stallCount;
+  StallSnapshot stalls[STALL_TASKS];
+  size_t printerCount;
+  PrinterSnapshot printers[MAX_PRINTERS];
+};
+
+// uptime and the closing brace, written when a response starts
+struct StatusTail {
+  char text[24];
+  size_t length;
+};
+
+// Serialized status of one version. A response reads the buffer of its
+// version; the other one takes the next version meanwhile.
+struct StatusBuffer {
+  uint32_t version;
+  size_t length;
+  char json[STATUS_JSON_SIZE];
+};
+
+// Only touched from the web server's task
+static StatusSnapshot current;
+static StatusSnapshot scratch;
+static StatusBuffer buffers[2];
+static uint32_t version = 0;
+
+// snprintf into a buffer, remembering when it ran out of room
+struct JsonWriter {
+  char* out;
+  size_t size;
+  size_t length;
+  bool overflow;
+
+  void add(const char* format, ...) {
+    if (overflow) {
+      return;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(out + length, size - length, format, args);
+    va_end(args);
+    if (written < 0 || (size_t)written >= size - length) {
+      overflow = true;
+      return;
+    }
+    length += written;
+  }
+  void add(const char* name, bool value) { add("\"%s\":%s", name, value ? "true" : "false"); }
+};
+
+static void copyText(char* dest, size_t size, const String& text) {
+  strncpy(dest, text.c_str(), size - 1);
+  dest[size - 1] = '\0';
+}
+
+static void takePrinter(PrinterSnapshot& s, const BlePrinter& printer) {
+  const LinkMetrics& metrics = printer.metrics();
+  PrintWriterStats stats = {};
+  getPrintWriterStats(printer.index(), stats);
+
+  copyText(s.id, sizeof(s.id), printer.id());
+  copyText(s.mac, sizeof(s.mac), printer.mac());
+  copyText(s.name, sizeof(s.name), printer.name());
+  copyText(s.profile, sizeof(s.profile), printer.profileName());
+  copyText(s.pipeline, sizeof(s.pipeline), printer.pipelineName());
+  s.pool = poolName(printer.pool());
+  s.dpi = printer.dpi();
+  s.dots = printer.dots();
+  s.connected = printer.connected();
+  s.link = printer.linkState();
+  s.mtu = printer.mtu();
+  s.chunkSize = printer.chunkSize();
+  s.txChunk = printer.txChunk();
+  s.txWindow = printer.txWindow();
+  s.txGapMs = printer.txGapMs();
+  s.rssi = printer.rssi();
+  s.txPower = printer.txPowerDbm();
+  s.probeRate = printer.probeRate();
+  s.probeChunk = printer.probeChunk();
+  s.probeNoResponse = printer.probeNoResponse();
+  s.connInterval = printer.connIntervalMs();
+  s.phy2M = printer.phy2M();
+  s.dataLength = printer.dataLength();
+  s.gattCached = printer.gattCached();
+  s.l2cap = printer.l2cap();
+  s.notifying = printer.notifying();
+  s.flowPaused = printer.flowPaused();
+  s.paperOut = printer.paperOut();
+  s.recoding = printer.recoder().active();
+  s.rasterIn = printer.recoder().bytesIn();
+  s.rasterOut = printer.recoder().bytesOut();
+  s.throughput = printer.throughput();
+  s.queueDepth = printQueueDepth(printer.index());
+  s.bytes = metrics.bytes();
+  s.rate10s = metrics.rate(10);
+  s.rate60s = metrics.rate(LINK_RATE_SECONDS);
+  s.writes = metrics.chunks();
+  s.latencyP50Us = metrics.latencyPercentileUs(0.5f);
+  s.latencyP99Us = metrics.latencyPercentileUs(0.99f);
+  s.creditTimeouts = metrics.creditTimeouts();
+  s.writeErrors = metrics.writeErrors();
+  s.flowPauses = metrics.flowPauses();
+  s.flowPausedMs = metrics.flowPausedMs();
+  s.paced = printer.paced();
+  s.pacedMs = metrics.pacedMs();
+  s.connects = metrics.connects();
+  s.connectFailures = metrics.connectFailures();
+  s.disconnects = metrics.disconnects();
+  s.jobsDone = stats.done;
+  s.jobsFailed = stats.failed;
+}
+
+// Connection and re-encoding details shared by both status layouts
+static void writeLinkFields(JsonWriter& json, const PrinterSnapshot& s) {
+  json.add("\"mtu\":%u,\"chunkSize\":%u,\"connInterval\":%.2f,\"phy\":\"%s\",\"dataLength\":%u,\"link\":\"%s\",",
+           s.mtu, s.chunkSize, s.connInterval, s.phy2M ? "2M" : "1M", s.dataLength, linkStateName(s.link));
+  json.add("\"profile\":\"%s\",\"pipeline\":\"%s\",\"txChunk\":%u,\"txWindow\":%u,\"txGapMs\":%u,\"rssi\":%d,\"txPower\":%d,",
+           s.profile, s.pipeline, s.txChunk, s.txWindow, s.txGapMs, s.rssi, s.txPower);
+  if (s.probeRate > 0) {
+    json.add("\"probe\":{\"bytesPerSec\":%u,\"chunk\":%u,\"mode\":\"%s\"},", s.probeRate, s.probeChunk,
+             s.probeNoResponse ? "nr" : "ack");
+  }
+  json.add("gattCached", s.gattCached);
+  json.add(",");
+  json.add("l2cap", s.l2cap);
+  json.add(",");
+  json.add("statusNotify", s.notifying);
+  json.add(",");
+  json.add("flowPaused", s.flowPaused);
+  json.add(",");
+  json.add("paced", s.paced);
+  json.add(",");
+  json.add("paperOut", s.paperOut);
+  json.add(",");
+  json.add("rasterRecoding", s.recoding);
+  json.add(",\"rasterBytesIn\":%u,\"rasterBytesOut\":%u", s.rasterIn, s.rasterOut);
+}
+
+static void writePrinter(JsonWriter& json, const PrinterSnapshot& s) {
+  json.add("{\"id\":\"%s\",\"mac\":\"%s\",\"status\":\"%s\",\"name\":\"%s\",", s.id, s.mac,
+           s.connected ? "connected" : "disconnected", s.name);
+  writeLinkFields(json, s);
+  json.add(",\"pool\":\"%s\",\"dpi\":%u,\"dots\":%u,\"throughput\":%u,\"queueDepth\":%u,", s.pool, s.dpi, s.dots,
+           s.throughput, s.queueDepth);
+  json.add("\"metrics\":{\"bytes\":%u,\"rate10s\":%u,\"rate60s\":%u,\"writes\":%u,\"latencyP50Us\":%u,"
+           "\"latencyP99Us\":%u,\"creditTimeouts\":%u,\"writeErrors\":%u,\"flowPauses\":%u,\"flowPausedMs\":%u,"
+           "\"pacedMs\":%u,\"connects\":%u,\"connectFailures\":%u,\"disconnects\":%u,\"jobsDone\":%u,\"jobsFailed\":%u}}",
+           s.bytes, s.rate10s, s.rate60s, s.writes, s.latencyP50Us, s.latencyP99Us, s.creditTimeouts,
+           s.writeErrors, s.flowPauses, s.flowPausedMs, s.pacedMs, s.connects, s.connectFailures, s.disconnects,
+           s.jobsDone, s.jobsFailed);
+}
+
+static void writeStallRecord(JsonWriter& json, const char* name, bool present, const StallRecord& r) {
+  if (!present) {
+    json.add("\"%s\":null", name);
+    return;
+  }
+  json.add("\"%s\":{\"task\":\"%s\",\"tag\":\"%s\",\"ms\":%u,\"uptime\":%u}", name, r.task, r.tag, r.ms, r.uptime);
+}
+
+static void writeStalls(JsonWriter& json, const StatusSnapshot& s) {
+  const StallReport& previous = previousStallReport();
+  json.add("\"stalls\":{\"resetReason\":\"%s\",\"lastBoot\":{", previous.resetReason);
+  writeStallRecord(json, "worst", previous.hasWorst, previous.worst);
+  json.add(",");
+  writeStallRecord(json, "open", previous.hasOpen, previous.open);
+  json.add("},\"tasks\":[");
+  for (size_t i = 0; i < s.stallCount; i++) {
+    json.add(i > 0 ? ",{" : "{");
+    json.add("\"task\":\"%s\",\"longestMs\":%u,\"tag\":\"%s\"}", s.stalls[i].task, s.stalls[i].ms, s.stalls[i].tag);
+  }
+  json.add("]}");
+}
+
+// Everything up to uptime, which each response appends with the closing brace
+static void serialize(const StatusSnapshot& s, StatusBuffer& buffer) {
+  JsonWriter json = {buffer.json, sizeof(buffer.json), 0, false};
+  // The top-level printer fields describe the first printer, as before
+  // there was a registry
+  const PrinterSnapshot& first = s.printers[0];
+  json.add("{\"wifi\":\"%s\",\"ethernet\":\"%s\",\"ip\":\"%s\",\"printer\":\"%s\",\"printerName\":\"%s\",",
+           s.wifi ? "connected" : "disconnected", s.ethernet ? "connected" : "disconnected", s.ip, first.connected ? "connected" : "disconnected", first.name);
+  writeLinkFields(json, first);
+  json.add(",\"queueDepth\":%u,\"boot\":{", s.queueDepth);
+  for (int phase = 0; phase < BOOT_PHASES; phase++) {
+    json.add(phase > 0 ? ",\"%s\":" : "\"%s\":", bootPhaseName((BootPhase)phase));
+    json.add(s.boot[phase] != 0 ? "%u" : "null", s.boot[phase]);
+  }
+  json.add("},");
+  writeStalls(json, s);
+  json.add(",\"printers\":[");
+  for (size_t i = 0; i < s.printerCount; i++) {
+    if (i > 0) {
+      json.add(",");
+    }
+    writePrinter(json, s.printers[i]);
+  }
+  json.add("],\"version\":%u,", version);
+  if (json.overflow) {
+    log_e("Status JSON larger than STATUS_JSON_SIZE (%u bytes)", sizeof(buffer.json));
+  }
+  buffer.version = version;
+  buffer.length = json.length;
+}
+
+uint32_t statusVersion() {
+  // Zeroed first so padding and unused text compare equal
+  memset(&scratch, 0, sizeof(scratch));
+  scratch.wifi = WiFi.status() == WL_CONNECTED;
+  scratch.ethernet = ethLinkUp();
+  if (scratch.wifi || scratch.ethernet) {
+    IPAddress ip = networkAddress();
+    snprintf(scratch.ip, sizeof(scratch.ip), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  }
+  scratch.queueDepth = printQueueDepth();
+  for (int phase = 0; phase < BOOT_PHASES; phase++) {
+    scratch.boot[phase] = bootPhaseMs((BootPhase)phase);
+  }
+  StallTaskInfo stalls[STALL_TASKS];
+  size_t stallTasks = getStallTasks(stalls, STALL_TASKS);
+  for (size_t i = 0; i < stallTasks; i++) {
+    if (stalls[i].longestTag == nullptr) {
+      continue;
+    }
+    StallSnapshot& stall = scratch.stalls[scratch.stallCount++];
+    strlcpy(stall.task, pcTaskGetName(stalls[i].task), sizeof(stall.task));
+    stall.tag = stalls[i].longestTag;
+    stall.ms = stalls[i].longestMs;
+  }
+  scratch.printerCount = printerCount() < MAX_PRINTERS ? printerCount() : MAX_PRINTERS;
+  for (size_t i = 0; i < scratch.printerCount; i++) {
+    takePrinter(scratch.printers[i], *getPrinter(i));
+  }
+
+  if (version == 0 || memcmp(&scratch, &current, sizeof(current)) != 0) {
+    memcpy(&current, &scratch, sizeof(current));
+    version++;
+    serialize(current, buffers[version & 1]);
+  }
+  return version;
+}
+
+// Body of a status response: the buffer of its version, then uptime. A
+// response that already waited its turn stops short if two newer versions
+// came in while it was sent; the client simply asks again.
+static size_t fillStatus(uint32_t forVersion, const StatusTail& tail, uint8_t* out, size_t maxLen, size_t index) {
+  const StatusBuffer& buffer = buffers[forVersion & 1];
+  if (buffer.version != forVersion) {
+    return 0;
+  }
+  size_t total = buffer.length + tail.length;
+  size_t n = 0;
+  while (index + n < total && n < maxLen) {
+    size_t at = index + n;
+    out[n++] = at < buffer.length ? buffer.json[at] : tail.text[at - buffer.length];
+  }
+  return n;
+}
+
+void sendStatus(AsyncWebServerRequest* request) {
+  uint32_t now = statusVersion();
+  char etag[16];
+  snprintf(etag, sizeof(etag), "\"%u\"", now);
+
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+    AsyncWebServerResponse* response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    request->send(response);
+    return;
+  }
+
+  // ?since=<version>: wait for a newer one, rechecked on every poll of the
+  // connection until it comes or the wait is over
+  bool wait = request->hasParam("since") && (uint32_t)request->getParam("since")->value().toInt() == now;
+  uint32_t since = now;
+  uint32_t start = millis();
+  uint32_t forVersion = wait ? 0 : now;
+  StatusTail tail = {};
+
+  AsyncWebServerResponse* response = request->beginChunkedResponse(
+      "application/json", [since, start, forVersion, tail](uint8_t* out, size_t maxLen, size_t index) mutable -> size_t {
+        if (forVersion == 0) {
+          uint32_t latest = statusVersion();
+          if (latest == since && millis() - start < STATUS_LONG_POLL_MS) {
+            return RESPONSE_TRY_AGAIN;
+          }
+          forVersion = latest;
+        }
+        if (index == 0) {
+          tail.length = snprintf(tail.text, sizeof(tail.text), "\"uptime\":%lu}", millis() / 1000);
+        }
+        return fillStatus(forVersion, tail, out, maxLen, index);
+      });
+  if (!wait) {
+    response->addHeader("ETag", etag);
+  }
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
@@ -0,0 +1,259 @@
+#include "status_view.h"
+
+void StatusView::beginFrame() {
+  memset(_next, 0, sizeof(_next));
+}
+
+void StatusView::set(uint8_t line, int16_t y, uint8_t size, uint16_t color, const char* format, ...) {
+  if (line >= STATUS_VIEW_LINES) {
+    return;
+  }
+  Line& next = _next[line];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(next.text, sizeof(next.text), format, args);
+  va_end(args);
+  next.color = color;
+  next.y = y;
+  next.size = size;
+}
+
+bool StatusView::same(const Line& a, const Line& b) {
+  return a.color == b.color && a.y == b.y && a.size == b.size && strcmp(a.text, b.text) == 0;
+}
+
+StatusView::Rows StatusView::rows(const Line& line) {
+  _canvas->setTextSize(line.size);
+  return {line.y, (int16_t)(line.y + _canvas->fontHeight())};
+}
+
+// Keeps the bands sorted and merged, so each is pushed once
+void StatusView::markDirty(const Rows& band) {
+  Rows merged = band;
+  if (_dirtyCount == sizeof(_dirty) / sizeof(_dirty[0])) {
+    // Out of slots: one band over all of them
+    merged.top = min(merged.top, _dirty[0].top);
+    merged.bottom = max(merged.bottom, _dirty[_dirtyCount - 1].bottom);
+  }
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < _dirtyCount; i++) {
+    const Rows& other = _dirty[i];
+    if (other.bottom < merged.top || other.top > merged.bottom) {
+      _dirty[kept++] = other;
+    } else {
+      merged.top = min(merged.top, other.top);
+      merged.bottom = max(merged.bottom, other.bottom);
+    }
+  }
+  uint8_t at = kept;
+  while (at > 0 && _dirty[at - 1].top > merged.top) {
+    _dirty[at] = _dirty[at - 1];
+    at--;
+  }
+  _dirty[at] = merged;
+  _dirtyCount = kept + 1;
+}
+
+// Push bands top down until the frame's budget is spent, at least one
+// slice per frame; the rest stays marked
+void StatusView::push() {
+  bool banded = _bands.ready();
+  if (!_sprite && !banded) {
+    _dirtyCount = 0;
+    return;
+  }
+  uint32_t started = micros();
+  int16_t height = _tft->height();
+  uint8_t done = 0;
+  bool pushed = false;
+  while (done < _dirtyCount) {
+    Rows& band = _dirty[done];
+    band.top = max<int16_t>(band.top, 0);
+    band.bottom = min(band.bottom, height);
+    if (band.bottom <= band.top) {
+      done++;
+      continue;
+    }
+    if (pushed && micros() - started >= STATUS_DRAW_BUDGET_US) {
+      break;
+    }
+    int16_t rows = min<int16_t>(band.bottom - band.top, banded ? _bands.rows() : STATUS_PUSH_ROWS);
+    if (banded) {
+      _bands.render(drawBand, this, band.top, band.top + rows);
+    } else {
+      _sprite->pushSprite(0, band.top, 0, band.top, _tft->width(), rows);
+    }
+    band.top += rows;
+    pushed = true;
+    if (band.top >= band.bottom) {
+      done++;
+    }
+  }
+  memmove(_dirty, _dirty + done, (_dirtyCount - done) * sizeof(_dirty[0]));
+  _dirtyCount -= done;
+}
+
+void StatusView::drawColumn(TFT_eSPI& canvas, int16_t x, uint32_t value) {
+  int16_t top = graphTop();
+  canvas.drawFastVLine(x, top, STATUS_GRAPH_HEIGHT, TFT_BLACK);
+  int16_t bar = _graphScale ? (int16_t)((uint64_t)value * STATUS_GRAPH_HEIGHT / _graphScale) : 0;
+  if (bar == 0 && value > 0) {
+    bar = 1;
+  }
+  if (bar > 0) {
+    canvas.drawFastVLine(x, top + STATUS_GRAPH_HEIGHT - bar, bar, TFT_CYAN);
+  }
+}
+
+void StatusView::addSample(uint32_t value) {
+  if (!_sprite && !_bands.ready()) {
+    return;
+  }
+  int16_t width = min<int16_t>(_tft->width(), STATUS_GRAPH_COLUMNS);
+  _samples[_sampleNext] = value;
+  _sampleNext = (_sampleNext + 1) % width;
+  if (_newSamples < width) {
+    _newSamples++;
+  }
+}
+
+// The next power of two over the largest sample shown, so the graph is
+// only redrawn as a whole when that changes
+uint32_t StatusView::graphScale() const {
+  int16_t width = min<int16_t>(_tft->width(), STATUS_GRAPH_COLUMNS);
+  uint32_t peak = 0;
+  for (int16_t i = 0; i < width; i++) {
+    peak = max(peak, _samples[i]);
+  }
+  uint32_t scale = 1024;
+  while (scale < peak && scale < 0x80000000u) {
+    scale <<= 1;
+  }
+  return scale;
+}
+
+// Scrolls in the samples added since the last frame, one column each
+void StatusView::drawGraph() {
+  int16_t width = min<int16_t>(_tft->width(), STATUS_GRAPH_COLUMNS);
+  uint32_t scale = graphScale();
+
+  if (_clear || scale != _graphScale) {
+    _graphScale = scale;
+    for (int16_t x = 0; x < width; x++) {
+      drawColumn(*_sprite, x, _samples[(_sampleNext + x) % width]);
+    }
+  } else {
+    _sprite->scroll(-_newSamples);
+    for (int16_t x = width - _newSamples; x < width; x++) {
+      drawColumn(*_sprite, x, _samples[(_sampleNext + x) % width]);
+    }
+  }
+  _newSamples = 0;
+  markDirty({graphTop(), (int16_t)(graphTop() + STATUS_GRAPH_HEIGHT)});
+}
+
+// Band renderer callback: the shown lines and the graph, clipped to the band
+void StatusView::drawBand(TFT_eSPI& canvas, void* context) {
+  StatusView* view = (StatusView*)context;
+  canvas.setTextDatum(TL_DATUM);
+  for (uint8_t i = 0; i < STATUS_VIEW_LINES; i++) {
+    const Line& line = view->_shown[i];
+    if (line.size != 0) {
+      canvas.setTextSize(line.size);
+      canvas.setTextColor(line.color, TFT_BLACK);
+      canvas.drawString(line.text, 0, line.y);
+    }
+  }
+  // The canvas origin is minus the band's top row
+  if (canvas.height() - canvas.getOriginY() <= view->graphTop()) {
+    return;
+  }
+  int16_t width = min<int16_t>(view->_tft->width(), STATUS_GRAPH_COLUMNS);
+  for (int16_t x = 0; x < width; x++) {
+    view->drawColumn(canvas, x, view->_samples[(view->_sampleNext + x) % width]);
+  }
+}
+
+void StatusView::begin(TFT_eSPI* tft) {
+  _tft = tft;
+  tft->setGlyphCache(STATUS_GLYPH_CACHE);
+  _sprite = new TFT_eSprite(tft);
+  _sprite->setColorDepth(16);
+  // Too large for internal RAM next to the BLE and Wi-Fi stacks
+  _sprite->setSpriteMemory(TFT_eSprite::SPRITE_MEM_PSRAM);
+  if (_sprite->createSprite(tft->width(), tft->height())) {
+    _canvas = _sprite;
+    _sprite->setGlyphCache(STATUS_GLYPH_CACHE);
+    _sprite->setScrollRect(0, graphTop(), min<int16_t>(tft->width(), STATUS_GRAPH_COLUMNS),
+                           STATUS_GRAPH_HEIGHT, TFT_BLACK);
+  } else {
+    delete _sprite;
+    _sprite = nullptr;
+    _canvas = tft;
+    if (_bands.begin(tft)) {
+      log_w("No memory for the status sprite, drawing in bands");
+    } else {
+      log_w("No memory for the status sprite, drawing on the panel");
+    }
+  }
+  _clear = true;
+}
+
+void StatusView::render() {
+  if (!_canvas) {
+    return;
+  }
+  // Bands draw from the shown lines when pushed, nothing is drawn here
+  bool banded = _bands.ready();
+  if (_clear) {
+    if (!banded) {
+      _canvas->fillScreen(TFT_BLACK);
+    }
+    memset(_shown, 0, sizeof(_shown));
+    markDirty({0, (int16_t)_tft->height()});
+  }
+
+  // Clear lines that moved or went away first, so that doesn't wipe a line
+  // redrawn at their old place; the padding only covers the new position
+  bool changed[STATUS_VIEW_LINES];
+  for (uint8_t i = 0; i < STATUS_VIEW_LINES; i++) {
+    const Line& shown = _shown[i];
+    const Line& next = _next[i];
+    changed[i] = _clear || !same(shown, next);
+    if (changed[i] && shown.size != 0) {
+      Rows old = rows(shown);
+      markDirty(old);
+      if (!banded && (next.size == 0 || shown.y != next.y || shown.size > next.size)) {
+        _canvas->fillRect(0, old.top, _canvas->width(), old.bottom - old.top, TFT_BLACK);
+      }
+    }
+  }
+
+  _canvas->setTextDatum(TL_DATUM);
+  // Pads each line to the full width, which overwrites the rest of its old text
+  _canvas->setTextPadding(_canvas->width());
+  for (uint8_t i = 0; i < STATUS_VIEW_LINES; i++) {
+    if (!changed[i]) {
+      continue;
+    }
+    const Line& next = _next[i];
+    if (next.size != 0) {
+      markDirty(rows(next));
+      if (!banded) {
+        _canvas->setTextColor(next.color, TFT_BLACK);
+        _canvas->drawString(next.text, 0, next.y);
+      }
+    }
+    _shown[i] = next;
+  }
+  _canvas->setTextPadding(0);
+  if (_sprite && (_clear || _newSamples > 0)) {
+    drawGraph();
+  } else if (banded && (_clear || _newSamples > 0)) {
+    _graphScale = graphScale();
+    _newSamples = 0;
+    markDirty({graphTop(), (int16_t)(graphTop() + STATUS_GRAPH_HEIGHT)});
+  }
+  _clear = false;
+  push();
+}
@@ -0,0 +1,257 @@
+#include "telemetry_export.h"
+
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include <stdarg.h>
+
+#include "ble_printer.h"
+#include "eth_link.h"
+#include "heap_stats.h"
+#include "print_writer.h"
+#include "wifi_link.h"
+
+static int sock = -1;
+static struct sockaddr_in collector;
+static bool resolved = false;
+static char bridgeId[16];
+
+// A line is formatted whole before it goes into the datagram, so a packet
+// never ends in half a line
+static char packet[TELEMETRY_PACKET_BYTES];
+static size_t packetUsed = 0;
+static char line[TELEMETRY_PACKET_BYTES];
+static size_t lineUsed = 0;
+static bool lineOverflow = false;
+static size_t lineFields = 0;
+static char prefix[80];                      // StatsD name up to the field
+
+static volatile uint32_t packetsSent = 0;
+static volatile uint32_t packetsDropped = 0;
+
+bool telemetryExportEnabled() {
+  return TELEMETRY_HOST[0] != '\0';
+}
+
+uint32_t telemetryPacketsSent() {
+  return packetsSent;
+}
+
+uint32_t telemetryPacketsDropped() {
+  return packetsDropped;
+}
+
+static void append(const char* format, ...) {
+  if (lineOverflow) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(line + lineUsed, sizeof(line) - lineUsed, format, args);
+  va_end(args);
+  if (written < 0 || (size_t)written >= sizeof(line) - lineUsed) {
+    lineOverflow = true;
+    return;
+  }
+  lineUsed += written;
+}
+
+// Tag values and StatsD name parts without the characters that delimit them
+static void appendName(const char* text, bool statsd) {
+  for (const char* p = text; *p != '\0'; p++) {
+    char c = *p;
+    if (statsd) {
+      append("%c", c == '.' || c == ':' || c == '|' || c == ' ' ? '_' : c);
+    } else {
+      append(c == ',' || c == '=' || c == ' ' ? "\\%c" : "%c", c);
+    }
+  }
+}
+
+static void flushPacket() {
+  if (packetUsed == 0) {
+    return;
+  }
+  if (sendto(sock, packet, packetUsed, MSG_DONTWAIT, (struct sockaddr*)&collector, sizeof(collector)) < 0) {
+    packetsDropped++;
+  } else {
+    packetsSent++;
+  }
+  packetUsed = 0;
+}
+
+static void beginLine(const char* measurement, const BlePrinter* printer) {
+  lineUsed = 0;
+  lineOverflow = false;
+  lineFields = 0;
+#if TELEMETRY_FORMAT == TELEMETRY_STATSD
+  append("bridge.%s.", bridgeId);
+  if (printer != nullptr) {
+    appendName(printer->id().c_str(), true);
+    append(".");
+  }
+  append("%s.", measurement);
+  strlcpy(prefix, line, sizeof(prefix));
+  lineUsed = 0;
+#else
+  append("%s,bridge=%s", measurement, bridgeId);
+  if (printer != nullptr) {
+    append(",printer=");
+    appendName(printer->id().c_str(), false);
+  }
+  append(" ");
+#endif
+}
+
+static void field(const char* name, uint64_t value) {
+#if TELEMETRY_FORMAT == TELEMETRY_STATSD
+  append("%s%s:%llu|g\n", prefix, name, (unsigned long long)value);
+#else
+  append("%s%s=%llui", lineFields > 0 ? "," : "", name, (unsigned long long)value);
+#endif
+  lineFields++;
+}
+
+// Into the datagram, sending it first when the line doesn't fit
+static void endLine() {
+#if TELEMETRY_FORMAT != TELEMETRY_STATSD
+  append("\n");
+#endif
+  if (lineOverflow || lineFields == 0) {
+    return;
+  }
+  if (packetUsed + lineUsed > sizeof(packet)) {
+    flushPacket();
+  }
+  memcpy(packet + packetUsed, line, lineUsed);
+  packetUsed += lineUsed;
+}
+
+static void addPrinter(const BlePrinter& printer) {
+  const LinkMetrics& metrics = printer.metrics();
+  PrintWriterStats stats = {};
+  getPrintWriterStats(printer.index(), stats);
+
+  beginLine("bridge_printer", &printer);
+  field("connected", printer.connected() ? 1 : 0);
+  field("bytes", metrics.bytes());
+  field("rate10s", metrics.rate(10));
+  field("rate60s", metrics.rate(LINK_RATE_SECONDS));
+  field("writes", metrics.chunks());
+  field("latency_p50_us", metrics.latencyPercentileUs(0.5f));
+  field("latency_p99_us", metrics.latencyPercentileUs(0.99f));
+  field("credit_timeouts", metrics.creditTimeouts());
+  field("write_errors", metrics.writeErrors());
+  field("flow_paused_ms", metrics.flowPausedMs());
+  field("connects", metrics.connects());
+  field("connect_failures", metrics.connectFailures());
+  field("disconnects", metrics.disconnects());
+  field("queue", printQueueDepth(printer.index()));
+  field("pending_bytes", printWriterPending(printer.index()));
+  field("jobs_done", stats.done);
+  field("jobs_failed", stats.failed);
+  endLine();
+
+  // Buckets by their upper bound, cumulative as in /metrics
+  beginLine("bridge_latency", &printer);
+  char name[16];
+  uint64_t cumulative = 0;
+  for (size_t b = 0; b < LINK_LATENCY_BUCKETS; b++) {
+    cumulative += metrics.bucketCount(b);
+    if (b + 1 < LINK_LATENCY_BUCKETS) {
+      snprintf(name, sizeof(name), "le_%u", (unsigned)LINK_LATENCY_BOUNDS_US[b]);
+    } else {
+      strlcpy(name, "le_inf", sizeof(name));
+    }
+    field(name, cumulative);
+  }
+  field("sum_us", metrics.latencySumUs());
+  endLine();
+}
+
+static void addBridge() {
+  HeapRegionStats internal;
+  HeapRegionStats psram;
+  getInternalHeapStats(internal);
+  getPsramStats(psram);
+  beginLine("bridge", nullptr);
+  field("uptime_s", millis() / 1000);
+  field("heap_free", internal.free);
+  field("heap_min_free", internal.minFree);
+  field("heap_largest_block", internal.largestBlock);
+  field("psram_free", psram.free);
+  field("queue", printQueueDepth());
+  field("pending_bytes", printWriterPending());
+  field("telemetry_dropped", packetsDropped);
+  endLine();
+}
+
+static bool resolveCollector() {
+  memset(&collector, 0, sizeof(collector));
+  collector.sin_family = AF_INET;
+  collector.sin_port = htons(TELEMETRY_PORT);
+  if (inet_aton(TELEMETRY_HOST, &collector.sin_addr)) {
+    return true;
+  }
+  IPAddress address;
+  if (!WiFi.hostByName(TELEMETRY_HOST, address)) {
+    return false;
+  }
+  collector.sin_addr.s_addr = (uint32_t)address;
+  return true;
+}
+
+static void exportTask(void* param) {
+  (void)param;
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(TELEMETRY_INTERVAL_MS));
+    if (!wifiLinkUp() && !ethLinkUp()) {
+      continue;
+    }
+    if (!resolved) {
+      resolved = resolveCollector();
+      if (!resolved) {
+        log_w("Telemetry: %s not resolved", TELEMETRY_HOST);
+        continue;
+      }
+    }
+    // The stack takes its buffers from internal RAM; leave it to the radios
+    HeapRegionStats internal;
+    getInternalHeapStats(internal);
+    if (internal.free < HEAP_INTERNAL_RESERVE) {
+      packetsDropped++;
+      continue;
+    }
+
+    packetUsed = 0;
+    for (size_t i = 0; i < printerCount(); i++) {
+      addPrinter(*getPrinter(i));
+    }
+    addBridge();
+    flushPacket();
+  }
+}
+
+void initTelemetryExport() {
+  if (!telemetryExportEnabled()) {
+    return;
+  }
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(bridgeId, sizeof(bridgeId), "bridge-%02x%02x%02x", (uint8_t)(mac >> 24), (uint8_t)(mac >> 32),
+           (uint8_t)(mac >> 40));
+
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0) {
+    log_e("Telemetry socket failed");
+    return;
+  }
+  if (xTaskCreatePinnedToCore(exportTask, "telemetry", 4096, nullptr, TELEMETRY_PRIORITY, nullptr,
+                              TELEMETRY_CORE) != pdPASS) {
+    log_e("Failed to start telemetry task");
+    close(sock);
+    sock = -1;
+    return;
+  }
+  log_i("Telemetry to %s:%u every %u ms", TELEMETRY_HOST, TELEMETRY_PORT, TELEMETRY_INTERVAL_MS);
+}
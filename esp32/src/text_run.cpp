@@ -0,0 +1,123 @@
+#include "text_run.h"
+
+bool TextRun::set(const char* utf8) {
+  uint16_t codes[TEXT_RUN_GLYPHS];
+  uint8_t length = 0;
+  const uint8_t* p = (const uint8_t*)utf8;
+  while (*p && length < TEXT_RUN_GLYPHS) {
+    uint16_t c = *p++;
+    if ((c & 0xE0) == 0xC0 && (p[0] & 0xC0) == 0x80) {
+      c = (c & 0x1F) << 6 | (*p++ & 0x3F);
+    } else if ((c & 0xF0) == 0xE0 && (p[0] & 0xC0) == 0x80 && (p[1] & 0xC0) == 0x80) {
+      c = (c & 0x0F) << 12 | (p[0] & 0x3F) << 6 | (p[1] & 0x3F);
+      p += 2;
+    }
+    codes[length++] = c;
+  }
+
+  if (length == _length && memcmp(codes, _codes, length * sizeof(codes[0])) == 0) {
+    return false;
+  }
+  memcpy(_codes, codes, length * sizeof(codes[0]));
+  _length = length;
+  _metricsKey = 0;
+  return true;
+}
+
+void TextRun::measure(TFT_eSPI& canvas) {
+  uint16_t key = canvas.textfont | canvas.textsize << 8;
+  if (key == _metricsKey) {
+    return;
+  }
+  _width = 0;
+  for (uint8_t i = 0; i < _length; i++) {
+    // textWidth() takes a string; one glyph encoded back to UTF-8
+    uint16_t c = _codes[i];
+    char glyph[4];
+    if (c < 0x80) {
+      glyph[0] = c;
+      glyph[1] = '\0';
+    } else if (c < 0x800) {
+      glyph[0] = 0xC0 | c >> 6;
+      glyph[1] = 0x80 | (c & 0x3F);
+      glyph[2] = '\0';
+    } else {
+      glyph[0] = 0xE0 | c >> 12;
+      glyph[1] = 0x80 | (c >> 6 & 0x3F);
+      glyph[2] = 0x80 | (c & 0x3F);
+      glyph[3] = '\0';
+    }
+    _advance[i] = canvas.textWidth(glyph, canvas.textfont);
+    _width += _advance[i];
+  }
+  _metricsKey = key;
+}
+
+int16_t TextRun::width(TFT_eSPI& canvas) {
+  measure(canvas);
+  return _width;
+}
+
+void TextRun::draw(TFT_eSPI& canvas, int16_t x, int16_t y, uint8_t datum, uint16_t color, uint16_t bg) {
+  measure(canvas);
+  int16_t left = x;
+  if (datum % 3 == 1) {
+    left -= _width / 2;
+  } else if (datum % 3 == 2) {
+    left -= _width;
+  }
+
+  // Glyphs can only be kept when they look the same
+  bool keep = _drawnWidth > 0 && _drawnKey == _metricsKey && _drawnY == y &&
+              _drawnColor == color && _drawnBg == bg;
+
+  canvas.startWrite();
+  if (_drawnWidth > 0) {
+    int16_t height = canvas.fontHeight();
+    int16_t oldRight = _drawnX + _drawnWidth;
+    if (!keep) {
+      // Another font, colour or row: the old text goes entirely
+      canvas.fillRect(_drawnX, _drawnY, _drawnWidth, _drawnHeight, _drawnBg);
+    } else {
+      // Only what the new cells don't paint over
+      if (_drawnX < left) {
+        canvas.fillRect(_drawnX, y, min<int16_t>(left, oldRight) - _drawnX, height, bg);
+      }
+      if (oldRight > left + _width) {
+        int16_t from = max<int16_t>(_drawnX, left + _width);
+        canvas.fillRect(from, y, oldRight - from, height, bg);
+      }
+    }
+  }
+
+  canvas.setTextColor(color, bg);
+  int16_t px = left;
+  int16_t ox = _drawnX;
+  uint8_t j = 0;
+  for (uint8_t i = 0; i < _length; i++) {
+    if (keep) {
+      // Old glyphs left of this one can't match any more
+      while (j < _drawnLength && ox < px) {
+        ox += _drawnAdvance[j++];
+      }
+      if (j < _drawnLength && ox == px && _drawnCodes[j] == _codes[i] && _drawnAdvance[j] == _advance[i]) {
+        px += _advance[i];
+        continue;
+      }
+    }
+    canvas.drawChar(_codes[i], px, y, canvas.textfont);
+    px += _advance[i];
+  }
+  canvas.endWrite();
+
+  memcpy(_drawnCodes, _codes, _length * sizeof(_codes[0]));
+  memcpy(_drawnAdvance, _advance, _length);
+  _drawnLength = _length;
+  _drawnX = left;
+  _drawnY = y;
+  _drawnWidth = _width;
+  _drawnHeight = canvas.fontHeight();
+  _drawnKey = _metricsKey;
+  _drawnColor = color;
+  _drawnBg = bg;
+}
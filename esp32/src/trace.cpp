@@ -0,0 +1,194 @@
+#include "trace.h"
+#include "heap_stats.h"
+#include "http_admission.h"
+
+#include <atomic>
+#include <esp_timer.h>
+
+#if TRACE_EVENTS
+
+static_assert((TRACE_EVENTS & (TRACE_EVENTS - 1)) == 0, "TRACE_EVENTS must be a power of two");
+
+struct TraceRecord {
+  uint32_t time;               // Low word of esp_timer_get_time()
+  uint32_t arg;
+  TaskHandle_t task;
+  uint16_t event;
+  char phase;
+  uint8_t core;
+};
+
+// Each core writes only its own ring. A task claims a slot before filling
+// it, so one that preempts another on the same core takes the next slot.
+struct TraceRing {
+  std::atomic<uint32_t> next{0};
+  TraceRecord records[TRACE_EVENTS];
+};
+
+static TraceRing rings[portNUM_PROCESSORS];
+
+static const char* const EVENT_NAMES[TRACE_EVENT_COUNT] = {
+  "http body", "job admit", "job append", "job streaming", "job done",
+  "writer slice", "ble write", "tx credit", "link state", "display"
+};
+
+// Tasks that aren't ours but show up in the trace, named by looking them up
+static const char* const SYSTEM_TASKS[] = {"async_tcp", "loopTask", "BTC_TASK", "BTU_TASK", "btController"};
+
+void traceRecord(TraceEvent event, char phase, uint32_t arg) {
+  uint8_t core = xPortGetCoreID();
+  TraceRing& ring = rings[core];
+  TraceRecord& record = ring.records[ring.next.fetch_add(1, std::memory_order_relaxed) & (TRACE_EVENTS - 1)];
+  record.time = (uint32_t)esp_timer_get_time();
+  record.arg = arg;
+  record.task = xTaskGetCurrentTaskHandle();
+  record.event = event;
+  record.phase = phase;
+  record.core = core;
+}
+
+enum DumpStage { DUMP_HEADER, DUMP_TASKS, DUMP_SYSTEM_TASKS, DUMP_RECORDS, DUMP_FOOTER, DUMP_END };
+
+// Copy of the rings taken when the request came in, formatted one event at
+// a time as the response is sent
+struct TraceDump {
+  int64_t now;
+  DumpStage stage;
+  size_t next;                 // Within the stage
+  size_t emitted;              // Trace events written, for the commas
+  char line[192];
+  size_t lineLength;
+  size_t linePos;
+  size_t count;
+  TraceRecord records[portNUM_PROCESSORS * TRACE_EVENTS];
+};
+
+static TraceDump* takeDump() {
+  TraceDump* dump = (TraceDump*)heapAlloc(HEAP_SITE_TRACE, sizeof(TraceDump));
+  if (dump == nullptr) {
+    return nullptr;
+  }
+  memset(dump, 0, offsetof(TraceDump, records));
+  dump->now = esp_timer_get_time();
+  for (size_t core = 0; core < portNUM_PROCESSORS; core++) {
+    uint32_t next = rings[core].next.load(std::memory_order_relaxed);
+    uint32_t kept = min<uint32_t>(next, TRACE_EVENTS);
+    for (uint32_t i = next - kept; i != next; i++) {
+      const TraceRecord& record = rings[core].records[i & (TRACE_EVENTS - 1)];
+      // A slot still being filled may hold parts of two records
+      if (record.event < TRACE_EVENT_COUNT && (record.phase == 'B' || record.phase == 'E' || record.phase == 'i')) {
+        dump->records[dump->count++] = record;
+      }
+    }
+  }
+  return dump;
+}
+
+static void threadName(TraceDump* dump, TaskHandle_t task, const char* name) {
+  dump->lineLength = snprintf(dump->line, sizeof(dump->line),
+                              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                              dump->emitted++ ? "," : "", (uint32_t)(uintptr_t)task, name);
+}
+
+static void recordLine(TraceDump* dump, const TraceRecord& record) {
+  // 64-bit time from the distance to the time of the copy
+  int64_t ts = dump->now - (uint32_t)((uint32_t)dump->now - record.time);
+  dump->lineLength = snprintf(dump->line, sizeof(dump->line),
+                              "%s{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%lld,\"pid\":1,\"tid\":%u,"
+                              "\"args\":{\"arg\":%u,\"core\":%u}}",
+                              dump->emitted++ ? "," : "", EVENT_NAMES[record.event], record.phase,
+                              record.phase == 'i' ? "\"s\":\"t\"," : "", (long long)ts, (uint32_t)(uintptr_t)record.task,
+                              record.arg, record.core);
+}
+
+// Put the next piece of the JSON into dump->line; false once all is out
+static bool nextLine(TraceDump* dump) {
+  dump->linePos = 0;
+  dump->lineLength = 0;
+  while (dump->lineLength == 0) {
+    switch (dump->stage) {
+      case DUMP_HEADER:
+        dump->lineLength = snprintf(dump->line, sizeof(dump->line), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        dump->stage = DUMP_TASKS;
+        break;
+      case DUMP_TASKS:
+        if (dump->next < trackedTaskCount()) {
+          threadName(dump, trackedTaskHandle(dump->next), trackedTaskName(dump->next));
+          dump->next++;
+        } else {
+          dump->stage = DUMP_SYSTEM_TASKS;
+          dump->next = 0;
+        }
+        break;
+      case DUMP_SYSTEM_TASKS:
+        if (dump->next < sizeof(SYSTEM_TASKS) / sizeof(SYSTEM_TASKS[0])) {
+          const char* name = SYSTEM_TASKS[dump->next++];
+          TaskHandle_t task = xTaskGetHandle(name);
+          if (task != nullptr) {
+            threadName(dump, task, name);
+          }
+        } else {
+          dump->stage = DUMP_RECORDS;
+          dump->next = 0;
+        }
+        break;
+      case DUMP_RECORDS:
+        if (dump->next < dump->count) {
+          recordLine(dump, dump->records[dump->next++]);
+        } else {
+          dump->stage = DUMP_FOOTER;
+        }
+        break;
+      case DUMP_FOOTER:
+        dump->lineLength = snprintf(dump->line, sizeof(dump->line), "]}");
+        dump->stage = DUMP_END;
+        break;
+      case DUMP_END:
+        return false;
+    }
+  }
+  return true;
+}
+
+static size_t fillTrace(TraceDump* dump, uint8_t* out, size_t maxLen) {
+  size_t n = 0;
+  while (n < maxLen) {
+    if (dump->linePos == dump->lineLength && !nextLine(dump)) {
+      break;
+    }
+    size_t take = min(maxLen - n, dump->lineLength - dump->linePos);
+    memcpy(out + n, dump->line + dump->linePos, take);
+    dump->linePos += take;
+    n += take;
+  }
+  return n;
+}
+
+static void sendTrace(AsyncWebServerRequest* request) {
+  TraceDump* dump = takeDump();
+  if (dump == nullptr) {
+    request->send(503, "text/plain", "No memory for the trace");
+    return;
+  }
+  onRequestEnd(request, [dump]() {
+    heapFree(dump);
+  });
+  AsyncWebServerResponse* response = request->beginChunkedResponse(
+      "application/json", [dump](uint8_t* out, size_t maxLen, size_t index) -> size_t {
+        return fillTrace(dump, out, maxLen);
+      });
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+void initTrace(AsyncWebServer& server) {
+  server.on(TRACE_PATH, HTTP_GET, sendTrace);
+  log_i("Tracing %u events per core at %s", TRACE_EVENTS, TRACE_PATH);
+}
+
+#else
+
+void initTrace(AsyncWebServer& server) {
+}
+
+#endif
@@ -0,0 +1,31 @@
+#include "tx_power.h"
+
+static const uint8_t MIN_STEP = TX_POWER_MIN_DBM <= -12 ? 0
+                              : TX_POWER_MIN_DBM >= 9 ? TX_POWER_STEPS - 1
+                              : (TX_POWER_MIN_DBM + 12 + 2) / 3;
+
+void TxPowerPolicy::begin() {
+  _step = TX_POWER_STEPS - 1;
+  _strongRounds = 0;
+}
+
+bool TxPowerPolicy::round(int8_t rssi, bool degraded) {
+  if (degraded || (rssi != 0 && rssi < TX_POWER_RAISE_RSSI)) {
+    _strongRounds = 0;
+    if (_step < TX_POWER_STEPS - 1) {
+      _step++;
+      return true;
+    }
+    return false;
+  }
+  if (rssi == 0 || rssi <= TX_POWER_LOWER_RSSI) {
+    _strongRounds = 0;
+    return false;
+  }
+  if (++_strongRounds < TX_POWER_LOWER_ROUNDS || _step <= MIN_STEP) {
+    return false;
+  }
+  _strongRounds = 0;
+  _step--;
+  return true;
+}
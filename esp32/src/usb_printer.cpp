@@ -0,0 +1,367 @@
+#include "usb_printer.h"
+#include "heap_stats.h"
+#include "stall_watch.h"
+
+#if USB_HOST_PRINTER
+
+#include <usb/usb_host.h>
+
+const uint8_t USB_CLASS_PRINTER = 0x07;
+const uint8_t USB_CLASS_CDC = 0x02;
+const uint8_t USB_CLASS_CDC_DATA = 0x0A;
+const uint8_t USB_DESC_INTERFACE = 0x04;
+const uint8_t USB_DESC_ENDPOINT = 0x05;
+const uint8_t USB_ENDPOINT_BULK = 0x02;
+
+// CDC-ACM class requests to the communication interface
+const uint8_t CDC_SET_LINE_CODING = 0x20;
+const uint8_t CDC_SET_CONTROL_LINE_STATE = 0x22;
+const uint16_t CDC_DTR_RTS = 0x0003;
+const uint32_t USB_CONTROL_TIMEOUT_MS = 1000;
+
+static UsbPrinterListener usbListener = nullptr;
+static void* usbListenerContext = nullptr;
+static usb_host_client_handle_t usbClient = nullptr;
+
+// The attached printer. The client task opens and closes it; the writer
+// task only submits transfers while it is attached.
+static usb_device_handle_t usbDevice = nullptr;
+static volatile bool usbAttached = false;
+static volatile bool usbClosing = false;        // Gone, waiting for its transfers to come back
+static volatile uint8_t usbNewAddress = 0;      // Seen by the client callback, opened by the task
+static UsbPrinterClass usbClass = USB_PRINTER_NONE;
+static uint8_t usbInterface = 0;
+static uint8_t usbControlInterface = 0;         // CDC communication interface
+static bool usbControlClaimed = false;
+static uint8_t usbEndpoint = 0;
+static char usbName[32] = "USB printer";
+
+// Bulk transfers not in flight; the writer takes one, fills and submits it
+static usb_transfer_t* usbTransfers[USB_PRINTER_TRANSFERS];
+static QueueHandle_t usbFreeTransfers = nullptr;
+static volatile bool usbFailed = false;         // A transfer went wrong since the last write
+static volatile bool usbControlDone = false;
+
+static void onBulkDone(usb_transfer_t* transfer) {
+  if (transfer->status != USB_TRANSFER_STATUS_COMPLETED) {
+    usbFailed = true;
+  }
+  xQueueSend(usbFreeTransfers, &transfer, 0);
+}
+
+static void onControlDone(usb_transfer_t* transfer) {
+  usbControlDone = true;
+}
+
+static void onClientEvent(const usb_host_client_event_msg_t* msg, void* arg) {
+  if (msg->event == USB_HOST_CLIENT_EVENT_NEW_DEV) {
+    if (usbDevice == nullptr) {
+      usbNewAddress = msg->new_dev.address;
+    }
+  } else if (msg->event == USB_HOST_CLIENT_EVENT_DEV_GONE) {
+    if (msg->dev_gone.dev_hdl == usbDevice && usbAttached) {
+      log_i("USB printer removed");
+      usbAttached = false;
+      usbClosing = true;
+      if (usbListener) {
+        usbListener(usbListenerContext, false);
+      }
+    }
+  }
+}
+
+// Class request on the CDC communication interface; runs in the client
+// task, which has to keep handling events for the transfer to complete
+static bool cdcRequest(uint8_t request, uint16_t value, const uint8_t* data, uint16_t length) {
+  usb_transfer_t* transfer;
+  if (usb_host_transfer_alloc(sizeof(usb_setup_packet_t) + 8, 0, &transfer) != ESP_OK) {
+    return false;
+  }
+  uint8_t* setup = transfer->data_buffer;
+  setup[0] = 0x21;                   // Host to device, class, interface
+  setup[1] = request;
+  setup[2] = value & 0xFF;
+  setup[3] = value >> 8;
+  setup[4] = usbControlInterface;
+  setup[5] = 0;
+  setup[6] = length & 0xFF;
+  setup[7] = length >> 8;
+  if (length > 0) {
+    memcpy(setup + sizeof(usb_setup_packet_t), data, length);
+  }
+  transfer->num_bytes = sizeof(usb_setup_packet_t) + length;
+  transfer->device_handle = usbDevice;
+  transfer->bEndpointAddress = 0;
+  transfer->callback = onControlDone;
+  transfer->context = nullptr;
+  transfer->timeout_ms = USB_CONTROL_TIMEOUT_MS;
+
+  usbControlDone = false;
+  bool ok = usb_host_transfer_submit_control(usbClient, transfer) == ESP_OK;
+  unsigned long start = millis();
+  while (ok && !usbControlDone) {
+    usb_host_client_handle_events(usbClient, pdMS_TO_TICKS(10));
+    if (millis() - start > USB_CONTROL_TIMEOUT_MS * 2) {
+      ok = false;
+    }
+  }
+  ok = ok && transfer->status == USB_TRANSFER_STATUS_COMPLETED;
+  // One the stack never gave back is left to leak rather than freed under it
+  if (usbControlDone) {
+    usb_host_transfer_free(transfer);
+  }
+  return ok;
+}
+
+// Take the product string as the printer's name, ASCII only
+static void readName() {
+  usb_device_info_t info;
+  strlcpy(usbName, "USB printer", sizeof(usbName));
+  if (usb_host_get_device_info(usbDevice, &info) != ESP_OK || info.str_desc_product == nullptr) {
+    return;
+  }
+  const usb_str_desc_t* text = info.str_desc_product;
+  size_t chars = (text->bLength - 2) / 2;
+  size_t length = 0;
+  for (size_t i = 0; i < chars && length + 1 < sizeof(usbName); i++) {
+    uint16_t c = text->wData[i];
+    usbName[length++] = (c >= 0x20 && c < 0x7F) ? (char)c : '?';
+  }
+  usbName[length] = '\0';
+}
+
+// Walk the configuration for the printer class interface, or the CDC data
+// interface and its communication interface, and a bulk OUT endpoint
+static bool findEndpoint() {
+  const usb_config_desc_t* config;
+  if (usb_host_get_active_config_descriptor(usbDevice, &config) != ESP_OK) {
+    return false;
+  }
+  const uint8_t* p = (const uint8_t*)config;
+  size_t total = config->wTotalLength;
+
+  UsbPrinterClass found = USB_PRINTER_NONE;
+  UsbPrinterClass current = USB_PRINTER_NONE;
+  bool haveControl = false;
+  uint8_t interfaceNumber = 0;
+  for (size_t offset = 0; offset + 2 <= total && p[offset] >= 2; offset += p[offset]) {
+    const uint8_t* desc = p + offset;
+    if (desc[1] == USB_DESC_INTERFACE && desc[0] >= 9) {
+      interfaceNumber = desc[2];
+      current = desc[5] == USB_CLASS_PRINTER ? USB_PRINTER_CLASS
+              : desc[5] == USB_CLASS_CDC_DATA ? USB_PRINTER_CDC : USB_PRINTER_NONE;
+      if (desc[5] == USB_CLASS_CDC) {
+        usbControlInterface = desc[2];
+        haveControl = true;
+      }
+    } else if (desc[1] == USB_DESC_ENDPOINT && desc[0] >= 7 && current != USB_PRINTER_NONE) {
+      bool bulkOut = (desc[2] & 0x80) == 0 && (desc[3] & 0x03) == USB_ENDPOINT_BULK;
+      // A printer class interface wins over a CDC one
+      if (bulkOut && (found == USB_PRINTER_NONE || (found == USB_PRINTER_CDC && current == USB_PRINTER_CLASS))) {
+        found = current;
+        usbInterface = interfaceNumber;
+        usbEndpoint = desc[2];
+      }
+    }
+  }
+  usbClass = found;
+  usbControlClaimed = found == USB_PRINTER_CDC && haveControl;
+  return found != USB_PRINTER_NONE;
+}
+
+static void openDevice(uint8_t address) {
+  if (usb_host_device_open(usbClient, address, &usbDevice) != ESP_OK) {
+    usbDevice = nullptr;
+    return;
+  }
+  if (!findEndpoint()) {
+    log_w("USB device %u has no printer or CDC bulk OUT endpoint", address);
+    usb_host_device_close(usbClient, usbDevice);
+    usbDevice = nullptr;
+    return;
+  }
+  if (usb_host_interface_claim(usbClient, usbDevice, usbInterface, 0) != ESP_OK) {
+    log_e("USB printer interface %u busy", usbInterface);
+    usb_host_device_close(usbClient, usbDevice);
+    usbDevice = nullptr;
+    return;
+  }
+  if (usbControlClaimed && usb_host_interface_claim(usbClient, usbDevice, usbControlInterface, 0) != ESP_OK) {
+    usbControlClaimed = false;
+  }
+  if (usbClass == USB_PRINTER_CDC && usbControlClaimed) {
+    // 8N1 at USB_CDC_BAUD, then DTR and RTS up; printers that ignore the
+    // line state refuse these, which is fine
+    uint32_t baud = USB_CDC_BAUD;
+    uint8_t coding[7] = {(uint8_t)baud, (uint8_t)(baud >> 8), (uint8_t)(baud >> 16), (uint8_t)(baud >> 24), 0, 0, 8};
+    if (!cdcRequest(CDC_SET_LINE_CODING, 0, coding, sizeof(coding)) ||
+        !cdcRequest(CDC_SET_CONTROL_LINE_STATE, CDC_DTR_RTS, nullptr, 0)) {
+      log_w("USB CDC printer refused line setup");
+    }
+  }
+
+  readName();
+  usbFailed = false;
+  usbAttached = true;
+  log_i("✅ USB printer %s, %s endpoint 0x%02x", usbName, usbClass == USB_PRINTER_CLASS ? "printer class" : "CDC",
+        usbEndpoint);
+  if (usbListener) {
+    usbListener(usbListenerContext, true);
+  }
+}
+
+static void closeDevice() {
+  usb_host_interface_release(usbClient, usbDevice, usbInterface);
+  if (usbControlClaimed) {
+    usb_host_interface_release(usbClient, usbDevice, usbControlInterface);
+  }
+  usb_host_device_close(usbClient, usbDevice);
+  usbDevice = nullptr;
+  usbClass = USB_PRINTER_NONE;
+  usbClosing = false;
+}
+
+static void usbHostTask(void* param) {
+  for (;;) {
+    uint32_t flags;
+    usb_host_lib_handle_events(portMAX_DELAY, &flags);
+    if (flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS) {
+      usb_host_device_free_all();
+    }
+  }
+}
+
+static void usbClientTask(void* param) {
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  for (;;) {
+    usb_host_client_handle_events(usbClient, pdMS_TO_TICKS(100));
+    if (usbNewAddress != 0) {
+      uint8_t address = usbNewAddress;
+      usbNewAddress = 0;
+      openDevice(address);
+    }
+    // A gone device is closed once all its transfers have come back
+    if (usbClosing && uxQueueMessagesWaiting(usbFreeTransfers) == USB_PRINTER_TRANSFERS) {
+      closeDevice();
+    }
+  }
+}
+
+bool initUsbPrinter(UsbPrinterListener listener, void* context) {
+  usbListener = listener;
+  usbListenerContext = context;
+
+  usb_host_config_t hostConfig = {};
+  hostConfig.intr_flags = ESP_INTR_FLAG_LEVEL1;
+  esp_err_t err = usb_host_install(&hostConfig);
+  if (err != ESP_OK) {
+    log_e("USB host install failed: %s", esp_err_to_name(err));
+    return false;
+  }
+
+  usb_host_client_config_t clientConfig = {};
+  clientConfig.is_synchronous = false;
+  clientConfig.max_num_event_msg = 5;
+  clientConfig.async.client_event_callback = onClientEvent;
+  clientConfig.async.callback_arg = nullptr;
+  if (usb_host_client_register(&clientConfig, &usbClient) != ESP_OK) {
+    log_e("USB host client registration failed");
+    return false;
+  }
+
+  usbFreeTransfers = xQueueCreate(USB_PRINTER_TRANSFERS, sizeof(usb_transfer_t*));
+  if (usbFreeTransfers == nullptr) {
+    return false;
+  }
+  for (size_t i = 0; i < USB_PRINTER_TRANSFERS; i++) {
+    if (usb_host_transfer_alloc(USB_PRINTER_TRANSFER_SIZE, 0, &usbTransfers[i]) != ESP_OK) {
+      log_e("No DMA memory for USB transfers");
+      return false;
+    }
+    usbTransfers[i]->callback = onBulkDone;
+    xQueueSend(usbFreeTransfers, &usbTransfers[i], 0);
+  }
+
+  if (xTaskCreatePinnedToCore(usbHostTask, "usbHost", 3072, nullptr, 2, nullptr, USB_HOST_CORE) != pdPASS ||
+      xTaskCreatePinnedToCore(usbClientTask, "usbPrinter", 4096, nullptr, 2, nullptr, USB_HOST_CORE) != pdPASS) {
+    log_e("Failed to start USB host tasks");
+    return false;
+  }
+  log_i("USB host up, waiting for a printer");
+  return true;
+}
+
+bool usbPrinterAttached() {
+  return usbAttached;
+}
+
+UsbPrinterClass usbPrinterClass() {
+  return usbAttached ? usbClass : USB_PRINTER_NONE;
+}
+
+const char* usbPrinterName() {
+  return usbName;
+}
+
+bool usbPrinterWrite(const uint8_t* data, size_t length) {
+  STALL_SECTION("usb write");
+  size_t offset = 0;
+  while (offset < length) {
+    usb_transfer_t* transfer;
+    if (!usbAttached) {
+      return false;
+    }
+    if (xQueueReceive(usbFreeTransfers, &transfer, pdMS_TO_TICKS(USB_PRINTER_TIMEOUT_MS)) != pdTRUE) {
+      // The printer has NAKed for too long; cancel what is in flight so the
+      // transfers come back
+      log_e("USB printer took nothing for %d ms", USB_PRINTER_TIMEOUT_MS);
+      usb_host_endpoint_halt(usbDevice, usbEndpoint);
+      usb_host_endpoint_flush(usbDevice, usbEndpoint);
+      usb_host_endpoint_clear(usbDevice, usbEndpoint);
+      return false;
+    }
+    if (usbFailed) {
+      usbFailed = false;
+      xQueueSend(usbFreeTransfers, &transfer, 0);
+      return false;
+    }
+
+    size_t chunk = length - offset < USB_PRINTER_TRANSFER_SIZE ? length - offset : USB_PRINTER_TRANSFER_SIZE;
+    memcpy(transfer->data_buffer, data + offset, chunk);
+    transfer->num_bytes = chunk;
+    transfer->device_handle = usbDevice;
+    transfer->bEndpointAddress = usbEndpoint;
+    transfer->timeout_ms = 0;
+    if (usb_host_transfer_submit(transfer) != ESP_OK) {
+      xQueueSend(usbFreeTransfers, &transfer, 0);
+      return false;
+    }
+    offset += chunk;
+  }
+  return true;
+}
+
+#else
+
+bool initUsbPrinter(UsbPrinterListener listener, void* context) {
+  log_e("Printer \"usb\" needs a build with -DUSB_HOST_PRINTER=1");
+  return false;
+}
+
+bool usbPrinterAttached() {
+  return false;
+}
+
+UsbPrinterClass usbPrinterClass() {
+  return USB_PRINTER_NONE;
+}
+
+const char* usbPrinterName() {
+  return "USB printer";
+}
+
+bool usbPrinterWrite(const uint8_t* data, size_t length) {
+  return false;
+}
+
+#endif
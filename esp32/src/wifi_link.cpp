@@ -0,0 +1,246 @@
+#include "wifi_link.h"
+
+#include <WiFi.h>
+#include <esp_attr.h>
+#include <esp_wifi.h>
+
+#include "power_profile.h"
+
+static const uint32_t WIFI_CACHE_MAGIC = 0x57494649;  // "WIFI"
+// Lets the HTTP answer that changed the network reach its client
+static const uint32_t WIFI_SWITCH_DELAY_MS = 500;
+
+// Access point of the last connection, kept across resets
+struct WifiCache {
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+};
+RTC_DATA_ATTR static WifiCache cache;
+
+static char wifiSsid[33];
+static char wifiPassword[65];
+static SemaphoreHandle_t wifiLock = nullptr;
+static volatile bool linkUp = false;
+static bool attempting = false;
+static bool retryPending = false;
+static bool useCache = false;
+static uint32_t attemptStart = 0;
+static uint32_t nextAttempt = 0;
+static uint32_t backoff = WIFI_BACKOFF_MIN_MS;
+static bool switchPending = false;
+static uint32_t switchAt = 0;
+static bool suspendWanted = false;
+static bool suspended = false;
+
+// Join with the profile's listen interval, which is only read at association
+static void connectStation() {
+  uint16_t interval = wifiListenInterval();
+  if (interval > 0) {
+    wifi_config_t conf;
+    if (esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK) {
+      conf.sta.listen_interval = interval;
+      esp_wifi_set_config(WIFI_IF_STA, &conf);
+    }
+  }
+  esp_wifi_connect();
+}
+
+static bool cacheValid() {
+  return cache.magic == WIFI_CACHE_MAGIC && cache.channel >= 1 && cache.channel <= 14;
+}
+
+// Caller holds wifiLock
+static void startAttempt() {
+  attempting = true;
+  attemptStart = millis();
+  if (useCache && cacheValid()) {
+    log_i("Joining %s on channel %u", wifiSsid, cache.channel);
+    WiFi.begin(wifiSsid, wifiPassword, cache.channel, cache.bssid, false);
+  } else {
+    log_i("Connecting to %s", wifiSsid);
+    WiFi.begin(wifiSsid, wifiPassword, 0, nullptr, false);
+  }
+  connectStation();
+}
+
+// Caller holds wifiLock
+static void scheduleRetry() {
+  attempting = false;
+  if (retryPending) {
+    return;
+  }
+  retryPending = true;
+  nextAttempt = millis() + backoff;
+  log_i("WiFi retry in %u ms", backoff);
+  backoff = backoff * 2 > WIFI_BACKOFF_MAX_MS ? WIFI_BACKOFF_MAX_MS : backoff * 2;
+}
+
+// Runs in the Wi-Fi event task
+static void onWifiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  xSemaphoreTake(wifiLock, portMAX_DELAY);
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+      memcpy(cache.bssid, info.wifi_sta_connected.bssid, sizeof(cache.bssid));
+      cache.channel = info.wifi_sta_connected.channel;
+      cache.magic = WIFI_CACHE_MAGIC;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      linkUp = true;
+      attempting = false;
+      retryPending = false;
+      useCache = true;
+      backoff = WIFI_BACKOFF_MIN_MS;
+      log_i("WiFi connected, IP %s", WiFi.localIP().toString().c_str());
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      if (suspended) {
+        linkUp = false;
+        break;
+      }
+      if (linkUp) {
+        log_w("WiFi lost, reason %u", info.wifi_sta_disconnected.reason);
+      } else if (attempting && useCache) {
+        // The access point may have moved; scan next time
+        useCache = false;
+      }
+      linkUp = false;
+      scheduleRetry();
+      break;
+    default:
+      break;
+  }
+  xSemaphoreGive(wifiLock);
+}
+
+// Dotted quad of a build flag, false when empty or malformed
+static bool parseAddress(const char* text, IPAddress& address) {
+  return text[0] != '\0' && address.fromString(text);
+}
+
+// WIFI_STATIC_IP and friends on the station interface
+static void applyStaticAddress() {
+  IPAddress ip;
+  if (parseAddress(WIFI_STATIC_IP, ip)) {
+    IPAddress gateway;
+    IPAddress subnet;
+    IPAddress dns;
+    parseAddress(WIFI_GATEWAY, gateway);
+    parseAddress(WIFI_SUBNET, subnet);
+    if (!parseAddress(WIFI_DNS, dns)) {
+      dns = gateway;
+    }
+    if (WiFi.config(ip, gateway, subnet, dns)) {
+      log_i("WiFi static IP %s", WIFI_STATIC_IP);
+    } else {
+      log_e("WiFi static IP %s rejected, using DHCP", WIFI_STATIC_IP);
+    }
+  } else if (WIFI_STATIC_IP[0] != '\0') {
+    log_e("WIFI_STATIC_IP %s is not an address, using DHCP", WIFI_STATIC_IP);
+  }
+}
+
+void initWifiLink(const char* ssid, const char* password) {
+  strlcpy(wifiSsid, ssid, sizeof(wifiSsid));
+  strlcpy(wifiPassword, password, sizeof(wifiPassword));
+  wifiLock = xSemaphoreCreateMutex();
+  if (wifiLock == nullptr) {
+    log_e("WiFi: out of memory");
+    return;
+  }
+
+  WiFi.mode(WIFI_STA);
+  WiFi.persistent(false);
+  // Retries are ours, with backoff
+  WiFi.setAutoReconnect(false);
+  applyWifiPowerSave();
+
+  applyStaticAddress();
+
+  WiFi.onEvent(onWifiEvent);
+
+  xSemaphoreTake(wifiLock, portMAX_DELAY);
+  useCache = cacheValid();
+  startAttempt();
+  xSemaphoreGive(wifiLock);
+}
+
+void serviceWifiLink() {
+  if (wifiLock == nullptr) {
+    return;
+  }
+  xSemaphoreTake(wifiLock, portMAX_DELAY);
+  uint32_t now = millis();
+  if (suspendWanted != suspended) {
+    suspended = suspendWanted;
+    attempting = false;
+    retryPending = false;
+    backoff = WIFI_BACKOFF_MIN_MS;
+    if (suspended) {
+      log_i("WiFi off while Ethernet is up");
+      linkUp = false;
+      WiFi.mode(WIFI_OFF);
+    } else {
+      log_i("WiFi back on");
+      WiFi.mode(WIFI_STA);
+      applyWifiPowerSave();
+      applyStaticAddress();
+      startAttempt();
+    }
+  }
+  if (suspended) {
+    xSemaphoreGive(wifiLock);
+    return;
+  }
+  if (switchPending && (int32_t)(now - switchAt) >= 0) {
+    switchPending = false;
+    // The cached access point belongs to the old network
+    cache.magic = 0;
+    useCache = false;
+    retryPending = false;
+    backoff = WIFI_BACKOFF_MIN_MS;
+    log_i("WiFi network changed to %s", wifiSsid);
+    if (linkUp || attempting) {
+      // Its disconnect event schedules the attempt on the new network
+      WiFi.disconnect();
+    } else {
+      startAttempt();
+    }
+  }
+  if (attempting && now - attemptStart >= WIFI_CONNECT_TIMEOUT_MS) {
+    log_w("WiFi attempt timed out");
+    useCache = false;
+    WiFi.disconnect();
+    scheduleRetry();
+  }
+  if (retryPending && (int32_t)(now - nextAttempt) >= 0) {
+    retryPending = false;
+    startAttempt();
+  }
+  xSemaphoreGive(wifiLock);
+}
+
+void setWifiCredentials(const char* ssid, const char* password) {
+  if (wifiLock == nullptr) {
+    return;
+  }
+  xSemaphoreTake(wifiLock, portMAX_DELAY);
+  strlcpy(wifiSsid, ssid, sizeof(wifiSsid));
+  strlcpy(wifiPassword, password, sizeof(wifiPassword));
+  switchPending = true;
+  switchAt = millis() + WIFI_SWITCH_DELAY_MS;
+  xSemaphoreGive(wifiLock);
+}
+
+void suspendWifiLink(bool suspend) {
+  if (wifiLock == nullptr) {
+    return;
+  }
+  xSemaphoreTake(wifiLock, portMAX_DELAY);
+  suspendWanted = suspend;
+  xSemaphoreGive(wifiLock);
+}
+
+bool wifiLinkUp() {
+  return linkUp;
+}
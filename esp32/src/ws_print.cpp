@@ -0,0 +1,196 @@
+#include "ws_print.h"
+#include "print_writer.h"
+
+struct WsPrintSession {
+  uint32_t clientId = 0;   // 0 marks a free session
+  uint32_t jobId = 0;
+  size_t received = 0;
+  size_t granted = 0;      // Offset the client may send up to
+};
+
+// Enough for every printer's queue to be fed over WebSockets
+static const size_t WS_PRINT_SESSIONS = PRINT_QUEUE_DEPTH * MAX_PRINTERS;
+
+static AsyncWebSocket printSocket(WS_PRINT_PATH);
+static WsPrintSession sessions[WS_PRINT_SESSIONS];
+static SemaphoreHandle_t sessionLock = nullptr;
+static WsPrintRoute wsPrintRoute = nullptr;
+
+static WsPrintSession* findSession(uint32_t clientId) {
+  for (size_t i = 0; i < WS_PRINT_SESSIONS; i++) {
+    if (sessions[i].clientId == clientId) {
+      return &sessions[i];
+    }
+  }
+  return nullptr;
+}
+
+static String creditJSON(const char* type, const WsPrintSession& session) {
+  return String("{\"type\":\"") + type + "\",\"id\":" + String(session.jobId) +
+         ",\"credit\":" + String(session.granted) + "}";
+}
+
+static String errorJSON(const char* message, uint32_t retryAfter) {
+  String json = String("{\"type\":\"error\",\"message\":\"") + message + "\"";
+  if (retryAfter > 0) {
+    json += ",\"retryAfter\":" + String(retryAfter);
+  }
+  json += "}";
+  return json;
+}
+
+// Raise the session's credit to everything the job buffer can take. Returns
+// true when the increase is worth telling the client about.
+static bool refreshCredit(WsPrintSession& session) {
+  size_t granted = session.received + printJobSpace(session.jobId);
+  if (granted < session.granted + WS_PRINT_CREDIT_STEP) {
+    return false;
+  }
+  session.granted = granted;
+  return true;
+}
+
+static String startJob(uint32_t clientId, const String& address, const String& printerId) {
+  uint8_t printer = 0;
+  const char* error = nullptr;
+  if (wsPrintRoute != nullptr && !wsPrintRoute(printerId, printer, error)) {
+    return errorJSON(error, 0);
+  }
+  if (findSession(clientId) != nullptr) {
+    return errorJSON("Job already open", 0);
+  }
+  WsPrintSession* session = findSession(0);
+  if (session == nullptr) {
+    return errorJSON("Print queue full", printQueueRetryAfter(printer));
+  }
+
+  PrintJobReject reject;
+  uint32_t id = createPrintJob(printer, PRINT_JOB_LENGTH_UNKNOWN, reject);
+  if (id == 0) {
+    return errorJSON(reject == JOB_REJECT_NO_MEMORY ? "Out of memory for print job" : "Print queue full",
+                     printQueueRetryAfter(printer));
+  }
+
+  setPrintJobClient(id, printClientKey(address.c_str()));
+  session->clientId = clientId;
+  session->jobId = id;
+  session->received = 0;
+  session->granted = 0;
+  refreshCredit(*session);
+  log_i("WebSocket print job %u from client %u for printer %u", id, clientId, printer);
+  return creditJSON("job", *session);
+}
+
+static String endJob(WsPrintSession& session, bool abort) {
+  if (abort) {
+    abortPrintJob(session.jobId);
+  } else {
+    finishPrintJob(session.jobId);
+  }
+  String reply = String("{\"type\":\"end\",\"id\":") + String(session.jobId) +
+                 ",\"received\":" + String(session.received) + "}";
+  session = WsPrintSession();
+  return reply;
+}
+
+// Job data. The client only sends within its credit, which was free buffer
+// space when granted, so appending never has to wait here.
+static String appendData(WsPrintSession& session, const uint8_t* data, size_t len) {
+  size_t queued = appendPrintJob(session.jobId, data, len, 0);
+  session.received += queued;
+  if (queued < len) {
+    log_e("WebSocket job %u overran its credit, dropped %u bytes", session.jobId, len - queued);
+    endJob(session, true);
+    return errorJSON("Credit exceeded", 0);
+  }
+  return refreshCredit(session) ? creditJSON("credit", session) : String();
+}
+
+static void onPrintSocketEvent(AsyncWebSocket* socket, AsyncWebSocketClient* client,
+                               AwsEventType type, void* arg, uint8_t* data, size_t len) {
+  String reply;
+
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+  WsPrintSession* session = findSession(client->id());
+
+  if (type == WS_EVT_DISCONNECT) {
+    if (session != nullptr) {
+      // A page that was cut off mid-stream must not print
+      endJob(*session, true);
+    }
+  } else if (type == WS_EVT_DATA) {
+    AwsFrameInfo* info = (AwsFrameInfo*)arg;
+    uint8_t opcode = (info->opcode == WS_CONTINUATION) ? info->message_opcode : info->opcode;
+
+    if (opcode == WS_BINARY) {
+      if (session != nullptr) {
+        reply = appendData(*session, data, len);
+      } else {
+        reply = errorJSON("No job open", 0);
+      }
+    } else if (opcode == WS_TEXT && info->index == 0 && info->final && len == info->len) {
+      // Control messages are short enough to always arrive in one piece
+      String command((const char*)data, len);
+      if (command == "start" || command.startsWith("start ")) {
+        String printerId = command.substring(5);
+        printerId.trim();
+        reply = startJob(client->id(), client->remoteIP().toString(), printerId);
+      } else if ((command == "end" || command == "abort") && session != nullptr) {
+        reply = endJob(*session, command == "abort");
+      } else {
+        reply = errorJSON("Unknown command", 0);
+      }
+    }
+  }
+  xSemaphoreGive(sessionLock);
+
+  if (reply.length() > 0) {
+    client->text(reply);
+  }
+}
+
+void initWsPrint(AsyncWebServer& server, WsPrintRoute route) {
+  sessionLock = xSemaphoreCreateMutex();
+  wsPrintRoute = route;
+  printSocket.onEvent(onPrintSocketEvent);
+  server.addHandler(&printSocket);
+}
+
+void serviceWsPrint() {
+  if (sessionLock == nullptr) {
+    return;
+  }
+
+  // Collect the updates first; sending takes the socket's own locks
+  uint32_t clients[WS_PRINT_SESSIONS];
+  String updates[WS_PRINT_SESSIONS];
+  size_t count = 0;
+
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+  for (size_t i = 0; i < WS_PRINT_SESSIONS; i++) {
+    WsPrintSession& session = sessions[i];
+    if (session.clientId != 0 && refreshCredit(session)) {
+      clients[count] = session.clientId;
+      updates[count] = creditJSON("credit", session);
+      count++;
+    }
+  }
+  xSemaphoreGive(sessionLock);
+
+  for (size_t i = 0; i < count; i++) {
+    printSocket.text(clients[i], updates[i].c_str());
+  }
+  printSocket.cleanupClients();
+}
+
+size_t wsPrintActiveJobs() {
+  size_t active = 0;
+  xSemaphoreTake(sessionLock, portMAX_DELAY);
+  for (size_t i = 0; i < WS_PRINT_SESSIONS; i++) {
+    if (sessions[i].clientId != 0) {
+      active++;
+    }
+  }
+  xSemaphoreGive(sessionLock);
+  return active;
+}
@@ -0,0 +1,535 @@
+#include "zpl_label.h"
+
+#include "heap_stats.h"
+#include "barcode.h"
+
+static const uint16_t ZPL_INK = TFT_WHITE;
+static const uint8_t LINE_FONT = 2;          // Code 128 interpretation line
+static const uint8_t LINE_GAP = 2;           // Dots between the bars and that line
+
+// Built-in fonts text is drawn with, by their height at size 1
+static const struct {
+  uint8_t font;
+  uint8_t height;
+} textFonts[] = {{1, 8}, {2, 16}, {4, 26}};
+static const uint8_t MAX_TEXT_SIZE = 7;
+
+static TFT_eSprite* sprite = nullptr;
+// The bands' pixels, the helper's after this one's. It only grows, so
+// labels of the usual widths are drawn without allocating once the widest
+// has been seen.
+static uint8_t* bandArena = nullptr;
+static size_t bandArenaSize = 0;
+static SemaphoreHandle_t renderLock = nullptr;
+
+// The band helper takes one band at a time and signals when it is drawn
+struct BandWork {
+  const ZplInterpreter* label;
+  uint16_t top;
+  uint16_t rows;
+};
+
+static TFT_eSprite* helperSprite = nullptr;
+static QueueHandle_t bandQueue = nullptr;
+static SemaphoreHandle_t bandDone = nullptr;
+
+const char* zplResultName(ZplResult result) {
+  switch (result) {
+    case ZPL_OK: return "OK";
+    case ZPL_INVALID: return "Invalid ZPL";
+    case ZPL_TOO_MANY: return "Too many fields in label";
+    case ZPL_TRUNCATED: return "Label without ^XZ";
+    case ZPL_NO_MEMORY: return "Out of memory for label";
+    case ZPL_OUTPUT: return "Print job refused label";
+  }
+  return "Unknown error";
+}
+
+void initZplLabels(TFT_eSPI* display) {
+  renderLock = xSemaphoreCreateMutex();
+  sprite = new TFT_eSprite(display);
+  sprite->setColorDepth(1);
+
+#if ZPL_PARALLEL_BANDS
+  if (portNUM_PROCESSORS < 2) {
+    return;
+  }
+  bandQueue = xQueueCreate(1, sizeof(BandWork));
+  bandDone = xSemaphoreCreateBinary();
+  helperSprite = new TFT_eSprite(display);
+  helperSprite->setColorDepth(1);
+  if (bandQueue == nullptr || bandDone == nullptr ||
+      xTaskCreatePinnedToCore(ZplInterpreter::bandTask, "zplBands", 4096, nullptr, ZPL_BAND_PRIORITY, nullptr,
+                              ZPL_BAND_CORE) != pdPASS) {
+    log_w("ZPL band helper not started, labels drawn on one core");
+    delete helperSprite;
+    helperSprite = nullptr;
+  }
+#endif
+}
+
+void ZplInterpreter::bandTask(void* param) {
+  (void)param;
+  trackTaskStack(xTaskGetCurrentTaskHandle());
+  BandWork work;
+  for (;;) {
+    if (xQueueReceive(bandQueue, &work, portMAX_DELAY) == pdTRUE) {
+      work.label->drawBand(*helperSprite, work.top, work.rows);
+      xSemaphoreGive(bandDone);
+    }
+  }
+}
+
+// Parameter index of a comma separated list, trimmed
+static String parameter(const String& parameters, uint8_t index) {
+  int start = 0;
+  for (uint8_t i = 0; i < index; i++) {
+    start = parameters.indexOf(',', start);
+    if (start < 0) {
+      return String();
+    }
+    start++;
+  }
+  int end = parameters.indexOf(',', start);
+  String value = parameters.substring(start, end < 0 ? parameters.length() : end);
+  value.trim();
+  return value;
+}
+
+static long number(const String& parameters, uint8_t index, long fallback) {
+  String value = parameter(parameters, index);
+  return value.length() > 0 ? value.toInt() : fallback;
+}
+
+static long clampNumber(long value, long low, long high) {
+  return value < low ? low : (value > high ? high : value);
+}
+
+// Built-in font and size whose height is nearest to height; the larger font
+// on a tie, whose glyphs are finer
+static void textFont(uint16_t height, uint8_t& font, uint8_t& size) {
+  int32_t best = INT32_MAX;
+  for (const auto& candidate : textFonts) {
+    for (uint8_t s = 1; s <= MAX_TEXT_SIZE; s++) {
+      int32_t diff = abs((int32_t)candidate.height * s - (int32_t)height);
+      if (diff <= best) {
+        best = diff;
+        font = candidate.font;
+        size = s;
+      }
+    }
+  }
+}
+
+void ZplInterpreter::begin(const ImageRasterOptions& options, uint16_t headDots, ImageOutput output,
+                           void* context) {
+  _options = options;
+  _headDots = headDots != 0 ? headDots : ZPL_DEFAULT_WIDTH;
+  _output = output;
+  _context = context;
+  _error = ZPL_OK;
+  _detail = String();
+  _labels = 0;
+  _state = SCAN;
+  _nameLen = 0;
+  _parameters = String();
+  _inLabel = false;
+  _fontHeight = 9;
+  _barModule = 2;
+  _barHeight = 10;
+  resetLabel();
+}
+
+void ZplInterpreter::fail(ZplResult result, const String& detail) {
+  if (_error == ZPL_OK) {
+    _error = result;
+    _detail = detail;
+  }
+}
+
+ZplResult ZplInterpreter::feed(const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length && _error == ZPL_OK; i++) {
+    char c = data[i];
+    // ^FD data and ^FX comments only end at the next ^
+    bool text = _state == PARAMETERS && _prefix == '^' &&
+                ((_name[0] == 'F' && _name[1] == 'D') || (_name[0] == 'F' && _name[1] == 'X'));
+    if (c == '^' || (c == '~' && !text)) {
+      if (_state != SCAN) {
+        command();
+      }
+      _prefix = c;
+      _nameLen = 0;
+      _parameters = String();
+      _state = COMMAND;
+      continue;
+    }
+    if (c == '\r' || c == '\n') {
+      continue;
+    }
+    switch (_state) {
+      case SCAN:
+        break;
+      case COMMAND:
+        _name[_nameLen++] = toupper((unsigned char)c);
+        if (_nameLen == 2) {
+          _name[2] = 0;
+          _state = PARAMETERS;
+        }
+        break;
+      case PARAMETERS:
+        if (_parameters.length() >= ZPL_MAX_PARAMETERS) {
+          fail(ZPL_INVALID, String(_prefix) + _name + " too long");
+          break;
+        }
+        _parameters += c;
+        break;
+    }
+  }
+  return _error;
+}
+
+ZplResult ZplInterpreter::end() {
+  if (_error == ZPL_OK && _state != SCAN) {
+    command();
+    _state = SCAN;
+  }
+  if (_error == ZPL_OK && _inLabel) {
+    fail(ZPL_TRUNCATED, "^XZ");
+  }
+  return _error;
+}
+
+void ZplInterpreter::resetLabel() {
+  _fieldCount = 0;
+  _width = 0;
+  _length = 0;
+  _homeX = 0;
+  _homeY = 0;
+  _copies = 1;
+  _nextFont = 0;
+  _fieldOpen = false;
+  _hexIndicator = 0;
+}
+
+// A one-letter command ends at its first parameter, which ^A takes as the
+// font: ^A0N,30 arrives as "A0" with "N,30"
+void ZplInterpreter::command() {
+  _state = SCAN;
+  if (_nameLen < 2 || _prefix == '~') {
+    return;
+  }
+  const String& p = _parameters;
+  String name = _name;
+
+  if (name == "XA") {
+    resetLabel();
+    _inLabel = true;
+    return;
+  }
+  if (!_inLabel) {
+    return;
+  }
+  if (name == "XZ") {
+    finishField();
+    _inLabel = false;
+    if (_error == ZPL_OK) {
+      ZplResult result = printLabel();
+      if (result != ZPL_OK) {
+        fail(result, "label " + String(_labels + 1));
+      }
+    }
+    return;
+  }
+
+  if (name == "FO" || name == "FT") {
+    finishField();
+    _field = Field();
+    _field.type = FIELD_TEXT;
+    _field.x = _homeX + clampNumber(number(p, 0, 0), 0, ZPL_MAX_DOTS);
+    _field.y = _homeY + clampNumber(number(p, 1, 0), 0, ZPL_MAX_DOTS);
+    _field.baseline = name == "FT";
+    _field.width = _nextFont != 0 ? _nextFont : _fontHeight;
+    _nextFont = 0;
+    _fieldOpen = true;
+    _fieldHasData = false;
+  } else if (name[0] == 'A') {
+    // Every font is drawn as font 0: p is orientation, height, width
+    uint16_t height = clampNumber(number(p, 1, _fontHeight), 1, ZPL_MAX_DOTS);
+    if (_fieldOpen) {
+      _field.width = height;
+    } else {
+      _nextFont = height;
+    }
+  } else if (name == "CF") {
+    _fontHeight = clampNumber(number(p, 1, _fontHeight), 1, ZPL_MAX_DOTS);
+  } else if (name == "FD") {
+    if (!_fieldOpen) {
+      _field = Field();
+      _field.type = FIELD_TEXT;
+      _field.x = _homeX;
+      _field.y = _homeY;
+      _field.width = _fontHeight;
+      _fieldOpen = true;
+    }
+    _field.data = _hexIndicator != 0 ? decodeHex(p) : p;
+    _fieldHasData = true;
+  } else if (name == "FH") {
+    _hexIndicator = p.length() > 0 ? p[0] : '_';
+  } else if (name == "FS") {
+    finishField();
+  } else if (name == "BY") {
+    _barModule = clampNumber(number(p, 0, _barModule), 1, 10);
+    _barHeight = clampNumber(number(p, 2, _barHeight), 1, ZPL_MAX_DOTS);
+  } else if (name == "BC" && _fieldOpen) {
+    _field.type = FIELD_CODE128;
+    _field.module = _barModule;
+    _field.height = clampNumber(number(p, 1, _barHeight), 1, ZPL_MAX_DOTS);
+    _field.line = !parameter(p, 2).equalsIgnoreCase("N");
+  } else if (name == "BQ" && _fieldOpen) {
+    _field.type = FIELD_QR;
+    _field.module = clampNumber(number(p, 2, 2), 1, 10);
+  } else if (name == "GB" && _fieldOpen) {
+    _field.type = FIELD_BOX;
+    _field.thickness = clampNumber(number(p, 2, 1), 1, ZPL_MAX_DOTS);
+    _field.width = clampNumber(number(p, 0, _field.thickness), _field.thickness, ZPL_MAX_DOTS);
+    _field.height = clampNumber(number(p, 1, _field.thickness), _field.thickness, ZPL_MAX_DOTS);
+    _field.white = parameter(p, 3).equalsIgnoreCase("W");
+  } else if (name == "PW") {
+    _width = clampNumber(number(p, 0, 0), 0, ZPL_MAX_DOTS);
+  } else if (name == "LL") {
+    _length = clampNumber(number(p, 0, 0), 0, ZPL_MAX_DOTS);
+  } else if (name == "LH") {
+    _homeX = clampNumber(number(p, 0, 0), 0, ZPL_MAX_DOTS);
+    _homeY = clampNumber(number(p, 1, 0), 0, ZPL_MAX_DOTS);
+  } else if (name == "PQ") {
+    _copies = clampNumber(number(p, 0, 1), 1, ZPL_MAX_COPIES);
+  }
+}
+
+// A field is complete at ^FS, or at the ^FO of the next one
+void ZplInterpreter::finishField() {
+  if (!_fieldOpen) {
+    return;
+  }
+  _fieldOpen = false;
+  _hexIndicator = 0;
+  if (_field.type != FIELD_BOX && !_fieldHasData) {
+    return;
+  }
+  if (_fieldCount == ZPL_MAX_FIELDS) {
+    fail(ZPL_TOO_MANY, "label " + String(_labels + 1));
+    return;
+  }
+  if (_field.type == FIELD_QR) {
+    // ^BQ data starts with the error correction and input mode, "QA,"
+    int comma = _field.data.indexOf(',');
+    if (comma >= 0 && comma <= 3) {
+      _field.data = _field.data.substring(comma + 1);
+    }
+  }
+  _fields[_fieldCount++] = _field;
+}
+
+String ZplInterpreter::decodeHex(const String& data) const {
+  String out;
+  out.reserve(data.length());
+  for (size_t i = 0; i < data.length(); i++) {
+    if (data[i] == _hexIndicator && i + 2 < data.length() && isxdigit((unsigned char)data[i + 1]) &&
+        isxdigit((unsigned char)data[i + 2])) {
+      char hex[3] = {data[i + 1], data[i + 2], 0};
+      out += (char)strtol(hex, nullptr, 16);
+      i += 2;
+    } else {
+      out += data[i];
+    }
+  }
+  return out;
+}
+
+ZplResult ZplInterpreter::printLabel() {
+  uint16_t width = _width != 0 ? _width : _headDots;
+  if (width > ZPL_MAX_DOTS) {
+    width = ZPL_MAX_DOTS;
+  }
+
+  xSemaphoreTake(renderLock, portMAX_DELAY);
+  size_t bytes = TFT_eSprite::spriteBytes(width, ZPL_BAND_ROWS, 1);
+  size_t wanted = helperSprite != nullptr ? 2 * bytes : bytes;
+  if (wanted > bandArenaSize) {
+    sprite->deleteSprite();
+    if (helperSprite != nullptr) {
+      helperSprite->deleteSprite();
+    }
+    heapFree(bandArena);
+    bandArenaSize = 0;
+    bandArena = (uint8_t*)heapAlloc(HEAP_SITE_ZPL, wanted);
+    // Without room for both bands the label is drawn on this core alone
+    if (bandArena == nullptr && wanted > bytes) {
+      bandArena = (uint8_t*)heapAlloc(HEAP_SITE_ZPL, bytes);
+      wanted = bytes;
+    }
+    if (bandArena != nullptr) {
+      bandArenaSize = wanted;
+    }
+  }
+  if (sprite->width() != width || !sprite->created()) {
+    sprite->deleteSprite();
+    if (sprite->createSprite(width, ZPL_BAND_ROWS, bandArena, bytes) == nullptr) {
+      xSemaphoreGive(renderLock);
+      return ZPL_NO_MEMORY;
+    }
+  }
+  bool parallel = false;
+  if (helperSprite != nullptr && bandArenaSize >= 2 * bytes) {
+    if (helperSprite->width() != width || !helperSprite->created()) {
+      helperSprite->deleteSprite();
+      helperSprite->createSprite(width, ZPL_BAND_ROWS, bandArena + bytes, bytes);
+    }
+    parallel = helperSprite->created();
+  }
+
+  // Every field is measured and checked before anything is sent. Barcodes
+  // are drawn far above the band to learn their size.
+  int32_t labelBottom = 0;
+  for (size_t f = 0; f < _fieldCount; f++) {
+    Field& field = _fields[f];
+    if (field.type == FIELD_TEXT) {
+      uint8_t font;
+      uint8_t size;
+      textFont(field.width, font, size);
+      sprite->setTextFont(font);
+      sprite->setTextSize(size);
+      int32_t height = sprite->fontHeight();
+      field.top = field.baseline ? field.y - height : field.y;
+      field.bottom = field.top + height;
+    } else if (field.type == FIELD_BOX) {
+      field.top = field.y;
+      field.bottom = field.y + field.height;
+    } else {
+      BarcodeType type = field.type == FIELD_QR ? BARCODE_QR : BARCODE_CODE128;
+      uint16_t drawn = 0;
+      if (!drawBarcode(*sprite, type, field.x, -2 * ZPL_MAX_DOTS, field.data, field.module, field.height, nullptr,
+                       &drawn)) {
+        xSemaphoreGive(renderLock);
+        _detail = field.data;
+        return ZPL_INVALID;
+      }
+      if (field.type == FIELD_CODE128 && field.line) {
+        sprite->setTextFont(LINE_FONT);
+        sprite->setTextSize(1);
+        drawn += LINE_GAP + sprite->fontHeight();
+      }
+      field.top = field.baseline ? field.y - drawn : field.y;
+      field.bottom = field.top + drawn;
+    }
+    if (field.bottom > labelBottom) {
+      labelBottom = field.bottom;
+    }
+  }
+  uint16_t height = _length != 0 ? _length : (labelBottom > ZPL_MAX_DOTS ? ZPL_MAX_DOTS : labelBottom);
+  if (height == 0) {
+    // Nothing to print, like a ^XA^XZ that only sets up the printer
+    xSemaphoreGive(renderLock);
+    return ZPL_OK;
+  }
+
+  ZplResult result = ZPL_OK;
+  size_t rowBytes = (width + 7) / 8;
+  for (uint16_t copy = 0; copy < _copies && result == ZPL_OK; copy++) {
+    RasterCommandWriter writer;
+    if (!writer.begin(_options, width, height, _output, _context)) {
+      result = writer.outputFailed() ? ZPL_OUTPUT : ZPL_NO_MEMORY;
+      break;
+    }
+    for (uint16_t bandTop = 0; bandTop < height && result == ZPL_OK;) {
+      uint16_t rows = height - bandTop < ZPL_BAND_ROWS ? height - bandTop : ZPL_BAND_ROWS;
+      // The band below goes to the helper while this one is drawn and sent
+      uint16_t nextTop = bandTop + rows;
+      uint16_t nextRows = height - nextTop < ZPL_BAND_ROWS ? height - nextTop : ZPL_BAND_ROWS;
+      bool helped = parallel && nextTop < height;
+      if (helped) {
+        BandWork work = {this, nextTop, nextRows};
+        xQueueSend(bandQueue, &work, portMAX_DELAY);
+      }
+      drawBand(*sprite, bandTop, rows);
+      const uint8_t* band = (const uint8_t*)sprite->getPointer();
+      for (uint16_t r = 0; r < rows && result == ZPL_OK; r++) {
+        if (!writer.row(band + r * rowBytes)) {
+          result = ZPL_OUTPUT;
+        }
+      }
+      bandTop = nextTop;
+      if (!helped) {
+        continue;
+      }
+      // Waited for even after a failure, so the helper's sprite is free
+      xSemaphoreTake(bandDone, portMAX_DELAY);
+      band = (const uint8_t*)helperSprite->getPointer();
+      for (uint16_t r = 0; r < nextRows && result == ZPL_OK; r++) {
+        if (!writer.row(band + r * rowBytes)) {
+          result = ZPL_OUTPUT;
+        }
+      }
+      bandTop += nextRows;
+    }
+  }
+  xSemaphoreGive(renderLock);
+
+  if (result == ZPL_OK) {
+    _labels++;
+    log_i("ZPL label %u: %ux%u dots, %u fields, %u copies", _labels, width, height, _fieldCount, _copies);
+  }
+  return result;
+}
+
+// Clear the band and draw the fields that reach into it
+void ZplInterpreter::drawBand(TFT_eSprite& band, uint16_t top, uint16_t rows) const {
+  memset(band.getPointer(), 0, ((band.width() + 7) / 8) * ZPL_BAND_ROWS);
+  for (size_t f = 0; f < _fieldCount; f++) {
+    const Field& field = _fields[f];
+    if (field.bottom <= top || field.top >= top + rows) {
+      continue;
+    }
+    int32_t y = field.top - top;
+    switch (field.type) {
+      case FIELD_TEXT: {
+        uint8_t font;
+        uint8_t size;
+        textFont(field.width, font, size);
+        band.setTextFont(font);
+        band.setTextSize(size);
+        band.setTextColor(ZPL_INK);
+        band.setTextDatum(TL_DATUM);
+        band.drawString(field.data, field.x, y);
+        break;
+      }
+      case FIELD_BOX: {
+        uint16_t colour = field.white ? TFT_BLACK : ZPL_INK;
+        uint16_t t = field.thickness;
+        if (2 * t >= field.width || 2 * t >= field.height) {
+          band.fillRect(field.x, y, field.width, field.height, colour);
+        } else {
+          band.fillRect(field.x, y, field.width, t, colour);
+          band.fillRect(field.x, y + field.height - t, field.width, t, colour);
+          band.fillRect(field.x, y + t, t, field.height - 2 * t, colour);
+          band.fillRect(field.x + field.width - t, y + t, t, field.height - 2 * t, colour);
+        }
+        break;
+      }
+      case FIELD_CODE128: {
+        uint16_t drawn = drawCode128(band, field.x, y, field.data, field.module, field.height);
+        if (field.line) {
+          band.setTextFont(LINE_FONT);
+          band.setTextSize(1);
+          band.setTextColor(ZPL_INK);
+          band.setTextDatum(TC_DATUM);
+          band.drawString(field.data, field.x + drawn / 2, y + field.height + LINE_GAP);
+        }
+        break;
+      }
+      case FIELD_QR:
+        drawQrCode(band, field.x, y, field.data, field.module);
+        break;
+    }
+  }
+}
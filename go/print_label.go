@@ -2,6 +2,7 @@ package main
 
 import (
 	"bytes"
+	"encoding/json"
 	"errors"
 	"flag"
 	"fmt"
@@ -10,10 +11,15 @@ import (
 	"image/png"
 	"io"
 	"log"
+	"math/rand"
 	"net"
+	"net/http"
 	"os"
 	"os/exec"
 	"path/filepath"
+	"sort"
+	"strings"
+	"sync"
 	"time"
 
 	xdraw "golang.org/x/image/draw"
@@ -635,6 +641,12 @@ func openBluetoothSocket(mac string, channel int) (io.ReadWriteCloser, error) {
 }
 
 func main() {
+	// Subcommands before the flags of the print tool
+	if len(os.Args) > 1 && os.Args[1] == "load" {
+		runLoad(os.Args[2:])
+		return
+	}
+
 	pdfPath := flag.String("pdf", "", "Path to PDF file")
 	paperSize := flag.Int("paper-size", 58, "Paper width in mm (58, 80, 100)")
 	paperHeight := flag.Int("paper-height", 0, "Paper height in mm (optional, for TSPL SIZE command)")
@@ -1011,4 +1023,261 @@ func main() {
 	// Explicitly close port here to ensure flush happens before exit
 	port.Close()
 	log.Println("Print job completed successfully")
-}
\ No newline at end of file
+}
+
+// The load subcommand plays a number of stations that use one ESP32 bridge
+// at the same time: each sends print jobs, polls /status and fetches a
+// static asset at its own fixed rate. Requests go out on schedule whether
+// or not the earlier ones were answered, so a bridge that falls behind
+// shows up as growing latencies and 503s instead of a slower test.
+//
+//	print_label load --bridge http://192.168.1.50 --stations 8 --duration 2m
+
+// loadSample is the outcome of one request
+type loadSample struct {
+	kind    string
+	latency time.Duration
+	status  int // 0 when the request failed before an answer
+}
+
+// loadStats collects the samples of all stations
+type loadStats struct {
+	mu      sync.Mutex
+	samples map[string][]loadSample
+}
+
+func (s *loadStats) add(sample loadSample) {
+	s.mu.Lock()
+	s.samples[sample.kind] = append(s.samples[sample.kind], sample)
+	s.mu.Unlock()
+}
+
+type loadConfig struct {
+	bridge     string
+	printer    string
+	client     *http.Client
+	payload    []byte
+	statusRate float64
+	printRate  float64
+	assetRate  float64
+	asset      string
+	trackJobs  bool
+	pollEvery  time.Duration
+}
+
+func runLoad(args []string) {
+	fs := flag.NewFlagSet("load", flag.ExitOnError)
+	bridge := fs.String("bridge", "", "Bridge base URL, e.g. http://192.168.1.50")
+	printer := fs.String("printer", "", "Printer ID for /print (the bridge's first printer if empty)")
+	stations := fs.Int("stations", 4, "Stations sending at the same time")
+	duration := fs.Duration("duration", time.Minute, "How long to send")
+	printRate := fs.Float64("print-rate", 0.1, "Print jobs per second per station (0 to send none)")
+	statusRate := fs.Float64("status-rate", 1, "/status requests per second per station")
+	assetRate := fs.Float64("asset-rate", 0.2, "Static asset requests per second per station")
+	asset := fs.String("asset", "/index.html", "Static asset to fetch")
+	width := fs.Int("width", 384, "Job width in dots")
+	height := fs.Int("height", 200, "Job height in dots; sets the job size")
+	tspl := fs.Bool("tspl", false, "Send TSPL jobs instead of ESC/POS raster")
+	trackJobs := fs.Bool("track-jobs", true, "Poll /jobs/{id} to time accepted jobs until done")
+	timeout := fs.Duration("timeout", 30*time.Second, "Timeout of one request")
+	fs.Parse(args)
+
+	if *bridge == "" {
+		log.Fatal("load needs --bridge")
+	}
+	if *width%8 != 0 {
+		log.Fatal("--width must be a multiple of 8")
+	}
+
+	// A striped label: dark enough to be a realistic raster job
+	pixels := make([]byte, *width**height)
+	for y := 0; y < *height; y++ {
+		for x := 0; x < *width; x++ {
+			if (x/16+y/16)%2 == 0 {
+				pixels[y**width+x] = 1
+			}
+		}
+	}
+	var payload []byte
+	if *tspl {
+		payload = generateTSPLCommands(pixels, *width, *height, *width/8, *height/8, 4, 8, 0, 0)
+	} else {
+		payload = generateRasterCommands(pixels, *width, *height, 0)
+	}
+
+	cfg := &loadConfig{
+		bridge:     strings.TrimRight(*bridge, "/"),
+		printer:    *printer,
+		client:     &http.Client{Timeout: *timeout},
+		payload:    payload,
+		statusRate: *statusRate,
+		printRate:  *printRate,
+		assetRate:  *assetRate,
+		asset:      *asset,
+		trackJobs:  *trackJobs,
+		pollEvery:  250 * time.Millisecond,
+	}
+	stats := &loadStats{samples: map[string][]loadSample{}}
+
+	log.Printf("%d stations for %v against %s, %d byte jobs", *stations, *duration, cfg.bridge, len(payload))
+	deadline := time.Now().Add(*duration)
+	var wg sync.WaitGroup
+	for i := 0; i < *stations; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			runStation(cfg, stats, deadline, &wg)
+		}()
+	}
+	wg.Wait()
+
+	printLoadReport(stats, *duration)
+}
+
+// runStation sends each kind of request at its rate until the deadline.
+// Every request runs in its own goroutine, tracked by wg.
+func runStation(cfg *loadConfig, stats *loadStats, deadline time.Time, wg *sync.WaitGroup) {
+	schedule := func(rate float64, send func()) {
+		if rate <= 0 {
+			return
+		}
+		interval := time.Duration(float64(time.Second) / rate)
+		// Spread the stations over the interval instead of sending in step
+		time.Sleep(time.Duration(rand.Int63n(int64(interval))))
+		ticker := time.NewTicker(interval)
+		defer ticker.Stop()
+		for now := time.Now(); now.Before(deadline); now = <-ticker.C {
+			wg.Add(1)
+			go func() {
+				defer wg.Done()
+				send()
+			}()
+		}
+	}
+
+	var kinds sync.WaitGroup
+	kinds.Add(3)
+	go func() {
+		defer kinds.Done()
+		schedule(cfg.printRate, func() { sendPrint(cfg, stats) })
+	}()
+	go func() {
+		defer kinds.Done()
+		schedule(cfg.statusRate, func() { sendGet(cfg, stats, "status", "/status") })
+	}()
+	go func() {
+		defer kinds.Done()
+		schedule(cfg.assetRate, func() { sendGet(cfg, stats, "asset", cfg.asset) })
+	}()
+	kinds.Wait()
+}
+
+func sendGet(cfg *loadConfig, stats *loadStats, kind, path string) {
+	start := time.Now()
+	resp, err := cfg.client.Get(cfg.bridge + path)
+	sample := loadSample{kind: kind}
+	if err == nil {
+		io.Copy(io.Discard, resp.Body)
+		resp.Body.Close()
+		sample.status = resp.StatusCode
+	}
+	sample.latency = time.Since(start)
+	stats.add(sample)
+}
+
+func sendPrint(cfg *loadConfig, stats *loadStats) {
+	url := cfg.bridge + "/print"
+	if cfg.printer != "" {
+		url += "?printer=" + cfg.printer
+	}
+	start := time.Now()
+	resp, err := cfg.client.Post(url, "application/octet-stream", bytes.NewReader(cfg.payload))
+	sample := loadSample{kind: "print"}
+	var job struct {
+		ID uint32 `json:"id"`
+	}
+	if err == nil {
+		body, _ := io.ReadAll(resp.Body)
+		resp.Body.Close()
+		sample.status = resp.StatusCode
+		if resp.StatusCode == http.StatusAccepted {
+			json.Unmarshal(body, &job)
+		}
+	}
+	sample.latency = time.Since(start)
+	stats.add(sample)
+
+	if cfg.trackJobs && job.ID != 0 {
+		trackJob(cfg, stats, job.ID, start)
+	}
+}
+
+// trackJob polls a job until it is done or failed and records the time
+// from the upload to then as a "job" sample
+func trackJob(cfg *loadConfig, stats *loadStats, id uint32, start time.Time) {
+	url := fmt.Sprintf("%s/jobs/%d", cfg.bridge, id)
+	for {
+		time.Sleep(cfg.pollEvery)
+		resp, err := cfg.client.Get(url)
+		if err != nil {
+			stats.add(loadSample{kind: "job", latency: time.Since(start)})
+			return
+		}
+		var info struct {
+			Status string `json:"status"`
+		}
+		json.NewDecoder(resp.Body).Decode(&info)
+		resp.Body.Close()
+		switch {
+		case resp.StatusCode != http.StatusOK:
+			// Fallen out of the job table before it was seen finishing
+			stats.add(loadSample{kind: "job", latency: time.Since(start), status: resp.StatusCode})
+			return
+		case info.Status == "done":
+			stats.add(loadSample{kind: "job", latency: time.Since(start), status: http.StatusOK})
+			return
+		case info.Status == "failed":
+			stats.add(loadSample{kind: "job", latency: time.Since(start), status: http.StatusInternalServerError})
+			return
+		}
+	}
+}
+
+func percentile(sorted []time.Duration, p float64) time.Duration {
+	if len(sorted) == 0 {
+		return 0
+	}
+	i := int(p * float64(len(sorted)-1))
+	return sorted[i]
+}
+
+func printLoadReport(stats *loadStats, duration time.Duration) {
+	fmt.Fprintf(os.Stdout, "%-7s %7s %7s %7s %7s %7s %9s %9s %9s %9s\n",
+		"kind", "count", "req/s", "ok", "503", "errors", "p50", "p90", "p99", "max")
+	for _, kind := range []string{"print", "job", "status", "asset"} {
+		samples := stats.samples[kind]
+		if len(samples) == 0 {
+			continue
+		}
+		var ok, busy, failed int
+		var latencies []time.Duration
+		for _, s := range samples {
+			switch {
+			case s.status >= 200 && s.status < 300:
+				ok++
+				latencies = append(latencies, s.latency)
+			case s.status == http.StatusServiceUnavailable:
+				busy++
+			default:
+				failed++
+			}
+		}
+		sort.Slice(latencies, func(a, b int) bool { return latencies[a] < latencies[b] })
+		ms := func(d time.Duration) string { return fmt.Sprintf("%.1fms", float64(d)/float64(time.Millisecond)) }
+		fmt.Fprintf(os.Stdout, "%-7s %7d %7.2f %7d %7d %7d %9s %9s %9s %9s\n",
+			kind, len(samples), float64(len(samples))/duration.Seconds(), ok, busy, failed,
+			ms(percentile(latencies, 0.50)), ms(percentile(latencies, 0.90)),
+			ms(percentile(latencies, 0.99)), ms(percentile(latencies, 1)))
+	}
+	fmt.Fprintln(os.Stdout, "Latencies are of answered requests; 503 means the print queue was full.")
+}
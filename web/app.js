@@ -353,6 +353,10 @@ const App = {
         try {
             this.log("Processing PDF...");
             const options = this.getOptions();
+            if (this.transport.openStream) {
+                await this.printStreaming(options);
+                return;
+            }
             const pages = await ImageProcessing.processPdf(
                 this.selectedFile,
                 options.widthDots,
@@ -421,6 +425,44 @@ const App = {
             this.log(`Error: ${e.message}`, "error");
         }
     },
+
+    async printStreaming(options) {
+        // Pages are sent as soon as they are rendered instead of after the
+        // whole document, so the first label prints while the rest renders
+        const checkboxCount = document.querySelectorAll('.page-checkbox').length;
+        const selectedIndices = this.getSelectedPages();
+        if (checkboxCount > 0 && selectedIndices.length === 0) {
+            this.log("No pages selected for printing.", "error");
+            return;
+        }
+        const isSelected = (index) => checkboxCount === 0 || selectedIndices.includes(index);
+
+        const stream = await this.transport.openStream();
+        let sent = 0;
+        try {
+            await ImageProcessing.processPdf(
+                this.selectedFile,
+                options.widthDots,
+                options.rotate,
+                options.invert,
+                async (page, index) => {
+                    if (!isSelected(index)) return;
+                    const data = options.cmdSet === 'tspl'
+                        ? PrinterCommands.generateTsplCommands([page], options)
+                        : PrinterCommands.generateEscPosCommands([page], options);
+                    this.log(`Streaming page ${index + 1} (${data.length} bytes)...`);
+                    await stream.write(data);
+                    sent += data.length;
+                }
+            );
+            const ended = await stream.close();
+            await this.transport.waitForJob(ended.id);
+        } catch (e) {
+            stream.abort();
+            throw e;
+        }
+        this.log(`Print job sent successfully (${sent} bytes)!`, "success");
+    },
     
     async calibrationPattern() {
         if (!this.transport.isConnected()) return;
@@ -7,6 +7,9 @@ class HTTPTransport {
         this.serverUrl = null;
         this.deviceName = null;
         this.onDisconnect = null;
+        this.compress = true;
+        // Registry ID of the bridge printer to use, first printer when null
+        this.printer = null;
     }
 
     isConnected() {
@@ -35,6 +38,7 @@ class HTTPTransport {
         // Ensure no trailing slash
         this.serverUrl = serverUrl.replace(/\/$/, '');
         this.deviceName = options.deviceName || 'ESP32 Printer';
+        this.printer = options.printer || null;
 
         // Test connection by fetching /status
         try {
@@ -81,12 +85,20 @@ class HTTPTransport {
             throw new Error('Unsupported data type for HTTP write');
         }
 
+        // Raster jobs are mostly runs of zeros; deflate them when the browser
+        // can, the bridge decodes on the fly
+        const headers = { 'Content-Type': 'application/octet-stream' };
+        if (this.compress && typeof CompressionStream !== 'undefined') {
+            const compressed = new Blob([buffer]).stream().pipeThrough(new CompressionStream('deflate'));
+            buffer = await new Response(compressed).arrayBuffer();
+            headers['Content-Encoding'] = 'deflate';
+        }
+
         // POST binary data to /print endpoint
-        const response = await fetch(`${this.serverUrl}/print`, {
+        const query = this.printer ? `?printer=${encodeURIComponent(this.printer)}` : '';
+        const response = await fetch(`${this.serverUrl}/print${query}`, {
             method: 'POST',
-            headers: {
-                'Content-Type': 'application/octet-stream',
-            },
+            headers: headers,
             body: buffer,
             mode: 'cors',
             cache: 'no-cache'
@@ -94,7 +106,17 @@ class HTTPTransport {
 
         if (!response.ok) {
             const text = await response.text();
-            throw new Error(`Print request failed: ${response.status} ${response.statusText} - ${text}`);
+            const retryAfter = response.headers.get('Retry-After');
+            const retryHint = retryAfter ? ` (retry after ${retryAfter} s)` : '';
+            throw new Error(`Print request failed: ${response.status} ${response.statusText} - ${text}${retryHint}`);
+        }
+
+        // The bridge queues the job and answers 202 with its ID
+        if (response.status === 202) {
+            const job = await response.json();
+            console.log('Print job queued:', job);
+            await this.waitForJob(job.id);
+            return;
         }
 
         // Optionally read response text
@@ -103,4 +125,133 @@ class HTTPTransport {
             console.log('Server response:', responseText);
         }
     }
-}
\ No newline at end of file
+
+    // Open a WebSocket print job that can be fed incrementally, e.g. page by
+    // page while later pages are still being rendered.
+    async openStream() {
+        if (!this.isConnected()) throw new Error("Not connected");
+
+        const stream = new WebSocketPrintStream(this.serverUrl.replace(/^http/, 'ws') + '/ws/print', this.printer);
+        await stream.open();
+        return stream;
+    }
+
+    async waitForJob(id, pollInterval = 250) {
+        for (;;) {
+            const response = await fetch(`${this.serverUrl}/jobs/${id}`, {
+                method: 'GET',
+                headers: { 'Accept': 'application/json' },
+                mode: 'cors',
+                cache: 'no-cache'
+            });
+            if (!response.ok) {
+                throw new Error(`Job status request failed: ${response.status} ${response.statusText}`);
+            }
+
+            const job = await response.json();
+            if (job.status === 'done') {
+                return job;
+            }
+            if (job.status === 'failed') {
+                throw new Error(`Print job ${id} failed after ${job.sent} of ${job.total} bytes`);
+            }
+            await new Promise(resolve => setTimeout(resolve, pollInterval));
+        }
+    }
+}
+
+/**
+ * Credit-based WebSocket print job. The bridge grants credits as absolute
+ * byte offsets; write() never sends past the latest one, so the ESP32 never
+ * has to buffer more than its job buffer holds.
+ */
+class WebSocketPrintStream {
+    constructor(url, printer = null, frameSize = 4096) {
+        this.url = url;
+        this.printer = printer;
+        this.frameSize = frameSize;
+        this.socket = null;
+        this.jobId = null;
+        this.sent = 0;
+        this.credit = 0;
+        this.error = null;
+        this.ended = null;
+        this.waiters = [];
+    }
+
+    open() {
+        return new Promise((resolve, reject) => {
+            this.socket = new WebSocket(this.url);
+            this.socket.binaryType = 'arraybuffer';
+            this.socket.onopen = () => this.socket.send(this.printer ? `start ${this.printer}` : 'start');
+            this.socket.onerror = () => reject(new Error('WebSocket connection failed'));
+            this.socket.onclose = () => {
+                if (!this.error) this.error = new Error('WebSocket closed');
+                this.wake();
+            };
+            this.socket.onmessage = (event) => {
+                const message = JSON.parse(event.data);
+                if (message.type === 'job') {
+                    this.jobId = message.id;
+                    this.credit = message.credit;
+                    resolve();
+                } else if (message.type === 'credit') {
+                    this.credit = Math.max(this.credit, message.credit);
+                } else if (message.type === 'error') {
+                    const retryHint = message.retryAfter ? ` (retry after ${message.retryAfter} s)` : '';
+                    this.error = new Error(`Print stream failed: ${message.message}${retryHint}`);
+                    reject(this.error);
+                } else if (message.type === 'end') {
+                    this.ended = message;
+                }
+                this.wake();
+            };
+        });
+    }
+
+    wake() {
+        const waiters = this.waiters;
+        this.waiters = [];
+        waiters.forEach(resolve => resolve());
+    }
+
+    waitForMessage() {
+        return new Promise(resolve => this.waiters.push(resolve));
+    }
+
+    async write(data) {
+        const bytes = data instanceof Uint8Array ? data : new Uint8Array(data);
+        let offset = 0;
+        while (offset < bytes.length) {
+            if (this.error) throw this.error;
+            const allowed = Math.min(this.credit - this.sent, this.frameSize, bytes.length - offset);
+            if (allowed <= 0) {
+                await this.waitForMessage();
+                continue;
+            }
+            this.socket.send(bytes.subarray(offset, offset + allowed));
+            offset += allowed;
+            this.sent += allowed;
+        }
+    }
+
+    // Finish the job and wait until the bridge has taken all of it
+    async close() {
+        if (this.error) throw this.error;
+        this.socket.send('end');
+        while (!this.ended && !this.error) {
+            await this.waitForMessage();
+        }
+        const ended = this.ended;
+        this.socket.close();
+        if (!ended) throw this.error;
+        return ended;
+    }
+
+    abort() {
+        if (this.socket && this.socket.readyState === WebSocket.OPEN) {
+            this.socket.send('abort');
+            this.socket.close();
+        }
+    }
+}
@@ -11,7 +11,7 @@ const ImageProcessing = {
      * @param {boolean} invert - Whether to invert colors (default true for black text on white paper)
      * @returns {Promise<Array<{pixels: Uint8Array, width: number, height: number}>>}
      */
-    async processPdf(file, widthDots, rotate, invert) {
+    async processPdf(file, widthDots, rotate, invert, onPage = null) {
         const arrayBuffer = await file.arrayBuffer();
         const pdf = await pdfjsLib.getDocument(arrayBuffer).promise;
         const pages = [];
@@ -74,12 +74,18 @@ const ImageProcessing = {
                 }
             }
 
-            pages.push({
+            const processed = {
                 pixels: finalPixels,
                 width: paddedWidth,
                 height: height,
                 originalWidth: width // Keep track of original width if needed
-            });
+            };
+            pages.push(processed);
+
+            // Let the caller consume each page as soon as it is rendered
+            if (onPage) {
+                await onPage(processed, i - 1);
+            }
         }
         return pages;
     },